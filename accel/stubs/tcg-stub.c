@@ -16,6 +16,9 @@
 #include "tcg/tcg.h"
 #include "exec/cpu-common.h"
 #include "exec/exec-all.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-misc.h"
+#include "sysemu/stats.h"
 
 void tb_flush(CPUState *cpu)
 {
@@ -24,3 +27,17 @@ void tb_flush(CPUState *cpu)
 void tlb_set_dirty(CPUState *cpu, target_ulong vaddr)
 {
 }
+
+TlbStatsList *qmp_query_tlb_stats(Error **errp)
+{
+    error_setg(errp, "TLB statistics are only available with accel=tcg");
+    return NULL;
+}
+
+void tlb_collect_stats(StatsResultList ***tail)
+{
+}
+
+void tb_cache_collect_stats(StatsResultList ***tail)
+{
+}
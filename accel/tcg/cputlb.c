@@ -32,6 +32,10 @@
 #include "exec/log.h"
 #include "exec/helper-proto.h"
 #include "qemu/atomic.h"
+#include "qemu/timer.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-misc.h"
+#include "sysemu/stats.h"
 
 /* DEBUG defines, enable DEBUG_TLB_LOG to log to the CPU_LOG_MMU target */
 /* #define DEBUG_TLB */
@@ -73,6 +77,267 @@ QEMU_BUILD_BUG_ON(sizeof(target_ulong) > sizeof(run_on_cpu_data));
 QEMU_BUILD_BUG_ON(NB_MMU_MODES > 16);
 #define ALL_MMUIDX_BITS ((1 << NB_MMU_MODES) - 1)
 
+/* Statistics are only written by the owning vCPU, but may be read
+ * from the monitor at any time.
+ */
+#define tlb_stat_inc(env, field) \
+    atomic_set(&(env)->tlb_stats.field, (env)->tlb_stats.field + 1)
+
+static inline bool tlb_entry_is_empty(const CPUTLBEntry *te)
+{
+    return te->addr_read == -1 && te->addr_write == -1 && te->addr_code == -1;
+}
+
+/* Return the page that a non-empty entry translates.  */
+static inline target_ulong tlb_entry_page(const CPUTLBEntry *te)
+{
+    target_ulong addr = te->addr_read;
+
+    if (addr == -1) {
+        addr = te->addr_write;
+    }
+    if (addr == -1) {
+        addr = te->addr_code;
+    }
+    return addr & TARGET_PAGE_MASK;
+}
+
+/* Return the first victim tlb slot of the set that may hold @page.
+ * Pages that collide in the main table differ only in their high bits,
+ * so the set is taken from a multiplicative hash of the whole page
+ * number rather than from its low bits.
+ */
+static inline size_t tlb_vtlb_set(target_ulong page)
+{
+#if CPU_VTLB_SET_BITS == 0
+    return 0;
+#else
+    uint64_t h = (uint64_t)(page >> TARGET_PAGE_BITS) *
+                 0x9e3779b97f4a7c15ull;
+
+    return (h >> (64 - CPU_VTLB_SET_BITS)) * CPU_VTLB_WAYS;
+#endif
+}
+
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+/* Window over which the use rate of a TLB is observed before shrinking. */
+#define TLB_WINDOW_NS (100 * 1000 * 1000)
+
+static inline size_t sizeof_tlb(CPUArchState *env, uintptr_t mmu_idx)
+{
+    return env->tlb_mask[mmu_idx] + (1 << CPU_TLB_ENTRY_BITS);
+}
+
+static inline void tlb_table_lock(CPUArchState *env)
+{
+    qemu_spin_lock(&env->tlb_lock);
+}
+
+static inline void tlb_table_unlock(CPUArchState *env)
+{
+    qemu_spin_unlock(&env->tlb_lock);
+}
+
+static void tlb_window_reset(CPUTLBDesc *desc, int64_t ns,
+                             size_t max_entries)
+{
+    desc->window_begin_ns = ns;
+    desc->window_max_entries = max_entries;
+}
+
+static void tlb_dyn_init(CPUArchState *env)
+{
+    int i;
+
+    qemu_spin_init(&env->tlb_lock);
+    for (i = 0; i < NB_MMU_MODES; i++) {
+        CPUTLBDesc *desc = &env->tlb_d[i];
+        size_t n_entries = 1 << CPU_TLB_DYN_DEFAULT_BITS;
+
+        tlb_window_reset(desc, get_clock_realtime(), 0);
+        desc->n_used_entries = 0;
+        env->tlb_mask[i] = (n_entries - 1) << CPU_TLB_ENTRY_BITS;
+        env->tlb_table[i] = g_new(CPUTLBEntry, n_entries);
+        env->iotlb[i] = g_new(CPUIOTLBEntry, n_entries);
+        memset(env->tlb_table[i], -1, sizeof_tlb(env, i));
+    }
+}
+
+static void tlb_dyn_destroy(CPUArchState *env)
+{
+    int i;
+
+    for (i = 0; i < NB_MMU_MODES; i++) {
+        g_free(env->tlb_table[i]);
+        g_free(env->iotlb[i]);
+        env->tlb_table[i] = NULL;
+        env->iotlb[i] = NULL;
+    }
+}
+
+/*
+ * Resize the TLB of @mmu_idx if its use since the last flush warrants it.
+ * Called with tlb_lock held, right before the table is flushed.
+ *
+ * The TLB is doubled as soon as more than 70% of it was in use at the
+ * time of a flush, up to CPU_TLB_DYN_MAX_BITS.  It is shrunk only if
+ * less than 30% of it was used during a whole window of TLB_WINDOW_NS,
+ * to the smallest size that keeps the observed maximum under 70%; this
+ * keeps a busy guest that flushes often from shrinking its TLB only to
+ * grow it back right after.
+ */
+static void tlb_mmu_resize_locked(CPUArchState *env, int mmu_idx)
+{
+    CPUTLBDesc *desc = &env->tlb_d[mmu_idx];
+    size_t old_size = tlb_n_entries(env, mmu_idx);
+    size_t max_size = (size_t)1 << MIN(CPU_TLB_DYN_MAX_BITS,
+                                       TARGET_LONG_BITS - TARGET_PAGE_BITS);
+    size_t new_size = old_size;
+    size_t rate;
+    int64_t now = get_clock_realtime();
+    bool window_expired = now > desc->window_begin_ns + TLB_WINDOW_NS;
+
+    if (desc->n_used_entries > desc->window_max_entries) {
+        desc->window_max_entries = desc->n_used_entries;
+    }
+    rate = desc->window_max_entries * 100 / old_size;
+
+    if (rate > 70) {
+        new_size = MIN(old_size << 1, max_size);
+    } else if (rate < 30 && window_expired) {
+        size_t ceil = pow2ceil(desc->window_max_entries);
+        size_t expected_rate = desc->window_max_entries * 100 / ceil;
+
+        /* Avoid shrinking to a size that would be grown again at once. */
+        if (expected_rate > 70) {
+            ceil *= 2;
+        }
+        new_size = MAX(ceil, 1 << CPU_TLB_DYN_MIN_BITS);
+    }
+
+    if (new_size == old_size) {
+        if (window_expired) {
+            tlb_window_reset(desc, now, desc->n_used_entries);
+        }
+        return;
+    }
+
+    g_free(env->tlb_table[mmu_idx]);
+    g_free(env->iotlb[mmu_idx]);
+
+    tlb_window_reset(desc, now, 0);
+    /* desc->n_used_entries is cleared by the caller */
+    env->tlb_mask[mmu_idx] = (new_size - 1) << CPU_TLB_ENTRY_BITS;
+    env->tlb_table[mmu_idx] = g_try_new(CPUTLBEntry, new_size);
+    env->iotlb[mmu_idx] = g_try_new(CPUIOTLBEntry, new_size);
+    /*
+     * If the allocations fail, try smaller sizes.  We just freed some
+     * memory, so going back to half of new_size has a good chance of
+     * working.  Increased memory pressure elsewhere in the system might
+     * cause the allocations to fail though, so we progressively reduce
+     * the allocation size, aborting if we cannot even allocate the
+     * smallest TLB we support.
+     */
+    while (env->tlb_table[mmu_idx] == NULL || env->iotlb[mmu_idx] == NULL) {
+        if (new_size == (1 << CPU_TLB_DYN_MIN_BITS)) {
+            error_report("%s: %s", __func__, strerror(errno));
+            abort();
+        }
+        new_size = MAX(new_size >> 1, 1 << CPU_TLB_DYN_MIN_BITS);
+        env->tlb_mask[mmu_idx] = (new_size - 1) << CPU_TLB_ENTRY_BITS;
+
+        g_free(env->tlb_table[mmu_idx]);
+        g_free(env->iotlb[mmu_idx]);
+        env->tlb_table[mmu_idx] = g_try_new(CPUTLBEntry, new_size);
+        env->iotlb[mmu_idx] = g_try_new(CPUIOTLBEntry, new_size);
+    }
+}
+
+static void tlb_table_flush_by_mmuidx(CPUArchState *env, int mmu_idx)
+{
+    tlb_table_lock(env);
+    tlb_mmu_resize_locked(env, mmu_idx);
+    memset(env->tlb_table[mmu_idx], -1, sizeof_tlb(env, mmu_idx));
+    env->tlb_d[mmu_idx].n_used_entries = 0;
+    tlb_table_unlock(env);
+}
+
+static inline void tlb_n_used_entries_inc(CPUArchState *env, uintptr_t mmu_idx)
+{
+    env->tlb_d[mmu_idx].n_used_entries++;
+}
+
+static inline void tlb_n_used_entries_dec(CPUArchState *env, uintptr_t mmu_idx)
+{
+    env->tlb_d[mmu_idx].n_used_entries--;
+}
+
+#else /* !TCG_TARGET_IMPLEMENTS_DYN_TLB */
+
+static inline void tlb_table_lock(CPUArchState *env)
+{
+}
+
+static inline void tlb_table_unlock(CPUArchState *env)
+{
+}
+
+static inline void tlb_dyn_init(CPUArchState *env)
+{
+}
+
+static inline void tlb_dyn_destroy(CPUArchState *env)
+{
+}
+
+static inline void tlb_table_flush_by_mmuidx(CPUArchState *env, int mmu_idx)
+{
+    memset(env->tlb_table[mmu_idx], -1, sizeof(env->tlb_table[0]));
+}
+
+static inline void tlb_n_used_entries_inc(CPUArchState *env, uintptr_t mmu_idx)
+{
+}
+
+static inline void tlb_n_used_entries_dec(CPUArchState *env, uintptr_t mmu_idx)
+{
+}
+#endif /* TCG_TARGET_IMPLEMENTS_DYN_TLB */
+
+static inline void tlb_large_page_reset(CPUArchState *env, int mmu_idx)
+{
+    env->tlb_large_page_addr[mmu_idx] = -1;
+    env->tlb_large_page_mask[mmu_idx] = 0;
+}
+
+/* Flush the main and victim tables of one MMU mode.  */
+static void tlb_flush_one_mmuidx(CPUArchState *env, int mmu_idx)
+{
+    tlb_table_flush_by_mmuidx(env, mmu_idx);
+    memset(env->tlb_v_table[mmu_idx], -1, sizeof(env->tlb_v_table[0]));
+    tlb_large_page_reset(env, mmu_idx);
+}
+
+void tlb_init(CPUState *cpu)
+{
+    CPUArchState *env = cpu->env_ptr;
+    int mmu_idx;
+
+    tlb_dyn_init(env);
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        tlb_large_page_reset(env, mmu_idx);
+    }
+    /* Nothing is known about the initial contents; the first flush
+     * must clear everything.
+     */
+    env->tlb_dirty = ALL_MMUIDX_BITS;
+}
+
+void tlb_destroy(CPUState *cpu)
+{
+    tlb_dyn_destroy(cpu->env_ptr);
+}
+
 /* flush_all_helper: run fn across all cpus
  *
  * If the wait flag is set then the src cpu's helper will be queued as
@@ -105,6 +370,62 @@ size_t tlb_flush_count(void)
     return count;
 }
 
+TlbStatsList *qmp_query_tlb_stats(Error **errp)
+{
+    TlbStatsList *head = NULL, **tail = &head;
+    CPUState *cpu;
+
+    if (!tcg_enabled()) {
+        error_setg(errp, "TLB statistics are only available with accel=tcg");
+        return NULL;
+    }
+
+    CPU_FOREACH(cpu) {
+        CPUArchState *env = cpu->env_ptr;
+        TlbStatsList *info = g_new0(TlbStatsList, 1);
+        TlbStats *value = g_new0(TlbStats, 1);
+
+        value->cpu_index = cpu->cpu_index;
+        value->fills = atomic_read(&env->tlb_stats.fills);
+        value->victim_hits = atomic_read(&env->tlb_stats.victim_hits);
+        value->misses = atomic_read(&env->tlb_stats.misses);
+        value->flushes = atomic_read(&env->tlb_flush_count);
+        value->partial_flushes = atomic_read(&env->tlb_stats.partial_flushes);
+        value->elided_flushes = atomic_read(&env->tlb_stats.elided_flushes);
+
+        info->value = value;
+        *tail = info;
+        tail = &info->next;
+    }
+    return head;
+}
+
+void tlb_collect_stats(StatsResultList ***tail)
+{
+    CPUState *cpu;
+
+    if (!tcg_enabled()) {
+        return;
+    }
+
+    CPU_FOREACH(cpu) {
+        CPUArchState *env = cpu->env_ptr;
+        char *id = g_strdup_printf("%d", cpu->cpu_index);
+        StatsResult *result = stats_result_add(tail, STATS_TARGET_TLB, id);
+
+        stats_add(result, "fills", atomic_read(&env->tlb_stats.fills));
+        stats_add(result, "victim-hits",
+                  atomic_read(&env->tlb_stats.victim_hits));
+        stats_add(result, "misses", atomic_read(&env->tlb_stats.misses));
+        stats_add(result, "flushes", atomic_read(&env->tlb_flush_count));
+        stats_add(result, "partial-flushes",
+                  atomic_read(&env->tlb_stats.partial_flushes));
+        stats_add(result, "elided-flushes",
+                  atomic_read(&env->tlb_stats.elided_flushes));
+        g_free(id);
+    }
+}
+
 /* This is OK because CPU architectures generally permit an
  * implementation to drop entries from the TLB at any time, so
  * flushing more entries than required is only an efficiency issue,
@@ -113,6 +434,7 @@ size_t tlb_flush_count(void)
 static void tlb_flush_nocheck(CPUState *cpu)
 {
     CPUArchState *env = cpu->env_ptr;
+    int mmu_idx;
 
     /* The QOM tests will trigger tlb_flushes without setting up TCG
      * so we bug out here in that case.
@@ -124,14 +446,22 @@ static void tlb_flush_nocheck(CPUState *cpu)
     assert_cpu_is_self(cpu);
     atomic_set(&env->tlb_flush_count, env->tlb_flush_count + 1);
     tlb_debug("(count: %zu)\n", tlb_flush_count());
+    if (!env->tlb_dirty) {
+        tlb_stat_inc(env, elided_flushes);
+    }
 
-    memset(env->tlb_table, -1, sizeof(env->tlb_table));
-    memset(env->tlb_v_table, -1, sizeof(env->tlb_v_table));
+    /* Only the MMU modes that were filled since their last flush need
+     * to be cleared; flush-heavy guests often flush an already clean TLB.
+     */
+    for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        if (env->tlb_dirty & (1 << mmu_idx)) {
+            tlb_flush_one_mmuidx(env, mmu_idx);
+        }
+    }
+    env->tlb_dirty = 0;
     cpu_tb_jmp_cache_clear(cpu);
 
     env->vtlb_index = 0;
-    env->tlb_flush_addr = -1;
-    env->tlb_flush_mask = 0;
 
     atomic_mb_set(&cpu->pending_tlb_flush, 0);
 }
@@ -178,13 +508,18 @@ static void tlb_flush_by_mmuidx_async_work(CPUState *cpu, run_on_cpu_data data)
 
     tlb_debug("start: mmu_idx:0x%04lx\n", mmu_idx_bitmask);
 
+    tlb_stat_inc(env, partial_flushes);
+
+    /* Skip the MMU modes that are already clean.  */
+    mmu_idx_bitmask &= env->tlb_dirty;
+    env->tlb_dirty &= ~mmu_idx_bitmask;
+
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
 
         if (test_bit(mmu_idx, &mmu_idx_bitmask)) {
             tlb_debug("%d\n", mmu_idx);
 
-            memset(env->tlb_table[mmu_idx], -1, sizeof(env->tlb_table[0]));
-            memset(env->tlb_v_table[mmu_idx], -1, sizeof(env->tlb_v_table[0]));
+            tlb_flush_one_mmuidx(env, mmu_idx);
         }
     }
 
@@ -243,51 +578,77 @@ static inline bool tlb_hit_page_anyprot(CPUTLBEntry *tlb_entry,
            tlb_hit_page(tlb_entry->addr_code, page);
 }
 
-static inline void tlb_flush_entry(CPUTLBEntry *tlb_entry, target_ulong page)
+/* Return true if the entry was for @page and has been cleared.  */
+static inline bool tlb_flush_entry(CPUTLBEntry *tlb_entry, target_ulong page)
 {
     if (tlb_hit_page_anyprot(tlb_entry, page)) {
         memset(tlb_entry, -1, sizeof(*tlb_entry));
+        return true;
     }
+    return false;
 }
 
 static inline void tlb_flush_vtlb_page(CPUArchState *env, int mmu_idx,
                                        target_ulong page)
 {
+    size_t set = tlb_vtlb_set(page);
     int k;
-    for (k = 0; k < CPU_VTLB_SIZE; k++) {
-        tlb_flush_entry(&env->tlb_v_table[mmu_idx][k], page);
+
+    for (k = 0; k < CPU_VTLB_WAYS; k++) {
+        tlb_flush_entry(&env->tlb_v_table[mmu_idx][set + k], page);
     }
 }
 
+/* Flush @page from the TLB of @mmu_idx.  If @page is covered by the
+ * large pages that were installed in this MMU mode, only the mode
+ * itself is flushed completely; the other modes are left alone.
+ * Return true in that case.
+ */
+static bool tlb_flush_page_mmuidx(CPUArchState *env, int mmu_idx,
+                                  target_ulong page)
+{
+    target_ulong lp_addr = env->tlb_large_page_addr[mmu_idx];
+    target_ulong lp_mask = env->tlb_large_page_mask[mmu_idx];
+
+    if ((page & lp_mask) == lp_addr) {
+        tlb_debug("forcing flush of mmu_idx %d ("
+                  TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
+                  mmu_idx, lp_addr, lp_mask);
+
+        tlb_flush_one_mmuidx(env, mmu_idx);
+        env->tlb_dirty &= ~(1 << mmu_idx);
+        return true;
+    }
+
+    if (tlb_flush_entry(tlb_entry(env, mmu_idx, page), page)) {
+        tlb_n_used_entries_dec(env, mmu_idx);
+    }
+    tlb_flush_vtlb_page(env, mmu_idx, page);
+    return false;
+}
+
 static void tlb_flush_page_async_work(CPUState *cpu, run_on_cpu_data data)
 {
     CPUArchState *env = cpu->env_ptr;
     target_ulong addr = (target_ulong) data.target_ptr;
-    int i;
+    bool flushed_mmuidx = false;
     int mmu_idx;
 
     assert_cpu_is_self(cpu);
 
     tlb_debug("page :" TARGET_FMT_lx "\n", addr);
 
-    /* Check if we need to flush due to large pages.  */
-    if ((addr & env->tlb_flush_mask) == env->tlb_flush_addr) {
-        tlb_debug("forcing full flush ("
-                  TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
-                  env->tlb_flush_addr, env->tlb_flush_mask);
-
-        tlb_flush(cpu);
-        return;
-    }
-
+    tlb_stat_inc(env, partial_flushes);
     addr &= TARGET_PAGE_MASK;
-    i = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
-        tlb_flush_entry(&env->tlb_table[mmu_idx][i], addr);
-        tlb_flush_vtlb_page(env, mmu_idx, addr);
+        flushed_mmuidx |= tlb_flush_page_mmuidx(env, mmu_idx, addr);
     }
 
-    tb_flush_jmp_cache(cpu, addr);
+    if (flushed_mmuidx) {
+        cpu_tb_jmp_cache_clear(cpu);
+    } else {
+        tb_flush_jmp_cache(cpu, addr);
+    }
 }
 
 void tlb_flush_page(CPUState *cpu, target_ulong addr)
@@ -314,44 +675,25 @@ static void tlb_flush_page_by_mmuidx_async_work(CPUState *cpu,
     target_ulong addr_and_mmuidx = (target_ulong) data.target_ptr;
     target_ulong addr = addr_and_mmuidx & TARGET_PAGE_MASK;
     unsigned long mmu_idx_bitmap = addr_and_mmuidx & ALL_MMUIDX_BITS;
-    int page = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
+    bool flushed_mmuidx = false;
     int mmu_idx;
 
     assert_cpu_is_self(cpu);
 
-    tlb_debug("page:%d addr:"TARGET_FMT_lx" mmu_idx:0x%lx\n",
-              page, addr, mmu_idx_bitmap);
+    tlb_debug("addr:"TARGET_FMT_lx" mmu_idx:0x%lx\n",
+              addr, mmu_idx_bitmap);
+    tlb_stat_inc(env, partial_flushes);
 
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
         if (test_bit(mmu_idx, &mmu_idx_bitmap)) {
-            tlb_flush_entry(&env->tlb_table[mmu_idx][page], addr);
-            tlb_flush_vtlb_page(env, mmu_idx, addr);
+            flushed_mmuidx |= tlb_flush_page_mmuidx(env, mmu_idx, addr);
         }
     }
 
-    tb_flush_jmp_cache(cpu, addr);
-}
-
-static void tlb_check_page_and_flush_by_mmuidx_async_work(CPUState *cpu,
-                                                          run_on_cpu_data data)
-{
-    CPUArchState *env = cpu->env_ptr;
-    target_ulong addr_and_mmuidx = (target_ulong) data.target_ptr;
-    target_ulong addr = addr_and_mmuidx & TARGET_PAGE_MASK;
-    unsigned long mmu_idx_bitmap = addr_and_mmuidx & ALL_MMUIDX_BITS;
-
-    tlb_debug("addr:"TARGET_FMT_lx" mmu_idx: %04lx\n", addr, mmu_idx_bitmap);
-
-    /* Check if we need to flush due to large pages.  */
-    if ((addr & env->tlb_flush_mask) == env->tlb_flush_addr) {
-        tlb_debug("forced full flush ("
-                  TARGET_FMT_lx "/" TARGET_FMT_lx ")\n",
-                  env->tlb_flush_addr, env->tlb_flush_mask);
-
-        tlb_flush_by_mmuidx_async_work(cpu,
-                                       RUN_ON_CPU_HOST_INT(mmu_idx_bitmap));
+    if (flushed_mmuidx) {
+        cpu_tb_jmp_cache_clear(cpu);
     } else {
-        tlb_flush_page_by_mmuidx_async_work(cpu, data);
+        tb_flush_jmp_cache(cpu, addr);
     }
 }
 
@@ -366,10 +708,10 @@ void tlb_flush_page_by_mmuidx(CPUState *cpu, target_ulong addr, uint16_t idxmap)
     addr_and_mmu_idx |= idxmap;
 
     if (!qemu_cpu_is_self(cpu)) {
-        async_run_on_cpu(cpu, tlb_check_page_and_flush_by_mmuidx_async_work,
+        async_run_on_cpu(cpu, tlb_flush_page_by_mmuidx_async_work,
                          RUN_ON_CPU_TARGET_PTR(addr_and_mmu_idx));
     } else {
-        tlb_check_page_and_flush_by_mmuidx_async_work(
+        tlb_flush_page_by_mmuidx_async_work(
             cpu, RUN_ON_CPU_TARGET_PTR(addr_and_mmu_idx));
     }
 }
@@ -377,7 +719,7 @@ void tlb_flush_page_by_mmuidx(CPUState *cpu, target_ulong addr, uint16_t idxmap)
 void tlb_flush_page_by_mmuidx_all_cpus(CPUState *src_cpu, target_ulong addr,
                                        uint16_t idxmap)
 {
-    const run_on_cpu_func fn = tlb_check_page_and_flush_by_mmuidx_async_work;
+    const run_on_cpu_func fn = tlb_flush_page_by_mmuidx_async_work;
     target_ulong addr_and_mmu_idx;
 
     tlb_debug("addr: "TARGET_FMT_lx" mmu_idx:%"PRIx16"\n", addr, idxmap);
@@ -394,7 +736,7 @@ void tlb_flush_page_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
                                                             target_ulong addr,
                                                             uint16_t idxmap)
 {
-    const run_on_cpu_func fn = tlb_check_page_and_flush_by_mmuidx_async_work;
+    const run_on_cpu_func fn = tlb_flush_page_by_mmuidx_async_work;
     target_ulong addr_and_mmu_idx;
 
     tlb_debug("addr: "TARGET_FMT_lx" mmu_idx:%"PRIx16"\n", addr, idxmap);
@@ -524,10 +866,13 @@ void tlb_reset_dirty(CPUState *cpu, ram_addr_t start1, ram_addr_t length)
     int mmu_idx;
 
     env = cpu->env_ptr;
+    /* The owning vCPU may be resizing its TLB concurrently.  */
+    tlb_table_lock(env);
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
         unsigned int i;
+        unsigned int n = tlb_n_entries(env, mmu_idx);
 
-        for (i = 0; i < CPU_TLB_SIZE; i++) {
+        for (i = 0; i < n; i++) {
             tlb_reset_dirty_range(&env->tlb_table[mmu_idx][i],
                                   start1, length);
         }
@@ -537,6 +882,7 @@ void tlb_reset_dirty(CPUState *cpu, ram_addr_t start1, ram_addr_t length)
                                   start1, length);
         }
     }
+    tlb_table_unlock(env);
 }
 
 static inline void tlb_set_dirty1(CPUTLBEntry *tlb_entry, target_ulong vaddr)
@@ -551,15 +897,13 @@ static inline void tlb_set_dirty1(CPUTLBEntry *tlb_entry, target_ulong vaddr)
 void tlb_set_dirty(CPUState *cpu, target_ulong vaddr)
 {
     CPUArchState *env = cpu->env_ptr;
-    int i;
     int mmu_idx;
 
     assert_cpu_is_self(cpu);
 
     vaddr &= TARGET_PAGE_MASK;
-    i = (vaddr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
-        tlb_set_dirty1(&env->tlb_table[mmu_idx][i], vaddr);
+        tlb_set_dirty1(tlb_entry(env, mmu_idx, vaddr), vaddr);
     }
 
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
@@ -571,26 +915,28 @@ void tlb_set_dirty(CPUState *cpu, target_ulong vaddr)
 }
 
 /* Our TLB does not support large pages, so remember the area covered by
-   large pages and trigger a full TLB flush if these are invalidated.  */
-static void tlb_add_large_page(CPUArchState *env, target_ulong vaddr,
-                               target_ulong size)
+   large pages in each MMU mode and flush that whole mode if any page of
+   the area is invalidated.  */
+static void tlb_add_large_page(CPUArchState *env, int mmu_idx,
+                               target_ulong vaddr, target_ulong size)
 {
+    target_ulong lp_addr = env->tlb_large_page_addr[mmu_idx];
     target_ulong mask = ~(size - 1);
 
-    if (env->tlb_flush_addr == (target_ulong)-1) {
-        env->tlb_flush_addr = vaddr & mask;
-        env->tlb_flush_mask = mask;
+    if (lp_addr == (target_ulong)-1) {
+        env->tlb_large_page_addr[mmu_idx] = vaddr & mask;
+        env->tlb_large_page_mask[mmu_idx] = mask;
         return;
     }
     /* Extend the existing region to include the new page.
        This is a compromise between unnecessary flushes and the cost
        of maintaining a full variable size TLB.  */
-    mask &= env->tlb_flush_mask;
-    while (((env->tlb_flush_addr ^ vaddr) & mask) != 0) {
+    mask &= env->tlb_large_page_mask[mmu_idx];
+    while (((lp_addr ^ vaddr) & mask) != 0) {
         mask <<= 1;
     }
-    env->tlb_flush_addr &= mask;
-    env->tlb_flush_mask = mask;
+    env->tlb_large_page_addr[mmu_idx] = lp_addr & mask;
+    env->tlb_large_page_mask[mmu_idx] = mask;
 }
 
 /* Add a new TLB entry. At most one entry for a given virtual address
@@ -621,7 +967,7 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
         sz = TARGET_PAGE_SIZE;
     } else {
         if (size > TARGET_PAGE_SIZE) {
-            tlb_add_large_page(env, vaddr, size);
+            tlb_add_large_page(env, mmu_idx, vaddr, size);
         }
         sz = size;
     }
@@ -661,15 +1007,21 @@ void tlb_set_page_with_attrs(CPUState *cpu, target_ulong vaddr,
     iotlb = memory_region_section_get_iotlb(cpu, section, vaddr_page,
                                             paddr_page, xlat, prot, &address);
 
-    index = (vaddr_page >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
-    te = &env->tlb_table[mmu_idx][index];
+    index = tlb_index(env, mmu_idx, vaddr_page);
+    te = tlb_entry(env, mmu_idx, vaddr_page);
+    env->tlb_dirty |= 1 << mmu_idx;
+    tlb_stat_inc(env, fills);
 
     /*
      * Only evict the old entry to the victim tlb if it's for a
      * different page; otherwise just overwrite the stale data.
+     * An empty entry has nothing to evict, but is now being used.
      */
-    if (!tlb_hit_page_anyprot(te, vaddr_page)) {
-        unsigned vidx = env->vtlb_index++ % CPU_VTLB_SIZE;
+    if (tlb_entry_is_empty(te)) {
+        tlb_n_used_entries_inc(env, mmu_idx);
+    } else if (!tlb_hit_page_anyprot(te, vaddr_page)) {
+        unsigned vidx = tlb_vtlb_set(tlb_entry_page(te)) +
+                        env->vtlb_index++ % CPU_VTLB_WAYS;
         CPUTLBEntry *tv = &env->tlb_v_table[mmu_idx][vidx];
 
         /* Evict the old entry into the victim tlb.  */
@@ -795,6 +1147,7 @@ static uint64_t io_readx(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
     hwaddr mr_offset;
     MemoryRegionSection *section;
     MemoryRegion *mr;
+    const MemoryRegionFastOps *fast_ops;
     uint64_t val;
     bool locked = false;
     MemTxResult r;
@@ -806,16 +1159,16 @@ static uint64_t io_readx(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
          * repeat the MMU check here. This tlb_fill() call might
          * longjump out if this access should cause a guest exception.
          */
-        int index;
+        CPUTLBEntry *entry;
         target_ulong tlb_addr;
 
         tlb_fill(cpu, addr, size, MMU_DATA_LOAD, mmu_idx, retaddr);
 
-        index = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
-        tlb_addr = env->tlb_table[mmu_idx][index].addr_read;
+        entry = tlb_entry(env, mmu_idx, addr);
+        tlb_addr = entry->addr_read;
         if (!(tlb_addr & ~(TARGET_PAGE_MASK | TLB_RECHECK))) {
             /* RAM access */
-            uintptr_t haddr = addr + env->tlb_table[mmu_idx][index].addend;
+            uintptr_t haddr = addr + entry->addend;
 
             return ldn_p((void *)haddr, size);
         }
@@ -832,6 +1185,11 @@ static uint64_t io_readx(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
 
     cpu->mem_io_vaddr = addr;
 
+    fast_ops = memory_region_fast_ops(mr, mr_offset, size);
+    if (fast_ops && fast_ops->read) {
+        return fast_ops->read(mr->opaque, mr_offset, size);
+    }
+
     if (mr->global_locking && !qemu_mutex_iothread_locked()) {
         qemu_mutex_lock_iothread();
         locked = true;
@@ -862,6 +1220,7 @@ static void io_writex(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
     hwaddr mr_offset;
     MemoryRegionSection *section;
     MemoryRegion *mr;
+    const MemoryRegionFastOps *fast_ops;
     bool locked = false;
     MemTxResult r;
 
@@ -872,16 +1231,16 @@ static void io_writex(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
          * repeat the MMU check here. This tlb_fill() call might
          * longjump out if this access should cause a guest exception.
          */
-        int index;
+        CPUTLBEntry *entry;
         target_ulong tlb_addr;
 
         tlb_fill(cpu, addr, size, MMU_DATA_STORE, mmu_idx, retaddr);
 
-        index = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
-        tlb_addr = env->tlb_table[mmu_idx][index].addr_write;
+        entry = tlb_entry(env, mmu_idx, addr);
+        tlb_addr = entry->addr_write;
         if (!(tlb_addr & ~(TARGET_PAGE_MASK | TLB_RECHECK))) {
             /* RAM access */
-            uintptr_t haddr = addr + env->tlb_table[mmu_idx][index].addend;
+            uintptr_t haddr = addr + entry->addend;
 
             stn_p((void *)haddr, size, val);
             return;
@@ -898,6 +1257,12 @@ static void io_writex(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
     cpu->mem_io_vaddr = addr;
     cpu->mem_io_pc = retaddr;
 
+    fast_ops = memory_region_fast_ops(mr, mr_offset, size);
+    if (fast_ops && fast_ops->write) {
+        fast_ops->write(mr->opaque, mr_offset, val, size);
+        return;
+    }
+
     if (mr->global_locking && !qemu_mutex_iothread_locked()) {
         qemu_mutex_lock_iothread();
         locked = true;
@@ -922,8 +1287,10 @@ static void io_writex(CPUArchState *env, CPUIOTLBEntry *iotlbentry,
 static bool victim_tlb_hit(CPUArchState *env, size_t mmu_idx, size_t index,
                            size_t elt_ofs, target_ulong page)
 {
+    size_t set = tlb_vtlb_set(page);
     size_t vidx;
-    for (vidx = 0; vidx < CPU_VTLB_SIZE; ++vidx) {
+
+    for (vidx = set; vidx < set + CPU_VTLB_WAYS; ++vidx) {
         CPUTLBEntry *vtlb = &env->tlb_v_table[mmu_idx][vidx];
         target_ulong cmp = *(target_ulong *)((uintptr_t)vtlb + elt_ofs);
 
@@ -931,6 +1298,9 @@ static bool victim_tlb_hit(CPUArchState *env, size_t mmu_idx, size_t index,
             /* Found entry in victim tlb, swap tlb and iotlb.  */
             CPUTLBEntry tmptlb, *tlb = &env->tlb_table[mmu_idx][index];
 
+            if (tlb_entry_is_empty(tlb)) {
+                tlb_n_used_entries_inc(env, mmu_idx);
+            }
             copy_tlb_helper(&tmptlb, tlb, false);
             copy_tlb_helper(tlb, vtlb, true);
             copy_tlb_helper(vtlb, &tmptlb, true);
@@ -938,9 +1308,28 @@ static bool victim_tlb_hit(CPUArchState *env, size_t mmu_idx, size_t index,
             CPUIOTLBEntry tmpio, *io = &env->iotlb[mmu_idx][index];
             CPUIOTLBEntry *vio = &env->iotlb_v[mmu_idx][vidx];
             tmpio = *io; *io = *vio; *vio = tmpio;
+
+            /* The displaced entry must live in the set of its own page,
+             * or a later flush of that page would not find it.
+             */
+            if (!tlb_entry_is_empty(vtlb)) {
+                size_t dset = tlb_vtlb_set(tlb_entry_page(vtlb));
+
+                if (dset != set) {
+                    size_t didx = dset + env->vtlb_index++ % CPU_VTLB_WAYS;
+
+                    copy_tlb_helper(&env->tlb_v_table[mmu_idx][didx], vtlb,
+                                    true);
+                    env->iotlb_v[mmu_idx][didx] = *vio;
+                    memset(&tmptlb, -1, sizeof(tmptlb));
+                    copy_tlb_helper(vtlb, &tmptlb, true);
+                }
+            }
+            tlb_stat_inc(env, victim_hits);
             return true;
         }
     }
+    tlb_stat_inc(env, misses);
     return false;
 }
 
@@ -956,7 +1345,8 @@ static bool victim_tlb_hit(CPUArchState *env, size_t mmu_idx, size_t index,
  */
 tb_page_addr_t get_page_addr_code(CPUArchState *env, target_ulong addr)
 {
-    int mmu_idx, index;
+    uintptr_t mmu_idx, index;
+    CPUTLBEntry *entry;
     void *p;
     MemoryRegion *mr;
     MemoryRegionSection *section;
@@ -964,29 +1354,32 @@ tb_page_addr_t get_page_addr_code(CPUArchState *env, target_ulong addr)
     CPUIOTLBEntry *iotlbentry;
     hwaddr physaddr, mr_offset;
 
-    index = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
     mmu_idx = cpu_mmu_index(env, true);
-    if (unlikely(!tlb_hit(env->tlb_table[mmu_idx][index].addr_code, addr))) {
+    index = tlb_index(env, mmu_idx, addr);
+    entry = tlb_entry(env, mmu_idx, addr);
+    if (unlikely(!tlb_hit(entry->addr_code, addr))) {
         if (!VICTIM_TLB_HIT(addr_code, addr)) {
             tlb_fill(ENV_GET_CPU(env), addr, 0, MMU_INST_FETCH, mmu_idx, 0);
+            index = tlb_index(env, mmu_idx, addr);
+            entry = tlb_entry(env, mmu_idx, addr);
         }
-        assert(tlb_hit(env->tlb_table[mmu_idx][index].addr_code, addr));
+        assert(tlb_hit(entry->addr_code, addr));
     }
 
-    if (unlikely(env->tlb_table[mmu_idx][index].addr_code & TLB_RECHECK)) {
+    if (unlikely(entry->addr_code & TLB_RECHECK)) {
         /*
          * This is a TLB_RECHECK access, where the MMU protection
          * covers a smaller range than a target page, and we must
          * repeat the MMU check here. This tlb_fill() call might
          * longjump out if this access should cause a guest exception.
          */
-        int index;
         target_ulong tlb_addr;
 
         tlb_fill(cpu, addr, 0, MMU_INST_FETCH, mmu_idx, 0);
 
-        index = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
-        tlb_addr = env->tlb_table[mmu_idx][index].addr_code;
+        index = tlb_index(env, mmu_idx, addr);
+        entry = tlb_entry(env, mmu_idx, addr);
+        tlb_addr = entry->addr_code;
         if (!(tlb_addr & ~(TARGET_PAGE_MASK | TLB_RECHECK))) {
             /* RAM access. We can't handle this, so for now just stop */
             cpu_abort(cpu, "Unable to handle guest executing from RAM within "
@@ -1036,7 +1429,7 @@ tb_page_addr_t get_page_addr_code(CPUArchState *env, target_ulong addr)
         report_bad_exec(cpu, addr);
         exit(1);
     }
-    p = (void *)((uintptr_t)addr + env->tlb_table[mmu_idx][index].addend);
+    p = (void *)((uintptr_t)addr + entry->addend);
     return qemu_ram_addr_from_host_nofail(p);
 }
 
@@ -1049,8 +1442,8 @@ tb_page_addr_t get_page_addr_code(CPUArchState *env, target_ulong addr)
 void probe_write(CPUArchState *env, target_ulong addr, int size, int mmu_idx,
                  uintptr_t retaddr)
 {
-    int index = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
-    target_ulong tlb_addr = env->tlb_table[mmu_idx][index].addr_write;
+    uintptr_t index = tlb_index(env, mmu_idx, addr);
+    target_ulong tlb_addr = tlb_entry(env, mmu_idx, addr)->addr_write;
 
     if (!tlb_hit(tlb_addr, addr)) {
         /* TLB entry is for a different page */
@@ -1068,8 +1461,8 @@ static void *atomic_mmu_lookup(CPUArchState *env, target_ulong addr,
                                NotDirtyInfo *ndi)
 {
     size_t mmu_idx = get_mmuidx(oi);
-    size_t index = (addr >> TARGET_PAGE_BITS) & (CPU_TLB_SIZE - 1);
-    CPUTLBEntry *tlbe = &env->tlb_table[mmu_idx][index];
+    size_t index = tlb_index(env, mmu_idx, addr);
+    CPUTLBEntry *tlbe = tlb_entry(env, mmu_idx, addr);
     target_ulong tlb_addr = tlbe->addr_write;
     TCGMemOp mop = get_memop(oi);
     int a_bits = get_alignment_bits(mop);
@@ -1100,6 +1493,8 @@ static void *atomic_mmu_lookup(CPUArchState *env, target_ulong addr,
         if (!VICTIM_TLB_HIT(addr_write, addr)) {
             tlb_fill(ENV_GET_CPU(env), addr, 1 << s_bits, MMU_DATA_STORE,
                      mmu_idx, retaddr);
+            index = tlb_index(env, mmu_idx, addr);
+            tlbe = tlb_entry(env, mmu_idx, addr);
         }
         tlb_addr = tlbe->addr_write & ~TLB_INVALID_MASK;
     }
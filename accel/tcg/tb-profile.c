@@ -0,0 +1,377 @@
+/*
+ * Per-TB execution profiler
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "cpu.h"
+#include "disas/disas.h"
+#include "exec/exec-all.h"
+#include "exec/tb-profile.h"
+#include "qapi/error.h"
+#include "qemu/thread.h"
+#include "tcg.h"
+#include "translate-all.h"
+#include "elf.h"
+
+bool tb_profile_enabled;
+
+void tb_profile_start(void)
+{
+    atomic_set(&tb_profile_enabled, true);
+    if (first_cpu) {
+        tb_flush(first_cpu);
+    }
+}
+
+void tb_profile_stop(void)
+{
+    atomic_set(&tb_profile_enabled, false);
+    if (first_cpu) {
+        tb_flush(first_cpu);
+    }
+}
+
+/* A copy of the interesting fields, so that TBs can go away meanwhile */
+typedef struct TBProfileEntry {
+    target_ulong pc;
+    const void *host;
+    uint64_t exec_count;
+    uint32_t exit_count[TB_EXIT_MASK + 1];
+    uint16_t size;
+    uint16_t icount;
+    uint32_t host_size;
+    char chain[3];
+} TBProfileEntry;
+
+static char tb_profile_chain_state(TranslationBlock *tb, int n)
+{
+    if (tb->jmp_reset_offset[n] == TB_JMP_RESET_OFFSET_INVALID) {
+        return '-';
+    }
+    return atomic_read(&tb->jmp_dest[n]) & ~(uintptr_t)1 ? 'C' : 'u';
+}
+
+static gboolean tb_profile_collect(gpointer key, gpointer value,
+                                   gpointer data)
+{
+    TranslationBlock *tb = value;
+    GArray *entries = data;
+    TBProfileEntry e;
+    int i;
+
+    /* The generated code does not update exec_count atomically either */
+    e.exec_count = tb->exec_count;
+    if (!e.exec_count) {
+        return false;
+    }
+    e.pc = tb->pc;
+    e.host = tb->tc.ptr;
+    for (i = 0; i <= TB_EXIT_MASK; i++) {
+        e.exit_count[i] = atomic_read(&tb->exit_count[i]);
+    }
+    e.size = tb->size;
+    e.icount = tb->icount;
+    e.host_size = tb->tc.size;
+    e.chain[0] = tb_profile_chain_state(tb, 0);
+    e.chain[1] = tb_profile_chain_state(tb, 1);
+    e.chain[2] = '\0';
+    g_array_append_val(entries, e);
+    return false;
+}
+
+static gint tb_profile_cmp(gconstpointer a, gconstpointer b)
+{
+    const TBProfileEntry *ea = a, *eb = b;
+
+    if (ea->exec_count != eb->exec_count) {
+        return ea->exec_count < eb->exec_count ? 1 : -1;
+    }
+    return ea->pc < eb->pc ? -1 : ea->pc > eb->pc;
+}
+
+void tb_profile_dump(FILE *f, fprintf_function cpu_fprintf, int max)
+{
+    GArray *entries = g_array_new(false, false, sizeof(TBProfileEntry));
+    uint64_t total = 0;
+    guint i;
+
+    if (!atomic_read(&tb_profile_enabled)) {
+        cpu_fprintf(f, "TB profiler is not running\n");
+        g_array_free(entries, true);
+        return;
+    }
+
+    tcg_tb_foreach(tb_profile_collect, entries);
+    g_array_sort(entries, tb_profile_cmp);
+    for (i = 0; i < entries->len; i++) {
+        total += g_array_index(entries, TBProfileEntry, i).exec_count;
+    }
+
+    cpu_fprintf(f, "%u TBs executed, %" PRIu64 " TB executions\n",
+                entries->len, total);
+    cpu_fprintf(f, "exits: jmp0/jmp1 = left through goto_tb 0/1, "
+                "req = exit request; chain: C = chained, u = unchained, "
+                "- = no direct jump\n");
+    cpu_fprintf(f, "%-18s %12s %6s %5s %5s %5s %10s %10s %10s %5s  %s\n",
+                "guest pc", "execs", "%", "insns", "gsize", "hsize",
+                "jmp0", "jmp1", "req", "chain", "symbol");
+    for (i = 0; i < entries->len && i < max; i++) {
+        TBProfileEntry *e = &g_array_index(entries, TBProfileEntry, i);
+
+        cpu_fprintf(f, "0x" TARGET_FMT_lx "%*s %12" PRIu64 " %6.2f"
+                    " %5u %5u %5u %10u %10u %10u %5s  %s\n",
+                    e->pc, (int)(16 - sizeof(target_ulong) * 2), "",
+                    e->exec_count, e->exec_count * 100.0 / total,
+                    e->icount, e->size, e->host_size,
+                    e->exit_count[TB_EXIT_IDX0],
+                    e->exit_count[TB_EXIT_IDX1],
+                    e->exit_count[TB_EXIT_REQUESTED],
+                    e->chain, lookup_symbol(e->pc));
+    }
+    g_array_free(entries, true);
+}
+
+#ifdef CONFIG_LINUX
+/*
+ * See tools/perf/Documentation/jitdump-specification.txt in Linux.
+ */
+#define JITDUMP_MAGIC     0x4A695444
+#define JITDUMP_VERSION   1
+#define JIT_CODE_LOAD     0
+
+#if defined(__x86_64__)
+#define JITDUMP_ELF_MACH  EM_X86_64
+#elif defined(__i386__)
+#define JITDUMP_ELF_MACH  EM_386
+#elif defined(__aarch64__)
+#define JITDUMP_ELF_MACH  EM_AARCH64
+#elif defined(__arm__)
+#define JITDUMP_ELF_MACH  EM_ARM
+#elif defined(__powerpc64__)
+#define JITDUMP_ELF_MACH  EM_PPC64
+#elif defined(__powerpc__)
+#define JITDUMP_ELF_MACH  EM_PPC
+#elif defined(__s390x__)
+#define JITDUMP_ELF_MACH  EM_S390
+#elif defined(__mips__)
+#define JITDUMP_ELF_MACH  EM_MIPS
+#elif defined(__sparc__)
+#define JITDUMP_ELF_MACH  EM_SPARCV9
+#elif defined(__riscv)
+#define JITDUMP_ELF_MACH  EM_RISCV
+#else
+#define JITDUMP_ELF_MACH  EM_NONE
+#endif
+
+typedef struct JitDumpHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t total_size;
+    uint32_t elf_mach;
+    uint32_t pad1;
+    uint32_t pid;
+    uint64_t timestamp;
+    uint64_t flags;
+} JitDumpHeader;
+
+typedef struct JitDumpCodeLoad {
+    uint32_t id;
+    uint32_t total_size;
+    uint64_t timestamp;
+    uint32_t pid;
+    uint32_t tid;
+    uint64_t vma;
+    uint64_t code_addr;
+    uint64_t code_size;
+    uint64_t code_index;
+} JitDumpCodeLoad;
+
+/* Protects the perf files, jitdump_marker and jitdump_index */
+static QemuMutex perf_lock;
+static FILE *jitdump_file;
+static void *jitdump_marker;
+static uint64_t jitdump_index;
+static FILE *perfmap_file;
+
+static void __attribute__((constructor)) perf_init(void)
+{
+    qemu_mutex_init(&perf_lock);
+}
+
+/* perf timestamps samples with CLOCK_MONOTONIC when run with -k 1 */
+static uint64_t jitdump_timestamp(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+bool tb_profile_jitdump_open(const char *dir, Error **errp)
+{
+    JitDumpHeader hdr = {
+        .magic = JITDUMP_MAGIC,
+        .version = JITDUMP_VERSION,
+        .total_size = sizeof(hdr),
+        .elf_mach = JITDUMP_ELF_MACH,
+        .pid = getpid(),
+    };
+    size_t page_size = getpagesize();
+    char *path;
+    FILE *f;
+    void *marker;
+
+    path = g_strdup_printf("%s/jit-%d.dump", dir, (int)getpid());
+    f = fopen(path, "w+");
+    if (!f) {
+        error_setg_errno(errp, errno, "cannot create %s", path);
+        g_free(path);
+        return false;
+    }
+
+    /*
+     * perf finds the file through the PROT_EXEC mapping in its
+     * mmap records, so the mapping must stay until the file is closed.
+     */
+    marker = mmap(NULL, page_size, PROT_READ | PROT_EXEC, MAP_PRIVATE,
+                  fileno(f), 0);
+    if (marker == MAP_FAILED) {
+        error_setg_errno(errp, errno, "cannot map %s", path);
+        fclose(f);
+        g_free(path);
+        return false;
+    }
+    g_free(path);
+
+    hdr.timestamp = jitdump_timestamp();
+    fwrite(&hdr, sizeof(hdr), 1, f);
+
+    qemu_mutex_lock(&perf_lock);
+    if (jitdump_file) {
+        munmap(jitdump_marker, page_size);
+        fclose(jitdump_file);
+    }
+    jitdump_file = f;
+    jitdump_marker = marker;
+    qemu_mutex_unlock(&perf_lock);
+    return true;
+}
+
+void tb_profile_jitdump_close(void)
+{
+    qemu_mutex_lock(&perf_lock);
+    if (jitdump_file) {
+        munmap(jitdump_marker, getpagesize());
+        fclose(jitdump_file);
+        jitdump_file = NULL;
+    }
+    qemu_mutex_unlock(&perf_lock);
+}
+
+bool tb_profile_perfmap_open(Error **errp)
+{
+    char *path = g_strdup_printf("/tmp/perf-%d.map", (int)getpid());
+    FILE *f = fopen(path, "w");
+
+    if (!f) {
+        error_setg_errno(errp, errno, "cannot create %s", path);
+        g_free(path);
+        return false;
+    }
+    g_free(path);
+
+    qemu_mutex_lock(&perf_lock);
+    if (perfmap_file) {
+        fclose(perfmap_file);
+    }
+    perfmap_file = f;
+    qemu_mutex_unlock(&perf_lock);
+    return true;
+}
+
+void tb_profile_perfmap_close(void)
+{
+    qemu_mutex_lock(&perf_lock);
+    if (perfmap_file) {
+        fclose(perfmap_file);
+        perfmap_file = NULL;
+    }
+    qemu_mutex_unlock(&perf_lock);
+}
+
+static void jitdump_write(TranslationBlock *tb, const char *name)
+{
+    JitDumpCodeLoad rec;
+
+    rec.id = JIT_CODE_LOAD;
+    rec.total_size = sizeof(rec) + strlen(name) + 1 + tb->tc.size;
+    rec.timestamp = jitdump_timestamp();
+    rec.pid = getpid();
+    rec.tid = qemu_get_thread_id();
+    rec.vma = (uintptr_t)tb->tc.ptr;
+    rec.code_addr = (uintptr_t)tb->tc.ptr;
+    rec.code_size = tb->tc.size;
+    rec.code_index = jitdump_index++;
+
+    fwrite(&rec, sizeof(rec), 1, jitdump_file);
+    fwrite(name, strlen(name) + 1, 1, jitdump_file);
+    fwrite(tb->tc.ptr, tb->tc.size, 1, jitdump_file);
+}
+
+void tb_profile_code_load(TranslationBlock *tb)
+{
+    char name[64];
+    const char *sym;
+
+    if (likely(!atomic_read(&jitdump_file) && !atomic_read(&perfmap_file))) {
+        return;
+    }
+
+    sym = lookup_symbol(tb->pc);
+    snprintf(name, sizeof(name), "guest_" TARGET_FMT_lx "%s%s",
+             tb->pc, *sym ? "_" : "", sym);
+
+    qemu_mutex_lock(&perf_lock);
+    if (jitdump_file) {
+        jitdump_write(tb, name);
+    }
+    if (perfmap_file) {
+        /*
+         * The map has no timestamps, so when a region is reused perf
+         * may still show the TB that lived there before.
+         */
+        fprintf(perfmap_file, "%" PRIxPTR " %x %s\n",
+                (uintptr_t)tb->tc.ptr, (unsigned)tb->tc.size, name);
+        fflush(perfmap_file);
+    }
+    qemu_mutex_unlock(&perf_lock);
+}
+#else
+bool tb_profile_jitdump_open(const char *dir, Error **errp)
+{
+    error_setg(errp, "perf jitdump is only supported on Linux hosts");
+    return false;
+}
+
+void tb_profile_jitdump_close(void)
+{
+}
+
+bool tb_profile_perfmap_open(Error **errp)
+{
+    error_setg(errp, "perf maps are only supported on Linux hosts");
+    return false;
+}
+
+void tb_profile_perfmap_close(void)
+{
+}
+
+void tb_profile_code_load(TranslationBlock *tb)
+{
+}
+#endif
@@ -153,8 +153,12 @@ void *HELPER(lookup_tb_ptr)(CPUArchState *env)
 
     tb = tb_lookup__cpu_state(cpu, &pc, &cs_base, &flags, curr_cflags());
     if (tb == NULL) {
+        atomic_set(&tcg_ctx->tb_lookup_ptr_miss_count,
+                   tcg_ctx->tb_lookup_ptr_miss_count + 1);
         return tcg_ctx->code_gen_epilogue;
     }
+    atomic_set(&tcg_ctx->tb_lookup_ptr_hit_count,
+               tcg_ctx->tb_lookup_ptr_hit_count + 1);
     qemu_log_mask_and_addr(CPU_LOG_EXEC, pc,
                            "Chain %d: %p ["
                            TARGET_FMT_lx "/" TARGET_FMT_lx "/%#x] %s\n",
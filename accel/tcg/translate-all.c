@@ -47,6 +47,7 @@
 #endif
 #else
 #include "exec/ram_addr.h"
+#include "sysemu/stats.h"
 #endif
 
 #include "exec/cputlb.h"
@@ -101,6 +102,10 @@
 
 #define SMC_BITMAP_USE_THRESHOLD 10
 
+/* Each page is split in SMC_LINES lines, 64 bytes with 4 KiB pages */
+#define SMC_LINES       64
+#define SMC_LINE_SHIFT  (TARGET_PAGE_BITS - 6)
+
 typedef struct PageDesc {
     /* list of TBs intersecting this ram page */
     uintptr_t first_tb;
@@ -109,6 +114,8 @@ typedef struct PageDesc {
        of lookups we do to a given page to use a bitmap */
     unsigned long *code_bitmap;
     unsigned int code_write_count;
+    /* lines that may hold code; set under the page lock, read without */
+    DECLARE_BITMAP(code_lines, SMC_LINES);
 #else
     unsigned long flags;
 #endif
@@ -557,6 +564,17 @@ static void page_lock_pair(PageDesc **ret_p1, tb_page_addr_t phys1,
 
 #define assert_page_locked(pd) tcg_debug_assert(have_mmap_lock())
 
+/*
+ * Incremented whenever guest mappings or the TBs of a page change; see
+ * tb_gen_code().  Protected by mmap_lock.
+ */
+static unsigned int page_code_gen;
+
+static inline void page_code_changed(void)
+{
+    page_code_gen++;
+}
+
 static inline void page_lock(PageDesc *pd)
 { }
 
@@ -649,6 +667,10 @@ static inline void page_unlock__debug(const PageDesc *pd)
 
 #endif /* CONFIG_DEBUG_TCG */
 
+/* Translation never drops the page locks in softmmu */
+static inline void page_code_changed(void)
+{ }
+
 static inline void page_lock(PageDesc *pd)
 {
     page_lock__debug(pd);
@@ -1182,6 +1204,13 @@ static inline void invalidate_page_bitmap(PageDesc *p)
     g_free(p->code_bitmap);
     p->code_bitmap = NULL;
     p->code_write_count = 0;
+    if (!p->first_tb) {
+        unsigned int i;
+
+        for (i = 0; i < BITS_TO_LONGS(SMC_LINES); i++) {
+            atomic_set(&p->code_lines[i], 0);
+        }
+    }
 #endif
 }
 
@@ -1265,6 +1294,46 @@ done:
     mmap_unlock();
 }
 
+static gboolean tb_evict_iter(gpointer key, gpointer value, gpointer data)
+{
+    TranslationBlock *tb = value;
+
+    tb_phys_invalidate(tb, -1);
+    return false;
+}
+
+/* Make room in the code buffer by evicting the oldest full region, and
+ * only flush everything if there is no such region.
+ */
+static void do_tb_evict(CPUState *cpu, run_on_cpu_data tb_flush_count)
+{
+    bool evicted;
+
+    mmap_lock();
+    /* A full flush in the meantime has already made room.  */
+    if (tb_ctx.tb_flush_count != tb_flush_count.host_int) {
+        mmap_unlock();
+        return;
+    }
+    evicted = tcg_region_evict(tb_evict_iter, NULL);
+    if (evicted) {
+        atomic_set(&tb_ctx.tb_evict_count, tb_ctx.tb_evict_count + 1);
+    }
+    mmap_unlock();
+
+    if (!evicted) {
+        do_tb_flush(cpu, tb_flush_count);
+    }
+}
+
+static void tb_evict(CPUState *cpu)
+{
+    unsigned tb_flush_count = atomic_mb_read(&tb_ctx.tb_flush_count);
+
+    async_safe_run_on_cpu(cpu, do_tb_evict,
+                          RUN_ON_CPU_HOST_INT(tb_flush_count));
+}
+
 void tb_flush(CPUState *cpu)
 {
     if (tcg_enabled()) {
@@ -1432,7 +1501,8 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
 {
     CPUState *cpu;
     PageDesc *p;
-    uint32_t h;
+    uint32_t h, l2;
+    int i;
     tb_page_addr_t phys_pc;
 
     assert_memory_lock();
@@ -1465,10 +1535,16 @@ static void do_tb_phys_invalidate(TranslationBlock *tb, bool rm_from_page_list)
 
     /* remove the TB from the hash list */
     h = tb_jmp_cache_hash_func(tb->pc);
+    l2 = tb_l2_cache_hash_func(tb->pc, tb->cs_base, tb->flags);
     CPU_FOREACH(cpu) {
         if (atomic_read(&cpu->tb_jmp_cache[h]) == tb) {
             atomic_set(&cpu->tb_jmp_cache[h], NULL);
         }
+        for (i = 0; i < TB_L2_CACHE_WAYS; i++) {
+            if (atomic_read(&cpu->tb_l2_cache[l2 + i]) == tb) {
+                atomic_set(&cpu->tb_l2_cache[l2 + i], NULL);
+            }
+        }
     }
 
     /* suppress this TB from the two jump lists */
@@ -1503,30 +1579,55 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
 }
 
 #ifdef CONFIG_SOFTMMU
+/* The part [@start, @end[ of its n-th page that @tb covers */
+static void tb_page_range(TranslationBlock *tb, int n, int *start, int *end)
+{
+    /* NOTE: this is subtle as a TB may span two physical pages */
+    if (n == 0) {
+        /* NOTE: tb_end may be after the end of the page, but
+           it is not a problem */
+        *start = tb->pc & ~TARGET_PAGE_MASK;
+        *end = *start + tb->size;
+        if (*end > TARGET_PAGE_SIZE) {
+            *end = TARGET_PAGE_SIZE;
+        }
+    } else {
+        *start = 0;
+        *end = ((tb->pc + tb->size) & ~TARGET_PAGE_MASK);
+    }
+}
+
+/* call with @p->lock held */
+static void page_set_code_lines(PageDesc *p, int start, int end)
+{
+    int line;
+
+    for (line = start >> SMC_LINE_SHIFT;
+         line <= (end - 1) >> SMC_LINE_SHIFT; line++) {
+        atomic_or(&p->code_lines[BIT_WORD(line)], BIT_MASK(line));
+    }
+}
+
 /* call with @p->lock held */
 static void build_page_bitmap(PageDesc *p)
 {
     int n, tb_start, tb_end;
     TranslationBlock *tb;
+    unsigned int i;
 
     assert_page_locked(p);
     p->code_bitmap = bitmap_new(TARGET_PAGE_SIZE);
+    /* drop the lines of TBs that were invalidated in the meantime */
+    for (i = 0; i < BITS_TO_LONGS(SMC_LINES); i++) {
+        atomic_set(&p->code_lines[i], 0);
+    }
 
     PAGE_FOR_EACH_TB(p, tb, n) {
-        /* NOTE: this is subtle as a TB may span two physical pages */
-        if (n == 0) {
-            /* NOTE: tb_end may be after the end of the page, but
-               it is not a problem */
-            tb_start = tb->pc & ~TARGET_PAGE_MASK;
-            tb_end = tb_start + tb->size;
-            if (tb_end > TARGET_PAGE_SIZE) {
-                tb_end = TARGET_PAGE_SIZE;
-             }
-        } else {
-            tb_start = 0;
-            tb_end = ((tb->pc + tb->size) & ~TARGET_PAGE_MASK);
+        tb_page_range(tb, n, &tb_start, &tb_end);
+        if (tb_end > tb_start) {
+            bitmap_set(p->code_bitmap, tb_start, tb_end - tb_start);
+            page_set_code_lines(p, tb_start, tb_end);
         }
-        bitmap_set(p->code_bitmap, tb_start, tb_end - tb_start);
     }
 }
 #endif
@@ -1552,6 +1653,16 @@ static inline void tb_page_add(PageDesc *p, TranslationBlock *tb,
 #endif
     p->first_tb = (uintptr_t)tb | n;
     invalidate_page_bitmap(p);
+#ifdef CONFIG_SOFTMMU
+    {
+        int start, end;
+
+        tb_page_range(tb, n, &start, &end);
+        if (end > start) {
+            page_set_code_lines(p, start, end);
+        }
+    }
+#endif
 
 #if defined(CONFIG_USER_ONLY)
     if (p->flags & PAGE_WRITE) {
@@ -1658,7 +1769,14 @@ tb_link_page(TranslationBlock *tb, tb_page_addr_t phys_pc,
     return tb;
 }
 
-/* Called with mmap_lock held for user mode emulation.  */
+/*
+ * Called with mmap_lock held for user mode emulation.
+ *
+ * In user mode the lock is dropped around tcg_gen_code() if a context of
+ * our own could be claimed, so that other threads can translate at the same
+ * time.  The guest code has already been read by then, but the mappings may
+ * change before the lock is taken again; if they did, translate again.
+ */
 TranslationBlock *tb_gen_code(CPUState *cpu,
                               target_ulong pc, target_ulong cs_base,
                               uint32_t flags, int cflags)
@@ -1669,19 +1787,38 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     target_ulong virt_page2;
     tcg_insn_unit *gen_code_buf;
     int gen_code_size, search_size;
+#ifdef CONFIG_USER_ONLY
+    bool parallel;
+    unsigned int gen;
+#endif
 #ifdef CONFIG_PROFILER
-    TCGProfile *prof = &tcg_ctx->prof;
+    TCGProfile *prof;
     int64_t ti;
 #endif
     assert_memory_lock();
 
+#ifdef CONFIG_USER_ONLY
+    parallel = tcg_ctx_claim();
+#endif
+#ifdef CONFIG_PROFILER
+    prof = &tcg_ctx->prof;
+#endif
     phys_pc = get_page_addr_code(env, pc);
 
  buffer_overflow:
+#ifdef CONFIG_USER_ONLY
+    if (!have_mmap_lock()) {
+        mmap_lock();
+    }
+    gen = page_code_gen;
+#endif
     tb = tb_alloc(pc);
     if (unlikely(!tb)) {
-        /* flush must be done */
-        tb_flush(cpu);
+        /* eviction or flush must be done */
+        tb_evict(cpu);
+#ifdef CONFIG_USER_ONLY
+        tcg_ctx_release();
+#endif
         mmap_unlock();
         /* Make the execution loop process the flush as soon as possible.  */
         cpu->exception_index = EXCP_INTERRUPT;
@@ -1695,6 +1832,8 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->flags = flags;
     tb->cflags = cflags;
     tb->trace_vcpu_dstate = *cpu->trace_dstate;
+    tb->exec_count = 0;
+    memset(tb->exit_count, 0, sizeof(tb->exit_count));
     tcg_ctx->tb_cflags = cflags;
 
 #ifdef CONFIG_PROFILER
@@ -1729,6 +1868,12 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     ti = profile_getclock();
 #endif
 
+#ifdef CONFIG_USER_ONLY
+    if (parallel) {
+        mmap_unlock();
+    }
+#endif
+
     /* ??? Overflow could be handled better here.  In particular, we
        don't need to re-do gen_intermediate_code, nor should we re-do
        the tcg optimization currently hidden inside tcg_gen_code.  All
@@ -1744,6 +1889,18 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     }
     tb->tc.size = gen_code_size;
 
+#ifdef CONFIG_USER_ONLY
+    if (parallel) {
+        mmap_lock();
+        if (unlikely(page_code_gen != gen)) {
+            /* Discard the TB, and translate again with the lock held */
+            atomic_set(&tcg_ctx->code_gen_ptr, (void *)tb);
+            parallel = false;
+            goto buffer_overflow;
+        }
+    }
+#endif
+
 #ifdef CONFIG_PROFILER
     atomic_set(&prof->code_time, prof->code_time + profile_getclock() - ti);
     atomic_set(&prof->code_in_len, prof->code_in_len + tb->size);
@@ -1820,9 +1977,16 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
 
         orig_aligned -= ROUND_UP(sizeof(*tb), qemu_icache_linesize);
         atomic_set(&tcg_ctx->code_gen_ptr, (void *)orig_aligned);
+#ifdef CONFIG_USER_ONLY
+        tcg_ctx_release();
+#endif
         return existing_tb;
     }
     tcg_tb_insert(tb);
+    tb_profile_code_load(tb);
+#ifdef CONFIG_USER_ONLY
+    tcg_ctx_release();
+#endif
     return tb;
 }
 
@@ -1852,6 +2016,7 @@ tb_invalidate_phys_page_range__locked(struct page_collection *pages,
 #endif /* TARGET_HAS_PRECISE_SMC */
 
     assert_page_locked(p);
+    page_code_changed();
 
 #if defined(TARGET_HAS_PRECISE_SMC)
     if (cpu != NULL) {
@@ -1983,6 +2148,25 @@ void tb_invalidate_phys_range(target_ulong start, target_ulong end)
 }
 
 #ifdef CONFIG_SOFTMMU
+/* len must be <= 8 and start must be a multiple of len.
+ * Called without any lock from the notdirty write path: false means
+ * that no TB can overlap [@start, @start + len[, so the page locks and
+ * tb_invalidate_phys_page_fast() can be skipped.  A page with code
+ * keeps TLB_NOTDIRTY set, but stores to its data lines no longer
+ * serialize on the page lock.
+ */
+bool tb_page_write_hits_code(tb_page_addr_t start, int len)
+{
+    PageDesc *p = page_find(start >> TARGET_PAGE_BITS);
+    unsigned int line = (start & ~TARGET_PAGE_MASK) >> SMC_LINE_SHIFT;
+
+    if (!p) {
+        return false;
+    }
+    /* an aligned access of at most 8 bytes never crosses a line */
+    return atomic_read(&p->code_lines[BIT_WORD(line)]) & BIT_MASK(line);
+}
+
 /* len must be <= 8 and start must be a multiple of len.
  * Called via softmmu_template.h when code areas are written to with
  * iothread mutex not held.
@@ -2058,6 +2242,7 @@ static bool tb_invalidate_phys_page(tb_page_addr_t addr, uintptr_t pc)
     if (!p) {
         return false;
     }
+    page_code_changed();
 
 #ifdef TARGET_HAS_PRECISE_SMC
     if (p->first_tb && pc != 0) {
@@ -2197,6 +2382,11 @@ static void tb_jmp_cache_clear_page(CPUState *cpu, target_ulong page_addr)
     for (i = 0; i < TB_JMP_PAGE_SIZE; i++) {
         atomic_set(&cpu->tb_jmp_cache[i0 + i], NULL);
     }
+
+    i0 = tb_l2_cache_hash_page(page_addr) * TB_L2_CACHE_WAYS;
+    for (i = 0; i < TB_L2_PAGE_SIZE * TB_L2_CACHE_WAYS; i++) {
+        atomic_set(&cpu->tb_l2_cache[i0 + i], NULL);
+    }
 }
 
 void tb_flush_jmp_cache(CPUState *cpu, target_ulong addr)
@@ -2282,7 +2472,7 @@ void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
 {
     struct tb_tree_stats tst = {};
     struct qht_stats hst;
-    size_t nb_tbs;
+    size_t nb_tbs, lookup_hits, lookup_misses;
 
     tcg_tb_foreach(tb_tree_stats_iter, &tst);
     nb_tbs = tst.nb_tbs;
@@ -2317,8 +2507,13 @@ void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
     cpu_fprintf(f, "\nStatistics:\n");
     cpu_fprintf(f, "TB flush count      %u\n",
                 atomic_read(&tb_ctx.tb_flush_count));
+    cpu_fprintf(f, "TB evict count      %u\n",
+                atomic_read(&tb_ctx.tb_evict_count));
     cpu_fprintf(f, "TB invalidate count %zu\n", tcg_tb_phys_invalidate_count());
     cpu_fprintf(f, "TLB flush count     %zu\n", tlb_flush_count());
+    tcg_tb_lookup_ptr_count(&lookup_hits, &lookup_misses);
+    cpu_fprintf(f, "TB lookup ptr count %zu (%zu misses)\n",
+                lookup_hits + lookup_misses, lookup_misses);
     tcg_dump_info(f, cpu_fprintf);
 }
 
@@ -2327,6 +2522,31 @@ void dump_opcount_info(FILE *f, fprintf_function cpu_fprintf)
     tcg_dump_op_count(f, cpu_fprintf);
 }
 
+/*
+ * Unlike dump_exec_info(), do not walk the TB trees: only take the
+ * counters that translation keeps up to date anyway.
+ */
+void tb_cache_collect_stats(StatsResultList ***tail)
+{
+    StatsResult *result;
+    size_t lookup_hits, lookup_misses;
+
+    if (!tcg_enabled()) {
+        return;
+    }
+
+    result = stats_result_add(tail, STATS_TARGET_TB_CACHE, NULL);
+    stats_add(result, "code-size", tcg_code_size());
+    stats_add(result, "code-capacity", tcg_code_capacity());
+    stats_add(result, "tbs", tcg_nb_tbs());
+    stats_add(result, "flushes", atomic_read(&tb_ctx.tb_flush_count));
+    stats_add(result, "evictions", atomic_read(&tb_ctx.tb_evict_count));
+    stats_add(result, "invalidations", tcg_tb_phys_invalidate_count());
+    tcg_tb_lookup_ptr_count(&lookup_hits, &lookup_misses);
+    stats_add(result, "lookup-hits", lookup_hits);
+    stats_add(result, "lookup-misses", lookup_misses);
+}
+
 #else /* CONFIG_USER_ONLY */
 
 void cpu_interrupt(CPUState *cpu, int mask)
@@ -2448,6 +2668,177 @@ void page_dump(FILE *f)
     walk_memory_regions(f, dump_region);
 }
 
+/*
+ * Index of the guest pages that have non-zero flags, kept by
+ * page_set_flags() and protected by the mmap_lock.  It is a GTree of
+ * disjoint ranges, and adjacent ranges are merged whatever the flags of
+ * their pages, so there is one node per contiguous mapped area.  This
+ * lets the mmap code find holes and check ranges without walking the
+ * page table one page at a time.
+ */
+typedef struct PageRange {
+    target_ulong start;
+    target_ulong last;          /* Inclusive */
+} PageRange;
+
+static GTree *page_ranges;
+
+/* Ranges compare equal if they overlap */
+static gint page_range_cmp(gconstpointer a, gconstpointer b, gpointer opaque)
+{
+    const PageRange *ra = a, *rb = b;
+
+    if (ra->last < rb->start) {
+        return -1;
+    }
+    if (ra->start > rb->last) {
+        return 1;
+    }
+    return 0;
+}
+
+typedef struct PageRangeSearch {
+    target_ulong addr;
+    PageRange *found;
+} PageRangeSearch;
+
+/* Find the lowest range that ends at or above s->addr */
+static gint page_range_search_above(gconstpointer key, gconstpointer data)
+{
+    PageRange *r = (PageRange *)key;
+    PageRangeSearch *s = (PageRangeSearch *)data;
+
+    if (r->last < s->addr) {
+        return 1;
+    }
+    s->found = r;
+    return -1;
+}
+
+/* Find the highest range that starts at or below s->addr */
+static gint page_range_search_below(gconstpointer key, gconstpointer data)
+{
+    PageRange *r = (PageRange *)key;
+    PageRangeSearch *s = (PageRangeSearch *)data;
+
+    if (r->start > s->addr) {
+        return -1;
+    }
+    s->found = r;
+    return 1;
+}
+
+static PageRange *page_range_search(GCompareFunc fn, target_ulong addr)
+{
+    PageRangeSearch s = { .addr = addr };
+
+    if (page_ranges) {
+        g_tree_search(page_ranges, fn, &s);
+    }
+    return s.found;
+}
+
+static void page_range_insert(target_ulong start, target_ulong last)
+{
+    PageRange *r = g_new(PageRange, 1);
+
+    r->start = start;
+    r->last = last;
+    g_tree_insert(page_ranges, r, r);
+}
+
+/* Remove [start, last] from the index, splitting the ranges it cuts */
+static void page_range_remove(target_ulong start, target_ulong last)
+{
+    PageRange key = { .start = start, .last = last };
+    PageRange *r;
+
+    while ((r = g_tree_lookup(page_ranges, &key))) {
+        PageRange old = *r;
+
+        g_tree_remove(page_ranges, r);
+        if (old.start < start) {
+            page_range_insert(old.start, start - 1);
+        }
+        if (old.last > last) {
+            page_range_insert(last + 1, old.last);
+        }
+    }
+}
+
+/* Add [start, last] to the index, merging it with its neighbours */
+static void page_range_add(target_ulong start, target_ulong last)
+{
+    PageRange key = {
+        .start = start ? start - 1 : 0,
+        .last = last + 1 ? last + 1 : last,
+    };
+    PageRange *r;
+
+    while ((r = g_tree_lookup(page_ranges, &key))) {
+        start = MIN(start, r->start);
+        last = MAX(last, r->last);
+        g_tree_remove(page_ranges, r);
+    }
+    page_range_insert(start, last);
+}
+
+int page_get_flags_range(target_ulong start, target_ulong end)
+{
+    target_ulong addr, last;
+    PageRange *r;
+    int flags = 0;
+
+    start &= TARGET_PAGE_MASK;
+    end = TARGET_PAGE_ALIGN(end);
+    if (start >= end) {
+        return 0;
+    }
+
+    addr = start;
+    while ((r = page_range_search(page_range_search_above, addr)) &&
+           r->start < end) {
+        addr = MAX(addr, r->start);
+        last = MIN(r->last, end - 1);
+        for (;;) {
+            flags |= page_get_flags(addr);
+            if (last - addr < TARGET_PAGE_SIZE) {
+                break;
+            }
+            addr += TARGET_PAGE_SIZE;
+        }
+        if (last == end - 1) {
+            break;
+        }
+        addr = last + 1;
+    }
+    return flags;
+}
+
+target_ulong page_find_free_below(target_ulong base, target_ulong end,
+                                  target_ulong len, target_ulong align)
+{
+    PageRange *r;
+    target_ulong addr;
+
+    assert(len != 0 && is_power_of_2(align));
+    for (;;) {
+        if (end < base || end - base < len) {
+            return -1;
+        }
+        addr = (end - len) & -align;
+        if (addr < base) {
+            return -1;
+        }
+        r = page_range_search(page_range_search_below, addr + len - 1);
+        if (!r || r->last < addr) {
+            return addr;
+        }
+        /* Skip the whole mapped range below the candidate and retry */
+        end = r->start;
+    }
+}
+
 int page_get_flags(target_ulong address)
 {
     PageDesc *p;
@@ -2474,6 +2865,7 @@ void page_set_flags(target_ulong start, target_ulong end, int flags)
 #endif
     assert(start < end);
     assert_memory_lock();
+    page_code_changed();
 
     start = start & TARGET_PAGE_MASK;
     end = TARGET_PAGE_ALIGN(end);
@@ -2496,6 +2888,15 @@ void page_set_flags(target_ulong start, target_ulong end, int flags)
         }
         p->flags = flags;
     }
+
+    if (!page_ranges) {
+        page_ranges = g_tree_new_full(page_range_cmp, NULL, g_free, NULL);
+    }
+    if (flags) {
+        page_range_add(start, end - 1);
+    } else {
+        page_range_remove(start, end - 1);
+    }
 }
 
 int page_check_range(target_ulong start, target_ulong len, int flags)
@@ -18,6 +18,8 @@
 #include "exec/log.h"
 #include "exec/translator.h"
 
+bool tcg_superblocks;
+
 /* Pairs with tcg_clear_temp_count.
    To be called by #TranslatorOps.{translate_insn,tb_stop} if
    (1) the target is sufficiently clean to support reporting,
@@ -570,6 +570,44 @@ int cpu_signal_handler(int host_signum, void *pinfo,
     return handle_cpu_signal(pc, info, is_write, &uc->uc_sigmask);
 }
 
+#elif defined(__riscv)
+
+int cpu_signal_handler(int host_signum, void *pinfo,
+                       void *puc)
+{
+    siginfo_t *info = pinfo;
+    ucontext_t *uc = puc;
+    greg_t pc = uc->uc_mcontext.__gregs[REG_PC];
+    uint16_t insn = *(uint16_t *)pc;
+    int is_write = 0;
+
+    /* Detect a store by decoding the faulting instruction.  Read the
+       second halfword only for 32-bit encodings, so that a compressed
+       instruction at the end of a page cannot fault again here.  */
+    if ((insn & 3) != 3) {
+        /* c.fsd, c.sw, c.sd; c.fsdsp, c.swsp, c.sdsp */
+        if (((insn & 3) == 0 || (insn & 3) == 2) && (insn >> 13) >= 5) {
+            is_write = 1;
+        }
+    } else {
+        uint32_t insn32 = insn | (uint32_t)*(uint16_t *)(pc + 2) << 16;
+
+        switch (insn32 & 0x7f) {
+        case 0x23: /* STORE */
+        case 0x27: /* STORE-FP */
+            is_write = 1;
+            break;
+        case 0x2f: /* AMO: everything but lr writes */
+            is_write = (insn32 >> 27) != 2;
+            break;
+        default:
+            break;
+        }
+    }
+
+    return handle_cpu_signal(pc, info, is_write, &uc->uc_sigmask);
+}
+
 #else
 
 #error host CPU specific signal handler needed
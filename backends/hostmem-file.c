@@ -32,6 +32,7 @@ struct HostMemoryBackendFile {
     HostMemoryBackend parent_obj;
 
     bool discard_data;
+    bool readonly;
     char *mem_path;
     uint64_t align;
 };
@@ -59,7 +60,7 @@ file_backend_memory_alloc(HostMemoryBackend *backend, Error **errp)
         memory_region_init_ram_from_file(&backend->mr, OBJECT(backend),
                                  path,
                                  backend->size, fb->align, backend->share,
-                                 fb->mem_path, errp);
+                                 fb->readonly, fb->mem_path, errp);
         g_free(path);
     }
 #endif
@@ -96,6 +97,23 @@ static void file_memory_backend_set_discard_data(Object *o, bool value,
     MEMORY_BACKEND_FILE(o)->discard_data = value;
 }
 
+static bool file_memory_backend_get_readonly(Object *o, Error **errp)
+{
+    return MEMORY_BACKEND_FILE(o)->readonly;
+}
+
+static void file_memory_backend_set_readonly(Object *o, bool value,
+                                             Error **errp)
+{
+    HostMemoryBackend *backend = MEMORY_BACKEND(o);
+
+    if (host_memory_backend_mr_inited(backend)) {
+        error_setg(errp, "cannot change property value");
+        return;
+    }
+    MEMORY_BACKEND_FILE(o)->readonly = value;
+}
+
 static void file_memory_backend_get_align(Object *o, Visitor *v,
                                           const char *name, void *opaque,
                                           Error **errp)
@@ -161,6 +179,9 @@ file_backend_class_init(ObjectClass *oc, void *data)
         file_memory_backend_get_align,
         file_memory_backend_set_align,
         NULL, NULL, &error_abort);
+    object_class_property_add_bool(oc, "readonly",
+        file_memory_backend_get_readonly, file_memory_backend_set_readonly,
+        &error_abort);
 }
 
 static void file_backend_instance_finalize(Object *o)
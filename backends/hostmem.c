@@ -15,6 +15,7 @@
 #include "hw/boards.h"
 #include "qapi/error.h"
 #include "qapi/qapi-builtin-visit.h"
+#include "qapi/qapi-events-misc.h"
 #include "qapi/visitor.h"
 #include "qemu/config-file.h"
 #include "qom/object_interfaces.h"
@@ -215,11 +216,7 @@ static void host_memory_backend_set_prealloc(Object *obj, bool value,
     }
 
     if (value && !backend->prealloc) {
-        int fd = memory_region_get_fd(&backend->mr);
-        void *ptr = memory_region_get_ram_ptr(&backend->mr);
-        uint64_t sz = memory_region_size(&backend->mr);
-
-        os_mem_prealloc(fd, ptr, sz, smp_cpus, &local_err);
+        host_memory_backend_prealloc(backend, &local_err);
         if (local_err) {
             error_propagate(errp, local_err);
             return;
@@ -228,6 +225,34 @@ static void host_memory_backend_set_prealloc(Object *obj, bool value,
     }
 }
 
+static void host_memory_backend_prealloc_progress(size_t done, size_t total,
+                                                  void *opaque)
+{
+    Object *obj = opaque;
+    char *id = object_get_canonical_path_component(obj);
+
+    qapi_event_send_memory_prealloc_progress(id, done, total, &error_abort);
+    g_free(id);
+}
+
+static void host_memory_backend_prealloc(HostMemoryBackend *backend,
+                                         Error **errp)
+{
+    int fd = memory_region_get_fd(&backend->mr);
+    void *ptr = memory_region_get_ram_ptr(&backend->mr);
+    uint64_t sz = memory_region_size(&backend->mr);
+    const unsigned long *host_nodes = NULL;
+
+#ifdef CONFIG_NUMA
+    if (backend->policy != MPOL_DEFAULT) {
+        host_nodes = backend->host_nodes;
+    }
+#endif
+    os_mem_prealloc(fd, ptr, sz, smp_cpus, host_nodes, MAX_NODES,
+                    host_memory_backend_prealloc_progress, OBJECT(backend),
+                    errp);
+}
+
 static void host_memory_backend_init(Object *obj)
 {
     HostMemoryBackend *backend = MEMORY_BACKEND(obj);
@@ -347,8 +372,7 @@ host_memory_backend_memory_complete(UserCreatable *uc, Error **errp)
          * specified NUMA policy in place.
          */
         if (backend->prealloc) {
-            os_mem_prealloc(memory_region_get_fd(&backend->mr), ptr, sz,
-                            smp_cpus, &local_err);
+            host_memory_backend_prealloc(backend, &local_err);
             if (local_err) {
                 goto out;
             }
@@ -4166,6 +4166,26 @@ int bdrv_get_info(BlockDriverState *bs, BlockDriverInfo *bdi)
     return drv->bdrv_get_info(bs, bdi);
 }
 
+/*
+ * Look up a host file descriptor that holds the data of @bs, for callers
+ * that want to move data with sendfile() and the like instead of going
+ * through a bounce buffer.  *@offset is translated from @bs to the
+ * returned descriptor.  The caller must keep @bs busy (bdrv_inc_in_flight)
+ * while it uses the descriptor, which may change when @bs is reopened.
+ */
+int bdrv_get_host_fd(BlockDriverState *bs, int64_t *offset)
+{
+    BlockDriver *drv = bs->drv;
+
+    if (!drv) {
+        return -ENOMEDIUM;
+    }
+    if (!drv->bdrv_get_host_fd) {
+        return -ENOTSUP;
+    }
+    return drv->bdrv_get_host_fd(bs, offset);
+}
+
 ImageInfoSpecific *bdrv_get_specific_info(BlockDriverState *bs)
 {
     BlockDriver *drv = bs->drv;
@@ -4175,6 +4195,15 @@ ImageInfoSpecific *bdrv_get_specific_info(BlockDriverState *bs)
     return NULL;
 }
 
+BlockStatsSpecific *bdrv_get_specific_stats(BlockDriverState *bs)
+{
+    BlockDriver *drv = bs->drv;
+    if (!drv || !drv->bdrv_get_specific_stats) {
+        return NULL;
+    }
+    return drv->bdrv_get_specific_stats(bs);
+}
+
 void bdrv_debug_event(BlockDriverState *bs, BlkdebugEvent event)
 {
     if (!bs || !bs->drv || !bs->drv->bdrv_debug_event) {
@@ -27,6 +27,7 @@
 #include "block/accounting.h"
 #include "block/block_int.h"
 #include "qemu/timer.h"
+#include "qemu/host-utils.h"
 #include "sysemu/qtest.h"
 
 static QEMUClockType clock_type = QEMU_CLOCK_REALTIME;
@@ -182,6 +183,82 @@ void block_latency_histograms_clear(BlockAcctStats *stats)
     }
 }
 
+static int block_latency_log_bin(uint64_t latency_ns)
+{
+    int shift;
+
+    latency_ns = MIN(latency_ns, (1ULL << BLOCK_LATENCY_LOG_MAX_SHIFT) - 1);
+    if (latency_ns < (1 << BLOCK_LATENCY_LOG_SUB_BITS)) {
+        return latency_ns;
+    }
+
+    /* Keep the top BLOCK_LATENCY_LOG_SUB_BITS + 1 bits; the leading one
+     * selects the power of two, the rest the linear bin inside it */
+    shift = 63 - clz64(latency_ns) - BLOCK_LATENCY_LOG_SUB_BITS;
+    return ((shift + 1) << BLOCK_LATENCY_LOG_SUB_BITS) +
+           ((latency_ns >> shift) & ((1 << BLOCK_LATENCY_LOG_SUB_BITS) - 1));
+}
+
+/* Largest latency that falls into @bin */
+static uint64_t block_latency_log_bin_max(int bin)
+{
+    int shift = (bin >> BLOCK_LATENCY_LOG_SUB_BITS) - 1;
+    uint64_t mantissa;
+
+    if (shift < 0) {
+        return bin;
+    }
+
+    mantissa = (1 << BLOCK_LATENCY_LOG_SUB_BITS) +
+               (bin & ((1 << BLOCK_LATENCY_LOG_SUB_BITS) - 1));
+    return ((mantissa + 1) << shift) - 1;
+}
+
+uint64_t block_acct_latency_count(BlockAcctStats *stats,
+                                  enum BlockAcctType type)
+{
+    BlockLatencyLogHistogram *hist = &stats->latency_log[type];
+    uint64_t count = 0;
+    int i;
+
+    for (i = 0; i < BLOCK_LATENCY_LOG_NBINS; i++) {
+        count += stat64_get(&hist->bins[i]);
+    }
+    return count;
+}
+
+/* Return the latency in nanoseconds below which @permille thousandths of
+ * the requests of type @type completed.  The result is the upper bound of
+ * the histogram bin that contains the percentile, so it overestimates
+ * the exact value by at most 12.5%.  Returns 0 if nothing was accounted.
+ */
+uint64_t block_acct_latency_percentile(BlockAcctStats *stats,
+                                       enum BlockAcctType type,
+                                       unsigned permille)
+{
+    BlockLatencyLogHistogram *hist = &stats->latency_log[type];
+    uint64_t count, rank, seen = 0;
+    int i;
+
+    assert(permille <= 1000);
+
+    count = block_acct_latency_count(stats, type);
+    if (count == 0) {
+        return 0;
+    }
+
+    rank = MAX(1, DIV_ROUND_UP(count * permille, 1000));
+    for (i = 0; i < BLOCK_LATENCY_LOG_NBINS; i++) {
+        seen += stat64_get(&hist->bins[i]);
+        if (seen >= rank) {
+            break;
+        }
+    }
+
+    /* Concurrent updates may make the bins sum to more than count */
+    return block_latency_log_bin_max(MIN(i, BLOCK_LATENCY_LOG_NBINS - 1));
+}
+
 static void block_account_one_io(BlockAcctStats *stats, BlockAcctCookie *cookie,
                                  bool failed)
 {
@@ -195,6 +272,9 @@ static void block_account_one_io(BlockAcctStats *stats, BlockAcctCookie *cookie,
 
     assert(cookie->type < BLOCK_MAX_IOTYPE);
 
+    stat64_add(&stats->latency_log[cookie->type].bins[
+                   block_latency_log_bin(MAX(latency_ns, 0))], 1);
+
     qemu_mutex_lock(&stats->lock);
 
     if (failed) {
@@ -27,6 +27,7 @@
 #include "qemu/error-report.h"
 
 #define BACKUP_CLUSTER_SIZE_DEFAULT (1 << 16)
+#define BACKUP_MAX_BOUNCE_SIZE (1 << 20)
 
 typedef struct BackupBlockJob {
     BlockJob common;
@@ -47,6 +48,8 @@ typedef struct BackupBlockJob {
     HBitmap *copy_bitmap;
     bool use_copy_range;
     int64_t copy_range_size;
+    /* Largest request copied through the bounce buffer */
+    int64_t bounce_size;
 
     bool serialize_target_writes;
 } BackupBlockJob;
@@ -90,6 +93,23 @@ static void cow_request_end(CowRequest *req)
     qemu_co_queue_restart_all(&req->wait_queue);
 }
 
+/* Return the number of bytes starting at the dirty cluster @start that can
+ * be copied in one request: the run of clusters still set in copy_bitmap,
+ * capped at @end, @max_bytes and the end of the image. */
+static int64_t backup_dirty_run(BackupBlockJob *job, int64_t start,
+                                int64_t end, int64_t max_bytes)
+{
+    int64_t next_zero;
+
+    next_zero = hbitmap_next_zero(job->copy_bitmap, start / job->cluster_size);
+    if (next_zero >= 0) {
+        end = MIN(end, next_zero * job->cluster_size);
+    }
+    end = MIN(end, start + max_bytes);
+
+    return MIN(end, job->len) - start;
+}
+
 /* Copy range to target with a bounce buffer and return the bytes copied. If
  * error occurred, return a negative error number */
 static int coroutine_fn backup_cow_with_bounce_buffer(BackupBlockJob *job,
@@ -104,13 +124,15 @@ static int coroutine_fn backup_cow_with_bounce_buffer(BackupBlockJob *job,
     QEMUIOVector qiov;
     BlockBackend *blk = job->common.blk;
     int nbytes;
+    int nr_clusters;
     int read_flags = is_write_notifier ? BDRV_REQ_NO_SERIALISING : 0;
     int write_flags = job->serialize_target_writes ? BDRV_REQ_SERIALISING : 0;
 
-    hbitmap_reset(job->copy_bitmap, start / job->cluster_size, 1);
-    nbytes = MIN(job->cluster_size, job->len - start);
+    nbytes = backup_dirty_run(job, start, end, job->bounce_size);
+    nr_clusters = DIV_ROUND_UP(nbytes, job->cluster_size);
+    hbitmap_reset(job->copy_bitmap, start / job->cluster_size, nr_clusters);
     if (!*bounce_buffer) {
-        *bounce_buffer = blk_blockalign(blk, job->cluster_size);
+        *bounce_buffer = blk_blockalign(blk, job->bounce_size);
     }
     iov.iov_base = *bounce_buffer;
     iov.iov_len = nbytes;
@@ -143,7 +165,7 @@ static int coroutine_fn backup_cow_with_bounce_buffer(BackupBlockJob *job,
 
     return nbytes;
 fail:
-    hbitmap_set(job->copy_bitmap, start / job->cluster_size, 1);
+    hbitmap_set(job->copy_bitmap, start / job->cluster_size, nr_clusters);
     return ret;
 
 }
@@ -163,7 +185,7 @@ static int coroutine_fn backup_cow_with_offload(BackupBlockJob *job,
     int write_flags = job->serialize_target_writes ? BDRV_REQ_SERIALISING : 0;
 
     assert(QEMU_IS_ALIGNED(job->copy_range_size, job->cluster_size));
-    nbytes = MIN(job->copy_range_size, end - start);
+    nbytes = backup_dirty_run(job, start, end, job->copy_range_size);
     nr_clusters = DIV_ROUND_UP(nbytes, job->cluster_size);
     hbitmap_reset(job->copy_bitmap, start / job->cluster_size,
                   nr_clusters);
@@ -417,23 +439,36 @@ static int coroutine_fn backup_run_incremental(BackupBlockJob *job)
 {
     int ret;
     bool error_is_read;
-    int64_t cluster;
+    int64_t cluster, next;
+    int64_t nb_clusters = DIV_ROUND_UP(job->len, job->cluster_size);
     HBitmapIter hbi;
 
     hbitmap_iter_init(&hbi, job->copy_bitmap, 0);
     while ((cluster = hbitmap_iter_next(&hbi, true)) != -1) {
         do {
+            int64_t offset = cluster * job->cluster_size;
+
             if (yield_and_check(job)) {
                 return 0;
             }
-            ret = backup_do_cow(job, cluster * job->cluster_size,
-                                job->cluster_size, &error_is_read, false);
+            /* backup_do_cow() skips the clean clusters in the range and
+             * coalesces the dirty runs into large requests. */
+            ret = backup_do_cow(job, offset,
+                                MIN(job->bounce_size, job->len - offset),
+                                &error_is_read, false);
             if (ret < 0 && backup_error_action(job, error_is_read, -ret) ==
                            BLOCK_ERROR_ACTION_REPORT)
             {
                 return ret;
             }
         } while (ret < 0);
+
+        /* The iterator may have cached bits that were just copied */
+        next = cluster + job->bounce_size / job->cluster_size;
+        if (next >= nb_clusters) {
+            break;
+        }
+        hbitmap_iter_init(&hbi, job->copy_bitmap, next);
     }
 
     return 0;
@@ -516,9 +551,13 @@ static void coroutine_fn backup_run(void *opaque)
     } else if (job->sync_mode == MIRROR_SYNC_MODE_INCREMENTAL) {
         ret = backup_run_incremental(job);
     } else {
-        /* Both FULL and TOP SYNC_MODE's require copying.. */
-        for (offset = 0; offset < job->len;
-             offset += job->cluster_size) {
+        /* Both FULL and TOP SYNC_MODE's require copying..  TOP checks the
+         * allocation status cluster by cluster, FULL copies in chunks as
+         * large as the bounce buffer. */
+        int64_t step = job->sync_mode == MIRROR_SYNC_MODE_TOP ?
+                       job->cluster_size : job->bounce_size;
+
+        for (offset = 0; offset < job->len; offset += step) {
             bool error_is_read;
             int alloced = 0;
 
@@ -560,7 +599,7 @@ static void coroutine_fn backup_run(void *opaque)
             if (alloced < 0) {
                 ret = alloced;
             } else {
-                ret = backup_do_cow(job, offset, job->cluster_size,
+                ret = backup_do_cow(job, offset, MIN(step, job->len - offset),
                                     &error_is_read, false);
             }
             if (ret < 0) {
@@ -570,7 +609,7 @@ static void coroutine_fn backup_run(void *opaque)
                 if (action == BLOCK_ERROR_ACTION_REPORT) {
                     break;
                 } else {
-                    offset -= job->cluster_size;
+                    offset -= step;
                     continue;
                 }
             }
@@ -741,6 +780,12 @@ BlockJob *backup_job_create(const char *job_id, BlockDriverState *bs,
     job->copy_range_size = MAX(job->cluster_size,
                                QEMU_ALIGN_UP(job->copy_range_size,
                                              job->cluster_size));
+    job->bounce_size = MIN_NON_ZERO(blk_get_max_transfer(job->common.blk),
+                                    blk_get_max_transfer(job->target));
+    job->bounce_size = MIN_NON_ZERO(job->bounce_size, BACKUP_MAX_BOUNCE_SIZE);
+    job->bounce_size = MAX(job->cluster_size,
+                           QEMU_ALIGN_DOWN(job->bounce_size,
+                                           job->cluster_size));
 
     /* Required permissions are already taken with target's blk_new() */
     block_job_add_bdrv(&job->common, "target", target, 0, BLK_PERM_ALL,
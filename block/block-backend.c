@@ -654,6 +654,14 @@ BlockBackend *blk_by_name(const char *name)
     return NULL;
 }
 
+/*
+ * Return the root BdrvChild of @blk if a node is attached, else null.
+ */
+BdrvChild *blk_root(BlockBackend *blk)
+{
+    return blk->root;
+}
+
 /*
  * Return the BlockDriverState attached to @blk if any, else null.
  */
@@ -21,18 +21,47 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/units.h"
 #include "block/block_int.h"
 
+/*
+ * Sequential guest reads are followed by a copy-on-read of the area just
+ * past them, so that streaming from a slow backing file (e.g. over NBD)
+ * is not bound by the latency of one guest request at a time.  The window
+ * doubles on every sequential read and is reset by a random one.
+ */
+#define COR_READAHEAD_MIN (128 * KiB)
+#define COR_READAHEAD_MAX (4 * MiB)
+
+typedef struct BDRVCopyOnReadState {
+    /* End of the last guest read; a read starting here is sequential */
+    int64_t next_offset;
+    int64_t readahead_bytes;
+    /* End of the area already prefetched */
+    int64_t readahead_end;
+    bool readahead_busy;
+} BDRVCopyOnReadState;
+
+typedef struct CORReadahead {
+    BlockDriverState *bs;
+    int64_t offset;
+    int64_t bytes;
+} CORReadahead;
+
 
 static int cor_open(BlockDriverState *bs, QDict *options, int flags,
                     Error **errp)
 {
+    BDRVCopyOnReadState *s = bs->opaque;
+
     bs->file = bdrv_open_child(NULL, options, "file", bs, &child_file, false,
                                errp);
     if (!bs->file) {
         return -EINVAL;
     }
 
+    s->readahead_bytes = COR_READAHEAD_MIN;
+
     bs->supported_write_flags = BDRV_REQ_WRITE_UNCHANGED |
                                 (BDRV_REQ_FUA &
                                     bs->file->bs->supported_write_flags);
@@ -87,12 +116,100 @@ static int coroutine_fn cor_co_truncate(BlockDriverState *bs, int64_t offset,
 }
 
 
+static void coroutine_fn cor_readahead_entry(void *opaque)
+{
+    CORReadahead *ra = opaque;
+    BlockDriverState *bs = ra->bs;
+    BDRVCopyOnReadState *s = bs->opaque;
+    int64_t offset = ra->offset;
+    int64_t end = ra->offset + ra->bytes;
+    void *buf;
+
+    buf = qemu_try_blockalign(bs->file->bs, ra->bytes);
+    while (buf && offset < end) {
+        int64_t pnum;
+        int ret;
+
+        /* Only the part not yet allocated in the top layer needs copying */
+        ret = bdrv_is_allocated(bs->file->bs, offset, end - offset, &pnum);
+        if (ret < 0 || pnum == 0) {
+            break;
+        }
+        if (ret == 0) {
+            struct iovec iov = {
+                .iov_base = buf,
+                .iov_len  = pnum,
+            };
+            QEMUIOVector qiov;
+
+            qemu_iovec_init_external(&qiov, &iov, 1);
+            if (bdrv_co_preadv(bs->file, offset, pnum, &qiov,
+                               BDRV_REQ_COPY_ON_READ) < 0) {
+                /* Errors are left for the guest read of this area */
+                break;
+            }
+        }
+        offset += pnum;
+    }
+
+    qemu_vfree(buf);
+    s->readahead_busy = false;
+    bdrv_dec_in_flight(bs);
+    g_free(ra);
+}
+
+static void cor_readahead(BlockDriverState *bs, int64_t offset, int64_t bytes)
+{
+    BDRVCopyOnReadState *s = bs->opaque;
+    int64_t end = offset + bytes;
+    int64_t len, start, ra_bytes;
+    CORReadahead *ra;
+
+    if (offset != s->next_offset) {
+        s->next_offset = end;
+        s->readahead_bytes = COR_READAHEAD_MIN;
+        s->readahead_end = 0;
+        return;
+    }
+    s->next_offset = end;
+    if (s->readahead_busy) {
+        return;
+    }
+
+    len = bdrv_getlength(bs);
+    start = MAX(end, s->readahead_end);
+    ra_bytes = MIN(end + s->readahead_bytes, len) - start;
+    if (len < 0 || ra_bytes <= 0) {
+        return;
+    }
+
+    ra = g_new(CORReadahead, 1);
+    *ra = (CORReadahead) {
+        .bs     = bs,
+        .offset = start,
+        .bytes  = ra_bytes,
+    };
+    s->readahead_end = start + ra_bytes;
+    s->readahead_busy = true;
+    s->readahead_bytes = MIN(s->readahead_bytes * 2, COR_READAHEAD_MAX);
+
+    /* Keeps drain waiting until the readahead has completed */
+    bdrv_inc_in_flight(bs);
+    bdrv_coroutine_enter(bs, qemu_coroutine_create(cor_readahead_entry, ra));
+}
+
 static int coroutine_fn cor_co_preadv(BlockDriverState *bs,
                                       uint64_t offset, uint64_t bytes,
                                       QEMUIOVector *qiov, int flags)
 {
-    return bdrv_co_preadv(bs->file, offset, bytes, qiov,
-                          flags | BDRV_REQ_COPY_ON_READ);
+    int ret;
+
+    ret = bdrv_co_preadv(bs->file, offset, bytes, qiov,
+                         flags | BDRV_REQ_COPY_ON_READ);
+    if (ret >= 0) {
+        cor_readahead(bs, offset, bytes);
+    }
+    return ret;
 }
 
 
@@ -141,6 +258,7 @@ static bool cor_recurse_is_first_non_filter(BlockDriverState *bs,
 
 BlockDriver bdrv_copy_on_read = {
     .format_name                        = "copy-on-read",
+    .instance_size                      = sizeof(BDRVCopyOnReadState),
 
     .bdrv_open                          = cor_open,
     .bdrv_close                         = cor_close,
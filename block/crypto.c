@@ -29,12 +29,21 @@
 #include "qapi/qobject-input-visitor.h"
 #include "qapi/error.h"
 #include "qemu/option.h"
+#include "block/thread-pool.h"
 #include "crypto.h"
 
+/* The default limit of a thread pool */
+#define BLOCK_CRYPTO_MAX_THREADS 64
+
 typedef struct BlockCrypto BlockCrypto;
 
 struct BlockCrypto {
     QCryptoBlock *block;
+
+    /* Encryption jobs running in the thread pool */
+    CoQueue thread_task_queue;
+    int nb_threads;
+    int max_threads;
 };
 
 
@@ -225,10 +234,14 @@ static int block_crypto_open_generic(QCryptoBlockFormat format,
     if (flags & BDRV_O_NO_IO) {
         cflags |= QCRYPTO_BLOCK_OPEN_NO_IO;
     }
+    qemu_co_queue_init(&crypto->thread_task_queue);
+    crypto->max_threads = MIN(g_get_num_processors(),
+                              BLOCK_CRYPTO_MAX_THREADS);
     crypto->block = qcrypto_block_open(open_opts, NULL,
                                        block_crypto_read_func,
                                        bs,
                                        cflags,
+                                       crypto->max_threads,
                                        errp);
 
     if (!crypto->block) {
@@ -323,6 +336,59 @@ static int block_crypto_reopen_prepare(BDRVReopenState *state,
  */
 #define BLOCK_CRYPTO_MAX_IO_SIZE (1024 * 1024)
 
+typedef struct BlockCryptoEncDecData {
+    QCryptoBlock *block;
+    bool encrypt;
+    uint64_t offset;
+    uint8_t *buf;
+    size_t len;
+} BlockCryptoEncDecData;
+
+static int block_crypto_encdec_pool_func(void *opaque)
+{
+    BlockCryptoEncDecData *data = opaque;
+
+    if (data->encrypt) {
+        return qcrypto_block_encrypt(data->block, data->offset,
+                                     data->buf, data->len, NULL);
+    } else {
+        return qcrypto_block_decrypt(data->block, data->offset,
+                                     data->buf, data->len, NULL);
+    }
+}
+
+/*
+ * Encrypt or decrypt in the thread pool, so that the AioContext keeps
+ * submitting I/O and several requests use several host CPUs.
+ */
+static int coroutine_fn
+block_crypto_co_encdec(BlockDriverState *bs, bool encrypt, uint64_t offset,
+                       uint8_t *buf, size_t len)
+{
+    BlockCrypto *crypto = bs->opaque;
+    ThreadPool *pool = aio_get_thread_pool(bdrv_get_aio_context(bs));
+    BlockCryptoEncDecData arg = {
+        .block = crypto->block,
+        .encrypt = encrypt,
+        .offset = offset,
+        .buf = buf,
+        .len = len,
+    };
+    int ret;
+
+    while (crypto->nb_threads >= crypto->max_threads) {
+        qemu_co_queue_wait(&crypto->thread_task_queue, NULL);
+    }
+
+    crypto->nb_threads++;
+    ret = thread_pool_submit_co(pool, block_crypto_encdec_pool_func, &arg);
+    crypto->nb_threads--;
+
+    qemu_co_queue_next(&crypto->thread_task_queue);
+
+    return ret;
+}
+
 static coroutine_fn int
 block_crypto_co_preadv(BlockDriverState *bs, uint64_t offset, uint64_t bytes,
                        QEMUIOVector *qiov, int flags)
@@ -366,8 +432,8 @@ block_crypto_co_preadv(BlockDriverState *bs, uint64_t offset, uint64_t bytes,
             goto cleanup;
         }
 
-        if (qcrypto_block_decrypt(crypto->block, offset + bytes_done,
-                                  cipher_data, cur_bytes, NULL) < 0) {
+        if (block_crypto_co_encdec(bs, false, offset + bytes_done,
+                                   cipher_data, cur_bytes) < 0) {
             ret = -EIO;
             goto cleanup;
         }
@@ -422,8 +488,8 @@ block_crypto_co_pwritev(BlockDriverState *bs, uint64_t offset, uint64_t bytes,
 
         qemu_iovec_to_buf(qiov, bytes_done, cipher_data, cur_bytes);
 
-        if (qcrypto_block_encrypt(crypto->block, offset + bytes_done,
-                                  cipher_data, cur_bytes, NULL) < 0) {
+        if (block_crypto_co_encdec(bs, true, offset + bytes_done,
+                                   cipher_data, cur_bytes) < 0) {
             ret = -EIO;
             goto cleanup;
         }
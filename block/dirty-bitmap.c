@@ -27,6 +27,7 @@
 #include "trace.h"
 #include "block/block_int.h"
 #include "block/blockjob.h"
+#include "qemu/bitmap.h"
 
 /**
  * A BdrvDirtyBitmap can be in three possible states:
@@ -55,6 +56,18 @@ struct BdrvDirtyBitmap {
                                    and this bitmap must remain unchanged while
                                    this flag is set. */
     bool persistent;            /* bitmap must be saved to owner disk image */
+
+    /* Lazy loading of the stored bitmap, see bdrv_dirty_bitmap_set_lazy_load.
+     * Only the chunks set in @unloaded still have to be ORed in from storage;
+     * @changed records which chunks differ from what has been stored. */
+    BdrvDirtyBitmapLoadFunc *load;
+    void *load_opaque;
+    GDestroyNotify load_opaque_free;
+    uint64_t chunk_size;
+    int64_t nb_chunks;
+    int64_t nb_unloaded;
+    unsigned long *unloaded;
+    unsigned long *changed;
     QLIST_ENTRY(BdrvDirtyBitmap) list;
 };
 
@@ -83,6 +96,250 @@ void bdrv_dirty_bitmap_unlock(BdrvDirtyBitmap *bitmap)
     qemu_mutex_unlock(bitmap->mutex);
 }
 
+/* Called within bdrv_dirty_bitmap_lock..unlock */
+static void mark_changed(BdrvDirtyBitmap *bitmap, int64_t offset,
+                         int64_t bytes)
+{
+    int64_t start, end;
+
+    if (!bitmap->changed || bytes <= 0 || offset >= bitmap->size) {
+        return;
+    }
+    start = offset / bitmap->chunk_size;
+    end = DIV_ROUND_UP(MIN(offset + bytes, bitmap->size), bitmap->chunk_size);
+    bitmap_set(bitmap->changed, start, end - start);
+}
+
+static void mark_all_changed(BdrvDirtyBitmap *bitmap)
+{
+    mark_changed(bitmap, 0, bitmap->size);
+}
+
+static bool range_loaded(const BdrvDirtyBitmap *bitmap, int64_t offset,
+                         int64_t bytes)
+{
+    int64_t end;
+
+    if (!bitmap->nb_unloaded || bytes <= 0) {
+        return true;
+    }
+    end = DIV_ROUND_UP(MIN(offset + bytes, bitmap->size), bitmap->chunk_size);
+    return find_next_bit(bitmap->unloaded, end,
+                         offset / bitmap->chunk_size) >= end;
+}
+
+/* Called within bdrv_dirty_bitmap_lock..unlock */
+static void clear_unloaded(BdrvDirtyBitmap *bitmap, int64_t start,
+                           int64_t end)
+{
+    int64_t i;
+
+    for (i = start; i < end; i++) {
+        if (test_and_clear_bit(i, bitmap->unloaded)) {
+            bitmap->nb_unloaded--;
+        }
+    }
+}
+
+/* Called within bdrv_dirty_bitmap_lock..unlock.  Stored data of chunks that
+ * are completely covered by a reset no longer matters, so they need not be
+ * loaded; partially covered chunks must have been loaded by the caller. */
+static void discard_unloaded(BdrvDirtyBitmap *bitmap, int64_t offset,
+                             int64_t bytes)
+{
+    int64_t start, end;
+
+    if (!bitmap->nb_unloaded || bytes <= 0) {
+        return;
+    }
+    start = DIV_ROUND_UP(offset, bitmap->chunk_size);
+    if (offset % bitmap->chunk_size) {
+        assert(!test_bit(start - 1, bitmap->unloaded));
+    }
+    if (offset + bytes >= bitmap->size) {
+        end = bitmap->nb_chunks;
+    } else {
+        end = (offset + bytes) / bitmap->chunk_size;
+        if ((offset + bytes) % bitmap->chunk_size) {
+            assert(!test_bit(end, bitmap->unloaded));
+        }
+    }
+    if (start < end) {
+        clear_unloaded(bitmap, start, end);
+    }
+}
+
+/**
+ * Defer loading the stored contents of @bitmap until they are needed.
+ * @bitmap is expected to be empty except for bits set since its creation;
+ * the stored data is ORed in one chunk of @chunk_size bytes at a time, by
+ * calling @load.  Until then, only operations that do not depend on the
+ * current state of the bits (setting, resetting whole chunks, clearing,
+ * merging into it) may be done on it.  The bitmap also starts tracking
+ * which chunks change, for bdrv_dirty_bitmap_changed().
+ * Called with BQL taken.
+ */
+void bdrv_dirty_bitmap_set_lazy_load(BdrvDirtyBitmap *bitmap,
+                                     uint64_t chunk_size,
+                                     BdrvDirtyBitmapLoadFunc *load,
+                                     void *opaque, GDestroyNotify free_opaque)
+{
+    assert(!bitmap->load);
+    assert(chunk_size &&
+           chunk_size % bdrv_dirty_bitmap_serialization_align(bitmap) == 0);
+
+    bitmap->load = load;
+    bitmap->load_opaque = opaque;
+    bitmap->load_opaque_free = free_opaque;
+    bitmap->chunk_size = chunk_size;
+    bitmap->nb_chunks = DIV_ROUND_UP(bitmap->size, chunk_size);
+    bitmap->nb_unloaded = bitmap->nb_chunks;
+    bitmap->unloaded = bitmap_new(bitmap->nb_chunks);
+    bitmap_set(bitmap->unloaded, 0, bitmap->nb_chunks);
+    bitmap->changed = bitmap_new(bitmap->nb_chunks);
+}
+
+/**
+ * Forget about the stored contents of @bitmap.  Chunks that have not been
+ * loaded yet are lost, so this is usually preceded by
+ * bdrv_dirty_bitmap_load_all().
+ */
+void bdrv_dirty_bitmap_drop_lazy_load(BdrvDirtyBitmap *bitmap)
+{
+    if (!bitmap->load) {
+        return;
+    }
+    if (bitmap->load_opaque_free) {
+        bitmap->load_opaque_free(bitmap->load_opaque);
+    }
+    g_free(bitmap->unloaded);
+    g_free(bitmap->changed);
+    bitmap->load = NULL;
+    bitmap->load_opaque = NULL;
+    bitmap->load_opaque_free = NULL;
+    bitmap->chunk_size = 0;
+    bitmap->nb_chunks = 0;
+    bitmap->nb_unloaded = 0;
+    bitmap->unloaded = NULL;
+    bitmap->changed = NULL;
+}
+
+/* Return the opaque pointer of @bitmap if it is lazily loaded by @load */
+void *bdrv_dirty_bitmap_lazy_load_opaque(BdrvDirtyBitmap *bitmap,
+                                         BdrvDirtyBitmapLoadFunc *load)
+{
+    return bitmap->load == load ? bitmap->load_opaque : NULL;
+}
+
+/**
+ * Make sure that the stored data for [@offset, @offset + @bytes) has been
+ * merged into @bitmap.  The data is read without holding the bitmap lock, so
+ * that concurrent writes can keep on setting bits meanwhile.
+ * Called with BQL taken.
+ */
+int bdrv_dirty_bitmap_load(BdrvDirtyBitmap *bitmap, uint64_t offset,
+                           uint64_t bytes, Error **errp)
+{
+    uint8_t *buf = NULL;
+    int64_t i, end;
+    int ret = 0;
+
+    if (!bitmap->nb_unloaded || !bytes || offset >= bitmap->size) {
+        return 0;
+    }
+
+    end = DIV_ROUND_UP(MIN(offset + bytes, bitmap->size), bitmap->chunk_size);
+    for (i = offset / bitmap->chunk_size; i < end; i++) {
+        uint64_t chunk_offset = i * bitmap->chunk_size;
+        uint64_t chunk_bytes = MIN(bitmap->chunk_size,
+                                   bitmap->size - chunk_offset);
+
+        if (!test_bit(i, bitmap->unloaded)) {
+            continue;
+        }
+        if (!buf) {
+            buf = g_malloc(bdrv_dirty_bitmap_serialization_size(
+                               bitmap, 0, MIN(bitmap->chunk_size,
+                                              bitmap->size)));
+        }
+
+        ret = bitmap->load(bitmap, chunk_offset, chunk_bytes, buf,
+                           bitmap->load_opaque);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Failed to load dirty bitmap '%s'",
+                             bitmap->name ?: "");
+            break;
+        }
+
+        qemu_mutex_lock(bitmap->mutex);
+        /* The chunk may have been reset while we were reading it */
+        if (test_bit(i, bitmap->unloaded)) {
+            hbitmap_deserialize_or(bitmap->bitmap, buf, chunk_offset,
+                                   chunk_bytes);
+            clear_unloaded(bitmap, i, i + 1);
+        }
+        qemu_mutex_unlock(bitmap->mutex);
+    }
+
+    g_free(buf);
+    return ret;
+}
+
+int bdrv_dirty_bitmap_load_all(BdrvDirtyBitmap *bitmap, Error **errp)
+{
+    return bdrv_dirty_bitmap_load(bitmap, 0, bitmap->size, errp);
+}
+
+/* Load @bitmap, or mark it completely dirty if the stored data is not
+ * readable.  Called with BQL taken. */
+static void bdrv_dirty_bitmap_load_or_fill(BdrvDirtyBitmap *bitmap)
+{
+    Error *local_err = NULL;
+
+    if (bdrv_dirty_bitmap_load_all(bitmap, &local_err) < 0) {
+        error_report_err(local_err);
+        qemu_mutex_lock(bitmap->mutex);
+        hbitmap_set(bitmap->bitmap, 0, bitmap->size);
+        mark_all_changed(bitmap);
+        clear_unloaded(bitmap, 0, bitmap->nb_chunks);
+        qemu_mutex_unlock(bitmap->mutex);
+    }
+}
+
+bool bdrv_dirty_bitmap_loaded(BdrvDirtyBitmap *bitmap)
+{
+    return !bitmap->nb_unloaded;
+}
+
+/**
+ * Return whether [@offset, @offset + @bytes) of @bitmap may differ from the
+ * stored data since it was loaded or since the last call to
+ * bdrv_dirty_bitmap_reset_changed().  Bitmaps that are not lazily loaded do
+ * not track changes, so for them this is always true.
+ */
+bool bdrv_dirty_bitmap_changed(BdrvDirtyBitmap *bitmap, uint64_t offset,
+                               uint64_t bytes)
+{
+    int64_t start, end;
+
+    if (!bitmap->changed) {
+        return true;
+    }
+    if (!bytes || offset >= bitmap->size) {
+        return false;
+    }
+    start = offset / bitmap->chunk_size;
+    end = DIV_ROUND_UP(MIN(offset + bytes, bitmap->size), bitmap->chunk_size);
+    return find_next_bit(bitmap->changed, end, start) < end;
+}
+
+void bdrv_dirty_bitmap_reset_changed(BdrvDirtyBitmap *bitmap)
+{
+    if (bitmap->changed) {
+        bitmap_zero(bitmap->changed, bitmap->nb_chunks);
+    }
+}
+
 /* Called with BQL or dirty_bitmap lock taken.  */
 BdrvDirtyBitmap *bdrv_find_dirty_bitmap(BlockDriverState *bs, const char *name)
 {
@@ -226,6 +483,11 @@ int bdrv_dirty_bitmap_create_successor(BlockDriverState *bs,
     }
     assert(!bitmap->successor);
 
+    /* The parent is read once the operation is over, even on success */
+    if (bdrv_dirty_bitmap_load_all(bitmap, errp) < 0) {
+        return -1;
+    }
+
     /* Create an anonymous successor */
     granularity = bdrv_dirty_bitmap_granularity(bitmap);
     child = bdrv_create_dirty_bitmap(bs, granularity, NULL, errp);
@@ -263,6 +525,7 @@ static void bdrv_release_dirty_bitmap_locked(BdrvDirtyBitmap *bitmap)
     assert(!bdrv_dirty_bitmap_frozen(bitmap));
     assert(!bitmap->meta);
     QLIST_REMOVE(bitmap, list);
+    bdrv_dirty_bitmap_drop_lazy_load(bitmap);
     hbitmap_free(bitmap->bitmap);
     g_free(bitmap->name);
     g_free(bitmap);
@@ -318,6 +581,7 @@ BdrvDirtyBitmap *bdrv_reclaim_dirty_bitmap_locked(BlockDriverState *bs,
         error_setg(errp, "Merging of parent and successor bitmap failed");
         return NULL;
     }
+    mark_all_changed(parent);
     bdrv_release_dirty_bitmap_locked(successor);
     parent->successor = NULL;
 
@@ -346,10 +610,16 @@ void bdrv_dirty_bitmap_truncate(BlockDriverState *bs, int64_t bytes)
 {
     BdrvDirtyBitmap *bitmap;
 
+    /* The chunk layout of the stored bitmaps does not survive resizing */
+    QLIST_FOREACH(bitmap, &bs->dirty_bitmaps, list) {
+        bdrv_dirty_bitmap_load_or_fill(bitmap);
+    }
+
     bdrv_dirty_bitmaps_lock(bs);
     QLIST_FOREACH(bitmap, &bs->dirty_bitmaps, list) {
         assert(!bdrv_dirty_bitmap_frozen(bitmap));
         assert(!bitmap->active_iterators);
+        bdrv_dirty_bitmap_drop_lazy_load(bitmap);
         hbitmap_truncate(bitmap->bitmap, bytes);
         bitmap->size = bytes;
     }
@@ -441,6 +711,10 @@ BlockDirtyInfoList *bdrv_query_dirty_bitmaps(BlockDriverState *bs)
     BlockDirtyInfoList *list = NULL;
     BlockDirtyInfoList **plist = &list;
 
+    QLIST_FOREACH(bm, &bs->dirty_bitmaps, list) {
+        bdrv_dirty_bitmap_load_or_fill(bm);
+    }
+
     bdrv_dirty_bitmaps_lock(bs);
     QLIST_FOREACH(bm, &bs->dirty_bitmaps, list) {
         BlockDirtyInfo *info = g_new0(BlockDirtyInfo, 1);
@@ -464,6 +738,7 @@ bool bdrv_get_dirty_locked(BlockDriverState *bs, BdrvDirtyBitmap *bitmap,
                            int64_t offset)
 {
     if (bitmap) {
+        assert(!bitmap->nb_unloaded);
         return hbitmap_get(bitmap->bitmap, offset);
     } else {
         return false;
@@ -498,6 +773,7 @@ uint32_t bdrv_dirty_bitmap_granularity(const BdrvDirtyBitmap *bitmap)
 BdrvDirtyBitmapIter *bdrv_dirty_iter_new(BdrvDirtyBitmap *bitmap)
 {
     BdrvDirtyBitmapIter *iter = g_new(BdrvDirtyBitmapIter, 1);
+    assert(!bitmap->nb_unloaded);
     hbitmap_iter_init(&iter->hbi, bitmap->bitmap, 0);
     iter->bitmap = bitmap;
     bitmap->active_iterators++;
@@ -590,6 +866,7 @@ void bdrv_set_dirty_bitmap_locked(BdrvDirtyBitmap *bitmap,
     assert(bdrv_dirty_bitmap_enabled(bitmap));
     assert(!bdrv_dirty_bitmap_readonly(bitmap));
     hbitmap_set(bitmap->bitmap, offset, bytes);
+    mark_changed(bitmap, offset, bytes);
 }
 
 void bdrv_set_dirty_bitmap(BdrvDirtyBitmap *bitmap,
@@ -606,7 +883,9 @@ void bdrv_reset_dirty_bitmap_locked(BdrvDirtyBitmap *bitmap,
 {
     assert(bdrv_dirty_bitmap_enabled(bitmap));
     assert(!bdrv_dirty_bitmap_readonly(bitmap));
+    discard_unloaded(bitmap, offset, bytes);
     hbitmap_reset(bitmap->bitmap, offset, bytes);
+    mark_changed(bitmap, offset, bytes);
 }
 
 void bdrv_reset_dirty_bitmap(BdrvDirtyBitmap *bitmap,
@@ -623,13 +902,17 @@ void bdrv_clear_dirty_bitmap(BdrvDirtyBitmap *bitmap, HBitmap **out)
     assert(!bdrv_dirty_bitmap_readonly(bitmap));
     bdrv_dirty_bitmap_lock(bitmap);
     if (!out) {
+        discard_unloaded(bitmap, 0, bitmap->size);
         hbitmap_reset_all(bitmap->bitmap);
     } else {
         HBitmap *backup = bitmap->bitmap;
+        /* Undo would bring back an incomplete bitmap */
+        assert(!bitmap->nb_unloaded);
         bitmap->bitmap = hbitmap_alloc(bitmap->size,
                                        hbitmap_granularity(backup));
         *out = backup;
     }
+    mark_all_changed(bitmap);
     bdrv_dirty_bitmap_unlock(bitmap);
 }
 
@@ -640,6 +923,7 @@ void bdrv_undo_clear_dirty_bitmap(BdrvDirtyBitmap *bitmap, HBitmap *in)
     assert(!bdrv_dirty_bitmap_readonly(bitmap));
     bitmap->bitmap = in;
     hbitmap_free(tmp);
+    mark_all_changed(bitmap);
 }
 
 uint64_t bdrv_dirty_bitmap_serialization_size(const BdrvDirtyBitmap *bitmap,
@@ -657,6 +941,7 @@ void bdrv_dirty_bitmap_serialize_part(const BdrvDirtyBitmap *bitmap,
                                       uint8_t *buf, uint64_t offset,
                                       uint64_t bytes)
 {
+    assert(range_loaded(bitmap, offset, bytes));
     hbitmap_serialize_part(bitmap->bitmap, buf, offset, bytes);
 }
 
@@ -665,6 +950,7 @@ void bdrv_dirty_bitmap_deserialize_part(BdrvDirtyBitmap *bitmap,
                                         uint64_t bytes, bool finish)
 {
     hbitmap_deserialize_part(bitmap->bitmap, buf, offset, bytes, finish);
+    mark_changed(bitmap, offset, bytes);
 }
 
 void bdrv_dirty_bitmap_deserialize_zeroes(BdrvDirtyBitmap *bitmap,
@@ -672,6 +958,7 @@ void bdrv_dirty_bitmap_deserialize_zeroes(BdrvDirtyBitmap *bitmap,
                                           bool finish)
 {
     hbitmap_deserialize_zeroes(bitmap->bitmap, offset, bytes, finish);
+    mark_changed(bitmap, offset, bytes);
 }
 
 void bdrv_dirty_bitmap_deserialize_ones(BdrvDirtyBitmap *bitmap,
@@ -679,6 +966,7 @@ void bdrv_dirty_bitmap_deserialize_ones(BdrvDirtyBitmap *bitmap,
                                         bool finish)
 {
     hbitmap_deserialize_ones(bitmap->bitmap, offset, bytes, finish);
+    mark_changed(bitmap, offset, bytes);
 }
 
 void bdrv_dirty_bitmap_deserialize_finish(BdrvDirtyBitmap *bitmap)
@@ -701,6 +989,7 @@ void bdrv_set_dirty(BlockDriverState *bs, int64_t offset, int64_t bytes)
         }
         assert(!bdrv_dirty_bitmap_readonly(bitmap));
         hbitmap_set(bitmap->bitmap, offset, bytes);
+        mark_changed(bitmap, offset, bytes);
     }
     bdrv_dirty_bitmaps_unlock(bs);
 }
@@ -715,6 +1004,7 @@ void bdrv_set_dirty_iter(BdrvDirtyBitmapIter *iter, int64_t offset)
 
 int64_t bdrv_get_dirty_count(BdrvDirtyBitmap *bitmap)
 {
+    assert(!bitmap->nb_unloaded);
     return hbitmap_count(bitmap->bitmap);
 }
 
@@ -780,22 +1070,31 @@ BdrvDirtyBitmap *bdrv_dirty_bitmap_next(BlockDriverState *bs,
                             QLIST_NEXT(bitmap, list);
 }
 
-char *bdrv_dirty_bitmap_sha256(const BdrvDirtyBitmap *bitmap, Error **errp)
+char *bdrv_dirty_bitmap_sha256(BdrvDirtyBitmap *bitmap, Error **errp)
 {
+    if (bdrv_dirty_bitmap_load_all(bitmap, errp) < 0) {
+        return NULL;
+    }
     return hbitmap_sha256(bitmap->bitmap, errp);
 }
 
 int64_t bdrv_dirty_bitmap_next_zero(BdrvDirtyBitmap *bitmap, uint64_t offset)
 {
+    assert(!bitmap->nb_unloaded);
     return hbitmap_next_zero(bitmap->bitmap, offset);
 }
 
-void bdrv_merge_dirty_bitmap(BdrvDirtyBitmap *dest, const BdrvDirtyBitmap *src,
+void bdrv_merge_dirty_bitmap(BdrvDirtyBitmap *dest, BdrvDirtyBitmap *src,
                              Error **errp)
 {
     /* only bitmaps from one bds are supported */
     assert(dest->mutex == src->mutex);
 
+    /* ORing into @dest commutes with loading it later, @src must be whole */
+    if (bdrv_dirty_bitmap_load_all(src, errp) < 0) {
+        return;
+    }
+
     qemu_mutex_lock(dest->mutex);
 
     assert(bdrv_dirty_bitmap_enabled(dest));
@@ -803,6 +1102,8 @@ void bdrv_merge_dirty_bitmap(BdrvDirtyBitmap *dest, const BdrvDirtyBitmap *src,
 
     if (!hbitmap_merge(dest->bitmap, src->bitmap)) {
         error_setg(errp, "Bitmaps are incompatible and can't be merged");
+    } else {
+        mark_all_changed(dest);
     }
 
     qemu_mutex_unlock(dest->mutex);
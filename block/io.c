@@ -1147,6 +1147,45 @@ bdrv_driver_pwritev_compressed(BlockDriverState *bs, uint64_t offset,
     return drv->bdrv_co_pwritev_compressed(bs, offset, bytes, qiov);
 }
 
+/* Short bounce buffers (alignment padding, copy-on-read of small clusters)
+ * are recycled through the node's AioContext instead of going through
+ * posix_memalign() for every request.
+ */
+static bool bdrv_bounce_buffer_pooled(BlockDriverState *bs, size_t size)
+{
+    return size <= AIO_BOUNCE_BUFFER_SIZE &&
+           bdrv_opt_mem_align(bs) <= qemu_real_host_page_size;
+}
+
+static void *bdrv_bounce_buffer_get(BlockDriverState *bs, size_t size)
+{
+    if (bdrv_bounce_buffer_pooled(bs, size)) {
+        return aio_bounce_buffer_get(bdrv_get_aio_context(bs));
+    }
+    return qemu_blockalign(bs, size);
+}
+
+static void *bdrv_try_bounce_buffer_get(BlockDriverState *bs, size_t size)
+{
+    if (bdrv_bounce_buffer_pooled(bs, size)) {
+        return aio_bounce_buffer_get(bdrv_get_aio_context(bs));
+    }
+    return qemu_try_blockalign(bs, size);
+}
+
+static void bdrv_bounce_buffer_put(BlockDriverState *bs, void *buf,
+                                   size_t size)
+{
+    if (!buf) {
+        return;
+    }
+    if (bdrv_bounce_buffer_pooled(bs, size)) {
+        aio_bounce_buffer_put(bdrv_get_aio_context(bs), buf);
+    } else {
+        qemu_vfree(buf);
+    }
+}
+
 static int coroutine_fn bdrv_co_do_copy_on_readv(BdrvChild *child,
         int64_t offset, unsigned int bytes, QEMUIOVector *qiov)
 {
@@ -1158,6 +1197,7 @@ static int coroutine_fn bdrv_co_do_copy_on_readv(BdrvChild *child,
      * where anything might happen inside guest memory.
      */
     void *bounce_buffer;
+    size_t bounce_size;
 
     BlockDriver *drv = bs->drv;
     struct iovec iov;
@@ -1194,9 +1234,8 @@ static int coroutine_fn bdrv_co_do_copy_on_readv(BdrvChild *child,
     trace_bdrv_co_do_copy_on_readv(bs, offset, bytes,
                                    cluster_offset, cluster_bytes);
 
-    bounce_buffer = qemu_try_blockalign(bs,
-                                        MIN(MIN(max_transfer, cluster_bytes),
-                                            MAX_BOUNCE_BUFFER));
+    bounce_size = MIN(MIN(max_transfer, cluster_bytes), MAX_BOUNCE_BUFFER);
+    bounce_buffer = bdrv_try_bounce_buffer_get(bs, bounce_size);
     if (bounce_buffer == NULL) {
         ret = -ENOMEM;
         goto err;
@@ -1283,7 +1322,7 @@ static int coroutine_fn bdrv_co_do_copy_on_readv(BdrvChild *child,
     ret = 0;
 
 err:
-    qemu_vfree(bounce_buffer);
+    bdrv_bounce_buffer_put(bs, bounce_buffer, bounce_size);
     return ret;
 }
 
@@ -1428,7 +1467,7 @@ int coroutine_fn bdrv_co_preadv(BdrvChild *child,
 
     /* Align read if necessary by padding qiov */
     if (offset & (align - 1)) {
-        head_buf = qemu_blockalign(bs, align);
+        head_buf = bdrv_bounce_buffer_get(bs, align);
         qemu_iovec_init(&local_qiov, qiov->niov + 2);
         qemu_iovec_add(&local_qiov, head_buf, offset & (align - 1));
         qemu_iovec_concat(&local_qiov, qiov, 0, qiov->size);
@@ -1444,7 +1483,7 @@ int coroutine_fn bdrv_co_preadv(BdrvChild *child,
             qemu_iovec_concat(&local_qiov, qiov, 0, qiov->size);
             use_local_qiov = true;
         }
-        tail_buf = qemu_blockalign(bs, align);
+        tail_buf = bdrv_bounce_buffer_get(bs, align);
         qemu_iovec_add(&local_qiov, tail_buf,
                        align - ((offset + bytes) & (align - 1)));
 
@@ -1460,8 +1499,8 @@ int coroutine_fn bdrv_co_preadv(BdrvChild *child,
 
     if (use_local_qiov) {
         qemu_iovec_destroy(&local_qiov);
-        qemu_vfree(head_buf);
-        qemu_vfree(tail_buf);
+        bdrv_bounce_buffer_put(bs, head_buf, align);
+        bdrv_bounce_buffer_put(bs, tail_buf, align);
     }
 
     return ret;
@@ -1769,7 +1808,7 @@ static int coroutine_fn bdrv_co_do_zero_pwritev(BdrvChild *child,
 
     assert(flags & BDRV_REQ_ZERO_WRITE);
     if (head_padding_bytes || tail_padding_bytes) {
-        buf = qemu_blockalign(bs, align);
+        buf = bdrv_bounce_buffer_get(bs, align);
         iov = (struct iovec) {
             .iov_base   = buf,
             .iov_len    = align,
@@ -1833,7 +1872,7 @@ static int coroutine_fn bdrv_co_do_zero_pwritev(BdrvChild *child,
                                    &local_qiov, flags & ~BDRV_REQ_ZERO_WRITE);
     }
 fail:
-    qemu_vfree(buf);
+    bdrv_bounce_buffer_put(bs, buf, align);
     return ret;
 
 }
@@ -1885,7 +1924,7 @@ int coroutine_fn bdrv_co_pwritev(BdrvChild *child,
         mark_request_serialising(&req, align);
         wait_serialising_requests(&req);
 
-        head_buf = qemu_blockalign(bs, align);
+        head_buf = bdrv_bounce_buffer_get(bs, align);
         head_iov = (struct iovec) {
             .iov_base   = head_buf,
             .iov_len    = align,
@@ -1927,7 +1966,7 @@ int coroutine_fn bdrv_co_pwritev(BdrvChild *child,
         waited = wait_serialising_requests(&req);
         assert(!waited || !use_local_qiov);
 
-        tail_buf = qemu_blockalign(bs, align);
+        tail_buf = bdrv_bounce_buffer_get(bs, align);
         tail_iov = (struct iovec) {
             .iov_base   = tail_buf,
             .iov_len    = align,
@@ -1963,8 +2002,8 @@ fail:
     if (use_local_qiov) {
         qemu_iovec_destroy(&local_qiov);
     }
-    qemu_vfree(head_buf);
-    qemu_vfree(tail_buf);
+    bdrv_bounce_buffer_put(bs, head_buf, align);
+    bdrv_bounce_buffer_put(bs, tail_buf, align);
 out:
     tracked_request_end(&req);
     bdrv_dec_in_flight(bs);
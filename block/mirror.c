@@ -25,6 +25,10 @@
 #include "qemu/bitmap.h"
 
 #define MAX_IN_FLIGHT 16
+/* Bounds and measurement window for the adaptive in-flight limit */
+#define MIN_IN_FLIGHT 4
+#define MAX_IN_FLIGHT_LIMIT 64
+#define IN_FLIGHT_TUNE_NS (250 * SCALE_MS)
 #define MAX_IO_BYTES (1 << 20) /* 1 Mb */
 #define DEFAULT_MIRROR_BUF_SIZE (MAX_IN_FLIGHT * MAX_IO_BYTES)
 
@@ -72,6 +76,14 @@ typedef struct MirrorBlockJob {
     unsigned long *in_flight_bitmap;
     int in_flight;
     int64_t bytes_in_flight;
+    /* Adaptive limit for in_flight; see mirror_tune_in_flight() */
+    int max_in_flight;
+    int tune_step;
+    bool tune_saturated;
+    int64_t tune_start_ns;
+    uint64_t tune_bytes;
+    uint64_t tune_last_rate;
+    bool use_copy_range;
     QTAILQ_HEAD(MirrorOpList, MirrorOp) ops_in_flight;
     int ret;
     bool unmap;
@@ -187,6 +199,7 @@ static void coroutine_fn mirror_iteration_done(MirrorOp *op, int ret)
         if (!s->initial_zeroing_ongoing) {
             job_progress_update(&s->common.job, op->bytes);
         }
+        s->tune_bytes += op->bytes;
     }
     qemu_iovec_destroy(&op->qiov);
 
@@ -303,6 +316,81 @@ static inline void mirror_wait_for_free_in_flight_slot(MirrorBlockJob *s)
     mirror_wait_for_any_operation(s, false);
 }
 
+/* Hill-climb the in-flight limit on measured throughput.  Every
+ * IN_FLIGHT_TUNE_NS the bytes completed in the window are turned into a
+ * rate; if the window was bounded by the in-flight limit, keep moving the
+ * limit in the same direction while the rate improves and turn around
+ * when it drops.  Windows in which the limit was never hit (rate limiting,
+ * few dirty chunks, buffer exhaustion) say nothing about the limit and
+ * leave it alone.
+ */
+static void mirror_tune_in_flight(MirrorBlockJob *s)
+{
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    int64_t elapsed = now - s->tune_start_ns;
+    uint64_t rate;
+
+    if (elapsed < IN_FLIGHT_TUNE_NS) {
+        return;
+    }
+
+    rate = s->tune_bytes * 1000 / (elapsed / SCALE_MS);
+    if (s->tune_saturated) {
+        bool move = false;
+
+        if (rate < s->tune_last_rate - s->tune_last_rate / 16) {
+            s->tune_step = -s->tune_step;
+            move = true;
+        } else if (rate > s->tune_last_rate + s->tune_last_rate / 16) {
+            move = true;
+        }
+        if (move) {
+            s->max_in_flight += s->tune_step * MAX(1, s->max_in_flight / 4);
+            s->max_in_flight = MAX(MIN_IN_FLIGHT,
+                                   MIN(s->max_in_flight, MAX_IN_FLIGHT_LIMIT));
+            if (s->max_in_flight == MIN_IN_FLIGHT) {
+                s->tune_step = 1;
+            }
+        }
+        trace_mirror_tune_in_flight(s, rate, s->max_in_flight);
+    }
+
+    s->tune_last_rate = rate;
+    s->tune_bytes = 0;
+    s->tune_saturated = false;
+    s->tune_start_ns = now;
+}
+
+/* Try to copy op's range with an offloaded copy_range request.  Returns
+ * true on success; on failure offloading is disabled for the rest of the
+ * job and the caller falls back to a read and write through the buffer.
+ */
+static bool coroutine_fn mirror_co_copy_range(MirrorOp *op)
+{
+    MirrorBlockJob *s = op->s;
+    int ret;
+
+    qemu_iovec_init(&op->qiov, 0);
+    s->in_flight++;
+    s->bytes_in_flight += op->bytes;
+    trace_mirror_one_iteration(s, op->offset, op->bytes);
+
+    ret = bdrv_co_copy_range(s->mirror_top_bs->backing, op->offset,
+                             blk_root(s->target), op->offset, op->bytes,
+                             0, 0);
+    if (ret >= 0) {
+        mirror_write_complete(op, 0);
+        return true;
+    }
+
+    trace_mirror_copy_range_fail(s, op->offset, ret);
+    s->use_copy_range = false;
+    s->in_flight--;
+    s->bytes_in_flight -= op->bytes;
+    qemu_iovec_destroy(&op->qiov);
+    return false;
+}
+
 /* Perform a mirror copy operation.
  *
  * *op->bytes_handled is set to the number of bytes copied after and
@@ -341,6 +429,10 @@ static void coroutine_fn mirror_co_read(void *opaque)
     assert(QEMU_IS_ALIGNED(op->bytes, BDRV_SECTOR_SIZE));
     nb_chunks = DIV_ROUND_UP(op->bytes, s->granularity);
 
+    if (s->use_copy_range && mirror_co_copy_range(op)) {
+        return;
+    }
+
     while (s->buf_free_count < nb_chunks) {
         trace_mirror_yield_in_flight(s, op->offset, s->in_flight);
         mirror_wait_for_free_in_flight_slot(s);
@@ -547,7 +639,8 @@ static uint64_t coroutine_fn mirror_iteration(MirrorBlockJob *s)
             }
         }
 
-        while (s->in_flight >= MAX_IN_FLIGHT) {
+        while (s->in_flight >= s->max_in_flight) {
+            s->tune_saturated = true;
             trace_mirror_yield_in_flight(s, offset, s->in_flight);
             mirror_wait_for_free_in_flight_slot(s);
         }
@@ -757,7 +850,7 @@ static int coroutine_fn mirror_dirty_init(MirrorBlockJob *s)
                 return 0;
             }
 
-            if (s->in_flight >= MAX_IN_FLIGHT) {
+            if (s->in_flight >= s->max_in_flight) {
                 trace_mirror_yield(s, UINT64_MAX, s->buf_free_count,
                                    s->in_flight);
                 mirror_wait_for_free_in_flight_slot(s);
@@ -887,6 +980,10 @@ static void coroutine_fn mirror_run(void *opaque)
         s->cow_bitmap = bitmap_new(length);
     }
     s->max_iov = MIN(bs->bl.max_iov, target_bs->bl.max_iov);
+    s->max_in_flight = MAX_IN_FLIGHT;
+    s->tune_step = 1;
+    s->tune_start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    s->use_copy_range = true;
 
     s->buf = qemu_try_blockalign(bs, s->buf_size);
     if (s->buf == NULL) {
@@ -923,6 +1020,7 @@ static void coroutine_fn mirror_run(void *opaque)
         }
 
         job_pause_point(&s->common.job);
+        mirror_tune_in_flight(s);
 
         cnt = bdrv_get_dirty_count(s->dirty_bitmap);
         /* cnt is the number of dirty bytes remaining and s->bytes_in_flight is
@@ -937,8 +1035,11 @@ static void coroutine_fn mirror_run(void *opaque)
         delta = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - s->last_pause_ns;
         if (delta < BLOCK_JOB_SLICE_TIME &&
             s->common.iostatus == BLOCK_DEVICE_IO_STATUS_OK) {
-            if (s->in_flight >= MAX_IN_FLIGHT || s->buf_free_count == 0 ||
+            if (s->in_flight >= s->max_in_flight || s->buf_free_count == 0 ||
                 (cnt == 0 && s->in_flight > 0)) {
+                if (s->in_flight >= s->max_in_flight) {
+                    s->tune_saturated = true;
+                }
                 trace_mirror_yield(s, cnt, s->buf_free_count, s->in_flight);
                 mirror_wait_for_free_in_flight_slot(s);
                 continue;
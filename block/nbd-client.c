@@ -34,7 +34,7 @@
 #define HANDLE_TO_INDEX(bs, handle) ((handle) ^ (uint64_t)(intptr_t)(bs))
 #define INDEX_TO_HANDLE(bs, index)  ((index)  ^ (uint64_t)(intptr_t)(bs))
 
-static void nbd_recv_coroutines_wake_all(NBDClientSession *s)
+static void nbd_recv_coroutines_wake_all(NBDClientConnection *s)
 {
     int i;
 
@@ -47,30 +47,29 @@ static void nbd_recv_coroutines_wake_all(NBDClientSession *s)
     }
 }
 
-static void nbd_teardown_connection(BlockDriverState *bs)
+static void nbd_teardown_connection(BlockDriverState *bs,
+                                    NBDClientConnection *conn)
 {
-    NBDClientSession *client = nbd_get_client_session(bs);
-
-    if (!client->ioc) { /* Already closed */
+    if (!conn->ioc) { /* Already closed */
         return;
     }
 
     /* finish any pending coroutines */
-    qio_channel_shutdown(client->ioc,
+    qio_channel_shutdown(conn->ioc,
                          QIO_CHANNEL_SHUTDOWN_BOTH,
                          NULL);
-    BDRV_POLL_WHILE(bs, client->read_reply_co);
+    BDRV_POLL_WHILE(bs, conn->read_reply_co);
 
-    nbd_client_detach_aio_context(bs);
-    object_unref(OBJECT(client->sioc));
-    client->sioc = NULL;
-    object_unref(OBJECT(client->ioc));
-    client->ioc = NULL;
+    qio_channel_detach_aio_context(QIO_CHANNEL(conn->ioc));
+    object_unref(OBJECT(conn->sioc));
+    conn->sioc = NULL;
+    object_unref(OBJECT(conn->ioc));
+    conn->ioc = NULL;
 }
 
 static coroutine_fn void nbd_read_reply_entry(void *opaque)
 {
-    NBDClientSession *s = opaque;
+    NBDClientConnection *s = opaque;
     uint64_t i;
     int ret = 0;
     Error *local_err = NULL;
@@ -118,13 +117,45 @@ static coroutine_fn void nbd_read_reply_entry(void *opaque)
     s->read_reply_co = NULL;
 }
 
+/* Pick the live connection with the fewest requests in flight, starting
+ * the search at a rotating index so that ties are spread evenly.  If all
+ * connections are dead, the first one is returned so that the caller
+ * fails in the usual way. */
+static NBDClientConnection *nbd_pick_connection(NBDClientSession *client)
+{
+    NBDClientConnection *best = NULL;
+    int i;
+
+    for (i = 0; i < client->num_conns; i++) {
+        NBDClientConnection *conn =
+            &client->conns[(client->next_conn + i) % client->num_conns];
+
+        if (conn->quit || !conn->ioc) {
+            continue;
+        }
+        if (!best || conn->in_flight < best->in_flight) {
+            best = conn;
+        }
+    }
+    client->next_conn = (client->next_conn + 1) % client->num_conns;
+
+    return best ? best : &client->conns[0];
+}
+
+/* nbd_co_send_request
+ * Send @request on one of the connections and return it in @pconn; the
+ * reply must be received on the same connection.
+ */
 static int nbd_co_send_request(BlockDriverState *bs,
                                NBDRequest *request,
-                               QEMUIOVector *qiov)
+                               QEMUIOVector *qiov,
+                               NBDClientConnection **pconn)
 {
-    NBDClientSession *s = nbd_get_client_session(bs);
+    NBDClientConnection *s = nbd_pick_connection(nbd_get_client_session(bs));
     int rc, i;
 
+    *pconn = s;
+
     qemu_co_mutex_lock(&s->send_mutex);
     while (s->in_flight == MAX_NBD_REQUESTS) {
         qemu_co_queue_wait(&s->free_sema, &s->send_mutex);
@@ -232,7 +263,7 @@ static int nbd_parse_offset_hole_payload(NBDStructuredReplyChunk *chunk,
  * support only one extent in reply and only for
  * base:allocation context
  */
-static int nbd_parse_blockstatus_payload(NBDClientSession *client,
+static int nbd_parse_blockstatus_payload(NBDClientConnection *conn,
                                          NBDStructuredReplyChunk *chunk,
                                          uint8_t *payload, uint64_t orig_length,
                                          NBDExtent *extent, Error **errp)
@@ -246,11 +277,11 @@ static int nbd_parse_blockstatus_payload(NBDClientSession *client,
     }
 
     context_id = payload_advance32(&payload);
-    if (client->info.meta_base_allocation_id != context_id) {
+    if (conn->info.meta_base_allocation_id != context_id) {
         error_setg(errp, "Protocol error: unexpected context id %d for "
                          "NBD_REPLY_TYPE_BLOCK_STATUS, when negotiated context "
                          "id is %d", context_id,
-                         client->info.meta_base_allocation_id);
+                         conn->info.meta_base_allocation_id);
         return -EINVAL;
     }
 
@@ -258,8 +289,8 @@ static int nbd_parse_blockstatus_payload(NBDClientSession *client,
     extent->flags = payload_advance32(&payload);
 
     if (extent->length == 0 ||
-        (client->info.min_block && !QEMU_IS_ALIGNED(extent->length,
-                                                    client->info.min_block))) {
+        (conn->info.min_block && !QEMU_IS_ALIGNED(extent->length,
+                                                  conn->info.min_block))) {
         error_setg(errp, "Protocol error: server sent status chunk with "
                    "invalid length");
         return -EINVAL;
@@ -315,7 +346,7 @@ static int nbd_parse_error_payload(NBDStructuredReplyChunk *chunk,
     return 0;
 }
 
-static int nbd_co_receive_offset_data_payload(NBDClientSession *s,
+static int nbd_co_receive_offset_data_payload(NBDClientConnection *s,
                                               uint64_t orig_offset,
                                               QEMUIOVector *qiov, Error **errp)
 {
@@ -360,7 +391,7 @@ static int nbd_co_receive_offset_data_payload(NBDClientSession *s,
 /* nbd_co_receive_structured_payload
  */
 static coroutine_fn int nbd_co_receive_structured_payload(
-        NBDClientSession *s, void **payload, Error **errp)
+        NBDClientConnection *s, void **payload, Error **errp)
 {
     int ret;
     uint32_t len;
@@ -409,7 +440,7 @@ static coroutine_fn int nbd_co_receive_structured_payload(
  * corresponding to the server's error reply), and errp is unchanged.
  */
 static coroutine_fn int nbd_co_do_receive_one_chunk(
-        NBDClientSession *s, uint64_t handle, bool only_structured,
+        NBDClientConnection *s, uint64_t handle, bool only_structured,
         int *request_ret, QEMUIOVector *qiov, void **payload, Error **errp)
 {
     int ret;
@@ -500,7 +531,7 @@ static coroutine_fn int nbd_co_do_receive_one_chunk(
  * Return value is a fatal error code or normal nbd reply error code
  */
 static coroutine_fn int nbd_co_receive_one_chunk(
-        NBDClientSession *s, uint64_t handle, bool only_structured,
+        NBDClientConnection *s, uint64_t handle, bool only_structured,
         QEMUIOVector *qiov, NBDReply *reply, void **payload, Error **errp)
 {
     int request_ret;
@@ -561,7 +592,7 @@ static void nbd_iter_error(NBDReplyChunkIter *iter, bool fatal,
 
 /* nbd_reply_chunk_iter_receive
  */
-static bool nbd_reply_chunk_iter_receive(NBDClientSession *s,
+static bool nbd_reply_chunk_iter_receive(NBDClientConnection *s,
                                          NBDReplyChunkIter *iter,
                                          uint64_t handle,
                                          QEMUIOVector *qiov, NBDReply *reply,
@@ -626,7 +657,7 @@ break_loop:
     return false;
 }
 
-static int nbd_co_receive_return_code(NBDClientSession *s, uint64_t handle,
+static int nbd_co_receive_return_code(NBDClientConnection *s, uint64_t handle,
                                       Error **errp)
 {
     NBDReplyChunkIter iter;
@@ -639,7 +670,7 @@ static int nbd_co_receive_return_code(NBDClientSession *s, uint64_t handle,
     return iter.ret;
 }
 
-static int nbd_co_receive_cmdread_reply(NBDClientSession *s, uint64_t handle,
+static int nbd_co_receive_cmdread_reply(NBDClientConnection *s, uint64_t handle,
                                         uint64_t offset, QEMUIOVector *qiov,
                                         Error **errp)
 {
@@ -688,7 +719,7 @@ static int nbd_co_receive_cmdread_reply(NBDClientSession *s, uint64_t handle,
     return iter.ret;
 }
 
-static int nbd_co_receive_blockstatus_reply(NBDClientSession *s,
+static int nbd_co_receive_blockstatus_reply(NBDClientConnection *s,
                                             uint64_t handle, uint64_t length,
                                             NBDExtent *extent, Error **errp)
 {
@@ -755,7 +786,7 @@ static int nbd_co_request(BlockDriverState *bs, NBDRequest *request,
 {
     int ret;
     Error *local_err = NULL;
-    NBDClientSession *client = nbd_get_client_session(bs);
+    NBDClientConnection *conn;
 
     assert(request->type != NBD_CMD_READ);
     if (write_qiov) {
@@ -764,12 +795,12 @@ static int nbd_co_request(BlockDriverState *bs, NBDRequest *request,
     } else {
         assert(request->type != NBD_CMD_WRITE);
     }
-    ret = nbd_co_send_request(bs, request, write_qiov);
+    ret = nbd_co_send_request(bs, request, write_qiov, &conn);
     if (ret < 0) {
         return ret;
     }
 
-    ret = nbd_co_receive_return_code(client, request->handle, &local_err);
+    ret = nbd_co_receive_return_code(conn, request->handle, &local_err);
     if (local_err) {
         error_report_err(local_err);
     }
@@ -781,7 +812,7 @@ int nbd_client_co_preadv(BlockDriverState *bs, uint64_t offset,
 {
     int ret;
     Error *local_err = NULL;
-    NBDClientSession *client = nbd_get_client_session(bs);
+    NBDClientConnection *conn;
     NBDRequest request = {
         .type = NBD_CMD_READ,
         .from = offset,
@@ -794,12 +825,12 @@ int nbd_client_co_preadv(BlockDriverState *bs, uint64_t offset,
     if (!bytes) {
         return 0;
     }
-    ret = nbd_co_send_request(bs, &request, NULL);
+    ret = nbd_co_send_request(bs, &request, NULL, &conn);
     if (ret < 0) {
         return ret;
     }
 
-    ret = nbd_co_receive_cmdread_reply(client, request.handle, offset, qiov,
+    ret = nbd_co_receive_cmdread_reply(conn, request.handle, offset, qiov,
                                        &local_err);
     if (local_err) {
         error_report_err(local_err);
@@ -901,6 +932,7 @@ int coroutine_fn nbd_client_co_block_status(BlockDriverState *bs,
     int64_t ret;
     NBDExtent extent = { 0 };
     NBDClientSession *client = nbd_get_client_session(bs);
+    NBDClientConnection *conn;
     Error *local_err = NULL;
 
     NBDRequest request = {
@@ -917,12 +949,12 @@ int coroutine_fn nbd_client_co_block_status(BlockDriverState *bs,
         return BDRV_BLOCK_DATA;
     }
 
-    ret = nbd_co_send_request(bs, &request, NULL);
+    ret = nbd_co_send_request(bs, &request, NULL, &conn);
     if (ret < 0) {
         return ret;
     }
 
-    ret = nbd_co_receive_blockstatus_reply(client, request.handle, bytes,
+    ret = nbd_co_receive_blockstatus_reply(conn, request.handle, bytes,
                                            &extent, &local_err);
     if (local_err) {
         error_report_err(local_err);
@@ -940,29 +972,97 @@ int coroutine_fn nbd_client_co_block_status(BlockDriverState *bs,
 void nbd_client_detach_aio_context(BlockDriverState *bs)
 {
     NBDClientSession *client = nbd_get_client_session(bs);
-    qio_channel_detach_aio_context(QIO_CHANNEL(client->ioc));
+    int i;
+
+    for (i = 0; i < client->num_conns; i++) {
+        qio_channel_detach_aio_context(QIO_CHANNEL(client->conns[i].ioc));
+    }
 }
 
 void nbd_client_attach_aio_context(BlockDriverState *bs,
                                    AioContext *new_context)
 {
     NBDClientSession *client = nbd_get_client_session(bs);
-    qio_channel_attach_aio_context(QIO_CHANNEL(client->ioc), new_context);
-    aio_co_schedule(new_context, client->read_reply_co);
+    int i;
+
+    for (i = 0; i < client->num_conns; i++) {
+        NBDClientConnection *conn = &client->conns[i];
+
+        qio_channel_attach_aio_context(QIO_CHANNEL(conn->ioc), new_context);
+        aio_co_schedule(new_context, conn->read_reply_co);
+    }
 }
 
 void nbd_client_close(BlockDriverState *bs)
 {
     NBDClientSession *client = nbd_get_client_session(bs);
     NBDRequest request = { .type = NBD_CMD_DISC };
+    int i;
 
-    if (client->ioc == NULL) {
-        return;
+    for (i = 0; i < client->num_conns; i++) {
+        NBDClientConnection *conn = &client->conns[i];
+
+        if (conn->ioc == NULL) {
+            continue;
+        }
+
+        nbd_send_request(conn->ioc, &request);
+
+        nbd_teardown_connection(bs, conn);
+    }
+}
+
+/* nbd_client_connect
+ * Negotiate with the server over @sioc and start the reply coroutine of
+ * @conn in the AioContext of @bs.
+ */
+static int nbd_client_connect(BlockDriverState *bs,
+                              NBDClientConnection *conn,
+                              QIOChannelSocket *sioc,
+                              const char *export,
+                              QCryptoTLSCreds *tlscreds,
+                              const char *hostname,
+                              const char *x_dirty_bitmap,
+                              Error **errp)
+{
+    int ret;
+
+    /* NBD handshake */
+    logout("session init %s\n", export);
+    qio_channel_set_blocking(QIO_CHANNEL(sioc), true, NULL);
+
+    conn->info.request_sizes = true;
+    conn->info.structured_reply = true;
+    conn->info.base_allocation = true;
+    conn->info.x_dirty_bitmap = g_strdup(x_dirty_bitmap);
+    ret = nbd_receive_negotiate(QIO_CHANNEL(sioc), export,
+                                tlscreds, hostname,
+                                &conn->ioc, &conn->info, errp);
+    g_free(conn->info.x_dirty_bitmap);
+    if (ret < 0) {
+        logout("Failed to negotiate with the NBD server\n");
+        return ret;
     }
 
-    nbd_send_request(client->ioc, &request);
+    qemu_co_mutex_init(&conn->send_mutex);
+    qemu_co_queue_init(&conn->free_sema);
+    conn->sioc = sioc;
+    object_ref(OBJECT(conn->sioc));
+
+    if (!conn->ioc) {
+        conn->ioc = QIO_CHANNEL(sioc);
+        object_ref(OBJECT(conn->ioc));
+    }
 
-    nbd_teardown_connection(bs);
+    /* Now that we're connected, set the socket to be non-blocking and
+     * kick the reply mechanism.  */
+    qio_channel_set_blocking(QIO_CHANNEL(sioc), false, NULL);
+    conn->read_reply_co = qemu_coroutine_create(nbd_read_reply_entry, conn);
+    qio_channel_attach_aio_context(QIO_CHANNEL(conn->ioc),
+                                   bdrv_get_aio_context(bs));
+    aio_co_schedule(bdrv_get_aio_context(bs), conn->read_reply_co);
+
+    return 0;
 }
 
 int nbd_client_init(BlockDriverState *bs,
@@ -974,30 +1074,26 @@ int nbd_client_init(BlockDriverState *bs,
                     Error **errp)
 {
     NBDClientSession *client = nbd_get_client_session(bs);
+    NBDClientConnection *conn = &client->conns[0];
     int ret;
 
-    /* NBD handshake */
-    logout("session init %s\n", export);
-    qio_channel_set_blocking(QIO_CHANNEL(sioc), true, NULL);
-
-    client->info.request_sizes = true;
-    client->info.structured_reply = true;
-    client->info.base_allocation = true;
-    client->info.x_dirty_bitmap = g_strdup(x_dirty_bitmap);
-    ret = nbd_receive_negotiate(QIO_CHANNEL(sioc), export,
-                                tlscreds, hostname,
-                                &client->ioc, &client->info, errp);
-    g_free(client->info.x_dirty_bitmap);
+    ret = nbd_client_connect(bs, conn, sioc, export, tlscreds, hostname,
+                             x_dirty_bitmap, errp);
     if (ret < 0) {
-        logout("Failed to negotiate with the NBD server\n");
         return ret;
     }
-    if (client->info.flags & NBD_FLAG_READ_ONLY &&
+    if (conn->info.flags & NBD_FLAG_READ_ONLY &&
         !bdrv_is_read_only(bs)) {
         error_setg(errp,
                    "request for write access conflicts with read-only export");
+        nbd_teardown_connection(bs, conn);
         return -EACCES;
     }
+
+    client->info = conn->info;
+    client->num_conns = 1;
+    client->next_conn = 0;
+
     if (client->info.flags & NBD_FLAG_SEND_FUA) {
         bs->supported_write_flags = BDRV_REQ_FUA;
         bs->supported_zero_flags |= BDRV_REQ_FUA;
@@ -1006,22 +1102,54 @@ int nbd_client_init(BlockDriverState *bs,
         bs->supported_zero_flags |= BDRV_REQ_MAY_UNMAP;
     }
 
-    qemu_co_mutex_init(&client->send_mutex);
-    qemu_co_queue_init(&client->free_sema);
-    client->sioc = sioc;
-    object_ref(OBJECT(client->sioc));
+    logout("Established connection with NBD server\n");
+    return 0;
+}
+
+/* Several connections may only be used if the server promises that they
+ * all see a consistent view of the export, which is trivially the case
+ * when nothing can write to it. */
+bool nbd_client_can_multi_conn(BlockDriverState *bs)
+{
+    NBDClientSession *client = nbd_get_client_session(bs);
+
+    return client->info.flags & (NBD_FLAG_CAN_MULTI_CONN | NBD_FLAG_READ_ONLY);
+}
+
+int nbd_client_add_connection(BlockDriverState *bs,
+                              QIOChannelSocket *sioc,
+                              const char *export,
+                              QCryptoTLSCreds *tlscreds,
+                              const char *hostname,
+                              const char *x_dirty_bitmap,
+                              Error **errp)
+{
+    NBDClientSession *client = nbd_get_client_session(bs);
+    NBDClientConnection *conn;
+    int ret;
+
+    assert(client->num_conns > 0 && client->num_conns < MAX_NBD_CONNECTIONS);
+    conn = &client->conns[client->num_conns];
 
-    if (!client->ioc) {
-        client->ioc = QIO_CHANNEL(sioc);
-        object_ref(OBJECT(client->ioc));
+    ret = nbd_client_connect(bs, conn, sioc, export, tlscreds, hostname,
+                             x_dirty_bitmap, errp);
+    if (ret < 0) {
+        return ret;
     }
 
-    /* Now that we're connected, set the socket to be non-blocking and
-     * kick the reply mechanism.  */
-    qio_channel_set_blocking(QIO_CHANNEL(sioc), false, NULL);
-    client->read_reply_co = qemu_coroutine_create(nbd_read_reply_entry, client);
-    nbd_client_attach_aio_context(bs, bdrv_get_aio_context(bs));
+    /* Requests are spread over all connections, so they must all accept
+     * the same ones. */
+    if (conn->info.size != client->info.size ||
+        conn->info.flags != client->info.flags ||
+        conn->info.structured_reply != client->info.structured_reply ||
+        conn->info.base_allocation != client->info.base_allocation) {
+        error_setg(errp, "NBD server sent inconsistent export information "
+                   "on connection %d", client->num_conns);
+        nbd_teardown_connection(bs, conn);
+        return -EINVAL;
+    }
 
-    logout("Established connection with NBD server\n");
+    client->num_conns++;
+    logout("Established connection %d with NBD server\n", client->num_conns);
     return 0;
 }
@@ -15,7 +15,8 @@
 #define logout(fmt, ...) ((void)0)
 #endif
 
-#define MAX_NBD_REQUESTS    16
+#define MAX_NBD_REQUESTS    64
+#define MAX_NBD_CONNECTIONS 16
 
 typedef struct {
     Coroutine *coroutine;
@@ -23,7 +24,9 @@ typedef struct {
     bool receiving;         /* waiting for read_reply_co? */
 } NBDClientRequest;
 
-typedef struct NBDClientSession {
+/* One socket to the server, with its own request window and reply
+ * coroutine.  Handles are only unique within a connection. */
+typedef struct NBDClientConnection {
     QIOChannelSocket *sioc; /* The master data channel */
     QIOChannel *ioc; /* The current I/O channel which may differ (eg TLS) */
     NBDExportInfo info;
@@ -36,6 +39,16 @@ typedef struct NBDClientSession {
     NBDClientRequest requests[MAX_NBD_REQUESTS];
     NBDReply reply;
     bool quit;
+} NBDClientConnection;
+
+typedef struct NBDClientSession {
+    /* Export information negotiated on the first connection; any further
+     * connection must agree with it. */
+    NBDExportInfo info;
+
+    NBDClientConnection conns[MAX_NBD_CONNECTIONS];
+    int num_conns;
+    int next_conn;
 } NBDClientSession;
 
 NBDClientSession *nbd_get_client_session(BlockDriverState *bs);
@@ -47,6 +60,14 @@ int nbd_client_init(BlockDriverState *bs,
                     const char *hostname,
                     const char *x_dirty_bitmap,
                     Error **errp);
+bool nbd_client_can_multi_conn(BlockDriverState *bs);
+int nbd_client_add_connection(BlockDriverState *bs,
+                              QIOChannelSocket *sock,
+                              const char *export_name,
+                              QCryptoTLSCreds *tlscreds,
+                              const char *hostname,
+                              const char *x_dirty_bitmap,
+                              Error **errp);
 void nbd_client_close(BlockDriverState *bs);
 
 int nbd_client_co_pdiscard(BlockDriverState *bs, int64_t offset, int bytes);
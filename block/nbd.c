@@ -384,6 +384,12 @@ static QemuOptsList nbd_runtime_opts = {
             .help = "experimental: expose named dirty bitmap in place of "
                     "block status",
         },
+        {
+            .name = "multi-conn",
+            .type = QEMU_OPT_NUMBER,
+            .help = "Number of connections to open to the server, if it "
+                    "allows more than one (default: 1)",
+        },
         { /* end of list */ }
     },
 };
@@ -397,7 +403,9 @@ static int nbd_open(BlockDriverState *bs, QDict *options, int flags,
     QIOChannelSocket *sioc = NULL;
     QCryptoTLSCreds *tlscreds = NULL;
     const char *hostname = NULL;
-    int ret = -EINVAL;
+    const char *x_dirty_bitmap;
+    uint64_t num_conns;
+    int i, ret = -EINVAL;
 
     opts = qemu_opts_create(&nbd_runtime_opts, NULL, 0, &error_abort);
     qemu_opts_absorb_qdict(opts, options, &local_err);
@@ -434,6 +442,13 @@ static int nbd_open(BlockDriverState *bs, QDict *options, int flags,
         hostname = s->saddr->u.inet.host;
     }
 
+    num_conns = qemu_opt_get_number(opts, "multi-conn", 1);
+    if (num_conns < 1 || num_conns > MAX_NBD_CONNECTIONS) {
+        error_setg(errp, "multi-conn must be between 1 and %d",
+                   MAX_NBD_CONNECTIONS);
+        goto error;
+    }
+
     /* establish TCP connection, return error if it fails
      * TODO: Configurable retry-until-timeout behaviour.
      */
@@ -444,8 +459,33 @@ static int nbd_open(BlockDriverState *bs, QDict *options, int flags,
     }
 
     /* NBD handshake */
+    x_dirty_bitmap = qemu_opt_get(opts, "x-dirty-bitmap");
     ret = nbd_client_init(bs, sioc, s->export, tlscreds, hostname,
-                          qemu_opt_get(opts, "x-dirty-bitmap"), errp);
+                          x_dirty_bitmap, errp);
+    if (ret < 0) {
+        goto error;
+    }
+
+    /* Servers that cannot keep several connections coherent only get
+     * one, without complaint, so that the option can be set blindly. */
+    if (!nbd_client_can_multi_conn(bs)) {
+        num_conns = 1;
+    }
+    for (i = 1; i < num_conns; i++) {
+        object_unref(OBJECT(sioc));
+        sioc = nbd_establish_connection(s->saddr, errp);
+        if (!sioc) {
+            ret = -ECONNREFUSED;
+        } else {
+            ret = nbd_client_add_connection(bs, sioc, s->export, tlscreds,
+                                            hostname, x_dirty_bitmap, errp);
+        }
+        if (ret < 0) {
+            nbd_client_close(bs);
+            goto error;
+        }
+    }
+
  error:
     if (sioc) {
         object_unref(OBJECT(sioc));
@@ -29,6 +29,10 @@
 #define NVME_CQ_ENTRY_BYTES 16
 #define NVME_QUEUE_SIZE 128
 #define NVME_BAR_SIZE 8192
+#define NVME_MAX_IO_QUEUES 64
+
+/* Set Features identifier for the number of I/O queues */
+#define NVME_FEAT_NUM_QUEUES 0x07
 
 typedef struct {
     int32_t  head, tail;
@@ -115,6 +119,7 @@ typedef struct {
 
 #define NVME_BLOCK_OPT_DEVICE "device"
 #define NVME_BLOCK_OPT_NAMESPACE "namespace"
+#define NVME_BLOCK_OPT_NUM_QUEUES "num-queues"
 
 static QemuOptsList runtime_opts = {
     .name = "nvme",
@@ -130,6 +135,11 @@ static QemuOptsList runtime_opts = {
             .type = QEMU_OPT_NUMBER,
             .help = "NVMe namespace",
         },
+        {
+            .name = NVME_BLOCK_OPT_NUM_QUEUES,
+            .type = QEMU_OPT_NUMBER,
+            .help = "Number of I/O queue pairs to create (default: 1)",
+        },
         { /* end of list */ }
     },
 };
@@ -535,6 +545,49 @@ static bool nvme_add_io_queue(BlockDriverState *bs, Error **errp)
     return true;
 }
 
+/* Ask the controller for @nr I/O queue pairs */
+static bool nvme_set_num_io_queues(BlockDriverState *bs, int nr, Error **errp)
+{
+    BDRVNVMeState *s = bs->opaque;
+    NvmeCmd cmd = {
+        .opcode = NVME_ADM_CMD_SET_FEATURES,
+        .cdw10 = cpu_to_le32(NVME_FEAT_NUM_QUEUES),
+        .cdw11 = cpu_to_le32(((nr - 1) << 16) | (nr - 1)),
+    };
+
+    if (nvme_cmd_sync(bs, s->queues[0], &cmd)) {
+        error_setg(errp, "Failed to set the number of io queues to %d", nr);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Pick the I/O queue pair for a new request: the one with the fewest
+ * requests queued or in flight.  Every queue pair has its own lock and
+ * its own slots, so spreading requests lets the controller work on more
+ * than NVME_QUEUE_SIZE - 1 of them at once and keeps one busy queue
+ * from making the others wait for a free slot.
+ */
+static NVMeQueuePair *nvme_select_io_queue(BDRVNVMeState *s)
+{
+    NVMeQueuePair *best = s->queues[1];
+    int best_load = atomic_read(&best->inflight) +
+                    atomic_read(&best->need_kick);
+    int i;
+
+    for (i = 2; i < s->nr_queues && best_load; i++) {
+        NVMeQueuePair *q = s->queues[i];
+        int load = atomic_read(&q->inflight) + atomic_read(&q->need_kick);
+
+        if (load < best_load) {
+            best = q;
+            best_load = load;
+        }
+    }
+    return best;
+}
+
 static bool nvme_poll_cb(void *opaque)
 {
     EventNotifier *e = opaque;
@@ -547,10 +600,11 @@ static bool nvme_poll_cb(void *opaque)
 }
 
 static int nvme_init(BlockDriverState *bs, const char *device, int namespace,
-                     Error **errp)
+                     int num_queues, Error **errp)
 {
     BDRVNVMeState *s = bs->opaque;
     int ret;
+    int i;
     uint64_t cap;
     uint64_t timeout_ms;
     uint64_t deadline, now;
@@ -653,10 +707,23 @@ static int nvme_init(BlockDriverState *bs, const char *device, int namespace,
     }
 
     /* Set up command queues. */
-    if (!nvme_add_io_queue(bs, errp)) {
+    if (num_queues > 1 && !nvme_set_num_io_queues(bs, num_queues, errp)) {
         ret = -EIO;
         goto fail_handler;
     }
+    for (i = 0; i < num_queues; i++) {
+        if (!nvme_add_io_queue(bs, i ? &local_err : errp)) {
+            if (!i) {
+                ret = -EIO;
+                goto fail_handler;
+            }
+            /* The controller may grant fewer queues than asked for */
+            warn_reportf_err(local_err, "nvme: using %d io queues instead "
+                             "of %d: ", i, num_queues);
+            local_err = NULL;
+            break;
+        }
+    }
     return 0;
 
 fail_handler:
@@ -751,6 +818,7 @@ static int nvme_file_open(BlockDriverState *bs, QDict *options, int flags,
     const char *device;
     QemuOpts *opts;
     int namespace;
+    int64_t num_queues;
     int ret;
     BDRVNVMeState *s = bs->opaque;
 
@@ -764,7 +832,14 @@ static int nvme_file_open(BlockDriverState *bs, QDict *options, int flags,
     }
 
     namespace = qemu_opt_get_number(opts, NVME_BLOCK_OPT_NAMESPACE, 1);
-    ret = nvme_init(bs, device, namespace, errp);
+    num_queues = qemu_opt_get_number(opts, NVME_BLOCK_OPT_NUM_QUEUES, 1);
+    if (num_queues < 1 || num_queues > NVME_MAX_IO_QUEUES) {
+        error_setg(errp, "'" NVME_BLOCK_OPT_NUM_QUEUES "' must be between "
+                   "1 and %d", NVME_MAX_IO_QUEUES);
+        qemu_opts_del(opts);
+        return -EINVAL;
+    }
+    ret = nvme_init(bs, device, namespace, num_queues, errp);
     qemu_opts_del(opts);
     if (ret) {
         goto fail;
@@ -926,7 +1001,7 @@ static coroutine_fn int nvme_co_prw_aligned(BlockDriverState *bs,
 {
     int r;
     BDRVNVMeState *s = bs->opaque;
-    NVMeQueuePair *ioq = s->queues[1];
+    NVMeQueuePair *ioq;
     NVMeRequest *req;
     uint32_t cdw12 = (((bytes >> BDRV_SECTOR_BITS) - 1) & 0xFFFF) |
                        (flags & BDRV_REQ_FUA ? 1 << 30 : 0);
@@ -944,6 +1019,7 @@ static coroutine_fn int nvme_co_prw_aligned(BlockDriverState *bs,
 
     trace_nvme_prw_aligned(s, is_write, offset, bytes, flags, qiov->niov);
     assert(s->nr_queues > 1);
+    ioq = nvme_select_io_queue(s);
     req = nvme_get_free_req(ioq);
     assert(req);
 
@@ -425,6 +425,24 @@ static void bdrv_latency_histogram_stats(BlockLatencyHistogram *hist,
     }
 }
 
+static void bdrv_latency_percentiles(BlockAcctStats *stats,
+                                     enum BlockAcctType type,
+                                     bool *not_null,
+                                     BlockLatencyPercentiles **info)
+{
+    uint64_t count = block_acct_latency_count(stats, type);
+
+    *not_null = count != 0;
+    if (*not_null) {
+        *info = g_new0(BlockLatencyPercentiles, 1);
+
+        (*info)->count = count;
+        (*info)->p50 = block_acct_latency_percentile(stats, type, 500);
+        (*info)->p99 = block_acct_latency_percentile(stats, type, 990);
+        (*info)->p999 = block_acct_latency_percentile(stats, type, 999);
+    }
+}
+
 static void bdrv_query_blk_stats(BlockDeviceStats *ds, BlockBackend *blk)
 {
     BlockAcctStats *stats = blk_get_stats(blk);
@@ -500,6 +518,16 @@ static void bdrv_query_blk_stats(BlockDeviceStats *ds, BlockBackend *blk)
     bdrv_latency_histogram_stats(&stats->latency_histogram[BLOCK_ACCT_FLUSH],
                                  &ds->has_x_flush_latency_histogram,
                                  &ds->x_flush_latency_histogram);
+
+    bdrv_latency_percentiles(stats, BLOCK_ACCT_READ,
+                             &ds->has_rd_latency_percentiles,
+                             &ds->rd_latency_percentiles);
+    bdrv_latency_percentiles(stats, BLOCK_ACCT_WRITE,
+                             &ds->has_wr_latency_percentiles,
+                             &ds->wr_latency_percentiles);
+    bdrv_latency_percentiles(stats, BLOCK_ACCT_FLUSH,
+                             &ds->has_flush_latency_percentiles,
+                             &ds->flush_latency_percentiles);
 }
 
 static BlockStats *bdrv_query_bds_stats(BlockDriverState *bs,
@@ -529,6 +557,11 @@ static BlockStats *bdrv_query_bds_stats(BlockDriverState *bs,
 
     s->stats->wr_highest_offset = stat64_get(&bs->wr_highest_offset);
 
+    s->driver_specific = bdrv_get_specific_stats(bs);
+    if (s->driver_specific) {
+        s->has_driver_specific = true;
+    }
+
     if (bs->file) {
         s->has_parent = true;
         s->parent = bdrv_query_bds_stats(bs->file->bs, blk_level);
@@ -87,11 +87,19 @@ typedef struct Qcow2Bitmap {
     char *name;
 
     BdrvDirtyBitmap *dirty_bitmap;
+    bool in_place; /* table stays in use, so it is not freed on error */
 
     QSIMPLEQ_ENTRY(Qcow2Bitmap) entry;
 } Qcow2Bitmap;
 typedef QSIMPLEQ_HEAD(Qcow2BitmapList, Qcow2Bitmap) Qcow2BitmapList;
 
+/* Stored bitmap a BdrvDirtyBitmap is being lazily loaded from */
+typedef struct Qcow2BitmapLazyLoad {
+    BlockDriverState *bs;
+    Qcow2BitmapTable table;
+    uint64_t *bitmap_table;
+} Qcow2BitmapLazyLoad;
+
 typedef enum BitmapType {
     BT_DIRTY_TRACKING_BITMAP = 1
 } BitmapType;
@@ -280,70 +288,51 @@ static uint64_t bytes_covered_by_bitmap_cluster(const BDRVQcow2State *s,
     return limit;
 }
 
-/* load_bitmap_data
- * @bitmap_table entries must satisfy specification constraints.
- * @bitmap must be cleared */
-static int load_bitmap_data(BlockDriverState *bs,
-                            const uint64_t *bitmap_table,
-                            uint32_t bitmap_table_size,
-                            BdrvDirtyBitmap *bitmap)
+/* load_bitmap_chunk
+ * BdrvDirtyBitmapLoadFunc for bitmaps loaded by load_bitmap().
+ * Reads the data covered by one bitmap table entry. */
+static int load_bitmap_chunk(BdrvDirtyBitmap *bitmap, uint64_t offset,
+                             uint64_t bytes, uint8_t *buf, void *opaque)
 {
-    int ret = 0;
-    BDRVQcow2State *s = bs->opaque;
-    uint64_t offset, limit;
-    uint64_t bm_size = bdrv_dirty_bitmap_size(bitmap);
-    uint8_t *buf = NULL;
-    uint64_t i, tab_size =
-            size_to_clusters(s,
-                bdrv_dirty_bitmap_serialization_size(bitmap, 0, bm_size));
-
-    if (tab_size != bitmap_table_size || tab_size > BME_MAX_TABLE_SIZE) {
-        return -EINVAL;
-    }
-
-    buf = g_malloc(s->cluster_size);
-    limit = bytes_covered_by_bitmap_cluster(s, bitmap);
-    for (i = 0, offset = 0; i < tab_size; ++i, offset += limit) {
-        uint64_t count = MIN(bm_size - offset, limit);
-        uint64_t entry = bitmap_table[i];
-        uint64_t data_offset = entry & BME_TABLE_ENTRY_OFFSET_MASK;
+    Qcow2BitmapLazyLoad *ll = opaque;
+    BDRVQcow2State *s = ll->bs->opaque;
+    uint64_t limit = bytes_covered_by_bitmap_cluster(s, bitmap);
+    uint64_t entry, data_offset, size;
+    int ret;
 
-        assert(check_table_entry(entry, s->cluster_size) == 0);
+    assert(offset % limit == 0 && offset / limit < ll->table.size);
+    entry = ll->bitmap_table[offset / limit];
+    data_offset = entry & BME_TABLE_ENTRY_OFFSET_MASK;
+    size = bdrv_dirty_bitmap_serialization_size(bitmap, offset, bytes);
+    assert(size <= s->cluster_size);
 
-        if (data_offset == 0) {
-            if (entry & BME_TABLE_ENTRY_FLAG_ALL_ONES) {
-                bdrv_dirty_bitmap_deserialize_ones(bitmap, offset, count,
-                                                   false);
-            } else {
-                /* No need to deserialize zeros because the dirty bitmap is
-                 * already cleared */
-            }
-        } else {
-            ret = bdrv_pread(bs->file, data_offset, buf, s->cluster_size);
-            if (ret < 0) {
-                goto finish;
-            }
-            bdrv_dirty_bitmap_deserialize_part(bitmap, buf, offset, count,
-                                               false);
-        }
+    if (data_offset == 0) {
+        memset(buf, entry & BME_TABLE_ENTRY_FLAG_ALL_ONES ? 0xff : 0, size);
+        return 0;
     }
-    ret = 0;
 
-    bdrv_dirty_bitmap_deserialize_finish(bitmap);
+    ret = bdrv_pread(ll->bs->file, data_offset, buf, size);
+    return ret < 0 ? ret : 0;
+}
 
-finish:
-    g_free(buf);
+static void lazy_load_free(void *opaque)
+{
+    Qcow2BitmapLazyLoad *ll = opaque;
 
-    return ret;
+    g_free(ll->bitmap_table);
+    g_free(ll);
 }
 
 static BdrvDirtyBitmap *load_bitmap(BlockDriverState *bs,
                                     Qcow2Bitmap *bm, Error **errp)
 {
     int ret;
+    BDRVQcow2State *s = bs->opaque;
     uint64_t *bitmap_table = NULL;
     uint32_t granularity;
     BdrvDirtyBitmap *bitmap = NULL;
+    Qcow2BitmapLazyLoad *ll;
+    uint64_t bm_size, tab_size;
 
     if (bm->flags & BME_FLAG_IN_USE) {
         error_setg(errp, "Bitmap '%s' is in use", bm->name);
@@ -364,14 +353,26 @@ static BdrvDirtyBitmap *load_bitmap(BlockDriverState *bs,
         goto fail;
     }
 
-    ret = load_bitmap_data(bs, bitmap_table, bm->table.size, bitmap);
-    if (ret < 0) {
-        error_setg_errno(errp, -ret, "Could not read bitmap '%s' from image",
+    bm_size = bdrv_dirty_bitmap_size(bitmap);
+    tab_size = size_to_clusters(s,
+        bdrv_dirty_bitmap_serialization_size(bitmap, 0, bm_size));
+    if (tab_size != bm->table.size || tab_size > BME_MAX_TABLE_SIZE) {
+        error_setg_errno(errp, EINVAL, "Could not read bitmap '%s' from image",
                          bm->name);
         goto fail;
     }
 
-    g_free(bitmap_table);
+    /* The data clusters are only read when the bitmap contents are needed;
+     * they stay in place while the bitmap is marked in use. */
+    ll = g_new0(Qcow2BitmapLazyLoad, 1);
+    ll->bs = bs;
+    ll->table.offset = bm->table.offset;
+    ll->table.size = bm->table.size;
+    ll->bitmap_table = bitmap_table;
+    bdrv_dirty_bitmap_set_lazy_load(bitmap,
+                                    bytes_covered_by_bitmap_cluster(s, bitmap),
+                                    load_bitmap_chunk, ll, lazy_load_free);
+
     return bitmap;
 
 fail:
@@ -1202,6 +1203,13 @@ static int store_bitmap(BlockDriverState *bs, Qcow2Bitmap *bm, Error **errp)
 
     bm_name = bdrv_dirty_bitmap_name(bitmap);
 
+    /* The old table is dropped once the new one is written */
+    ret = bdrv_dirty_bitmap_load_all(bitmap, errp);
+    if (ret < 0) {
+        return ret;
+    }
+    bdrv_dirty_bitmap_drop_lazy_load(bitmap);
+
     tb = store_bitmap_data(bs, bitmap, &tb_size, errp);
     if (tb == NULL) {
         return -EINVAL;
@@ -1252,6 +1260,140 @@ fail:
     return ret;
 }
 
+/* store_bitmap_in_place()
+ * Update the clusters of a lazily loaded bitmap that changed since they were
+ * loaded, keeping its bitmap table where it is.  Entries whose data became
+ * all zeroes are cleared and their clusters freed.
+ */
+static int store_bitmap_in_place(BlockDriverState *bs, Qcow2Bitmap *bm,
+                                 Qcow2BitmapLazyLoad *ll, Error **errp)
+{
+    BDRVQcow2State *s = bs->opaque;
+    BdrvDirtyBitmap *bitmap = bm->dirty_bitmap;
+    const char *bm_name = bdrv_dirty_bitmap_name(bitmap);
+    uint64_t bm_size = bdrv_dirty_bitmap_size(bitmap);
+    uint64_t limit = bytes_covered_by_bitmap_cluster(s, bitmap);
+    uint32_t tb_size = ll->table.size;
+    uint64_t *tb, *be_tb;
+    uint8_t *buf;
+    bool tb_changed = false;
+    uint32_t i;
+    int ret = 0;
+
+    tb = g_memdup(ll->bitmap_table, tb_size * sizeof(tb[0]));
+    buf = g_malloc(s->cluster_size);
+
+    for (i = 0; i < tb_size; i++) {
+        uint64_t offset = i * limit;
+        uint64_t count = MIN(bm_size - offset, limit);
+        uint64_t write_size;
+        int64_t off;
+
+        if (!bdrv_dirty_bitmap_changed(bitmap, offset, count)) {
+            continue;
+        }
+
+        /* Bits only ever get added to the stored data by loading it */
+        ret = bdrv_dirty_bitmap_load(bitmap, offset, count, errp);
+        if (ret < 0) {
+            goto fail;
+        }
+
+        write_size = bdrv_dirty_bitmap_serialization_size(bitmap, offset,
+                                                          count);
+        assert(write_size <= s->cluster_size);
+        bdrv_dirty_bitmap_serialize_part(bitmap, buf, offset, count);
+
+        if (buffer_is_zero(buf, write_size)) {
+            if (tb[i]) {
+                tb[i] = 0;
+                tb_changed = true;
+            }
+            continue;
+        }
+
+        off = tb[i] & BME_TABLE_ENTRY_OFFSET_MASK;
+        if (off == 0) {
+            off = qcow2_alloc_clusters(bs, s->cluster_size);
+            if (off < 0) {
+                error_setg_errno(errp, -off,
+                                 "Failed to allocate clusters for bitmap '%s'",
+                                 bm_name);
+                ret = off;
+                goto fail;
+            }
+            tb[i] = off;
+            tb_changed = true;
+        }
+
+        if (write_size < s->cluster_size) {
+            memset(buf + write_size, 0, s->cluster_size - write_size);
+        }
+
+        ret = qcow2_pre_write_overlap_check(bs, 0, off, s->cluster_size);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Qcow2 overlap check failed");
+            goto fail;
+        }
+
+        ret = bdrv_pwrite(bs->file, off, buf, s->cluster_size);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Failed to write bitmap '%s' to file",
+                             bm_name);
+            goto fail;
+        }
+    }
+
+    if (tb_changed) {
+        ret = qcow2_pre_write_overlap_check(bs, 0, ll->table.offset,
+                                            tb_size * sizeof(tb[0]));
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Qcow2 overlap check failed");
+            goto fail;
+        }
+
+        be_tb = g_memdup(tb, tb_size * sizeof(tb[0]));
+        bitmap_table_to_be(be_tb, tb_size);
+        ret = bdrv_pwrite(bs->file, ll->table.offset, be_tb,
+                          tb_size * sizeof(tb[0]));
+        g_free(be_tb);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Failed to write bitmap '%s' to file",
+                             bm_name);
+            goto fail;
+        }
+
+        for (i = 0; i < tb_size; i++) {
+            uint64_t old = ll->bitmap_table[i] & BME_TABLE_ENTRY_OFFSET_MASK;
+            if (old && !(tb[i] & BME_TABLE_ENTRY_OFFSET_MASK)) {
+                qcow2_free_clusters(bs, old, s->cluster_size,
+                                    QCOW2_DISCARD_OTHER);
+            }
+        }
+    }
+
+    g_free(ll->bitmap_table);
+    ll->bitmap_table = tb;
+    bdrv_dirty_bitmap_reset_changed(bitmap);
+    g_free(buf);
+
+    return 0;
+
+fail:
+    /* The on-disk table still points to the old clusters only */
+    for (i = 0; i < tb_size; i++) {
+        uint64_t new = tb[i] & BME_TABLE_ENTRY_OFFSET_MASK;
+        if (new && !(ll->bitmap_table[i] & BME_TABLE_ENTRY_OFFSET_MASK)) {
+            qcow2_free_clusters(bs, new, s->cluster_size,
+                                QCOW2_DISCARD_OTHER);
+        }
+    }
+    g_free(tb);
+    g_free(buf);
+
+    return ret;
+}
+
 static Qcow2Bitmap *find_bitmap_by_name(Qcow2BitmapList *bm_list,
                                         const char *name)
 {
@@ -1378,15 +1520,25 @@ void qcow2_store_persistent_dirty_bitmaps(BlockDriverState *bs, Error **errp)
             bm->name = g_strdup(name);
             QSIMPLEQ_INSERT_TAIL(bm_list, bm, entry);
         } else {
+            Qcow2BitmapLazyLoad *ll =
+                bdrv_dirty_bitmap_lazy_load_opaque(bitmap, load_bitmap_chunk);
+
             if (!(bm->flags & BME_FLAG_IN_USE)) {
                 error_setg(errp, "Bitmap '%s' already exists in the image",
                            name);
                 goto fail;
             }
-            tb = g_memdup(&bm->table, sizeof(bm->table));
-            bm->table.offset = 0;
-            bm->table.size = 0;
-            QSIMPLEQ_INSERT_TAIL(&drop_tables, tb, entry);
+            if (ll && ll->table.offset == bm->table.offset &&
+                ll->table.size == bm->table.size)
+            {
+                /* Still backed by the stored data, update it in place */
+                bm->in_place = true;
+            } else {
+                tb = g_memdup(&bm->table, sizeof(bm->table));
+                bm->table.offset = 0;
+                bm->table.size = 0;
+                QSIMPLEQ_INSERT_TAIL(&drop_tables, tb, entry);
+            }
         }
         bm->flags = bdrv_dirty_bitmap_enabled(bitmap) ? BME_FLAG_AUTO : 0;
         bm->granularity_bits = ctz32(bdrv_dirty_bitmap_granularity(bitmap));
@@ -1399,7 +1551,14 @@ void qcow2_store_persistent_dirty_bitmaps(BlockDriverState *bs, Error **errp)
             continue;
         }
 
-        ret = store_bitmap(bs, bm, errp);
+        if (bm->in_place) {
+            ret = store_bitmap_in_place(bs, bm,
+                bdrv_dirty_bitmap_lazy_load_opaque(bm->dirty_bitmap,
+                                                   load_bitmap_chunk),
+                errp);
+        } else {
+            ret = store_bitmap(bs, bm, errp);
+        }
         if (ret < 0) {
             goto fail;
         }
@@ -1423,7 +1582,8 @@ void qcow2_store_persistent_dirty_bitmaps(BlockDriverState *bs, Error **errp)
 
 fail:
     QSIMPLEQ_FOREACH(bm, bm_list, entry) {
-        if (bm->dirty_bitmap == NULL || bm->table.offset == 0) {
+        if (bm->dirty_bitmap == NULL || bm->in_place ||
+            bm->table.offset == 0) {
             continue;
         }
 
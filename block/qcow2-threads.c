@@ -0,0 +1,377 @@
+/*
+ * Threaded data processing for Qcow2: compression, encryption
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+
+#define ZLIB_CONST
+#include <zlib.h>
+#ifdef CONFIG_ZSTD
+#include <zstd.h>
+#endif
+
+#include "qcow2.h"
+#include "block/thread-pool.h"
+
+/*
+ * Run @func(@arg) in the thread pool of the node's AioContext, with at most
+ * s->max_threads of them in flight at once.  Must not be called with
+ * s->lock held, so that other requests can make progress meanwhile.
+ */
+int coroutine_fn qcow2_co_process(BlockDriverState *bs, ThreadPoolFunc *func,
+                                  void *arg)
+{
+    BDRVQcow2State *s = bs->opaque;
+    ThreadPool *pool = aio_get_thread_pool(bdrv_get_aio_context(bs));
+    int ret;
+
+    while (s->nb_threads >= s->max_threads) {
+        qemu_co_queue_wait(&s->thread_task_queue, NULL);
+    }
+
+    s->nb_threads++;
+    ret = thread_pool_submit_co(pool, func, arg);
+    s->nb_threads--;
+
+    qemu_co_queue_next(&s->thread_task_queue);
+
+    return ret;
+}
+
+
+typedef int Qcow2EncDecFunc(QCryptoBlock *block, uint64_t offset,
+                            uint8_t *buf, size_t len, Error **errp);
+
+typedef struct Qcow2EncDecData {
+    QCryptoBlock *block;
+    uint64_t offset;
+    uint8_t *buf;
+    size_t len;
+
+    Qcow2EncDecFunc *func;
+} Qcow2EncDecData;
+
+static int qcow2_encdec_pool_func(void *opaque)
+{
+    Qcow2EncDecData *data = opaque;
+
+    return data->func(data->block, data->offset, data->buf, data->len, NULL);
+}
+
+static int coroutine_fn
+qcow2_co_encdec(BlockDriverState *bs, uint64_t file_cluster_offset,
+                uint64_t offset, void *buf, size_t len, Qcow2EncDecFunc func)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2EncDecData arg = {
+        .block = s->crypto,
+        .offset = s->crypt_physical_offset ?
+                      file_cluster_offset + offset_into_cluster(s, offset) :
+                      offset,
+        .buf = buf,
+        .len = len,
+        .func = func,
+    };
+
+    return qcow2_co_process(bs, qcow2_encdec_pool_func, &arg);
+}
+
+/*
+ * qcow2_co_encrypt:
+ * @file_cluster_offset: host offset of the cluster that holds the data
+ * @offset: guest offset of the data
+ *
+ * Encrypt @len bytes of @buf in place, in a worker thread.  Which of the two
+ * offsets determines the IV depends on the image.
+ *
+ * Returns: 0 on success, -1 on failure
+ */
+int coroutine_fn
+qcow2_co_encrypt(BlockDriverState *bs, uint64_t file_cluster_offset,
+                 uint64_t offset, void *buf, size_t len)
+{
+    return qcow2_co_encdec(bs, file_cluster_offset, offset, buf, len,
+                           qcrypto_block_encrypt);
+}
+
+/* Like qcow2_co_encrypt(), but decrypt */
+int coroutine_fn
+qcow2_co_decrypt(BlockDriverState *bs, uint64_t file_cluster_offset,
+                 uint64_t offset, void *buf, size_t len)
+{
+    return qcow2_co_encdec(bs, file_cluster_offset, offset, buf, len,
+                           qcrypto_block_decrypt);
+}
+
+
+typedef ssize_t Qcow2CompressFunc(void *dest, size_t dest_size,
+                                  const void *src, size_t src_size);
+
+typedef struct Qcow2CompressData {
+    void *dest;
+    size_t dest_size;
+    const void *src;
+    size_t src_size;
+    ssize_t ret;
+
+    Qcow2CompressFunc *func;
+} Qcow2CompressData;
+
+/*
+ * qcow2_zlib_compress()
+ *
+ * @dest - destination buffer, @dest_size bytes
+ * @src - source buffer, @src_size bytes
+ *
+ * Returns: compressed size on success
+ *          -ENOMEM if the compressed data does not fit in @dest
+ *          -EIO on any other error
+ */
+static ssize_t qcow2_zlib_compress(void *dest, size_t dest_size,
+                                   const void *src, size_t src_size)
+{
+    ssize_t ret;
+    z_stream strm;
+
+    /* best compression, small window, no zlib header */
+    memset(&strm, 0, sizeof(strm));
+    ret = deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                       -12, 9, Z_DEFAULT_STRATEGY);
+    if (ret != Z_OK) {
+        return -EIO;
+    }
+
+    /* strm.next_in is not const in old zlib versions, such as those used on
+     * OpenBSD/NetBSD, so cast the const away */
+    strm.avail_in = src_size;
+    strm.next_in = (void *) src;
+    strm.avail_out = dest_size;
+    strm.next_out = dest;
+
+    ret = deflate(&strm, Z_FINISH);
+    if (ret == Z_STREAM_END) {
+        ret = dest_size - strm.avail_out;
+    } else {
+        ret = (ret == Z_OK ? -ENOMEM : -EIO);
+    }
+
+    deflateEnd(&strm);
+
+    return ret;
+}
+
+/*
+ * qcow2_zlib_decompress()
+ *
+ * Decompress @src, which may be followed by unrelated bytes, until @dest is
+ * full.
+ *
+ * Returns: 0 on success, -EIO on failure
+ */
+static ssize_t qcow2_zlib_decompress(void *dest, size_t dest_size,
+                                     const void *src, size_t src_size)
+{
+    ssize_t ret;
+    z_stream strm;
+
+    memset(&strm, 0, sizeof(strm));
+    strm.avail_in = src_size;
+    strm.next_in = (void *) src;
+    strm.avail_out = dest_size;
+    strm.next_out = dest;
+
+    ret = inflateInit2(&strm, -12);
+    if (ret != Z_OK) {
+        return -EIO;
+    }
+
+    ret = inflate(&strm, Z_FINISH);
+    if ((ret == Z_STREAM_END || ret == Z_BUF_ERROR) && strm.avail_out == 0) {
+        /* Z_BUF_ERROR means that the end of the stream was not seen before
+         * the output was full, which is fine: the cluster is complete */
+        ret = 0;
+    } else {
+        ret = -EIO;
+    }
+
+    inflateEnd(&strm);
+
+    return ret;
+}
+
+#ifdef CONFIG_ZSTD
+/* Same as qcow2_zlib_compress(), but produces a zstd frame */
+static ssize_t qcow2_zstd_compress(void *dest, size_t dest_size,
+                                   const void *src, size_t src_size)
+{
+    ZSTD_outBuffer output = { .dst = dest, .size = dest_size };
+    ZSTD_inBuffer input = { .src = src, .size = src_size };
+    ZSTD_CCtx *cctx;
+    size_t zret;
+    ssize_t ret;
+
+    cctx = ZSTD_createCCtx();
+    if (!cctx) {
+        return -EIO;
+    }
+
+    /* With ZSTD_e_end, a result that is neither zero nor an error is the
+     * amount of data that is still buffered because the frame did not fit
+     * into the output buffer */
+    zret = ZSTD_compressStream2(cctx, &output, &input, ZSTD_e_end);
+    if (zret == 0) {
+        ret = output.pos;
+    } else if (!ZSTD_isError(zret)) {
+        ret = -ENOMEM;
+    } else {
+        ret = -EIO;
+    }
+
+    ZSTD_freeCCtx(cctx);
+
+    return ret;
+}
+
+/*
+ * Same as qcow2_zlib_decompress().  The exact size of the compressed data is
+ * not stored in the image, so use the streaming interface, which stops at
+ * the end of the frame and ignores what follows.
+ */
+static ssize_t qcow2_zstd_decompress(void *dest, size_t dest_size,
+                                     const void *src, size_t src_size)
+{
+    ZSTD_outBuffer output = { .dst = dest, .size = dest_size };
+    ZSTD_inBuffer input = { .src = src, .size = src_size };
+    ZSTD_DCtx *dctx;
+    size_t zret;
+    ssize_t ret = 0;
+
+    dctx = ZSTD_createDCtx();
+    if (!dctx) {
+        return -EIO;
+    }
+
+    while (output.pos < output.size) {
+        size_t in_pos = input.pos;
+        size_t out_pos = output.pos;
+
+        zret = ZSTD_decompressStream(dctx, &output, &input);
+        if (ZSTD_isError(zret)) {
+            ret = -EIO;
+            break;
+        }
+        if (zret == 0) {
+            /* End of the frame */
+            break;
+        }
+        if (input.pos == in_pos && output.pos == out_pos) {
+            /* Truncated frame */
+            ret = -EIO;
+            break;
+        }
+    }
+
+    if (output.pos != output.size) {
+        ret = -EIO;
+    }
+
+    ZSTD_freeDCtx(dctx);
+
+    return ret;
+}
+#endif
+
+static int qcow2_compress_pool_func(void *opaque)
+{
+    Qcow2CompressData *data = opaque;
+
+    data->ret = data->func(data->dest, data->dest_size,
+                           data->src, data->src_size);
+
+    return 0;
+}
+
+static ssize_t coroutine_fn
+qcow2_co_do_compress(BlockDriverState *bs, void *dest, size_t dest_size,
+                     const void *src, size_t src_size, Qcow2CompressFunc func)
+{
+    Qcow2CompressData arg = {
+        .dest = dest,
+        .dest_size = dest_size,
+        .src = src,
+        .src_size = src_size,
+        .func = func,
+    };
+
+    qcow2_co_process(bs, qcow2_compress_pool_func, &arg);
+
+    return arg.ret;
+}
+
+/*
+ * qcow2_co_compress:
+ *
+ * Compress @src_size bytes of @src into @dest, in a worker thread, with the
+ * compression type of the image.
+ *
+ * Returns: compressed size on success
+ *          -ENOMEM if the compressed data does not fit in @dest_size bytes
+ *          -EIO on any other error
+ */
+ssize_t coroutine_fn
+qcow2_co_compress(BlockDriverState *bs, void *dest, size_t dest_size,
+                  const void *src, size_t src_size)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2CompressFunc *func;
+
+    switch (s->compression_type) {
+    case QCOW2_COMPRESSION_TYPE_ZLIB:
+        func = qcow2_zlib_compress;
+        break;
+#ifdef CONFIG_ZSTD
+    case QCOW2_COMPRESSION_TYPE_ZSTD:
+        func = qcow2_zstd_compress;
+        break;
+#endif
+    default:
+        abort();
+    }
+
+    return qcow2_co_do_compress(bs, dest, dest_size, src, src_size, func);
+}
+
+/*
+ * qcow2_co_decompress:
+ *
+ * Decompress @src into @dest, in a worker thread, until @dest_size bytes
+ * have been produced.  @src may extend beyond the end of the compressed
+ * data.
+ *
+ * Returns: 0 on success, -EIO on failure
+ */
+ssize_t coroutine_fn
+qcow2_co_decompress(BlockDriverState *bs, void *dest, size_t dest_size,
+                    const void *src, size_t src_size)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2CompressFunc *func;
+
+    switch (s->compression_type) {
+    case QCOW2_COMPRESSION_TYPE_ZLIB:
+        func = qcow2_zlib_decompress;
+        break;
+#ifdef CONFIG_ZSTD
+    case QCOW2_COMPRESSION_TYPE_ZSTD:
+        func = qcow2_zstd_decompress;
+        break;
+#endif
+    default:
+        abort();
+    }
+
+    return qcow2_co_do_compress(bs, dest, dest_size, src, src_size, func);
+}
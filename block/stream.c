@@ -27,6 +27,12 @@ enum {
      * contiguous regions of the image is efficient.
      */
     STREAM_BUFFER_SIZE = 512 * 1024, /* in bytes */
+
+    /*
+     * Copy requests kept in flight at once, so that a backing file with a
+     * high latency (e.g. NBD) is read at link speed.
+     */
+    STREAM_MAX_IN_FLIGHT = 16,
 };
 
 typedef struct StreamBlockJob {
@@ -35,8 +41,22 @@ typedef struct StreamBlockJob {
     BlockdevOnError on_error;
     char *backing_file_str;
     int bs_flags;
+
+    int in_flight;
+    CoQueue io_wait;
+    /* First failed copy request since the last error action, or -1 */
+    int64_t err_offset;
+    int err_ret;
+    /* Bytes of all copy requests that failed since the last error action */
+    int64_t err_bytes;
 } StreamBlockJob;
 
+typedef struct StreamOp {
+    StreamBlockJob *s;
+    int64_t offset;
+    int64_t bytes;
+} StreamOp;
+
 static int coroutine_fn stream_populate(BlockBackend *blk,
                                         int64_t offset, uint64_t bytes,
                                         void *buf)
@@ -54,6 +74,46 @@ static int coroutine_fn stream_populate(BlockBackend *blk,
     return blk_co_preadv(blk, offset, qiov.size, &qiov, BDRV_REQ_COPY_ON_READ);
 }
 
+static void coroutine_fn stream_op_entry(void *opaque)
+{
+    StreamOp *op = opaque;
+    StreamBlockJob *s = op->s;
+    BlockBackend *blk = s->common.blk;
+    void *buf;
+    int ret;
+
+    buf = qemu_blockalign(blk_bs(blk), op->bytes);
+    ret = stream_populate(blk, op->offset, op->bytes, buf);
+    qemu_vfree(buf);
+
+    if (ret < 0) {
+        if (s->err_offset < 0 || op->offset < s->err_offset) {
+            s->err_offset = op->offset;
+            s->err_ret = ret;
+        }
+        s->err_bytes += op->bytes;
+    } else {
+        job_progress_update(&s->common.job, op->bytes);
+    }
+
+    s->in_flight--;
+    g_free(op);
+    qemu_co_queue_restart_all(&s->io_wait);
+}
+
+static void stream_start_op(StreamBlockJob *s, int64_t offset, int64_t bytes)
+{
+    StreamOp *op = g_new(StreamOp, 1);
+
+    *op = (StreamOp) {
+        .s      = s,
+        .offset = offset,
+        .bytes  = bytes,
+    };
+    s->in_flight++;
+    qemu_coroutine_enter(qemu_coroutine_create(stream_op_entry, op));
+}
+
 typedef struct {
     int ret;
 } StreamCompleteData;
@@ -110,7 +170,8 @@ static void coroutine_fn stream_run(void *opaque)
     int error = 0;
     int ret = 0;
     int64_t n = 0; /* bytes */
-    void *buf;
+    int64_t status_end = 0;
+    bool copy = false;
 
     if (!bs->backing) {
         goto out;
@@ -123,8 +184,6 @@ static void coroutine_fn stream_run(void *opaque)
     }
     job_progress_set_remaining(&s->common.job, len);
 
-    buf = qemu_blockalign(bs, STREAM_BUFFER_SIZE);
-
     /* Turn on copy-on-read for the whole block device so that guest read
      * requests help us make progress.  Only do this when copying the entire
      * backing chain since the copy-on-read operation does not take base into
@@ -134,62 +193,109 @@ static void coroutine_fn stream_run(void *opaque)
         bdrv_enable_copy_on_read(bs);
     }
 
-    for ( ; offset < len; offset += n) {
-        bool copy;
-
+    for (;;) {
         /* Note that even when no rate limit is applied we need to yield
-         * with no pending I/O here so that bdrv_drain_all() returns.
+         * here so that bdrv_drain_all() returns.  Copy requests in flight
+         * complete on their own and do not keep the job from pausing.
          */
         job_sleep_ns(&s->common.job, delay_ns);
+        delay_ns = 0;
         if (job_is_cancelled(&s->common.job)) {
             break;
         }
 
-        copy = false;
-
-        ret = bdrv_is_allocated(bs, offset, STREAM_BUFFER_SIZE, &n);
-        if (ret == 1) {
-            /* Allocated in the top, no need to copy.  */
-        } else if (ret >= 0) {
-            /* Copy if allocated in the intermediate images.  Limit to the
-             * known-unallocated area [offset, offset+n*BDRV_SECTOR_SIZE).  */
-            ret = bdrv_is_allocated_above(backing_bs(bs), base,
-                                          offset, n, &n);
-
-            /* Finish early if end of backing file has been reached */
-            if (ret == 0 && n == 0) {
-                n = len - offset;
-            }
-
-            copy = (ret == 1);
-        }
-        trace_stream_one_iteration(s, offset, n, ret);
-        if (copy) {
-            ret = stream_populate(blk, offset, n, buf);
+        /* Errors are handled once all requests have completed */
+        if (s->in_flight && (s->in_flight >= STREAM_MAX_IN_FLIGHT ||
+                             s->err_offset >= 0 || offset >= len)) {
+            qemu_co_queue_wait(&s->io_wait, NULL);
+            continue;
         }
-        if (ret < 0) {
+
+        if (s->err_offset >= 0) {
             BlockErrorAction action =
-                block_job_error_action(&s->common, s->on_error, true, -ret);
+                block_job_error_action(&s->common, s->on_error, true,
+                                       -s->err_ret);
             if (action == BLOCK_ERROR_ACTION_STOP) {
-                n = 0;
-                continue;
+                /* Retry from the first failed request.  Whatever was
+                 * counted after it will be counted again.  */
+                job_progress_increase_remaining(&s->common.job,
+                                                offset - s->err_offset -
+                                                s->err_bytes);
+                offset = s->err_offset;
+                status_end = 0;
+            } else {
+                if (error == 0) {
+                    error = s->err_ret;
+                }
+                if (action == BLOCK_ERROR_ACTION_REPORT) {
+                    break;
+                }
+                job_progress_update(&s->common.job, s->err_bytes);
             }
-            if (error == 0) {
-                error = ret;
+            s->err_offset = -1;
+            s->err_bytes = 0;
+            continue;
+        }
+
+        if (offset >= len) {
+            break;
+        }
+
+        /* Query the allocation status of the whole remaining image at once
+         * and issue copy requests for the extent it returns, rather than
+         * one query per request.  */
+        if (offset >= status_end) {
+            copy = false;
+
+            ret = bdrv_is_allocated(bs, offset, len - offset, &n);
+            if (ret == 1) {
+                /* Allocated in the top, no need to copy.  */
+            } else if (ret >= 0) {
+                /* Copy if allocated in the intermediate images.  Limit to
+                 * the known-unallocated area [offset, offset+n).  */
+                ret = bdrv_is_allocated_above(backing_bs(bs), base,
+                                              offset, n, &n);
+
+                /* Finish early if end of backing file has been reached */
+                if (ret == 0 && n == 0) {
+                    n = len - offset;
+                }
+
+                copy = (ret == 1);
             }
-            if (action == BLOCK_ERROR_ACTION_REPORT) {
-                break;
+            trace_stream_one_iteration(s, offset, n, ret);
+            if (ret < 0) {
+                BlockErrorAction action =
+                    block_job_error_action(&s->common, s->on_error, true,
+                                           -ret);
+                if (action == BLOCK_ERROR_ACTION_STOP) {
+                    continue;
+                }
+                if (error == 0) {
+                    error = ret;
+                }
+                if (action == BLOCK_ERROR_ACTION_REPORT) {
+                    break;
+                }
             }
+            ret = 0;
+            status_end = offset + n;
         }
-        ret = 0;
 
-        /* Publish progress */
-        job_progress_update(&s->common.job, n);
+        n = status_end - offset;
         if (copy) {
+            n = MIN(n, STREAM_BUFFER_SIZE);
+            stream_start_op(s, offset, n);
             delay_ns = block_job_ratelimit_get_delay(&s->common, n);
         } else {
-            delay_ns = 0;
+            /* Publish progress */
+            job_progress_update(&s->common.job, n);
         }
+        offset += n;
+    }
+
+    while (s->in_flight) {
+        qemu_co_queue_wait(&s->io_wait, NULL);
     }
 
     if (!base) {
@@ -199,8 +305,6 @@ static void coroutine_fn stream_run(void *opaque)
     /* Do not remove the backing file if an error was there but ignored.  */
     ret = error;
 
-    qemu_vfree(buf);
-
 out:
     /* Modify backing chain and close BDSes in main loop */
     data = g_malloc(sizeof(*data));
@@ -263,6 +367,8 @@ void stream_start(const char *job_id, BlockDriverState *bs,
     s->bs_flags = orig_bs_flags;
 
     s->on_error = on_error;
+    s->err_offset = -1;
+    qemu_co_queue_init(&s->io_wait);
     trace_stream_start(bs, base, s);
     job_start(&s->common.job);
     return;
@@ -37,6 +37,15 @@
 static void throttle_group_obj_init(Object *obj);
 static void throttle_group_obj_complete(UserCreatable *obj, Error **errp);
 
+/* Granting a member a budget of its own lets it pass back-to-back requests
+ * without taking tg->lock.  Each grant is worth THROTTLE_CREDIT_NS of the
+ * configured average rates, which is small compared to the bucket sizes
+ * (at least a tenth of a second), and at most THROTTLE_CREDIT_MAX_UNITS
+ * operations.
+ */
+#define THROTTLE_CREDIT_NS SCALE_MS
+#define THROTTLE_CREDIT_MAX_UNITS 64
+
 /* The ThrottleGroup structure (with its ThrottleState) is shared
  * among different ThrottleGroupMembers and it's independent from
  * AioContext, so in order to use it from different threads it needs
@@ -75,6 +84,10 @@ typedef struct ThrottleGroup {
     bool any_timer_armed[2];
     QEMUClockType clock_type;
 
+    /* Bumped when the configuration changes, invalidating all credit.
+     * Written under the lock, read with atomic operations. */
+    unsigned credit_gen;
+
     /* This field is protected by the global QEMU mutex */
     QTAILQ_ENTRY(ThrottleGroup) list;
 } ThrottleGroup;
@@ -338,6 +351,89 @@ static void schedule_next_request(ThrottleGroupMember *tgm, bool is_write)
     }
 }
 
+/* Try to pay for an I/O request with the member's credit.  This is the
+ * fast path of throttle_group_co_io_limits_intercept() and runs without
+ * tg->lock.
+ *
+ * @tgm:       the current ThrottleGroupMember
+ * @bytes:     the number of bytes for this I/O
+ * @is_write:  the type of operation (read/write)
+ * @ret:       whether the request was paid for and can be executed
+ */
+static bool throttle_group_use_credit(ThrottleGroupMember *tgm,
+                                      unsigned int bytes, bool is_write)
+{
+    ThrottleGroup *tg = container_of(tgm->throttle_state, ThrottleGroup, ts);
+    double units;
+
+    if (tgm->credit_gen != atomic_read(&tg->credit_gen) ||
+        tgm->pending_reqs[is_write] ||
+        tgm->credit_bytes[is_write] < bytes) {
+        return false;
+    }
+
+    units = throttle_op_units(tgm->credit_op_size, bytes);
+    if (tgm->credit_units[is_write] < units ||
+        qemu_clock_get_ns(tg->clock_type) >= tgm->credit_expire[is_write]) {
+        return false;
+    }
+
+    tgm->credit_units[is_write] -= units;
+    tgm->credit_bytes[is_write] -= bytes;
+    return true;
+}
+
+/* Give the unused credit of a member back to the group, or drop it if the
+ * configuration changed since it was granted.
+ *
+ * This assumes that tg->lock is held.
+ */
+static void throttle_group_return_credit(ThrottleGroupMember *tgm,
+                                         bool is_write)
+{
+    ThrottleGroup *tg = container_of(tgm->throttle_state, ThrottleGroup, ts);
+
+    if (tgm->credit_gen == tg->credit_gen) {
+        throttle_account_budget(tgm->throttle_state, is_write,
+                                -tgm->credit_units[is_write],
+                                -tgm->credit_bytes[is_write]);
+    }
+    tgm->credit_units[is_write] = 0;
+    tgm->credit_bytes[is_write] = 0;
+}
+
+/* Grant the member new credit if nobody in the group is being throttled.
+ *
+ * This assumes that tg->lock is held.
+ */
+static void throttle_group_grant_credit(ThrottleGroupMember *tgm,
+                                        bool is_write)
+{
+    ThrottleState *ts = tgm->throttle_state;
+    ThrottleGroup *tg = container_of(ts, ThrottleGroup, ts);
+    double units = THROTTLE_CREDIT_MAX_UNITS;
+    double bytes = INT64_MAX;
+
+    if (tg->any_timer_armed[is_write] || tgm->pending_reqs[is_write] ||
+        atomic_read(&tgm->io_limits_disabled)) {
+        return;
+    }
+
+    throttle_budget(ts, is_write, THROTTLE_CREDIT_NS, &units, &bytes);
+    if (units < 1 || bytes < BDRV_SECTOR_SIZE) {
+        /* Limits too low for this to be worthwhile */
+        return;
+    }
+
+    throttle_account_budget(ts, is_write, units, bytes);
+    tgm->credit_units[is_write] = units;
+    tgm->credit_bytes[is_write] = bytes;
+    tgm->credit_expire[is_write] = qemu_clock_get_ns(tg->clock_type) +
+                                   THROTTLE_CREDIT_NS;
+    tgm->credit_op_size = ts->cfg.op_size;
+    tgm->credit_gen = tg->credit_gen;
+}
+
 /* Check if an I/O request needs to be throttled, wait and set a timer
  * if necessary, and schedule the next request using a round robin
  * algorithm.
@@ -353,7 +449,13 @@ void coroutine_fn throttle_group_co_io_limits_intercept(ThrottleGroupMember *tgm
     bool must_wait;
     ThrottleGroupMember *token;
     ThrottleGroup *tg = container_of(tgm->throttle_state, ThrottleGroup, ts);
+
+    if (throttle_group_use_credit(tgm, bytes, is_write)) {
+        return;
+    }
+
     qemu_mutex_lock(&tg->lock);
+    throttle_group_return_credit(tgm, is_write);
 
     /* First we check if this I/O has to be throttled. */
     token = next_throttle_token(tgm, is_write);
@@ -377,6 +479,8 @@ void coroutine_fn throttle_group_co_io_limits_intercept(ThrottleGroupMember *tgm
     /* Schedule the next request */
     schedule_next_request(tgm, is_write);
 
+    throttle_group_grant_credit(tgm, is_write);
+
     qemu_mutex_unlock(&tg->lock);
 }
 
@@ -440,6 +544,7 @@ void throttle_group_config(ThrottleGroupMember *tgm, ThrottleConfig *cfg)
     ThrottleGroup *tg = container_of(ts, ThrottleGroup, ts);
     qemu_mutex_lock(&tg->lock);
     throttle_config(ts, tg->clock_type, cfg);
+    atomic_inc(&tg->credit_gen);
     qemu_mutex_unlock(&tg->lock);
 
     throttle_group_restart_tgm(tgm);
@@ -564,6 +669,7 @@ void throttle_group_unregister_tgm(ThrottleGroupMember *tgm)
 
     qemu_mutex_lock(&tg->lock);
     for (i = 0; i < 2; i++) {
+        throttle_group_return_credit(tgm, i);
         if (timer_pending(tgm->throttle_timers.timers[i])) {
             tg->any_timer_armed[i] = false;
             schedule_next_request(tgm, i);
@@ -877,6 +983,7 @@ static void throttle_group_set_limits(Object *obj, Visitor *v,
         goto unlock;
     }
     throttle_config(&tg->ts, tg->clock_type, &cfg);
+    atomic_inc(&tg->credit_gen);
 
 unlock:
     qemu_mutex_unlock(&tg->lock);
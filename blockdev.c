@@ -57,6 +57,7 @@
 #include "block/trace.h"
 #include "sysemu/arch_init.h"
 #include "sysemu/qtest.h"
+#include "sysemu/stats.h"
 #include "qemu/cutils.h"
 #include "qemu/help_option.h"
 #include "qemu/throttle-options.h"
@@ -266,6 +267,43 @@ void drive_check_orphaned(void)
     }
 }
 
+/*
+ * Only BlockAcctStats.lock is taken, which I/O completion holds just long
+ * enough to bump the counters; the AioContext of the backend is not.
+ */
+void block_collect_stats(StatsResultList ***tail)
+{
+    static const struct {
+        enum BlockAcctType type;
+        const char *bytes, *ops;
+    } types[] = {
+        { BLOCK_ACCT_READ, "rd-bytes", "rd-operations" },
+        { BLOCK_ACCT_WRITE, "wr-bytes", "wr-operations" },
+        { BLOCK_ACCT_FLUSH, NULL, "flush-operations" },
+    };
+    BlockBackend *blk;
+    int i;
+
+    for (blk = blk_next(NULL); blk; blk = blk_next(blk)) {
+        BlockAcctStats *stats = blk_get_stats(blk);
+        StatsResult *result = stats_result_add(tail, STATS_TARGET_BLOCK,
+                                               blk_name(blk));
+        uint64_t nr_bytes[BLOCK_MAX_IOTYPE], nr_ops[BLOCK_MAX_IOTYPE];
+
+        qemu_mutex_lock(&stats->lock);
+        memcpy(nr_bytes, stats->nr_bytes, sizeof(nr_bytes));
+        memcpy(nr_ops, stats->nr_ops, sizeof(nr_ops));
+        qemu_mutex_unlock(&stats->lock);
+
+        for (i = 0; i < ARRAY_SIZE(types); i++) {
+            if (types[i].bytes) {
+                stats_add(result, types[i].bytes, nr_bytes[types[i].type]);
+            }
+            stats_add(result, types[i].ops, nr_ops[types[i].type]);
+        }
+    }
+}
+
 DriveInfo *drive_get_by_index(BlockInterfaceType type, int index)
 {
     return drive_get(type,
@@ -385,6 +423,8 @@ static void extract_common_blockdev_options(QemuOpts *opts, int *bdrv_flags,
         if ((aio = qemu_opt_get(opts, "aio")) != NULL) {
             if (!strcmp(aio, "native")) {
                 *bdrv_flags |= BDRV_O_NATIVE_AIO;
+            } else if (!strcmp(aio, "io_uring")) {
+                *bdrv_flags |= BDRV_O_IO_URING;
             } else if (!strcmp(aio, "threads")) {
                 /* this is the default */
             } else {
@@ -2133,6 +2173,11 @@ static void block_dirty_bitmap_clear_prepare(BlkActionState *common,
         return;
     }
 
+    /* The backup must be complete to be restored on abort */
+    if (bdrv_dirty_bitmap_load_all(state->bitmap, errp) < 0) {
+        return;
+    }
+
     bdrv_clear_dirty_bitmap(state->bitmap, &state->backup);
 }
 
@@ -4463,7 +4508,7 @@ QemuOptsList qemu_common_drive_opts = {
         },{
             .name = "aio",
             .type = QEMU_OPT_STRING,
-            .help = "host AIO implementation (threads, native)",
+            .help = "host AIO implementation (threads, native, io_uring)",
         },{
             .name = BDRV_OPT_CACHE_WB,
             .type = QEMU_OPT_BOOL,
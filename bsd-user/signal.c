@@ -28,3 +28,8 @@ void signal_init(void)
 void process_pending_signals(CPUArchState *cpu_env)
 {
 }
+
+bool cpu_exec_signals(CPUState *cpu)
+{
+    return false;
+}
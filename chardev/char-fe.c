@@ -147,6 +147,11 @@ int qemu_chr_fe_set_msgfds(CharBackend *be, int *fds, int num)
         return -1;
     }
 
+    /* the descriptors must travel with the next write, not a later flush */
+    if (s->outbuf_size) {
+        return -1;
+    }
+
     return CHARDEV_GET_CLASS(s)->set_msgfds ?
         CHARDEV_GET_CLASS(s)->set_msgfds(s, fds, num) : -1;
 }
@@ -341,6 +346,13 @@ void qemu_chr_fe_set_open(CharBackend *be, int fe_open)
     }
 }
 
+bool qemu_chr_fe_write_blocked(CharBackend *be)
+{
+    Chardev *s = be->chr;
+
+    return s && atomic_read(&s->out_blocked);
+}
+
 guint qemu_chr_fe_add_watch(CharBackend *be, GIOCondition cond,
                             GIOFunc func, void *user_data)
 {
@@ -871,6 +871,7 @@ static void char_socket_finalize(Object *obj)
     Chardev *chr = CHARDEV(obj);
     SocketChardev *s = SOCKET_CHARDEV(obj);
 
+    qemu_chr_flush_output(chr);
     tcp_chr_free_connection(chr);
     tcp_chr_reconn_timer_cancel(s);
     qapi_free_SocketAddress(s->addr);
@@ -1183,6 +1184,7 @@ static void char_socket_class_init(ObjectClass *oc, void *data)
     cc->parse = qemu_chr_parse_socket;
     cc->open = qmp_chardev_open_socket;
     cc->chr_wait_connected = tcp_chr_wait_connected;
+    cc->supports_outbuf = true;
     cc->chr_write = tcp_chr_write;
     cc->chr_sync_read = tcp_chr_sync_read;
     cc->chr_disconnect = tcp_chr_disconnect;
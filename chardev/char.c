@@ -98,6 +98,128 @@ static void qemu_chr_write_log(Chardev *s, const uint8_t *buf, size_t len)
     }
 }
 
+/* Called with chr_write_lock held.  Returns false if the backend pushed
+ * back before the output buffer was emptied.  */
+static bool qemu_chr_flush_outbuf_locked(Chardev *s)
+{
+    ChardevClass *cc = CHARDEV_GET_CLASS(s);
+
+    while (s->outbuf.offset) {
+        int res = cc->chr_write(s, s->outbuf.buffer, s->outbuf.offset);
+
+        if (res < 0 && errno == EAGAIN) {
+            return false;
+        }
+        if (res <= 0) {
+            /* same as a failed unbuffered write: the data is lost */
+            buffer_reset(&s->outbuf);
+            break;
+        }
+        buffer_advance(&s->outbuf, res);
+    }
+    atomic_set(&s->out_blocked, false);
+    return true;
+}
+
+static gboolean qemu_chr_out_watch_cb(GIOChannel *chan, GIOCondition cond,
+                                      void *opaque)
+{
+    Chardev *s = opaque;
+    gboolean again;
+
+    qemu_mutex_lock(&s->chr_write_lock);
+    again = !qemu_chr_flush_outbuf_locked(s);
+    if (!again) {
+        g_source_unref(s->out_watch);
+        s->out_watch = NULL;
+    }
+    qemu_mutex_unlock(&s->chr_write_lock);
+
+    return again;
+}
+
+/* Called with chr_write_lock held, after the backend returned EAGAIN.
+ * The front end sees the chardev as blocked until it can take data
+ * again; without a watch there is no way to notice that, so only
+ * report backpressure when one could be created.  */
+static void qemu_chr_wait_writable_locked(Chardev *s)
+{
+    ChardevClass *cc = CHARDEV_GET_CLASS(s);
+
+    if (!s->out_watch && cc->chr_add_watch) {
+        s->out_watch = cc->chr_add_watch(s, G_IO_OUT | G_IO_HUP);
+        if (s->out_watch) {
+            g_source_set_callback(s->out_watch,
+                                  (GSourceFunc)qemu_chr_out_watch_cb, s, NULL);
+            g_source_attach(s->out_watch, s->gcontext);
+        }
+    }
+    if (s->out_watch) {
+        atomic_set(&s->out_blocked, true);
+    }
+}
+
+static gboolean qemu_chr_outbuf_timeout(void *opaque)
+{
+    Chardev *s = opaque;
+
+    qemu_mutex_lock(&s->chr_write_lock);
+    g_source_unref(s->outbuf_timer);
+    s->outbuf_timer = NULL;
+    if (!qemu_chr_flush_outbuf_locked(s)) {
+        qemu_chr_wait_writable_locked(s);
+    }
+    qemu_mutex_unlock(&s->chr_write_lock);
+
+    return FALSE;
+}
+
+/* Called with chr_write_lock held.  Data is only handed to the backend
+ * when the buffer is full or when the flush timer fires, so that a
+ * stream of one-byte writes from a UART becomes a few large writes.  */
+static int qemu_chr_write_outbuf_locked(Chardev *s,
+                                        const uint8_t *buf, int len,
+                                        int *offset, bool write_all)
+{
+    while (*offset < len) {
+        size_t n = MIN(s->outbuf_size - s->outbuf.offset, len - *offset);
+
+        if (n) {
+            buffer_reserve(&s->outbuf, n);
+            buffer_append(&s->outbuf, buf + *offset, n);
+            *offset += n;
+            continue;
+        }
+        if (qemu_chr_flush_outbuf_locked(s)) {
+            continue;
+        }
+        qemu_chr_wait_writable_locked(s);
+        if (!write_all) {
+            break;
+        }
+        g_usleep(100);
+    }
+
+    if (s->outbuf.offset && !s->outbuf_timer) {
+        s->outbuf_timer = qemu_chr_timeout_add_ms(s, s->outbuf_flush_ms,
+                                                  qemu_chr_outbuf_timeout, s);
+    }
+    if (*offset == 0 && len) {
+        errno = EAGAIN;
+        return -1;
+    }
+    return *offset;
+}
+
+void qemu_chr_flush_output(Chardev *s)
+{
+    qemu_mutex_lock(&s->chr_write_lock);
+    while (!qemu_chr_flush_outbuf_locked(s)) {
+        g_usleep(100);
+    }
+    qemu_mutex_unlock(&s->chr_write_lock);
+}
+
 static int qemu_chr_write_buffer(Chardev *s,
                                  const uint8_t *buf, int len,
                                  int *offset, bool write_all)
@@ -107,6 +229,10 @@ static int qemu_chr_write_buffer(Chardev *s,
     *offset = 0;
 
     qemu_mutex_lock(&s->chr_write_lock);
+    if (s->outbuf_size && !qemu_chr_replay(s)) {
+        res = qemu_chr_write_outbuf_locked(s, buf, len, offset, write_all);
+        goto out;
+    }
     while (*offset < len) {
     retry:
         res = cc->chr_write(s, buf + *offset, len - *offset);
@@ -116,6 +242,9 @@ static int qemu_chr_write_buffer(Chardev *s,
         }
 
         if (res <= 0) {
+            if (res < 0 && errno == EAGAIN) {
+                qemu_chr_wait_writable_locked(s);
+            }
             break;
         }
 
@@ -124,6 +253,7 @@ static int qemu_chr_write_buffer(Chardev *s,
             break;
         }
     }
+out:
     if (*offset > 0) {
         qemu_chr_write_log(s, buf, *offset);
     }
@@ -212,6 +342,23 @@ static void qemu_char_open(Chardev *chr, ChardevBackend *backend,
     /* Any ChardevCommon member would work */
     ChardevCommon *common = backend ? backend->u.null.data : NULL;
 
+    if (common && common->has_outbuf_size && common->outbuf_size) {
+        if (!cc->supports_outbuf) {
+            error_setg(errp, "chardev type '%s' does not support output "
+                       "buffering", object_get_typename(OBJECT(chr)));
+            return;
+        }
+        if (common->outbuf_size > INT_MAX) {
+            error_setg(errp, "outbuf-size must be less than 2 GiB");
+            return;
+        }
+        chr->outbuf_size = common->outbuf_size;
+        chr->outbuf_flush_ms = common->has_outbuf_flush_ms ?
+                               common->outbuf_flush_ms : 10;
+        buffer_init(&chr->outbuf, "%s-outbuf",
+                    object_get_typename(OBJECT(chr)));
+    }
+
     if (common && common->has_logfile) {
         int flags = O_WRONLY | O_CREAT;
         if (common->has_logappend &&
@@ -267,6 +414,15 @@ static void char_finalize(Object *obj)
     if (chr->logfd != -1) {
         close(chr->logfd);
     }
+    if (chr->outbuf_timer) {
+        g_source_destroy(chr->outbuf_timer);
+        g_source_unref(chr->outbuf_timer);
+    }
+    if (chr->out_watch) {
+        g_source_destroy(chr->out_watch);
+        g_source_unref(chr->out_watch);
+    }
+    buffer_free(&chr->outbuf);
     qemu_mutex_destroy(&chr->chr_write_lock);
 }
 
@@ -479,12 +635,21 @@ fail:
 void qemu_chr_parse_common(QemuOpts *opts, ChardevCommon *backend)
 {
     const char *logfile = qemu_opt_get(opts, "logfile");
+    const char *flush_ms;
 
     backend->has_logfile = logfile != NULL;
     backend->logfile = g_strdup(logfile);
 
     backend->has_logappend = true;
     backend->logappend = qemu_opt_get_bool(opts, "logappend", false);
+
+    backend->has_outbuf_size = qemu_opt_get(opts, "outbuf-size") != NULL;
+    backend->outbuf_size = qemu_opt_get_size(opts, "outbuf-size", 0);
+
+    flush_ms = qemu_opt_get(opts, "outbuf-flush-ms");
+    backend->has_outbuf_flush_ms = flush_ms != NULL;
+    backend->outbuf_flush_ms = qemu_opt_get_number(opts, "outbuf-flush-ms",
+                                                   10);
 }
 
 static const ChardevClass *char_get_class(const char *driver, Error **errp)
@@ -876,6 +1041,12 @@ QemuOptsList qemu_chardev_opts = {
         },{
             .name = "logappend",
             .type = QEMU_OPT_BOOL,
+        },{
+            .name = "outbuf-size",
+            .type = QEMU_OPT_SIZE,
+        },{
+            .name = "outbuf-flush-ms",
+            .type = QEMU_OPT_NUMBER,
         },
         { /* end of list */ }
     },
@@ -22,6 +22,7 @@
 #include "exec/cpu-common.h"
 #include "qom/cpu.h"
 #include "sysemu/cpus.h"
+#include "qemu/loop-profile.h"
 
 static QemuMutex qemu_cpu_list_lock;
 static QemuCond exclusive_cond;
@@ -313,6 +314,7 @@ void async_safe_run_on_cpu(CPUState *cpu, run_on_cpu_func func,
 void process_queued_cpu_work(CPUState *cpu)
 {
     struct qemu_work_item *wi;
+    int64_t start;
 
     if (cpu->queued_work_first == NULL) {
         return;
@@ -326,6 +328,7 @@ void process_queued_cpu_work(CPUState *cpu)
             cpu->queued_work_last = NULL;
         }
         qemu_mutex_unlock(&cpu->work_mutex);
+        stat64_add(&cpu->work_items, 1);
         if (wi->exclusive) {
             /* Running work items outside the BQL avoids the following deadlock:
              * 1) start_exclusive() is called with the BQL taken while another
@@ -335,11 +338,15 @@ void process_queued_cpu_work(CPUState *cpu)
              */
             qemu_mutex_unlock_iothread();
             start_exclusive();
+            start = loop_profile_start();
             wi->func(cpu, wi->data);
+            loop_profile_end(LOOP_PROFILE_KIND_RUN_ON_CPU, wi->func, start);
             end_exclusive();
             qemu_mutex_lock_iothread();
         } else {
+            start = loop_profile_start();
             wi->func(cpu, wi->data);
+            loop_profile_end(LOOP_PROFILE_KIND_RUN_ON_CPU, wi->func, start);
         }
         qemu_mutex_lock(&cpu->work_mutex);
         if (wi->free) {
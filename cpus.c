@@ -28,6 +28,7 @@
 #include "monitor/monitor.h"
 #include "qapi/error.h"
 #include "qapi/qapi-commands-misc.h"
+#include "qapi/qapi-events-misc.h"
 #include "qapi/qapi-events-run-state.h"
 #include "qapi/qmp/qerror.h"
 #include "qemu/error-report.h"
@@ -41,6 +42,7 @@
 #include "sysemu/hvf.h"
 #include "sysemu/whpx.h"
 #include "exec/exec-all.h"
+#include "exec/translator.h"
 
 #include "qemu/thread.h"
 #include "sysemu/cpus.h"
@@ -53,6 +55,10 @@
 #include "hw/nmi.h"
 #include "sysemu/replay.h"
 #include "hw/boards.h"
+#include "qemu/loop-profile.h"
+#include "sysemu/stats.h"
+#include "sysemu/iothread.h"
+#include "migration/misc.h"
 
 #ifdef CONFIG_LINUX
 
@@ -224,6 +230,8 @@ void qemu_tcg_configure(QemuOpts *opts, Error **errp)
     } else {
         mttcg_enabled = default_mttcg_enabled();
     }
+
+    tcg_superblocks = qemu_opt_get_bool(opts, "superblocks", false);
 }
 
 /* The current number of executed instructions is based on what we
@@ -710,19 +718,25 @@ static const VMStateDescription vmstate_timers = {
     }
 };
 
+/* Throttle percentage applied to @cpu */
+static int cpu_throttle_vcpu_effective(CPUState *cpu)
+{
+    return MAX(cpu_throttle_get_percentage(),
+               cpu_throttle_get_vcpu_percentage(cpu));
+}
+
 static void cpu_throttle_thread(CPUState *cpu, run_on_cpu_data opaque)
 {
-    double pct;
-    double throttle_ratio;
+    int pct = cpu_throttle_vcpu_effective(cpu);
     long sleeptime_ns;
 
-    if (!cpu_throttle_get_percentage()) {
+    if (!pct) {
+        atomic_set(&cpu->throttle_thread_scheduled, 0);
         return;
     }
 
-    pct = (double)cpu_throttle_get_percentage()/100;
-    throttle_ratio = pct / (1 - pct);
-    sleeptime_ns = (long)(throttle_ratio * CPU_THROTTLE_TIMESLICE_NS);
+    /* Sleep for pct of the period between two timer ticks */
+    sleeptime_ns = (long)((double)pct/100 * opaque.host_ulong);
 
     qemu_mutex_unlock_iothread();
     g_usleep(sleeptime_ns / 1000); /* Convert ns to us for usleep call */
@@ -733,22 +747,35 @@ static void cpu_throttle_thread(CPUState *cpu, run_on_cpu_data opaque)
 static void cpu_throttle_timer_tick(void *opaque)
 {
     CPUState *cpu;
-    double pct;
+    int max_pct = cpu_throttle_get_percentage();
+    unsigned long period_ns;
+
+    CPU_FOREACH(cpu) {
+        max_pct = MAX(max_pct, cpu_throttle_get_vcpu_percentage(cpu));
+    }
 
     /* Stop the timer if needed */
-    if (!cpu_throttle_get_percentage()) {
+    if (!max_pct) {
         return;
     }
+
+    /*
+     * The most throttled vcpu runs for CPU_THROTTLE_TIMESLICE_NS in each
+     * period; every vcpu sleeps its own percentage of the period.
+     */
+    period_ns = CPU_THROTTLE_TIMESLICE_NS / (1 - (double)max_pct/100);
     CPU_FOREACH(cpu) {
+        if (!cpu_throttle_vcpu_effective(cpu)) {
+            continue;
+        }
         if (!atomic_xchg(&cpu->throttle_thread_scheduled, 1)) {
             async_run_on_cpu(cpu, cpu_throttle_thread,
-                             RUN_ON_CPU_NULL);
+                             RUN_ON_CPU_HOST_ULONG(period_ns));
         }
     }
 
-    pct = (double)cpu_throttle_get_percentage()/100;
     timer_mod(throttle_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL_RT) +
-                                   CPU_THROTTLE_TIMESLICE_NS / (1-pct));
+                                   period_ns);
 }
 
 void cpu_throttle_set(int new_throttle_pct)
@@ -763,9 +790,28 @@ void cpu_throttle_set(int new_throttle_pct)
                                        CPU_THROTTLE_TIMESLICE_NS);
 }
 
+void cpu_throttle_set_vcpu(CPUState *cpu, int new_throttle_pct)
+{
+    /* 0 is valid here, it stops throttling this vcpu alone */
+    new_throttle_pct = MIN(new_throttle_pct, CPU_THROTTLE_PCT_MAX);
+    new_throttle_pct = MAX(new_throttle_pct, 0);
+
+    atomic_set(&cpu->throttle_percentage, new_throttle_pct);
+
+    if (new_throttle_pct && !timer_pending(throttle_timer)) {
+        timer_mod(throttle_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL_RT) +
+                                           CPU_THROTTLE_TIMESLICE_NS);
+    }
+}
+
 void cpu_throttle_stop(void)
 {
+    CPUState *cpu;
+
     atomic_set(&throttle_percentage, 0);
+    CPU_FOREACH(cpu) {
+        atomic_set(&cpu->throttle_percentage, 0);
+    }
 }
 
 bool cpu_throttle_active(void)
@@ -778,6 +824,11 @@ int cpu_throttle_get_percentage(void)
     return atomic_read(&throttle_percentage);
 }
 
+int cpu_throttle_get_vcpu_percentage(CPUState *cpu)
+{
+    return atomic_read(&cpu->throttle_percentage);
+}
+
 void cpu_ticks_init(void)
 {
     seqlock_init(&timers_state.vm_clock_seqlock);
@@ -1104,6 +1155,19 @@ static void qemu_init_sigbus(void)
 
 static QemuMutex qemu_global_mutex;
 
+/* For the loop profiler: who took the BQL, and since when it is held */
+static __thread const void *iothread_lock_caller;
+static __thread int64_t iothread_lock_start;
+
+/* Wait on @cond, not counting the wait as BQL hold time */
+static void qemu_cond_wait_iothread(QemuCond *cond)
+{
+    loop_profile_end(LOOP_PROFILE_KIND_BQL_HOLD, iothread_lock_caller,
+                     iothread_lock_start);
+    qemu_cond_wait(cond, &qemu_global_mutex);
+    iothread_lock_start = loop_profile_start();
+}
+
 static QemuThread io_thread;
 
 /* cpu creation */
@@ -1162,7 +1226,8 @@ static void qemu_tcg_rr_wait_io_event(CPUState *cpu)
 {
     while (all_cpu_threads_idle()) {
         stop_tcg_kick_timer();
-        qemu_cond_wait(cpu->halt_cond, &qemu_global_mutex);
+        stat64_add(&cpu->halts, 1);
+        qemu_cond_wait_iothread(cpu->halt_cond);
     }
 
     start_tcg_kick_timer();
@@ -1173,7 +1238,8 @@ static void qemu_tcg_rr_wait_io_event(CPUState *cpu)
 static void qemu_wait_io_event(CPUState *cpu)
 {
     while (cpu_thread_is_idle(cpu)) {
-        qemu_cond_wait(cpu->halt_cond, &qemu_global_mutex);
+        stat64_add(&cpu->halts, 1);
+        qemu_cond_wait_iothread(cpu->halt_cond);
     }
 
 #ifdef _WIN32
@@ -1309,6 +1375,28 @@ static void handle_icount_deadline(void)
     }
 }
 
+/*
+ * In icount mode, round-robin time slices are bounded by the
+ * instruction budget.  A vCPU may run for twice its recent average,
+ * clamped between TCG_RR_MIN_SLICE and TCG_KICK_PERIOD of virtual time.
+ * A vCPU that usually halts or blocks quickly is descheduled soon if it
+ * starts spinning, e.g. on a lock held by another vCPU.  CPU-bound vCPUs
+ * grow back to long slices within a few visits.  All of this is counted
+ * in instructions, so record and replay schedule the same way.
+ */
+#define TCG_RR_MIN_SLICE (NANOSECONDS_PER_SECOND / 1000)
+
+static int64_t tcg_rr_slice(CPUState *cpu)
+{
+    int64_t min = qemu_icount_round(TCG_RR_MIN_SLICE);
+    int64_t max = qemu_icount_round(TCG_KICK_PERIOD);
+
+    if (!CPU_NEXT(first_cpu)) {
+        return INT64_MAX;
+    }
+    return MIN(MAX(2 * cpu->tcg_rr_avg_insns, min), max);
+}
+
 static void prepare_icount_for_run(CPUState *cpu)
 {
     if (use_icount) {
@@ -1321,7 +1409,7 @@ static void prepare_icount_for_run(CPUState *cpu)
         g_assert(cpu->icount_decr.u16.low == 0);
         g_assert(cpu->icount_extra == 0);
 
-        cpu->icount_budget = tcg_get_icount_limit();
+        cpu->icount_budget = MIN(tcg_get_icount_limit(), tcg_rr_slice(cpu));
         insns_left = MIN(0xffff, cpu->icount_budget);
         cpu->icount_decr.u16.low = insns_left;
         cpu->icount_extra = cpu->icount_budget - insns_left;
@@ -1333,6 +1421,10 @@ static void prepare_icount_for_run(CPUState *cpu)
 static void process_icount_data(CPUState *cpu)
 {
     if (use_icount) {
+        int64_t executed = cpu_get_icount_executed(cpu);
+
+        cpu->tcg_rr_avg_insns += (executed - cpu->tcg_rr_avg_insns) / 4;
+
         /* Account for executed instructions */
         cpu_update_icount(cpu);
 
@@ -1412,7 +1504,7 @@ static void *qemu_tcg_rr_cpu_thread_fn(void *arg)
 
     /* wait for initial kick-off after machine start */
     while (first_cpu->stopped) {
-        qemu_cond_wait(first_cpu->halt_cond, &qemu_global_mutex);
+        qemu_cond_wait_iothread(first_cpu->halt_cond);
 
         /* process any pending work */
         CPU_FOREACH(cpu) {
@@ -1457,6 +1549,13 @@ static void *qemu_tcg_rr_cpu_thread_fn(void *arg)
             if (cpu_can_run(cpu)) {
                 int r;
 
+                if (cpu->halted && !cpu->interrupt_request &&
+                    !cpu_has_work(cpu)) {
+                    /* cpu_exec() would return EXCP_HALTED right away */
+                    cpu = CPU_NEXT(cpu);
+                    continue;
+                }
+
                 qemu_mutex_unlock_iothread();
                 prepare_icount_for_run(cpu);
 
@@ -1603,7 +1702,7 @@ static void *qemu_whpx_cpu_thread_fn(void *arg)
             }
         }
         while (cpu_thread_is_idle(cpu)) {
-            qemu_cond_wait(cpu->halt_cond, &qemu_global_mutex);
+            qemu_cond_wait_iothread(cpu->halt_cond);
         }
         qemu_wait_io_event_common(cpu);
     } while (!cpu->unplug || cpu_can_run(cpu));
@@ -1722,6 +1821,7 @@ static void qemu_cpu_kick_thread(CPUState *cpu)
 
 void qemu_cpu_kick(CPUState *cpu)
 {
+    stat64_add(&cpu->kicks, 1);
     qemu_cond_broadcast(cpu->halt_cond);
     if (tcg_enabled()) {
         cpu_exit(cpu);
@@ -1764,16 +1864,26 @@ bool qemu_mutex_iothread_locked(void)
 
 void qemu_mutex_lock_iothread(void)
 {
+    int64_t start = loop_profile_start();
+
     g_assert(!qemu_mutex_iothread_locked());
     qemu_mutex_lock(&qemu_global_mutex);
     iothread_locked = true;
+
+    iothread_lock_caller = __builtin_return_address(0);
+    loop_profile_end(LOOP_PROFILE_KIND_BQL_WAIT, iothread_lock_caller, start);
+    iothread_lock_start = loop_profile_start();
 }
 
 void qemu_mutex_unlock_iothread(void)
 {
+    int64_t start = iothread_lock_start;
+
     g_assert(qemu_mutex_iothread_locked());
     iothread_locked = false;
+    iothread_lock_start = 0;
     qemu_mutex_unlock(&qemu_global_mutex);
+    loop_profile_end(LOOP_PROFILE_KIND_BQL_HOLD, iothread_lock_caller, start);
 }
 
 static bool all_vcpus_paused(void)
@@ -1809,7 +1919,7 @@ void pause_all_vcpus(void)
     replay_mutex_unlock();
 
     while (!all_vcpus_paused()) {
-        qemu_cond_wait(&qemu_pause_cond, &qemu_global_mutex);
+        qemu_cond_wait_iothread(&qemu_pause_cond);
         CPU_FOREACH(cpu) {
             qemu_cpu_kick(cpu);
         }
@@ -1850,11 +1960,12 @@ void cpu_remove_sync(CPUState *cpu)
 /* For temporary buffers for forming a name */
 #define VCPU_THREAD_NAME_SIZE 16
 
+static QemuCond *single_tcg_halt_cond;
+static QemuThread *single_tcg_cpu_thread;
+
 static void qemu_tcg_init_vcpu(CPUState *cpu)
 {
     char thread_name[VCPU_THREAD_NAME_SIZE];
-    static QemuCond *single_tcg_halt_cond;
-    static QemuThread *single_tcg_cpu_thread;
     static int tcg_region_inited;
 
     assert(tcg_enabled());
@@ -2012,7 +2123,7 @@ void qemu_init_vcpu(CPUState *cpu)
     }
 
     while (!cpu->created) {
-        qemu_cond_wait(&qemu_cpu_cond, &qemu_global_mutex);
+        qemu_cond_wait_iothread(&qemu_cpu_cond);
     }
 }
 
@@ -2290,6 +2401,118 @@ CpuInfoFastList *qmp_query_cpus_fast(Error **errp)
     return head;
 }
 
+void vcpu_collect_stats(StatsResultList ***tail)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        char *id = g_strdup_printf("%d", cpu->cpu_index);
+        StatsResult *result = stats_result_add(tail, STATS_TARGET_VCPU, id);
+
+        stats_add(result, "halts", stat64_get(&cpu->halts));
+        stats_add(result, "kicks", stat64_get(&cpu->kicks));
+        stats_add(result, "work-items", stat64_get(&cpu->work_items));
+        g_free(id);
+    }
+}
+
+#ifdef CONFIG_POSIX
+static void vm_fork_child_exited(pid_t pid, int status, void *opaque)
+{
+    qapi_event_send_vm_fork_exit(pid, WIFEXITED(status), WEXITSTATUS(status),
+                                 WIFSIGNALED(status), WTERMSIG(status),
+                                 &error_abort);
+}
+
+/* Only the thread that called fork() exists in the child */
+static void qemu_tcg_fork_child(void)
+{
+    CPUState *cpu;
+
+    tcg_fork_child();
+    single_tcg_halt_cond = NULL;
+    single_tcg_cpu_thread = NULL;
+    CPU_FOREACH(cpu) {
+        cpu->created = false;
+        cpu->thread_kicked = false;
+        qemu_init_vcpu(cpu);
+    }
+}
+
+VmForkInfo *qmp_x_vm_fork(Error **errp)
+{
+    VmForkInfo *info;
+    BlockBackend *blk;
+    pid_t pid;
+    int err;
+
+    if (!tcg_enabled()) {
+        error_setg(errp, "x-vm-fork is only supported with accel=tcg");
+        return NULL;
+    }
+    if (runstate_is_running()) {
+        error_setg(errp, "the guest must be stopped before forking");
+        return NULL;
+    }
+    if (!migration_is_idle() || replay_mode != REPLAY_MODE_NONE) {
+        error_setg(errp, "cannot fork during migration or record/replay");
+        return NULL;
+    }
+    for (blk = blk_all_next(NULL); blk; blk = blk_all_next(blk)) {
+        if (blk_is_inserted(blk) && !blk_is_read_only(blk)) {
+            error_setg(errp, "cannot fork with writable block devices");
+            return NULL;
+        }
+    }
+
+    /*
+     * No thread may be inside the block layer, an AioContext or a
+     * thread pool at the time of fork(), or the child would inherit
+     * locks and requests that nobody is going to complete.  vCPU
+     * threads are stopped already; RCU has its own atfork handlers.
+     */
+    bdrv_drain_all_begin();
+    if (!aio_context_fork_prepare(qemu_get_aio_context(), errp) ||
+        !iothread_fork_prepare(errp)) {
+        bdrv_drain_all_end();
+        return NULL;
+    }
+
+    rcu_enable_atfork();
+    pid = fork();
+    err = errno;
+    rcu_disable_atfork();
+
+    if (pid == 0) {
+        monitor_fork_child();
+    }
+    iothread_fork_done();
+    bdrv_drain_all_end();
+
+    if (pid < 0) {
+        error_setg_errno(errp, err, "cannot fork");
+        return NULL;
+    }
+
+    if (pid == 0) {
+        qemu_tcg_fork_child();
+        vm_start();
+    } else {
+        qemu_add_child_watch_full(pid, vm_fork_child_exited, NULL);
+    }
+
+    info = g_new0(VmForkInfo, 1);
+    info->pid = pid;
+    return info;
+}
+#else
+VmForkInfo *qmp_x_vm_fork(Error **errp)
+{
+    error_setg(errp, "x-vm-fork is not supported on this host");
+    return NULL;
+}
+#endif
+
 void qmp_memsave(int64_t addr, int64_t size, const char *filename,
                  bool has_cpu, int64_t cpu_index, Error **errp)
 {
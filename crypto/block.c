@@ -52,29 +52,39 @@ QCryptoBlock *qcrypto_block_open(QCryptoBlockOpenOptions *options,
                                  QCryptoBlockReadFunc readfunc,
                                  void *opaque,
                                  unsigned int flags,
+                                 size_t n_threads,
                                  Error **errp)
 {
     QCryptoBlock *block = g_new0(QCryptoBlock, 1);
 
+    qemu_mutex_init(&block->mutex);
+    qemu_cond_init(&block->cipher_cond);
+
     block->format = options->format;
 
     if (options->format >= G_N_ELEMENTS(qcrypto_block_drivers) ||
         !qcrypto_block_drivers[options->format]) {
         error_setg(errp, "Unsupported block driver %s",
                    QCryptoBlockFormat_str(options->format));
-        g_free(block);
-        return NULL;
+        goto error;
     }
 
     block->driver = qcrypto_block_drivers[options->format];
 
     if (block->driver->open(block, options, optprefix,
-                            readfunc, opaque, flags, errp) < 0) {
-        g_free(block);
-        return NULL;
+                            readfunc, opaque, flags,
+                            MAX(n_threads, 1), errp) < 0) {
+        goto error;
     }
 
     return block;
+
+ error:
+    qcrypto_block_free_cipher(block);
+    qemu_cond_destroy(&block->cipher_cond);
+    qemu_mutex_destroy(&block->mutex);
+    g_free(block);
+    return NULL;
 }
 
 
@@ -87,25 +97,33 @@ QCryptoBlock *qcrypto_block_create(QCryptoBlockCreateOptions *options,
 {
     QCryptoBlock *block = g_new0(QCryptoBlock, 1);
 
+    qemu_mutex_init(&block->mutex);
+    qemu_cond_init(&block->cipher_cond);
+
     block->format = options->format;
 
     if (options->format >= G_N_ELEMENTS(qcrypto_block_drivers) ||
         !qcrypto_block_drivers[options->format]) {
         error_setg(errp, "Unsupported block driver %s",
                    QCryptoBlockFormat_str(options->format));
-        g_free(block);
-        return NULL;
+        goto error;
     }
 
     block->driver = qcrypto_block_drivers[options->format];
 
     if (block->driver->create(block, options, optprefix, initfunc,
                               writefunc, opaque, errp) < 0) {
-        g_free(block);
-        return NULL;
+        goto error;
     }
 
     return block;
+
+ error:
+    qcrypto_block_free_cipher(block);
+    qemu_cond_destroy(&block->cipher_cond);
+    qemu_mutex_destroy(&block->mutex);
+    g_free(block);
+    return NULL;
 }
 
 
@@ -148,7 +166,8 @@ int qcrypto_block_encrypt(QCryptoBlock *block,
 
 QCryptoCipher *qcrypto_block_get_cipher(QCryptoBlock *block)
 {
-    return block->cipher;
+    /* Ciphers should be accessed through pop/push functions below */
+    return block->n_ciphers > 0 ? block->ciphers[0] : NULL;
 }
 
 
@@ -184,113 +203,178 @@ void qcrypto_block_free(QCryptoBlock *block)
 
     block->driver->cleanup(block);
 
-    qcrypto_cipher_free(block->cipher);
+    qcrypto_block_free_cipher(block);
     qcrypto_ivgen_free(block->ivgen);
+    qemu_cond_destroy(&block->cipher_cond);
+    qemu_mutex_destroy(&block->mutex);
     g_free(block);
 }
 
 
-int qcrypto_block_decrypt_helper(QCryptoCipher *cipher,
-                                 size_t niv,
-                                 QCryptoIVGen *ivgen,
-                                 int sectorsize,
-                                 uint64_t offset,
-                                 uint8_t *buf,
-                                 size_t len,
-                                 Error **errp)
+int qcrypto_block_init_cipher(QCryptoBlock *block,
+                              QCryptoCipherAlgorithm alg,
+                              QCryptoCipherMode mode,
+                              const uint8_t *key, size_t nkey,
+                              size_t n_threads, Error **errp)
 {
-    uint8_t *iv;
-    int ret = -1;
-    uint64_t startsector = offset / sectorsize;
+    size_t i;
 
-    assert(QEMU_IS_ALIGNED(offset, sectorsize));
-    assert(QEMU_IS_ALIGNED(len, sectorsize));
+    assert(!block->ciphers && !block->n_ciphers && !block->n_free_ciphers);
 
-    iv = niv ? g_new0(uint8_t, niv) : NULL;
+    block->ciphers = g_new0(QCryptoCipher *, n_threads);
 
-    while (len > 0) {
-        size_t nbytes;
-        if (niv) {
-            if (qcrypto_ivgen_calculate(ivgen,
-                                        startsector,
-                                        iv, niv,
-                                        errp) < 0) {
-                goto cleanup;
-            }
-
-            if (qcrypto_cipher_setiv(cipher,
-                                     iv, niv,
-                                     errp) < 0) {
-                goto cleanup;
-            }
+    for (i = 0; i < n_threads; i++) {
+        block->ciphers[i] = qcrypto_cipher_new(alg, mode, key, nkey, errp);
+        if (!block->ciphers[i]) {
+            qcrypto_block_free_cipher(block);
+            return -1;
         }
+        block->n_ciphers++;
+        block->n_free_ciphers++;
+    }
 
-        nbytes = len > sectorsize ? sectorsize : len;
-        if (qcrypto_cipher_decrypt(cipher, buf, buf,
-                                   nbytes, errp) < 0) {
-            goto cleanup;
-        }
+    return 0;
+}
 
-        startsector++;
-        buf += nbytes;
-        len -= nbytes;
+
+void qcrypto_block_free_cipher(QCryptoBlock *block)
+{
+    size_t i;
+
+    if (!block->ciphers) {
+        return;
     }
 
-    ret = 0;
- cleanup:
-    g_free(iv);
-    return ret;
+    assert(block->n_ciphers == block->n_free_ciphers);
+
+    for (i = 0; i < block->n_ciphers; i++) {
+        qcrypto_cipher_free(block->ciphers[i]);
+    }
+
+    g_free(block->ciphers);
+    block->ciphers = NULL;
+    block->n_ciphers = block->n_free_ciphers = 0;
 }
 
 
-int qcrypto_block_encrypt_helper(QCryptoCipher *cipher,
-                                 size_t niv,
-                                 QCryptoIVGen *ivgen,
-                                 int sectorsize,
-                                 uint64_t offset,
-                                 uint8_t *buf,
-                                 size_t len,
-                                 Error **errp)
+static QCryptoCipher *qcrypto_block_pop_cipher(QCryptoBlock *block)
 {
-    uint8_t *iv;
+    QCryptoCipher *cipher;
+
+    qemu_mutex_lock(&block->mutex);
+
+    assert(block->n_ciphers);
+    while (!block->n_free_ciphers) {
+        qemu_cond_wait(&block->cipher_cond, &block->mutex);
+    }
+    cipher = block->ciphers[--block->n_free_ciphers];
+
+    qemu_mutex_unlock(&block->mutex);
+
+    return cipher;
+}
+
+
+static void qcrypto_block_push_cipher(QCryptoBlock *block,
+                                      QCryptoCipher *cipher)
+{
+    qemu_mutex_lock(&block->mutex);
+
+    assert(block->n_free_ciphers < block->n_ciphers);
+    block->ciphers[block->n_free_ciphers++] = cipher;
+    qemu_cond_signal(&block->cipher_cond);
+
+    qemu_mutex_unlock(&block->mutex);
+}
+
+
+/* Sectors whose IVs are computed up front and handed to the cipher at once */
+#define QCRYPTO_BLOCK_SECTOR_BATCH 64
+
+static int qcrypto_block_crypt_helper(QCryptoBlock *block,
+                                      bool encrypt,
+                                      int sectorsize,
+                                      uint64_t offset,
+                                      uint8_t *buf,
+                                      size_t len,
+                                      Error **errp)
+{
+    QCryptoCipher *cipher;
+    size_t niv = block->niv;
+    uint8_t *ivs;
     int ret = -1;
     uint64_t startsector = offset / sectorsize;
 
     assert(QEMU_IS_ALIGNED(offset, sectorsize));
     assert(QEMU_IS_ALIGNED(len, sectorsize));
 
-    iv = niv ? g_new0(uint8_t, niv) : NULL;
+    ivs = niv ? g_new0(uint8_t, niv * QCRYPTO_BLOCK_SECTOR_BATCH) : NULL;
+    cipher = qcrypto_block_pop_cipher(block);
 
     while (len > 0) {
-        size_t nbytes;
+        size_t nsectors = MIN(len / sectorsize, QCRYPTO_BLOCK_SECTOR_BATCH);
+        size_t nbytes = nsectors * sectorsize;
+        size_t i;
+        int r = 0;
+
+        /* The IV generator may itself use a cipher, which is not shared */
         if (niv) {
-            if (qcrypto_ivgen_calculate(ivgen,
-                                        startsector,
-                                        iv, niv,
-                                        errp) < 0) {
-                goto cleanup;
+            qemu_mutex_lock(&block->mutex);
+            for (i = 0; r == 0 && i < nsectors; i++) {
+                r = qcrypto_ivgen_calculate(block->ivgen,
+                                            startsector + i,
+                                            ivs + i * niv, niv,
+                                            errp);
             }
-
-            if (qcrypto_cipher_setiv(cipher,
-                                     iv, niv,
-                                     errp) < 0) {
+            qemu_mutex_unlock(&block->mutex);
+            if (r < 0) {
                 goto cleanup;
             }
         }
 
-        nbytes = len > sectorsize ? sectorsize : len;
-        if (qcrypto_cipher_encrypt(cipher, buf, buf,
-                                   nbytes, errp) < 0) {
+        if (encrypt) {
+            r = qcrypto_cipher_encrypt_sectors(cipher, ivs, niv, sectorsize,
+                                               buf, buf, nbytes, errp);
+        } else {
+            r = qcrypto_cipher_decrypt_sectors(cipher, ivs, niv, sectorsize,
+                                               buf, buf, nbytes, errp);
+        }
+        if (r < 0) {
             goto cleanup;
         }
 
-        startsector++;
+        startsector += nsectors;
         buf += nbytes;
         len -= nbytes;
     }
 
     ret = 0;
  cleanup:
-    g_free(iv);
+    qcrypto_block_push_cipher(block, cipher);
+    g_free(ivs);
     return ret;
 }
+
+
+int qcrypto_block_decrypt_helper(QCryptoBlock *block,
+                                 int sectorsize,
+                                 uint64_t offset,
+                                 uint8_t *buf,
+                                 size_t len,
+                                 Error **errp)
+{
+    return qcrypto_block_crypt_helper(block, false, sectorsize,
+                                      offset, buf, len, errp);
+}
+
+
+int qcrypto_block_encrypt_helper(QCryptoBlock *block,
+                                 int sectorsize,
+                                 uint64_t offset,
+                                 uint8_t *buf,
+                                 size_t len,
+                                 Error **errp)
+{
+    return qcrypto_block_crypt_helper(block, true, sectorsize,
+                                      offset, buf, len, errp);
+}
@@ -150,6 +150,279 @@ static void qcrypto_cipher_aes_xts_decrypt(const void *ctx,
 }
 
 
+/*
+ * Hardware AES.  The round keys computed by crypto/aes.c are reused: they
+ * are kept as big-endian words, and the decryption schedule is already in
+ * the "equivalent inverse cipher" form that AESDEC and AESD expect, so
+ * only the byte order needs fixing up.
+ */
+#if defined(CONFIG_AVX2_OPT)
+#define QCRYPTO_AES_HW 1
+
+#include "qemu/cpuid.h"
+
+static bool aes_hw_enabled;
+
+static void __attribute__((constructor)) aes_hw_init(void)
+{
+    int a, b, c, d;
+
+    if (__get_cpuid_max(0, NULL) >= 1) {
+        __cpuid(1, a, b, c, d);
+        aes_hw_enabled = (c & bit_AES) && (c & bit_SSSE3);
+    }
+}
+
+/* As in util/bufferiszero.c, the includes must be inside the region */
+#pragma GCC push_options
+#pragma GCC target("aes,ssse3")
+#include <wmmintrin.h>
+#include <tmmintrin.h>
+
+typedef __m128i AESHWBlock;
+
+static inline AESHWBlock aes_hw_load(const uint8_t *p)
+{
+    return _mm_loadu_si128((const __m128i *)p);
+}
+
+static inline void aes_hw_store(uint8_t *p, AESHWBlock b)
+{
+    _mm_storeu_si128((__m128i *)p, b);
+}
+
+static inline AESHWBlock aes_hw_xor(AESHWBlock a, AESHWBlock b)
+{
+    return _mm_xor_si128(a, b);
+}
+
+static int aes_hw_load_key(const AES_KEY *key, AESHWBlock *rk)
+{
+    const __m128i bswap32 = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11,
+                                         4, 5, 6, 7, 0, 1, 2, 3);
+    int i;
+
+    /* Unused entries are zero; loading them keeps rk[] fully initialized */
+    for (i = 0; i <= AES_MAXNR; i++) {
+        rk[i] = _mm_shuffle_epi8(aes_hw_load((const uint8_t *)
+                                             &key->rd_key[4 * i]), bswap32);
+    }
+    return key->rounds;
+}
+
+static inline AESHWBlock aes_hw_encrypt(AESHWBlock b, const AESHWBlock *rk,
+                                        int rounds)
+{
+    int i;
+
+    b = _mm_xor_si128(b, rk[0]);
+    for (i = 1; i < rounds; i++) {
+        b = _mm_aesenc_si128(b, rk[i]);
+    }
+    return _mm_aesenclast_si128(b, rk[rounds]);
+}
+
+static inline AESHWBlock aes_hw_decrypt(AESHWBlock b, const AESHWBlock *rk,
+                                        int rounds)
+{
+    int i;
+
+    b = _mm_xor_si128(b, rk[0]);
+    for (i = 1; i < rounds; i++) {
+        b = _mm_aesdec_si128(b, rk[i]);
+    }
+    return _mm_aesdeclast_si128(b, rk[rounds]);
+}
+
+/* Multiply the tweak by x in GF(2^128), like xts_mult_x() */
+static inline AESHWBlock aes_hw_mult_x(AESHWBlock t)
+{
+    __m128i carry = _mm_srai_epi32(t, 31);
+
+    carry = _mm_and_si128(carry, _mm_set_epi32(0x87, 1, 1, 1));
+    carry = _mm_shuffle_epi32(carry, 0x93);
+    return _mm_xor_si128(_mm_slli_epi32(t, 1), carry);
+}
+
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRYPTO) && \
+    !defined(HOST_WORDS_BIGENDIAN)
+#define QCRYPTO_AES_HW 1
+
+#include <arm_neon.h>
+
+/* There is no portable way to probe for the extensions at run time */
+static const bool aes_hw_enabled = true;
+
+typedef uint8x16_t AESHWBlock;
+
+static inline AESHWBlock aes_hw_load(const uint8_t *p)
+{
+    return vld1q_u8(p);
+}
+
+static inline void aes_hw_store(uint8_t *p, AESHWBlock b)
+{
+    vst1q_u8(p, b);
+}
+
+static inline AESHWBlock aes_hw_xor(AESHWBlock a, AESHWBlock b)
+{
+    return veorq_u8(a, b);
+}
+
+static int aes_hw_load_key(const AES_KEY *key, AESHWBlock *rk)
+{
+    int i;
+
+    /* Unused entries are zero; loading them keeps rk[] fully initialized */
+    for (i = 0; i <= AES_MAXNR; i++) {
+        rk[i] = vrev32q_u8(aes_hw_load((const uint8_t *)&key->rd_key[4 * i]));
+    }
+    return key->rounds;
+}
+
+static inline AESHWBlock aes_hw_encrypt(AESHWBlock b, const AESHWBlock *rk,
+                                        int rounds)
+{
+    int i;
+
+    for (i = 0; i < rounds - 1; i++) {
+        b = vaesmcq_u8(vaeseq_u8(b, rk[i]));
+    }
+    return veorq_u8(vaeseq_u8(b, rk[rounds - 1]), rk[rounds]);
+}
+
+static inline AESHWBlock aes_hw_decrypt(AESHWBlock b, const AESHWBlock *rk,
+                                        int rounds)
+{
+    int i;
+
+    for (i = 0; i < rounds - 1; i++) {
+        b = vaesimcq_u8(vaesdq_u8(b, rk[i]));
+    }
+    return veorq_u8(vaesdq_u8(b, rk[rounds - 1]), rk[rounds]);
+}
+
+/* Multiply the tweak by x in GF(2^128), like xts_mult_x() */
+static inline AESHWBlock aes_hw_mult_x(AESHWBlock t)
+{
+    int64x2_t s = vreinterpretq_s64_u8(t);
+    int64x2_t carry = vshrq_n_s64(s, 63);
+
+    carry = vandq_s64(vextq_s64(carry, carry, 1),
+                      vcombine_s64(vcreate_s64(0x87), vcreate_s64(1)));
+    return vreinterpretq_u8_s64(veorq_s64(vshlq_n_s64(s, 1), carry));
+}
+#endif
+
+#ifdef QCRYPTO_AES_HW
+/* @len must be a multiple of AES_BLOCK_SIZE; @iv is left untouched */
+static void aes_hw_xts(const QCryptoCipherBuiltinAES *aes, bool encrypt,
+                       const uint8_t *iv, size_t len,
+                       uint8_t *dst, const uint8_t *src)
+{
+    AESHWBlock rk[AES_MAXNR + 1], t;
+    int rounds;
+
+    rounds = aes_hw_load_key(&aes->key_tweak.enc, rk);
+    t = aes_hw_encrypt(aes_hw_load(iv), rk, rounds);
+    rounds = aes_hw_load_key(encrypt ? &aes->key.enc : &aes->key.dec, rk);
+
+    for (; len; len -= AES_BLOCK_SIZE) {
+        AESHWBlock b = aes_hw_xor(aes_hw_load(src), t);
+
+        b = encrypt ? aes_hw_encrypt(b, rk, rounds)
+                    : aes_hw_decrypt(b, rk, rounds);
+        aes_hw_store(dst, aes_hw_xor(b, t));
+        t = aes_hw_mult_x(t);
+        src += AES_BLOCK_SIZE;
+        dst += AES_BLOCK_SIZE;
+    }
+}
+
+/* @len must be a multiple of AES_BLOCK_SIZE; @iv is updated like CBC does */
+static void aes_hw_cbc(const QCryptoCipherBuiltinAES *aes, bool encrypt,
+                       uint8_t *iv, size_t len,
+                       uint8_t *dst, const uint8_t *src)
+{
+    AESHWBlock rk[AES_MAXNR + 1], prev = aes_hw_load(iv);
+    int rounds;
+
+    rounds = aes_hw_load_key(encrypt ? &aes->key.enc : &aes->key.dec, rk);
+    for (; len; len -= AES_BLOCK_SIZE) {
+        AESHWBlock b = aes_hw_load(src);
+
+        if (encrypt) {
+            prev = aes_hw_encrypt(aes_hw_xor(b, prev), rk, rounds);
+            aes_hw_store(dst, prev);
+        } else {
+            /* Decryption is not chained, but @dst may be @src */
+            aes_hw_store(dst, aes_hw_xor(aes_hw_decrypt(b, rk, rounds),
+                                         prev));
+            prev = b;
+        }
+        src += AES_BLOCK_SIZE;
+        dst += AES_BLOCK_SIZE;
+    }
+    aes_hw_store(iv, prev);
+}
+#endif
+
+#if defined(CONFIG_AVX2_OPT)
+#pragma GCC pop_options
+#endif
+
+
+static void qcrypto_cipher_aes_xts_crypt(QCryptoCipherBuiltinAES *aes,
+                                         bool encrypt,
+                                         const uint8_t *iv,
+                                         const void *in,
+                                         void *out,
+                                         size_t len)
+{
+    uint8_t tweak[AES_BLOCK_SIZE];
+
+#ifdef QCRYPTO_AES_HW
+    if (aes_hw_enabled && !(len % AES_BLOCK_SIZE)) {
+        aes_hw_xts(aes, encrypt, iv, len, out, in);
+        return;
+    }
+#endif
+
+    memcpy(tweak, iv, AES_BLOCK_SIZE);
+    if (encrypt) {
+        xts_encrypt(&aes->key, &aes->key_tweak,
+                    qcrypto_cipher_aes_xts_encrypt,
+                    qcrypto_cipher_aes_xts_decrypt,
+                    tweak, len, out, in);
+    } else {
+        xts_decrypt(&aes->key, &aes->key_tweak,
+                    qcrypto_cipher_aes_xts_encrypt,
+                    qcrypto_cipher_aes_xts_decrypt,
+                    tweak, len, out, in);
+    }
+}
+
+
+static void qcrypto_cipher_aes_cbc_crypt(QCryptoCipherBuiltinAES *aes,
+                                         bool encrypt,
+                                         const void *in,
+                                         void *out,
+                                         size_t len)
+{
+#ifdef QCRYPTO_AES_HW
+    if (aes_hw_enabled && !(len % AES_BLOCK_SIZE)) {
+        aes_hw_cbc(aes, encrypt, aes->iv, len, out, in);
+        return;
+    }
+#endif
+
+    AES_cbc_encrypt(in, out, len,
+                    encrypt ? &aes->key.enc : &aes->key.dec,
+                    aes->iv, encrypt);
+}
+
+
 static int qcrypto_cipher_encrypt_aes(QCryptoCipher *cipher,
                                       const void *in,
                                       void *out,
@@ -164,17 +437,11 @@ static int qcrypto_cipher_encrypt_aes(QCryptoCipher *cipher,
                                        in, out, len);
         break;
     case QCRYPTO_CIPHER_MODE_CBC:
-        AES_cbc_encrypt(in, out, len,
-                        &ctxt->state.aes.key.enc,
-                        ctxt->state.aes.iv, 1);
+        qcrypto_cipher_aes_cbc_crypt(&ctxt->state.aes, true, in, out, len);
         break;
     case QCRYPTO_CIPHER_MODE_XTS:
-        xts_encrypt(&ctxt->state.aes.key,
-                    &ctxt->state.aes.key_tweak,
-                    qcrypto_cipher_aes_xts_encrypt,
-                    qcrypto_cipher_aes_xts_decrypt,
-                    ctxt->state.aes.iv,
-                    len, out, in);
+        qcrypto_cipher_aes_xts_crypt(&ctxt->state.aes, true,
+                                     ctxt->state.aes.iv, in, out, len);
         break;
     default:
         g_assert_not_reached();
@@ -198,17 +465,11 @@ static int qcrypto_cipher_decrypt_aes(QCryptoCipher *cipher,
                                        in, out, len);
         break;
     case QCRYPTO_CIPHER_MODE_CBC:
-        AES_cbc_encrypt(in, out, len,
-                        &ctxt->state.aes.key.dec,
-                        ctxt->state.aes.iv, 0);
+        qcrypto_cipher_aes_cbc_crypt(&ctxt->state.aes, false, in, out, len);
         break;
     case QCRYPTO_CIPHER_MODE_XTS:
-        xts_decrypt(&ctxt->state.aes.key,
-                    &ctxt->state.aes.key_tweak,
-                    qcrypto_cipher_aes_xts_encrypt,
-                    qcrypto_cipher_aes_xts_decrypt,
-                    ctxt->state.aes.iv,
-                    len, out, in);
+        qcrypto_cipher_aes_xts_crypt(&ctxt->state.aes, false,
+                                     ctxt->state.aes.iv, in, out, len);
         break;
     default:
         g_assert_not_reached();
@@ -526,9 +787,96 @@ qcrypto_builtin_cipher_setiv(QCryptoCipher *cipher,
 }
 
 
+static int
+qcrypto_builtin_cipher_crypt_sectors(QCryptoCipher *cipher,
+                                     bool encrypt,
+                                     const uint8_t *ivs, size_t niv,
+                                     size_t sectorsize,
+                                     const uint8_t *in,
+                                     uint8_t *out,
+                                     size_t len,
+                                     Error **errp)
+{
+    QCryptoCipherBuiltin *ctxt = cipher->opaque;
+    size_t offset;
+
+    if (sectorsize % ctxt->blocksize) {
+        error_setg(errp, "Sector size %zu must be a multiple of block size %zu",
+                   sectorsize, ctxt->blocksize);
+        return -1;
+    }
+
+    /* XTS takes each sector's IV directly, without going through setiv */
+    if (cipher->mode == QCRYPTO_CIPHER_MODE_XTS &&
+        ivs && niv == AES_BLOCK_SIZE) {
+        for (offset = 0; offset < len; offset += sectorsize) {
+            qcrypto_cipher_aes_xts_crypt(&ctxt->state.aes, encrypt,
+                                         ivs, in + offset, out + offset,
+                                         sectorsize);
+            ivs += niv;
+        }
+        return 0;
+    }
+
+    for (offset = 0; offset < len; offset += sectorsize) {
+        int ret;
+
+        if (ivs) {
+            if (ctxt->setiv(cipher, ivs, niv, errp) < 0) {
+                return -1;
+            }
+            ivs += niv;
+        }
+        if (encrypt) {
+            ret = ctxt->encrypt(cipher, in + offset, out + offset,
+                                sectorsize, errp);
+        } else {
+            ret = ctxt->decrypt(cipher, in + offset, out + offset,
+                                sectorsize, errp);
+        }
+        if (ret < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+static int
+qcrypto_builtin_cipher_encrypt_sectors(QCryptoCipher *cipher,
+                                       const uint8_t *ivs, size_t niv,
+                                       size_t sectorsize,
+                                       const void *in,
+                                       void *out,
+                                       size_t len,
+                                       Error **errp)
+{
+    return qcrypto_builtin_cipher_crypt_sectors(cipher, true, ivs, niv,
+                                                sectorsize, in, out, len,
+                                                errp);
+}
+
+
+static int
+qcrypto_builtin_cipher_decrypt_sectors(QCryptoCipher *cipher,
+                                       const uint8_t *ivs, size_t niv,
+                                       size_t sectorsize,
+                                       const void *in,
+                                       void *out,
+                                       size_t len,
+                                       Error **errp)
+{
+    return qcrypto_builtin_cipher_crypt_sectors(cipher, false, ivs, niv,
+                                                sectorsize, in, out, len,
+                                                errp);
+}
+
+
 static struct QCryptoCipherDriver qcrypto_cipher_lib_driver = {
     .cipher_encrypt = qcrypto_builtin_cipher_encrypt,
     .cipher_decrypt = qcrypto_builtin_cipher_decrypt,
+    .cipher_encrypt_sectors = qcrypto_builtin_cipher_encrypt_sectors,
+    .cipher_decrypt_sectors = qcrypto_builtin_cipher_decrypt_sectors,
     .cipher_setiv = qcrypto_builtin_cipher_setiv,
     .cipher_free = qcrypto_builtin_cipher_ctx_free,
 };
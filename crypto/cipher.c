@@ -214,6 +214,79 @@ int qcrypto_cipher_decrypt(QCryptoCipher *cipher,
 }
 
 
+static int qcrypto_cipher_crypt_sectors(QCryptoCipher *cipher,
+                                        bool encrypt,
+                                        const uint8_t *ivs, size_t niv,
+                                        size_t sectorsize,
+                                        const uint8_t *in,
+                                        uint8_t *out,
+                                        size_t len,
+                                        Error **errp)
+{
+    QCryptoCipherDriver *drv = cipher->driver;
+    size_t offset;
+
+    assert(sectorsize && QEMU_IS_ALIGNED(len, sectorsize));
+
+    if (encrypt && drv->cipher_encrypt_sectors) {
+        return drv->cipher_encrypt_sectors(cipher, ivs, niv, sectorsize,
+                                           in, out, len, errp);
+    }
+    if (!encrypt && drv->cipher_decrypt_sectors) {
+        return drv->cipher_decrypt_sectors(cipher, ivs, niv, sectorsize,
+                                           in, out, len, errp);
+    }
+
+    for (offset = 0; offset < len; offset += sectorsize) {
+        int ret;
+
+        if (ivs) {
+            if (drv->cipher_setiv(cipher, ivs, niv, errp) < 0) {
+                return -1;
+            }
+            ivs += niv;
+        }
+        if (encrypt) {
+            ret = drv->cipher_encrypt(cipher, in + offset, out + offset,
+                                      sectorsize, errp);
+        } else {
+            ret = drv->cipher_decrypt(cipher, in + offset, out + offset,
+                                      sectorsize, errp);
+        }
+        if (ret < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+
+int qcrypto_cipher_encrypt_sectors(QCryptoCipher *cipher,
+                                   const uint8_t *ivs, size_t niv,
+                                   size_t sectorsize,
+                                   const void *in,
+                                   void *out,
+                                   size_t len,
+                                   Error **errp)
+{
+    return qcrypto_cipher_crypt_sectors(cipher, true, ivs, niv, sectorsize,
+                                        in, out, len, errp);
+}
+
+
+int qcrypto_cipher_decrypt_sectors(QCryptoCipher *cipher,
+                                   const uint8_t *ivs, size_t niv,
+                                   size_t sectorsize,
+                                   const void *in,
+                                   void *out,
+                                   size_t len,
+                                   Error **errp)
+{
+    return qcrypto_cipher_crypt_sectors(cipher, false, ivs, niv, sectorsize,
+                                        in, out, len, errp);
+}
+
+
 int qcrypto_cipher_setiv(QCryptoCipher *cipher,
                          const uint8_t *iv, size_t niv,
                          Error **errp)
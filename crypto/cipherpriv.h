@@ -32,6 +32,23 @@ struct QCryptoCipherDriver {
                           size_t len,
                           Error **errp);
 
+    /* Optional, qcrypto_cipher_*_sectors() loop over setiv otherwise */
+    int (*cipher_encrypt_sectors)(QCryptoCipher *cipher,
+                                  const uint8_t *ivs, size_t niv,
+                                  size_t sectorsize,
+                                  const void *in,
+                                  void *out,
+                                  size_t len,
+                                  Error **errp);
+
+    int (*cipher_decrypt_sectors)(QCryptoCipher *cipher,
+                                  const uint8_t *ivs, size_t niv,
+                                  size_t sectorsize,
+                                  const void *in,
+                                  void *out,
+                                  size_t len,
+                                  Error **errp);
+
     int (*cipher_setiv)(QCryptoCipher *cipher,
                         const uint8_t *iv, size_t niv,
                         Error **errp);
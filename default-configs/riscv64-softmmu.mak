@@ -1,7 +1,11 @@
 # Default configuration for riscv-softmmu
 
+include pci.mak
+
 CONFIG_SERIAL=y
 CONFIG_VIRTIO_MMIO=y
 include virtio.mak
 
+CONFIG_PCI_GENERIC=y
+
 CONFIG_CADENCE=y
@@ -37,6 +37,67 @@ int dma_memory_set(AddressSpace *as, dma_addr_t addr, uint8_t c, dma_addr_t len)
     return error;
 }
 
+void dma_window_init(DMAWindow *w, AddressSpace *as, bool writable)
+{
+    w->as = as;
+    w->addr = 0;
+    w->len = 0;
+    w->writable = writable;
+    w->cache = MEMORY_REGION_CACHE_INVALID;
+}
+
+/* Point @w at a new range; it is mapped on first access */
+void dma_window_set(DMAWindow *w, dma_addr_t addr, dma_addr_t len)
+{
+    address_space_cache_destroy(&w->cache);
+    w->addr = addr;
+    w->len = len;
+}
+
+void dma_window_destroy(DMAWindow *w)
+{
+    address_space_cache_destroy(&w->cache);
+    w->len = 0;
+}
+
+/* Called from RCU critical section.  Returns false if the window does
+ * not map RAM.  Holding a reference to the old FlatView means that a
+ * new one can never be allocated at the same address.  */
+static bool dma_window_map(DMAWindow *w)
+{
+    if (unlikely(w->cache.fv != address_space_to_flatview(w->as))) {
+        address_space_cache_destroy(&w->cache);
+        address_space_cache_init(&w->cache, w->as, w->addr, w->len,
+                                 w->writable);
+    }
+    return w->cache.ptr != NULL;
+}
+
+int dma_window_rw(DMAWindow *w, dma_addr_t addr, void *buf, dma_addr_t len,
+                  DMADirection dir)
+{
+    bool is_write = dir == DMA_DIRECTION_FROM_DEVICE;
+    dma_addr_t offset = addr - w->addr;
+
+    if (dma_window_contains(w, addr, len) && (w->writable || !is_write)) {
+        rcu_read_lock();
+        if (dma_window_map(w) && len <= w->cache.len &&
+            offset <= w->cache.len - len) {
+            dma_barrier(w->as, dir);
+            if (is_write) {
+                address_space_write_cached(&w->cache, offset, buf, len);
+                address_space_cache_invalidate(&w->cache, offset, len);
+            } else {
+                address_space_read_cached(&w->cache, offset, buf, len);
+            }
+            rcu_read_unlock();
+            return 0;
+        }
+        rcu_read_unlock();
+    }
+    return dma_memory_rw(w->as, addr, buf, len, dir);
+}
+
 void qemu_sglist_init(QEMUSGList *qsg, DeviceState *dev, int alloc_hint,
                       AddressSpace *as)
 {
@@ -157,7 +218,7 @@ static void dma_blk_cb(void *opaque, int ret)
     if (dbs->iov.size == 0) {
         trace_dma_map_wait(dbs);
         dbs->bh = aio_bh_new(dbs->ctx, reschedule_dma, dbs);
-        cpu_register_map_client(dbs->bh);
+        address_space_register_map_client(dbs->sg->as, dbs->bh);
         return;
     }
 
@@ -183,7 +244,7 @@ static void dma_aio_cancel(BlockAIOCB *acb)
         blk_aio_cancel_async(dbs->acb);
     }
     if (dbs->bh) {
-        cpu_unregister_map_client(dbs->bh);
+        address_space_unregister_map_client(dbs->sg->as, dbs->bh);
         qemu_bh_delete(dbs->bh);
         dbs->bh = NULL;
     }
@@ -18,6 +18,7 @@
  */
 #include "qemu/osdep.h"
 #include "qapi/error.h"
+#include "qapi/qapi-events-misc.h"
 
 #include "qemu/cutils.h"
 #include "cpu.h"
@@ -214,6 +215,7 @@ typedef struct subpage_t {
 static void io_mem_init(void);
 static void memory_map_init(void);
 static void tcg_commit(MemoryListener *listener);
+static void dirty_ring_free(DirtyRing *ring);
 
 static MemoryRegion io_mem_watch;
 
@@ -951,7 +953,12 @@ void cpu_exec_unrealizefn(CPUState *cpu)
     }
 #ifndef CONFIG_USER_ONLY
     tcg_iommu_free_notifier_list(cpu);
+    if (cpu->dirty_ring) {
+        call_rcu(cpu->dirty_ring, dirty_ring_free, rcu);
+        cpu->dirty_ring = NULL;
+    }
 #endif
+    tlb_destroy(cpu);
 }
 
 Property cpu_common_props[] = {
@@ -991,6 +998,7 @@ void cpu_exec_realizefn(CPUState *cpu, Error **errp)
         tcg_target_initialized = true;
         cc->tcg_initialize();
     }
+    tlb_init(cpu);
 
 #ifndef CONFIG_USER_ONLY
     if (qdev_get_vmsd(DEVICE(cpu)) == NULL) {
@@ -1472,6 +1480,203 @@ bool cpu_physical_memory_snapshot_get_dirty(DirtyBitmapSnapshot *snap,
     return false;
 }
 
+/*
+ * Dirty page rings.  While migration runs with the x-dirty-ring
+ * capability, every page whose DIRTY_MEMORY_MIGRATION bit is set is also
+ * logged in a ring: the running vCPU's own ring, or a shared ring for
+ * the other threads.  The migration thread then harvests the rings
+ * instead of scanning the whole bitmap.  Whenever a page cannot be
+ * logged, ram_list.dirty_ring_overflow makes the next sync fall back to
+ * the full scan.
+ */
+#define DIRTY_RING_SIZE 16384
+
+struct DirtyRing {
+    struct rcu_head rcu;
+    /* Written by the producer only */
+    uint32_t head;
+    /* Written by the migration thread only */
+    uint32_t tail;
+    ram_addr_t pages[DIRTY_RING_SIZE];
+};
+
+static DirtyRing *dirty_ring_shared;
+static QemuSpin dirty_ring_shared_lock;
+
+static bool dirty_ring_push(DirtyRing *ring, ram_addr_t page, ram_addr_t end)
+{
+    uint32_t head = ring->head;
+
+    if (end - page > DIRTY_RING_SIZE - (head - atomic_read(&ring->tail))) {
+        return false;
+    }
+    while (page < end) {
+        ring->pages[head++ % DIRTY_RING_SIZE] = page++;
+    }
+    /* The dirty bits were set before the pages become visible here.  */
+    atomic_store_release(&ring->head, head);
+    return true;
+}
+
+void cpu_physical_memory_dirty_ring_push(ram_addr_t start, ram_addr_t length)
+{
+    ram_addr_t page = start >> TARGET_PAGE_BITS;
+    ram_addr_t end = TARGET_PAGE_ALIGN(start + length) >> TARGET_PAGE_BITS;
+    DirtyRing *ring = current_cpu ? atomic_read(&current_cpu->dirty_ring)
+                                  : NULL;
+    bool ok;
+
+    if (ring) {
+        ok = dirty_ring_push(ring, page, end);
+    } else {
+        qemu_spin_lock(&dirty_ring_shared_lock);
+        ok = dirty_ring_push(dirty_ring_shared, page, end);
+        qemu_spin_unlock(&dirty_ring_shared_lock);
+    }
+    if (!ok) {
+        atomic_set(&ram_list.dirty_ring_overflow, true);
+    }
+}
+
+static DirtyRing *dirty_ring_new(void)
+{
+    return g_new0(DirtyRing, 1);
+}
+
+static void dirty_ring_free(DirtyRing *ring)
+{
+    g_free(ring);
+}
+
+/* Called with the iothread lock held.  */
+void cpu_physical_memory_dirty_ring_start(void)
+{
+    CPUState *cpu;
+
+    if (!tcg_enabled()) {
+        return;
+    }
+    if (!dirty_ring_shared) {
+        qemu_spin_init(&dirty_ring_shared_lock);
+        dirty_ring_shared = dirty_ring_new();
+    }
+    CPU_FOREACH(cpu) {
+        if (!cpu->dirty_ring) {
+            atomic_set(&cpu->dirty_ring, dirty_ring_new());
+        }
+    }
+    /* Pages dirtied so far are only in the bitmap.  */
+    atomic_set(&ram_list.dirty_ring_overflow, true);
+    smp_wmb();
+    atomic_set(&ram_list.dirty_ring_enabled, true);
+}
+
+void cpu_physical_memory_dirty_ring_stop(void)
+{
+    atomic_set(&ram_list.dirty_ring_enabled, false);
+}
+
+static RAMBlock *dirty_ring_find_block(ram_addr_t addr, RAMBlock *last)
+{
+    RAMBlock *block;
+
+    if (last && addr - last->offset < last->used_length) {
+        return last;
+    }
+    RAMBLOCK_FOREACH(block) {
+        if (addr - block->offset < block->used_length) {
+            return block;
+        }
+    }
+    return NULL;
+}
+
+static bool dirty_ring_harvest(DirtyRing *ring, bool discard,
+                               uint64_t *num_dirty,
+                               uint64_t *real_dirty_pages,
+                               uint64_t *logged)
+{
+    uint32_t head = atomic_load_acquire(&ring->head);
+    uint32_t tail = ring->tail;
+    DirtyMemoryBlocks *blocks;
+    RAMBlock *block = NULL;
+    bool harvested = false;
+
+    *logged += head - tail;
+    blocks = atomic_rcu_read(&ram_list.dirty_memory[DIRTY_MEMORY_MIGRATION]);
+    for (; !discard && tail != head; tail++) {
+        ram_addr_t page = ring->pages[tail % DIRTY_RING_SIZE];
+        ram_addr_t addr = page << TARGET_PAGE_BITS;
+
+        block = dirty_ring_find_block(addr, block);
+        if (!block || !block->bmap) {
+            continue;
+        }
+        if (!bitmap_test_and_clear_atomic(
+                blocks->blocks[page / DIRTY_MEMORY_BLOCK_SIZE],
+                page % DIRTY_MEMORY_BLOCK_SIZE, 1)) {
+            /* Logged twice, or already picked up by a full scan */
+            continue;
+        }
+        *real_dirty_pages += 1;
+        if (!test_and_set_bit((addr - block->offset) >> TARGET_PAGE_BITS,
+                              block->bmap)) {
+            *num_dirty += 1;
+        }
+        harvested = true;
+    }
+    atomic_store_release(&ring->tail, head);
+    return harvested;
+}
+
+/*
+ * Move the pages logged since the last call into the migration bitmaps
+ * of their RAMBlocks, adding the newly dirty pages to @num_dirty and all
+ * harvested pages to @real_dirty_pages.  The pages logged by each vCPU
+ * are also counted in its dirty_pages.  Returns false if some pages may
+ * be missing from the rings; the caller must then sync the whole dirty
+ * bitmap.  Called from RCU critical section by the migration thread.
+ */
+bool cpu_physical_memory_sync_dirty_ring(uint64_t *num_dirty,
+                                         uint64_t *real_dirty_pages)
+{
+    bool overflow = atomic_xchg(&ram_list.dirty_ring_overflow, false);
+    uint64_t shared_pages = 0;
+    bool harvested;
+    CPUState *cpu;
+    RAMBlock *block;
+
+    if (!dirty_ring_shared) {
+        return false;
+    }
+
+    harvested = dirty_ring_harvest(dirty_ring_shared, overflow,
+                                   num_dirty, real_dirty_pages,
+                                   &shared_pages);
+    CPU_FOREACH(cpu) {
+        DirtyRing *ring = atomic_read(&cpu->dirty_ring);
+
+        if (ring) {
+            harvested |= dirty_ring_harvest(ring, overflow,
+                                            num_dirty, real_dirty_pages,
+                                            &cpu->dirty_pages);
+        }
+    }
+    if (overflow) {
+        return false;
+    }
+
+    /* Stores to the harvested pages must go through notdirty again.  */
+    if (harvested) {
+        RAMBLOCK_FOREACH(block) {
+            if (block->bmap && block->used_length) {
+                tlb_reset_dirty_range_all(block->offset, block->used_length);
+            }
+        }
+    }
+    return true;
+}
+
 /* Called from RCU critical section */
 hwaddr memory_region_section_get_iotlb(CPUState *cpu,
                                        MemoryRegionSection *section,
@@ -1772,6 +1977,7 @@ static int64_t get_file_size(int fd)
 
 static int file_ram_open(const char *path,
                          const char *region_name,
+                         bool readonly,
                          bool *created,
                          Error **errp)
 {
@@ -1781,6 +1987,16 @@ static int file_ram_open(const char *path,
     int fd = -1;
 
     *created = false;
+    if (readonly) {
+        /* The contents must come from an existing file, never create one */
+        fd = qemu_open(path, O_RDONLY);
+        if (fd < 0) {
+            error_setg_errno(errp, errno,
+                             "can't open backing store %s for guest RAM",
+                             path);
+        }
+        return fd;
+    }
     for (;;) {
         fd = open(path, O_RDWR);
         if (fd >= 0) {
@@ -1831,6 +2047,15 @@ static int file_ram_open(const char *path,
     return fd;
 }
 
+static void file_ram_prealloc_progress(size_t done, size_t total, void *opaque)
+{
+    RAMBlock *block = opaque;
+
+    /* The idstr is not set yet, use the name of the memory region */
+    qapi_event_send_memory_prealloc_progress(memory_region_name(block->mr),
+                                             done, total, &error_abort);
+}
+
 static void *file_ram_alloc(RAMBlock *block,
                             ram_addr_t memory,
                             int fd,
@@ -1893,7 +2118,8 @@ static void *file_ram_alloc(RAMBlock *block,
     }
 
     if (mem_prealloc) {
-        os_mem_prealloc(fd, area, memory, smp_cpus, errp);
+        os_mem_prealloc(fd, area, memory, smp_cpus, NULL, 0,
+                        file_ram_prealloc_progress, block, errp);
         if (errp && *errp) {
             qemu_ram_munmap(area, memory);
             return NULL;
@@ -2319,17 +2545,28 @@ RAMBlock *qemu_ram_alloc_from_fd(ram_addr_t size, MemoryRegion *mr,
 
 
 RAMBlock *qemu_ram_alloc_from_file(ram_addr_t size, MemoryRegion *mr,
-                                   bool share, const char *mem_path,
-                                   Error **errp)
+                                   bool share, bool readonly,
+                                   const char *mem_path, Error **errp)
 {
     int fd;
     bool created;
     RAMBlock *block;
 
-    fd = file_ram_open(mem_path, memory_region_name(mr), &created, errp);
+    if (readonly && share) {
+        error_setg(errp, "a read-only backing store can't be shared");
+        return NULL;
+    }
+
+    fd = file_ram_open(mem_path, memory_region_name(mr), readonly, &created,
+                       errp);
     if (fd < 0) {
         return NULL;
     }
+    if (readonly && get_file_size(fd) <= 0) {
+        error_setg(errp, "read-only backing store %s is empty", mem_path);
+        close(fd);
+        return NULL;
+    }
 
     block = qemu_ram_alloc_from_fd(size, mr, share, fd, errp);
     if (!block) {
@@ -2677,7 +2914,8 @@ void memory_notdirty_write_prepare(NotDirtyInfo *ndi,
     ndi->pages = NULL;
 
     assert(tcg_enabled());
-    if (!cpu_physical_memory_get_dirty_flag(ram_addr, DIRTY_MEMORY_CODE)) {
+    if (!cpu_physical_memory_get_dirty_flag(ram_addr, DIRTY_MEMORY_CODE) &&
+        tb_page_write_hits_code(ram_addr, size)) {
         ndi->pages = page_collection_lock(ram_addr, ram_addr + size);
         tb_invalidate_phys_page_fast(ndi->pages, ram_addr, size);
     }
@@ -3089,6 +3327,10 @@ static void tcg_commit(MemoryListener *listener)
      * may have split the RCU critical section.
      */
     d = address_space_to_dispatch(cpuas->as);
+    if (d == cpuas->memory_dispatch) {
+        /* The FlatView was reused, so the TLB still matches it */
+        return;
+    }
     atomic_rcu_set(&cpuas->memory_dispatch, d);
     tlb_flush(cpuas->cpu);
 }
@@ -3470,53 +3712,47 @@ void cpu_flush_icache_range(hwaddr start, int len)
                                            start, NULL, len, FLUSH_CACHE);
 }
 
-typedef struct {
+struct BounceBuffer {
     MemoryRegion *mr;
     void *buffer;
     hwaddr addr;
     hwaddr len;
-    bool in_use;
-} BounceBuffer;
-
-static BounceBuffer bounce;
+    QLIST_ENTRY(BounceBuffer) link;
+};
 
-typedef struct MapClient {
+struct AddressSpaceMapClient {
     QEMUBH *bh;
-    QLIST_ENTRY(MapClient) link;
-} MapClient;
-
-QemuMutex map_client_list_lock;
-static QLIST_HEAD(map_client_list, MapClient) map_client_list
-    = QLIST_HEAD_INITIALIZER(map_client_list);
+    QLIST_ENTRY(AddressSpaceMapClient) link;
+};
 
-static void cpu_unregister_map_client_do(MapClient *client)
+static void map_client_free(AddressSpaceMapClient *client)
 {
     QLIST_REMOVE(client, link);
     g_free(client);
 }
 
-static void cpu_notify_map_clients_locked(void)
+static void address_space_notify_map_clients_locked(AddressSpace *as)
 {
-    MapClient *client;
+    AddressSpaceMapClient *client;
 
-    while (!QLIST_EMPTY(&map_client_list)) {
-        client = QLIST_FIRST(&map_client_list);
+    while (!QLIST_EMPTY(&as->map_client_list)) {
+        client = QLIST_FIRST(&as->map_client_list);
         qemu_bh_schedule(client->bh);
-        cpu_unregister_map_client_do(client);
+        map_client_free(client);
     }
 }
 
-void cpu_register_map_client(QEMUBH *bh)
+void address_space_register_map_client(AddressSpace *as, QEMUBH *bh)
 {
-    MapClient *client = g_malloc(sizeof(*client));
+    AddressSpaceMapClient *client = g_malloc(sizeof(*client));
 
-    qemu_mutex_lock(&map_client_list_lock);
+    qemu_mutex_lock(&as->bounce_lock);
     client->bh = bh;
-    QLIST_INSERT_HEAD(&map_client_list, client, link);
-    if (!atomic_read(&bounce.in_use)) {
-        cpu_notify_map_clients_locked();
+    QLIST_INSERT_HEAD(&as->map_client_list, client, link);
+    if (atomic_read(&as->bounce_buffer_size) < as->max_bounce_buffer_size) {
+        address_space_notify_map_clients_locked(as);
     }
-    qemu_mutex_unlock(&map_client_list_lock);
+    qemu_mutex_unlock(&as->bounce_lock);
 }
 
 void cpu_exec_init_all(void)
@@ -3532,28 +3768,51 @@ void cpu_exec_init_all(void)
     finalize_target_page_bits();
     io_mem_init();
     memory_map_init();
-    qemu_mutex_init(&map_client_list_lock);
 }
 
-void cpu_unregister_map_client(QEMUBH *bh)
+void address_space_unregister_map_client(AddressSpace *as, QEMUBH *bh)
 {
-    MapClient *client;
+    AddressSpaceMapClient *client;
 
-    qemu_mutex_lock(&map_client_list_lock);
-    QLIST_FOREACH(client, &map_client_list, link) {
+    qemu_mutex_lock(&as->bounce_lock);
+    QLIST_FOREACH(client, &as->map_client_list, link) {
         if (client->bh == bh) {
-            cpu_unregister_map_client_do(client);
+            map_client_free(client);
             break;
         }
     }
-    qemu_mutex_unlock(&map_client_list_lock);
+    qemu_mutex_unlock(&as->bounce_lock);
 }
 
-static void cpu_notify_map_clients(void)
+static void address_space_notify_map_clients(AddressSpace *as)
 {
-    qemu_mutex_lock(&map_client_list_lock);
-    cpu_notify_map_clients_locked();
-    qemu_mutex_unlock(&map_client_list_lock);
+    qemu_mutex_lock(&as->bounce_lock);
+    address_space_notify_map_clients_locked(as);
+    qemu_mutex_unlock(&as->bounce_lock);
+}
+
+/*
+ * Reserve up to @len bytes of the bounce buffer space of @as and return
+ * how much was reserved, possibly 0.
+ */
+static hwaddr address_space_reserve_bounce(AddressSpace *as, hwaddr len)
+{
+    size_t used = atomic_read(&as->bounce_buffer_size);
+    size_t max = as->max_bounce_buffer_size;
+
+    for (;;) {
+        hwaddr alloc = used < max ? MIN(max - used, len) : 0;
+        size_t actual;
+
+        if (alloc == 0) {
+            return 0;
+        }
+        actual = atomic_cmpxchg(&as->bounce_buffer_size, used, used + alloc);
+        if (actual == used) {
+            return alloc;
+        }
+        used = actual;
+    }
 }
 
 static bool flatview_access_valid(FlatView *fv, hwaddr addr, int len,
@@ -3623,8 +3882,8 @@ flatview_extend_translation(FlatView *fv, hwaddr addr,
  * May map a subset of the requested range, given by and returned in *plen.
  * May return NULL if resources needed to perform the mapping are exhausted.
  * Use only for reads OR writes - not for read-modify-write operations.
- * Use cpu_register_map_client() to know when retrying the map operation is
- * likely to succeed.
+ * Use address_space_register_map_client() to know when retrying the map
+ * operation is likely to succeed.
  */
 void *address_space_map(AddressSpace *as,
                         hwaddr addr,
@@ -3648,26 +3907,33 @@ void *address_space_map(AddressSpace *as,
     mr = flatview_translate(fv, addr, &xlat, &l, is_write, attrs);
 
     if (!memory_access_is_direct(mr, is_write)) {
-        if (atomic_xchg(&bounce.in_use, true)) {
+        BounceBuffer *bounce;
+
+        /* Several mappings may be in flight, up to max_bounce_buffer_size */
+        l = address_space_reserve_bounce(as, l);
+        if (l == 0) {
             rcu_read_unlock();
             return NULL;
         }
-        /* Avoid unbounded allocations */
-        l = MIN(l, TARGET_PAGE_SIZE);
-        bounce.buffer = qemu_memalign(TARGET_PAGE_SIZE, l);
-        bounce.addr = addr;
-        bounce.len = l;
+        bounce = g_new(BounceBuffer, 1);
+        bounce->buffer = qemu_memalign(TARGET_PAGE_SIZE, l);
+        bounce->addr = addr;
+        bounce->len = l;
 
         memory_region_ref(mr);
-        bounce.mr = mr;
+        bounce->mr = mr;
         if (!is_write) {
             flatview_read(fv, addr, MEMTXATTRS_UNSPECIFIED,
-                               bounce.buffer, l);
+                               bounce->buffer, l);
         }
 
+        qemu_mutex_lock(&as->bounce_lock);
+        QLIST_INSERT_HEAD(&as->bounce_buffers, bounce, link);
+        qemu_mutex_unlock(&as->bounce_lock);
+
         rcu_read_unlock();
         *plen = l;
-        return bounce.buffer;
+        return bounce->buffer;
     }
 
 
@@ -3687,7 +3953,21 @@ void *address_space_map(AddressSpace *as,
 void address_space_unmap(AddressSpace *as, void *buffer, hwaddr len,
                          int is_write, hwaddr access_len)
 {
-    if (buffer != bounce.buffer) {
+    BounceBuffer *bounce = NULL;
+
+    /* Mapped bounce buffers are accounted in bounce_buffer_size */
+    if (atomic_read(&as->bounce_buffer_size)) {
+        qemu_mutex_lock(&as->bounce_lock);
+        QLIST_FOREACH(bounce, &as->bounce_buffers, link) {
+            if (bounce->buffer == buffer) {
+                QLIST_REMOVE(bounce, link);
+                break;
+            }
+        }
+        qemu_mutex_unlock(&as->bounce_lock);
+    }
+
+    if (!bounce) {
         MemoryRegion *mr;
         ram_addr_t addr1;
 
@@ -3703,14 +3983,14 @@ void address_space_unmap(AddressSpace *as, void *buffer, hwaddr len,
         return;
     }
     if (is_write) {
-        address_space_write(as, bounce.addr, MEMTXATTRS_UNSPECIFIED,
-                            bounce.buffer, access_len);
+        address_space_write(as, bounce->addr, MEMTXATTRS_UNSPECIFIED,
+                            bounce->buffer, access_len);
     }
-    qemu_vfree(bounce.buffer);
-    bounce.buffer = NULL;
-    memory_region_unref(bounce.mr);
-    atomic_mb_set(&bounce.in_use, false);
-    cpu_notify_map_clients();
+    qemu_vfree(bounce->buffer);
+    memory_region_unref(bounce->mr);
+    atomic_sub(&as->bounce_buffer_size, bounce->len);
+    g_free(bounce);
+    address_space_notify_map_clients(as);
 }
 
 void *cpu_physical_memory_map(hwaddr addr,
@@ -3977,26 +4257,6 @@ int qemu_ram_foreach_block(RAMBlockIterFunc func, void *opaque)
     return ret;
 }
 
-int qemu_ram_foreach_migratable_block(RAMBlockIterFunc func, void *opaque)
-{
-    RAMBlock *block;
-    int ret = 0;
-
-    rcu_read_lock();
-    RAMBLOCK_FOREACH(block) {
-        if (!qemu_ram_is_migratable(block)) {
-            continue;
-        }
-        ret = func(block->idstr, block->host, block->offset,
-                   block->used_length, opaque);
-        if (ret) {
-            break;
-        }
-    }
-    rcu_read_unlock();
-    return ret;
-}
-
 /*
  * Unmap pages of memory from start to start+length such that
  * they a) read as 0, b) Trigger whatever fault mechanism
@@ -83,6 +83,8 @@ this code that are retained.
  * target-dependent and needs the TARGET_* macros.
  */
 #include "qemu/osdep.h"
+#include <math.h>
+#include <float.h>
 #include "qemu/bitops.h"
 #include "fpu/softfloat.h"
 
@@ -736,8 +738,8 @@ float16  __attribute__((flatten)) float16_add(float16 a, float16 b,
     return float16_round_pack_canonical(pr, status);
 }
 
-float32 __attribute__((flatten)) float32_add(float32 a, float32 b,
-                                             float_status *status)
+static float32 __attribute__((flatten, noinline))
+soft_f32_add(float32 a, float32 b, float_status *status)
 {
     FloatParts pa = float32_unpack_canonical(a, status);
     FloatParts pb = float32_unpack_canonical(b, status);
@@ -746,8 +748,8 @@ float32 __attribute__((flatten)) float32_add(float32 a, float32 b,
     return float32_round_pack_canonical(pr, status);
 }
 
-float64 __attribute__((flatten)) float64_add(float64 a, float64 b,
-                                             float_status *status)
+static float64 __attribute__((flatten, noinline))
+soft_f64_add(float64 a, float64 b, float_status *status)
 {
     FloatParts pa = float64_unpack_canonical(a, status);
     FloatParts pb = float64_unpack_canonical(b, status);
@@ -766,8 +768,8 @@ float16 __attribute__((flatten)) float16_sub(float16 a, float16 b,
     return float16_round_pack_canonical(pr, status);
 }
 
-float32 __attribute__((flatten)) float32_sub(float32 a, float32 b,
-                                             float_status *status)
+static float32 __attribute__((flatten, noinline))
+soft_f32_sub(float32 a, float32 b, float_status *status)
 {
     FloatParts pa = float32_unpack_canonical(a, status);
     FloatParts pb = float32_unpack_canonical(b, status);
@@ -776,8 +778,8 @@ float32 __attribute__((flatten)) float32_sub(float32 a, float32 b,
     return float32_round_pack_canonical(pr, status);
 }
 
-float64 __attribute__((flatten)) float64_sub(float64 a, float64 b,
-                                             float_status *status)
+static float64 __attribute__((flatten, noinline))
+soft_f64_sub(float64 a, float64 b, float_status *status)
 {
     FloatParts pa = float64_unpack_canonical(a, status);
     FloatParts pb = float64_unpack_canonical(b, status);
@@ -786,6 +788,127 @@ float64 __attribute__((flatten)) float64_sub(float64 a, float64 b,
     return float64_round_pack_canonical(pr, status);
 }
 
+/*
+ * Hardfloat fast paths.
+ *
+ * Once the inexact flag is set and rounding is to nearest-even, an
+ * operation on zero or normal inputs can only raise overflow, underflow
+ * or invalid on top of what is already there.  If its inputs also rule
+ * out invalid, the host FPU gives the same result as the code above,
+ * provided that results which might be tiny are left to the soft
+ * implementation, which knows about the target's tininess detection and
+ * flush-to-zero settings.  Overflow only needs the flag to be raised.
+ *
+ * The host must use IEEE single and double precision arithmetic
+ * directly, which rules out x87 and -ffast-math builds.
+ */
+#if defined(__FAST_MATH__) || (defined(__i386__) && !defined(__SSE2__))
+# define QEMU_HARDFLOAT 0
+#else
+# define QEMU_HARDFLOAT 1
+#endif
+
+typedef union {
+    float32 s;
+    float h;
+} union_float32;
+
+typedef union {
+    float64 s;
+    double h;
+} union_float64;
+
+static inline bool can_use_fpu(const float_status *s)
+{
+    return QEMU_HARDFLOAT &&
+           likely(s->float_exception_flags & float_flag_inexact) &&
+           likely(s->float_rounding_mode == float_round_nearest_even);
+}
+
+/*
+ * Check the result of a hardfloat operation.  Returns false if the soft
+ * implementation must compute it instead; @zero_ok says whether a zero
+ * result is known to be exact.
+ */
+static inline bool f32_hard_result_ok(union_float32 r, bool zero_ok,
+                                      float_status *s)
+{
+    if (unlikely(isinf(r.h))) {
+        s->float_exception_flags |= float_flag_overflow;
+    } else if (unlikely(fabsf(r.h) <= FLT_MIN)) {
+        return zero_ok && r.h == 0;
+    }
+    return true;
+}
+
+static inline bool f64_hard_result_ok(union_float64 r, bool zero_ok,
+                                      float_status *s)
+{
+    if (unlikely(isinf(r.h))) {
+        s->float_exception_flags |= float_flag_overflow;
+    } else if (unlikely(fabs(r.h) <= DBL_MIN)) {
+        return zero_ok && r.h == 0;
+    }
+    return true;
+}
+
+/* The sum of two floats, when it is zero or subnormal, is exact.  */
+float32 float32_add(float32 a, float32 b, float_status *status)
+{
+    union_float32 ua = { .s = a }, ub = { .s = b }, ur;
+
+    if (can_use_fpu(status) &&
+        float32_is_zero_or_normal(a) && float32_is_zero_or_normal(b)) {
+        ur.h = ua.h + ub.h;
+        if (f32_hard_result_ok(ur, true, status)) {
+            return ur.s;
+        }
+    }
+    return soft_f32_add(a, b, status);
+}
+
+float64 float64_add(float64 a, float64 b, float_status *status)
+{
+    union_float64 ua = { .s = a }, ub = { .s = b }, ur;
+
+    if (can_use_fpu(status) &&
+        float64_is_zero_or_normal(a) && float64_is_zero_or_normal(b)) {
+        ur.h = ua.h + ub.h;
+        if (f64_hard_result_ok(ur, true, status)) {
+            return ur.s;
+        }
+    }
+    return soft_f64_add(a, b, status);
+}
+
+float32 float32_sub(float32 a, float32 b, float_status *status)
+{
+    union_float32 ua = { .s = a }, ub = { .s = b }, ur;
+
+    if (can_use_fpu(status) &&
+        float32_is_zero_or_normal(a) && float32_is_zero_or_normal(b)) {
+        ur.h = ua.h - ub.h;
+        if (f32_hard_result_ok(ur, true, status)) {
+            return ur.s;
+        }
+    }
+    return soft_f32_sub(a, b, status);
+}
+
+float64 float64_sub(float64 a, float64 b, float_status *status)
+{
+    union_float64 ua = { .s = a }, ub = { .s = b }, ur;
+
+    if (can_use_fpu(status) &&
+        float64_is_zero_or_normal(a) && float64_is_zero_or_normal(b)) {
+        ur.h = ua.h - ub.h;
+        if (f64_hard_result_ok(ur, true, status)) {
+            return ur.s;
+        }
+    }
+    return soft_f64_sub(a, b, status);
+}
+
 /*
  * Returns the result of multiplying the floating-point values `a' and
  * `b'. The operation is performed according to the IEC/IEEE Standard
@@ -845,8 +968,8 @@ float16 __attribute__((flatten)) float16_mul(float16 a, float16 b,
     return float16_round_pack_canonical(pr, status);
 }
 
-float32 __attribute__((flatten)) float32_mul(float32 a, float32 b,
-                                             float_status *status)
+static float32 __attribute__((flatten, noinline))
+soft_f32_mul(float32 a, float32 b, float_status *status)
 {
     FloatParts pa = float32_unpack_canonical(a, status);
     FloatParts pb = float32_unpack_canonical(b, status);
@@ -855,8 +978,8 @@ float32 __attribute__((flatten)) float32_mul(float32 a, float32 b,
     return float32_round_pack_canonical(pr, status);
 }
 
-float64 __attribute__((flatten)) float64_mul(float64 a, float64 b,
-                                             float_status *status)
+static float64 __attribute__((flatten, noinline))
+soft_f64_mul(float64 a, float64 b, float_status *status)
 {
     FloatParts pa = float64_unpack_canonical(a, status);
     FloatParts pb = float64_unpack_canonical(b, status);
@@ -865,6 +988,36 @@ float64 __attribute__((flatten)) float64_mul(float64 a, float64 b,
     return float64_round_pack_canonical(pr, status);
 }
 
+float32 float32_mul(float32 a, float32 b, float_status *status)
+{
+    union_float32 ua = { .s = a }, ub = { .s = b }, ur;
+
+    if (can_use_fpu(status) &&
+        float32_is_zero_or_normal(a) && float32_is_zero_or_normal(b)) {
+        ur.h = ua.h * ub.h;
+        if (f32_hard_result_ok(ur, float32_is_zero(a) || float32_is_zero(b),
+                               status)) {
+            return ur.s;
+        }
+    }
+    return soft_f32_mul(a, b, status);
+}
+
+float64 float64_mul(float64 a, float64 b, float_status *status)
+{
+    union_float64 ua = { .s = a }, ub = { .s = b }, ur;
+
+    if (can_use_fpu(status) &&
+        float64_is_zero_or_normal(a) && float64_is_zero_or_normal(b)) {
+        ur.h = ua.h * ub.h;
+        if (f64_hard_result_ok(ur, float64_is_zero(a) || float64_is_zero(b),
+                               status)) {
+            return ur.s;
+        }
+    }
+    return soft_f64_mul(a, b, status);
+}
+
 /*
  * Returns the result of multiplying the floating-point values `a' and
  * `b' then adding 'c', with no intermediate rounding step after the
@@ -1079,8 +1232,9 @@ float16 __attribute__((flatten)) float16_muladd(float16 a, float16 b, float16 c,
     return float16_round_pack_canonical(pr, status);
 }
 
-float32 __attribute__((flatten)) float32_muladd(float32 a, float32 b, float32 c,
-                                                int flags, float_status *status)
+static float32 __attribute__((flatten, noinline))
+soft_f32_muladd(float32 a, float32 b, float32 c, int flags,
+                float_status *status)
 {
     FloatParts pa = float32_unpack_canonical(a, status);
     FloatParts pb = float32_unpack_canonical(b, status);
@@ -1090,8 +1244,9 @@ float32 __attribute__((flatten)) float32_muladd(float32 a, float32 b, float32 c,
     return float32_round_pack_canonical(pr, status);
 }
 
-float64 __attribute__((flatten)) float64_muladd(float64 a, float64 b, float64 c,
-                                                int flags, float_status *status)
+static float64 __attribute__((flatten, noinline))
+soft_f64_muladd(float64 a, float64 b, float64 c, int flags,
+                float_status *status)
 {
     FloatParts pa = float64_unpack_canonical(a, status);
     FloatParts pb = float64_unpack_canonical(b, status);
@@ -1101,6 +1256,68 @@ float64 __attribute__((flatten)) float64_muladd(float64 a, float64 b, float64 c,
     return float64_round_pack_canonical(pr, status);
 }
 
+/*
+ * Only use the host fma when the compiler says it is as fast as a
+ * multiply and add, i.e. not a libm emulation.
+ */
+#if defined(__FP_FAST_FMAF) && defined(__FP_FAST_FMA)
+# define QEMU_HARDFLOAT_FMA QEMU_HARDFLOAT
+#else
+# define QEMU_HARDFLOAT_FMA 0
+#endif
+
+float32 float32_muladd(float32 a, float32 b, float32 c, int flags,
+                       float_status *status)
+{
+    union_float32 ua = { .s = a }, ub = { .s = b }, uc = { .s = c }, ur;
+
+    if (QEMU_HARDFLOAT_FMA && can_use_fpu(status) &&
+        !(flags & float_muladd_halve_result) &&
+        float32_is_zero_or_normal(a) && float32_is_zero_or_normal(b) &&
+        float32_is_zero_or_normal(c)) {
+        if (flags & float_muladd_negate_product) {
+            ua.s = float32_chs(ua.s);
+        }
+        if (flags & float_muladd_negate_c) {
+            uc.s = float32_chs(uc.s);
+        }
+        ur.h = fmaf(ua.h, ub.h, uc.h);
+        if (f32_hard_result_ok(ur, false, status)) {
+            if (flags & float_muladd_negate_result) {
+                ur.s = float32_chs(ur.s);
+            }
+            return ur.s;
+        }
+    }
+    return soft_f32_muladd(a, b, c, flags, status);
+}
+
+float64 float64_muladd(float64 a, float64 b, float64 c, int flags,
+                       float_status *status)
+{
+    union_float64 ua = { .s = a }, ub = { .s = b }, uc = { .s = c }, ur;
+
+    if (QEMU_HARDFLOAT_FMA && can_use_fpu(status) &&
+        !(flags & float_muladd_halve_result) &&
+        float64_is_zero_or_normal(a) && float64_is_zero_or_normal(b) &&
+        float64_is_zero_or_normal(c)) {
+        if (flags & float_muladd_negate_product) {
+            ua.s = float64_chs(ua.s);
+        }
+        if (flags & float_muladd_negate_c) {
+            uc.s = float64_chs(uc.s);
+        }
+        ur.h = fma(ua.h, ub.h, uc.h);
+        if (f64_hard_result_ok(ur, false, status)) {
+            if (flags & float_muladd_negate_result) {
+                ur.s = float64_chs(ur.s);
+            }
+            return ur.s;
+        }
+    }
+    return soft_f64_muladd(a, b, c, flags, status);
+}
+
 /*
  * Returns the result of dividing the floating-point value `a' by the
  * corresponding value `b'. The operation is performed according to
@@ -1170,7 +1387,8 @@ float16 float16_div(float16 a, float16 b, float_status *status)
     return float16_round_pack_canonical(pr, status);
 }
 
-float32 float32_div(float32 a, float32 b, float_status *status)
+static float32 __attribute__((noinline))
+soft_f32_div(float32 a, float32 b, float_status *status)
 {
     FloatParts pa = float32_unpack_canonical(a, status);
     FloatParts pb = float32_unpack_canonical(b, status);
@@ -1179,7 +1397,8 @@ float32 float32_div(float32 a, float32 b, float_status *status)
     return float32_round_pack_canonical(pr, status);
 }
 
-float64 float64_div(float64 a, float64 b, float_status *status)
+static float64 __attribute__((noinline))
+soft_f64_div(float64 a, float64 b, float_status *status)
 {
     FloatParts pa = float64_unpack_canonical(a, status);
     FloatParts pb = float64_unpack_canonical(b, status);
@@ -1188,6 +1407,35 @@ float64 float64_div(float64 a, float64 b, float_status *status)
     return float64_round_pack_canonical(pr, status);
 }
 
+/* A zero divisor would raise divbyzero or invalid, so it stays soft.  */
+float32 float32_div(float32 a, float32 b, float_status *status)
+{
+    union_float32 ua = { .s = a }, ub = { .s = b }, ur;
+
+    if (can_use_fpu(status) &&
+        float32_is_zero_or_normal(a) && float32_is_normal(b)) {
+        ur.h = ua.h / ub.h;
+        if (f32_hard_result_ok(ur, float32_is_zero(a), status)) {
+            return ur.s;
+        }
+    }
+    return soft_f32_div(a, b, status);
+}
+
+float64 float64_div(float64 a, float64 b, float_status *status)
+{
+    union_float64 ua = { .s = a }, ub = { .s = b }, ur;
+
+    if (can_use_fpu(status) &&
+        float64_is_zero_or_normal(a) && float64_is_normal(b)) {
+        ur.h = ua.h / ub.h;
+        if (f64_hard_result_ok(ur, float64_is_zero(a), status)) {
+            return ur.s;
+        }
+    }
+    return soft_f64_div(a, b, status);
+}
+
 /*
  * Float to Float conversions
  *
@@ -2078,20 +2326,49 @@ float16 __attribute__((flatten)) float16_sqrt(float16 a, float_status *status)
     return float16_round_pack_canonical(pr, status);
 }
 
-float32 __attribute__((flatten)) float32_sqrt(float32 a, float_status *status)
+static float32 __attribute__((flatten, noinline))
+soft_f32_sqrt(float32 a, float_status *status)
 {
     FloatParts pa = float32_unpack_canonical(a, status);
     FloatParts pr = sqrt_float(pa, status, &float32_params);
     return float32_round_pack_canonical(pr, status);
 }
 
-float64 __attribute__((flatten)) float64_sqrt(float64 a, float_status *status)
+static float64 __attribute__((flatten, noinline))
+soft_f64_sqrt(float64 a, float_status *status)
 {
     FloatParts pa = float64_unpack_canonical(a, status);
     FloatParts pr = sqrt_float(pa, status, &float64_params);
     return float64_round_pack_canonical(pr, status);
 }
 
+/* The square root of a positive normal number is normal.  */
+float32 float32_sqrt(float32 a, float_status *status)
+{
+    union_float32 ua = { .s = a }, ur;
+
+    if (can_use_fpu(status) &&
+        (float32_is_zero(a) ||
+         (float32_is_normal(a) && !float32_is_neg(a)))) {
+        ur.h = sqrtf(ua.h);
+        return ur.s;
+    }
+    return soft_f32_sqrt(a, status);
+}
+
+float64 float64_sqrt(float64 a, float_status *status)
+{
+    union_float64 ua = { .s = a }, ur;
+
+    if (can_use_fpu(status) &&
+        (float64_is_zero(a) ||
+         (float64_is_normal(a) && !float64_is_neg(a)))) {
+        ur.h = sqrt(ua.h);
+        return ur.s;
+    }
+    return soft_f64_sqrt(a, status);
+}
+
 /*----------------------------------------------------------------------------
 | The pattern for a default generated NaN.
 *----------------------------------------------------------------------------*/
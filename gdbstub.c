@@ -32,7 +32,12 @@
 #include "exec/gdbstub.h"
 #endif
 
-#define MAX_PACKET_LENGTH 4096
+/*
+ * Advertised to gdb as PacketSize; it bounds what a single 'm' or 'X'
+ * packet can transfer, so dumping memory takes fewer round trips with
+ * a larger value.
+ */
+#define MAX_PACKET_LENGTH 16384
 
 #include "qemu/sockets.h"
 #include "sysemu/hw_accel.h"
@@ -1173,6 +1178,28 @@ static int gdb_handle_packet(GDBState *s, const char *line_buf)
             put_packet(s, "OK");
         }
         break;
+    case 'X':
+        /* Like 'M', but the data is binary and may contain NUL bytes */
+        addr = strtoull(p, (char **)&p, 16);
+        if (*p == ',')
+            p++;
+        len = strtoull(p, (char **)&p, 16);
+        if (*p == ':')
+            p++;
+
+        if (len > s->line_buf_index - (p - line_buf)) {
+            put_packet(s, "E22");
+            break;
+        }
+        /* gdb probes for 'X' support with an empty write */
+        memcpy(mem_buf, p, len);
+        if (len && target_memory_rw_debug(s->g_cpu, addr, mem_buf, len,
+                                          true) != 0) {
+            put_packet(s, "E14");
+        } else {
+            put_packet(s, "OK");
+        }
+        break;
     case 'p':
         /* Older gdb are really dumb, and don't use 'g' if 'p' is avaialable.
            This works, but can be very slow.  Anything new enough to
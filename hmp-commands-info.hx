@@ -297,6 +297,55 @@ STEXI
 @item info opcount
 @findex info opcount
 Show dynamic compiler opcode counters
+ETEXI
+
+#if defined(CONFIG_TCG)
+    {
+        .name       = "tb-profile",
+        .args_type  = "max:i?",
+        .params     = "[max]",
+        .help       = "show the most executed TBs (default 20)",
+        .cmd        = hmp_info_tb_profile,
+    },
+#endif
+
+STEXI
+@item info tb-profile [@var{max}]
+@findex info tb-profile
+Show the @var{max} most executed translation blocks while the TB profiler
+is running: guest PC and symbol, execution count, guest instruction count,
+guest and host code size, how often execution left the TB through each
+exit, and whether the direct jumps are chained.
+ETEXI
+
+    {
+        .name       = "tlb-stats",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show software TLB statistics of each CPU",
+        .cmd        = hmp_info_tlb_stats,
+    },
+
+STEXI
+@item info tlb-stats
+@findex info tlb-stats
+Show software TLB fill, victim hit, miss and flush counters of each CPU.
+ETEXI
+
+    {
+        .name       = "stats",
+        .args_type  = "target:s?",
+        .params     = "[vcpu|tlb|tb-cache|block|net]",
+        .help       = "show counters of vCPUs, TCG caches, block and "
+                      "net devices",
+        .cmd        = hmp_info_stats,
+    },
+
+STEXI
+@item info stats [@var{target}]
+@findex info stats
+Show the counters that @code{query-stats} returns, optionally only those
+of one kind of object.  The vCPUs are not interrupted to read them.
 ETEXI
 
     {
@@ -717,6 +766,20 @@ STEXI
 @item info iothreads
 @findex info iothreads
 Show iothread's identifiers.
+ETEXI
+
+    {
+        .name       = "loop-profile",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show event loop profiler statistics",
+        .cmd        = hmp_info_loop_profile,
+    },
+
+STEXI
+@item info loop-profile
+@findex info loop-profile
+Show the execution times collected by the event loop profiler.
 ETEXI
 
     {
@@ -408,6 +408,27 @@ STEXI
 @findex singlestep
 Run the emulation in single step mode.
 If called with option off, the emulation returns to normal mode.
+ETEXI
+
+#if defined(CONFIG_TCG)
+    {
+        .name       = "tb-profile",
+        .args_type  = "enable:b,jitdump:s?",
+        .params     = "on|off [jitdump-dir]",
+        .help       = "start or stop counting TB executions",
+        .cmd        = hmp_tb_profile,
+    },
+#endif
+
+STEXI
+@item tb-profile on|off [@var{jitdump-dir}]
+@findex tb-profile
+Start or stop the TB profiler.  Both flush the translation cache, so
+counts start from zero and are lost when the profiler is stopped; use
+@code{info tb-profile} to see them.  With @var{jitdump-dir}, host code
+is also described in @var{jitdump-dir}/jit-@var{pid}.dump for
+@code{perf inject --jit}, so that @code{perf report} can attribute
+samples to guest code.
 ETEXI
 
     {
@@ -38,6 +38,7 @@
 #include "qapi/qapi-commands-run-state.h"
 #include "qapi/qapi-commands-tpm.h"
 #include "qapi/qapi-commands-ui.h"
+#include "qapi/qapi-visit-migration.h"
 #include "qapi/qmp/qdict.h"
 #include "qapi/qmp/qerror.h"
 #include "qapi/string-input-visitor.h"
@@ -291,6 +292,17 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
         g_free(str);
         visit_free(v);
     }
+
+    if (info->has_x_vcpu_dirty) {
+        VcpuDirtyInfoList *entry;
+
+        for (entry = info->x_vcpu_dirty; entry; entry = entry->next) {
+            monitor_printf(mon, "vcpu %" PRId64 " dirty rate: %" PRIu64
+                           " bytes/s, throttle percentage: %" PRId64 "\n",
+                           entry->value->cpu_index, entry->value->dirty_rate,
+                           entry->value->throttle_percentage);
+        }
+    }
     qapi_free_MigrationInfo(info);
     qapi_free_MigrationCapabilityStatusList(caps);
 }
@@ -369,6 +381,25 @@ void hmp_info_migrate_parameters(Monitor *mon, const QDict *qdict)
         monitor_printf(mon, "%s: %u\n",
             MigrationParameter_str(MIGRATION_PARAMETER_X_MULTIFD_PAGE_COUNT),
             params->x_multifd_page_count);
+        monitor_printf(mon, "%s: %s\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_X_MULTIFD_COMPRESSION),
+            MultiFDCompression_str(params->x_multifd_compression));
+        monitor_printf(mon, "%s: %u\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_X_BITMAP_SYNC_THREADS),
+            params->x_bitmap_sync_threads);
+        monitor_printf(mon, "%s: %u\n",
+            MigrationParameter_str(
+                MIGRATION_PARAMETER_X_POSTCOPY_PREFETCH_PAGES),
+            params->x_postcopy_prefetch_pages);
+        monitor_printf(mon, "%s: %" PRIu64 "\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_X_VCPU_DIRTY_LIMIT),
+            params->x_vcpu_dirty_limit);
+        monitor_printf(mon, "%s: %" PRIu64 "\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_X_STREAM_BUFFER_SIZE),
+            params->x_stream_buffer_size);
+        monitor_printf(mon, "%s: %u\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_X_STREAM_IOV_COUNT),
+            params->x_stream_iov_count);
         monitor_printf(mon, "%s: %" PRIu64 "\n",
             MigrationParameter_str(MIGRATION_PARAMETER_XBZRLE_CACHE_SIZE),
             params->xbzrle_cache_size);
@@ -1681,6 +1712,31 @@ void hmp_migrate_set_parameter(Monitor *mon, const QDict *qdict)
         p->has_x_multifd_page_count = true;
         visit_type_int(v, param, &p->x_multifd_page_count, &err);
         break;
+    case MIGRATION_PARAMETER_X_MULTIFD_COMPRESSION:
+        p->has_x_multifd_compression = true;
+        visit_type_MultiFDCompression(v, param, &p->x_multifd_compression,
+                                      &err);
+        break;
+    case MIGRATION_PARAMETER_X_BITMAP_SYNC_THREADS:
+        p->has_x_bitmap_sync_threads = true;
+        visit_type_int(v, param, &p->x_bitmap_sync_threads, &err);
+        break;
+    case MIGRATION_PARAMETER_X_POSTCOPY_PREFETCH_PAGES:
+        p->has_x_postcopy_prefetch_pages = true;
+        visit_type_int(v, param, &p->x_postcopy_prefetch_pages, &err);
+        break;
+    case MIGRATION_PARAMETER_X_VCPU_DIRTY_LIMIT:
+        p->has_x_vcpu_dirty_limit = true;
+        visit_type_size(v, param, &p->x_vcpu_dirty_limit, &err);
+        break;
+    case MIGRATION_PARAMETER_X_STREAM_BUFFER_SIZE:
+        p->has_x_stream_buffer_size = true;
+        visit_type_size(v, param, &p->x_stream_buffer_size, &err);
+        break;
+    case MIGRATION_PARAMETER_X_STREAM_IOV_COUNT:
+        p->has_x_stream_iov_count = true;
+        visit_type_int(v, param, &p->x_stream_iov_count, &err);
+        break;
     case MIGRATION_PARAMETER_XBZRLE_CACHE_SIZE:
         p->has_xbzrle_cache_size = true;
         visit_type_size(v, param, &cache_size, &err);
@@ -2535,6 +2591,7 @@ void hmp_info_iothreads(Monitor *mon, const QDict *qdict)
     IOThreadInfoList *info_list = qmp_query_iothreads(NULL);
     IOThreadInfoList *info;
     IOThreadInfo *value;
+    uint64List *bucket;
 
     for (info = info_list; info; info = info->next) {
         value = info->value;
@@ -2543,11 +2600,109 @@ void hmp_info_iothreads(Monitor *mon, const QDict *qdict)
         monitor_printf(mon, "  poll-max-ns=%" PRId64 "\n", value->poll_max_ns);
         monitor_printf(mon, "  poll-grow=%" PRId64 "\n", value->poll_grow);
         monitor_printf(mon, "  poll-shrink=%" PRId64 "\n", value->poll_shrink);
+        monitor_printf(mon, "  poll-hits=%" PRIu64 "\n", value->poll_hits);
+        monitor_printf(mon, "  poll-misses=%" PRIu64 "\n", value->poll_misses);
+        monitor_printf(mon, "  poll-idle-handlers=%" PRId64 "\n",
+                       value->poll_idle_handlers);
+        monitor_printf(mon, "  poll-wait-histogram=");
+        for (bucket = value->poll_wait_histogram; bucket;
+             bucket = bucket->next) {
+            monitor_printf(mon, "%" PRIu64 "%s", bucket->value,
+                           bucket->next ? "," : "\n");
+        }
     }
 
     qapi_free_IOThreadInfoList(info_list);
 }
 
+void hmp_info_loop_profile(Monitor *mon, const QDict *qdict)
+{
+    LoopProfileEntryList *info_list = qmp_query_loop_profile(NULL);
+    LoopProfileEntryList *info;
+    LoopProfileEntry *value;
+    uint64List *bucket;
+
+    for (info = info_list; info; info = info->next) {
+        value = info->value;
+        monitor_printf(mon, "%s %#" PRIx64 ": count=%" PRIu64
+                       " total-ns=%" PRIu64 " max-ns=%" PRIu64 "\n",
+                       LoopProfileKind_str(value->kind), value->callback,
+                       value->count, value->total_ns, value->max_ns);
+        monitor_printf(mon, "  histogram=");
+        for (bucket = value->histogram; bucket; bucket = bucket->next) {
+            monitor_printf(mon, "%" PRIu64 "%s", bucket->value,
+                           bucket->next ? "," : "\n");
+        }
+    }
+
+    qapi_free_LoopProfileEntryList(info_list);
+}
+
+void hmp_info_tlb_stats(Monitor *mon, const QDict *qdict)
+{
+    Error *err = NULL;
+    TlbStatsList *info_list = qmp_query_tlb_stats(&err);
+    TlbStatsList *info;
+    TlbStats *value;
+
+    if (err) {
+        hmp_handle_error(mon, &err);
+        return;
+    }
+
+    for (info = info_list; info; info = info->next) {
+        value = info->value;
+        monitor_printf(mon, "CPU #%" PRId64 ":\n", value->cpu_index);
+        monitor_printf(mon, "  fills=%" PRId64 "\n", value->fills);
+        monitor_printf(mon, "  victim-hits=%" PRId64 "\n", value->victim_hits);
+        monitor_printf(mon, "  misses=%" PRId64 "\n", value->misses);
+        monitor_printf(mon, "  flushes=%" PRId64 "\n", value->flushes);
+        monitor_printf(mon, "  partial-flushes=%" PRId64 "\n",
+                       value->partial_flushes);
+        monitor_printf(mon, "  elided-flushes=%" PRId64 "\n",
+                       value->elided_flushes);
+    }
+
+    qapi_free_TlbStatsList(info_list);
+}
+
+void hmp_info_stats(Monitor *mon, const QDict *qdict)
+{
+    Error *err = NULL;
+    const char *target_str = qdict_get_try_str(qdict, "target");
+    StatsResultList *info_list, *info;
+    StatList *stat;
+    int target = 0;
+
+    if (target_str) {
+        target = qapi_enum_parse(&StatsTarget_lookup, target_str, -1, &err);
+        if (err) {
+            hmp_handle_error(mon, &err);
+            return;
+        }
+    }
+
+    info_list = qmp_query_stats(!!target_str, target, &err);
+    if (err) {
+        hmp_handle_error(mon, &err);
+        return;
+    }
+
+    for (info = info_list; info; info = info->next) {
+        StatsResult *value = info->value;
+
+        monitor_printf(mon, "%s%s%s:\n", StatsTarget_str(value->target),
+                       value->has_id ? " " : "",
+                       value->has_id ? value->id : "");
+        for (stat = value->stats; stat; stat = stat->next) {
+            monitor_printf(mon, "  %s=%" PRIu64 "\n",
+                           stat->value->name, stat->value->value);
+        }
+    }
+
+    qapi_free_StatsResultList(info_list);
+}
+
 void hmp_qom_list(Monitor *mon, const QDict *qdict)
 {
     const char *path = qdict_get_try_str(qdict, "path");
@@ -19,10 +19,18 @@
  *      -drive file=<file>,if=none,id=<drive_id>
  *      -device nvme,drive=<drive_id>,serial=<serial>,id=<id[optional]>, \
  *              cmb_size_mb=<cmb_size_mb[optional]>, \
- *              num_queues=<N[optional]>
+ *              num_queues=<N[optional]>, iothread=<id[optional]>, \
+ *              sq-poll-max-ns=<ns[optional]>
  *
  * Note cmb_size_mb denotes size of CMB in MB. CMB is assumed to be at
  * offset 0 in BAR2 and supports only WDS, RDS and SQS for now.
+ *
+ * With iothread, the I/O queues are processed in that thread.  Once the
+ * driver configures shadow doorbells, the submission queue doorbells of
+ * the I/O queues become ioeventfds and the iothread polls the shadow
+ * doorbells according to its poll-max-ns.  sq-poll-max-ns additionally
+ * busy-waits up to that long for new commands after a queue runs empty,
+ * before asking the driver for a doorbell write again.
  */
 
 #include "qemu/osdep.h"
@@ -38,6 +46,7 @@
 
 #include "qemu/log.h"
 #include "qemu/cutils.h"
+#include "qemu/main-loop.h"
 #include "trace.h"
 #include "nvme.h"
 
@@ -50,16 +59,32 @@
 
 static void nvme_process_sq(void *opaque);
 
+static bool nvme_addr_is_cmb(NvmeCtrl *n, hwaddr addr)
+{
+    return n->cmbsz && addr >= n->ctrl_mem.addr &&
+        addr < (n->ctrl_mem.addr + int128_get64(n->ctrl_mem.size));
+}
+
 static void nvme_addr_read(NvmeCtrl *n, hwaddr addr, void *buf, int size)
 {
-    if (n->cmbsz && addr >= n->ctrl_mem.addr &&
-                addr < (n->ctrl_mem.addr + int128_get64(n->ctrl_mem.size))) {
+    if (nvme_addr_is_cmb(n, addr)) {
         memcpy(buf, (void *)&n->cmbuf[addr - n->ctrl_mem.addr], size);
     } else {
         pci_dma_read(&n->parent_obj, addr, buf, size);
     }
 }
 
+/* Queue entries go through the queue's DMAWindow unless they are in the CMB */
+static void nvme_ring_read(NvmeCtrl *n, DMAWindow *ring, hwaddr addr,
+                           void *buf, int size)
+{
+    if (nvme_addr_is_cmb(n, addr)) {
+        memcpy(buf, (void *)&n->cmbuf[addr - n->ctrl_mem.addr], size);
+    } else {
+        dma_window_read(ring, addr, buf, size);
+    }
+}
+
 static int nvme_check_sqid(NvmeCtrl *n, uint16_t sqid)
 {
     return sqid < n->num_queues && n->sq[sqid] != NULL ? 0 : -1;
@@ -94,6 +119,56 @@ static uint8_t nvme_sq_empty(NvmeSQueue *sq)
     return sq->head == sq->tail;
 }
 
+/* Timers of the I/O queues run in the iothread, if there is one */
+static QEMUTimer *nvme_timer_new(NvmeCtrl *n, uint16_t qid, QEMUTimerCB *cb,
+                                 void *opaque)
+{
+    if (qid && n->iothread) {
+        return aio_timer_new(n->ctx, QEMU_CLOCK_VIRTUAL, SCALE_NS, cb, opaque);
+    }
+    return timer_new_ns(QEMU_CLOCK_VIRTUAL, cb, opaque);
+}
+
+static void nvme_update_sq_tail(NvmeSQueue *sq)
+{
+    uint32_t tail;
+
+    pci_dma_read(&sq->ctrl->parent_obj, sq->db_addr, &tail, sizeof(tail));
+    tail = le32_to_cpu(tail);
+    /* Like a doorbell write, a value beyond the queue size is ignored */
+    if (tail < sq->size) {
+        sq->tail = tail;
+    }
+}
+
+/*
+ * Ask the driver to write the doorbell once it moves the tail past what
+ * was consumed, then check for commands that raced with that.
+ */
+static bool nvme_sq_rearm(NvmeSQueue *sq)
+{
+    uint32_t ei = cpu_to_le32(sq->tail);
+
+    pci_dma_write(&sq->ctrl->parent_obj, sq->ei_addr, &ei, sizeof(ei));
+    smp_mb();
+    nvme_update_sq_tail(sq);
+    return !nvme_sq_empty(sq);
+}
+
+static void nvme_cq_rearm(NvmeCQueue *cq)
+{
+    uint32_t ei = cpu_to_le32(cq->head);
+    uint32_t head;
+
+    pci_dma_write(&cq->ctrl->parent_obj, cq->ei_addr, &ei, sizeof(ei));
+    smp_mb();
+    pci_dma_read(&cq->ctrl->parent_obj, cq->db_addr, &head, sizeof(head));
+    head = le32_to_cpu(head);
+    if (head < cq->size) {
+        cq->head = head;
+    }
+}
+
 static void nvme_irq_check(NvmeCtrl *n)
 {
     if (msix_enabled(&(n->parent_obj))) {
@@ -136,6 +211,46 @@ static void nvme_irq_deassert(NvmeCtrl *n, NvmeCQueue *cq)
     }
 }
 
+static void nvme_irq_bh(void *opaque)
+{
+    NvmeCQueue *cq = opaque;
+
+    nvme_irq_assert(cq->ctrl, cq);
+}
+
+/* Interrupts are delivered from the main loop, which holds the BQL */
+static void nvme_cq_notify(NvmeCtrl *n, NvmeCQueue *cq)
+{
+    if (cq->irq_bh) {
+        qemu_bh_schedule(cq->irq_bh);
+    } else {
+        nvme_irq_assert(n, cq);
+    }
+}
+
+static void nvme_cq_irq_timer(void *opaque)
+{
+    NvmeCQueue *cq = opaque;
+    NvmeCtrl *n = cq->ctrl;
+
+    aio_context_acquire(n->ctx);
+    cq->pending_irqs = 0;
+    nvme_cq_notify(n, cq);
+    aio_context_release(n->ctx);
+}
+
+/*
+ * Interrupt coalescing applies to the I/O completion queues whose vector
+ * did not opt out of it.
+ */
+static bool nvme_cq_coalescing(NvmeCtrl *n, NvmeCQueue *cq)
+{
+    uint32_t intc = n->features.int_coalescing;
+
+    return cq->cqid && (NVME_INTC_THR(intc) || NVME_INTC_TIME(intc)) &&
+        !(n->features.int_vector_config[cq->vector] & NVME_INTVC_NOCOALESCING);
+}
+
 static uint16_t nvme_map_prp(QEMUSGList *qsg, QEMUIOVector *iov, uint64_t prp1,
                              uint64_t prp2, uint32_t len, NvmeCtrl *n)
 {
@@ -252,11 +367,23 @@ static void nvme_post_cqes(void *opaque)
     NvmeCQueue *cq = opaque;
     NvmeCtrl *n = cq->ctrl;
     NvmeRequest *req, *next;
+    uint32_t intc = n->features.int_coalescing;
+    uint32_t posted = 0;
 
+    aio_context_acquire(n->ctx);
     QTAILQ_FOREACH_SAFE(req, &cq->req_list, entry, next) {
         NvmeSQueue *sq;
         hwaddr addr;
 
+        /*
+         * With shadow doorbells the head is only fetched when it is needed.
+         * The pin interrupt is deasserted by doorbell writes, so then the
+         * driver has to write them after every interrupt.
+         */
+        if (cq->db_addr &&
+            (nvme_cq_full(cq) || !msix_enabled(&n->parent_obj))) {
+            nvme_cq_rearm(cq);
+        }
         if (nvme_cq_full(cq)) {
             break;
         }
@@ -268,11 +395,26 @@ static void nvme_post_cqes(void *opaque)
         req->cqe.sq_head = cpu_to_le16(sq->head);
         addr = cq->dma_addr + cq->tail * n->cqe_size;
         nvme_inc_cq_tail(cq);
-        pci_dma_write(&n->parent_obj, addr, (void *)&req->cqe,
-            sizeof(req->cqe));
+        dma_window_write(&cq->ring, addr, &req->cqe, sizeof(req->cqe));
         QTAILQ_INSERT_TAIL(&sq->req_list, req, entry);
+        posted++;
+    }
+
+    if (!nvme_cq_coalescing(n, cq)) {
+        nvme_cq_notify(n, cq);
+    } else {
+        /* THR is 0's based, TIME is in 100 microsecond units */
+        cq->pending_irqs += posted;
+        if (cq->pending_irqs > NVME_INTC_THR(intc)) {
+            timer_del(cq->irq_timer);
+            cq->pending_irqs = 0;
+            nvme_cq_notify(n, cq);
+        } else if (cq->pending_irqs && !timer_pending(cq->irq_timer)) {
+            timer_mod(cq->irq_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                      NVME_INTC_TIME(intc) * 100 * SCALE_US);
+        }
     }
-    nvme_irq_assert(n, cq);
+    aio_context_release(n->ctx);
 }
 
 static void nvme_enqueue_req_completion(NvmeCQueue *cq, NvmeRequest *req)
@@ -290,6 +432,7 @@ static void nvme_rw_cb(void *opaque, int ret)
     NvmeCtrl *n = sq->ctrl;
     NvmeCQueue *cq = n->cq[sq->cqid];
 
+    aio_context_acquire(n->ctx);
     if (!ret) {
         block_acct_done(blk_get_stats(n->conf.blk), &req->acct);
         req->status = NVME_SUCCESS;
@@ -301,6 +444,7 @@ static void nvme_rw_cb(void *opaque, int ret)
         qemu_sglist_destroy(&req->qsg);
     }
     nvme_enqueue_req_completion(cq, req);
+    aio_context_release(n->ctx);
 }
 
 static uint16_t nvme_flush(NvmeCtrl *n, NvmeNamespace *ns, NvmeCmd *cmd,
@@ -412,11 +556,104 @@ static uint16_t nvme_io_cmd(NvmeCtrl *n, NvmeCmd *cmd, NvmeRequest *req)
     }
 }
 
+static void nvme_sq_notifier_read(EventNotifier *e)
+{
+    NvmeSQueue *sq = container_of(e, NvmeSQueue, notifier);
+
+    if (event_notifier_test_and_clear(e)) {
+        nvme_process_sq(sq);
+    }
+}
+
+static void nvme_sq_notifier_poll_begin(EventNotifier *e)
+{
+    NvmeSQueue *sq = container_of(e, NvmeSQueue, notifier);
+
+    sq->aio_polling = true;
+}
+
+static bool nvme_sq_notifier_poll(void *opaque)
+{
+    EventNotifier *e = opaque;
+    NvmeSQueue *sq = container_of(e, NvmeSQueue, notifier);
+    NvmeCtrl *n = sq->ctrl;
+    bool progress;
+
+    aio_context_acquire(n->ctx);
+    nvme_update_sq_tail(sq);
+    progress = !nvme_sq_empty(sq) && !QTAILQ_EMPTY(&sq->req_list);
+    if (progress) {
+        nvme_process_sq(sq);
+    }
+    aio_context_release(n->ctx);
+    return progress;
+}
+
+static void nvme_sq_notifier_poll_end(EventNotifier *e)
+{
+    NvmeSQueue *sq = container_of(e, NvmeSQueue, notifier);
+    NvmeCtrl *n = sq->ctrl;
+
+    /* Caller polls once more after this to catch commands that race */
+    aio_context_acquire(n->ctx);
+    sq->aio_polling = false;
+    nvme_sq_rearm(sq);
+    aio_context_release(n->ctx);
+}
+
+/*
+ * The doorbell value is lost with an ioeventfd, so it is only used together
+ * with the shadow doorbell.
+ */
+static void nvme_sq_set_ioeventfd(NvmeCtrl *n, NvmeSQueue *sq, bool enable)
+{
+    hwaddr offset = 0x1000 + (sq->sqid << 3);
+
+    if (enable) {
+        if (event_notifier_init(&sq->notifier, 0)) {
+            /* Keep using the MMIO doorbell */
+            return;
+        }
+        aio_set_event_notifier(n->ctx, &sq->notifier, true,
+                               nvme_sq_notifier_read, nvme_sq_notifier_poll);
+        aio_set_event_notifier_poll(n->ctx, &sq->notifier,
+                                    nvme_sq_notifier_poll_begin,
+                                    nvme_sq_notifier_poll_end);
+        memory_region_add_eventfd(&n->iomem, offset, 4, false, 0,
+                                  &sq->notifier);
+        sq->ioeventfd = true;
+    } else if (sq->ioeventfd) {
+        memory_region_del_eventfd(&n->iomem, offset, 4, false, 0,
+                                  &sq->notifier);
+        aio_set_event_notifier(n->ctx, &sq->notifier, true, NULL, NULL);
+        event_notifier_cleanup(&sq->notifier);
+        sq->ioeventfd = false;
+        sq->aio_polling = false;
+    }
+}
+
+static void nvme_init_sq_dbbuf(NvmeCtrl *n, NvmeSQueue *sq)
+{
+    sq->db_addr = n->dbbuf_dbs + (sq->sqid << 3);
+    sq->ei_addr = n->dbbuf_eis + (sq->sqid << 3);
+    if (n->iothread && !sq->ioeventfd) {
+        nvme_sq_set_ioeventfd(n, sq, true);
+    }
+}
+
+static void nvme_init_cq_dbbuf(NvmeCtrl *n, NvmeCQueue *cq)
+{
+    cq->db_addr = n->dbbuf_dbs + (cq->cqid << 3) + (1 << 2);
+    cq->ei_addr = n->dbbuf_eis + (cq->cqid << 3) + (1 << 2);
+}
+
 static void nvme_free_sq(NvmeSQueue *sq, NvmeCtrl *n)
 {
     n->sq[sq->sqid] = NULL;
+    nvme_sq_set_ioeventfd(n, sq, false);
     timer_del(sq->timer);
     timer_free(sq->timer);
+    dma_window_destroy(&sq->ring);
     g_free(sq->io_req);
     if (sq->sqid) {
         g_free(sq);
@@ -439,10 +676,14 @@ static uint16_t nvme_del_sq(NvmeCtrl *n, NvmeCmd *cmd)
     trace_nvme_del_sq(qid);
 
     sq = n->sq[qid];
-    while (!QTAILQ_EMPTY(&sq->out_req_list)) {
-        req = QTAILQ_FIRST(&sq->out_req_list);
-        assert(req->aiocb);
-        blk_aio_cancel(req->aiocb);
+    if (!QTAILQ_EMPTY(&sq->out_req_list)) {
+        /* Synchronous cancellation does not work across AioContexts */
+        QTAILQ_FOREACH(req, &sq->out_req_list, entry) {
+            assert(req->aiocb);
+            blk_aio_cancel_async(req->aiocb);
+        }
+        blk_drain(n->conf.blk);
+        assert(QTAILQ_EMPTY(&sq->out_req_list));
     }
     if (!nvme_check_cqid(n, sq->cqid)) {
         cq = n->cq[sq->cqid];
@@ -471,6 +712,8 @@ static void nvme_init_sq(NvmeSQueue *sq, NvmeCtrl *n, uint64_t dma_addr,
     sq->dma_addr = dma_addr;
     sq->sqid = sqid;
     sq->size = size;
+    dma_window_init(&sq->ring, pci_get_address_space(&n->parent_obj), false);
+    dma_window_set(&sq->ring, dma_addr, (dma_addr_t)size * n->sqe_size);
     sq->cqid = cqid;
     sq->head = sq->tail = 0;
     sq->io_req = g_new(NvmeRequest, sq->size);
@@ -481,12 +724,17 @@ static void nvme_init_sq(NvmeSQueue *sq, NvmeCtrl *n, uint64_t dma_addr,
         sq->io_req[i].sq = sq;
         QTAILQ_INSERT_TAIL(&(sq->req_list), &sq->io_req[i], entry);
     }
-    sq->timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, nvme_process_sq, sq);
+    sq->timer = nvme_timer_new(n, sqid, nvme_process_sq, sq);
 
     assert(n->cq[cqid]);
     cq = n->cq[cqid];
     QTAILQ_INSERT_TAIL(&(cq->sq_list), sq, entry);
     n->sq[sqid] = sq;
+
+    /* The admin queue always uses the MMIO doorbells */
+    if (sqid && n->dbbuf_enabled) {
+        nvme_init_sq_dbbuf(n, sq);
+    }
 }
 
 static uint16_t nvme_create_sq(NvmeCtrl *n, NvmeCmd *cmd)
@@ -532,6 +780,12 @@ static void nvme_free_cq(NvmeCQueue *cq, NvmeCtrl *n)
     n->cq[cq->cqid] = NULL;
     timer_del(cq->timer);
     timer_free(cq->timer);
+    timer_del(cq->irq_timer);
+    timer_free(cq->irq_timer);
+    dma_window_destroy(&cq->ring);
+    if (cq->irq_bh) {
+        qemu_bh_delete(cq->irq_bh);
+    }
     msix_vector_unuse(&n->parent_obj, cq->vector);
     if (cq->cqid) {
         g_free(cq);
@@ -566,6 +820,8 @@ static void nvme_init_cq(NvmeCQueue *cq, NvmeCtrl *n, uint64_t dma_addr,
     cq->cqid = cqid;
     cq->size = size;
     cq->dma_addr = dma_addr;
+    dma_window_init(&cq->ring, pci_get_address_space(&n->parent_obj), true);
+    dma_window_set(&cq->ring, dma_addr, (dma_addr_t)size * n->cqe_size);
     cq->phase = 1;
     cq->irq_enabled = irq_enabled;
     cq->vector = vector;
@@ -574,7 +830,15 @@ static void nvme_init_cq(NvmeCQueue *cq, NvmeCtrl *n, uint64_t dma_addr,
     QTAILQ_INIT(&cq->sq_list);
     msix_vector_use(&n->parent_obj, cq->vector);
     n->cq[cqid] = cq;
-    cq->timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, nvme_post_cqes, cq);
+    cq->timer = nvme_timer_new(n, cqid, nvme_post_cqes, cq);
+    cq->pending_irqs = 0;
+    cq->irq_timer = nvme_timer_new(n, cqid, nvme_cq_irq_timer, cq);
+    if (cqid && n->iothread) {
+        cq->irq_bh = aio_bh_new(qemu_get_aio_context(), nvme_irq_bh, cq);
+    }
+    if (cqid && n->dbbuf_enabled) {
+        nvme_init_cq_dbbuf(n, cq);
+    }
 }
 
 static uint16_t nvme_create_cq(NvmeCtrl *n, NvmeCmd *cmd)
@@ -602,7 +866,7 @@ static uint16_t nvme_create_cq(NvmeCtrl *n, NvmeCmd *cmd)
         trace_nvme_err_invalid_create_cq_addr(prp1);
         return NVME_INVALID_FIELD | NVME_DNR;
     }
-    if (unlikely(vector > n->num_queues)) {
+    if (unlikely(vector >= n->num_queues)) {
         trace_nvme_err_invalid_create_cq_vector(vector);
         return NVME_INVALID_IRQ_VECTOR | NVME_DNR;
     }
@@ -707,6 +971,17 @@ static uint16_t nvme_get_feature(NvmeCtrl *n, NvmeCmd *cmd, NvmeRequest *req)
         result = cpu_to_le32((n->num_queues - 2) | ((n->num_queues - 2) << 16));
         trace_nvme_getfeat_numq(result);
         break;
+    case NVME_INTERRUPT_COALESCING:
+        result = cpu_to_le32(n->features.int_coalescing);
+        break;
+    case NVME_INTERRUPT_VECTOR_CONF:
+        if (NVME_INTVC_IV(le32_to_cpu(cmd->cdw11)) >= n->num_queues) {
+            trace_nvme_err_invalid_getfeat(dw10);
+            return NVME_INVALID_FIELD | NVME_DNR;
+        }
+        result = cpu_to_le32(n->features.int_vector_config[
+                                 NVME_INTVC_IV(le32_to_cpu(cmd->cdw11))]);
+        break;
     default:
         trace_nvme_err_invalid_getfeat(dw10);
         return NVME_INVALID_FIELD | NVME_DNR;
@@ -732,6 +1007,18 @@ static uint16_t nvme_set_feature(NvmeCtrl *n, NvmeCmd *cmd, NvmeRequest *req)
         req->cqe.result =
             cpu_to_le32((n->num_queues - 2) | ((n->num_queues - 2) << 16));
         break;
+    case NVME_INTERRUPT_COALESCING:
+        trace_nvme_setfeat_intc(NVME_INTC_THR(dw11), NVME_INTC_TIME(dw11));
+        n->features.int_coalescing = dw11 & 0xffff;
+        break;
+    case NVME_INTERRUPT_VECTOR_CONF:
+        if (NVME_INTVC_IV(dw11) >= n->num_queues) {
+            trace_nvme_err_invalid_setfeat(dw10);
+            return NVME_INVALID_FIELD | NVME_DNR;
+        }
+        n->features.int_vector_config[NVME_INTVC_IV(dw11)] =
+            dw11 & (0xffff | NVME_INTVC_NOCOALESCING);
+        break;
     default:
         trace_nvme_err_invalid_setfeat(dw10);
         return NVME_INVALID_FIELD | NVME_DNR;
@@ -739,6 +1026,33 @@ static uint16_t nvme_set_feature(NvmeCtrl *n, NvmeCmd *cmd, NvmeRequest *req)
     return NVME_SUCCESS;
 }
 
+static uint16_t nvme_dbbuf_config(NvmeCtrl *n, NvmeCmd *cmd)
+{
+    uint64_t dbs = le64_to_cpu(cmd->prp1);
+    uint64_t eis = le64_to_cpu(cmd->prp2);
+    int i;
+
+    trace_nvme_dbbuf_config(dbs, eis);
+
+    if (unlikely(!dbs || !eis || (dbs | eis) & (n->page_size - 1))) {
+        trace_nvme_err_invalid_dbbuf(dbs, eis);
+        return NVME_INVALID_FIELD | NVME_DNR;
+    }
+
+    n->dbbuf_dbs = dbs;
+    n->dbbuf_eis = eis;
+    n->dbbuf_enabled = true;
+    for (i = 1; i < n->num_queues; i++) {
+        if (n->sq[i]) {
+            nvme_init_sq_dbbuf(n, n->sq[i]);
+        }
+        if (n->cq[i]) {
+            nvme_init_cq_dbbuf(n, n->cq[i]);
+        }
+    }
+    return NVME_SUCCESS;
+}
+
 static uint16_t nvme_admin_cmd(NvmeCtrl *n, NvmeCmd *cmd, NvmeRequest *req)
 {
     switch (cmd->opcode) {
@@ -756,12 +1070,47 @@ static uint16_t nvme_admin_cmd(NvmeCtrl *n, NvmeCmd *cmd, NvmeRequest *req)
         return nvme_set_feature(n, cmd, req);
     case NVME_ADM_CMD_GET_FEATURES:
         return nvme_get_feature(n, cmd, req);
+    case NVME_ADM_CMD_DBBUF_CONFIG:
+        return nvme_dbbuf_config(n, cmd);
     default:
         trace_nvme_err_invalid_admin_opc(cmd->opcode);
         return NVME_INVALID_OPCODE | NVME_DNR;
     }
 }
 
+/*
+ * Busy-wait for the driver to move the shadow tail before asking it for a
+ * doorbell write again.  The window doubles after a hit and halves after
+ * a miss, between 1/16 of sq_poll_max_ns and the full value.
+ */
+static bool nvme_sq_poll(NvmeCtrl *n, NvmeSQueue *sq)
+{
+    int64_t max_ns = n->sq_poll_max_ns;
+    int64_t min_ns = MAX(max_ns / 16, 1);
+    int64_t deadline;
+
+    if (!max_ns) {
+        return false;
+    }
+    if (!sq->poll_ns) {
+        sq->poll_ns = min_ns;
+    }
+
+    deadline = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) + sq->poll_ns;
+    do {
+        nvme_update_sq_tail(sq);
+        if (!nvme_sq_empty(sq)) {
+            sq->poll_ns = MIN(sq->poll_ns * 2, max_ns);
+            trace_nvme_sq_poll(sq->sqid, true, sq->poll_ns);
+            return true;
+        }
+    } while (qemu_clock_get_ns(QEMU_CLOCK_REALTIME) < deadline);
+
+    sq->poll_ns = MAX(sq->poll_ns / 2, min_ns);
+    trace_nvme_sq_poll(sq->sqid, false, sq->poll_ns);
+    return false;
+}
+
 static void nvme_process_sq(void *opaque)
 {
     NvmeSQueue *sq = opaque;
@@ -773,9 +1122,15 @@ static void nvme_process_sq(void *opaque)
     NvmeCmd cmd;
     NvmeRequest *req;
 
+    aio_context_acquire(n->ctx);
+    if (sq->db_addr) {
+        nvme_update_sq_tail(sq);
+    }
+
+process:
     while (!(nvme_sq_empty(sq) || QTAILQ_EMPTY(&sq->req_list))) {
         addr = sq->dma_addr + sq->head * n->sqe_size;
-        nvme_addr_read(n, addr, (void *)&cmd, sizeof(cmd));
+        nvme_ring_read(n, &sq->ring, addr, &cmd, sizeof(cmd));
         nvme_inc_sq_head(sq);
 
         req = QTAILQ_FIRST(&sq->req_list);
@@ -790,13 +1145,29 @@ static void nvme_process_sq(void *opaque)
             req->status = status;
             nvme_enqueue_req_completion(cq, req);
         }
+        if (sq->db_addr) {
+            nvme_update_sq_tail(sq);
+        }
     }
+
+    /* While the AioContext polls, the driver need not write the doorbell */
+    if (sq->db_addr && !sq->aio_polling) {
+        if (!QTAILQ_EMPTY(&sq->req_list) && nvme_sq_poll(n, sq)) {
+            goto process;
+        }
+        if (nvme_sq_rearm(sq) && !QTAILQ_EMPTY(&sq->req_list)) {
+            goto process;
+        }
+    }
+    aio_context_release(n->ctx);
 }
 
 static void nvme_clear_ctrl(NvmeCtrl *n)
 {
     int i;
 
+    aio_context_acquire(n->ctx);
+    blk_drain(n->conf.blk);
     for (i = 0; i < n->num_queues; i++) {
         if (n->sq[i] != NULL) {
             nvme_free_sq(n->sq[i], n);
@@ -809,6 +1180,14 @@ static void nvme_clear_ctrl(NvmeCtrl *n)
     }
 
     blk_flush(n->conf.blk);
+    aio_context_release(n->ctx);
+
+    n->dbbuf_dbs = n->dbbuf_eis = 0;
+    n->dbbuf_enabled = false;
+    n->features.int_coalescing = 0;
+    for (i = 0; i < n->num_queues; i++) {
+        n->features.int_vector_config[i] = i;
+    }
     n->bar.cc = 0;
 }
 
@@ -1070,17 +1449,10 @@ static uint64_t nvme_mmio_read(void *opaque, hwaddr addr, unsigned size)
     return val;
 }
 
-static void nvme_process_db(NvmeCtrl *n, hwaddr addr, int val)
+static void nvme_process_db_locked(NvmeCtrl *n, hwaddr addr, int val)
 {
     uint32_t qid;
 
-    if (unlikely(addr & ((1 << 2) - 1))) {
-        NVME_GUEST_ERR(nvme_ub_db_wr_misaligned,
-                       "doorbell write not 32-bit aligned,"
-                       " offset=0x%"PRIx64", ignoring", addr);
-        return;
-    }
-
     if (((addr - 0x1000) >> 2) & 1) {
         /* Completion queue doorbell write */
 
@@ -1150,6 +1522,20 @@ static void nvme_process_db(NvmeCtrl *n, hwaddr addr, int val)
     }
 }
 
+static void nvme_process_db(NvmeCtrl *n, hwaddr addr, int val)
+{
+    if (unlikely(addr & ((1 << 2) - 1))) {
+        NVME_GUEST_ERR(nvme_ub_db_wr_misaligned,
+                       "doorbell write not 32-bit aligned,"
+                       " offset=0x%"PRIx64", ignoring", addr);
+        return;
+    }
+
+    aio_context_acquire(n->ctx);
+    nvme_process_db_locked(n, addr, val);
+    aio_context_release(n->ctx);
+}
+
 static void nvme_mmio_write(void *opaque, hwaddr addr, uint64_t data,
     unsigned size)
 {
@@ -1241,6 +1627,10 @@ static void nvme_realize(PCIDevice *pci_dev, Error **errp)
     n->namespaces = g_new0(NvmeNamespace, n->num_namespaces);
     n->sq = g_new0(NvmeSQueue *, n->num_queues);
     n->cq = g_new0(NvmeCQueue *, n->num_queues);
+    n->features.int_vector_config = g_new(uint32_t, n->num_queues);
+    for (i = 0; i < n->num_queues; i++) {
+        n->features.int_vector_config[i] = i;
+    }
 
     memory_region_init_io(&n->iomem, OBJECT(n), &nvme_mmio_ops, n,
                           "nvme", n->reg_size);
@@ -1258,7 +1648,7 @@ static void nvme_realize(PCIDevice *pci_dev, Error **errp)
     id->ieee[0] = 0x00;
     id->ieee[1] = 0x02;
     id->ieee[2] = 0xb3;
-    id->oacs = cpu_to_le16(0);
+    id->oacs = cpu_to_le16(NVME_OACS_DBBUF);
     id->frmw = 7 << 1;
     id->lpa = 1 << 0;
     id->sqes = (0x6 << 4) | 0x6;
@@ -1322,6 +1712,13 @@ static void nvme_realize(PCIDevice *pci_dev, Error **errp)
             cpu_to_le64(n->ns_size >>
                 id_ns->lbaf[NVME_ID_NS_FLBAS_INDEX(ns->id_ns.flbas)].ds);
     }
+
+    if (n->iothread) {
+        n->ctx = iothread_get_aio_context(n->iothread);
+        blk_set_aio_context(n->conf.blk, n->ctx);
+    } else {
+        n->ctx = qemu_get_aio_context();
+    }
 }
 
 static void nvme_exit(PCIDevice *pci_dev)
@@ -1329,9 +1726,15 @@ static void nvme_exit(PCIDevice *pci_dev)
     NvmeCtrl *n = NVME(pci_dev);
 
     nvme_clear_ctrl(n);
+    if (n->iothread) {
+        aio_context_acquire(n->ctx);
+        blk_set_aio_context(n->conf.blk, qemu_get_aio_context());
+        aio_context_release(n->ctx);
+    }
     g_free(n->namespaces);
     g_free(n->cq);
     g_free(n->sq);
+    g_free(n->features.int_vector_config);
     if (n->cmbsz) {
         memory_region_unref(&n->ctrl_mem);
     }
@@ -1344,6 +1747,9 @@ static Property nvme_props[] = {
     DEFINE_PROP_STRING("serial", NvmeCtrl, serial),
     DEFINE_PROP_UINT32("cmb_size_mb", NvmeCtrl, cmb_size_mb, 0),
     DEFINE_PROP_UINT32("num_queues", NvmeCtrl, num_queues, 64),
+    DEFINE_PROP_LINK("iothread", NvmeCtrl, iothread, TYPE_IOTHREAD,
+                     IOThread *),
+    DEFINE_PROP_UINT32("sq-poll-max-ns", NvmeCtrl, sq_poll_max_ns, 0),
     DEFINE_PROP_END_OF_LIST(),
 };
 
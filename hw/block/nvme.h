@@ -1,6 +1,7 @@
 #ifndef HW_NVME_H
 #define HW_NVME_H
 #include "block/nvme.h"
+#include "sysemu/iothread.h"
 
 typedef struct NvmeAsyncEvent {
     QSIMPLEQ_ENTRY(NvmeAsyncEvent) entry;
@@ -27,7 +28,17 @@ typedef struct NvmeSQueue {
     uint32_t    tail;
     uint32_t    size;
     uint64_t    dma_addr;
+    DMAWindow   ring;
+    /* Shadow doorbell and EventIdx entries, 0 if not configured */
+    uint64_t    db_addr;
+    uint64_t    ei_addr;
     QEMUTimer   *timer;
+    EventNotifier notifier;
+    bool        ioeventfd;
+    /* The AioContext is polling the shadow doorbell */
+    bool        aio_polling;
+    /* Current busy-wait window, see nvme_sq_poll() */
+    int64_t     poll_ns;
     NvmeRequest *io_req;
     QTAILQ_HEAD(sq_req_list, NvmeRequest) req_list;
     QTAILQ_HEAD(out_req_list, NvmeRequest) out_req_list;
@@ -44,7 +55,15 @@ typedef struct NvmeCQueue {
     uint32_t    vector;
     uint32_t    size;
     uint64_t    dma_addr;
+    DMAWindow   ring;
+    uint64_t    db_addr;
+    uint64_t    ei_addr;
     QEMUTimer   *timer;
+    /* Interrupt coalescing: entries posted since the last interrupt */
+    uint32_t    pending_irqs;
+    QEMUTimer   *irq_timer;
+    /* Raises the interrupt from the main loop when using an iothread */
+    QEMUBH      *irq_bh;
     QTAILQ_HEAD(sq_list, NvmeSQueue) sq_list;
     QTAILQ_HEAD(cq_req_list, NvmeRequest) req_list;
 } NvmeCQueue;
@@ -79,6 +98,15 @@ typedef struct NvmeCtrl {
     uint32_t    cmbloc;
     uint8_t     *cmbuf;
     uint64_t    irq_status;
+    uint32_t    sq_poll_max_ns;
+    uint64_t    dbbuf_dbs;
+    uint64_t    dbbuf_eis;
+    bool        dbbuf_enabled;
+    NvmeFeatureVal features;
+
+    /* I/O queues run here; its lock protects the state of all queues */
+    IOThread        *iothread;
+    AioContext      *ctx;
 
     char            *serial;
     NvmeNamespace   *namespaces;
@@ -127,21 +127,24 @@ static void virtio_blk_rw_complete(void *opaque, int ret)
 
 static void virtio_blk_flush_complete(void *opaque, int ret)
 {
-    VirtIOBlockReq *req = opaque;
-    VirtIOBlock *s = req->dev;
+    VirtIOBlockReq *next = opaque;
+    VirtIOBlock *s = next->dev;
 
     aio_context_acquire(blk_get_aio_context(s->conf.conf.blk));
-    if (ret) {
-        if (virtio_blk_handle_rw_error(req, -ret, 0)) {
-            goto out;
-        }
-    }
+    while (next) {
+        VirtIOBlockReq *req = next;
+        next = req->mr_next;
 
-    virtio_blk_req_complete(req, VIRTIO_BLK_S_OK);
-    block_acct_done(blk_get_stats(req->dev->blk), &req->acct);
-    virtio_blk_free_request(req);
+        if (ret) {
+            if (virtio_blk_handle_rw_error(req, -ret, 0)) {
+                continue;
+            }
+        }
 
-out:
+        virtio_blk_req_complete(req, VIRTIO_BLK_S_OK);
+        block_acct_done(blk_get_stats(req->dev->blk), &req->acct);
+        virtio_blk_free_request(req);
+    }
     aio_context_release(blk_get_aio_context(s->conf.conf.blk));
 }
 
@@ -198,16 +201,6 @@ out:
 
 #endif
 
-static VirtIOBlockReq *virtio_blk_get_request(VirtIOBlock *s, VirtQueue *vq)
-{
-    VirtIOBlockReq *req = virtqueue_pop(vq, sizeof(VirtIOBlockReq));
-
-    if (req) {
-        virtio_blk_init_request(s, vq, req);
-    }
-    return req;
-}
-
 static int virtio_blk_handle_scsi_req(VirtIOBlockReq *req)
 {
     int status = VIRTIO_BLK_S_OK;
@@ -442,18 +435,49 @@ static void virtio_blk_submit_multireq(BlockBackend *blk, MultiReqBuffer *mrb)
     mrb->num_reqs = 0;
 }
 
+/* Issue one flush for all the flushes collected in @mrb.  A flush only
+ * has to cover the writes that completed before it was queued, so
+ * completing earlier flushes together with the last one is correct.
+ * Writes queued in @mrb must have been submitted already.
+ */
+static void virtio_blk_submit_flushes(BlockBackend *blk, MultiReqBuffer *mrb)
+{
+    VirtIOBlockReq *req = mrb->flush_reqs;
+
+    trace_virtio_blk_submit_flushes(VIRTIO_DEVICE(req->dev), mrb,
+                                    mrb->num_flush_reqs);
+    blk_aio_flush(blk, virtio_blk_flush_complete, req);
+    mrb->flush_reqs = NULL;
+    mrb->num_flush_reqs = 0;
+}
+
+/* Submit everything that is still queued in @mrb */
+static void virtio_blk_submit_mrb(BlockBackend *blk, MultiReqBuffer *mrb)
+{
+    if (mrb->num_reqs) {
+        virtio_blk_submit_multireq(blk, mrb);
+    }
+    if (mrb->flush_reqs) {
+        virtio_blk_submit_flushes(blk, mrb);
+    }
+}
+
 static void virtio_blk_handle_flush(VirtIOBlockReq *req, MultiReqBuffer *mrb)
 {
     block_acct_start(blk_get_stats(req->dev->blk), &req->acct, 0,
                      BLOCK_ACCT_FLUSH);
 
     /*
-     * Make sure all outstanding writes are posted to the backing device.
+     * Coalesce with the other flushes of this batch; they are issued after
+     * all outstanding writes have been posted to the backing device.
      */
-    if (mrb->is_write && mrb->num_reqs > 0) {
-        virtio_blk_submit_multireq(req->dev->blk, mrb);
+    req->mr_next = mrb->flush_reqs;
+    mrb->flush_reqs = req;
+    mrb->num_flush_reqs++;
+
+    if (!req->dev->conf.request_merging) {
+        virtio_blk_submit_mrb(req->dev->blk, mrb);
     }
-    blk_aio_flush(req->dev->blk, virtio_blk_flush_complete, req);
 }
 
 static bool virtio_blk_sect_range_ok(VirtIOBlock *dev,
@@ -593,9 +617,10 @@ static int virtio_blk_handle_request(VirtIOBlockReq *req, MultiReqBuffer *mrb)
 
 bool virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
 {
-    VirtIOBlockReq *req;
+    VirtIOBlockReq *reqs[VIRTIO_BLK_POP_BATCH];
     MultiReqBuffer mrb = {};
     bool progress = false;
+    unsigned int i, n;
 
     aio_context_acquire(blk_get_aio_context(s->blk));
     blk_io_plug(s->blk);
@@ -603,11 +628,21 @@ bool virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
     do {
         virtio_queue_set_notification(vq, 0);
 
-        while ((req = virtio_blk_get_request(s, vq))) {
+        while ((n = virtqueue_pop_batch(vq, sizeof(VirtIOBlockReq),
+                                        (void **)reqs, ARRAY_SIZE(reqs)))) {
             progress = true;
-            if (virtio_blk_handle_request(req, &mrb)) {
-                virtqueue_detach_element(req->vq, &req->elem, 0);
-                virtio_blk_free_request(req);
+            for (i = 0; i < n; i++) {
+                virtio_blk_init_request(s, vq, reqs[i]);
+                if (virtio_blk_handle_request(reqs[i], &mrb)) {
+                    break;
+                }
+            }
+            if (i < n) {
+                /* The device is broken, give back the rest of the batch */
+                for (; i < n; i++) {
+                    virtqueue_detach_element(vq, &reqs[i]->elem, 0);
+                    virtio_blk_free_request(reqs[i]);
+                }
                 break;
             }
         }
@@ -615,9 +650,7 @@ bool virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
         virtio_queue_set_notification(vq, 1);
     } while (!virtio_queue_empty(vq));
 
-    if (mrb.num_reqs) {
-        virtio_blk_submit_multireq(s->blk, &mrb);
-    }
+    virtio_blk_submit_mrb(s->blk, &mrb);
 
     blk_io_unplug(s->blk);
     aio_context_release(blk_get_aio_context(s->blk));
@@ -674,9 +707,7 @@ static void virtio_blk_dma_restart_bh(void *opaque)
         req = next;
     }
 
-    if (mrb.num_reqs) {
-        virtio_blk_submit_multireq(s->blk, &mrb);
-    }
+    virtio_blk_submit_mrb(s->blk, &mrb);
     aio_context_release(blk_get_aio_context(s->conf.conf.blk));
 }
 
@@ -861,7 +892,7 @@ static void virtio_blk_save_device(VirtIODevice *vdev, QEMUFile *f)
             qemu_put_be32(f, virtio_get_queue_index(req->vq));
         }
 
-        qemu_put_virtqueue_element(f, &req->elem);
+        qemu_put_virtqueue_element(vdev, f, &req->elem);
         req = req->next;
     }
     qemu_put_sbyte(f, 0);
@@ -234,8 +234,68 @@ static gboolean serial_watch_cb(GIOChannel *chan, GIOCondition cond,
     return FALSE;
 }
 
+/* In FIFO mode, send out the whole transmit FIFO with one chardev write
+ * and raise THRE once it is empty, rather than once per character. */
+static void serial_xmit_fifo(SerialState *s)
+{
+    uint8_t buf[UART_FIFO_LENGTH];
+    uint32_t len = 0, num;
+    const uint8_t *data;
+    int rc;
+
+    timer_del(s->xmit_flush_timer);
+
+    while (!fifo8_is_empty(&s->xmit_fifo)) {
+        data = fifo8_pop_buf(&s->xmit_fifo, sizeof(buf) - len, &num);
+        memcpy(buf + len, data, num);
+        len += num;
+    }
+
+    if (len) {
+        rc = qemu_chr_fe_write(&s->chr, buf, len);
+        if (rc < 0) {
+            /* Like a single character, drop the data on hard errors */
+            rc = errno == EAGAIN ? 0 : len;
+        }
+
+        if (rc < len && s->tsr_retry < MAX_XMIT_RETRY) {
+            assert(s->watch_tag == 0);
+            s->watch_tag =
+                qemu_chr_fe_add_watch(&s->chr, G_IO_OUT | G_IO_HUP,
+                                      serial_watch_cb, s);
+            if (s->watch_tag > 0) {
+                fifo8_push_all(&s->xmit_fifo, buf + rc, len - rc);
+                s->tsr_retry = rc > 0 ? 1 : s->tsr_retry + 1;
+                return;
+            }
+        }
+    }
+    s->tsr_retry = 0;
+
+    s->last_xmit_ts = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    s->lsr |= UART_LSR_THRE | UART_LSR_TEMT;
+    if (!s->thr_ipending) {
+        s->thr_ipending = 1;
+        serial_update_irq(s);
+    }
+}
+
+static void serial_xmit_flush(void *opaque)
+{
+    SerialState *s = opaque;
+
+    if (s->tsr_retry == 0 && !fifo8_is_empty(&s->xmit_fifo)) {
+        serial_xmit(s);
+    }
+}
+
 static void serial_xmit(SerialState *s)
 {
+    if ((s->fcr & UART_FCR_FE) && !(s->mcr & UART_MCR_LOOP)) {
+        serial_xmit_fifo(s);
+        return;
+    }
+
     do {
         assert(!(s->lsr & UART_LSR_TEMT));
         if (s->tsr_retry == 0) {
@@ -364,7 +424,19 @@ static void serial_ioport_write(void *opaque, hwaddr addr, uint64_t val,
             s->lsr &= ~UART_LSR_THRE;
             s->lsr &= ~UART_LSR_TEMT;
             serial_update_irq(s);
-            if (s->tsr_retry == 0) {
+            if (s->tsr_retry != 0) {
+                break;
+            }
+            if ((s->fcr & UART_FCR_FE) && !(s->mcr & UART_MCR_LOOP) &&
+                !fifo8_is_full(&s->xmit_fifo)) {
+                /* Let the guest fill the FIFO, it is sent when full or
+                 * after one character time at the latest. */
+                if (!timer_pending(s->xmit_flush_timer)) {
+                    timer_mod(s->xmit_flush_timer,
+                              qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                              s->char_transmit_time);
+                }
+            } else {
                 serial_xmit(s);
             }
         }
@@ -432,6 +504,11 @@ static void serial_ioport_write(void *opaque, hwaddr addr, uint64_t val,
             s->lsr |= UART_LSR_THRE;
             s->thr_ipending = 1;
             fifo8_reset(&s->xmit_fifo);
+            /* Drop the characters still waiting to be sent as a batch */
+            timer_del(s->xmit_flush_timer);
+            if (s->tsr_retry == 0) {
+                s->lsr |= UART_LSR_TEMT;
+            }
         }
 
         serial_write_fcr(s, val & 0xC9);
@@ -528,6 +605,10 @@ static uint64_t serial_ioport_read(void *opaque, hwaddr addr, unsigned size)
         ret = s->mcr;
         break;
     case 5:
+        /* A guest polling for THRE wants the FIFO drained now */
+        if (timer_pending(s->xmit_flush_timer)) {
+            serial_xmit_flush(s);
+        }
         ret = s->lsr;
         /* Clear break and overrun interrupts */
         if (s->lsr & (UART_LSR_BI|UART_LSR_OE)) {
@@ -643,6 +724,12 @@ static int serial_pre_save(void *opaque)
     SerialState *s = opaque;
     s->fcr_vmstate = s->fcr;
 
+    /* Characters waiting to be batched leave the transmitter busy without
+     * a retry pending, which the destination would not accept. */
+    if (timer_pending(s->xmit_flush_timer)) {
+        serial_xmit_flush(s);
+    }
+
     return 0;
 }
 
@@ -886,6 +973,7 @@ static void serial_reset(void *opaque)
 
     s->timeout_ipending = 0;
     timer_del(s->fifo_timeout_timer);
+    timer_del(s->xmit_flush_timer);
     timer_del(s->modem_status_poll);
 
     fifo8_reset(&s->recv_fifo);
@@ -934,6 +1022,8 @@ void serial_realize_core(SerialState *s, Error **errp)
     s->modem_status_poll = timer_new_ns(QEMU_CLOCK_VIRTUAL, (QEMUTimerCB *) serial_update_msl, s);
 
     s->fifo_timeout_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, (QEMUTimerCB *) fifo_timeout_int, s);
+    s->xmit_flush_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                       serial_xmit_flush, s);
     qemu_register_reset(serial_reset, s);
 
     qemu_chr_fe_set_handlers(&s->chr, serial_can_receive1, serial_receive1,
@@ -953,6 +1043,9 @@ void serial_exit_core(SerialState *s)
     timer_del(s->fifo_timeout_timer);
     timer_free(s->fifo_timeout_timer);
 
+    timer_del(s->xmit_flush_timer);
+    timer_free(s->xmit_flush_timer);
+
     fifo8_destroy(&s->recv_fifo);
     fifo8_destroy(&s->xmit_fifo);
 
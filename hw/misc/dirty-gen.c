@@ -0,0 +1,225 @@
+/*
+ * Synthetic guest RAM dirtying workload
+ *
+ * This device has no guest interface.  While the VM runs it writes to
+ * guest RAM through the system address space at a fixed rate, so that
+ * migration sees a repeatable dirtying workload without a guest OS:
+ *
+ *   -device x-dirty-gen,base=1M,size=64M,rate=20000,pattern=hotspot
+ *
+ * @rate is in pages per second.  @pattern is "seq" (walk the region in
+ * order), "random" (uniform over the region) or "hotspot" (90% of the
+ * writes go to the first @hot-percent of the region).
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/timer.h"
+#include "qemu/units.h"
+#include "qapi/error.h"
+#include "qapi/visitor.h"
+#include "exec/address-spaces.h"
+#include "exec/target_page.h"
+#include "hw/qdev.h"
+#include "hw/qdev-properties.h"
+#include "sysemu/sysemu.h"
+
+#define TYPE_DIRTY_GEN "x-dirty-gen"
+#define DIRTY_GEN(obj) OBJECT_CHECK(DirtyGenState, (obj), TYPE_DIRTY_GEN)
+
+/* Timer period; each tick writes the pages that are due since the last */
+#define DIRTY_GEN_TICK_NS   (1 * SCALE_MS)
+
+typedef enum DirtyGenPattern {
+    DIRTY_GEN_SEQ,
+    DIRTY_GEN_RANDOM,
+    DIRTY_GEN_HOTSPOT,
+} DirtyGenPattern;
+
+typedef struct DirtyGenState {
+    DeviceState parent_obj;
+
+    uint64_t base;
+    uint64_t size;
+    uint32_t rate;
+    uint32_t hot_percent;
+    char *pattern_str;
+
+    DirtyGenPattern pattern;
+    uint64_t npages;
+    QEMUTimer *timer;
+    VMChangeStateEntry *vmstate_entry;
+    int64_t last_ns;
+    uint64_t due_frac;
+    uint64_t pos;
+    uint64_t rand_state;
+    uint64_t written;
+} DirtyGenState;
+
+static uint64_t dirty_gen_rand(DirtyGenState *s)
+{
+    s->rand_state ^= s->rand_state >> 12;
+    s->rand_state ^= s->rand_state << 25;
+    s->rand_state ^= s->rand_state >> 27;
+    return s->rand_state * 0x2545f4914f6cdd1dULL;
+}
+
+static uint64_t dirty_gen_next_page(DirtyGenState *s)
+{
+    uint64_t hot;
+
+    switch (s->pattern) {
+    case DIRTY_GEN_SEQ:
+        s->pos = (s->pos + 1) % s->npages;
+        return s->pos;
+    case DIRTY_GEN_RANDOM:
+        return dirty_gen_rand(s) % s->npages;
+    case DIRTY_GEN_HOTSPOT:
+        hot = MAX(s->npages * s->hot_percent / 100, 1);
+        if (dirty_gen_rand(s) % 10) {
+            return dirty_gen_rand(s) % hot;
+        }
+        return dirty_gen_rand(s) % s->npages;
+    }
+    g_assert_not_reached();
+}
+
+static void dirty_gen_tick(void *opaque)
+{
+    DirtyGenState *s = opaque;
+    size_t page_size = qemu_target_page_size();
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    uint64_t due, i;
+
+    /*
+     * Catch up on at most 100ms, so that a long stall (for example in
+     * the monitor) does not turn into a burst.
+     */
+    due = (uint64_t)MIN(now - s->last_ns, 100 * SCALE_MS) * s->rate
+          + s->due_frac;
+    s->due_frac = due % NANOSECONDS_PER_SECOND;
+    due /= NANOSECONDS_PER_SECOND;
+    s->last_ns = now;
+
+    for (i = 0; i < due; i++) {
+        uint64_t val = ++s->written;
+
+        address_space_write(&address_space_memory,
+                            s->base + dirty_gen_next_page(s) * page_size,
+                            MEMTXATTRS_UNSPECIFIED, (uint8_t *)&val,
+                            sizeof(val));
+    }
+
+    timer_mod(s->timer, now + DIRTY_GEN_TICK_NS);
+}
+
+static void dirty_gen_vm_state_change(void *opaque, int running,
+                                      RunState state)
+{
+    DirtyGenState *s = opaque;
+
+    if (running) {
+        s->last_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+        timer_mod(s->timer, s->last_ns + DIRTY_GEN_TICK_NS);
+    } else {
+        timer_del(s->timer);
+    }
+}
+
+static void dirty_gen_get_written(Object *obj, Visitor *v, const char *name,
+                                  void *opaque, Error **errp)
+{
+    DirtyGenState *s = DIRTY_GEN(obj);
+
+    visit_type_uint64(v, name, &s->written, errp);
+}
+
+static void dirty_gen_realize(DeviceState *dev, Error **errp)
+{
+    DirtyGenState *s = DIRTY_GEN(dev);
+    size_t page_size = qemu_target_page_size();
+
+    if (!s->pattern_str || !strcmp(s->pattern_str, "random")) {
+        s->pattern = DIRTY_GEN_RANDOM;
+    } else if (!strcmp(s->pattern_str, "seq")) {
+        s->pattern = DIRTY_GEN_SEQ;
+    } else if (!strcmp(s->pattern_str, "hotspot")) {
+        s->pattern = DIRTY_GEN_HOTSPOT;
+    } else {
+        error_setg(errp, "pattern must be seq, random or hotspot");
+        return;
+    }
+    if (s->size < page_size || s->base % page_size) {
+        error_setg(errp, "base must be page aligned and size at least "
+                   "one page");
+        return;
+    }
+    if (s->base + s->size > ram_size) {
+        error_setg(errp, "region must be within guest RAM");
+        return;
+    }
+    if (s->hot_percent < 1 || s->hot_percent > 100) {
+        error_setg(errp, "hot-percent must be between 1 and 100");
+        return;
+    }
+
+    s->npages = s->size / page_size;
+    s->rand_state = 0x9e3779b97f4a7c15ULL;
+    s->timer = timer_new_ns(QEMU_CLOCK_REALTIME, dirty_gen_tick, s);
+    s->vmstate_entry =
+        qemu_add_vm_change_state_handler(dirty_gen_vm_state_change, s);
+    if (runstate_is_running()) {
+        dirty_gen_vm_state_change(s, 1, RUN_STATE_RUNNING);
+    }
+}
+
+static void dirty_gen_unrealize(DeviceState *dev, Error **errp)
+{
+    DirtyGenState *s = DIRTY_GEN(dev);
+
+    qemu_del_vm_change_state_handler(s->vmstate_entry);
+    timer_del(s->timer);
+    timer_free(s->timer);
+}
+
+static void dirty_gen_instance_init(Object *obj)
+{
+    object_property_add(obj, "written", "uint64", dirty_gen_get_written,
+                        NULL, NULL, NULL, NULL);
+}
+
+static Property dirty_gen_props[] = {
+    DEFINE_PROP_SIZE("base", DirtyGenState, base, 1 * MiB),
+    DEFINE_PROP_SIZE("size", DirtyGenState, size, 16 * MiB),
+    DEFINE_PROP_UINT32("rate", DirtyGenState, rate, 1000),
+    DEFINE_PROP_UINT32("hot-percent", DirtyGenState, hot_percent, 10),
+    DEFINE_PROP_STRING("pattern", DirtyGenState, pattern_str),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void dirty_gen_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+
+    dc->realize = dirty_gen_realize;
+    dc->unrealize = dirty_gen_unrealize;
+    dc->props = dirty_gen_props;
+    dc->desc = "Synthetic RAM dirtying workload for migration tests";
+}
+
+static const TypeInfo dirty_gen_info = {
+    .name = TYPE_DIRTY_GEN,
+    .parent = TYPE_DEVICE,
+    .instance_size = sizeof(DirtyGenState),
+    .instance_init = dirty_gen_instance_init,
+    .class_init = dirty_gen_class_init,
+};
+
+static void dirty_gen_register_types(void)
+{
+    type_register_static(&dirty_gen_info);
+}
+
+type_init(dirty_gen_register_types)
@@ -28,6 +28,9 @@
 #include "hw/net/cadence_gem.h"
 #include "qapi/error.h"
 #include "qemu/log.h"
+#include "qemu/iov.h"
+#include "exec/address-spaces.h"
+#include "sysemu/dma.h"
 #include "net/checksum.h"
 
 #ifdef CADENCE_GEM_ERR_DEBUG
@@ -802,12 +805,47 @@ static int get_queue_from_screen(CadenceGEMState *s, uint8_t *rxbuf_ptr,
     return 0;
 }
 
-static void gem_get_rx_desc(CadenceGEMState *s, int q)
+/*
+ * Descriptors are accessed through a DMAWindow over a part of the ring,
+ * so that walking a burst of them costs one address translation rather
+ * than one per access.  The window slides forward when a descriptor
+ * falls outside of it.  It only lives for one transmit or receive pass.
+ */
+#define GEM_DESC_WINDOW_SIZE 4096
+
+static void gem_desc_read(DMAWindow *w, hwaddr addr, unsigned *desc)
+{
+    const hwaddr size = 2 * sizeof(*desc);
+
+    if (!w) {
+        cpu_physical_memory_read(addr, (uint8_t *)desc, size);
+        return;
+    }
+    if (!dma_window_contains(w, addr, size)) {
+        dma_window_set(w, addr, GEM_DESC_WINDOW_SIZE);
+    }
+    dma_window_read(w, addr, desc, size);
+}
+
+static void gem_desc_write(DMAWindow *w, hwaddr addr, unsigned *desc)
+{
+    const hwaddr size = 2 * sizeof(*desc);
+
+    if (!w) {
+        cpu_physical_memory_write(addr, (uint8_t *)desc, size);
+        return;
+    }
+    if (!dma_window_contains(w, addr, size)) {
+        dma_window_set(w, addr, GEM_DESC_WINDOW_SIZE);
+    }
+    dma_window_write(w, addr, desc, size);
+}
+
+static void gem_get_rx_desc(CadenceGEMState *s, DMAWindow *w, int q)
 {
     DB_PRINT("read descriptor 0x%x\n", (unsigned)s->rx_desc_addr[q]);
     /* read current descriptor */
-    cpu_physical_memory_read(s->rx_desc_addr[q],
-                             (uint8_t *)s->rx_desc[q], sizeof(s->rx_desc[q]));
+    gem_desc_read(w, s->rx_desc_addr[q], s->rx_desc[q]);
 
     /* Descriptor owned by software ? */
     if (rx_desc_get_ownership(s->rx_desc[q]) == 1) {
@@ -832,6 +870,7 @@ static ssize_t gem_receive(NetClientState *nc, const uint8_t *buf, size_t size)
     uint8_t    rxbuf[2048];
     uint8_t   *rxbuf_ptr;
     bool first_desc = true;
+    DMAWindow w;
     int maf;
     int q = 0;
 
@@ -915,10 +954,12 @@ static ssize_t gem_receive(NetClientState *nc, const uint8_t *buf, size_t size)
     /* Find which queue we are targeting */
     q = get_queue_from_screen(s, rxbuf_ptr, rxbufsize);
 
+    dma_window_init(&w, &address_space_memory, true);
     while (bytes_to_copy) {
         /* Do nothing if receive is not enabled. */
         if (!gem_can_receive(nc)) {
             assert(!first_desc);
+            dma_window_destroy(&w);
             return -1;
         }
 
@@ -962,9 +1003,7 @@ static ssize_t gem_receive(NetClientState *nc, const uint8_t *buf, size_t size)
         }
 
         /* Descriptor write-back.  */
-        cpu_physical_memory_write(s->rx_desc_addr[q],
-                                  (uint8_t *)s->rx_desc[q],
-                                  sizeof(s->rx_desc[q]));
+        gem_desc_write(&w, s->rx_desc_addr[q], s->rx_desc[q]);
 
         /* Next descriptor */
         if (rx_desc_get_wrap(s->rx_desc[q])) {
@@ -975,8 +1014,9 @@ static ssize_t gem_receive(NetClientState *nc, const uint8_t *buf, size_t size)
             s->rx_desc_addr[q] += 8;
         }
 
-        gem_get_rx_desc(s, q);
+        gem_get_rx_desc(s, &w, q);
     }
+    dma_window_destroy(&w);
 
     /* Count it */
     gem_receive_updatestats(s, buf, size);
@@ -1036,6 +1076,68 @@ static void gem_transmit_updatestats(CadenceGEMState *s, const uint8_t *packet,
     }
 }
 
+#define GEM_TX_MAX_IOV 64
+
+/*
+ * The frame being transmitted.  Its fragments are mapped in place and sent
+ * as an iovec.  When a fragment cannot be mapped, or the frame must be in
+ * one buffer for checksum offload or loopback, it is gathered into buf.
+ */
+typedef struct GemTxFrame {
+    struct iovec iov[GEM_TX_MAX_IOV];
+    int iovcnt;
+    bool linear;
+    unsigned len;
+    uint8_t buf[2048];
+} GemTxFrame;
+
+static void gem_tx_frame_unmap(GemTxFrame *f)
+{
+    int i;
+
+    for (i = 0; i < f->iovcnt; i++) {
+        address_space_unmap(&address_space_memory, f->iov[i].iov_base,
+                            f->iov[i].iov_len, false, f->iov[i].iov_len);
+    }
+    f->iovcnt = 0;
+}
+
+static void gem_tx_frame_reset(GemTxFrame *f, bool linear)
+{
+    gem_tx_frame_unmap(f);
+    f->linear = linear;
+    f->len = 0;
+}
+
+static void gem_tx_frame_add(GemTxFrame *f, hwaddr addr, unsigned len)
+{
+    if (!f->linear && f->iovcnt < GEM_TX_MAX_IOV) {
+        hwaddr plen = len;
+        void *ptr = address_space_map(&address_space_memory, addr, &plen,
+                                      false, MEMTXATTRS_UNSPECIFIED);
+
+        if (ptr && plen == len) {
+            f->iov[f->iovcnt].iov_base = ptr;
+            f->iov[f->iovcnt].iov_len = len;
+            f->iovcnt++;
+            f->len += len;
+            return;
+        }
+        if (ptr) {
+            address_space_unmap(&address_space_memory, ptr, plen, false, 0);
+        }
+    }
+
+    if (!f->linear) {
+        /* Gather what is mapped so far and copy from now on */
+        iov_to_buf(f->iov, f->iovcnt, 0, f->buf, f->len);
+        gem_tx_frame_unmap(f);
+        f->linear = true;
+    }
+    cpu_physical_memory_read(addr, f->buf + f->len, len);
+    f->len += len;
+}
+
 /*
  * gem_transmit:
  * Fish packets out of the descriptor ring and feed them to QEMU
@@ -1044,9 +1146,9 @@ static void gem_transmit(CadenceGEMState *s)
 {
     unsigned    desc[2];
     hwaddr packet_desc_addr;
-    uint8_t     tx_packet[2048];
-    uint8_t     *p;
-    unsigned    total_bytes;
+    GemTxFrame  frame;
+    DMAWindow w;
+    bool        linear;
     int q = 0;
 
     /* Do nothing if transmit is not enabled. */
@@ -1056,26 +1158,25 @@ static void gem_transmit(CadenceGEMState *s)
 
     DB_PRINT("\n");
 
-    /* The packet we will hand off to QEMU.
-     * Packets scattered across multiple descriptors are gathered to this
-     * one contiguous buffer first.
-     */
-    p = tx_packet;
-    total_bytes = 0;
+    /* Checksum offload and loopback need the frame in one buffer */
+    linear = (s->regs[GEM_DMACFG] & GEM_DMACFG_TXCSUM_OFFL) ||
+             s->phy_loop || (s->regs[GEM_NWCTRL] & GEM_NWCTRL_LOCALLOOP);
+    frame.iovcnt = 0;
+    gem_tx_frame_reset(&frame, linear);
+    dma_window_init(&w, &address_space_memory, true);
 
     for (q = s->num_priority_queues - 1; q >= 0; q--) {
         /* read current descriptor */
         packet_desc_addr = s->tx_desc_addr[q];
 
         DB_PRINT("read descriptor 0x%" HWADDR_PRIx "\n", packet_desc_addr);
-        cpu_physical_memory_read(packet_desc_addr,
-                                 (uint8_t *)desc, sizeof(desc));
+        gem_desc_read(&w, packet_desc_addr, desc);
         /* Handle all descriptors owned by hardware */
         while (tx_desc_get_used(desc) == 0) {
 
             /* Do nothing if transmit is not enabled. */
             if (!(s->regs[GEM_NWCTRL] & GEM_NWCTRL_TXENA)) {
-                return;
+                goto out;
             }
             print_gem_tx_desc(desc, q);
 
@@ -1089,37 +1190,29 @@ static void gem_transmit(CadenceGEMState *s)
                 break;
             }
 
-            if (tx_desc_get_length(desc) > sizeof(tx_packet) -
-                                               (p - tx_packet)) {
+            if (tx_desc_get_length(desc) > sizeof(frame.buf) - frame.len) {
                 DB_PRINT("TX descriptor @ 0x%x too large: size 0x%x space " \
                          "0x%x\n", (unsigned)packet_desc_addr,
                          (unsigned)tx_desc_get_length(desc),
-                         sizeof(tx_packet) - (p - tx_packet));
+                         sizeof(frame.buf) - frame.len);
                 break;
             }
 
-            /* Gather this fragment of the packet from "dma memory" to our
-             * contig buffer.
-             */
-            cpu_physical_memory_read(tx_desc_get_buffer(desc), p,
-                                     tx_desc_get_length(desc));
-            p += tx_desc_get_length(desc);
-            total_bytes += tx_desc_get_length(desc);
+            /* Add this fragment of the packet from "dma memory" */
+            gem_tx_frame_add(&frame, tx_desc_get_buffer(desc),
+                             tx_desc_get_length(desc));
 
             /* Last descriptor for this packet; hand the whole thing off */
             if (tx_desc_get_last(desc)) {
                 unsigned    desc_first[2];
+                uint8_t     header[6] = { 0 };
 
                 /* Modify the 1st descriptor of this packet to be owned by
                  * the processor.
                  */
-                cpu_physical_memory_read(s->tx_desc_addr[q],
-                                         (uint8_t *)desc_first,
-                                         sizeof(desc_first));
+                gem_desc_read(&w, s->tx_desc_addr[q], desc_first);
                 tx_desc_set_used(desc_first);
-                cpu_physical_memory_write(s->tx_desc_addr[q],
-                                          (uint8_t *)desc_first,
-                                          sizeof(desc_first));
+                gem_desc_write(&w, s->tx_desc_addr[q], desc_first);
                 /* Advance the hardware current descriptor past this packet */
                 if (tx_desc_get_wrap(desc)) {
                     s->tx_desc_addr[q] = s->regs[GEM_TXQBASE];
@@ -1142,25 +1235,33 @@ static void gem_transmit(CadenceGEMState *s)
 
                 /* Is checksum offload enabled? */
                 if (s->regs[GEM_DMACFG] & GEM_DMACFG_TXCSUM_OFFL) {
-                    net_checksum_calculate(tx_packet, total_bytes);
+                    net_checksum_calculate(frame.buf, frame.len);
                 }
 
                 /* Update MAC statistics */
-                gem_transmit_updatestats(s, tx_packet, total_bytes);
+                if (frame.linear) {
+                    memcpy(header, frame.buf, MIN(frame.len, sizeof(header)));
+                } else {
+                    iov_to_buf(frame.iov, frame.iovcnt, 0, header,
+                               sizeof(header));
+                }
+                gem_transmit_updatestats(s, header, frame.len);
 
                 /* Send the packet somewhere */
                 if (s->phy_loop || (s->regs[GEM_NWCTRL] &
                                     GEM_NWCTRL_LOCALLOOP)) {
-                    gem_receive(qemu_get_queue(s->nic), tx_packet,
-                                total_bytes);
+                    gem_receive(qemu_get_queue(s->nic), frame.buf,
+                                frame.len);
+                } else if (frame.linear) {
+                    qemu_send_packet(qemu_get_queue(s->nic), frame.buf,
+                                     frame.len);
                 } else {
-                    qemu_send_packet(qemu_get_queue(s->nic), tx_packet,
-                                     total_bytes);
+                    qemu_sendv_packet(qemu_get_queue(s->nic), frame.iov,
+                                      frame.iovcnt);
                 }
 
                 /* Prepare for next packet */
-                p = tx_packet;
-                total_bytes = 0;
+                gem_tx_frame_reset(&frame, linear);
             }
 
             /* read next descriptor */
@@ -1171,8 +1272,7 @@ static void gem_transmit(CadenceGEMState *s)
                 packet_desc_addr += 8;
             }
             DB_PRINT("read descriptor 0x%" HWADDR_PRIx "\n", packet_desc_addr);
-            cpu_physical_memory_read(packet_desc_addr,
-                                     (uint8_t *)desc, sizeof(desc));
+            gem_desc_read(&w, packet_desc_addr, desc);
         }
 
         if (tx_desc_get_used(desc)) {
@@ -1181,6 +1281,11 @@ static void gem_transmit(CadenceGEMState *s)
             gem_update_int_status(s);
         }
     }
+
+out:
+    /* A frame without its last descriptor is dropped, as before */
+    gem_tx_frame_unmap(&frame);
+    dma_window_destroy(&w);
 }
 
 static void gem_phy_reset(CadenceGEMState *s)
@@ -1356,7 +1461,7 @@ static void gem_write(void *opaque, hwaddr offset, uint64_t val,
     case GEM_NWCTRL:
         if (val & GEM_NWCTRL_RXENA) {
             for (i = 0; i < s->num_priority_queues; ++i) {
-                gem_get_rx_desc(s, i);
+                gem_get_rx_desc(s, NULL, i);
             }
         }
         if (val & GEM_NWCTRL_TXSTART) {
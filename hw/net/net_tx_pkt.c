@@ -496,17 +496,29 @@ enum {
     NET_TX_PKT_FRAGMENT_HEADER_NUM
 };
 
+enum {
+    NET_TX_PKT_SEGMENT_L2_HDR_POS = 0,
+    NET_TX_PKT_SEGMENT_L3_HDR_POS,
+    NET_TX_PKT_SEGMENT_L4_HDR_POS,
+    NET_TX_PKT_SEGMENT_HEADER_NUM
+};
+
 #define NET_MAX_FRAG_SG_LIST (64)
+#define NET_MAX_TCP_HDR_LEN  (60)
 
+/*
+ * Fill @dst starting at *@dst_idx with at most @max_len bytes of payload
+ * taken from the packet vector at *@src_idx / *@src_offset.  Nothing is
+ * copied: the destination entries point into the guest buffers.
+ */
 static size_t net_tx_pkt_fetch_fragment(struct NetTxPkt *pkt,
-    int *src_idx, size_t *src_offset, struct iovec *dst, int *dst_idx)
+    int *src_idx, size_t *src_offset, size_t max_len,
+    struct iovec *dst, int *dst_idx)
 {
     size_t fetched = 0;
     struct iovec *src = pkt->vec;
 
-    *dst_idx = NET_TX_PKT_FRAGMENT_HEADER_NUM;
-
-    while (fetched < IP_FRAG_ALIGN_SIZE(pkt->virt_hdr.gso_size)) {
+    while (fetched < max_len) {
 
         /* no more place in fragment iov */
         if (*dst_idx == NET_MAX_FRAG_SG_LIST) {
@@ -521,7 +533,7 @@ static size_t net_tx_pkt_fetch_fragment(struct NetTxPkt *pkt,
 
         dst[*dst_idx].iov_base = src[*src_idx].iov_base + *src_offset;
         dst[*dst_idx].iov_len = MIN(src[*src_idx].iov_len - *src_offset,
-            IP_FRAG_ALIGN_SIZE(pkt->virt_hdr.gso_size) - fetched);
+            max_len - fetched);
 
         *src_offset += dst[*dst_idx].iov_len;
         fetched += dst[*dst_idx].iov_len;
@@ -575,8 +587,9 @@ static bool net_tx_pkt_do_sw_fragmentation(struct NetTxPkt *pkt,
 
     /* Put as much data as possible and send */
     do {
+        dst_idx = NET_TX_PKT_FRAGMENT_HEADER_NUM;
         fragment_len = net_tx_pkt_fetch_fragment(pkt, &src_idx, &src_offset,
-            fragment, &dst_idx);
+            IP_FRAG_ALIGN_SIZE(pkt->virt_hdr.gso_size), fragment, &dst_idx);
 
         more_frags = (fragment_offset + fragment_len < pkt->payload_len);
 
@@ -594,12 +607,121 @@ static bool net_tx_pkt_do_sw_fragmentation(struct NetTxPkt *pkt,
     return true;
 }
 
+/*
+ * Split a TSO packet into MSS sized TCP segments.  The L2/L3 headers are
+ * patched in place and the TCP header lives in a scratch buffer, while
+ * the payload of every segment is referenced from the guest buffers.
+ */
+static bool net_tx_pkt_do_sw_tcp_segmentation(struct NetTxPkt *pkt,
+    NetClientState *nc)
+{
+    struct iovec segment[NET_MAX_FRAG_SG_LIST];
+    uint8_t l4_hdr_buf[NET_MAX_TCP_HDR_LEN];
+    struct tcp_header *l4hdr = (struct tcp_header *) l4_hdr_buf;
+    struct iovec *l3vec = &pkt->vec[NET_TX_PKT_L3HDR_FRAG];
+    bool is_ipv4 = (pkt->virt_hdr.gso_type & ~VIRTIO_NET_HDR_GSO_ECN) ==
+                   VIRTIO_NET_HDR_GSO_TCPV4;
+    size_t l4_hdr_len = pkt->virt_hdr.hdr_len - pkt->hdr_len;
+    size_t l4_payload_len, segment_len, segment_offset = 0;
+    uint16_t orig_flags, ip_id = 0;
+    uint32_t seq, csum_cntr, cso;
+    int src_idx = NET_TX_PKT_PL_START_FRAG, dst_idx;
+    size_t src_offset = l4_hdr_len;
+
+    if (l4_hdr_len < sizeof(*l4hdr) || l4_hdr_len > sizeof(l4_hdr_buf) ||
+        l4_hdr_len > pkt->payload_len || !pkt->virt_hdr.gso_size) {
+        return false;
+    }
+
+    iov_to_buf(&pkt->vec[NET_TX_PKT_PL_START_FRAG], pkt->payload_frags,
+               0, l4_hdr_buf, l4_hdr_len);
+    l4_payload_len = pkt->payload_len - l4_hdr_len;
+    seq = be32_to_cpu(l4hdr->th_seq);
+    orig_flags = be16_to_cpu(l4hdr->th_offset_flags);
+
+    if (is_ipv4) {
+        ip_id = be16_to_cpu(((struct ip_header *) l3vec->iov_base)->ip_id);
+    }
+
+    /* Skip the TCP header, it is sent from the scratch buffer instead */
+    while (src_idx < pkt->payload_frags + NET_TX_PKT_PL_START_FRAG &&
+           src_offset >= pkt->vec[src_idx].iov_len) {
+        src_offset -= pkt->vec[src_idx].iov_len;
+        src_idx++;
+    }
+
+    segment[NET_TX_PKT_SEGMENT_L2_HDR_POS] = pkt->vec[NET_TX_PKT_L2HDR_FRAG];
+    segment[NET_TX_PKT_SEGMENT_L3_HDR_POS] = *l3vec;
+    segment[NET_TX_PKT_SEGMENT_L4_HDR_POS].iov_base = l4_hdr_buf;
+    segment[NET_TX_PKT_SEGMENT_L4_HDR_POS].iov_len = l4_hdr_len;
+
+    do {
+        uint16_t flags = orig_flags;
+
+        dst_idx = NET_TX_PKT_SEGMENT_HEADER_NUM;
+        segment_len = net_tx_pkt_fetch_fragment(pkt, &src_idx, &src_offset,
+            pkt->virt_hdr.gso_size, segment, &dst_idx);
+
+        /* FIN and PSH belong to the last segment, CWR to the first one */
+        if (segment_offset + segment_len < l4_payload_len) {
+            flags &= ~(TCP_FLAG_FIN | TCP_FLAG_PSH);
+        }
+        if (segment_offset) {
+            flags &= ~TCP_FLAG_CWR;
+        }
+        l4hdr->th_offset_flags = cpu_to_be16(flags);
+        l4hdr->th_seq = cpu_to_be32(seq + segment_offset);
+        l4hdr->th_sum = 0;
+
+        if (is_ipv4) {
+            struct ip_header *iphdr = l3vec->iov_base;
+
+            iphdr->ip_len = cpu_to_be16(l3vec->iov_len + l4_hdr_len +
+                                        segment_len);
+            iphdr->ip_id = cpu_to_be16(ip_id++);
+            eth_fix_ip4_checksum(iphdr, l3vec->iov_len);
+            csum_cntr = eth_calc_ip4_pseudo_hdr_csum(iphdr,
+                l4_hdr_len + segment_len, &cso);
+        } else {
+            struct ip6_header *ip6hdr = l3vec->iov_base;
+
+            ip6hdr->ip6_ctlun.ip6_un1.ip6_un1_plen =
+                cpu_to_be16(l3vec->iov_len - sizeof(*ip6hdr) +
+                            l4_hdr_len + segment_len);
+            csum_cntr = eth_calc_ip6_pseudo_hdr_csum(ip6hdr,
+                l4_hdr_len + segment_len, IP_PROTO_TCP, &cso);
+        }
+
+        csum_cntr += net_checksum_add_iov(
+            &segment[NET_TX_PKT_SEGMENT_L4_HDR_POS],
+            dst_idx - NET_TX_PKT_SEGMENT_L4_HDR_POS,
+            0, l4_hdr_len + segment_len, cso);
+        l4hdr->th_sum = cpu_to_be16(net_checksum_finish(csum_cntr));
+
+        net_tx_pkt_sendv(pkt, nc, segment, dst_idx);
+
+        segment_offset += segment_len;
+    } while (segment_len && segment_offset < l4_payload_len);
+
+    return true;
+}
+
 bool net_tx_pkt_send(struct NetTxPkt *pkt, NetClientState *nc)
 {
+    uint8_t gso_type;
+
     assert(pkt);
 
+    gso_type = pkt->virt_hdr.gso_type & ~VIRTIO_NET_HDR_GSO_ECN;
+
+    /*
+     * TCP segmentation computes the checksum of every segment on its own,
+     * so there is no point in summing up the whole packet beforehand.
+     */
     if (!pkt->has_virt_hdr &&
-        pkt->virt_hdr.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) {
+        pkt->virt_hdr.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM &&
+        gso_type != VIRTIO_NET_HDR_GSO_TCPV4 &&
+        gso_type != VIRTIO_NET_HDR_GSO_TCPV6) {
         net_tx_pkt_do_sw_csum(pkt);
     }
 
@@ -622,6 +744,11 @@ bool net_tx_pkt_send(struct NetTxPkt *pkt, NetClientState *nc)
         return true;
     }
 
+    if (gso_type == VIRTIO_NET_HDR_GSO_TCPV4 ||
+        gso_type == VIRTIO_NET_HDR_GSO_TCPV6) {
+        return net_tx_pkt_do_sw_tcp_segmentation(pkt, nc);
+    }
+
     return net_tx_pkt_do_sw_fragmentation(pkt, nc);
 }
 
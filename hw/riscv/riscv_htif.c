@@ -22,6 +22,7 @@
 
 #include "qemu/osdep.h"
 #include "qapi/error.h"
+#include "qapi/visitor.h"
 #include "qemu/log.h"
 #include "hw/sysbus.h"
 #include "hw/char/serial.h"
@@ -30,6 +31,7 @@
 #include "hw/riscv/riscv_htif.h"
 #include "qemu/timer.h"
 #include "qemu/error-report.h"
+#include "exec/address-spaces.h"
 
 #define RISCV_DEBUG_HTIF 0
 #define HTIF_DEBUG(fmt, ...)                                                   \
@@ -45,6 +47,9 @@ static int address_symbol_set;
 void htif_symbol_callback(const char *st_name, int st_info, uint64_t st_value,
                           uint64_t st_size)
 {
+    if (address_symbol_set == 3) {
+        return;
+    }
     if (strcmp("fromhost", st_name) == 0) {
         address_symbol_set |= 1;
         fromhost_addr = st_value;
@@ -62,6 +67,52 @@ void htif_symbol_callback(const char *st_name, int st_info, uint64_t st_value,
     }
 }
 
+/*
+ * tohost/fromhost can also be given as machine properties, so that load_elf
+ * need not pass every symbol through htif_symbol_callback.
+ */
+static void htif_get_addr(Object *obj, Visitor *v, const char *name,
+                          void *opaque, Error **errp)
+{
+    visit_type_uint64(v, name, opaque, errp);
+}
+
+static void htif_set_addr(Object *obj, Visitor *v, const char *name,
+                          void *opaque, Error **errp)
+{
+    uint64_t *addr = opaque;
+    Error *local_err = NULL;
+    uint64_t value;
+
+    visit_type_uint64(v, name, &value, &local_err);
+    if (local_err) {
+        error_propagate(errp, local_err);
+        return;
+    }
+    *addr = value;
+    address_symbol_set |= addr == &fromhost_addr ? 1 : 2;
+}
+
+void htif_machine_class_add_props(MachineClass *mc)
+{
+    ObjectClass *oc = OBJECT_CLASS(mc);
+
+    object_class_property_add(oc, "htif-tohost", "uint64", htif_get_addr,
+                              htif_set_addr, NULL, &tohost_addr, &error_abort);
+    object_class_property_set_description(oc, "htif-tohost",
+        "Address of tohost, instead of the ELF symbol", &error_abort);
+    object_class_property_add(oc, "htif-fromhost", "uint64", htif_get_addr,
+                              htif_set_addr, NULL, &fromhost_addr,
+                              &error_abort);
+    object_class_property_set_description(oc, "htif-fromhost",
+        "Address of fromhost, instead of the ELF symbol", &error_abort);
+}
+
+bool htif_uses_elf_symbols(void)
+{
+    return address_symbol_set != 3;
+}
+
 /*
  * Called by the char dev to see if HTIF is ready to accept input.
  */
@@ -111,6 +162,182 @@ static int htif_be_change(void *opaque)
     return 0;
 }
 
+/*
+ * Proxy kernel frontend syscalls.  The payload points at magic memory
+ * holding the syscall number and arguments, the result replaces the
+ * syscall number.  Guest buffers are mapped and handed to the host
+ * read/write directly, so one exchange moves a whole buffer; guest fds
+ * 0-2 are the console.
+ */
+#define HTIF_SYS_OPENAT 56
+#define HTIF_SYS_CLOSE  57
+#define HTIF_SYS_READ   63
+#define HTIF_SYS_WRITE  64
+#define HTIF_SYS_EXIT   93
+
+/* newlib/Linux generic open flags used by the proxy kernel */
+#define HTIF_O_ACCMODE  03
+#define HTIF_O_CREAT    0100
+#define HTIF_O_EXCL     0200
+#define HTIF_O_TRUNC    01000
+#define HTIF_O_APPEND   02000
+#define HTIF_AT_FDCWD   -100
+
+static int htif_host_fd(HTIFState *s, uint64_t fd)
+{
+    return fd < HTIF_MAX_FDS ? s->fds[fd] : HTIF_FD_FREE;
+}
+
+static int64_t htif_sys_rw(HTIFState *s, uint64_t fd, hwaddr addr,
+                           uint64_t len, bool to_host)
+{
+    int host_fd = htif_host_fd(s, fd);
+    int64_t done = 0;
+
+    if (host_fd == HTIF_FD_FREE) {
+        return -EBADF;
+    }
+    if (host_fd == HTIF_FD_CONSOLE && !to_host) {
+        /* console input goes through the HTIF console device */
+        return 0;
+    }
+    while (len) {
+        hwaddr l = len;
+        void *buf = address_space_map(&address_space_memory, addr, &l,
+                                      !to_host, MEMTXATTRS_UNSPECIFIED);
+        ssize_t ret;
+        int err;
+
+        if (!buf) {
+            return done ? done : -EFAULT;
+        }
+        if (host_fd == HTIF_FD_CONSOLE) {
+            /* a short write lets the guest retry instead of stalling here */
+            ret = qemu_chr_fe_write(&s->chr, buf, l);
+            if (ret <= 0 && !done) {
+                ret = qemu_chr_fe_write_all(&s->chr, buf, l);
+            }
+        } else if (to_host) {
+            ret = write(host_fd, buf, l);
+        } else {
+            ret = read(host_fd, buf, l);
+        }
+        err = errno;
+        address_space_unmap(&address_space_memory, buf, l, !to_host,
+                            ret > 0 ? ret : 0);
+        if (ret < 0) {
+            return done ? done : -err;
+        }
+        done += ret;
+        addr += ret;
+        len -= ret;
+        if (ret < l) {
+            break;
+        }
+    }
+    return done;
+}
+
+static int64_t htif_sys_openat(HTIFState *s, uint64_t dirfd, hwaddr name,
+                               uint64_t len, uint64_t flags, uint64_t mode)
+{
+    char path[PATH_MAX];
+    int host_dirfd = AT_FDCWD;
+    int host_flags = 0;
+    int fd, host_fd;
+
+    if (len == 0 || len > sizeof(path)) {
+        return -ENAMETOOLONG;
+    }
+    if ((int64_t)dirfd != HTIF_AT_FDCWD) {
+        host_dirfd = htif_host_fd(s, dirfd);
+        if (host_dirfd < 0) {
+            return -EBADF;
+        }
+    }
+    for (fd = 0; fd < HTIF_MAX_FDS && s->fds[fd] != HTIF_FD_FREE; fd++) {
+    }
+    if (fd == HTIF_MAX_FDS) {
+        return -EMFILE;
+    }
+
+    address_space_read(&address_space_memory, name, MEMTXATTRS_UNSPECIFIED,
+                       (uint8_t *)path, len);
+    path[len - 1] = 0;
+
+    switch (flags & HTIF_O_ACCMODE) {
+    case 0:
+        host_flags = O_RDONLY;
+        break;
+    case 1:
+        host_flags = O_WRONLY;
+        break;
+    default:
+        host_flags = O_RDWR;
+        break;
+    }
+    host_flags |= flags & HTIF_O_CREAT ? O_CREAT : 0;
+    host_flags |= flags & HTIF_O_EXCL ? O_EXCL : 0;
+    host_flags |= flags & HTIF_O_TRUNC ? O_TRUNC : 0;
+    host_flags |= flags & HTIF_O_APPEND ? O_APPEND : 0;
+
+    host_fd = openat(host_dirfd, path, host_flags | O_CLOEXEC, (mode_t)mode);
+    if (host_fd < 0) {
+        return -errno;
+    }
+    s->fds[fd] = host_fd;
+    return fd;
+}
+
+static int64_t htif_sys_close(HTIFState *s, uint64_t fd)
+{
+    int host_fd = htif_host_fd(s, fd);
+
+    if (host_fd == HTIF_FD_FREE) {
+        return -EBADF;
+    }
+    if (host_fd != HTIF_FD_CONSOLE) {
+        close(host_fd);
+        s->fds[fd] = HTIF_FD_FREE;
+    }
+    return 0;
+}
+
+static void htif_handle_syscall(HTIFState *s, hwaddr magic)
+{
+    uint64_t args[8];
+    int64_t ret;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(args); i++) {
+        args[i] = ldq_le_phys(&address_space_memory, magic + i * 8);
+    }
+
+    switch (args[0]) {
+    case HTIF_SYS_WRITE:
+        ret = htif_sys_rw(s, args[1], args[2], args[3], true);
+        break;
+    case HTIF_SYS_READ:
+        ret = htif_sys_rw(s, args[1], args[2], args[3], false);
+        break;
+    case HTIF_SYS_OPENAT:
+        ret = htif_sys_openat(s, args[1], args[2], args[3], args[4], args[5]);
+        break;
+    case HTIF_SYS_CLOSE:
+        ret = htif_sys_close(s, args[1]);
+        break;
+    case HTIF_SYS_EXIT:
+        exit(args[1]);
+    default:
+        qemu_log_mask(LOG_UNIMP, "pk syscall %" PRIu64 " not supported\n",
+                      args[0]);
+        ret = -ENOSYS;
+        break;
+    }
+
+    stq_le_phys(&address_space_memory, magic, ret);
+}
+
 static void htif_handle_tohost_write(HTIFState *htifstate, uint64_t val_written)
 {
     uint8_t device = val_written >> 56;
@@ -123,7 +350,7 @@ static void htif_handle_tohost_write(HTIFState *htifstate, uint64_t val_written)
 
     /*
      * Currently, there is a fixed mapping of devices:
-     * 0: riscv-tests Pass/Fail Reporting Only (no syscall proxy)
+     * 0: Proxy kernel syscalls and riscv-tests Pass/Fail Reporting
      * 1: Console
      */
     if (unlikely(device == 0x0)) {
@@ -134,7 +361,8 @@ static void htif_handle_tohost_write(HTIFState *htifstate, uint64_t val_written)
                 int exit_code = payload >> 1;
                 exit(exit_code);
             } else {
-                qemu_log_mask(LOG_UNIMP, "pk syscall proxy not supported\n");
+                htif_handle_syscall(htifstate, payload);
+                resp = 1;
             }
         } else {
             qemu_log("HTIF device %d: unknown command\n", device);
@@ -236,6 +464,7 @@ HTIFState *htif_mm_init(MemoryRegion *address_space, MemoryRegion *main_mem,
     uint64_t size = MAX(tohost_addr + 8, fromhost_addr + 8) - base;
     uint64_t tohost_offset = tohost_addr - base;
     uint64_t fromhost_offset = fromhost_addr - base;
+    int i;
 
     HTIFState *s = g_malloc0(sizeof(HTIFState));
     s->address_space = address_space;
@@ -247,6 +476,9 @@ HTIFState *htif_mm_init(MemoryRegion *address_space, MemoryRegion *main_mem,
     s->pending_read = 0;
     s->allow_tohost = 0;
     s->fromhost_inprogress = 0;
+    for (i = 0; i < HTIF_MAX_FDS; i++) {
+        s->fds[i] = i <= 2 ? HTIF_FD_CONSOLE : HTIF_FD_FREE;
+    }
     qemu_chr_fe_init(&s->chr, chr, &error_abort);
     qemu_chr_fe_set_handlers(&s->chr, htif_can_recv, htif_recv, htif_event,
         htif_be_change, s, NULL, true);
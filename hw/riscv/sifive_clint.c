@@ -26,48 +26,152 @@
 #include "hw/riscv/sifive_clint.h"
 #include "qemu/timer.h"
 
+/* the timebase is a whole number of ns, so no muldiv64 is needed */
+#define SIFIVE_CLINT_TICK_NS \
+    (NANOSECONDS_PER_SECOND / SIFIVE_CLINT_TIMEBASE_FREQ)
+QEMU_BUILD_BUG_ON(NANOSECONDS_PER_SECOND % SIFIVE_CLINT_TIMEBASE_FREQ);
+
 static uint64_t cpu_riscv_read_rtc(void)
 {
-    return muldiv64(qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL),
-        SIFIVE_CLINT_TIMEBASE_FREQ, NANOSECONDS_PER_SECOND);
+    return qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) / SIFIVE_CLINT_TICK_NS;
+}
+
+/*
+ * Harts whose timecmp is in the future are kept in a binary min-heap
+ * ordered by timecmp, and the single CLINT timer is armed for the top.
+ */
+static uint64_t sifive_clint_heap_key(SiFiveCLINTState *s, uint32_t i)
+{
+    return s->harts[s->heap[i]]->env.timecmp;
+}
+
+static void sifive_clint_heap_swap(SiFiveCLINTState *s, uint32_t i,
+                                   uint32_t j)
+{
+    uint32_t hartid = s->heap[i];
+
+    s->heap[i] = s->heap[j];
+    s->heap[j] = hartid;
+    s->heap_pos[s->heap[i]] = i;
+    s->heap_pos[s->heap[j]] = j;
+}
+
+static void sifive_clint_heap_sift(SiFiveCLINTState *s, uint32_t i)
+{
+    while (i > 0) {
+        uint32_t parent = (i - 1) / 2;
+
+        if (sifive_clint_heap_key(s, parent) <= sifive_clint_heap_key(s, i)) {
+            break;
+        }
+        sifive_clint_heap_swap(s, i, parent);
+        i = parent;
+    }
+    for (;;) {
+        uint32_t min = i, l = 2 * i + 1, r = 2 * i + 2;
+
+        if (l < s->heap_len &&
+            sifive_clint_heap_key(s, l) < sifive_clint_heap_key(s, min)) {
+            min = l;
+        }
+        if (r < s->heap_len &&
+            sifive_clint_heap_key(s, r) < sifive_clint_heap_key(s, min)) {
+            min = r;
+        }
+        if (min == i) {
+            break;
+        }
+        sifive_clint_heap_swap(s, i, min);
+        i = min;
+    }
+}
+
+static void sifive_clint_heap_remove(SiFiveCLINTState *s, uint32_t hartid)
+{
+    uint32_t i = s->heap_pos[hartid];
+
+    if (i == SIFIVE_CLINT_NOT_QUEUED) {
+        return;
+    }
+    s->heap_len--;
+    if (i != s->heap_len) {
+        sifive_clint_heap_swap(s, i, s->heap_len);
+        sifive_clint_heap_sift(s, i);
+    }
+    s->heap_pos[hartid] = SIFIVE_CLINT_NOT_QUEUED;
+}
+
+static void sifive_clint_heap_update(SiFiveCLINTState *s, uint32_t hartid)
+{
+    uint32_t i = s->heap_pos[hartid];
+
+    if (i == SIFIVE_CLINT_NOT_QUEUED) {
+        i = s->heap_len++;
+        s->heap[i] = hartid;
+        s->heap_pos[hartid] = i;
+    }
+    sifive_clint_heap_sift(s, i);
+}
+
+/* arm the timer for the earliest timecmp, if one is representable */
+static void sifive_clint_rearm(SiFiveCLINTState *s)
+{
+    uint64_t timecmp;
+
+    if (!s->heap_len) {
+        timer_del(s->timer);
+        s->armed = SIFIVE_CLINT_NOT_ARMED;
+        return;
+    }
+    timecmp = sifive_clint_heap_key(s, 0);
+    if (timecmp > INT64_MAX / SIFIVE_CLINT_TICK_NS) {
+        timer_del(s->timer);
+    } else if (timecmp != s->armed) {
+        timer_mod(s->timer, timecmp * SIFIVE_CLINT_TICK_NS);
+    }
+    s->armed = timecmp;
 }
 
 /*
  * Called when timecmp is written to update the QEMU timer or immediately
  * trigger timer interrupt if mtimecmp <= current timer value.
  */
-static void sifive_clint_write_timecmp(RISCVCPU *cpu, uint64_t value)
+static void sifive_clint_write_timecmp(SiFiveCLINTState *s, uint32_t hartid,
+                                       uint64_t value)
 {
-    uint64_t next;
-    uint64_t diff;
-
-    uint64_t rtc_r = cpu_riscv_read_rtc();
+    RISCVCPU *cpu = s->harts[hartid];
 
     cpu->env.timecmp = value;
-    if (cpu->env.timecmp <= rtc_r) {
+    if (cpu->env.timecmp <= cpu_riscv_read_rtc()) {
         /* if we're setting an MTIMECMP value in the "past",
            immediately raise the timer interrupt */
+        sifive_clint_heap_remove(s, hartid);
         riscv_set_local_interrupt(cpu, MIP_MTIP, 1);
-        return;
+    } else {
+        /* otherwise, set up the future timer interrupt */
+        riscv_set_local_interrupt(cpu, MIP_MTIP, 0);
+        sifive_clint_heap_update(s, hartid);
     }
-
-    /* otherwise, set up the future timer interrupt */
-    riscv_set_local_interrupt(cpu, MIP_MTIP, 0);
-    diff = cpu->env.timecmp - rtc_r;
-    /* back to ns (note args switched in muldiv64) */
-    next = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
-        muldiv64(diff, NANOSECONDS_PER_SECOND, SIFIVE_CLINT_TIMEBASE_FREQ);
-    timer_mod(cpu->env.timer, next);
+    sifive_clint_rearm(s);
 }
 
 /*
  * Callback used when the timer set using timer_mod expires.
- * Should raise the timer interrupt line
+ * Raises the timer interrupt line of every hart that is due.
  */
 static void sifive_clint_timer_cb(void *opaque)
 {
-    RISCVCPU *cpu = opaque;
-    riscv_set_local_interrupt(cpu, MIP_MTIP, 1);
+    SiFiveCLINTState *s = opaque;
+    uint64_t rtc_r = cpu_riscv_read_rtc();
+
+    s->armed = SIFIVE_CLINT_NOT_ARMED;
+    while (s->heap_len && sifive_clint_heap_key(s, 0) <= rtc_r) {
+        uint32_t hartid = s->heap[0];
+
+        sifive_clint_heap_remove(s, hartid);
+        riscv_set_local_interrupt(s->harts[hartid], MIP_MTIP, 1);
+    }
+    sifive_clint_rearm(s);
 }
 
 /* CPU wants to read rtc or timecmp register */
@@ -90,8 +194,8 @@ static uint64_t sifive_clint_read(void *opaque, hwaddr addr, unsigned size)
     } else if (addr >= clint->timecmp_base &&
         addr < clint->timecmp_base + (clint->num_harts << 3)) {
         size_t hartid = (addr - clint->timecmp_base) >> 3;
-        CPUState *cpu = qemu_get_cpu(hartid);
-        CPURISCVState *env = cpu ? cpu->env_ptr : NULL;
+        CPURISCVState *env = clint->harts[hartid] ?
+                             &clint->harts[hartid]->env : NULL;
         if (!env) {
             error_report("clint: invalid timecmp hartid: %zu", hartid);
         } else if ((addr & 0x7) == 0) {
@@ -140,20 +244,20 @@ static void sifive_clint_write(void *opaque, hwaddr addr, uint64_t value,
     } else if (addr >= clint->timecmp_base &&
         addr < clint->timecmp_base + (clint->num_harts << 3)) {
         size_t hartid = (addr - clint->timecmp_base) >> 3;
-        CPUState *cpu = qemu_get_cpu(hartid);
-        CPURISCVState *env = cpu ? cpu->env_ptr : NULL;
+        CPURISCVState *env = clint->harts[hartid] ?
+                             &clint->harts[hartid]->env : NULL;
         if (!env) {
             error_report("clint: invalid timecmp hartid: %zu", hartid);
         } else if ((addr & 0x7) == 0) {
             /* timecmp_lo */
             uint64_t timecmp = env->timecmp;
-            sifive_clint_write_timecmp(RISCV_CPU(cpu),
+            sifive_clint_write_timecmp(clint, hartid,
                 timecmp << 32 | (value & 0xFFFFFFFF));
             return;
         } else if ((addr & 0x7) == 4) {
             /* timecmp_hi */
             uint64_t timecmp = env->timecmp;
-            sifive_clint_write_timecmp(RISCV_CPU(cpu),
+            sifive_clint_write_timecmp(clint, hartid,
                 value << 32 | (timecmp & 0xFFFFFFFF));
         } else {
             error_report("clint: invalid timecmp write: %08x", (uint32_t)addr);
@@ -182,6 +286,25 @@ static const MemoryRegionOps sifive_clint_ops = {
     }
 };
 
+/*
+ * mtime only depends on the virtual clock, so vCPUs polling it can read it
+ * without the global lock.
+ */
+static uint64_t sifive_clint_time_read(void *opaque, hwaddr addr,
+                                       unsigned size)
+{
+    SiFiveCLINTState *clint = opaque;
+
+    return (cpu_riscv_read_rtc() >> ((addr - clint->time_base) << 3)) &
+           0xFFFFFFFF;
+}
+
+static const MemoryRegionFastOps sifive_clint_time_ops = {
+    .read = sifive_clint_time_read,
+    .min_access_size = 4,
+    .max_access_size = 4
+};
+
 static Property sifive_clint_properties[] = {
     DEFINE_PROP_UINT32("num-harts", SiFiveCLINTState, num_harts, 0),
     DEFINE_PROP_UINT32("sip-base", SiFiveCLINTState, sip_base, 0),
@@ -194,9 +317,28 @@ static Property sifive_clint_properties[] = {
 static void sifive_clint_realize(DeviceState *dev, Error **errp)
 {
     SiFiveCLINTState *s = SIFIVE_CLINT(dev);
+    int i;
+
     memory_region_init_io(&s->mmio, OBJECT(dev), &sifive_clint_ops, s,
                           TYPE_SIFIVE_CLINT, s->aperture_size);
+    memory_region_set_fast_ops(&s->mmio, s->time_base, 8,
+                               &sifive_clint_time_ops);
     sysbus_init_mmio(SYS_BUS_DEVICE(dev), &s->mmio);
+
+    s->harts = g_new0(RISCVCPU *, s->num_harts);
+    s->heap = g_new(uint32_t, s->num_harts);
+    s->heap_pos = g_new(uint32_t, s->num_harts);
+    for (i = 0; i < s->num_harts; i++) {
+        CPUState *cpu = qemu_get_cpu(i);
+        if (cpu) {
+            s->harts[i] = RISCV_CPU(cpu);
+            s->harts[i]->env.timecmp = 0;
+            s->harts[i]->env.rdtime_fn = cpu_riscv_read_rtc;
+        }
+        s->heap_pos[i] = SIFIVE_CLINT_NOT_QUEUED;
+    }
+    s->armed = SIFIVE_CLINT_NOT_ARMED;
+    s->timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, &sifive_clint_timer_cb, s);
 }
 
 static void sifive_clint_class_init(ObjectClass *klass, void *data)
@@ -227,18 +369,6 @@ type_init(sifive_clint_register_types)
 DeviceState *sifive_clint_create(hwaddr addr, hwaddr size, uint32_t num_harts,
     uint32_t sip_base, uint32_t timecmp_base, uint32_t time_base)
 {
-    int i;
-    for (i = 0; i < num_harts; i++) {
-        CPUState *cpu = qemu_get_cpu(i);
-        CPURISCVState *env = cpu ? cpu->env_ptr : NULL;
-        if (!env) {
-            continue;
-        }
-        env->timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
-                                  &sifive_clint_timer_cb, cpu);
-        env->timecmp = 0;
-    }
-
     DeviceState *dev = qdev_create(NULL, TYPE_SIFIVE_CLINT);
     qdev_prop_set_uint32(dev, "num-harts", num_harts);
     qdev_prop_set_uint32(dev, "sip-base", sip_base);
@@ -21,6 +21,7 @@
 #include "qemu/osdep.h"
 #include "qemu/log.h"
 #include "qemu/error-report.h"
+#include "qemu/bitops.h"
 #include "hw/sysbus.h"
 #include "target/riscv/cpu.h"
 #include "hw/riscv/sifive_plic.h"
@@ -81,6 +82,70 @@ static void sifive_plic_print_state(SiFivePLICState *plic)
     }
 }
 
+/*
+ * For each context and priority level, plic->ready is the bitmap of the
+ * sources that are pending, enabled and not claimed.  The bitmaps are
+ * updated incrementally when one of those inputs changes, so finding the
+ * interrupts deliverable to a context does not rescan every source.
+ */
+static unsigned long *sifive_plic_ready(SiFivePLICState *plic,
+                                        uint32_t addrid, uint32_t prio)
+{
+    return plic->ready +
+        (addrid * SIFIVE_PLIC_PRIORITY_LEVELS + prio) * plic->ready_longs;
+}
+
+static bool sifive_plic_active(SiFivePLICState *plic, int irq)
+{
+    uint32_t word = irq >> 5;
+    return (plic->pending[word] & ~plic->claimed[word]) & (1 << (irq & 31));
+}
+
+static bool sifive_plic_enabled(SiFivePLICState *plic, uint32_t addrid,
+                                int irq)
+{
+    uint32_t word = irq >> 5;
+    return plic->enable[addrid * plic->bitfield_words + word] &
+           (1 << (irq & 31));
+}
+
+/* plic->lock must be held */
+static void sifive_plic_set_ready(SiFivePLICState *plic, uint32_t addrid,
+                                  int irq, bool ready)
+{
+    uint32_t prio = plic->source_priority[irq];
+    unsigned long *map = sifive_plic_ready(plic, addrid, prio);
+    uint32_t *count =
+        &plic->ready_count[addrid * SIFIVE_PLIC_PRIORITY_LEVELS + prio];
+
+    if (ready == test_bit(irq, map)) {
+        return;
+    }
+    if (ready) {
+        set_bit(irq, map);
+        if ((*count)++ == 0) {
+            plic->ready_prios[addrid] |= 1 << prio;
+        }
+    } else {
+        clear_bit(irq, map);
+        if (--(*count) == 0) {
+            plic->ready_prios[addrid] &= ~(1 << prio);
+        }
+    }
+}
+
+/* plic->lock must be held */
+static void sifive_plic_update_source(SiFivePLICState *plic, int irq)
+{
+    bool active = sifive_plic_active(plic, irq);
+    uint32_t addrid;
+
+    for (addrid = 0; addrid < plic->num_addrs; addrid++) {
+        sifive_plic_set_ready(plic, addrid, irq,
+                              active && sifive_plic_enabled(plic, addrid, irq));
+    }
+}
+
 static
 void sifive_plic_set_pending(SiFivePLICState *plic, int irq, bool pending)
 {
@@ -91,6 +156,7 @@ void sifive_plic_set_pending(SiFivePLICState *plic, int irq, bool pending)
     } else {
         plic->pending[word] &= ~(1 << (irq & 31));
     }
+    sifive_plic_update_source(plic, irq);
     qemu_mutex_unlock(&plic->lock);
 }
 
@@ -104,30 +170,55 @@ void sifive_plic_set_claimed(SiFivePLICState *plic, int irq, bool claimed)
     } else {
         plic->claimed[word] &= ~(1 << (irq & 31));
     }
+    sifive_plic_update_source(plic, irq);
     qemu_mutex_unlock(&plic->lock);
 }
 
-static
-int sifive_plic_num_irqs_pending(SiFivePLICState *plic, uint32_t addrid)
+static void sifive_plic_set_priority(SiFivePLICState *plic, int irq,
+                                     uint32_t prio)
 {
-    int i, j, count = 0;
-    for (i = 0; i < plic->bitfield_words; i++) {
-        uint32_t pending_enabled_not_claimed =
-            (plic->pending[i] & ~plic->claimed[i]) &
-            plic->enable[addrid * plic->bitfield_words + i];
-        if (!pending_enabled_not_claimed) {
-            continue;
-        }
-        for (j = 0; j < 32; j++) {
-            int irq = (i << 5) + j;
-            uint32_t prio = plic->source_priority[irq];
-            int enabled = pending_enabled_not_claimed & (1 << j);
-            if (enabled && prio > plic->target_priority[addrid]) {
-                count++;
-            }
+    uint32_t addrid;
+
+    qemu_mutex_lock(&plic->lock);
+    for (addrid = 0; addrid < plic->num_addrs; addrid++) {
+        sifive_plic_set_ready(plic, addrid, irq, false);
+    }
+    plic->source_priority[irq] = prio;
+    sifive_plic_update_source(plic, irq);
+    qemu_mutex_unlock(&plic->lock);
+}
+
+static void sifive_plic_set_enable(SiFivePLICState *plic, uint32_t addrid,
+                                   uint32_t wordid, uint32_t value)
+{
+    uint32_t *enable = &plic->enable[addrid * plic->bitfield_words + wordid];
+    uint32_t changed;
+
+    qemu_mutex_lock(&plic->lock);
+    changed = *enable ^ value;
+    *enable = value;
+    while (changed) {
+        int irq = (wordid << 5) + ctz32(changed);
+        changed &= changed - 1;
+        if (irq < plic->num_sources) {
+            sifive_plic_set_ready(plic, addrid, irq,
+                                  sifive_plic_active(plic, irq) &&
+                                  sifive_plic_enabled(plic, addrid, irq));
         }
     }
-    return count;
+    qemu_mutex_unlock(&plic->lock);
+}
+
+/* levels above the context threshold with a ready source */
+static uint32_t sifive_plic_ready_above(SiFivePLICState *plic,
+                                        uint32_t addrid)
+{
+    uint32_t threshold = plic->target_priority[addrid];
+
+    if (threshold >= SIFIVE_PLIC_PRIORITY_LEVELS - 1) {
+        return 0;
+    }
+    return plic->ready_prios[addrid] & (-2u << threshold);
 }
 
 static void sifive_plic_update(SiFivePLICState *plic)
@@ -136,6 +227,12 @@ static void sifive_plic_update(SiFivePLICState *plic)
 
     /* raise irq on harts where this irq is enabled */
     for (addrid = 0; addrid < plic->num_addrs; addrid++) {
+        bool level = sifive_plic_ready_above(plic, addrid) != 0;
+        if (level == plic->context_level[addrid]) {
+            continue;
+        }
+        plic->context_level[addrid] = level;
+
         uint32_t hartid = plic->addr_config[addrid].hartid;
         PLICMode mode = plic->addr_config[addrid].mode;
         CPUState *cpu = qemu_get_cpu(hartid);
@@ -143,7 +240,6 @@ static void sifive_plic_update(SiFivePLICState *plic)
         if (!env) {
             continue;
         }
-        int level = sifive_plic_num_irqs_pending(plic, addrid) > 0;
         switch (mode) {
         case PLICMode_M:
             riscv_set_local_interrupt(RISCV_CPU(cpu), MIP_MEIP, level);
@@ -175,26 +271,26 @@ void sifive_plic_lower_irq(SiFivePLICState *plic, uint32_t irq)
 
 static uint32_t sifive_plic_claim(SiFivePLICState *plic, uint32_t addrid)
 {
-    int i, j;
-    for (i = 0; i < plic->bitfield_words; i++) {
-        uint32_t pending_enabled_not_claimed =
-            (plic->pending[i] & ~plic->claimed[i]) &
-            plic->enable[addrid * plic->bitfield_words + i];
-        if (!pending_enabled_not_claimed) {
-            continue;
-        }
-        for (j = 0; j < 32; j++) {
-            int irq = (i << 5) + j;
-            uint32_t prio = plic->source_priority[irq];
-            int enabled = pending_enabled_not_claimed & (1 << j);
-            if (enabled && prio > plic->target_priority[addrid]) {
-                sifive_plic_set_pending(plic, irq, false);
-                sifive_plic_set_claimed(plic, irq, true);
-                return irq;
-            }
-        }
+    uint32_t levels, prio, irq = 0;
+
+    qemu_mutex_lock(&plic->lock);
+    levels = sifive_plic_ready_above(plic, addrid);
+    if (levels) {
+        /* highest priority first, ties go to the lowest source id */
+        prio = 31 - clz32(levels);
+        irq = find_first_bit(sifive_plic_ready(plic, addrid, prio),
+                             plic->num_sources);
+        plic->pending[irq >> 5] &= ~(1 << (irq & 31));
+        plic->claimed[irq >> 5] |= 1 << (irq & 31);
+        sifive_plic_update_source(plic, irq);
     }
-    return 0;
+    qemu_mutex_unlock(&plic->lock);
+
+    if (irq) {
+        /* drop the line if nothing else is ready for the context */
+        sifive_plic_update(plic);
+    }
+    return irq;
 }
 
 static uint64_t sifive_plic_read(void *opaque, hwaddr addr, unsigned size)
@@ -283,7 +379,9 @@ static void sifive_plic_write(void *opaque, hwaddr addr, uint64_t value,
         addr < plic->priority_base + (plic->num_sources << 2))
     {
         uint32_t irq = (addr - plic->priority_base) >> 2;
-        plic->source_priority[irq] = value & 7;
+        sifive_plic_set_priority(plic, irq,
+                                 value & (SIFIVE_PLIC_PRIORITY_LEVELS - 1));
+        sifive_plic_update(plic);
         if (RISCV_DEBUG_PLIC) {
             qemu_log("plic: write priority: irq=%d priority=%d\n",
                 irq, plic->source_priority[irq]);
@@ -300,7 +398,8 @@ static void sifive_plic_write(void *opaque, hwaddr addr, uint64_t value,
         uint32_t addrid = (addr - plic->enable_base) / plic->enable_stride;
         uint32_t wordid = (addr & (plic->enable_stride - 1)) >> 2;
         if (wordid < plic->bitfield_words) {
-            plic->enable[addrid * plic->bitfield_words + wordid] = value;
+            sifive_plic_set_enable(plic, addrid, wordid, value);
+            sifive_plic_update(plic);
             if (RISCV_DEBUG_PLIC) {
                 qemu_log("plic: write enable: hart%d-%c word=%d value=%x\n",
                     plic->addr_config[addrid].hartid,
@@ -442,10 +541,17 @@ static void sifive_plic_realize(DeviceState *dev, Error **errp)
     qemu_mutex_init(&plic->lock);
     plic->bitfield_words = (plic->num_sources + 31) >> 5;
     plic->source_priority = g_new0(uint32_t, plic->num_sources);
-    plic->target_priority = g_new(uint32_t, plic->num_addrs);
+    plic->target_priority = g_new0(uint32_t, plic->num_addrs);
     plic->pending = g_new0(uint32_t, plic->bitfield_words);
     plic->claimed = g_new0(uint32_t, plic->bitfield_words);
     plic->enable = g_new0(uint32_t, plic->bitfield_words * plic->num_addrs);
+    plic->ready_longs = BITS_TO_LONGS(plic->num_sources);
+    plic->ready = g_new0(unsigned long, plic->ready_longs *
+                         SIFIVE_PLIC_PRIORITY_LEVELS * plic->num_addrs);
+    plic->ready_count = g_new0(uint32_t, SIFIVE_PLIC_PRIORITY_LEVELS *
+                                         plic->num_addrs);
+    plic->ready_prios = g_new0(uint32_t, plic->num_addrs);
+    plic->context_level = g_new0(bool, plic->num_addrs);
     sysbus_init_mmio(SYS_BUS_DEVICE(dev), &plic->mmio);
     qdev_init_gpio_in(dev, sifive_plic_irq_request, plic->num_sources);
 }
@@ -78,6 +78,23 @@ static uint64_t load_kernel(const char *kernel_filename)
     return kernel_entry;
 }
 
+static void *load_fdt(const char *dtb_filename, int *sizep,
+                      const char *cmdline)
+{
+    char *filename = qemu_find_file(QEMU_FILE_TYPE_BIOS, dtb_filename);
+    void *fdt = filename ? load_device_tree(filename, sizep) : NULL;
+
+    if (!fdt) {
+        error_report("qemu: could not load dtb '%s'", dtb_filename);
+        exit(1);
+    }
+    g_free(filename);
+
+    /* The blob was dumped from this board, so it already has /chosen */
+    qemu_fdt_setprop_string(fdt, "/chosen", "bootargs", cmdline);
+    return fdt;
+}
+
 static void create_fdt(SiFiveUState *s, const struct MemmapEntry *memmap,
     uint64_t mem_size, const char *cmdline)
 {
@@ -256,8 +273,13 @@ static void riscv_sifive_u_init(MachineState *machine)
     memory_region_add_subregion(system_memory, memmap[SIFIVE_U_DRAM].base,
                                 main_mem);
 
-    /* create device tree */
-    create_fdt(s, memmap, machine->ram_size, machine->kernel_cmdline);
+    /* create device tree, or reuse one saved with -machine dumpdtb */
+    if (machine->dtb) {
+        s->fdt = load_fdt(machine->dtb, &s->fdt_size,
+                          machine->kernel_cmdline);
+    } else {
+        create_fdt(s, memmap, machine->ram_size, machine->kernel_cmdline);
+    }
 
     if (machine->kernel_filename) {
         load_kernel(machine->kernel_filename);
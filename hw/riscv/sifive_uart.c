@@ -21,30 +21,85 @@
 #include "hw/sysbus.h"
 #include "chardev/char.h"
 #include "chardev/char-fe.h"
+#include "qemu/main-loop.h"
 #include "target/riscv/cpu.h"
 #include "hw/riscv/sifive_uart.h"
 
 /*
- * Not yet implemented:
- *
- * Transmit FIFO using "qemu/fifo8.h"
- * SIFIVE_UART_IE_TXWM interrupts
- * SIFIVE_UART_IE_RXWM interrupts must honor fifo watermark
- * Rx FIFO watermark interrupt trigger threshold
- * Tx FIFO watermark interrupt trigger threshold.
+ * The transmit FIFO drains instantly as far as the guest can see, so it
+ * is always below a non-zero watermark.  Transmitted bytes are collected
+ * in tx_buf and written to the chardev in one go from a bottom half, or
+ * when tx_buf fills up.  If the chardev pushes back, the FIFO reads as
+ * full and the watermark interrupt drops until the chardev drains, so
+ * the guest waits instead of the vCPU blocking in the chardev.
  */
 
+static bool uart_tx_full(SiFiveUARTState *s)
+{
+    return s->tx_buf_len == sizeof(s->tx_buf) || s->tx_watch;
+}
+
+static uint32_t uart_ip(SiFiveUARTState *s)
+{
+    uint32_t ip = 0;
+
+    if (SIFIVE_UART_TXCNT(s->txctrl) > 0 && !uart_tx_full(s)) {
+        ip |= SIFIVE_UART_IP_TXWM;
+    }
+    if (s->rx_fifo_len > SIFIVE_UART_RXCNT(s->rxctrl)) {
+        ip |= SIFIVE_UART_IP_RXWM;
+    }
+    return ip;
+}
+
+/* only touch the line when a watermark crossing changes its level */
 static void update_irq(SiFiveUARTState *s)
 {
-    int cond = 0;
-    if ((s->ie & SIFIVE_UART_IE_RXWM) && s->rx_fifo_len) {
-        cond = 1;
+    bool level = (s->ie & uart_ip(s)) != 0;
+
+    if (level != s->irq_level) {
+        s->irq_level = level;
+        qemu_set_irq(s->irq, level);
+    }
+}
+
+static void uart_flush_tx(void *opaque);
+
+static gboolean uart_tx_writable(GIOChannel *chan, GIOCondition cond,
+                                 void *opaque)
+{
+    SiFiveUARTState *s = opaque;
+
+    s->tx_watch = 0;
+    uart_flush_tx(s);
+    return FALSE;
+}
+
+static void uart_flush_tx(void *opaque)
+{
+    SiFiveUARTState *s = opaque;
+    int ret = 0;
+
+    if (!s->tx_buf_len || s->tx_watch) {
+        return;
     }
-    if (cond) {
-        qemu_irq_raise(s->irq);
-    } else {
-        qemu_irq_lower(s->irq);
+    if (!qemu_chr_fe_write_blocked(&s->chr)) {
+        ret = qemu_chr_fe_write(&s->chr, s->tx_buf, s->tx_buf_len);
+        if (ret < 0) {
+            /* a broken backend loses the data, as write_all would */
+            ret = errno == EAGAIN ? 0 : s->tx_buf_len;
+        }
+    }
+    s->tx_buf_len -= ret;
+    memmove(s->tx_buf, s->tx_buf + ret, s->tx_buf_len);
+    if (s->tx_buf_len) {
+        s->tx_watch = qemu_chr_fe_add_watch(&s->chr, G_IO_OUT | G_IO_HUP,
+                                            uart_tx_writable, s);
+        if (!s->tx_watch) {
+            s->tx_buf_len = 0;
+        }
     }
+    update_irq(s);
 }
 
 static uint64_t
@@ -65,11 +120,11 @@ uart_read(void *opaque, hwaddr addr, unsigned int size)
         return 0x80000000;
 
     case SIFIVE_UART_TXFIFO:
-        return 0; /* Should check tx fifo */
+        return uart_tx_full(s) ? 0x80000000 : 0;
     case SIFIVE_UART_IE:
         return s->ie;
     case SIFIVE_UART_IP:
-        return s->rx_fifo_len ? SIFIVE_UART_IP_RXWM : 0;
+        return uart_ip(s);
     case SIFIVE_UART_TXCTRL:
         return s->txctrl;
     case SIFIVE_UART_RXCTRL:
@@ -93,7 +148,17 @@ uart_write(void *opaque, hwaddr addr,
 
     switch (addr) {
     case SIFIVE_UART_TXFIFO:
-        qemu_chr_fe_write(&s->chr, &ch, 1);
+        if (s->tx_buf_len == sizeof(s->tx_buf)) {
+            /* the guest did not check txdata.full; don't drop the data */
+            qemu_chr_fe_write_all(&s->chr, s->tx_buf, s->tx_buf_len);
+            s->tx_buf_len = 0;
+        }
+        s->tx_buf[s->tx_buf_len++] = ch;
+        if (s->tx_buf_len == sizeof(s->tx_buf)) {
+            uart_flush_tx(s);
+        } else {
+            qemu_bh_schedule(s->tx_bh);
+        }
         return;
     case SIFIVE_UART_IE:
         s->ie = val64;
@@ -101,9 +166,11 @@ uart_write(void *opaque, hwaddr addr,
         return;
     case SIFIVE_UART_TXCTRL:
         s->txctrl = val64;
+        update_irq(s);
         return;
     case SIFIVE_UART_RXCTRL:
         s->rxctrl = val64;
+        update_irq(s);
         return;
     case SIFIVE_UART_DIV:
         s->div = val64;
@@ -166,6 +233,7 @@ SiFiveUARTState *sifive_uart_create(MemoryRegion *address_space, hwaddr base,
 {
     SiFiveUARTState *s = g_malloc0(sizeof(SiFiveUARTState));
     s->irq = irq;
+    s->tx_bh = qemu_bh_new(uart_flush_tx, s);
     qemu_chr_fe_init(&s->chr, chr, &error_abort);
     qemu_chr_fe_set_handlers(&s->chr, uart_can_rx, uart_rx, uart_event,
         uart_be_change, s, NULL, true);
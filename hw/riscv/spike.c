@@ -59,7 +59,8 @@ static uint64_t load_kernel(const char *kernel_filename)
 
     if (load_elf_ram_sym(kernel_filename, NULL, NULL,
             &kernel_entry, NULL, &kernel_high, 0, EM_RISCV, 1, 0,
-            NULL, true, htif_symbol_callback) < 0) {
+            NULL, true,
+            htif_uses_elf_symbols() ? htif_symbol_callback : NULL) < 0) {
         error_report("qemu: could not load kernel '%s'", kernel_filename);
         exit(1);
     }
@@ -73,6 +74,7 @@ static void create_fdt(SpikeState *s, const struct MemmapEntry *memmap,
     int cpu;
     uint32_t *cells;
     char *nodename;
+    uint32_t phandle = 1;
 
     fdt = s->fdt = create_device_tree(&s->fdt_size);
     if (!fdt) {
@@ -113,6 +115,7 @@ static void create_fdt(SpikeState *s, const struct MemmapEntry *memmap,
         nodename = g_strdup_printf("/cpus/cpu@%d", cpu);
         char *intc = g_strdup_printf("/cpus/cpu@%d/interrupt-controller", cpu);
         char *isa = riscv_isa_string(&s->soc.harts[cpu]);
+        int cpu_phandle = phandle++;
         qemu_fdt_add_subnode(fdt, nodename);
         qemu_fdt_setprop_cell(fdt, nodename, "clock-frequency",
                               SPIKE_CLOCK_FREQ);
@@ -123,8 +126,8 @@ static void create_fdt(SpikeState *s, const struct MemmapEntry *memmap,
         qemu_fdt_setprop_cell(fdt, nodename, "reg", cpu);
         qemu_fdt_setprop_string(fdt, nodename, "device_type", "cpu");
         qemu_fdt_add_subnode(fdt, intc);
-        qemu_fdt_setprop_cell(fdt, intc, "phandle", 1);
-        qemu_fdt_setprop_cell(fdt, intc, "linux,phandle", 1);
+        qemu_fdt_setprop_cell(fdt, intc, "phandle", cpu_phandle);
+        qemu_fdt_setprop_cell(fdt, intc, "linux,phandle", cpu_phandle);
         qemu_fdt_setprop_string(fdt, intc, "compatible", "riscv,cpu-intc");
         qemu_fdt_setprop(fdt, intc, "interrupt-controller", NULL, 0);
         qemu_fdt_setprop_cell(fdt, intc, "#interrupt-cells", 1);
@@ -350,14 +353,16 @@ static void spike_v1_09_1_machine_init(MachineClass *mc)
     mc->desc = "RISC-V Spike Board (Privileged ISA v1.9.1)";
     mc->init = spike_v1_09_1_board_init;
     mc->max_cpus = 1;
+    htif_machine_class_add_props(mc);
 }
 
 static void spike_v1_10_0_machine_init(MachineClass *mc)
 {
     mc->desc = "RISC-V Spike Board (Privileged ISA v1.10)";
     mc->init = spike_v1_10_0_board_init;
-    mc->max_cpus = 1;
+    mc->max_cpus = 8; /* hardcoded limit in BBL */
     mc->is_default = 1;
+    htif_machine_class_add_props(mc);
 }
 
 DEFINE_MACHINE("spike_v1.9.1", spike_v1_09_1_machine_init)
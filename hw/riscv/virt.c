@@ -3,7 +3,7 @@
  *
  * Copyright (c) 2017 SiFive, Inc.
  *
- * RISC-V machine with 16550a UART and VirtIO MMIO
+ * RISC-V machine with 16550a UART, VirtIO MMIO and a generic PCIe host
  *
  * This program is free software; you can redistribute it and/or modify it
  * under the terms and conditions of the GNU General Public License,
@@ -35,9 +35,13 @@
 #include "hw/riscv/sifive_clint.h"
 #include "hw/riscv/sifive_test.h"
 #include "hw/riscv/virt.h"
+#include "hw/pci/pci.h"
+#include "hw/pci-host/gpex.h"
 #include "chardev/char.h"
 #include "sysemu/arch_init.h"
 #include "sysemu/device_tree.h"
+#include "sysemu/numa.h"
+#include "sysemu/cpus.h"
 #include "exec/address-spaces.h"
 #include "elf.h"
 
@@ -47,14 +51,17 @@ static const struct MemmapEntry {
     hwaddr base;
     hwaddr size;
 } virt_memmap[] = {
-    [VIRT_DEBUG] =    {        0x0,      0x100 },
-    [VIRT_MROM] =     {     0x1000,    0x11000 },
-    [VIRT_TEST] =     {   0x100000,     0x1000 },
-    [VIRT_CLINT] =    {  0x2000000,    0x10000 },
-    [VIRT_PLIC] =     {  0xc000000,  0x4000000 },
-    [VIRT_UART0] =    { 0x10000000,      0x100 },
-    [VIRT_VIRTIO] =   { 0x10001000,     0x1000 },
-    [VIRT_DRAM] =     { 0x80000000,        0x0 },
+    [VIRT_DEBUG] =       {        0x0,         0x100 },
+    [VIRT_MROM] =        {     0x1000,       0x11000 },
+    [VIRT_TEST] =        {   0x100000,        0x1000 },
+    [VIRT_CLINT] =       {  0x2000000,       0x10000 },
+    [VIRT_PCIE_PIO] =    {  0x3000000,       0x10000 },
+    [VIRT_PLIC] =        {  0xc000000,     0x4000000 },
+    [VIRT_UART0] =       { 0x10000000,         0x100 },
+    [VIRT_VIRTIO] =      { 0x10001000,        0x1000 },
+    [VIRT_PCIE_ECAM] =   { 0x30000000,    0x10000000 },
+    [VIRT_PCIE_MMIO] =   { 0x40000000,    0x40000000 },
+    [VIRT_DRAM] =        { 0x80000000,           0x0 },
 };
 
 static uint64_t load_kernel(const char *kernel_filename)
@@ -98,6 +105,131 @@ static hwaddr load_initrd(const char *filename, uint64_t mem_size,
     return *start + size;
 }
 
+static void *load_fdt(const char *dtb_filename, int *sizep,
+                      const char *cmdline)
+{
+    char *filename = qemu_find_file(QEMU_FILE_TYPE_BIOS, dtb_filename);
+    void *fdt = filename ? load_device_tree(filename, sizep) : NULL;
+
+    if (!fdt) {
+        error_report("qemu: could not load dtb '%s'", dtb_filename);
+        exit(1);
+    }
+    g_free(filename);
+
+    /* The blob was dumped from this board, so it already has /chosen */
+    qemu_fdt_setprop_string(fdt, "/chosen", "bootargs", cmdline);
+    return fdt;
+}
+
+static void create_fdt_cpu_map(void *fdt, int num_harts, uint32_t *phandle)
+{
+    int per_socket = smp_cores * smp_threads;
+    int cpu;
+
+    qemu_fdt_add_subnode(fdt, "/cpus/cpu-map");
+
+    /*
+     * Subnodes are prepended, so walk the harts backwards to keep the map
+     * in ascending order.  The first hart visited in a socket or core is its
+     * highest one, which is when the parent node gets created.
+     */
+    for (cpu = num_harts - 1; cpu >= 0; cpu--) {
+        bool first = cpu == num_harts - 1;
+        uint32_t cpu_phandle = (*phandle)++;
+        char *cpu_name = g_strdup_printf("/cpus/cpu@%d", cpu);
+        char *cluster = g_strdup_printf("/cpus/cpu-map/cluster%d",
+                                        cpu / per_socket);
+        char *core = g_strdup_printf("%s/core%d", cluster,
+                                     (cpu / smp_threads) % smp_cores);
+        char *leaf = smp_threads > 1 ?
+            g_strdup_printf("%s/thread%d", core, cpu % smp_threads) :
+            g_strdup(core);
+
+        if (first || (cpu + 1) % per_socket == 0) {
+            qemu_fdt_add_subnode(fdt, cluster);
+        }
+        if (smp_threads > 1 && (first || (cpu + 1) % smp_threads == 0)) {
+            qemu_fdt_add_subnode(fdt, core);
+        }
+        qemu_fdt_add_subnode(fdt, leaf);
+
+        qemu_fdt_setprop_cell(fdt, cpu_name, "phandle", cpu_phandle);
+        qemu_fdt_setprop_cell(fdt, leaf, "cpu", cpu_phandle);
+        g_free(leaf);
+        g_free(core);
+        g_free(cluster);
+        g_free(cpu_name);
+    }
+}
+
+static void create_fdt_numa_distance(void *fdt)
+{
+    int size = nb_numa_nodes * nb_numa_nodes * 3 * sizeof(uint32_t);
+    uint32_t *matrix = g_malloc0(size);
+    int idx, i, j;
+
+    for (i = 0; i < nb_numa_nodes; i++) {
+        for (j = 0; j < nb_numa_nodes; j++) {
+            idx = (i * nb_numa_nodes + j) * 3;
+            matrix[idx + 0] = cpu_to_be32(i);
+            matrix[idx + 1] = cpu_to_be32(j);
+            matrix[idx + 2] = cpu_to_be32(numa_info[i].distance[j]);
+        }
+    }
+
+    qemu_fdt_add_subnode(fdt, "/distance-map");
+    qemu_fdt_setprop_string(fdt, "/distance-map", "compatible",
+                            "numa-distance-map-v1");
+    qemu_fdt_setprop(fdt, "/distance-map", "distance-matrix", matrix, size);
+    g_free(matrix);
+}
+
+static void create_pcie_irq_map(void *fdt, char *nodename,
+                                uint32_t plic_phandle)
+{
+    int pin, dev;
+    uint32_t
+        full_irq_map[GPEX_NUM_IRQS * GPEX_NUM_IRQS * FDT_INT_MAP_WIDTH] = {};
+    uint32_t *irq_map = full_irq_map;
+
+    /* This code creates a standard swizzle of interrupts such that
+     * each device's first interrupt is based on it's PCI_SLOT number.
+     * (See pci_swizzle_map_irq_fn())
+     *
+     * We only need one entry per interrupt in the table (not one per
+     * possible slot) seeing the interrupt-map-mask will allow the table
+     * to wrap to any number of devices.
+     */
+    for (dev = 0; dev < GPEX_NUM_IRQS; dev++) {
+        int devfn = dev * 0x8;
+
+        for (pin = 0; pin < GPEX_NUM_IRQS; pin++) {
+            int irq_nr = PCIE_IRQ + ((pin + PCI_SLOT(devfn)) % GPEX_NUM_IRQS);
+            int i = 0;
+
+            irq_map[i] = cpu_to_be32(devfn << 8);
+
+            i += FDT_PCI_ADDR_CELLS;
+            irq_map[i] = cpu_to_be32(pin + 1);
+
+            i += FDT_PCI_INT_CELLS;
+            irq_map[i++] = cpu_to_be32(plic_phandle);
+
+            i += FDT_PLIC_ADDR_CELLS;
+            irq_map[i] = cpu_to_be32(irq_nr);
+
+            irq_map += FDT_INT_MAP_WIDTH;
+        }
+    }
+
+    qemu_fdt_setprop(fdt, nodename, "interrupt-map",
+                     full_irq_map, sizeof(full_irq_map));
+
+    qemu_fdt_setprop_cells(fdt, nodename, "interrupt-map-mask",
+                           0x1800, 0, 0, 0x7);
+}
+
 static void *create_fdt(RISCVVirtState *s, const struct MemmapEntry *memmap,
     uint64_t mem_size, const char *cmdline)
 {
@@ -106,6 +238,9 @@ static void *create_fdt(RISCVVirtState *s, const struct MemmapEntry *memmap,
     uint32_t *cells;
     char *nodename;
     uint32_t plic_phandle, phandle = 1;
+    MachineState *ms = MACHINE(qdev_get_machine());
+    const CPUArchIdList *possible_cpus =
+        MACHINE_GET_CLASS(ms)->possible_cpu_arch_ids(ms);
     int i;
 
     fdt = s->fdt = create_device_tree(&s->fdt_size);
@@ -125,14 +260,34 @@ static void *create_fdt(RISCVVirtState *s, const struct MemmapEntry *memmap,
     qemu_fdt_setprop_cell(fdt, "/soc", "#size-cells", 0x2);
     qemu_fdt_setprop_cell(fdt, "/soc", "#address-cells", 0x2);
 
-    nodename = g_strdup_printf("/memory@%lx",
-        (long)memmap[VIRT_DRAM].base);
-    qemu_fdt_add_subnode(fdt, nodename);
-    qemu_fdt_setprop_cells(fdt, nodename, "reg",
-        memmap[VIRT_DRAM].base >> 32, memmap[VIRT_DRAM].base,
-        mem_size >> 32, mem_size);
-    qemu_fdt_setprop_string(fdt, nodename, "device_type", "memory");
-    g_free(nodename);
+    if (nb_numa_nodes > 0) {
+        hwaddr mem_base = memmap[VIRT_DRAM].base;
+
+        for (i = 0; i < nb_numa_nodes; i++) {
+            uint64_t mem_len = numa_info[i].node_mem;
+
+            if (!mem_len) {
+                continue;
+            }
+            nodename = g_strdup_printf("/memory@%lx", (long)mem_base);
+            qemu_fdt_add_subnode(fdt, nodename);
+            qemu_fdt_setprop_cells(fdt, nodename, "reg",
+                mem_base >> 32, mem_base, mem_len >> 32, mem_len);
+            qemu_fdt_setprop_string(fdt, nodename, "device_type", "memory");
+            qemu_fdt_setprop_cell(fdt, nodename, "numa-node-id", i);
+            mem_base += mem_len;
+            g_free(nodename);
+        }
+    } else {
+        nodename = g_strdup_printf("/memory@%lx",
+            (long)memmap[VIRT_DRAM].base);
+        qemu_fdt_add_subnode(fdt, nodename);
+        qemu_fdt_setprop_cells(fdt, nodename, "reg",
+            memmap[VIRT_DRAM].base >> 32, memmap[VIRT_DRAM].base,
+            mem_size >> 32, mem_size);
+        qemu_fdt_setprop_string(fdt, nodename, "device_type", "memory");
+        g_free(nodename);
+    }
 
     qemu_fdt_add_subnode(fdt, "/cpus");
     qemu_fdt_setprop_cell(fdt, "/cpus", "timebase-frequency",
@@ -154,6 +309,10 @@ static void *create_fdt(RISCVVirtState *s, const struct MemmapEntry *memmap,
         qemu_fdt_setprop_string(fdt, nodename, "status", "okay");
         qemu_fdt_setprop_cell(fdt, nodename, "reg", cpu);
         qemu_fdt_setprop_string(fdt, nodename, "device_type", "cpu");
+        if (possible_cpus->cpus[cpu].props.has_node_id) {
+            qemu_fdt_setprop_cell(fdt, nodename, "numa-node-id",
+                                  possible_cpus->cpus[cpu].props.node_id);
+        }
         qemu_fdt_add_subnode(fdt, intc);
         qemu_fdt_setprop_cell(fdt, intc, "phandle", cpu_phandle);
         qemu_fdt_setprop_cell(fdt, intc, "linux,phandle", cpu_phandle);
@@ -165,6 +324,11 @@ static void *create_fdt(RISCVVirtState *s, const struct MemmapEntry *memmap,
         g_free(nodename);
     }
 
+    create_fdt_cpu_map(fdt, s->soc.num_harts, &phandle);
+    if (have_numa_distance) {
+        create_fdt_numa_distance(fdt);
+    }
+
     cells =  g_new0(uint32_t, s->soc.num_harts * 4);
     for (cpu = 0; cpu < s->soc.num_harts; cpu++) {
         nodename =
@@ -233,6 +397,34 @@ static void *create_fdt(RISCVVirtState *s, const struct MemmapEntry *memmap,
         g_free(nodename);
     }
 
+    nodename = g_strdup_printf("/soc/pci@%lx",
+        (long) memmap[VIRT_PCIE_ECAM].base);
+    qemu_fdt_add_subnode(fdt, nodename);
+    qemu_fdt_setprop_cells(fdt, nodename, "#address-cells",
+                           FDT_PCI_ADDR_CELLS);
+    qemu_fdt_setprop_cells(fdt, nodename, "#interrupt-cells",
+                           FDT_PCI_INT_CELLS);
+    qemu_fdt_setprop_cells(fdt, nodename, "#size-cells", 0x2);
+    qemu_fdt_setprop_string(fdt, nodename, "compatible",
+                            "pci-host-ecam-generic");
+    qemu_fdt_setprop_string(fdt, nodename, "device_type", "pci");
+    qemu_fdt_setprop_cell(fdt, nodename, "linux,pci-domain", 0);
+    qemu_fdt_setprop_cells(fdt, nodename, "bus-range", 0,
+                           memmap[VIRT_PCIE_ECAM].size /
+                               PCIE_MMCFG_SIZE_MIN - 1);
+    qemu_fdt_setprop(fdt, nodename, "dma-coherent", NULL, 0);
+    qemu_fdt_setprop_cells(fdt, nodename, "reg",
+        0x0, memmap[VIRT_PCIE_ECAM].base,
+        0x0, memmap[VIRT_PCIE_ECAM].size);
+    qemu_fdt_setprop_sized_cells(fdt, nodename, "ranges",
+        1, FDT_PCI_RANGE_IOPORT, 2, 0,
+        2, memmap[VIRT_PCIE_PIO].base, 2, memmap[VIRT_PCIE_PIO].size,
+        1, FDT_PCI_RANGE_MMIO,
+        2, memmap[VIRT_PCIE_MMIO].base,
+        2, memmap[VIRT_PCIE_MMIO].base, 2, memmap[VIRT_PCIE_MMIO].size);
+    create_pcie_irq_map(fdt, nodename, plic_phandle);
+    g_free(nodename);
+
     nodename = g_strdup_printf("/test@%lx",
         (long)memmap[VIRT_TEST].base);
     qemu_fdt_add_subnode(fdt, nodename);
@@ -260,6 +452,44 @@ static void *create_fdt(RISCVVirtState *s, const struct MemmapEntry *memmap,
     return fdt;
 }
 
+static DeviceState *gpex_pcie_init(MemoryRegion *sys_mem,
+                                   hwaddr ecam_base, hwaddr ecam_size,
+                                   hwaddr mmio_base, hwaddr mmio_size,
+                                   hwaddr pio_base, DeviceState *plic)
+{
+    DeviceState *dev;
+    MemoryRegion *ecam_alias, *ecam_reg;
+    MemoryRegion *mmio_alias, *mmio_reg;
+    qemu_irq irq;
+    int i;
+
+    dev = qdev_create(NULL, TYPE_GPEX_HOST);
+    qdev_init_nofail(dev);
+
+    ecam_alias = g_new0(MemoryRegion, 1);
+    ecam_reg = sysbus_mmio_get_region(SYS_BUS_DEVICE(dev), 0);
+    memory_region_init_alias(ecam_alias, OBJECT(dev), "pcie-ecam",
+                             ecam_reg, 0, ecam_size);
+    memory_region_add_subregion(sys_mem, ecam_base, ecam_alias);
+
+    /* Map the PCI memory window 1:1 into the system address space */
+    mmio_alias = g_new0(MemoryRegion, 1);
+    mmio_reg = sysbus_mmio_get_region(SYS_BUS_DEVICE(dev), 1);
+    memory_region_init_alias(mmio_alias, OBJECT(dev), "pcie-mmio",
+                             mmio_reg, mmio_base, mmio_size);
+    memory_region_add_subregion(sys_mem, mmio_base, mmio_alias);
+
+    sysbus_mmio_map(SYS_BUS_DEVICE(dev), 2, pio_base);
+
+    for (i = 0; i < GPEX_NUM_IRQS; i++) {
+        irq = qdev_get_gpio_in(plic, PCIE_IRQ + i);
+        sysbus_connect_irq(SYS_BUS_DEVICE(dev), i, irq);
+        gpex_set_irq_num(GPEX_HOST(dev), i, PCIE_IRQ + i);
+    }
+
+    return dev;
+}
+
 static void riscv_virt_board_init(MachineState *machine)
 {
     const struct MemmapEntry *memmap = virt_memmap;
@@ -283,14 +513,21 @@ static void riscv_virt_board_init(MachineState *machine)
     object_property_set_bool(OBJECT(&s->soc), true, "realized",
                             &error_abort);
 
-    /* register system main memory (actual RAM) */
-    memory_region_init_ram(main_mem, NULL, "riscv_virt_board.ram",
-                           machine->ram_size, &error_fatal);
+    /* register system main memory (actual RAM), honouring -numa memdev */
+    memory_region_allocate_system_memory(main_mem, NULL,
+                                         "riscv_virt_board.ram",
+                                         machine->ram_size);
     memory_region_add_subregion(system_memory, memmap[VIRT_DRAM].base,
         main_mem);
 
-    /* create device tree */
-    fdt = create_fdt(s, memmap, machine->ram_size, machine->kernel_cmdline);
+    /* create device tree, or reuse one saved with -machine dumpdtb */
+    if (machine->dtb) {
+        fdt = s->fdt = load_fdt(machine->dtb, &s->fdt_size,
+                                machine->kernel_cmdline);
+    } else {
+        fdt = create_fdt(s, memmap, machine->ram_size,
+                         machine->kernel_cmdline);
+    }
 
     /* boot rom */
     memory_region_init_rom(mask_rom, NULL, "riscv_virt_board.mrom",
@@ -377,21 +614,81 @@ static void riscv_virt_board_init(MachineState *machine)
     sifive_test_create(memmap[VIRT_TEST].base);
 
     for (i = 0; i < VIRTIO_COUNT; i++) {
-        sysbus_create_simple("virtio-mmio",
-            memmap[VIRT_VIRTIO].base + i * memmap[VIRT_VIRTIO].size,
+        DeviceState *dev = qdev_create(NULL, "virtio-mmio");
+        /* queue notifications are handled off the vCPU thread */
+        qdev_prop_set_bit(dev, "ioeventfd", true);
+        qdev_init_nofail(dev);
+        sysbus_mmio_map(SYS_BUS_DEVICE(dev), 0,
+            memmap[VIRT_VIRTIO].base + i * memmap[VIRT_VIRTIO].size);
+        sysbus_connect_irq(SYS_BUS_DEVICE(dev), 0,
             qdev_get_gpio_in(DEVICE(s->plic), VIRTIO_IRQ + i));
     }
 
+    gpex_pcie_init(system_memory,
+                   memmap[VIRT_PCIE_ECAM].base,
+                   memmap[VIRT_PCIE_ECAM].size,
+                   memmap[VIRT_PCIE_MMIO].base,
+                   memmap[VIRT_PCIE_MMIO].size,
+                   memmap[VIRT_PCIE_PIO].base,
+                   DEVICE(s->plic));
+
     serial_mm_init(system_memory, memmap[VIRT_UART0].base,
         0, qdev_get_gpio_in(DEVICE(s->plic), UART0_IRQ), 399193,
         serial_hd(0), DEVICE_LITTLE_ENDIAN);
 }
 
+static CpuInstanceProperties
+riscv_virt_cpu_index_to_props(MachineState *ms, unsigned cpu_index)
+{
+    MachineClass *mc = MACHINE_GET_CLASS(ms);
+    const CPUArchIdList *possible_cpus = mc->possible_cpu_arch_ids(ms);
+
+    assert(cpu_index < possible_cpus->len);
+    return possible_cpus->cpus[cpu_index].props;
+}
+
+static int64_t riscv_virt_get_default_cpu_node_id(const MachineState *ms,
+                                                  int idx)
+{
+    /* keep whole sockets on one node */
+    return (idx / (smp_cores * smp_threads)) % nb_numa_nodes;
+}
+
+static const CPUArchIdList *riscv_virt_possible_cpu_arch_ids(MachineState *ms)
+{
+    int n;
+
+    if (ms->possible_cpus) {
+        assert(ms->possible_cpus->len == max_cpus);
+        return ms->possible_cpus;
+    }
+
+    ms->possible_cpus = g_malloc0(sizeof(CPUArchIdList) +
+                                  sizeof(CPUArchId) * max_cpus);
+    ms->possible_cpus->len = max_cpus;
+    for (n = 0; n < ms->possible_cpus->len; n++) {
+        CpuInstanceProperties *props = &ms->possible_cpus->cpus[n].props;
+
+        ms->possible_cpus->cpus[n].type = VIRT_CPU;
+        ms->possible_cpus->cpus[n].arch_id = n; /* mhartid */
+        props->has_socket_id = true;
+        props->socket_id = n / (smp_cores * smp_threads);
+        props->has_core_id = true;
+        props->core_id = (n / smp_threads) % smp_cores;
+        props->has_thread_id = true;
+        props->thread_id = n % smp_threads;
+    }
+    return ms->possible_cpus;
+}
+
 static void riscv_virt_board_machine_init(MachineClass *mc)
 {
     mc->desc = "RISC-V VirtIO Board (Privileged ISA v1.10)";
     mc->init = riscv_virt_board_init;
     mc->max_cpus = 8; /* hardcoded limit in BBL */
+    mc->possible_cpu_arch_ids = riscv_virt_possible_cpu_arch_ids;
+    mc->cpu_index_to_instance_props = riscv_virt_cpu_index_to_props;
+    mc->get_default_cpu_node_id = riscv_virt_get_default_cpu_node_id;
 }
 
 DEFINE_MACHINE("virt", riscv_virt_board_machine_init)
@@ -19,6 +19,7 @@
 #include "hw/hw.h"
 #include "qemu/atomic.h"
 #include "qemu/range.h"
+#include "qemu/units.h"
 #include "qemu/error-report.h"
 #include "qemu/memfd.h"
 #include <linux/vhost.h>
@@ -41,6 +42,9 @@
     do { } while (0)
 #endif
 
+/* How much to translate ahead of a device IOTLB miss */
+#define VHOST_IOTLB_PREFETCH_SIZE (256 * KiB)
+
 static struct vhost_log *vhost_log;
 static struct vhost_log *vhost_log_shm;
 
@@ -898,10 +902,75 @@ static int vhost_memory_region_lookup(struct vhost_dev *hdev,
     return -EFAULT;
 }
 
+/*
+ * Translate [@iova, @iova + @size) and send it to the backend, merging
+ * translations that are contiguous in both IOVA and userspace address and
+ * have the same permissions into a single update.  Large IOMMU pages are
+ * sent whole.  Stops at the first address that cannot be translated;
+ * returns the number of bytes sent, or a negative errno if an update
+ * failed.  Called with the RCU read lock held.
+ */
+static int64_t vhost_device_iotlb_update_range(struct vhost_dev *dev,
+                                               uint64_t iova, uint64_t size,
+                                               bool write)
+{
+    uint64_t end = iova + size;
+    uint64_t run_iova = 0, run_uaddr = 0, run_len = 0;
+    IOMMUAccessFlags run_perm = IOMMU_NONE;
+    int64_t done = 0;
+    int ret;
+
+    while (iova < end) {
+        IOMMUTLBEntry iotlb;
+        uint64_t uaddr, len;
+
+        iotlb = address_space_get_iotlb_entry(dev->vdev->dma_as, iova, write,
+                                              MEMTXATTRS_UNSPECIFIED);
+        if (iotlb.target_as == NULL ||
+            vhost_memory_region_lookup(dev, iotlb.translated_addr,
+                                       &uaddr, &len)) {
+            break;
+        }
+        len = MIN(iotlb.addr_mask + 1, len);
+
+        if (run_len && run_iova + run_len == iotlb.iova &&
+            run_uaddr + run_len == uaddr && run_perm == iotlb.perm) {
+            run_len += len;
+        } else {
+            if (run_len) {
+                ret = vhost_backend_update_device_iotlb(dev, run_iova,
+                                                        run_uaddr, run_len,
+                                                        run_perm);
+                if (ret) {
+                    return ret;
+                }
+                done += run_len;
+            }
+            run_iova = iotlb.iova;
+            run_uaddr = uaddr;
+            run_len = len;
+            run_perm = iotlb.perm;
+        }
+        iova = iotlb.iova + len;
+    }
+
+    if (run_len) {
+        ret = vhost_backend_update_device_iotlb(dev, run_iova, run_uaddr,
+                                                run_len, run_perm);
+        if (ret) {
+            return ret;
+        }
+        done += run_len;
+    }
+
+    return done;
+}
+
 int vhost_device_iotlb_miss(struct vhost_dev *dev, uint64_t iova, int write)
 {
     IOMMUTLBEntry iotlb;
     uint64_t uaddr, len;
+    int64_t sent;
     int ret = -EFAULT;
 
     rcu_read_lock();
@@ -921,14 +990,19 @@ int vhost_device_iotlb_miss(struct vhost_dev *dev, uint64_t iova, int write)
             goto out;
         }
 
-        len = MIN(iotlb.addr_mask + 1, len);
-        iova = iova & ~iotlb.addr_mask;
-
-        ret = vhost_backend_update_device_iotlb(dev, iova, uaddr,
-                                                len, iotlb.perm);
-        if (ret) {
+        /*
+         * Buffers tend to be near each other, so also send the
+         * translations that follow the missing one; the device would
+         * most likely ask for them next.
+         */
+        sent = vhost_device_iotlb_update_range(dev, iotlb.iova,
+                                               MAX(iotlb.addr_mask + 1,
+                                                   VHOST_IOTLB_PREFETCH_SIZE),
+                                               write);
+        if (sent <= 0) {
             trace_vhost_iotlb_miss(dev, 4);
             error_report("Fail to update device iotlb");
+            ret = sent ? sent : -EFAULT;
             goto out;
         }
     }
@@ -1483,6 +1557,47 @@ void vhost_dev_set_config_notifier(struct vhost_dev *hdev,
     hdev->config_ops = ops;
 }
 
+void vhost_dev_free_inflight(struct vhost_inflight *inflight)
+{
+    if (inflight->addr) {
+        qemu_memfd_free(inflight->addr, inflight->size, inflight->fd);
+        inflight->addr = NULL;
+        inflight->fd = -1;
+    }
+}
+
+int vhost_dev_set_inflight(struct vhost_dev *dev,
+                           struct vhost_inflight *inflight)
+{
+    int r;
+
+    if (dev->vhost_ops->vhost_set_inflight_fd && inflight->addr) {
+        r = dev->vhost_ops->vhost_set_inflight_fd(dev, inflight);
+        if (r) {
+            VHOST_OPS_DEBUG("vhost_set_inflight_fd failed");
+            return -errno;
+        }
+    }
+
+    return 0;
+}
+
+int vhost_dev_get_inflight(struct vhost_dev *dev, uint16_t queue_size,
+                           struct vhost_inflight *inflight)
+{
+    int r;
+
+    if (dev->vhost_ops->vhost_get_inflight_fd) {
+        r = dev->vhost_ops->vhost_get_inflight_fd(dev, queue_size, inflight);
+        if (r) {
+            VHOST_OPS_DEBUG("vhost_get_inflight_fd failed");
+            return -errno;
+        }
+    }
+
+    return 0;
+}
+
 /* Host notifiers must be enabled at this point. */
 int vhost_dev_start(struct vhost_dev *hdev, VirtIODevice *vdev)
 {
@@ -1540,11 +1655,19 @@ int vhost_dev_start(struct vhost_dev *hdev, VirtIODevice *vdev)
         hdev->vhost_ops->vhost_set_iotlb_callback(hdev, true);
 
         /* Update used ring information for IOTLB to work correctly,
-         * vhost-kernel code requires for this.*/
+         * vhost-kernel code requires for this.  Send the descriptor table
+         * and the avail ring too, the device needs them right away. */
+        rcu_read_lock();
         for (i = 0; i < hdev->nvqs; ++i) {
             struct vhost_virtqueue *vq = hdev->vqs + i;
-            vhost_device_iotlb_miss(hdev, vq->used_phys, true);
+            vhost_device_iotlb_update_range(hdev, vq->desc_phys,
+                                            vq->desc_size, false);
+            vhost_device_iotlb_update_range(hdev, vq->avail_phys,
+                                            vq->avail_size, false);
+            vhost_device_iotlb_update_range(hdev, vq->used_phys,
+                                            vq->used_size, true);
         }
+        rcu_read_unlock();
     }
     return 0;
 fail_log:
@@ -21,9 +21,14 @@
 #include "hw/virtio/virtio-access.h"
 #include "standard-headers/linux/virtio_ids.h"
 #include "sysemu/cryptodev-vhost.h"
+#include "block/aio.h"
+#include "block/thread-pool.h"
 
 #define VIRTIO_CRYPTO_VM_VERSION 1
 
+/* Maximum number of requests passed to the backend at once */
+#define VIRTIO_CRYPTO_BATCH_MAX 64
+
 /*
  * Transfer virtqueue index to crypto queue index.
  * The control virtqueue is after the data virtqueues
@@ -208,6 +213,18 @@ virtio_crypto_handle_close_session(VirtIOCrypto *vcrypto,
     return status;
 }
 
+/* Waits for the backend to finish the batches of all queues */
+static void virtio_crypto_drain(VirtIOCrypto *vcrypto)
+{
+    int i;
+
+    for (i = 0; i < vcrypto->max_queues; i++) {
+        while (vcrypto->vqs[i].batch_in_flight) {
+            aio_poll(qemu_get_aio_context(), true);
+        }
+    }
+}
+
 static void virtio_crypto_handle_ctrl(VirtIODevice *vdev, VirtQueue *vq)
 {
     VirtIOCrypto *vcrypto = VIRTIO_CRYPTO(vdev);
@@ -224,6 +241,9 @@ static void virtio_crypto_handle_ctrl(VirtIODevice *vdev, VirtQueue *vq)
     uint8_t status;
     size_t s;
 
+    /* Sessions must not change under the backend's feet */
+    virtio_crypto_drain(vcrypto);
+
     for (;;) {
         elem = virtqueue_pop(vq, sizeof(VirtQueueElement));
         if (!elem) {
@@ -332,6 +352,8 @@ static void virtio_crypto_init_request(VirtIOCrypto *vcrypto, VirtQueue *vq,
     req->in_len = 0;
     req->flags = CRYPTODEV_BACKEND_ALG__MAX;
     req->u.sym_op_info = NULL;
+    req->status = VIRTIO_CRYPTO_ERR;
+    req->err = NULL;
 }
 
 static void virtio_crypto_free_request(VirtIOCryptoReq *req)
@@ -400,7 +422,6 @@ static void virtio_crypto_req_complete(VirtIOCryptoReq *req, uint8_t status)
     }
     stb_p(&req->in->status, status);
     virtqueue_push(req->vq, &req->elem, req->in_len);
-    virtio_notify(vdev, req->vq);
 }
 
 static VirtIOCryptoReq *
@@ -570,6 +591,10 @@ virtio_crypto_handle_sym_req(VirtIOCrypto *vcrypto,
     return 0;
 }
 
+/*
+ * Returns 1 if the request was added to the batch of its queue, 0 if it
+ * was completed right away and -1 if the device needs a reset.
+ */
 static int
 virtio_crypto_handle_request(VirtIOCryptoReq *request)
 {
@@ -577,6 +602,7 @@ virtio_crypto_handle_request(VirtIOCryptoReq *request)
     VirtIODevice *vdev = VIRTIO_DEVICE(vcrypto);
     VirtQueueElement *elem = &request->elem;
     int queue_index = virtio_crypto_vq2q(virtio_get_queue_index(request->vq));
+    VirtIOCryptoQueue *q = &vcrypto->vqs[queue_index];
     struct virtio_crypto_op_data_req req;
     int ret;
     struct iovec *in_iov;
@@ -584,10 +610,8 @@ virtio_crypto_handle_request(VirtIOCryptoReq *request)
     unsigned in_num;
     unsigned out_num;
     uint32_t opcode;
-    uint8_t status = VIRTIO_CRYPTO_ERR;
     uint64_t session_id;
     CryptoDevBackendSymOpInfo *sym_op_info = NULL;
-    Error *local_err = NULL;
 
     if (elem->out_num < 1 || elem->in_num < 1) {
         virtio_error(vdev, "virtio-crypto dataq missing headers");
@@ -646,18 +670,8 @@ virtio_crypto_handle_request(VirtIOCryptoReq *request)
             /* Set request's parameter */
             request->flags = CRYPTODEV_BACKEND_ALG_SYM;
             request->u.sym_op_info = sym_op_info;
-            ret = cryptodev_backend_crypto_operation(vcrypto->cryptodev,
-                                    request, queue_index, &local_err);
-            if (ret < 0) {
-                status = -ret;
-                if (local_err) {
-                    error_report_err(local_err);
-                }
-            } else { /* ret == VIRTIO_CRYPTO_OK */
-                status = ret;
-            }
-            virtio_crypto_req_complete(request, status);
-            virtio_crypto_free_request(request);
+            QSIMPLEQ_INSERT_TAIL(&q->batch, request, next);
+            return 1;
         }
         break;
     case VIRTIO_CRYPTO_HASH:
@@ -674,17 +688,78 @@ virtio_crypto_handle_request(VirtIOCryptoReq *request)
     return 0;
 }
 
+/* Runs in a worker thread, so that slow operations do not stall vCPUs */
+static int virtio_crypto_batch_work(void *opaque)
+{
+    VirtIOCryptoQueue *q = opaque;
+    VirtIOCrypto *vcrypto = q->vcrypto;
+    int queue_index = virtio_crypto_vq2q(virtio_get_queue_index(q->dataq));
+    VirtIOCryptoReq *req;
+    int ret;
+
+    QSIMPLEQ_FOREACH(req, &q->batch, next) {
+        ret = cryptodev_backend_crypto_operation(vcrypto->cryptodev,
+                                                 req, queue_index, &req->err);
+        /* ret is VIRTIO_CRYPTO_OK or a negated VIRTIO_CRYPTO_* status */
+        req->status = ret < 0 ? -ret : ret;
+    }
+    return 0;
+}
+
+static void virtio_crypto_batch_complete(void *opaque, int ret)
+{
+    VirtIOCryptoQueue *q = opaque;
+    VirtIODevice *vdev = VIRTIO_DEVICE(q->vcrypto);
+    VirtIOCryptoReq *req;
+
+    while ((req = QSIMPLEQ_FIRST(&q->batch))) {
+        QSIMPLEQ_REMOVE_HEAD(&q->batch, next);
+        if (req->err) {
+            error_report_err(req->err);
+        }
+        virtio_crypto_req_complete(req, req->status);
+        virtio_crypto_free_request(req);
+    }
+    q->batch_in_flight = false;
+    virtio_notify(vdev, q->dataq);
+
+    /* Pick up the requests that arrived in the meantime */
+    qemu_bh_schedule(q->dataq_bh);
+}
+
 static void virtio_crypto_handle_dataq(VirtIODevice *vdev, VirtQueue *vq)
 {
     VirtIOCrypto *vcrypto = VIRTIO_CRYPTO(vdev);
+    VirtIOCryptoQueue *q =
+         &vcrypto->vqs[virtio_crypto_vq2q(virtio_get_queue_index(vq))];
     VirtIOCryptoReq *req;
+    bool notify = false;
+    int queued = 0;
+    int ret;
 
-    while ((req = virtio_crypto_get_request(vcrypto, vq))) {
-        if (virtio_crypto_handle_request(req) < 0) {
+    while (queued < VIRTIO_CRYPTO_BATCH_MAX &&
+           (req = virtio_crypto_get_request(vcrypto, vq))) {
+        ret = virtio_crypto_handle_request(req);
+        if (ret < 0) {
             virtqueue_detach_element(req->vq, &req->elem, 0);
             virtio_crypto_free_request(req);
             break;
         }
+        if (ret > 0) {
+            queued++;
+        } else {
+            notify = true;
+        }
+    }
+    if (notify) {
+        virtio_notify(vdev, vq);
+    }
+
+    if (!QSIMPLEQ_EMPTY(&q->batch)) {
+        q->batch_in_flight = true;
+        thread_pool_submit_aio(aio_get_thread_pool(qemu_get_aio_context()),
+                               virtio_crypto_batch_work, q,
+                               virtio_crypto_batch_complete, q);
     }
 }
 
@@ -704,8 +779,16 @@ static void virtio_crypto_dataq_bh(void *opaque)
         return;
     }
 
+    /* Notifications stay disabled until the batch in flight completes */
+    if (q->batch_in_flight) {
+        return;
+    }
+
     for (;;) {
         virtio_crypto_handle_dataq(vdev, q->dataq);
+        if (q->batch_in_flight) {
+            return;
+        }
         virtio_queue_set_notification(q->dataq, 1);
 
         /* Are we done or did the guest add more buffers? */
@@ -742,6 +825,8 @@ static uint64_t virtio_crypto_get_features(VirtIODevice *vdev,
 static void virtio_crypto_reset(VirtIODevice *vdev)
 {
     VirtIOCrypto *vcrypto = VIRTIO_CRYPTO(vdev);
+
+    virtio_crypto_drain(vcrypto);
     /* multiqueue is disabled by default */
     vcrypto->curr_queues = 1;
     if (!cryptodev_backend_is_ready(vcrypto->cryptodev)) {
@@ -806,6 +891,7 @@ static void virtio_crypto_device_realize(DeviceState *dev, Error **errp)
         vcrypto->vqs[i].dataq_bh =
                  qemu_bh_new(virtio_crypto_dataq_bh, &vcrypto->vqs[i]);
         vcrypto->vqs[i].vcrypto = vcrypto;
+        QSIMPLEQ_INIT(&vcrypto->vqs[i].batch);
     }
 
     vcrypto->ctrl_vq = virtio_add_queue(vdev, 64, virtio_crypto_handle_ctrl);
@@ -826,6 +912,7 @@ static void virtio_crypto_device_unrealize(DeviceState *dev, Error **errp)
     VirtIOCryptoQueue *q;
     int i, max_queues;
 
+    virtio_crypto_drain(vcrypto);
     max_queues = vcrypto->multiqueue ? vcrypto->max_queues : 1;
     for (i = 0; i < max_queues; i++) {
         virtio_del_queue(vdev, i);
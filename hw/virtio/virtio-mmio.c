@@ -69,11 +69,15 @@ typedef struct {
     /* virtio-bus */
     VirtioBusState bus;
     bool format_transport_address;
+    /* use ioeventfd for queue notifications without KVM, too */
+    bool ioeventfd;
 } VirtIOMMIOProxy;
 
 static bool virtio_mmio_ioeventfd_enabled(DeviceState *d)
 {
-    return kvm_eventfds_enabled();
+    VirtIOMMIOProxy *proxy = VIRTIO_MMIO(d);
+
+    return kvm_eventfds_enabled() || proxy->ioeventfd;
 }
 
 static int virtio_mmio_ioeventfd_assign(DeviceState *d,
@@ -426,6 +430,7 @@ assign_error:
 static Property virtio_mmio_properties[] = {
     DEFINE_PROP_BOOL("format_transport_address", VirtIOMMIOProxy,
                      format_transport_address, true),
+    DEFINE_PROP_BOOL("ioeventfd", VirtIOMMIOProxy, ioeventfd, false),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -27,6 +27,7 @@
 
 #include "qemu/timed-average.h"
 #include "qemu/thread.h"
+#include "qemu/stats64.h"
 #include "qapi/qapi-builtin-types.h"
 
 typedef struct BlockAcctTimedStats BlockAcctTimedStats;
@@ -76,6 +77,22 @@ typedef struct BlockLatencyHistogram {
     uint64_t *bins;
 } BlockLatencyHistogram;
 
+/* Log-linear latency histogram that is always collected.  Each power of
+ * two of nanoseconds is split into 1 << BLOCK_LATENCY_LOG_SUB_BITS linear
+ * bins, so a bin's width is within 12.5% of its lower bound.  Latencies
+ * from 2^BLOCK_LATENCY_LOG_MAX_SHIFT ns (about 18 minutes) up all land
+ * in the last bin.  Bins are updated without taking BlockAcctStats.lock.
+ */
+#define BLOCK_LATENCY_LOG_SUB_BITS 3
+#define BLOCK_LATENCY_LOG_MAX_SHIFT 40
+#define BLOCK_LATENCY_LOG_NBINS \
+    ((BLOCK_LATENCY_LOG_MAX_SHIFT - BLOCK_LATENCY_LOG_SUB_BITS + 1) << \
+     BLOCK_LATENCY_LOG_SUB_BITS)
+
+typedef struct BlockLatencyLogHistogram {
+    Stat64 bins[BLOCK_LATENCY_LOG_NBINS];
+} BlockLatencyLogHistogram;
+
 struct BlockAcctStats {
     QemuMutex lock;
     uint64_t nr_bytes[BLOCK_MAX_IOTYPE];
@@ -89,6 +106,7 @@ struct BlockAcctStats {
     bool account_invalid;
     bool account_failed;
     BlockLatencyHistogram latency_histogram[BLOCK_MAX_IOTYPE];
+    BlockLatencyLogHistogram latency_log[BLOCK_MAX_IOTYPE];
 };
 
 typedef struct BlockAcctCookie {
@@ -117,5 +135,10 @@ double block_acct_queue_depth(BlockAcctTimedStats *stats,
 int block_latency_histogram_set(BlockAcctStats *stats, enum BlockAcctType type,
                                 uint64List *boundaries);
 void block_latency_histograms_clear(BlockAcctStats *stats);
+uint64_t block_acct_latency_count(BlockAcctStats *stats,
+                                  enum BlockAcctType type);
+uint64_t block_acct_latency_percentile(BlockAcctStats *stats,
+                                       enum BlockAcctType type,
+                                       unsigned permille);
 
 #endif
@@ -19,6 +19,9 @@
 #include "qemu/event_notifier.h"
 #include "qemu/thread.h"
 #include "qemu/timer.h"
+#ifdef CONFIG_LINUX_IO_URING
+#include <liburing.h>
+#endif
 
 typedef struct BlockAIOCB BlockAIOCB;
 typedef void BlockCompletionFunc(void *opaque, int ret);
@@ -43,13 +46,24 @@ void qemu_aio_unref(void *p);
 void qemu_aio_ref(void *p);
 
 typedef struct AioHandler AioHandler;
+
+/* Bucket n counts aio_poll() waits below 1024 << n nanoseconds, the last
+ * bucket counts all longer waits.
+ */
+#define AIO_POLL_HISTOGRAM_BUCKETS 16
+
 typedef void QEMUBHFunc(void *opaque);
 typedef bool AioPollFn(void *opaque);
 typedef void IOHandler(void *opaque);
 
 struct Coroutine;
 struct ThreadPool;
+
+/* Size and number of the buffers cached by aio_bounce_buffer_get() */
+#define AIO_BOUNCE_BUFFER_SIZE (64 * 1024)
+#define AIO_BOUNCE_POOL_SIZE 16
 struct LinuxAioState;
+struct LuringState;
 
 struct AioContext {
     GSource source;
@@ -123,6 +137,18 @@ struct AioContext {
      */
     struct LinuxAioState *linux_aio;
 #endif
+#ifdef CONFIG_LINUX_IO_URING
+    /* State for Linux io_uring.  Uses aio_context_acquire/release for
+     * locking.
+     */
+    struct LuringState *linux_io_uring;
+#endif
+
+    /* Free page-aligned bounce buffers of AIO_BOUNCE_BUFFER_SIZE bytes.
+     * Uses aio_context_acquire/release for locking.
+     */
+    void *bounce_pool[AIO_BOUNCE_POOL_SIZE];
+    int bounce_pool_len;
 
     /* TimerLists for calling timers - one per clock type.  Has its own
      * locking.
@@ -143,10 +169,34 @@ struct AioContext {
     /* Are we in polling mode or monitoring file descriptors? */
     bool poll_started;
 
+    /* Number of AioHandlers skipped by busy polling for lack of work */
+    int poll_idle_cnt;
+
+    /* Polling statistics reported by query-iothreads, updated only
+     * while poll_max_ns is non-zero.  Readers from other threads may
+     * see slightly stale values.
+     */
+    uint64_t poll_hits;     /* busy polling found work */
+    uint64_t poll_misses;   /* had to wait for file descriptors */
+    uint64_t poll_wait_histogram[AIO_POLL_HISTOGRAM_BUCKETS];
+
     /* epoll(7) state used when built with CONFIG_EPOLL */
     int epollfd;
     bool epoll_enabled;
     bool epoll_available;
+
+#ifdef CONFIG_LINUX_IO_URING
+    /* io_uring fd monitoring, preferred over epoll(7) when available */
+    struct io_uring fdmon_io_uring;
+    bool io_uring_available;
+    bool io_uring_multishot;
+
+    /* AioHandlers whose poll request must be (re)submitted */
+    QSLIST_HEAD(, AioHandler) submit_list;
+
+    /* Removed AioHandlers that still have a poll request in flight */
+    QLIST_HEAD(, AioHandler) deleted_aio_handlers;
+#endif
 };
 
 /**
@@ -381,12 +431,43 @@ GSource *aio_get_g_source(AioContext *ctx);
 /* Return the ThreadPool bound to this AioContext */
 struct ThreadPool *aio_get_thread_pool(AioContext *ctx);
 
+/**
+ * aio_context_fork_prepare:
+ * @ctx: the aio context
+ * @errp: error object
+ *
+ * Get @ctx ready for fork(), which only keeps the calling thread alive in
+ * the child.  The worker threads of the thread pool are stopped; the pool
+ * is created again on first use.  Fails if a Linux AIO or io_uring context
+ * is attached, because the child would share it with the parent.
+ *
+ * There must be no requests in flight, and no thread may be running
+ * aio_poll() on @ctx.
+ *
+ * Returns: false on failure.
+ */
+bool aio_context_fork_prepare(AioContext *ctx, Error **errp);
+
 /* Setup the LinuxAioState bound to this AioContext */
 struct LinuxAioState *aio_setup_linux_aio(AioContext *ctx, Error **errp);
 
 /* Return the LinuxAioState bound to this AioContext */
 struct LinuxAioState *aio_get_linux_aio(AioContext *ctx);
 
+/* Setup the LuringState bound to this AioContext */
+struct LuringState *aio_setup_linux_io_uring(AioContext *ctx, Error **errp);
+
+/* Return the LuringState bound to this AioContext */
+struct LuringState *aio_get_linux_io_uring(AioContext *ctx);
+
+/* Return a page-aligned buffer of AIO_BOUNCE_BUFFER_SIZE bytes, recycled
+ * from this AioContext's cache if possible.  Its contents are undefined.
+ */
+void *aio_bounce_buffer_get(AioContext *ctx);
+
+/* Give a buffer from aio_bounce_buffer_get() back to the cache */
+void aio_bounce_buffer_put(AioContext *ctx, void *buf);
+
 /**
  * aio_timer_new:
  * @ctx: the aio context
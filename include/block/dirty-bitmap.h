@@ -5,6 +5,16 @@
 #include "qapi/qapi-types-block-core.h"
 #include "qemu/hbitmap.h"
 
+/*
+ * Read the stored data for [@offset, @offset + @bytes) of @bitmap into @buf,
+ * in the format of bdrv_dirty_bitmap_serialize_part().  @offset and @bytes
+ * cover exactly one chunk, as passed to bdrv_dirty_bitmap_set_lazy_load(),
+ * and @buf has room for bdrv_dirty_bitmap_serialization_size() bytes.
+ */
+typedef int BdrvDirtyBitmapLoadFunc(BdrvDirtyBitmap *bitmap, uint64_t offset,
+                                    uint64_t bytes, uint8_t *buf,
+                                    void *opaque);
+
 BdrvDirtyBitmap *bdrv_create_dirty_bitmap(BlockDriverState *bs,
                                           uint32_t granularity,
                                           const char *name,
@@ -66,11 +76,26 @@ void bdrv_dirty_bitmap_deserialize_ones(BdrvDirtyBitmap *bitmap,
                                         bool finish);
 void bdrv_dirty_bitmap_deserialize_finish(BdrvDirtyBitmap *bitmap);
 
+void bdrv_dirty_bitmap_set_lazy_load(BdrvDirtyBitmap *bitmap,
+                                     uint64_t chunk_size,
+                                     BdrvDirtyBitmapLoadFunc *load,
+                                     void *opaque, GDestroyNotify free_opaque);
+void bdrv_dirty_bitmap_drop_lazy_load(BdrvDirtyBitmap *bitmap);
+void *bdrv_dirty_bitmap_lazy_load_opaque(BdrvDirtyBitmap *bitmap,
+                                         BdrvDirtyBitmapLoadFunc *load);
+int bdrv_dirty_bitmap_load(BdrvDirtyBitmap *bitmap, uint64_t offset,
+                           uint64_t bytes, Error **errp);
+int bdrv_dirty_bitmap_load_all(BdrvDirtyBitmap *bitmap, Error **errp);
+bool bdrv_dirty_bitmap_loaded(BdrvDirtyBitmap *bitmap);
+bool bdrv_dirty_bitmap_changed(BdrvDirtyBitmap *bitmap, uint64_t offset,
+                               uint64_t bytes);
+void bdrv_dirty_bitmap_reset_changed(BdrvDirtyBitmap *bitmap);
+
 void bdrv_dirty_bitmap_set_readonly(BdrvDirtyBitmap *bitmap, bool value);
 void bdrv_dirty_bitmap_set_persistance(BdrvDirtyBitmap *bitmap,
                                        bool persistent);
 void bdrv_dirty_bitmap_set_qmp_locked(BdrvDirtyBitmap *bitmap, bool qmp_locked);
-void bdrv_merge_dirty_bitmap(BdrvDirtyBitmap *dest, const BdrvDirtyBitmap *src,
+void bdrv_merge_dirty_bitmap(BdrvDirtyBitmap *dest, BdrvDirtyBitmap *src,
                              Error **errp);
 
 /* Functions that require manual locking.  */
@@ -97,7 +122,7 @@ bool bdrv_dirty_bitmap_qmp_locked(BdrvDirtyBitmap *bitmap);
 bool bdrv_has_changed_persistent_bitmaps(BlockDriverState *bs);
 BdrvDirtyBitmap *bdrv_dirty_bitmap_next(BlockDriverState *bs,
                                         BdrvDirtyBitmap *bitmap);
-char *bdrv_dirty_bitmap_sha256(const BdrvDirtyBitmap *bitmap, Error **errp);
+char *bdrv_dirty_bitmap_sha256(BdrvDirtyBitmap *bitmap, Error **errp);
 int64_t bdrv_dirty_bitmap_next_zero(BdrvDirtyBitmap *bitmap, uint64_t start);
 BdrvDirtyBitmap *bdrv_reclaim_dirty_bitmap_locked(BlockDriverState *bs,
                                                   BdrvDirtyBitmap *bitmap,
@@ -51,6 +51,16 @@ typedef struct ThrottleGroupMember {
     unsigned       pending_reqs[2];
     QLIST_ENTRY(ThrottleGroupMember) round_robin;
 
+    /* Budget already accounted in the group's buckets that this member
+     * may spend without taking the ThrottleGroup lock, until credit_expire.
+     * These fields are only accessed from the member's AioContext (and
+     * changed under the ThrottleGroup lock).
+     */
+    double         credit_units[2];
+    double         credit_bytes[2];
+    int64_t        credit_expire[2];
+    uint64_t       credit_op_size;
+    unsigned       credit_gen;
 } ThrottleGroupMember;
 
 #define TYPE_THROTTLE_GROUP "throttle-group"
@@ -176,6 +176,17 @@ void qemu_chr_fe_printf(CharBackend *be, const char *fmt, ...)
 guint qemu_chr_fe_add_watch(CharBackend *be, GIOCondition cond,
                             GIOFunc func, void *user_data);
 
+/**
+ * @qemu_chr_fe_write_blocked:
+ *
+ * Returns true if the back end recently refused data (or its output
+ * buffer is full) and has not drained yet.  Front ends that model a
+ * transmit FIFO can use this to report it as full to the guest rather
+ * than stalling the vCPU in qemu_chr_fe_write_all().  The state is
+ * cleared from the main loop once the back end becomes writable again.
+ */
+bool qemu_chr_fe_write_blocked(CharBackend *be);
+
 /**
  * @qemu_chr_fe_write:
  *
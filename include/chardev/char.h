@@ -4,6 +4,7 @@
 #include "qapi/qapi-types-char.h"
 #include "qemu/main-loop.h"
 #include "qemu/bitmap.h"
+#include "qemu/buffer.h"
 #include "qom/object.h"
 
 #define IAC_EOR 239
@@ -65,6 +66,14 @@ struct Chardev {
     GSource *gsource;
     GMainContext *gcontext;
     DECLARE_BITMAP(features, QEMU_CHAR_FEATURE_LAST);
+
+    /* Output coalescing, protected by chr_write_lock */
+    Buffer outbuf;
+    size_t outbuf_size;         /* 0 if writes go straight to chr_write */
+    unsigned outbuf_flush_ms;
+    GSource *outbuf_timer;
+    GSource *out_watch;         /* waits for the backend to drain */
+    bool out_blocked;           /* read locklessly by the front end */
 };
 
 /**
@@ -143,6 +152,15 @@ void qemu_chr_cleanup(void);
  */
 Chardev *qemu_chr_new_noreplay(const char *label, const char *filename);
 
+/**
+ * @qemu_chr_flush_output:
+ *
+ * Write out any data coalesced in the output buffer, waiting for the
+ * backend if necessary.  Backends that support output buffering call
+ * this before tearing down their channel.
+ */
+void qemu_chr_flush_output(Chardev *s);
+
 /**
  * @qemu_chr_be_can_write:
  *
@@ -238,6 +256,7 @@ typedef struct ChardevClass {
     ObjectClass parent_class;
 
     bool internal; /* TODO: eventually use TYPE_USER_CREATABLE */
+    bool supports_outbuf; /* ChardevCommon.outbuf-size can be used */
     void (*parse)(QemuOpts *opts, ChardevBackend *backend, Error **errp);
 
     void (*open)(Chardev *chr, ChardevBackend *backend,
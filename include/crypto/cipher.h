@@ -213,6 +213,56 @@ int qcrypto_cipher_decrypt(QCryptoCipher *cipher,
                            size_t len,
                            Error **errp);
 
+/**
+ * qcrypto_cipher_encrypt_sectors:
+ * @cipher: the cipher object
+ * @ivs: the initialization vectors of all sectors, or NULL
+ * @niv: the length of each initialization vector
+ * @sectorsize: the size of each sector
+ * @in: buffer holding the plain text input data
+ * @out: buffer to fill with the cipher text output data
+ * @len: the length of @in and @out buffers, a multiple of @sectorsize
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Encrypts @len / @sectorsize sectors in one call, as if
+ * qcrypto_cipher_setiv() were called with the next @niv
+ * bytes of @ivs before encrypting each sector with
+ * qcrypto_cipher_encrypt().  If @ivs is NULL, the IV is
+ * left alone.
+ *
+ * Returns: 0 on success, or -1 on error
+ */
+int qcrypto_cipher_encrypt_sectors(QCryptoCipher *cipher,
+                                   const uint8_t *ivs, size_t niv,
+                                   size_t sectorsize,
+                                   const void *in,
+                                   void *out,
+                                   size_t len,
+                                   Error **errp);
+
+/**
+ * qcrypto_cipher_decrypt_sectors:
+ * @cipher: the cipher object
+ * @ivs: the initialization vectors of all sectors, or NULL
+ * @niv: the length of each initialization vector
+ * @sectorsize: the size of each sector
+ * @in: buffer holding the cipher text input data
+ * @out: buffer to fill with the plain text output data
+ * @len: the length of @in and @out buffers, a multiple of @sectorsize
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * The decryption counterpart of qcrypto_cipher_encrypt_sectors().
+ *
+ * Returns: 0 on success, or -1 on error
+ */
+int qcrypto_cipher_decrypt_sectors(QCryptoCipher *cipher,
+                                   const uint8_t *ivs, size_t niv,
+                                   size_t sectorsize,
+                                   const void *in,
+                                   void *out,
+                                   size_t len,
+                                   Error **errp);
+
 /**
  * qcrypto_cipher_setiv:
  * @cipher: the cipher object
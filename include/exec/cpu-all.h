@@ -260,6 +260,33 @@ int walk_memory_regions(void *, walk_memory_regions_fn);
 int page_get_flags(target_ulong address);
 void page_set_flags(target_ulong start, target_ulong end, int flags);
 int page_check_range(target_ulong start, target_ulong len, int flags);
+
+/**
+ * page_get_flags_range:
+ * @start: first address of the range
+ * @end: end of the range (exclusive)
+ *
+ * Returns: the union of the flags of the pages in [@start, @end).
+ * Unmapped parts of the range are skipped without looking at them, so
+ * this returns 0 quickly for a range that is entirely free.
+ * The mmap_lock must be held.
+ */
+int page_get_flags_range(target_ulong start, target_ulong end);
+
+/**
+ * page_find_free_below:
+ * @base: lowest acceptable address
+ * @end: end of the area to search (exclusive)
+ * @len: size of the hole to find
+ * @align: alignment of the hole, a power of 2
+ *
+ * Returns: the highest @align aligned address A such that no page in
+ * [A, A + @len) has flags and @base <= A, A + @len <= @end; or -1 if
+ * there is no such hole.  Each step skips a whole mapped area.
+ * The mmap_lock must be held.
+ */
+target_ulong page_find_free_below(target_ulong base, target_ulong end,
+                                  target_ulong len, target_ulong align);
 #endif
 
 CPUArchState *cpu_copy(CPUArchState *env);
@@ -32,6 +32,7 @@
 #include "exec/hwaddr.h"
 #endif
 #include "exec/memattrs.h"
+#include "qemu/thread.h"
 
 #ifndef TARGET_LONG_BITS
 #error TARGET_LONG_BITS must be defined before including this header
@@ -57,8 +58,16 @@ typedef uint64_t target_ulong;
 #endif
 
 #if !defined(CONFIG_USER_ONLY) && defined(CONFIG_TCG)
-/* use a fully associative victim tlb of 8 entries */
-#define CPU_VTLB_SIZE 8
+/* The victim tlb is CPU_VTLB_WAYS-way set associative, with
+ * 1 << CPU_VTLB_SET_BITS sets.  Both can be overridden at build time.
+ */
+#ifndef CPU_VTLB_SET_BITS
+#define CPU_VTLB_SET_BITS 2
+#endif
+#ifndef CPU_VTLB_WAYS
+#define CPU_VTLB_WAYS 4
+#endif
+#define CPU_VTLB_SIZE (CPU_VTLB_WAYS << CPU_VTLB_SET_BITS)
 
 #if HOST_LONG_BITS == 32 && TARGET_LONG_BITS == 32
 #define CPU_TLB_ENTRY_BITS 4
@@ -66,6 +75,23 @@ typedef uint64_t target_ulong;
 #define CPU_TLB_ENTRY_BITS 5
 #endif
 
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+/* The TLB of each MMU mode is resized at flush time, depending on how
+ * much of it was used since the previous resize.  TCG backends load the
+ * current size from env->tlb_mask and the table from env->tlb_table.
+ */
+#define CPU_TLB_DYN_MIN_BITS 6
+#define CPU_TLB_DYN_DEFAULT_BITS 8
+
+# if HOST_LONG_BITS == 32
+/* Make sure we do not require a double-word shift for the TLB load */
+#  define CPU_TLB_DYN_MAX_BITS (32 - TARGET_PAGE_BITS)
+# else
+#  define CPU_TLB_DYN_MAX_BITS 22
+# endif
+
+#else /* !TCG_TARGET_IMPLEMENTS_DYN_TLB */
+
 /* TCG_TARGET_TLB_DISPLACEMENT_BITS is used in CPU_TLB_BITS to ensure that
  * the TLB is not unnecessarily small, but still small enough for the
  * TLB lookup instruction sequence used by the TCG target.
@@ -98,6 +124,8 @@ typedef uint64_t target_ulong;
 
 #define CPU_TLB_SIZE (1 << CPU_TLB_BITS)
 
+#endif /* TCG_TARGET_IMPLEMENTS_DYN_TLB */
+
 typedef struct CPUTLBEntry {
     /* bit TARGET_LONG_BITS to TARGET_PAGE_BITS : virtual address
        bit TARGET_PAGE_BITS-1..4  : Nonzero for accesses that should not
@@ -140,17 +168,68 @@ typedef struct CPUIOTLBEntry {
     MemTxAttrs attrs;
 } CPUIOTLBEntry;
 
+typedef struct CPUTLBStats {
+    /* entries installed by tlb_set_page */
+    size_t fills;
+    /* main table misses served by the victim tlb */
+    size_t victim_hits;
+    /* misses that had to go through tlb_fill */
+    size_t misses;
+    /* page and mmu_idx flushes */
+    size_t partial_flushes;
+    /* full flushes skipped because the tlb was already clean */
+    size_t elided_flushes;
+} CPUTLBStats;
+
+#if TCG_TARGET_IMPLEMENTS_DYN_TLB
+typedef struct CPUTLBDesc {
+    /* start of the window over which the use rate is observed */
+    int64_t window_begin_ns;
+    /* maximum number of entries observed in the window */
+    size_t window_max_entries;
+    /* number of entries in use since the last flush */
+    size_t n_used_entries;
+} CPUTLBDesc;
+
+#define CPU_COMMON_TLB \
+    /* The meaning of the MMU modes is defined in the target code. */   \
+    /* tlb_mask[i] contains (n_entries - 1) << CPU_TLB_ENTRY_BITS */    \
+    uintptr_t tlb_mask[NB_MMU_MODES];                                   \
+    CPUTLBEntry *tlb_table[NB_MMU_MODES];                               \
+    CPUTLBEntry tlb_v_table[NB_MMU_MODES][CPU_VTLB_SIZE];               \
+    CPUIOTLBEntry *iotlb[NB_MMU_MODES];                                 \
+    CPUIOTLBEntry iotlb_v[NB_MMU_MODES][CPU_VTLB_SIZE];                 \
+    CPUTLBDesc tlb_d[NB_MMU_MODES];                                     \
+    /* protects tlb_table/iotlb against resizing by the owning vCPU */  \
+    QemuSpin tlb_lock;                                                  \
+    /* bitmask of the MMU modes that may hold valid entries */          \
+    uint16_t tlb_dirty;                                                 \
+    size_t tlb_flush_count;                                             \
+    CPUTLBStats tlb_stats;                                              \
+    /* area covered by large pages, flushed as a whole per MMU mode */  \
+    target_ulong tlb_large_page_addr[NB_MMU_MODES];                     \
+    target_ulong tlb_large_page_mask[NB_MMU_MODES];                     \
+    target_ulong vtlb_index;                                            \
+
+#else
+
 #define CPU_COMMON_TLB \
     /* The meaning of the MMU modes is defined in the target code. */   \
     CPUTLBEntry tlb_table[NB_MMU_MODES][CPU_TLB_SIZE];                  \
     CPUTLBEntry tlb_v_table[NB_MMU_MODES][CPU_VTLB_SIZE];               \
     CPUIOTLBEntry iotlb[NB_MMU_MODES][CPU_TLB_SIZE];                    \
     CPUIOTLBEntry iotlb_v[NB_MMU_MODES][CPU_VTLB_SIZE];                 \
+    /* bitmask of the MMU modes that may hold valid entries */          \
+    uint16_t tlb_dirty;                                                 \
     size_t tlb_flush_count;                                             \
-    target_ulong tlb_flush_addr;                                        \
-    target_ulong tlb_flush_mask;                                        \
+    CPUTLBStats tlb_stats;                                              \
+    /* area covered by large pages, flushed as a whole per MMU mode */  \
+    target_ulong tlb_large_page_addr[NB_MMU_MODES];                     \
+    target_ulong tlb_large_page_mask[NB_MMU_MODES];                     \
     target_ulong vtlb_index;                                            \
 
+#endif /* TCG_TARGET_IMPLEMENTS_DYN_TLB */
+
 #else
 
 #define CPU_COMMON_TLB
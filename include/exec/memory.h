@@ -47,6 +47,7 @@
                          TYPE_IOMMU_MEMORY_REGION)
 
 typedef struct MemoryRegionOps MemoryRegionOps;
+typedef struct MemoryRegionFastOps MemoryRegionFastOps;
 typedef struct MemoryRegionMmio MemoryRegionMmio;
 
 struct MemoryRegionMmio {
@@ -194,6 +195,22 @@ struct MemoryRegionOps {
     const MemoryRegionMmio old_mmio;
 };
 
+/*
+ * Direct accessors for a small window of a MMIO region, called by TCG
+ * without taking the global lock and without going through
+ * memory_region_dispatch_read/write.  @addr is relative to the region,
+ * just as for MemoryRegionOps.  Accesses are always naturally aligned
+ * and between @min_access_size and @max_access_size bytes; the data is
+ * never byte swapped, as for a DEVICE_NATIVE_ENDIAN region.  Either callback
+ * may be NULL, in which case that direction uses the normal path.
+ */
+struct MemoryRegionFastOps {
+    uint64_t (*read)(void *opaque, hwaddr addr, unsigned size);
+    void (*write)(void *opaque, hwaddr addr, uint64_t data, unsigned size);
+    unsigned min_access_size;
+    unsigned max_access_size;
+};
+
 enum IOMMUMemoryRegionAttr {
     IOMMU_ATTR_SPAPR_TCE_FD
 };
@@ -356,6 +373,9 @@ struct MemoryRegion {
 
     const MemoryRegionOps *ops;
     void *opaque;
+    const MemoryRegionFastOps *fast_ops;
+    hwaddr fast_addr;
+    hwaddr fast_size;
     MemoryRegion *container;
     Int128 size;
     hwaddr addr;
@@ -421,6 +441,12 @@ struct MemoryListener {
     QTAILQ_ENTRY(MemoryListener) link_as;
 };
 
+typedef struct BounceBuffer BounceBuffer;
+typedef struct AddressSpaceMapClient AddressSpaceMapClient;
+
+/* Default limit for the bounce buffers of address_space_map() */
+#define DEFAULT_MAX_BOUNCE_BUFFER_SIZE 4096
+
 /**
  * AddressSpace: describes a mapping of addresses to #MemoryRegion objects
  */
@@ -437,6 +463,15 @@ struct AddressSpace {
     struct MemoryRegionIoeventfd *ioeventfds;
     QTAILQ_HEAD(memory_listeners_as, MemoryListener) listeners;
     QTAILQ_ENTRY(AddressSpace) address_spaces_link;
+
+    /* Maximum total size of the bounce buffers mapped at the same time */
+    size_t max_bounce_buffer_size;
+    /* Total size of the bounce buffers currently mapped, accessed atomically */
+    size_t bounce_buffer_size;
+    /* Protects bounce_buffers and map_client_list */
+    QemuMutex bounce_lock;
+    QLIST_HEAD(, BounceBuffer) bounce_buffers;
+    QLIST_HEAD(, AddressSpaceMapClient) map_client_list;
 };
 
 typedef struct AddressSpaceDispatch AddressSpaceDispatch;
@@ -632,6 +667,8 @@ void memory_region_init_resizeable_ram(MemoryRegion *mr,
  * @align: alignment of the region base address; if 0, the default alignment
  *         (getpagesize()) will be used.
  * @share: %true if memory must be mmaped with the MAP_SHARED flag
+ * @readonly: %true to open an existing file read-only; requires !@share,
+ *            so that writes go to private copy-on-write pages
  * @path: the path in which to allocate the RAM.
  * @errp: pointer to Error*, to store an error if it happens.
  *
@@ -644,6 +681,7 @@ void memory_region_init_ram_from_file(MemoryRegion *mr,
                                       uint64_t size,
                                       uint64_t align,
                                       bool share,
+                                      bool readonly,
                                       const char *path,
                                       Error **errp);
 
@@ -1417,6 +1455,49 @@ void memory_region_clear_flush_coalesced(MemoryRegion *mr);
  */
 void memory_region_clear_global_locking(MemoryRegion *mr);
 
+/**
+ * memory_region_set_fast_ops: Register lockless accessors for part of an
+ *                             I/O region.
+ *
+ * Accesses from TCG that fall entirely within [@addr, @addr + @size) of
+ * @mr are handed straight to @fast_ops, skipping access size adjustment,
+ * endianness conversion, tracing and the QEMU global lock.  The callbacks
+ * must therefore be safe to run concurrently from any vCPU thread.
+ * Other accessors (KVM, DMA, the monitor) keep using the regular
+ * MemoryRegionOps, which must implement the same registers.
+ *
+ * @mr: the memory region to be updated; must be an I/O region.
+ * @addr: start of the window, relative to @mr.
+ * @size: size of the window in bytes.
+ * @fast_ops: the direct accessors, or NULL to drop the window.
+ */
+void memory_region_set_fast_ops(MemoryRegion *mr, hwaddr addr, hwaddr size,
+                                const MemoryRegionFastOps *fast_ops);
+
+/**
+ * memory_region_fast_ops: Return the lockless accessors for an access.
+ *
+ * Returns the #MemoryRegionFastOps registered with
+ * memory_region_set_fast_ops() if the access can use them, or NULL.
+ *
+ * @mr: the memory region being accessed.
+ * @addr: address of the access, relative to @mr.
+ * @size: size of the access in bytes.
+ */
+static inline const MemoryRegionFastOps *
+memory_region_fast_ops(MemoryRegion *mr, hwaddr addr, unsigned size)
+{
+    const MemoryRegionFastOps *fast_ops = mr->fast_ops;
+
+    if (likely(!fast_ops) ||
+        addr < mr->fast_addr || addr + size > mr->fast_addr + mr->fast_size ||
+        (addr & (size - 1)) ||
+        size < fast_ops->min_access_size || size > fast_ops->max_access_size) {
+        return NULL;
+    }
+    return fast_ops;
+}
+
 /**
  * memory_region_add_eventfd: Request an eventfd to be triggered when a word
  *                            is written to a location.
@@ -1987,8 +2068,11 @@ bool address_space_access_valid(AddressSpace *as, hwaddr addr, int len,
  * May map a subset of the requested range, given by and returned in @plen.
  * May return %NULL if resources needed to perform the mapping are exhausted.
  * Use only for reads OR writes - not for read-modify-write operations.
- * Use cpu_register_map_client() to know when retrying the map operation is
- * likely to succeed.
+ * Use address_space_register_map_client() to know when retrying the map
+ * operation is likely to succeed.
+ *
+ * Accesses to MMIO go through bounce buffers; at most
+ * @as->max_bounce_buffer_size bytes of them can be mapped at the same time.
  *
  * @as: #AddressSpace to be accessed
  * @addr: address within that address space
@@ -2013,6 +2097,25 @@ void *address_space_map(AddressSpace *as, hwaddr addr,
 void address_space_unmap(AddressSpace *as, void *buffer, hwaddr len,
                          int is_write, hwaddr access_len);
 
+/* address_space_register_map_client: wait for bounce buffer space
+ *
+ * Schedule @bh once a bounce buffer of @as is unmapped, or right away if
+ * there is space left.  The registration is dropped after @bh has been
+ * scheduled.
+ *
+ * @as: #AddressSpace whose address_space_map() failed
+ * @bh: bottom half to schedule
+ */
+void address_space_register_map_client(AddressSpace *as, QEMUBH *bh);
+
+/* address_space_unregister_map_client: cancel
+ * address_space_register_map_client()
+ *
+ * @as: #AddressSpace passed to address_space_register_map_client()
+ * @bh: bottom half passed to address_space_register_map_client()
+ */
+void address_space_unregister_map_client(AddressSpace *as, QEMUBH *bh);
+
 
 /* Internal functions, part of the implementation of address_space_read.  */
 MemTxResult address_space_read_full(AddressSpace *as, hwaddr addr,
@@ -72,8 +72,8 @@ static inline unsigned long int ramblock_recv_bitmap_offset(void *host_addr,
 
 long qemu_getrampagesize(void);
 RAMBlock *qemu_ram_alloc_from_file(ram_addr_t size, MemoryRegion *mr,
-                                   bool share, const char *mem_path,
-                                   Error **errp);
+                                   bool share, bool readonly,
+                                   const char *mem_path, Error **errp);
 RAMBlock *qemu_ram_alloc_from_fd(ram_addr_t size, MemoryRegion *mr,
                                  bool share, int fd,
                                  Error **errp);
@@ -234,6 +234,12 @@ static inline void cpu_physical_memory_set_dirty_flag(ram_addr_t addr,
     rcu_read_unlock();
 }
 
+void cpu_physical_memory_dirty_ring_push(ram_addr_t start, ram_addr_t length);
+void cpu_physical_memory_dirty_ring_start(void);
+void cpu_physical_memory_dirty_ring_stop(void);
+bool cpu_physical_memory_sync_dirty_ring(uint64_t *num_dirty,
+                                         uint64_t *real_dirty_pages);
+
 static inline void cpu_physical_memory_set_dirty_range(ram_addr_t start,
                                                        ram_addr_t length,
                                                        uint8_t mask)
@@ -241,12 +247,19 @@ static inline void cpu_physical_memory_set_dirty_range(ram_addr_t start,
     DirtyMemoryBlocks *blocks[DIRTY_MEMORY_NUM];
     unsigned long end, page;
     unsigned long idx, offset, base;
+    bool log_ring;
     int i;
 
     if (!mask && !xen_enabled()) {
         return;
     }
 
+    /* Only pages that become dirty need to be logged in the dirty rings */
+    log_ring = unlikely(atomic_read(&ram_list.dirty_ring_enabled)) &&
+               (mask & (1 << DIRTY_MEMORY_MIGRATION)) &&
+               !cpu_physical_memory_all_dirty(start, length,
+                                              DIRTY_MEMORY_MIGRATION);
+
     end = TARGET_PAGE_ALIGN(start + length) >> TARGET_PAGE_BITS;
     page = start >> TARGET_PAGE_BITS;
 
@@ -283,6 +296,10 @@ static inline void cpu_physical_memory_set_dirty_range(ram_addr_t start,
 
     rcu_read_unlock();
 
+    if (unlikely(log_ring)) {
+        cpu_physical_memory_dirty_ring_push(start, length);
+    }
+
     xen_hvm_modified_memory(start, length);
 }
 
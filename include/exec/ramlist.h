@@ -52,6 +52,9 @@ typedef struct RAMList {
     DirtyMemoryBlocks *dirty_memory[DIRTY_MEMORY_NUM];
     uint32_t version;
     QLIST_HEAD(, RAMBlockNotifier) ramblock_notifiers;
+    /* Dirty page rings, see cpu_physical_memory_dirty_ring_start().  */
+    bool dirty_ring_enabled;
+    bool dirty_ring_overflow;
 } RAMList;
 extern RAMList ram_list;
 
@@ -47,6 +47,33 @@ static inline unsigned int tb_jmp_cache_hash_func(target_ulong pc)
            | (tmp & TB_JMP_ADDR_MASK));
 }
 
+/* The second level cache is organized the same way, by sets: the sets
+   of a page are contiguous, and the bits within the page are mixed with
+   cs_base and flags so that several variants of a pc can coexist.  */
+#define TB_L2_PAGE_BITS (TB_L2_CACHE_BITS / 2)
+#define TB_L2_PAGE_SIZE (1 << TB_L2_PAGE_BITS)
+#define TB_L2_ADDR_MASK (TB_L2_PAGE_SIZE - 1)
+#define TB_L2_PAGE_MASK ((1 << TB_L2_CACHE_BITS) - TB_L2_PAGE_SIZE)
+
+static inline unsigned int tb_l2_cache_hash_page(target_ulong pc)
+{
+    target_ulong tmp;
+    tmp = pc ^ (pc >> (TARGET_PAGE_BITS - TB_L2_PAGE_BITS));
+    return (tmp >> (TARGET_PAGE_BITS - TB_L2_PAGE_BITS)) & TB_L2_PAGE_MASK;
+}
+
+/* Return the index of the first way of the set for (pc, cs_base, flags) */
+static inline unsigned int tb_l2_cache_hash_func(target_ulong pc,
+                                                 target_ulong cs_base,
+                                                 uint32_t flags)
+{
+    target_ulong tmp;
+    tmp = pc ^ (pc >> (TARGET_PAGE_BITS - TB_L2_PAGE_BITS));
+    return ((((tmp >> (TARGET_PAGE_BITS - TB_L2_PAGE_BITS)) & TB_L2_PAGE_MASK)
+            | ((tmp ^ cs_base ^ flags) & TB_L2_ADDR_MASK))
+            * TB_L2_CACHE_WAYS);
+}
+
 #else
 
 /* In user-mode we can get better hashing because we do not have a TLB */
@@ -55,6 +82,14 @@ static inline unsigned int tb_jmp_cache_hash_func(target_ulong pc)
     return (pc ^ (pc >> TB_JMP_CACHE_BITS)) & (TB_JMP_CACHE_SIZE - 1);
 }
 
+static inline unsigned int tb_l2_cache_hash_func(target_ulong pc,
+                                                 target_ulong cs_base,
+                                                 uint32_t flags)
+{
+    return ((pc ^ (pc >> TB_L2_CACHE_BITS) ^ cs_base ^ flags)
+            & ((1 << TB_L2_CACHE_BITS) - 1)) * TB_L2_CACHE_WAYS;
+}
+
 #endif /* CONFIG_SOFTMMU */
 
 static inline
@@ -16,6 +16,44 @@
 #include "exec/exec-all.h"
 #include "exec/tb-hash.h"
 
+static inline bool tb_lookup_cmp(CPUState *cpu, TranslationBlock *tb,
+                                 target_ulong pc, target_ulong cs_base,
+                                 uint32_t flags, uint32_t cf_mask)
+{
+    return tb &&
+           tb->pc == pc &&
+           tb->cs_base == cs_base &&
+           tb->flags == flags &&
+           tb->trace_vcpu_dstate == *cpu->trace_dstate &&
+           (tb_cflags(tb) & (CF_HASH_MASK | CF_INVALID)) == cf_mask;
+}
+
+/* Record @tb in the second level cache, replacing the ways round-robin */
+static inline void tb_l2_cache_insert(CPUState *cpu, TranslationBlock *tb)
+{
+    unsigned int set = tb_l2_cache_hash_func(tb->pc, tb->cs_base, tb->flags);
+    unsigned int way = cpu->tb_l2_cache_next++ % TB_L2_CACHE_WAYS;
+
+    atomic_set(&cpu->tb_l2_cache[set + way], tb);
+}
+
+static inline TranslationBlock *
+tb_l2_cache_lookup(CPUState *cpu, target_ulong pc, target_ulong cs_base,
+                   uint32_t flags, uint32_t cf_mask)
+{
+    unsigned int set = tb_l2_cache_hash_func(pc, cs_base, flags);
+    unsigned int i;
+
+    for (i = 0; i < TB_L2_CACHE_WAYS; i++) {
+        TranslationBlock *tb = atomic_rcu_read(&cpu->tb_l2_cache[set + i]);
+
+        if (tb_lookup_cmp(cpu, tb, pc, cs_base, flags, cf_mask)) {
+            return tb;
+        }
+    }
+    return NULL;
+}
+
 /* Might cause an exception, so have a longjmp destination ready */
 static inline TranslationBlock *
 tb_lookup__cpu_state(CPUState *cpu, target_ulong *pc, target_ulong *cs_base,
@@ -28,17 +66,22 @@ tb_lookup__cpu_state(CPUState *cpu, target_ulong *pc, target_ulong *cs_base,
     cpu_get_tb_cpu_state(env, pc, cs_base, flags);
     hash = tb_jmp_cache_hash_func(*pc);
     tb = atomic_rcu_read(&cpu->tb_jmp_cache[hash]);
-    if (likely(tb &&
-               tb->pc == *pc &&
-               tb->cs_base == *cs_base &&
-               tb->flags == *flags &&
-               tb->trace_vcpu_dstate == *cpu->trace_dstate &&
-               (tb_cflags(tb) & (CF_HASH_MASK | CF_INVALID)) == cf_mask)) {
+    if (likely(tb_lookup_cmp(cpu, tb, *pc, *cs_base, *flags, cf_mask))) {
         return tb;
     }
-    tb = tb_htable_lookup(cpu, *pc, *cs_base, *flags, cf_mask);
+    /*
+     * Try the per-vCPU second level before the shared hash table, whose
+     * buckets bounce between the vCPUs' caches.  TBs found in the hash
+     * table are recorded in the second level so that hot TBs which keep
+     * colliding in the jump cache stay local.
+     */
+    tb = tb_l2_cache_lookup(cpu, *pc, *cs_base, *flags, cf_mask);
     if (tb == NULL) {
-        return NULL;
+        tb = tb_htable_lookup(cpu, *pc, *cs_base, *flags, cf_mask);
+        if (tb == NULL) {
+            return NULL;
+        }
+        tb_l2_cache_insert(cpu, tb);
     }
     atomic_set(&cpu->tb_jmp_cache[hash], tb);
     return tb;
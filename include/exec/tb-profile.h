@@ -0,0 +1,87 @@
+/*
+ * Per-TB execution profiler
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef EXEC_TB_PROFILE_H
+#define EXEC_TB_PROFILE_H
+
+#include "qemu/fprintf-fn.h"
+
+/*
+ * When set, newly translated TBs count their executions in
+ * TranslationBlock.exec_count and cpu_tb_exec() counts how each
+ * TB chain was left in TranslationBlock.exit_count.
+ */
+extern bool tb_profile_enabled;
+
+/**
+ * tb_profile_start:
+ *
+ * Enable the profiler.  All TBs are flushed, so that the counters
+ * start from zero and every TB is translated with a counter.
+ */
+void tb_profile_start(void);
+
+/**
+ * tb_profile_stop:
+ *
+ * Disable the profiler and flush the counting code.
+ */
+void tb_profile_stop(void);
+
+/**
+ * tb_profile_dump:
+ * @f: stream for @cpu_fprintf
+ * @cpu_fprintf: output function
+ * @max: number of TBs to print
+ *
+ * Print the @max most executed TBs.
+ */
+void tb_profile_dump(FILE *f, fprintf_function cpu_fprintf, int max);
+
+/**
+ * tb_profile_jitdump_open:
+ * @dir: directory for the dump file
+ * @errp: error object
+ *
+ * Start writing a perf jitdump file, @dir/jit-<pid>.dump, with one
+ * code load record per TB.  After "perf record -k 1", "perf inject
+ * --jit" turns the records into symbols named after the guest PC, so
+ * that "perf report" attributes host samples to guest code.
+ *
+ * Returns: true on success.
+ */
+bool tb_profile_jitdump_open(const char *dir, Error **errp);
+
+/**
+ * tb_profile_jitdump_close:
+ *
+ * Stop writing the perf jitdump file.
+ */
+void tb_profile_jitdump_close(void);
+
+/**
+ * tb_profile_perfmap_open:
+ * @errp: error object
+ *
+ * Start writing /tmp/perf-<pid>.map, which "perf top" and "perf
+ * report" read directly, with one line per TB giving its host code
+ * range and guest PC.  Unlike jitdump records the lines carry no
+ * timestamp, so after a flush or region reuse perf may attribute
+ * samples to the TB that previously occupied the same host range.
+ *
+ * Returns: true on success.
+ */
+bool tb_profile_perfmap_open(Error **errp);
+
+/**
+ * tb_profile_perfmap_close:
+ *
+ * Stop writing the perf map.
+ */
+void tb_profile_perfmap_close(void);
+
+#endif
@@ -136,6 +136,15 @@ typedef struct TranslatorOps {
  * - When single-stepping is enabled (system-wide or on the current vCPU).
  * - When too many instructions have been translated.
  */
+/*
+ * tcg_superblocks:
+ *
+ * Set by "-accel tcg,superblocks=on".  Front ends that support it keep
+ * translating at the target of direct unconditional jumps instead of
+ * ending the TB, as long as the target stays within the TB's first page.
+ */
+extern bool tcg_superblocks;
+
 void translator_loop(const TranslatorOps *ops, DisasContextBase *db,
                      CPUState *cpu, TranslationBlock *tb);
 
@@ -71,6 +71,7 @@ struct SerialState {
 
     QEMUTimer *fifo_timeout_timer;
     int timeout_ipending;           /* timeout interrupt pending state */
+    QEMUTimer *xmit_flush_timer;    /* sends out xmit_fifo in one go */
 
     uint64_t char_transmit_time;    /* time to transmit a char in ticks */
     int poll_msl;
@@ -282,6 +282,7 @@ static int glue(load_elf, SZ)(const char *name, int fd,
     uint8_t *data = NULL;
     char label[128];
     int ret = ELF_LOAD_FAILED;
+    GMappedFile *mapped_file = NULL;
 
     if (read(fd, &ehdr, sizeof(ehdr)) != sizeof(ehdr))
         goto fail;
@@ -355,20 +356,29 @@ static int glue(load_elf, SZ)(const char *name, int fd,
         }
     }
 
+    /*
+     * Map the file privately rather than reading each segment into a fresh
+     * buffer: rom blobs reference the mapping directly, and pages are only
+     * copied if relocation or byte swapping writes to them.
+     */
+    mapped_file = g_mapped_file_new(name, true, NULL);
+    if (!mapped_file) {
+        goto fail;
+    }
+
     total_size = 0;
     for(i = 0; i < ehdr.e_phnum; i++) {
         ph = &phdr[i];
         if (ph->p_type == PT_LOAD) {
             mem_size = ph->p_memsz; /* Size of the ROM */
             file_size = ph->p_filesz; /* Size of the allocated data */
-            data = g_malloc0(file_size);
-            if (ph->p_filesz > 0) {
-                if (lseek(fd, ph->p_offset, SEEK_SET) < 0) {
-                    goto fail;
-                }
-                if (read(fd, data, file_size) != file_size) {
+            if (file_size > 0) {
+                if (ph->p_offset + file_size >
+                    g_mapped_file_get_length(mapped_file)) {
                     goto fail;
                 }
+                data = (uint8_t *)g_mapped_file_get_contents(mapped_file) +
+                       ph->p_offset;
             }
 
             /* The ELF spec is somewhat vague about the purpose of the
@@ -465,17 +475,15 @@ static int glue(load_elf, SZ)(const char *name, int fd,
                  * ROM blobs, because the zero-length blob can falsely
                  * trigger the overlapping-ROM-blobs check.
                  */
-                g_free(data);
             } else {
                 if (load_rom) {
                     snprintf(label, sizeof(label), "phdr #%d: %s", i, name);
 
-                    /* rom_add_elf_program() seize the ownership of 'data' */
-                    rom_add_elf_program(label, data, file_size, mem_size,
-                                        addr, as);
+                    /* rom_add_elf_program() takes a reference on the map */
+                    rom_add_elf_program(label, mapped_file, data, file_size,
+                                        mem_size, addr, as);
                 } else {
                     cpu_physical_memory_write(addr, data, file_size);
-                    g_free(data);
                 }
             }
 
@@ -489,13 +497,16 @@ static int glue(load_elf, SZ)(const char *name, int fd,
         }
     }
     g_free(phdr);
+    g_mapped_file_unref(mapped_file);
     if (lowaddr)
         *lowaddr = (uint64_t)(elf_sword)low;
     if (highaddr)
         *highaddr = (uint64_t)(elf_sword)high;
     return total_size;
  fail:
-    g_free(data);
+    if (mapped_file) {
+        g_mapped_file_unref(mapped_file);
+    }
     g_free(phdr);
     return ret;
 }
@@ -29,6 +29,11 @@
 
 #define TYPE_HTIF_UART "riscv.htif.uart"
 
+/* guest fds of the proxy kernel syscalls, see htif_handle_syscall */
+#define HTIF_MAX_FDS    64
+#define HTIF_FD_FREE    -1
+#define HTIF_FD_CONSOLE -2
+
 typedef struct HTIFState {
     int allow_tohost;
     int fromhost_inprogress;
@@ -45,6 +50,8 @@ typedef struct HTIFState {
     CPURISCVState *env;
     CharBackend chr;
     uint64_t pending_read;
+    /* host fd of each guest fd, or HTIF_FD_FREE/HTIF_FD_CONSOLE */
+    int fds[HTIF_MAX_FDS];
 } HTIFState;
 
 extern const VMStateDescription vmstate_htif;
@@ -54,6 +61,11 @@ extern const MemoryRegionOps htif_io_ops;
 void htif_symbol_callback(const char *st_name, int st_info, uint64_t st_value,
     uint64_t st_size);
 
+/* htif-tohost/htif-fromhost machine properties */
+void htif_machine_class_add_props(MachineClass *mc);
+/* whether tohost/fromhost still have to be found in the ELF symbols */
+bool htif_uses_elf_symbols(void);
+
 /* legacy pre qom */
 HTIFState *htif_mm_init(MemoryRegion *address_space, MemoryRegion *main_mem,
     CPURISCVState *env, Chardev *chr);
@@ -36,8 +36,20 @@ typedef struct SiFiveCLINTState {
     uint32_t timecmp_base;
     uint32_t time_base;
     uint32_t aperture_size;
+
+    RISCVCPU **harts;
+    /* min-heap of hart ids by timecmp, and each hart's heap index */
+    uint32_t *heap;
+    uint32_t *heap_pos;
+    uint32_t heap_len;
+    /* one timer for the whole CLINT, armed for the first timecmp */
+    QEMUTimer *timer;
+    uint64_t armed;
 } SiFiveCLINTState;
 
+#define SIFIVE_CLINT_NOT_QUEUED UINT32_MAX
+#define SIFIVE_CLINT_NOT_ARMED  UINT64_MAX
+
 DeviceState *sifive_clint_create(hwaddr addr, hwaddr size, uint32_t num_harts,
     uint32_t sip_base, uint32_t timecmp_base, uint32_t time_base);
 
@@ -28,6 +28,9 @@
 #define SIFIVE_PLIC(obj) \
     OBJECT_CHECK(SiFivePLICState, (obj), TYPE_SIFIVE_PLIC)
 
+/* source priorities are 3 bits wide, priority 0 never interrupts */
+#define SIFIVE_PLIC_PRIORITY_LEVELS 8
+
 typedef enum PLICMode {
     PLICMode_U,
     PLICMode_S,
@@ -55,6 +58,14 @@ typedef struct SiFivePLICState {
     uint32_t *pending;
     uint32_t *claimed;
     uint32_t *enable;
+    /* per context and priority: pending, enabled, unclaimed sources */
+    unsigned long *ready;
+    uint32_t ready_longs;
+    uint32_t *ready_count;
+    /* per context: mask of the priority levels with a ready source */
+    uint32_t *ready_prios;
+    /* per context: last MEIP/SEIP level sent to the hart */
+    bool *context_level;
     QemuMutex lock;
 
     /* config */
@@ -43,6 +43,13 @@ enum {
     SIFIVE_UART_IP_RXWM       = 2  /* Receive watermark interrupt pending */
 };
 
+/* watermark levels in txctrl and rxctrl */
+#define SIFIVE_UART_TXCNT(txctrl) extract32(txctrl, 16, 3)
+#define SIFIVE_UART_RXCNT(rxctrl) extract32(rxctrl, 16, 3)
+
+/* transmitted bytes are batched up to this many per chardev write */
+#define SIFIVE_UART_TX_BUF_SIZE 256
+
 #define TYPE_SIFIVE_UART "riscv.sifive.uart"
 
 #define SIFIVE_UART(obj) \
@@ -63,6 +70,11 @@ typedef struct SiFiveUARTState {
     uint32_t txctrl;
     uint32_t rxctrl;
     uint32_t div;
+    uint8_t tx_buf[SIFIVE_UART_TX_BUF_SIZE];
+    unsigned int tx_buf_len;
+    QEMUBH *tx_bh;
+    guint tx_watch;
+    bool irq_level;
 } SiFiveUARTState;
 
 SiFiveUARTState *sifive_uart_create(MemoryRegion *address_space, hwaddr base,
@@ -46,6 +46,20 @@ struct vhost_iommu {
     QLIST_ENTRY(vhost_iommu) iommu_next;
 };
 
+/*
+ * Shared buffer in which the backend records the descriptors it is
+ * processing, so that a restarted backend can resubmit them.  The
+ * layout belongs to the backend; QEMU only keeps the buffer alive
+ * across reconnects and until the device is reset.
+ */
+struct vhost_inflight {
+    int fd;
+    void *addr;
+    uint64_t size;
+    uint64_t offset;
+    uint16_t queue_size;
+};
+
 typedef struct VhostDevConfigOps {
     /* Vhost device config space changed callback
      */
@@ -120,4 +134,10 @@ int vhost_dev_set_config(struct vhost_dev *dev, const uint8_t *data,
  */
 void vhost_dev_set_config_notifier(struct vhost_dev *dev,
                                    const VhostDevConfigOps *ops);
+
+void vhost_dev_free_inflight(struct vhost_inflight *inflight);
+int vhost_dev_set_inflight(struct vhost_dev *dev,
+                           struct vhost_inflight *inflight);
+int vhost_dev_get_inflight(struct vhost_dev *dev, uint16_t queue_size,
+                           struct vhost_inflight *inflight);
 #endif
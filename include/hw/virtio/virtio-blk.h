@@ -74,11 +74,15 @@ typedef struct VirtIOBlockReq {
 } VirtIOBlockReq;
 
 #define VIRTIO_BLK_MAX_MERGE_REQS 32
+#define VIRTIO_BLK_POP_BATCH 16
 
 typedef struct MultiReqBuffer {
     VirtIOBlockReq *reqs[VIRTIO_BLK_MAX_MERGE_REQS];
     unsigned int num_reqs;
     bool is_write;
+    /* Flushes linked through mr_next, submitted as a single one */
+    VirtIOBlockReq *flush_reqs;
+    unsigned int num_flush_reqs;
 } MultiReqBuffer;
 
 bool virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq);
@@ -74,12 +74,19 @@ typedef struct VirtIOCryptoReq {
     union {
         CryptoDevBackendSymOpInfo *sym_op_info;
     } u;
+    /* Result of the backend operation, set in the worker thread */
+    uint8_t status;
+    Error *err;
+    QSIMPLEQ_ENTRY(VirtIOCryptoReq) next;
 } VirtIOCryptoReq;
 
 typedef struct VirtIOCryptoQueue {
     VirtQueue *dataq;
     QEMUBH *dataq_bh;
     struct VirtIOCrypto *vcrypto;
+    /* Requests handed to the backend as one thread pool job */
+    QSIMPLEQ_HEAD(, VirtIOCryptoReq) batch;
+    bool batch_in_flight;
 } VirtIOCryptoQueue;
 
 typedef struct VirtIOCrypto {
@@ -48,6 +48,11 @@ struct QIOChannelSocket {
     socklen_t localAddrLen;
     struct sockaddr_storage remoteAddr;
     socklen_t remoteAddrLen;
+    /* SO_ZEROCOPY has been enabled on @fd */
+    bool zero_copy_enabled;
+    /* MSG_ZEROCOPY sendmsg calls issued, and completed by the kernel */
+    uint64_t zero_copy_queued;
+    uint64_t zero_copy_sent;
 };
 
 
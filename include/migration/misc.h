@@ -18,6 +18,23 @@
 
 /* migration/ram.c */
 
+typedef enum PrecopyNotifyReason {
+    PRECOPY_NOTIFY_SETUP = 0,
+    PRECOPY_NOTIFY_BEFORE_BITMAP_SYNC = 1,
+    PRECOPY_NOTIFY_AFTER_BITMAP_SYNC = 2,
+    PRECOPY_NOTIFY_COMPLETE = 3,
+    PRECOPY_NOTIFY_CLEANUP = 4,
+} PrecopyNotifyReason;
+
+/*
+ * The notifiers get a pointer to the PrecopyNotifyReason as data.  They
+ * are called with the iothread lock held.
+ */
+void precopy_add_notifier(Notifier *n);
+void precopy_remove_notifier(Notifier *n);
+void precopy_enable_free_page_hints(void);
+void qemu_guest_free_page_hint(void *addr, size_t len);
+
 void ram_mig_init(void);
 
 /* migration/block.c */
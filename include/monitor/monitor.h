@@ -20,6 +20,7 @@ bool monitor_cur_is_qmp(void);
 void monitor_init_globals(void);
 void monitor_init(Chardev *chr, int flags);
 void monitor_cleanup(void);
+void monitor_fork_child(void);
 
 int monitor_suspend(Monitor *mon);
 void monitor_resume(Monitor *mon);
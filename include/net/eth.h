@@ -72,7 +72,10 @@ typedef struct tcp_header {
 #define TCP_HEADER_FLAGS(tcp) \
     TCP_FLAGS_ONLY(be16_to_cpu((tcp)->th_offset_flags))
 
+#define TCP_FLAG_FIN  0x01
+#define TCP_FLAG_PSH  0x08
 #define TCP_FLAG_ACK  0x10
+#define TCP_FLAG_CWR  0x80
 
 #define TCP_HEADER_DATA_OFFSET(tcp) \
     (((be16_to_cpu((tcp)->th_offset_flags) >> 12) & 0xf) << 2)
@@ -2,6 +2,7 @@
 #define QEMU_NET_H
 
 #include "qemu/queue.h"
+#include "qemu/stats64.h"
 #include "qapi/qapi-types-net.h"
 #include "net/queue.h"
 #include "migration/vmstate.h"
@@ -98,6 +99,9 @@ struct NetClientState {
     int vring_enable;
     int vnet_hdr_len;
     QTAILQ_HEAD(NetFilterHead, NetFilterState) filters;
+    /* Packets delivered to and sent by this client, for query-stats */
+    Stat64 rx_packets, rx_bytes;
+    Stat64 tx_packets, tx_bytes;
 };
 
 typedef struct NICState {
@@ -15,8 +15,32 @@
 #define QEMU_JSON_PARSER_H
 
 #include "qemu-common.h"
+#include "qapi/qmp/json-lexer.h"
 
-QObject *json_parser_parse(GQueue *tokens, va_list *ap);
-QObject *json_parser_parse_err(GQueue *tokens, va_list *ap, Error **errp);
+/*
+ * The parser is fed one token at a time and builds the QObject as it
+ * goes, so that no token outlives the lexer's buffer.
+ */
+typedef struct JSONParser {
+    va_list *ap;
+    int state;
+    /* Containers being built, with their pending keys; innermost last */
+    GArray *stack;
+    QObject *result;
+    Error *err;
+} JSONParser;
+
+void json_parser_init(JSONParser *parser, va_list *ap);
+
+void json_parser_feed(JSONParser *parser, JSONTokenType type,
+                      const char *str, size_t len);
+
+/* Return the value fed since the last call, or NULL with @errp set */
+QObject *json_parser_finish(JSONParser *parser, Error **errp);
+
+/* Throw away the partially parsed value, if any */
+void json_parser_reset(JSONParser *parser);
+
+void json_parser_destroy(JSONParser *parser);
 
 #endif
@@ -15,26 +15,30 @@
 #define QEMU_JSON_STREAMER_H
 
 #include "qapi/qmp/json-lexer.h"
-
-typedef struct JSONToken {
-    int type;
-    int x;
-    int y;
-    char str[];
-} JSONToken;
+#include "qapi/qmp/json-parser.h"
 
 typedef struct JSONMessageParser
 {
-    void (*emit)(struct JSONMessageParser *parser, GQueue *tokens);
+    void (*emit)(void *opaque, QObject *json, Error *err);
+    void *opaque;
     JSONLexer lexer;
+    JSONParser parser;
     int brace_count;
     int bracket_count;
-    GQueue *tokens;
+    uint64_t token_count;
     uint64_t token_size;
 } JSONMessageParser;
 
+/*
+ * @emit is called with each complete JSON value, or with NULL and the
+ * parse error.  The error is NULL if the lexer rejected the input or a
+ * limit was exceeded.  @emit takes ownership of both.  @ap supplies the
+ * values of %-escapes, which are rejected when it is NULL.
+ */
 void json_message_parser_init(JSONMessageParser *parser,
-                              void (*func)(JSONMessageParser *, GQueue *));
+                              void (*emit)(void *opaque, QObject *json,
+                                           Error *err),
+                              void *opaque, va_list *ap);
 
 int json_message_parser_feed(JSONMessageParser *parser,
                              const char *buffer, size_t size);
@@ -159,6 +159,8 @@ int qemu_strtosz_metric(const char *nptr, char **end, uint64_t *result);
 #define STR_OR_NULL(str) ((str) ? (str) : "null")
 
 bool buffer_is_zero(const void *buf, size_t len);
+#define BUFFER_ZERO_LINE_SIZE 64
+size_t buffer_find_nonzero_offset(const void *buf, size_t len);
 bool test_buffer_is_zero_next_accel(void);
 
 /*
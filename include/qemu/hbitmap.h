@@ -243,6 +243,20 @@ void hbitmap_deserialize_zeroes(HBitmap *hb, uint64_t start, uint64_t count,
 void hbitmap_deserialize_ones(HBitmap *hb, uint64_t start, uint64_t count,
                               bool finish);
 
+/**
+ * hbitmap_deserialize_or
+ * @hb: HBitmap to operate on.
+ * @buf: Buffer to read bitmap data from.
+ * @start: First bit to restore.
+ * @count: Number of bits to restore.
+ *
+ * Like hbitmap_deserialize_part, but sets the bits that are set in @buf
+ * without clearing any, and keeps the HBitmap consistent so that no call to
+ * hbitmap_deserialize_finish is needed.
+ */
+void hbitmap_deserialize_or(HBitmap *hb, const uint8_t *buf,
+                            uint64_t start, uint64_t count);
+
 /**
  * hbitmap_deserialize_finish
  * @hb: HBitmap to operate on.
@@ -0,0 +1,50 @@
+/*
+ * Event loop and vCPU latency profiler
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_LOOP_PROFILE_H
+#define QEMU_LOOP_PROFILE_H
+
+#include "qapi/qapi-types-misc.h"
+#include "qemu/atomic.h"
+#include "qemu/timer.h"
+
+/* Element n counts durations shorter than 1024 << n ns */
+#define LOOP_PROFILE_HISTOGRAM_BUCKETS 16
+
+extern bool loop_profile_enabled;
+
+/**
+ * loop_profile_start:
+ *
+ * Returns: a timestamp to pass to loop_profile_end(), or 0 if the profiler
+ * is disabled.
+ */
+static inline int64_t loop_profile_start(void)
+{
+    return unlikely(atomic_read(&loop_profile_enabled)) ? get_clock() : 0;
+}
+
+void loop_profile_record(LoopProfileKind kind, const void *callback,
+                         int64_t start);
+
+/**
+ * loop_profile_end:
+ * @kind: what was measured
+ * @callback: function the time is accounted to
+ * @start: the value returned by loop_profile_start()
+ *
+ * Account the time since @start to @callback.
+ */
+static inline void loop_profile_end(LoopProfileKind kind,
+                                    const void *callback, int64_t start)
+{
+    if (unlikely(start)) {
+        loop_profile_record(kind, callback, start);
+    }
+}
+
+#endif
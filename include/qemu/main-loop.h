@@ -251,6 +251,20 @@ AioContext *iohandler_get_aio_context(void);
  * @pid: The pid that QEMU should observe.
  */
 int qemu_add_child_watch(pid_t pid);
+
+typedef void ChildWatchFunc(pid_t pid, int status, void *opaque);
+
+/**
+ * qemu_add_child_watch_full: Register a child process for reaping.
+ *
+ * Like qemu_add_child_watch(), but call @cb with the status returned
+ * by waitpid once the child has been reaped.
+ *
+ * @pid: The pid that QEMU should observe.
+ * @cb: The function to call when the child exits.
+ * @opaque: Passed to @cb.
+ */
+int qemu_add_child_watch_full(pid_t pid, ChildWatchFunc *cb, void *opaque);
 #endif
 
 /**
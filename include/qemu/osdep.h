@@ -536,7 +536,28 @@ unsigned long qemu_getauxval(unsigned long type);
 
 void qemu_set_tty_echo(int fd, bool echo);
 
+typedef void MemPreallocProgress(size_t done, size_t total, void *opaque);
+
+/**
+ * os_mem_prealloc:
+ * @fd: the file descriptor backing @area, or -1
+ * @area: the memory to allocate
+ * @sz: the size of @area
+ * @smp_cpus: upper bound on the number of threads to use
+ * @host_nodes: bitmap of the host NUMA nodes @area is bound to, or NULL
+ * @max_node: the number of bits in @host_nodes
+ * @progress: if not NULL, called about once a second with the number of
+ * bytes allocated so far
+ * @opaque: passed to @progress
+ * @errp: returns an error if the host runs out of memory
+ *
+ * Allocate the host pages of @area, so that the guest never waits for
+ * them to be faulted in and cannot fail for lack of host memory later.
+ * With @host_nodes, the work is done from the CPUs of those nodes.
+ */
 void os_mem_prealloc(int fd, char *area, size_t sz, int smp_cpus,
+                     const unsigned long *host_nodes, unsigned long max_node,
+                     MemPreallocProgress *progress, void *opaque,
                      Error **errp);
 
 /**
@@ -85,6 +85,24 @@ void qht_destroy(struct qht *ht);
  */
 bool qht_insert(struct qht *ht, void *p, uint32_t hash, void **existing);
 
+/**
+ * qht_insert_bulk - Insert many pointers into the hash table
+ * @ht: QHT to insert to
+ * @ps: array of @n pointers to be inserted
+ * @hashes: array of the @n hashes corresponding to @ps
+ * @n: number of entries
+ *
+ * Equivalent to calling qht_insert() on each pair, except that with
+ * QHT_MODE_AUTO_RESIZE the table is first grown once so that it can hold
+ * @n entries, instead of growing repeatedly while the entries are added.
+ * This is meant for populating a table from a known set of entries.
+ *
+ * Returns the number of entries that were inserted, i.e. that did not
+ * have an equivalent entry in the table already.
+ */
+size_t qht_insert_bulk(struct qht *ht, void *const *ps, const uint32_t *hashes,
+                       size_t n);
+
 /**
  * qht_lookup_custom - Look up a pointer using a custom comparison function.
  * @ht: QHT to be looked up
@@ -164,6 +182,9 @@ bool qht_reset_size(struct qht *ht, size_t n_elems);
  * @ht: QHT to be resized
  * @n_elems: number of entries the resized hash table should be optimized for
  *
+ * Doubling the number of buckets is done incrementally, so that concurrent
+ * writers are not blocked until the whole table has been copied.
+ *
  * Returns true on success.
  * Returns false if the resize was not necessary and therefore not performed.
  * See also: qht_reset_size().
@@ -153,6 +153,11 @@ bool throttle_schedule_timer(ThrottleState *ts,
                              bool is_write);
 
 void throttle_account(ThrottleState *ts, bool is_write, uint64_t size);
+double throttle_op_units(uint64_t op_size, uint64_t size);
+void throttle_budget(ThrottleState *ts, bool is_write, int64_t ns,
+                     double *units, double *bytes);
+void throttle_account_budget(ThrottleState *ts, bool is_write,
+                             double units, double bytes);
 void throttle_limits_to_config(ThrottleLimits *arg, ThrottleConfig *cfg,
                                Error **errp);
 void throttle_config_to_limits(ThrottleConfig *cfg, ThrottleLimits *var);
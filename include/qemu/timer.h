@@ -66,7 +66,8 @@ struct QEMUTimer {
     QEMUTimerList *timer_list;
     QEMUTimerCB *cb;
     void *opaque;
-    QEMUTimer *next;
+    uint64_t seq;               /* arming order, breaks expire_time ties */
+    size_t heap_index;          /* position in the timer list heap */
     int scale;
 };
 
@@ -27,6 +27,7 @@
 #include "qapi/qapi-types-run-state.h"
 #include "qemu/bitmap.h"
 #include "qemu/queue.h"
+#include "qemu/stats64.h"
 #include "qemu/thread.h"
 
 typedef int (*WriteCoreDumpFunction)(const void *buf, size_t size,
@@ -250,6 +251,11 @@ struct hax_vcpu_state;
 #define TB_JMP_CACHE_BITS 12
 #define TB_JMP_CACHE_SIZE (1 << TB_JMP_CACHE_BITS)
 
+/* Second level, set associative TB lookup cache */
+#define TB_L2_CACHE_BITS 10
+#define TB_L2_CACHE_WAYS 4
+#define TB_L2_CACHE_SIZE (TB_L2_CACHE_WAYS << TB_L2_CACHE_BITS)
+
 /* work queue */
 
 /* The union type allows passing of 64 bit target pointers on 32 bit
@@ -292,6 +298,8 @@ struct qemu_work_item;
  * @crash_occurred: Indicates the OS reported a crash (panic) for this CPU
  * @singlestep_enabled: Flags for single-stepping.
  * @icount_extra: Instructions until next timer event.
+ * @tcg_rr_avg_insns: Moving average of the instructions executed per
+ * round-robin time slice, used to size the next slice in icount mode.
  * @icount_decr: Low 16 bits: number of cycles left, only used in icount mode.
  * High 16 bits: Set to -1 to force TCG to stop executing linked TBs for this
  * CPU and return to its top level loop (even in non-icount mode).
@@ -305,6 +313,8 @@ struct qemu_work_item;
  * @num_ases: number of CPUAddressSpaces in @cpu_ases
  * @as: Pointer to the first AddressSpace, for the convenience of targets which
  *      only have a single AddressSpace
+ * @dirty_ring: Pages this CPU dirtied since the last migration bitmap sync.
+ * @dirty_pages: Pages harvested from @dirty_ring since it was created.
  * @env_ptr: Pointer to subclass-specific CPUArchState field.
  * @gdb_regs: Additional GDB registers.
  * @gdb_num_regs: Number of total registers accessible to GDB.
@@ -316,6 +326,9 @@ struct qemu_work_item;
  * @kvm_fd: vCPU file descriptor for KVM.
  * @work_mutex: Lock to prevent multiple access to queued_work_*.
  * @queued_work_first: First asynchronous work pending.
+ * @halts: Number of times the vCPU thread went to sleep on @halt_cond.
+ * @kicks: Number of times the vCPU was kicked out of guest execution.
+ * @work_items: Number of run_on_cpu and async_run_on_cpu items executed.
  * @trace_dstate_delayed: Delayed changes to trace_dstate (includes all changes
  *                        to @trace_dstate).
  * @trace_dstate: Dynamic tracing state of events for this vCPU (bitmask).
@@ -353,20 +366,30 @@ struct CPUState {
     int singlestep_enabled;
     int64_t icount_budget;
     int64_t icount_extra;
+    int64_t tcg_rr_avg_insns;
     sigjmp_buf jmp_env;
 
     QemuMutex work_mutex;
     struct qemu_work_item *queued_work_first, *queued_work_last;
 
+    Stat64 halts;
+    Stat64 kicks;
+    Stat64 work_items;
+
     CPUAddressSpace *cpu_ases;
     int num_ases;
     AddressSpace *as;
     MemoryRegion *memory;
+    DirtyRing *dirty_ring;
+    uint64_t dirty_pages;
 
     void *env_ptr; /* CPUArchState */
 
     /* Accessed in parallel; all accesses must be atomic */
     struct TranslationBlock *tb_jmp_cache[TB_JMP_CACHE_SIZE];
+    struct TranslationBlock *tb_l2_cache[TB_L2_CACHE_SIZE];
+    /* only used by the vCPU thread */
+    unsigned int tb_l2_cache_next;
 
     struct GDBRegisterState *gdb_regs;
     int gdb_num_regs;
@@ -408,6 +431,8 @@ struct CPUState {
      * autoconverge
      */
     bool throttle_thread_scheduled;
+    /* Throttle percentage of this vcpu alone, see cpu_throttle_set_vcpu */
+    int throttle_percentage;
 
     bool ignore_memory_transaction_failures;
 
@@ -453,6 +478,9 @@ static inline void cpu_tb_jmp_cache_clear(CPUState *cpu)
     for (i = 0; i < TB_JMP_CACHE_SIZE; i++) {
         atomic_set(&cpu->tb_jmp_cache[i], NULL);
     }
+    for (i = 0; i < TB_L2_CACHE_SIZE; i++) {
+        atomic_set(&cpu->tb_l2_cache[i], NULL);
+    }
 }
 
 /**
@@ -838,6 +866,27 @@ bool cpu_throttle_active(void);
  */
 int cpu_throttle_get_percentage(void);
 
+/**
+ * cpu_throttle_set_vcpu:
+ * @cpu: The vcpu to throttle.
+ * @new_throttle_pct: Percent of sleep time. Valid range is 0 to 99.
+ *
+ * Like cpu_throttle_set, but throttles @cpu alone.  The vcpu sleeps for
+ * the higher of its own percentage and the one of cpu_throttle_set.
+ * A percentage of 0 stops throttling @cpu alone; cpu_throttle_stop stops
+ * it for all vcpus.
+ */
+void cpu_throttle_set_vcpu(CPUState *cpu, int new_throttle_pct);
+
+/**
+ * cpu_throttle_get_vcpu_percentage:
+ * @cpu: The vcpu to query.
+ *
+ * Returns: The throttle percentage of @cpu alone, 0 if it is not
+ * throttled on its own. See cpu_throttle_set_vcpu for details.
+ */
+int cpu_throttle_get_vcpu_percentage(CPUState *cpu);
+
 #ifndef CONFIG_USER_ONLY
 
 typedef void (*CPUInterruptHandler)(CPUState *, int);
@@ -297,6 +297,10 @@ int cryptodev_backend_sym_close_session(
  * Do crypto operation, such as encryption and
  * decryption
  *
+ * This can be called from a worker thread without the BQL, but never
+ * concurrently with session creation or closing, or with another
+ * operation on the same queue.
+ *
  * Returns: VIRTIO_CRYPTO_OK on success,
  *         or -VIRTIO_CRYPTO_* on error
  */
@@ -185,6 +185,50 @@ DEFINE_LDST_DMA(q, q, 64, be);
 
 #undef DEFINE_LDST_DMA
 
+/*
+ * A DMAWindow caches the translation of a guest buffer that a device
+ * accesses over and over, such as a descriptor ring or a completion
+ * queue.  Accesses that fall inside the window and hit RAM are a
+ * memcpy; everything else, including accesses outside the window and
+ * windows that map MMIO or an IOMMU, goes through dma_memory_rw().
+ * The window is remapped lazily after any change to the memory map
+ * of the address space, so it can be kept for the lifetime of a ring.
+ *
+ * A window must only be used by one thread at a time.
+ */
+typedef struct DMAWindow {
+    AddressSpace *as;
+    dma_addr_t addr;
+    dma_addr_t len;
+    bool writable;
+    MemoryRegionCache cache;
+} DMAWindow;
+
+void dma_window_init(DMAWindow *w, AddressSpace *as, bool writable);
+void dma_window_set(DMAWindow *w, dma_addr_t addr, dma_addr_t len);
+void dma_window_destroy(DMAWindow *w);
+int dma_window_rw(DMAWindow *w, dma_addr_t addr, void *buf, dma_addr_t len,
+                  DMADirection dir);
+
+static inline bool dma_window_contains(DMAWindow *w, dma_addr_t addr,
+                                       dma_addr_t len)
+{
+    return addr - w->addr < w->len && len <= w->len - (addr - w->addr);
+}
+
+static inline int dma_window_read(DMAWindow *w, dma_addr_t addr,
+                                  void *buf, dma_addr_t len)
+{
+    return dma_window_rw(w, addr, buf, len, DMA_DIRECTION_TO_DEVICE);
+}
+
+static inline int dma_window_write(DMAWindow *w, dma_addr_t addr,
+                                   const void *buf, dma_addr_t len)
+{
+    return dma_window_rw(w, addr, (void *)buf, len,
+                         DMA_DIRECTION_FROM_DEVICE);
+}
+
 struct ScatterGatherEntry {
     dma_addr_t base;
     dma_addr_t len;
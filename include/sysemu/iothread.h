@@ -31,6 +31,7 @@ typedef struct {
     QemuCond init_done_cond;    /* is thread initialization done? */
     bool stopping;              /* has iothread_stop() been called? */
     bool running;               /* should iothread_run() continue? */
+    bool fork_stopped;          /* stopped by iothread_fork_prepare() */
     int thread_id;
 
     /* AioContext poll parameters */
@@ -56,4 +57,24 @@ IOThread *iothread_create(const char *id, Error **errp);
 void iothread_stop(IOThread *iothread);
 void iothread_destroy(IOThread *iothread);
 
+/**
+ * iothread_fork_prepare:
+ * @errp: error object
+ *
+ * Stop all iothreads, including internal ones, and get their AioContexts
+ * ready for fork() with aio_context_fork_prepare().  Call iothread_fork_done()
+ * in both the parent and the child to start them again.  On failure the
+ * iothreads are already restarted.
+ *
+ * Returns: false on failure.
+ */
+bool iothread_fork_prepare(Error **errp);
+
+/**
+ * iothread_fork_done:
+ *
+ * Restart the iothreads stopped by iothread_fork_prepare().
+ */
+void iothread_fork_done(void);
+
 #endif /* IOTHREAD_H */
@@ -0,0 +1,46 @@
+/*
+ * Counters for query-stats
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef SYSEMU_STATS_H
+#define SYSEMU_STATS_H
+
+#include "qapi/qapi-types-misc.h"
+
+/*
+ * The collectors run in the monitor with the BQL held.  They must only
+ * read counters that can be sampled from any thread, i.e. Stat64 or
+ * atomic_read(), and never wait for a vCPU to reach a safe point.
+ */
+
+/**
+ * stats_result_add:
+ * @tail: where to append the new element; advanced past it
+ * @target: kind of the object
+ * @id: identifier of the object, or %NULL
+ *
+ * Returns: a new #StatsResult with no counters, appended to the list.
+ */
+StatsResult *stats_result_add(StatsResultList ***tail, StatsTarget target,
+                              const char *id);
+
+/**
+ * stats_add:
+ * @result: the object's #StatsResult
+ * @name: name of the counter
+ * @value: value of the counter
+ *
+ * Append a counter to @result.
+ */
+void stats_add(StatsResult *result, const char *name, uint64_t value);
+
+void vcpu_collect_stats(StatsResultList ***tail);
+void tlb_collect_stats(StatsResultList ***tail);
+void tb_cache_collect_stats(StatsResultList ***tail);
+void block_collect_stats(StatsResultList ***tail);
+void net_collect_stats(StatsResultList ***tail);
+
+#endif
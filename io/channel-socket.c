@@ -25,6 +25,14 @@
 #include "io/channel-watch.h"
 #include "trace.h"
 #include "qapi/clone-visitor.h"
+#ifdef CONFIG_LINUX
+#include <linux/errqueue.h>
+#include <poll.h>
+
+#if defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY)
+#define QEMU_MSG_ZEROCOPY
+#endif
+#endif
 
 #define SOCKET_MAX_FDS 16
 
@@ -109,6 +117,14 @@ qio_channel_socket_set_fd(QIOChannelSocket *sioc,
     }
 #endif /* WIN32 */
 
+#ifdef QEMU_MSG_ZEROCOPY
+    if (sioc->localAddr.ss_family == AF_INET ||
+        sioc->localAddr.ss_family == AF_INET6) {
+        QIOChannel *ioc = QIO_CHANNEL(sioc);
+        qio_channel_set_feature(ioc, QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY);
+    }
+#endif
+
     return 0;
 
  error:
@@ -640,6 +656,131 @@ static ssize_t qio_channel_socket_writev(QIOChannel *ioc,
 }
 #endif /* WIN32 */
 
+#ifdef QEMU_MSG_ZEROCOPY
+static int qio_channel_socket_flush(QIOChannel *ioc,
+                                    Error **errp);
+
+static ssize_t qio_channel_socket_writev_zero_copy(QIOChannel *ioc,
+                                                   const struct iovec *iov,
+                                                   size_t niov,
+                                                   Error **errp)
+{
+    QIOChannelSocket *sioc = QIO_CHANNEL_SOCKET(ioc);
+    struct msghdr msg = { NULL, };
+    bool flushed = false;
+    ssize_t ret;
+
+    if (!sioc->zero_copy_enabled) {
+        int v = 1;
+
+        if (setsockopt(sioc->fd, SOL_SOCKET, SO_ZEROCOPY, &v, sizeof(v))) {
+            error_setg_errno(errp, errno, "Unable to enable SO_ZEROCOPY");
+            return -1;
+        }
+        sioc->zero_copy_enabled = true;
+    }
+
+    msg.msg_iov = (struct iovec *)iov;
+    msg.msg_iovlen = niov;
+
+ retry:
+    ret = sendmsg(sioc->fd, &msg, MSG_ZEROCOPY);
+    if (ret <= 0) {
+        if (errno == EAGAIN) {
+            return QIO_CHANNEL_ERR_BLOCK;
+        }
+        if (errno == EINTR) {
+            goto retry;
+        }
+        if (errno == ENOBUFS && !flushed) {
+            /*
+             * Too much memory pinned for the socket's optmem limit:
+             * reap the completions, which unpins it, and try again.
+             */
+            if (qio_channel_socket_flush(ioc, errp) < 0) {
+                return -1;
+            }
+            flushed = true;
+            goto retry;
+        }
+        error_setg_errno(errp, errno,
+                         "Unable to write to socket");
+        return -1;
+    }
+    sioc->zero_copy_queued++;
+    return ret;
+}
+
+static int qio_channel_socket_flush(QIOChannel *ioc,
+                                    Error **errp)
+{
+    QIOChannelSocket *sioc = QIO_CHANNEL_SOCKET(ioc);
+    char control[CMSG_SPACE(sizeof(struct sock_extended_err))];
+    bool copied = false;
+
+    while (sioc->zero_copy_sent < sioc->zero_copy_queued) {
+        struct msghdr msg = { NULL, };
+        struct sock_extended_err *serr;
+        struct cmsghdr *cm;
+        ssize_t ret;
+
+        memset(control, 0, sizeof(control));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        ret = recvmsg(sioc->fd, &msg, MSG_ERRQUEUE);
+        if (ret < 0) {
+            if (errno == EAGAIN) {
+                /* Completions are reported as POLLERR */
+                struct pollfd pfd = { .fd = sioc->fd, .events = POLLERR };
+
+                if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+                    error_setg_errno(errp, errno, "Unable to poll socket");
+                    return -1;
+                }
+                continue;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            error_setg_errno(errp, errno,
+                             "Unable to read socket error queue");
+            return -1;
+        }
+
+        cm = CMSG_FIRSTHDR(&msg);
+        if (!cm ||
+            !((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+              (cm->cmsg_level == SOL_IPV6 &&
+               cm->cmsg_type == IPV6_RECVERR))) {
+            error_setg_errno(errp, EPROTOTYPE,
+                             "Wrong cmsg in socket error queue");
+            return -1;
+        }
+
+        serr = (void *)CMSG_DATA(cm);
+        if (serr->ee_errno != 0) {
+            error_setg_errno(errp, serr->ee_errno,
+                             "Error on socket");
+            return -1;
+        }
+        if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+            error_setg(errp, "Unexpected origin %d in socket error queue",
+                       serr->ee_origin);
+            return -1;
+        }
+
+        /* One notification covers the sendmsg calls ee_info..ee_data */
+        sioc->zero_copy_sent += serr->ee_data - serr->ee_info + 1;
+        if (serr->ee_code == SO_EE_CODE_ZEROCOPY_COPIED) {
+            copied = true;
+        }
+    }
+
+    return copied;
+}
+#endif /* QEMU_MSG_ZEROCOPY */
+
 static int
 qio_channel_socket_set_blocking(QIOChannel *ioc,
                                 bool enabled,
@@ -779,6 +920,10 @@ static void qio_channel_socket_class_init(ObjectClass *klass,
     ioc_klass->io_set_delay = qio_channel_socket_set_delay;
     ioc_klass->io_create_watch = qio_channel_socket_create_watch;
     ioc_klass->io_set_aio_fd_handler = qio_channel_socket_set_aio_fd_handler;
+#ifdef QEMU_MSG_ZEROCOPY
+    ioc_klass->io_writev_zero_copy = qio_channel_socket_writev_zero_copy;
+    ioc_klass->io_flush = qio_channel_socket_flush;
+#endif
 }
 
 static const TypeInfo qio_channel_socket_info = {
@@ -151,11 +151,13 @@ int qio_channel_readv_all(QIOChannel *ioc,
     return ret;
 }
 
-int qio_channel_writev_all(QIOChannel *ioc,
-                           const struct iovec *iov,
-                           size_t niov,
-                           Error **errp)
+static int qio_channel_writev_all_internal(QIOChannel *ioc,
+                                          const struct iovec *iov,
+                                          size_t niov,
+                                          bool zero_copy,
+                                          Error **errp)
 {
+    QIOChannelClass *klass = QIO_CHANNEL_GET_CLASS(ioc);
     int ret = -1;
     struct iovec *local_iov = g_new(struct iovec, niov);
     struct iovec *local_iov_head = local_iov;
@@ -167,7 +169,12 @@ int qio_channel_writev_all(QIOChannel *ioc,
 
     while (nlocal_iov > 0) {
         ssize_t len;
-        len = qio_channel_writev(ioc, local_iov, nlocal_iov, errp);
+        if (zero_copy) {
+            len = klass->io_writev_zero_copy(ioc, local_iov, nlocal_iov,
+                                             errp);
+        } else {
+            len = qio_channel_writev(ioc, local_iov, nlocal_iov, errp);
+        }
         if (len == QIO_CHANNEL_ERR_BLOCK) {
             if (qemu_in_coroutine()) {
                 qio_channel_yield(ioc, G_IO_OUT);
@@ -189,6 +196,44 @@ int qio_channel_writev_all(QIOChannel *ioc,
     return ret;
 }
 
+int qio_channel_writev_all(QIOChannel *ioc,
+                           const struct iovec *iov,
+                           size_t niov,
+                           Error **errp)
+{
+    return qio_channel_writev_all_internal(ioc, iov, niov, false, errp);
+}
+
+int qio_channel_writev_zero_copy_all(QIOChannel *ioc,
+                                     const struct iovec *iov,
+                                     size_t niov,
+                                     Error **errp)
+{
+    QIOChannelClass *klass = QIO_CHANNEL_GET_CLASS(ioc);
+
+    if (!qio_channel_has_feature(ioc, QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY) ||
+        !klass->io_writev_zero_copy) {
+        error_setg_errno(errp, ENOTSUP,
+                         "Channel does not support zero copy writes");
+        return -1;
+    }
+
+    return qio_channel_writev_all_internal(ioc, iov, niov, true, errp);
+}
+
+int qio_channel_flush(QIOChannel *ioc,
+                      Error **errp)
+{
+    QIOChannelClass *klass = QIO_CHANNEL_GET_CLASS(ioc);
+
+    if (!klass->io_flush ||
+        !qio_channel_has_feature(ioc, QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY)) {
+        return 0;
+    }
+
+    return klass->io_flush(ioc, errp);
+}
+
 ssize_t qio_channel_readv(QIOChannel *ioc,
                           const struct iovec *iov,
                           size_t niov,
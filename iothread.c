@@ -139,15 +139,38 @@ static void iothread_instance_finalize(Object *obj)
     qemu_mutex_destroy(&iothread->init_done_lock);
 }
 
-static void iothread_complete(UserCreatable *obj, Error **errp)
+static void iothread_start(IOThread *iothread)
 {
-    Error *local_error = NULL;
-    IOThread *iothread = IOTHREAD(obj);
     char *name, *thread_name;
 
     iothread->stopping = false;
     iothread->running = true;
     iothread->thread_id = -1;
+
+    /* This assumes we are called from a thread with useful CPU affinity for us
+     * to inherit.
+     */
+    name = object_get_canonical_path_component(OBJECT(iothread));
+    thread_name = g_strdup_printf("IO %s", name);
+    qemu_thread_create(&iothread->thread, thread_name, iothread_run,
+                       iothread, QEMU_THREAD_JOINABLE);
+    g_free(thread_name);
+    g_free(name);
+
+    /* Wait for initialization to complete */
+    qemu_mutex_lock(&iothread->init_done_lock);
+    while (iothread->thread_id == -1) {
+        qemu_cond_wait(&iothread->init_done_cond,
+                       &iothread->init_done_lock);
+    }
+    qemu_mutex_unlock(&iothread->init_done_lock);
+}
+
+static void iothread_complete(UserCreatable *obj, Error **errp)
+{
+    Error *local_error = NULL;
+    IOThread *iothread = IOTHREAD(obj);
+
     iothread->ctx = aio_context_new(&local_error);
     if (!iothread->ctx) {
         error_propagate(errp, local_error);
@@ -170,23 +193,7 @@ static void iothread_complete(UserCreatable *obj, Error **errp)
     qemu_cond_init(&iothread->init_done_cond);
     iothread->once = (GOnce) G_ONCE_INIT;
 
-    /* This assumes we are called from a thread with useful CPU affinity for us
-     * to inherit.
-     */
-    name = object_get_canonical_path_component(OBJECT(obj));
-    thread_name = g_strdup_printf("IO %s", name);
-    qemu_thread_create(&iothread->thread, thread_name, iothread_run,
-                       iothread, QEMU_THREAD_JOINABLE);
-    g_free(thread_name);
-    g_free(name);
-
-    /* Wait for initialization to complete */
-    qemu_mutex_lock(&iothread->init_done_lock);
-    while (iothread->thread_id == -1) {
-        qemu_cond_wait(&iothread->init_done_cond,
-                       &iothread->init_done_lock);
-    }
-    qemu_mutex_unlock(&iothread->init_done_lock);
+    iothread_start(iothread);
 }
 
 typedef struct {
@@ -303,6 +310,9 @@ static int query_one_iothread(Object *object, void *opaque)
     IOThreadInfoList *elem;
     IOThreadInfo *info;
     IOThread *iothread;
+    uint64List **hist;
+    AioContext *ctx;
+    int i;
 
     iothread = (IOThread *)object_dynamic_cast(object, TYPE_IOTHREAD);
     if (!iothread) {
@@ -316,6 +326,17 @@ static int query_one_iothread(Object *object, void *opaque)
     info->poll_grow = iothread->poll_grow;
     info->poll_shrink = iothread->poll_shrink;
 
+    ctx = iothread->ctx;
+    info->poll_hits = ctx->poll_hits;
+    info->poll_misses = ctx->poll_misses;
+    info->poll_idle_handlers = ctx->poll_idle_cnt;
+    hist = &info->poll_wait_histogram;
+    for (i = 0; i < AIO_POLL_HISTOGRAM_BUCKETS; i++) {
+        *hist = g_new0(uint64List, 1);
+        (*hist)->value = ctx->poll_wait_histogram[i];
+        hist = &(*hist)->next;
+    }
+
     elem = g_new0(IOThreadInfoList, 1);
     elem->value = info;
     elem->next = NULL;
@@ -375,6 +396,53 @@ void iothread_destroy(IOThread *iothread)
     object_unparent(OBJECT(iothread));
 }
 
+static int iothread_fork_prepare_one(Object *object, void *opaque)
+{
+    IOThread *iothread;
+    Error **errp = opaque;
+
+    iothread = (IOThread *)object_dynamic_cast(object, TYPE_IOTHREAD);
+    if (!iothread || !iothread->ctx || iothread->stopping) {
+        return 0;
+    }
+
+    iothread_stop(iothread);
+    iothread->fork_stopped = true;
+    return aio_context_fork_prepare(iothread->ctx, errp) ? 0 : -1;
+}
+
+static int iothread_fork_done_one(Object *object, void *opaque)
+{
+    IOThread *iothread;
+
+    iothread = (IOThread *)object_dynamic_cast(object, TYPE_IOTHREAD);
+    if (iothread && iothread->fork_stopped) {
+        iothread->fork_stopped = false;
+        iothread_start(iothread);
+    }
+    return 0;
+}
+
+bool iothread_fork_prepare(Error **errp)
+{
+    if (object_child_foreach(object_get_objects_root(),
+                             iothread_fork_prepare_one, errp) ||
+        object_child_foreach(object_get_internal_root(),
+                             iothread_fork_prepare_one, errp)) {
+        iothread_fork_done();
+        return false;
+    }
+    return true;
+}
+
+void iothread_fork_done(void)
+{
+    object_child_foreach(object_get_objects_root(),
+                         iothread_fork_done_one, NULL);
+    object_child_foreach(object_get_internal_root(),
+                         iothread_fork_done_one, NULL);
+}
+
 /* Lookup IOThread by its id.  Only finds user-created objects, not internal
  * iothread_create() objects. */
 IOThread *iothread_by_id(const char *id)
@@ -1298,6 +1298,11 @@ static inline void init_thread(struct target_pt_regs *regs,
 
 #define ELF_EXEC_PAGESIZE 4096
 
+#ifdef TARGET_HAS_VDSO
+#define DLINFO_ARCH_ITEMS 1
+#define ARCH_DLINFO NEW_AUX_ENT(AT_SYSINFO_EHDR, info->vdso)
+#endif
+
 #endif /* TARGET_RISCV */
 
 #ifdef TARGET_HPPA
@@ -2593,6 +2598,171 @@ uint32_t get_elf_eflags(int fd)
     return ehdr.e_flags;
 }
 
+#ifdef TARGET_HAS_VDSO
+#include "target_vdso.h"
+
+/*
+ * The vDSO is put together at exec time from the code in target_vdso.h,
+ * so that building QEMU does not need a cross toolchain.  The guest gets
+ * a vvar data page followed by a one page shared object holding just
+ * what dynamic linkers use to look symbols up: the program headers, a
+ * SysV hash table, and the dynamic symbol and string tables.
+ *
+ * The vvar page starts with the nanoseconds between the host's
+ * CLOCK_MONOTONIC and CLOCK_REALTIME.  It is read-only for the guest,
+ * but QEMU keeps the host mapping writable to refresh it.
+ */
+static abi_ulong vdso_vvar;
+
+void vdso_update_time(void)
+{
+    struct timespec rt, mono;
+    int64_t offset;
+
+    if (!vdso_vvar) {
+        return;
+    }
+    clock_gettime(CLOCK_REALTIME, &rt);
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    offset = tswap64((rt.tv_sec - mono.tv_sec) * 1000000000LL +
+                     (rt.tv_nsec - mono.tv_nsec));
+
+    /* Avoid bouncing the cache line between threads when idle */
+    if (atomic_read((int64_t *)g2h(vdso_vvar)) != offset) {
+        atomic_set((int64_t *)g2h(vdso_vvar), offset);
+    }
+}
+
+static void load_vdso(struct image_info *info)
+{
+    static const char soname[] = "linux-vdso.so.1";
+    const int nsyms = ARRAY_SIZE(vdso_symbols) + 1;
+    uint8_t *buf = g_malloc0(TARGET_PAGE_SIZE);
+    struct elfhdr *ehdr = (struct elfhdr *)buf;
+    struct elf_phdr *phdr = (struct elf_phdr *)(ehdr + 1);
+    uint32_t *hash;
+    struct elf_sym *sym;
+    ElfW(Dyn) *dyn;
+    char *str;
+    size_t hash_off, sym_off, str_off, str_len, dyn_off, dyn_len;
+    size_t name_off;
+    abi_ulong addr;
+    int i, n;
+
+    hash_off = sizeof(*ehdr) + 2 * sizeof(*phdr);
+    sym_off = QEMU_ALIGN_UP(hash_off + (3 + nsyms) * sizeof(*hash), 8);
+    str_off = sym_off + nsyms * sizeof(*sym);
+    str_len = 1 + sizeof(soname);
+    for (i = 0; i < ARRAY_SIZE(vdso_symbols); i++) {
+        str_len += strlen(vdso_symbols[i].name) + 1;
+    }
+    dyn_off = QEMU_ALIGN_UP(str_off + str_len, 8);
+    dyn_len = 7 * sizeof(*dyn);
+    assert(dyn_off + dyn_len <= VDSO_CODE_OFFSET);
+    assert(VDSO_CODE_OFFSET + sizeof(vdso_code) <= TARGET_PAGE_SIZE);
+
+    memcpy(ehdr->e_ident, ELFMAG, SELFMAG);
+    ehdr->e_ident[EI_CLASS] = ELF_CLASS;
+    ehdr->e_ident[EI_DATA] = ELF_DATA;
+    ehdr->e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr->e_type = ET_DYN;
+    ehdr->e_machine = ELF_ARCH;
+    ehdr->e_version = EV_CURRENT;
+    ehdr->e_phoff = sizeof(*ehdr);
+    ehdr->e_ehsize = sizeof(*ehdr);
+    ehdr->e_phentsize = sizeof(*phdr);
+    ehdr->e_phnum = 2;
+    bswap_ehdr(ehdr);
+
+    phdr[0].p_type = PT_LOAD;
+    phdr[0].p_flags = PF_R | PF_X;
+    phdr[0].p_filesz = TARGET_PAGE_SIZE;
+    phdr[0].p_memsz = TARGET_PAGE_SIZE;
+    phdr[0].p_align = TARGET_PAGE_SIZE;
+    phdr[1].p_type = PT_DYNAMIC;
+    phdr[1].p_flags = PF_R;
+    phdr[1].p_offset = dyn_off;
+    phdr[1].p_vaddr = dyn_off;
+    phdr[1].p_paddr = dyn_off;
+    phdr[1].p_filesz = dyn_len;
+    phdr[1].p_memsz = dyn_len;
+    phdr[1].p_align = 8;
+    bswap_phdr(phdr, 2);
+
+    /* One bucket that chains all the symbols */
+    hash = (uint32_t *)(buf + hash_off);
+    hash[0] = tswap32(1);
+    hash[1] = tswap32(nsyms);
+    hash[2] = tswap32(nsyms - 1);
+    for (i = 1; i < nsyms; i++) {
+        hash[3 + i] = tswap32(i - 1);
+    }
+
+    /*
+     * There are no section headers; the symbols only need st_shndx to
+     * be defined, and SHN_ABS would make loaders skip the load bias.
+     */
+    sym = (struct elf_sym *)(buf + sym_off);
+    str = (char *)(buf + str_off);
+    name_off = 1;
+    for (i = 0; i < ARRAY_SIZE(vdso_symbols); i++) {
+        struct elf_sym *s = &sym[i + 1];
+
+        n = strlen(vdso_symbols[i].name) + 1;
+        memcpy(str + name_off, vdso_symbols[i].name, n);
+        s->st_name = name_off;
+        s->st_info = ELF_ST_INFO(STB_GLOBAL, STT_FUNC);
+        s->st_shndx = 1;
+        s->st_value = VDSO_CODE_OFFSET + vdso_symbols[i].offset;
+        s->st_size = vdso_symbols[i].size;
+        bswap_sym(s);
+        name_off += n;
+    }
+    memcpy(str + name_off, soname, sizeof(soname));
+
+    dyn = (ElfW(Dyn) *)(buf + dyn_off);
+    dyn[0].d_tag = tswapal(DT_HASH);
+    dyn[0].d_un.d_ptr = tswapal(hash_off);
+    dyn[1].d_tag = tswapal(DT_STRTAB);
+    dyn[1].d_un.d_ptr = tswapal(str_off);
+    dyn[2].d_tag = tswapal(DT_SYMTAB);
+    dyn[2].d_un.d_ptr = tswapal(sym_off);
+    dyn[3].d_tag = tswapal(DT_STRSZ);
+    dyn[3].d_un.d_val = tswapal(str_len);
+    dyn[4].d_tag = tswapal(DT_SYMENT);
+    dyn[4].d_un.d_val = tswapal(sizeof(*sym));
+    dyn[5].d_tag = tswapal(DT_SONAME);
+    dyn[5].d_un.d_val = tswapal(name_off);
+    /* dyn[6] is DT_NULL */
+
+    for (i = 0; i < ARRAY_SIZE(vdso_code); i++) {
+        uint32_t insn = tswap32(vdso_code[i]);
+
+        memcpy(buf + VDSO_CODE_OFFSET + i * 4, &insn, 4);
+    }
+
+    addr = target_mmap(0, 2 * TARGET_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == -1) {
+        /* Not fatal, the C library falls back to system calls */
+        g_free(buf);
+        return;
+    }
+    memcpy_to_target(addr + TARGET_PAGE_SIZE, buf, TARGET_PAGE_SIZE);
+    g_free(buf);
+
+    mmap_lock();
+    page_set_flags(addr, addr + TARGET_PAGE_SIZE, PAGE_READ | PAGE_VALID);
+    page_set_flags(addr + TARGET_PAGE_SIZE, addr + 2 * TARGET_PAGE_SIZE,
+                   PAGE_READ | PAGE_EXEC | PAGE_VALID);
+    mmap_unlock();
+
+    vdso_vvar = addr;
+    vdso_update_time();
+    info->vdso = addr + TARGET_PAGE_SIZE;
+}
+#endif
+
 int load_elf_binary(struct linux_binprm *bprm, struct image_info *info)
 {
     struct image_info interp_info;
@@ -2663,6 +2833,10 @@ int load_elf_binary(struct linux_binprm *bprm, struct image_info *info)
         }
     }
 
+#ifdef TARGET_HAS_VDSO
+    load_vdso(info);
+#endif
+
     bprm->p = create_elf_tables(bprm->p, bprm->argc, bprm->envc, &elf_ex,
                                 info, (elf_interpreter ? &interp_info : NULL));
     info->start_stack = bprm->p;
@@ -18,6 +18,7 @@
  */
 #include "qemu/osdep.h"
 #include "qemu.h"
+#include "exec/tb-profile.h"
 
 #ifdef CONFIG_GCOV
 extern void __gcov_dump(void);
@@ -31,5 +32,10 @@ void preexit_cleanup(CPUArchState *env, int code)
 #ifdef CONFIG_GCOV
         __gcov_dump();
 #endif
+        if (tb_profile_max) {
+            tb_profile_dump(stderr, fprintf, tb_profile_max);
+        }
+        tb_profile_jitdump_close();
+        tb_profile_perfmap_close();
         gdb_exit(env, code);
 }
@@ -23,6 +23,7 @@
 #include <sys/resource.h>
 
 #include "qapi/error.h"
+#include "qemu/error-report.h"
 #include "qemu.h"
 #include "qemu/path.h"
 #include "qemu/config-file.h"
@@ -30,6 +31,7 @@
 #include "qemu/help_option.h"
 #include "cpu.h"
 #include "exec/exec-all.h"
+#include "exec/tb-profile.h"
 #include "tcg.h"
 #include "qemu/timer.h"
 #include "qemu/envlist.h"
@@ -50,6 +52,7 @@ static const char *cpu_type;
 unsigned long mmap_min_addr;
 unsigned long guest_base;
 int have_guest_base;
+int tb_profile_max;
 
 /*
  * When running 32-on-64 we should make sure we can fit all of the possible
@@ -371,6 +374,35 @@ static void handle_arg_strace(const char *arg)
     do_strace = 1;
 }
 
+static void handle_arg_tb_profile(const char *arg)
+{
+    if (qemu_strtoi(arg, NULL, 0, &tb_profile_max) < 0 ||
+        tb_profile_max <= 0) {
+        fprintf(stderr, "Invalid number of TBs: %s\n", arg);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void handle_arg_perfmap(const char *arg)
+{
+    Error *err = NULL;
+
+    if (!tb_profile_perfmap_open(&err)) {
+        error_report_err(err);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void handle_arg_perf_jitdump(const char *arg)
+{
+    Error *err = NULL;
+
+    if (!tb_profile_jitdump_open(arg, &err)) {
+        error_report_err(err);
+        exit(EXIT_FAILURE);
+    }
+}
+
 static void handle_arg_version(const char *arg)
 {
     printf("qemu-" TARGET_NAME " version " QEMU_FULL_VERSION
@@ -432,6 +464,12 @@ static const struct qemu_argument arg_table[] = {
      "",           "run in singlestep mode"},
     {"strace",     "QEMU_STRACE",      false, handle_arg_strace,
      "",           "log system calls"},
+    {"tb-profile", "QEMU_TB_PROFILE",  true,  handle_arg_tb_profile,
+     "n",          "print the 'n' most executed TBs at exit"},
+    {"perfmap",    "QEMU_PERFMAP",     false, handle_arg_perfmap,
+     "",           "write /tmp/perf-<pid>.map for the TBs"},
+    {"perf-jitdump", "QEMU_PERF_JITDUMP", true, handle_arg_perf_jitdump,
+     "dir",        "write a perf jitdump file for the TBs to 'dir'"},
     {"seed",       "QEMU_RAND_SEED",   true,  handle_arg_randseed,
      "",           "Seed for pseudo-random number generator"},
     {"trace",      "QEMU_TRACE",       true,  handle_arg_trace,
@@ -683,6 +721,10 @@ int main(int argc, char **argv, char **envp)
 
     thread_cpu = cpu;
 
+    if (tb_profile_max) {
+        tb_profile_start();
+    }
+
     if (getenv("QEMU_STRACE")) {
         do_strace = 1;
     }
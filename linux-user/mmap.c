@@ -64,7 +64,7 @@ void mmap_fork_end(int child)
 /* NOTE: all the constants are the HOST ones, but addresses are target. */
 int target_mprotect(abi_ulong start, abi_ulong len, int prot)
 {
-    abi_ulong end, host_start, host_end, addr;
+    abi_ulong end, host_start, host_end;
     int prot1, ret;
 
 #ifdef DEBUG_MMAP
@@ -91,14 +91,9 @@ int target_mprotect(abi_ulong start, abi_ulong len, int prot)
     host_end = HOST_PAGE_ALIGN(end);
     if (start > host_start) {
         /* handle host page containing start */
-        prot1 = prot;
-        for(addr = host_start; addr < start; addr += TARGET_PAGE_SIZE) {
-            prot1 |= page_get_flags(addr);
-        }
+        prot1 = prot | page_get_flags_range(host_start, start);
         if (host_end == host_start + qemu_host_page_size) {
-            for(addr = end; addr < host_end; addr += TARGET_PAGE_SIZE) {
-                prot1 |= page_get_flags(addr);
-            }
+            prot1 |= page_get_flags_range(end, host_end);
             end = host_end;
         }
         ret = mprotect(g2h(host_start), qemu_host_page_size, prot1 & PAGE_BITS);
@@ -107,10 +102,7 @@ int target_mprotect(abi_ulong start, abi_ulong len, int prot)
         host_start += qemu_host_page_size;
     }
     if (end < host_end) {
-        prot1 = prot;
-        for(addr = end; addr < host_end; addr += TARGET_PAGE_SIZE) {
-            prot1 |= page_get_flags(addr);
-        }
+        prot1 = prot | page_get_flags_range(end, host_end);
         ret = mprotect(g2h(host_end - qemu_host_page_size), qemu_host_page_size,
                        prot1 & PAGE_BITS);
         if (ret != 0)
@@ -137,7 +129,7 @@ static int mmap_frag(abi_ulong real_start,
                      abi_ulong start, abi_ulong end,
                      int prot, int flags, int fd, abi_ulong offset)
 {
-    abi_ulong real_end, addr;
+    abi_ulong real_end;
     void *host_start;
     int prot1, prot_new;
 
@@ -145,11 +137,8 @@ static int mmap_frag(abi_ulong real_start,
     host_start = g2h(real_start);
 
     /* get the protection of the target pages outside the mapping */
-    prot1 = 0;
-    for(addr = real_start; addr < real_end; addr++) {
-        if (addr < start || addr >= end)
-            prot1 |= page_get_flags(addr);
-    }
+    prot1 = page_get_flags_range(real_start, start) |
+            page_get_flags_range(end, real_end);
 
     if (prot1 == 0) {
         /* no page was there, so we allocate one */
@@ -204,10 +193,8 @@ unsigned long last_brk;
    of guest address space.  */
 static abi_ulong mmap_find_vma_reserved(abi_ulong start, abi_ulong size)
 {
-    abi_ulong addr;
+    target_ulong addr;
     abi_ulong end_addr;
-    int prot;
-    int looped = 0;
 
     if (size > reserved_va) {
         return (abi_ulong)-1;
@@ -218,26 +205,16 @@ static abi_ulong mmap_find_vma_reserved(abi_ulong start, abi_ulong size)
     if (end_addr > reserved_va) {
         end_addr = reserved_va;
     }
-    addr = end_addr - qemu_host_page_size;
 
-    while (1) {
-        if (addr > end_addr) {
-            if (looped) {
-                return (abi_ulong)-1;
-            }
-            end_addr = reserved_va;
-            addr = end_addr - qemu_host_page_size;
-            looped = 1;
-            continue;
-        }
-        prot = page_get_flags(addr);
-        if (prot) {
-            end_addr = addr;
-        }
-        if (addr && addr + size == end_addr) {
-            break;
-        }
-        addr -= qemu_host_page_size;
+    /* Search downwards from start, then from the top of the reserved area */
+    addr = page_find_free_below(qemu_host_page_size, end_addr, size,
+                                qemu_host_page_size);
+    if (addr == (target_ulong)-1 && end_addr < reserved_va) {
+        addr = page_find_free_below(qemu_host_page_size, reserved_va, size,
+                                    qemu_host_page_size);
+    }
+    if (addr == (target_ulong)-1) {
+        return (abi_ulong)-1;
     }
 
     if (start == mmap_next_start) {
@@ -581,7 +558,6 @@ static void mmap_reserve(abi_ulong start, abi_ulong size)
 {
     abi_ulong real_start;
     abi_ulong real_end;
-    abi_ulong addr;
     abi_ulong end;
     int prot;
 
@@ -590,24 +566,16 @@ static void mmap_reserve(abi_ulong start, abi_ulong size)
     end = start + size;
     if (start > real_start) {
         /* handle host page containing start */
-        prot = 0;
-        for (addr = real_start; addr < start; addr += TARGET_PAGE_SIZE) {
-            prot |= page_get_flags(addr);
-        }
+        prot = page_get_flags_range(real_start, start);
         if (real_end == real_start + qemu_host_page_size) {
-            for (addr = end; addr < real_end; addr += TARGET_PAGE_SIZE) {
-                prot |= page_get_flags(addr);
-            }
+            prot |= page_get_flags_range(end, real_end);
             end = real_end;
         }
         if (prot != 0)
             real_start += qemu_host_page_size;
     }
     if (end < real_end) {
-        prot = 0;
-        for (addr = end; addr < real_end; addr += TARGET_PAGE_SIZE) {
-            prot |= page_get_flags(addr);
-        }
+        prot = page_get_flags_range(end, real_end);
         if (prot != 0)
             real_end -= qemu_host_page_size;
     }
@@ -620,7 +588,7 @@ static void mmap_reserve(abi_ulong start, abi_ulong size)
 
 int target_munmap(abi_ulong start, abi_ulong len)
 {
-    abi_ulong end, real_start, real_end, addr;
+    abi_ulong end, real_start, real_end;
     int prot, ret;
 
 #ifdef DEBUG_MMAP
@@ -642,24 +610,16 @@ int target_munmap(abi_ulong start, abi_ulong len)
 
     if (start > real_start) {
         /* handle host page containing start */
-        prot = 0;
-        for(addr = real_start; addr < start; addr += TARGET_PAGE_SIZE) {
-            prot |= page_get_flags(addr);
-        }
+        prot = page_get_flags_range(real_start, start);
         if (real_end == real_start + qemu_host_page_size) {
-            for(addr = end; addr < real_end; addr += TARGET_PAGE_SIZE) {
-                prot |= page_get_flags(addr);
-            }
+            prot |= page_get_flags_range(end, real_end);
             end = real_end;
         }
         if (prot != 0)
             real_start += qemu_host_page_size;
     }
     if (end < real_end) {
-        prot = 0;
-        for(addr = end; addr < real_end; addr += TARGET_PAGE_SIZE) {
-            prot |= page_get_flags(addr);
-        }
+        prot = page_get_flags_range(end, real_end);
         if (prot != 0)
             real_end -= qemu_host_page_size;
     }
@@ -725,12 +685,8 @@ abi_long target_mremap(abi_ulong old_addr, abi_ulong old_size,
     } else {
         int prot = 0;
         if (reserved_va && old_size < new_size) {
-            abi_ulong addr;
-            for (addr = old_addr + old_size;
-                 addr < old_addr + new_size;
-                 addr++) {
-                prot |= page_get_flags(addr);
-            }
+            prot = page_get_flags_range(old_addr + old_size,
+                                        old_addr + new_size);
         }
         if (prot == 0) {
             host_addr = mremap(g2h(old_addr), old_size, new_size, flags);
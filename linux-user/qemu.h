@@ -52,6 +52,7 @@ struct image_info {
         uint32_t        elf_flags;
 	int		personality;
         abi_ulong       alignment;
+        abi_ulong       vdso;
 
         /* The fields below are used in FDPIC mode.  */
         abi_ulong       loadmap_addr;
@@ -195,6 +196,9 @@ int info_is_fdpic(struct image_info *info);
 
 uint32_t get_elf_eflags(int fd);
 int load_elf_binary(struct linux_binprm *bprm, struct image_info *info);
+#ifdef TARGET_HAS_VDSO
+void vdso_update_time(void);
+#endif
 int load_flt_binary(struct linux_binprm *bprm, struct image_info *info);
 
 abi_long memcpy_to_target(abi_ulong dest, const void *src,
@@ -445,6 +449,7 @@ void mmap_fork_end(int child);
 
 /* main.c */
 extern unsigned long guest_stack_size;
+extern int tb_profile_max;
 
 /* user access */
 
@@ -52,6 +52,10 @@ void cpu_loop(CPURISCVState *env)
                    self-modifying code is automatically detected */
                 ret = 0;
             } else {
+#ifdef TARGET_HAS_VDSO
+                /* Catch up with host clock steps for the vDSO */
+                vdso_update_time();
+#endif
                 ret = do_syscall(env,
                                  env->gpr[xA7],
                                  env->gpr[xA0],
@@ -44,6 +44,7 @@ struct target_pt_regs {
 #define UNAME_MACHINE "riscv32"
 #else
 #define UNAME_MACHINE "riscv64"
+#define TARGET_HAS_VDSO
 #endif
 #define UNAME_MINIMUM_RELEASE "4.15.0"
 
@@ -0,0 +1,108 @@
+/*
+ * RISC-V vDSO code for linux-user
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation, or (at your option) any
+ * later version. See the COPYING file in the top-level directory.
+ */
+
+#ifndef RISCV_TARGET_VDSO_H
+#define RISCV_TARGET_VDSO_H
+
+/*
+ * In linux-user mode the time CSR counts nanoseconds of the host's
+ * CLOCK_MONOTONIC, and rdtime does not leave the translation block.
+ * CLOCK_REALTIME adds the offset that QEMU keeps at the start of the
+ * vvar page, just below the vDSO image.  Every other clock, and
+ * gettimeofday() with a timezone, falls back to the system call.
+ *
+ * The code is placed VDSO_CODE_OFFSET bytes into the image; the vvar
+ * loads depend on that.  It was assembled from:
+ *
+ * __vdso_clock_gettime:
+ *         li      t0, 1                   # CLOCK_MONOTONIC
+ *         bgtu    a0, t0, 1f
+ *         rdtime  t1
+ *         bnez    a0, 2f
+ *         auipc   t2, 0xfffff             # vvar page
+ *         ld      t2, -0x410(t2)          # realtime offset
+ *         add     t1, t1, t2
+ * 2:      li      t2, 1000000000
+ *         divu    t3, t1, t2
+ *         remu    t4, t1, t2
+ *         sd      t3, 0(a1)
+ *         sd      t4, 8(a1)
+ *         li      a0, 0
+ *         ret
+ * 1:      li      a7, 113                 # __NR_clock_gettime
+ *         ecall
+ *         ret
+ *
+ * __vdso_gettimeofday:
+ *         bnez    a1, 1f
+ *         beqz    a0, 2f
+ *         rdtime  t1
+ *         auipc   t2, 0xfffff
+ *         ld      t2, -0x454(t2)
+ *         add     t1, t1, t2
+ *         li      t2, 1000000000
+ *         divu    t3, t1, t2
+ *         remu    t4, t1, t2
+ *         li      t2, 1000
+ *         divu    t4, t4, t2
+ *         sd      t3, 0(a0)
+ *         sd      t4, 8(a0)
+ * 2:      li      a0, 0
+ *         ret
+ * 1:      li      a7, 169                 # __NR_gettimeofday
+ *         ecall
+ *         ret
+ *
+ * __vdso_clock_getres:
+ *         li      t0, 1
+ *         bgtu    a0, t0, 1f
+ *         beqz    a1, 2f
+ *         li      t1, 1
+ *         sd      zero, 0(a1)
+ *         sd      t1, 8(a1)
+ * 2:      li      a0, 0
+ *         ret
+ * 1:      li      a7, 114                 # __NR_clock_getres
+ *         ecall
+ *         ret
+ */
+
+#define VDSO_CODE_OFFSET 0x400
+
+static const uint32_t vdso_code[] = {
+    /* __vdso_clock_gettime */
+    0x00100293, 0x02a2ec63, 0xc0102373, 0x00051863,
+    0xfffff397, 0xbf03b383, 0x00730333, 0x3b9ad3b7,
+    0xa003839b, 0x02735e33, 0x02737eb3, 0x01c5b023,
+    0x01d5b423, 0x00000513, 0x00008067, 0x07100893,
+    0x00000073, 0x00008067,
+    /* __vdso_gettimeofday */
+    0x04059063, 0x02050a63, 0xc0102373, 0xfffff397,
+    0xbac3b383, 0x00730333, 0x3b9ad3b7, 0xa003839b,
+    0x02735e33, 0x02737eb3, 0x3e800393, 0x027edeb3,
+    0x01c53023, 0x01d53423, 0x00000513, 0x00008067,
+    0x0a900893, 0x00000073, 0x00008067,
+    /* __vdso_clock_getres */
+    0x00100293, 0x00a2ee63, 0x00058863, 0x00100313,
+    0x0005b023, 0x0065b423, 0x00000513, 0x00008067,
+    0x07200893, 0x00000073, 0x00008067,
+};
+
+/* Offsets and sizes are in bytes from the start of vdso_code */
+static const struct {
+    const char *name;
+    uint32_t offset;
+    uint32_t size;
+} vdso_symbols[] = {
+    { "__vdso_clock_gettime", 0x00, 0x48 },
+    { "__vdso_gettimeofday", 0x48, 0x4c },
+    { "__vdso_clock_getres", 0x94, 0x2c },
+};
+
+#endif
@@ -694,8 +694,12 @@ static void host_signal_handler(int host_signum, siginfo_t *info,
     sigdelset(&uc->uc_sigmask, SIGSEGV);
     sigdelset(&uc->uc_sigmask, SIGBUS);
 
-    /* interrupt the virtual CPU as soon as possible */
-    cpu_exit(thread_cpu);
+    /* Stop the virtual CPU at the next TB boundary.  There is no need for
+     * a full cpu_exit(): cpu_exec() delivers the signal itself through
+     * cpu_exec_signals(), and if we are outside cpu_exec() the main loop
+     * will get to process_pending_signals() anyway.
+     */
+    atomic_mb_set(&cpu->icount_decr.u16.high, -1);
 }
 
 /* do_sigaltstack() returns target values and errnos. */
@@ -981,3 +985,22 @@ void process_pending_signals(CPUArchState *cpu_env)
     }
     ts->in_sigsuspend = 0;
 }
+
+/* Called by cpu_exec() between TBs: deliver any signals that arrived
+ * while guest code was running without returning to the main loop.
+ * Returns true if it did, in which case the PC may have changed.
+ */
+bool cpu_exec_signals(CPUState *cpu)
+{
+    CPUClass *cc = CPU_GET_CLASS(cpu);
+    TaskState *ts = cpu->opaque;
+
+    if (likely(!atomic_read(&ts->signal_pending))) {
+        return false;
+    }
+    /* The signal frame needs the architectural state, e.g. x86 eflags */
+    cc->cpu_exec_exit(cpu);
+    process_pending_signals(cpu->env_ptr);
+    cc->cpu_exec_enter(cpu);
+    return true;
+}
@@ -7109,6 +7109,22 @@ static inline abi_long target_ftruncate64(void *cpu_env, abi_long arg1,
 }
 #endif
 
+/* When a guest structure has the same layout as the host's, the kernel
+   can read and write it in guest memory without a conversion.  */
+#if defined(TARGET_WORDS_BIGENDIAN) == defined(HOST_WORDS_BIGENDIAN)
+#define TARGET_TIMESPEC_IS_HOST \
+    (sizeof(struct target_timespec) == sizeof(struct timespec))
+#ifdef CONFIG_EPOLL
+#define TARGET_EPOLL_EVENT_IS_HOST \
+    (sizeof(struct target_epoll_event) == sizeof(struct epoll_event) && \
+     offsetof(struct target_epoll_event, data) == \
+     offsetof(struct epoll_event, data))
+#endif
+#else
+#define TARGET_TIMESPEC_IS_HOST 0
+#define TARGET_EPOLL_EVENT_IS_HOST 0
+#endif
+
 static inline abi_long target_to_host_timespec(struct timespec *host_ts,
                                                abi_ulong target_addr)
 {
@@ -7358,7 +7374,7 @@ static int do_futex(target_ulong uaddr, int op, int val, target_ulong timeout,
                     target_ulong uaddr2, int val3)
 {
     struct timespec ts, *pts;
-    int base_op;
+    int base_op, ret;
 
     /* ??? We assume FUTEX_* constants are the same on both host
        and target.  */
@@ -7370,14 +7386,25 @@ static int do_futex(target_ulong uaddr, int op, int val, target_ulong timeout,
     switch (base_op) {
     case FUTEX_WAIT:
     case FUTEX_WAIT_BITSET:
-        if (timeout) {
-            pts = &ts;
-            target_to_host_timespec(pts, timeout);
-        } else {
+        if (!timeout) {
             pts = NULL;
+        } else if (TARGET_TIMESPEC_IS_HOST) {
+            pts = lock_user(VERIFY_READ, timeout, sizeof(ts), 1);
+            if (!pts) {
+                return -TARGET_EFAULT;
+            }
+        } else {
+            pts = &ts;
+            if (target_to_host_timespec(pts, timeout)) {
+                return -TARGET_EFAULT;
+            }
+        }
+        ret = get_errno(safe_futex(g2h(uaddr), op, tswap32(val),
+                                   pts, NULL, val3));
+        if (pts && pts != &ts) {
+            unlock_user(pts, timeout, 0);
         }
-        return get_errno(safe_futex(g2h(uaddr), op, tswap32(val),
-                         pts, NULL, val3));
+        return ret;
     case FUTEX_WAKE:
         return get_errno(safe_futex(g2h(uaddr), op, val, NULL, NULL, 0));
     case FUTEX_FD:
@@ -12051,6 +12078,16 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
     case TARGET_NR_clock_gettime:
     {
         struct timespec ts;
+
+        if (TARGET_TIMESPEC_IS_HOST) {
+            p = lock_user(VERIFY_WRITE, arg2, sizeof(ts), 0);
+            if (!p) {
+                goto efault;
+            }
+            ret = get_errno(clock_gettime(arg1, p));
+            unlock_user(p, arg2, is_error(ret) ? 0 : sizeof(ts));
+            break;
+        }
         ret = get_errno(clock_gettime(arg1, &ts));
         if (!is_error(ret)) {
             ret = host_to_target_timespec(arg2, &ts);
@@ -12463,11 +12500,16 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
             goto efault;
         }
 
-        ep = g_try_new(struct epoll_event, maxevents);
-        if (!ep) {
-            unlock_user(target_ep, arg2, 0);
-            ret = -TARGET_ENOMEM;
-            break;
+        if (TARGET_EPOLL_EVENT_IS_HOST) {
+            /* The kernel fills in the guest's array directly */
+            ep = (struct epoll_event *)target_ep;
+        } else {
+            ep = g_try_new(struct epoll_event, maxevents);
+            if (!ep) {
+                unlock_user(target_ep, arg2, 0);
+                ret = -TARGET_ENOMEM;
+                break;
+            }
         }
 
         switch (num) {
@@ -12511,7 +12553,7 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
         }
         if (!is_error(ret)) {
             int i;
-            for (i = 0; i < ret; i++) {
+            for (i = 0; i < ret && !TARGET_EPOLL_EVENT_IS_HOST; i++) {
                 target_ep[i].events = tswap32(ep[i].events);
                 target_ep[i].data.u64 = tswap64(ep[i].data.u64);
             }
@@ -12520,7 +12562,9 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
         } else {
             unlock_user(target_ep, arg2, 0);
         }
-        g_free(ep);
+        if (!TARGET_EPOLL_EVENT_IS_HOST) {
+            g_free(ep);
+        }
         break;
     }
 #endif
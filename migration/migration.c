@@ -36,6 +36,7 @@
 #include "qapi/qmp/qerror.h"
 #include "qapi/qmp/qnull.h"
 #include "qemu/rcu.h"
+#include "qemu/units.h"
 #include "block.h"
 #include "postcopy-ram.h"
 #include "qemu/thread.h"
@@ -81,6 +82,17 @@
 #define DEFAULT_MIGRATE_X_CHECKPOINT_DELAY 200
 #define DEFAULT_MIGRATE_MULTIFD_CHANNELS 2
 #define DEFAULT_MIGRATE_MULTIFD_PAGE_COUNT 16
+#define DEFAULT_MIGRATE_MULTIFD_COMPRESSION MULTIFD_COMPRESSION_NONE
+#define DEFAULT_MIGRATE_BITMAP_SYNC_THREADS 4
+#define MAX_MIGRATE_BITMAP_SYNC_THREADS 64
+#define DEFAULT_MIGRATE_POSTCOPY_PREFETCH_PAGES 0
+#define MAX_MIGRATE_POSTCOPY_PREFETCH_PAGES 4096
+#define DEFAULT_MIGRATE_VCPU_DIRTY_LIMIT 0
+#define DEFAULT_MIGRATE_STREAM_BUFFER_SIZE (32 * KiB)
+#define MIN_MIGRATE_STREAM_BUFFER_SIZE (32 * KiB)
+#define MAX_MIGRATE_STREAM_BUFFER_SIZE (64 * MiB)
+#define DEFAULT_MIGRATE_STREAM_IOV_COUNT 64
+#define MAX_MIGRATE_STREAM_IOV_COUNT 1024
 
 /* Background transfer rate for postcopy, 0 means unlimited, note
  * that page requests can still exceed this limit.
@@ -693,6 +705,18 @@ MigrationParameters *qmp_query_migrate_parameters(Error **errp)
     params->x_multifd_channels = s->parameters.x_multifd_channels;
     params->has_x_multifd_page_count = true;
     params->x_multifd_page_count = s->parameters.x_multifd_page_count;
+    params->has_x_multifd_compression = true;
+    params->x_multifd_compression = s->parameters.x_multifd_compression;
+    params->has_x_bitmap_sync_threads = true;
+    params->x_bitmap_sync_threads = s->parameters.x_bitmap_sync_threads;
+    params->has_x_postcopy_prefetch_pages = true;
+    params->x_postcopy_prefetch_pages = s->parameters.x_postcopy_prefetch_pages;
+    params->has_x_vcpu_dirty_limit = true;
+    params->x_vcpu_dirty_limit = s->parameters.x_vcpu_dirty_limit;
+    params->has_x_stream_buffer_size = true;
+    params->x_stream_buffer_size = s->parameters.x_stream_buffer_size;
+    params->has_x_stream_iov_count = true;
+    params->x_stream_iov_count = s->parameters.x_stream_iov_count;
     params->has_xbzrle_cache_size = true;
     params->xbzrle_cache_size = s->parameters.xbzrle_cache_size;
     params->has_max_postcopy_bandwidth = true;
@@ -760,6 +784,11 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
     if (s->state != MIGRATION_STATUS_COMPLETED) {
         info->ram->remaining = ram_bytes_remaining();
         info->ram->dirty_pages_rate = ram_counters.dirty_pages_rate;
+
+        if (migrate_use_dirty_ring()) {
+            info->x_vcpu_dirty = ram_vcpu_dirty_info();
+            info->has_x_vcpu_dirty = !!info->x_vcpu_dirty;
+        }
     }
 }
 
@@ -895,6 +924,18 @@ static bool migrate_caps_check(bool *cap_list,
         }
     }
 
+    if (cap_list[MIGRATION_CAPABILITY_X_ZERO_COPY_SEND] &&
+        !cap_list[MIGRATION_CAPABILITY_X_MULTIFD]) {
+        error_setg(errp, "Zero copy send only works with multifd");
+        return false;
+    }
+
+    if (cap_list[MIGRATION_CAPABILITY_X_MULTIFD_DEVICE_STATE] &&
+        !cap_list[MIGRATION_CAPABILITY_X_MULTIFD]) {
+        error_setg(errp, "Device state on multifd channels needs multifd");
+        return false;
+    }
+
     return true;
 }
 
@@ -1033,6 +1074,51 @@ static bool migrate_params_check(MigrationParameters *params, Error **errp)
         return false;
     }
 
+    if (params->has_x_multifd_compression &&
+        !multifd_compression_supported(params->x_multifd_compression)) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "multifd_compression",
+                   "is not supported by this build");
+        return false;
+    }
+
+    if (params->has_x_bitmap_sync_threads &&
+        (params->x_bitmap_sync_threads < 0 ||
+         params->x_bitmap_sync_threads > MAX_MIGRATE_BITMAP_SYNC_THREADS)) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "bitmap_sync_threads",
+                   "is invalid, it should be in the range of 0 to 64");
+        return false;
+    }
+
+    if (params->has_x_postcopy_prefetch_pages &&
+        (params->x_postcopy_prefetch_pages < 0 ||
+         params->x_postcopy_prefetch_pages >
+         MAX_MIGRATE_POSTCOPY_PREFETCH_PAGES)) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "postcopy_prefetch_pages",
+                   "is invalid, it should be in the range of 0 to 4096");
+        return false;
+    }
+
+    if (params->has_x_stream_buffer_size &&
+        (params->x_stream_buffer_size < MIN_MIGRATE_STREAM_BUFFER_SIZE ||
+         params->x_stream_buffer_size > MAX_MIGRATE_STREAM_BUFFER_SIZE)) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "stream_buffer_size",
+                   "is invalid, it should be in the range of 32 KiB to 64 MiB");
+        return false;
+    }
+
+    if (params->has_x_stream_iov_count &&
+        (params->x_stream_iov_count < 1 ||
+         params->x_stream_iov_count > MAX_MIGRATE_STREAM_IOV_COUNT)) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "stream_iov_count",
+                   "is invalid, it should be in the range of 1 to 1024");
+        return false;
+    }
+
     if (params->has_xbzrle_cache_size &&
         (params->xbzrle_cache_size < qemu_target_page_size() ||
          !is_power_of_2(params->xbzrle_cache_size))) {
@@ -1104,6 +1190,24 @@ static void migrate_params_test_apply(MigrateSetParameters *params,
     if (params->has_x_multifd_page_count) {
         dest->x_multifd_page_count = params->x_multifd_page_count;
     }
+    if (params->has_x_multifd_compression) {
+        dest->x_multifd_compression = params->x_multifd_compression;
+    }
+    if (params->has_x_bitmap_sync_threads) {
+        dest->x_bitmap_sync_threads = params->x_bitmap_sync_threads;
+    }
+    if (params->has_x_postcopy_prefetch_pages) {
+        dest->x_postcopy_prefetch_pages = params->x_postcopy_prefetch_pages;
+    }
+    if (params->has_x_vcpu_dirty_limit) {
+        dest->x_vcpu_dirty_limit = params->x_vcpu_dirty_limit;
+    }
+    if (params->has_x_stream_buffer_size) {
+        dest->x_stream_buffer_size = params->x_stream_buffer_size;
+    }
+    if (params->has_x_stream_iov_count) {
+        dest->x_stream_iov_count = params->x_stream_iov_count;
+    }
     if (params->has_xbzrle_cache_size) {
         dest->xbzrle_cache_size = params->xbzrle_cache_size;
     }
@@ -1178,6 +1282,25 @@ static void migrate_params_apply(MigrateSetParameters *params, Error **errp)
     if (params->has_x_multifd_page_count) {
         s->parameters.x_multifd_page_count = params->x_multifd_page_count;
     }
+    if (params->has_x_multifd_compression) {
+        s->parameters.x_multifd_compression = params->x_multifd_compression;
+    }
+    if (params->has_x_bitmap_sync_threads) {
+        s->parameters.x_bitmap_sync_threads = params->x_bitmap_sync_threads;
+    }
+    if (params->has_x_postcopy_prefetch_pages) {
+        s->parameters.x_postcopy_prefetch_pages =
+            params->x_postcopy_prefetch_pages;
+    }
+    if (params->has_x_vcpu_dirty_limit) {
+        s->parameters.x_vcpu_dirty_limit = params->x_vcpu_dirty_limit;
+    }
+    if (params->has_x_stream_buffer_size) {
+        s->parameters.x_stream_buffer_size = params->x_stream_buffer_size;
+    }
+    if (params->has_x_stream_iov_count) {
+        s->parameters.x_stream_iov_count = params->x_stream_iov_count;
+    }
     if (params->has_xbzrle_cache_size) {
         s->parameters.xbzrle_cache_size = params->xbzrle_cache_size;
         xbzrle_cache_resize(params->xbzrle_cache_size, errp);
@@ -1668,6 +1791,11 @@ static bool migrate_prepare(MigrationState *s, bool blk, bool blk_inc,
         return false;
     }
 
+    if (migrate_use_mapped_ram()) {
+        error_setg(errp, "x-mapped-ram can only be used by snapshots");
+        return false;
+    }
+
     if (blk || blk_inc) {
         if (migrate_use_block() || migrate_use_block_incremental()) {
             error_setg(errp, "Command options are incompatible with "
@@ -1803,6 +1931,51 @@ bool migrate_release_ram(void)
     return s->enabled_capabilities[MIGRATION_CAPABILITY_RELEASE_RAM];
 }
 
+bool migrate_use_dirty_ring(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_X_DIRTY_RING];
+}
+
+bool migrate_use_zero_copy_send(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_X_ZERO_COPY_SEND];
+}
+
+bool migrate_ignore_shared(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_X_IGNORE_SHARED];
+}
+
+bool migrate_use_mapped_ram(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_X_MAPPED_RAM];
+}
+
+bool migrate_multifd_device_state(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_X_MULTIFD_DEVICE_STATE];
+}
+
 bool migrate_postcopy_ram(void)
 {
     MigrationState *s;
@@ -1935,6 +2108,51 @@ int migrate_multifd_page_count(void)
     return s->parameters.x_multifd_page_count;
 }
 
+MultiFDCompression migrate_multifd_compression(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->parameters.x_multifd_compression;
+}
+
+int migrate_bitmap_sync_threads(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->parameters.x_bitmap_sync_threads;
+}
+
+int migrate_postcopy_prefetch_pages(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->parameters.x_postcopy_prefetch_pages;
+}
+
+uint64_t migrate_vcpu_dirty_limit(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->parameters.x_vcpu_dirty_limit;
+}
+
+bool migrate_use_async_flush(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_X_ASYNC_FLUSH];
+}
+
 int migrate_use_xbzrle(void)
 {
     MigrationState *s;
@@ -3059,6 +3277,12 @@ void migrate_fd_connect(MigrationState *s, Error *error_in)
 
     qemu_file_set_rate_limit(s->to_dst_file, rate_limit);
     qemu_file_set_blocking(s->to_dst_file, true);
+    qemu_file_set_buffer_size(s->to_dst_file,
+                              s->parameters.x_stream_buffer_size,
+                              s->parameters.x_stream_iov_count);
+    if (migrate_use_async_flush()) {
+        qemu_file_enable_async_flush(s->to_dst_file);
+    }
 
     /*
      * Open the return path. For postcopy, it is used exclusively. For
@@ -3154,6 +3378,24 @@ static Property migration_properties[] = {
     DEFINE_PROP_UINT32("x-multifd-page-count", MigrationState,
                       parameters.x_multifd_page_count,
                       DEFAULT_MIGRATE_MULTIFD_PAGE_COUNT),
+    DEFINE_PROP_MULTIFD_COMPRESSION("x-multifd-compression", MigrationState,
+                      parameters.x_multifd_compression,
+                      DEFAULT_MIGRATE_MULTIFD_COMPRESSION),
+    DEFINE_PROP_UINT8("x-bitmap-sync-threads", MigrationState,
+                      parameters.x_bitmap_sync_threads,
+                      DEFAULT_MIGRATE_BITMAP_SYNC_THREADS),
+    DEFINE_PROP_UINT32("x-postcopy-prefetch-pages", MigrationState,
+                      parameters.x_postcopy_prefetch_pages,
+                      DEFAULT_MIGRATE_POSTCOPY_PREFETCH_PAGES),
+    DEFINE_PROP_SIZE("x-vcpu-dirty-limit", MigrationState,
+                      parameters.x_vcpu_dirty_limit,
+                      DEFAULT_MIGRATE_VCPU_DIRTY_LIMIT),
+    DEFINE_PROP_SIZE("x-stream-buffer-size", MigrationState,
+                      parameters.x_stream_buffer_size,
+                      DEFAULT_MIGRATE_STREAM_BUFFER_SIZE),
+    DEFINE_PROP_UINT32("x-stream-iov-count", MigrationState,
+                      parameters.x_stream_iov_count,
+                      DEFAULT_MIGRATE_STREAM_IOV_COUNT),
     DEFINE_PROP_SIZE("xbzrle-cache-size", MigrationState,
                       parameters.xbzrle_cache_size,
                       DEFAULT_MIGRATE_XBZRLE_CACHE_SIZE),
@@ -3174,6 +3416,15 @@ static Property migration_properties[] = {
     DEFINE_PROP_MIG_CAP("x-block", MIGRATION_CAPABILITY_BLOCK),
     DEFINE_PROP_MIG_CAP("x-return-path", MIGRATION_CAPABILITY_RETURN_PATH),
     DEFINE_PROP_MIG_CAP("x-multifd", MIGRATION_CAPABILITY_X_MULTIFD),
+    DEFINE_PROP_MIG_CAP("x-dirty-ring", MIGRATION_CAPABILITY_X_DIRTY_RING),
+    DEFINE_PROP_MIG_CAP("x-zero-copy-send",
+                        MIGRATION_CAPABILITY_X_ZERO_COPY_SEND),
+    DEFINE_PROP_MIG_CAP("x-ignore-shared",
+                        MIGRATION_CAPABILITY_X_IGNORE_SHARED),
+    DEFINE_PROP_MIG_CAP("x-mapped-ram", MIGRATION_CAPABILITY_X_MAPPED_RAM),
+    DEFINE_PROP_MIG_CAP("x-async-flush", MIGRATION_CAPABILITY_X_ASYNC_FLUSH),
+    DEFINE_PROP_MIG_CAP("x-multifd-device-state",
+                        MIGRATION_CAPABILITY_X_MULTIFD_DEVICE_STATE),
 
     DEFINE_PROP_END_OF_LIST(),
 };
@@ -3228,6 +3479,12 @@ static void migration_instance_init(Object *obj)
     params->has_block_incremental = true;
     params->has_x_multifd_channels = true;
     params->has_x_multifd_page_count = true;
+    params->has_x_multifd_compression = true;
+    params->has_x_bitmap_sync_threads = true;
+    params->has_x_postcopy_prefetch_pages = true;
+    params->has_x_vcpu_dirty_limit = true;
+    params->has_x_stream_buffer_size = true;
+    params->has_x_stream_iov_count = true;
     params->has_xbzrle_cache_size = true;
     params->has_max_postcopy_bandwidth = true;
 
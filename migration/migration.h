@@ -250,6 +250,11 @@ MigrationState *migrate_get_current(void);
 bool migrate_postcopy(void);
 
 bool migrate_release_ram(void);
+bool migrate_use_dirty_ring(void);
+bool migrate_use_zero_copy_send(void);
+bool migrate_ignore_shared(void);
+bool migrate_use_mapped_ram(void);
+bool migrate_multifd_device_state(void);
 bool migrate_postcopy_ram(void);
 bool migrate_zero_blocks(void);
 bool migrate_dirty_bitmaps(void);
@@ -259,6 +264,11 @@ bool migrate_use_multifd(void);
 bool migrate_pause_before_switchover(void);
 int migrate_multifd_channels(void);
 int migrate_multifd_page_count(void);
+MultiFDCompression migrate_multifd_compression(void);
+int migrate_bitmap_sync_threads(void);
+int migrate_postcopy_prefetch_pages(void);
+uint64_t migrate_vcpu_dirty_limit(void);
+bool migrate_use_async_flush(void);
 
 int migrate_use_xbzrle(void);
 int64_t migrate_xbzrle_cache_size(void);
@@ -31,12 +31,24 @@
 /* the page in cache will not be replaced in two cycles */
 #define CACHED_PAGE_LIFETIME 2
 
+/*
+ * The cache is two-way set associative.  Each item counts how often its
+ * page was found dirty again while cached; these are the pages XBZRLE
+ * pays off for.  A page that conflicts with two frequently dirtied pages
+ * wears their counts down instead of evicting them, so pages that are
+ * only dirtied once cannot flush out the working set.
+ */
+#define CACHE_WAYS 2
+#define CACHED_PAGE_MAX_HITS 8
+
 typedef struct CacheItem CacheItem;
 
 struct CacheItem {
     uint64_t it_addr;
     uint64_t it_age;
     uint8_t *it_data;
+    /* times the page was dirtied again while cached, saturating */
+    unsigned int it_hits;
 };
 
 struct PageCache {
@@ -44,6 +56,7 @@ struct PageCache {
     size_t page_size;
     size_t max_num_items;
     size_t num_items;
+    size_t ways;
 };
 
 PageCache *cache_init(int64_t new_size, size_t page_size, Error **errp)
@@ -75,6 +88,7 @@ PageCache *cache_init(int64_t new_size, size_t page_size, Error **errp)
     cache->page_size = page_size;
     cache->num_items = 0;
     cache->max_num_items = num_pages;
+    cache->ways = MIN(CACHE_WAYS, num_pages);
 
     DPRINTF("Setting cache buckets to %" PRId64 "\n", cache->max_num_items);
 
@@ -92,6 +106,7 @@ PageCache *cache_init(int64_t new_size, size_t page_size, Error **errp)
         cache->page_cache[i].it_data = NULL;
         cache->page_cache[i].it_age = 0;
         cache->page_cache[i].it_addr = -1;
+        cache->page_cache[i].it_hits = 0;
     }
 
     return cache;
@@ -113,28 +128,36 @@ void cache_fini(PageCache *cache)
     g_free(cache);
 }
 
-static size_t cache_get_cache_pos(const PageCache *cache,
-                                  uint64_t address)
-{
-    g_assert(cache->max_num_items);
-    return (address / cache->page_size) & (cache->max_num_items - 1);
-}
-
-static CacheItem *cache_get_by_addr(const PageCache *cache, uint64_t addr)
+static CacheItem *cache_get_set(const PageCache *cache, uint64_t address)
 {
     size_t pos;
 
     g_assert(cache);
     g_assert(cache->page_cache);
+    g_assert(cache->max_num_items);
 
-    pos = cache_get_cache_pos(cache, addr);
+    pos = (address / cache->page_size) & (cache->max_num_items - 1);
+    return &cache->page_cache[pos & ~(cache->ways - 1)];
+}
 
-    return &cache->page_cache[pos];
+static CacheItem *cache_get_by_addr(const PageCache *cache, uint64_t addr)
+{
+    CacheItem *set = cache_get_set(cache, addr);
+    size_t i;
+
+    for (i = 0; i < cache->ways; i++) {
+        if (set[i].it_addr == addr) {
+            return &set[i];
+        }
+    }
+    return NULL;
 }
 
 uint8_t *get_cached_data(const PageCache *cache, uint64_t addr)
 {
-    return cache_get_by_addr(cache, addr)->it_data;
+    CacheItem *it = cache_get_by_addr(cache, addr);
+
+    return it ? it->it_data : NULL;
 }
 
 bool cache_is_cached(const PageCache *cache, uint64_t addr,
@@ -144,14 +167,51 @@ bool cache_is_cached(const PageCache *cache, uint64_t addr,
 
     it = cache_get_by_addr(cache, addr);
 
-    if (it->it_addr == addr) {
+    if (it) {
         /* update the it_age when the cache hit */
         it->it_age = current_age;
+        if (it->it_hits < CACHED_PAGE_MAX_HITS) {
+            it->it_hits++;
+        }
         return true;
     }
     return false;
 }
 
+/*
+ * Pick the item of @addr's set that a new page may replace, or return
+ * NULL if every item is worth keeping.
+ */
+static CacheItem *cache_get_victim(const PageCache *cache, uint64_t addr,
+                                   uint64_t current_age)
+{
+    CacheItem *set = cache_get_set(cache, addr);
+    CacheItem *victim = NULL;
+    size_t i;
+
+    for (i = 0; i < cache->ways; i++) {
+        CacheItem *it = &set[i];
+
+        if (!it->it_data) {
+            return it;
+        }
+        /* the cache page is fresh, don't replace it */
+        if (it->it_age + CACHED_PAGE_LIFETIME > current_age) {
+            continue;
+        }
+        if (!victim || it->it_hits < victim->it_hits) {
+            victim = it;
+        }
+    }
+
+    if (victim && victim->it_hits) {
+        /* age the frequently dirtied page, it goes on the next conflict */
+        victim->it_hits--;
+        return NULL;
+    }
+    return victim;
+}
+
 int cache_insert(PageCache *cache, uint64_t addr, const uint8_t *pdata,
                  uint64_t current_age)
 {
@@ -160,12 +220,14 @@ int cache_insert(PageCache *cache, uint64_t addr, const uint8_t *pdata,
 
     /* actual update of entry */
     it = cache_get_by_addr(cache, addr);
-
-    if (it->it_data && it->it_addr != addr &&
-        it->it_age + CACHED_PAGE_LIFETIME > current_age) {
-        /* the cache page is fresh, don't replace it */
-        return -1;
+    if (!it) {
+        it = cache_get_victim(cache, addr, current_age);
+        if (!it) {
+            return -1;
+        }
+        it->it_hits = 0;
     }
+
     /* allocate page */
     if (!it->it_data) {
         it->it_data = g_try_malloc(cache->page_size);
@@ -26,6 +26,8 @@
 #include "qemu-common.h"
 #include "qemu/error-report.h"
 #include "qemu/iov.h"
+#include "qemu/bitmap.h"
+#include "qemu/thread.h"
 #include "migration.h"
 #include "qemu-file.h"
 #include "trace.h"
@@ -33,6 +35,25 @@
 #define IO_BUF_SIZE 32768
 #define MAX_IOV_SIZE MIN(IOV_MAX, 64)
 
+/*
+ * Second set of write buffers, handed over to a helper thread when the
+ * first one fills up so that the caller can go on filling the other.
+ */
+typedef struct QEMUFileFlusher {
+    QemuThread thread;
+    QemuMutex mutex;
+    QemuCond cond;
+    bool quit;
+    bool busy;          /* the batch below is being written */
+
+    uint8_t *buf;
+    unsigned long *may_free;
+    struct iovec *iov;
+    unsigned int iovcnt;
+    int64_t pos;
+    int error;          /* first error hit by the helper thread */
+} QEMUFileFlusher;
+
 struct QEMUFile {
     const QEMUFileOps *ops;
     const QEMUFileHooks *hooks;
@@ -45,12 +66,16 @@ struct QEMUFile {
                     when reading */
     int buf_index;
     int buf_size; /* 0 when writing */
-    uint8_t buf[IO_BUF_SIZE];
+    int buf_capacity; /* never below IO_BUF_SIZE */
+    uint8_t *buf;
 
-    DECLARE_BITMAP(may_free, MAX_IOV_SIZE);
-    struct iovec iov[MAX_IOV_SIZE];
+    unsigned int iov_capacity;
+    unsigned long *may_free;
+    struct iovec *iov;
     unsigned int iovcnt;
 
+    QEMUFileFlusher *flusher;
+
     int last_error;
 };
 
@@ -98,6 +123,11 @@ QEMUFile *qemu_fopen_ops(void *opaque, const QEMUFileOps *ops)
 
     f->opaque = opaque;
     f->ops = ops;
+    f->buf_capacity = IO_BUF_SIZE;
+    f->buf = g_malloc(f->buf_capacity);
+    f->iov_capacity = MAX_IOV_SIZE;
+    f->iov = g_new(struct iovec, f->iov_capacity);
+    f->may_free = bitmap_new(f->iov_capacity);
     return f;
 }
 
@@ -131,39 +161,174 @@ bool qemu_file_is_writable(QEMUFile *f)
     return f->ops->writev_buffer;
 }
 
-static void qemu_iovec_release_ram(QEMUFile *f)
+static void qemu_iovec_release_ram(const struct iovec *vec,
+                                   unsigned int iovcnt,
+                                   unsigned long *may_free)
 {
     struct iovec iov;
     unsigned long idx;
 
     /* Find and release all the contiguous memory ranges marked as may_free. */
-    idx = find_next_bit(f->may_free, f->iovcnt, 0);
-    if (idx >= f->iovcnt) {
+    idx = find_next_bit(may_free, iovcnt, 0);
+    if (idx >= iovcnt) {
         return;
     }
-    iov = f->iov[idx];
+    iov = vec[idx];
 
     /* The madvise() in the loop is called for iov within a continuous range and
      * then reinitialize the iov. And in the end, madvise() is called for the
      * last iov.
      */
-    while ((idx = find_next_bit(f->may_free, f->iovcnt, idx + 1)) < f->iovcnt) {
+    while ((idx = find_next_bit(may_free, iovcnt, idx + 1)) < iovcnt) {
         /* check for adjacent buffer and coalesce them */
-        if (iov.iov_base + iov.iov_len == f->iov[idx].iov_base) {
-            iov.iov_len += f->iov[idx].iov_len;
+        if (iov.iov_base + iov.iov_len == vec[idx].iov_base) {
+            iov.iov_len += vec[idx].iov_len;
             continue;
         }
         if (qemu_madvise(iov.iov_base, iov.iov_len, QEMU_MADV_DONTNEED) < 0) {
             error_report("migrate: madvise DONTNEED failed %p %zd: %s",
                          iov.iov_base, iov.iov_len, strerror(errno));
         }
-        iov = f->iov[idx];
+        iov = vec[idx];
     }
     if (qemu_madvise(iov.iov_base, iov.iov_len, QEMU_MADV_DONTNEED) < 0) {
             error_report("migrate: madvise DONTNEED failed %p %zd: %s",
                          iov.iov_base, iov.iov_len, strerror(errno));
     }
-    memset(f->may_free, 0, sizeof(f->may_free));
+    bitmap_zero(may_free, iovcnt);
+}
+
+static void *qemu_file_flush_thread(void *opaque)
+{
+    QEMUFile *f = opaque;
+    QEMUFileFlusher *fl = f->flusher;
+    ssize_t expect, ret;
+
+    qemu_mutex_lock(&fl->mutex);
+    for (;;) {
+        while (!fl->busy && !fl->quit) {
+            qemu_cond_wait(&fl->cond, &fl->mutex);
+        }
+        if (!fl->busy) {
+            break;
+        }
+        qemu_mutex_unlock(&fl->mutex);
+
+        expect = iov_size(fl->iov, fl->iovcnt);
+        ret = f->ops->writev_buffer(f->opaque, fl->iov, fl->iovcnt, fl->pos);
+        qemu_iovec_release_ram(fl->iov, fl->iovcnt, fl->may_free);
+
+        qemu_mutex_lock(&fl->mutex);
+        if (ret != expect && !fl->error) {
+            fl->error = ret < 0 ? ret : -EIO;
+        }
+        fl->iovcnt = 0;
+        fl->busy = false;
+        qemu_cond_signal(&fl->cond);
+    }
+    qemu_mutex_unlock(&fl->mutex);
+
+    return NULL;
+}
+
+/*
+ * Wait until the helper thread is done with the previous batch and
+ * pick up the error it may have hit.
+ */
+static void qemu_file_flusher_wait(QEMUFile *f)
+{
+    QEMUFileFlusher *fl = f->flusher;
+    int error;
+
+    qemu_mutex_lock(&fl->mutex);
+    while (fl->busy) {
+        qemu_cond_wait(&fl->cond, &fl->mutex);
+    }
+    error = fl->error;
+    fl->error = 0;
+    qemu_mutex_unlock(&fl->mutex);
+
+    if (error) {
+        qemu_file_set_error(f, error);
+    }
+}
+
+/*
+ * Enable a second set of write buffers and a helper thread for f:
+ * whenever the buffer or the iovec array fills up, the pending data is
+ * passed to the thread and the caller carries on with the other set.
+ * qemu_fflush() still waits for everything to be written.
+ *
+ * Not used for files with hooks (RDMA), which do their own queuing.
+ */
+void qemu_file_enable_async_flush(QEMUFile *f)
+{
+    QEMUFileFlusher *fl;
+
+    if (f->flusher || f->hooks || !qemu_file_is_writable(f)) {
+        return;
+    }
+
+    fl = g_new0(QEMUFileFlusher, 1);
+    fl->buf = g_malloc(f->buf_capacity);
+    fl->iov = g_new(struct iovec, f->iov_capacity);
+    fl->may_free = bitmap_new(f->iov_capacity);
+    qemu_mutex_init(&fl->mutex);
+    qemu_cond_init(&fl->cond);
+    f->flusher = fl;
+
+    qemu_thread_create(&fl->thread, "migration flush",
+                       qemu_file_flush_thread, f, QEMU_THREAD_JOINABLE);
+}
+
+static void qemu_file_stop_async_flush(QEMUFile *f)
+{
+    QEMUFileFlusher *fl = f->flusher;
+
+    qemu_mutex_lock(&fl->mutex);
+    fl->quit = true;
+    qemu_cond_signal(&fl->cond);
+    qemu_mutex_unlock(&fl->mutex);
+    qemu_thread_join(&fl->thread);
+
+    qemu_cond_destroy(&fl->cond);
+    qemu_mutex_destroy(&fl->mutex);
+    g_free(fl->may_free);
+    g_free(fl->iov);
+    g_free(fl->buf);
+    g_free(fl);
+    f->flusher = NULL;
+}
+
+/*
+ * Resize the write buffer and the iovec array of f.  Larger values
+ * mean fewer, bigger writes to the backend; the buffer is never made
+ * smaller than IO_BUF_SIZE since the read side relies on it.
+ */
+void qemu_file_set_buffer_size(QEMUFile *f, size_t buf_size,
+                               unsigned int iov_count)
+{
+    assert(!f->flusher);
+
+    if (!qemu_file_is_writable(f)) {
+        return;
+    }
+
+    buf_size = MAX(buf_size, IO_BUF_SIZE);
+    iov_count = MIN(MAX(iov_count, 1), IOV_MAX);
+    if (buf_size == f->buf_capacity && iov_count == f->iov_capacity) {
+        return;
+    }
+
+    qemu_fflush(f);
+
+    g_free(f->buf);
+    f->buf_capacity = buf_size;
+    f->buf = g_malloc(f->buf_capacity);
+    g_free(f->may_free);
+    f->iov_capacity = iov_count;
+    f->iov = g_renew(struct iovec, f->iov, f->iov_capacity);
+    f->may_free = bitmap_new(f->iov_capacity);
 }
 
 /**
@@ -182,11 +347,15 @@ void qemu_fflush(QEMUFile *f)
         return;
     }
 
+    if (f->flusher) {
+        qemu_file_flusher_wait(f);
+    }
+
     if (f->iovcnt > 0) {
         expect = iov_size(f->iov, f->iovcnt);
         ret = f->ops->writev_buffer(f->opaque, f->iov, f->iovcnt, f->pos);
 
-        qemu_iovec_release_ram(f);
+        qemu_iovec_release_ram(f->iov, f->iovcnt, f->may_free);
     }
 
     if (ret >= 0) {
@@ -202,6 +371,53 @@ void qemu_fflush(QEMUFile *f)
     f->iovcnt = 0;
 }
 
+/*
+ * Flush because the buffer or the iovec array is full.  With a helper
+ * thread the batch is swapped with the spare set and written in the
+ * background; the stream position is advanced right away.
+ */
+static void qemu_fflush_async(QEMUFile *f)
+{
+    QEMUFileFlusher *fl = f->flusher;
+    uint8_t *buf;
+    unsigned long *may_free;
+    struct iovec *iov;
+
+    if (!fl) {
+        qemu_fflush(f);
+        return;
+    }
+
+    qemu_file_flusher_wait(f);
+    if (f->last_error) {
+        /* The stream is broken, don't bother writing the rest */
+        bitmap_zero(f->may_free, f->iovcnt);
+        f->buf_index = 0;
+        f->iovcnt = 0;
+        return;
+    }
+
+    qemu_mutex_lock(&fl->mutex);
+    buf = fl->buf;
+    may_free = fl->may_free;
+    iov = fl->iov;
+    fl->buf = f->buf;
+    fl->may_free = f->may_free;
+    fl->iov = f->iov;
+    fl->iovcnt = f->iovcnt;
+    fl->pos = f->pos;
+    fl->busy = fl->iovcnt > 0;
+    qemu_cond_signal(&fl->cond);
+    qemu_mutex_unlock(&fl->mutex);
+
+    f->pos += iov_size(fl->iov, fl->iovcnt);
+    f->buf = buf;
+    f->may_free = may_free;
+    f->iov = iov;
+    f->buf_index = 0;
+    f->iovcnt = 0;
+}
+
 void ram_control_before_iterate(QEMUFile *f, uint64_t flags)
 {
     int ret = 0;
@@ -321,6 +537,9 @@ int qemu_fclose(QEMUFile *f)
 {
     int ret;
     qemu_fflush(f);
+    if (f->flusher) {
+        qemu_file_stop_async_flush(f);
+    }
     ret = qemu_file_get_error(f);
 
     if (f->ops->close) {
@@ -335,6 +554,9 @@ int qemu_fclose(QEMUFile *f)
     if (f->last_error) {
         ret = f->last_error;
     }
+    g_free(f->may_free);
+    g_free(f->iov);
+    g_free(f->buf);
     g_free(f);
     trace_qemu_file_fclose();
     return ret;
@@ -357,8 +579,8 @@ static void add_to_iovec(QEMUFile *f, const uint8_t *buf, size_t size,
         f->iov[f->iovcnt++].iov_len = size;
     }
 
-    if (f->iovcnt >= MAX_IOV_SIZE) {
-        qemu_fflush(f);
+    if (f->iovcnt >= f->iov_capacity) {
+        qemu_fflush_async(f);
     }
 }
 
@@ -382,7 +604,7 @@ void qemu_put_buffer(QEMUFile *f, const uint8_t *buf, size_t size)
     }
 
     while (size > 0) {
-        l = IO_BUF_SIZE - f->buf_index;
+        l = f->buf_capacity - f->buf_index;
         if (l > size) {
             l = size;
         }
@@ -390,8 +612,8 @@ void qemu_put_buffer(QEMUFile *f, const uint8_t *buf, size_t size)
         f->bytes_xfer += l;
         add_to_iovec(f, f->buf + f->buf_index, l, false);
         f->buf_index += l;
-        if (f->buf_index == IO_BUF_SIZE) {
-            qemu_fflush(f);
+        if (f->buf_index == f->buf_capacity) {
+            qemu_fflush_async(f);
         }
         if (qemu_file_get_error(f)) {
             break;
@@ -411,8 +633,8 @@ void qemu_put_byte(QEMUFile *f, int v)
     f->bytes_xfer++;
     add_to_iovec(f, f->buf + f->buf_index, 1, false);
     f->buf_index++;
-    if (f->buf_index == IO_BUF_SIZE) {
-        qemu_fflush(f);
+    if (f->buf_index == f->buf_capacity) {
+        qemu_fflush_async(f);
     }
 }
 
@@ -694,14 +916,14 @@ static int qemu_compress_data(z_stream *stream, uint8_t *dest, size_t dest_len,
 ssize_t qemu_put_compression_data(QEMUFile *f, z_stream *stream,
                                   const uint8_t *p, size_t size)
 {
-    ssize_t blen = IO_BUF_SIZE - f->buf_index - sizeof(int32_t);
+    ssize_t blen = f->buf_capacity - f->buf_index - sizeof(int32_t);
 
     if (blen < compressBound(size)) {
         if (!qemu_file_is_writable(f)) {
             return -1;
         }
         qemu_fflush(f);
-        blen = IO_BUF_SIZE - sizeof(int32_t);
+        blen = f->buf_capacity - sizeof(int32_t);
         if (blen < compressBound(size)) {
             return -1;
         }
@@ -718,7 +940,7 @@ ssize_t qemu_put_compression_data(QEMUFile *f, z_stream *stream,
         add_to_iovec(f, f->buf + f->buf_index, blen, false);
     }
     f->buf_index += blen;
-    if (f->buf_index == IO_BUF_SIZE) {
+    if (f->buf_index == f->buf_capacity) {
         qemu_fflush(f);
     }
     return blen + sizeof(int32_t);
@@ -155,6 +155,9 @@ int qemu_file_shutdown(QEMUFile *f);
 QEMUFile *qemu_file_get_return_path(QEMUFile *f);
 void qemu_fflush(QEMUFile *f);
 void qemu_file_set_blocking(QEMUFile *f, bool block);
+void qemu_file_set_buffer_size(QEMUFile *f, size_t buf_size,
+                               unsigned int iov_count);
+void qemu_file_enable_async_flush(QEMUFile *f);
 
 size_t qemu_get_counted_string(QEMUFile *f, char buf[256]);
 
@@ -29,6 +29,12 @@
 #include "qemu/osdep.h"
 #include "cpu.h"
 #include <zlib.h>
+#ifdef CONFIG_ZSTD
+#include <zstd.h>
+#endif
+#ifdef CONFIG_LZ4
+#include <lz4.h>
+#endif
 #include "qemu/cutils.h"
 #include "qemu/bitops.h"
 #include "qemu/bitmap.h"
@@ -75,6 +81,7 @@
 #define RAM_SAVE_FLAG_XBZRLE   0x40
 /* 0x80 is reserved in migration.h start with 0x100 next */
 #define RAM_SAVE_FLAG_COMPRESS_PAGE    0x100
+#define RAM_SAVE_FLAG_MAPPED   0x200
 
 static inline bool is_zero_range(uint8_t *p, uint64_t size)
 {
@@ -158,18 +165,46 @@ out:
     return ret;
 }
 
+bool ramblock_is_ignored(RAMBlock *block)
+{
+    return !qemu_ram_is_migratable(block) ||
+           (migrate_ignore_shared() && qemu_ram_is_shared(block));
+}
+
 /* Should be holding either ram_list.mutex, or the RCU lock. */
+#define RAMBLOCK_FOREACH_NOT_IGNORED(block)            \
+    INTERNAL_RAMBLOCK_FOREACH(block)                   \
+        if (ramblock_is_ignored(block)) {} else
+
 #define RAMBLOCK_FOREACH_MIGRATABLE(block)             \
     INTERNAL_RAMBLOCK_FOREACH(block)                   \
         if (!qemu_ram_is_migratable(block)) {} else
 
 #undef RAMBLOCK_FOREACH
 
+int foreach_not_ignored_block(RAMBlockIterFunc func, void *opaque)
+{
+    RAMBlock *block;
+    int ret = 0;
+
+    rcu_read_lock();
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        ret = func(block->idstr, block->host, block->offset,
+                   block->used_length, opaque);
+        if (ret) {
+            break;
+        }
+    }
+    rcu_read_unlock();
+
+    return ret;
+}
+
 static void ramblock_recv_map_init(void)
 {
     RAMBlock *rb;
 
-    RAMBLOCK_FOREACH_MIGRATABLE(rb) {
+    RAMBLOCK_FOREACH_NOT_IGNORED(rb) {
         assert(!rb->receivedmap);
         rb->receivedmap = bitmap_new(rb->max_length >> qemu_target_page_bits());
     }
@@ -275,6 +310,19 @@ struct RAMSrcPageRequest {
     QSIMPLEQ_ENTRY(RAMSrcPageRequest) next_req;
 };
 
+/* Maximum number of postcopy prefetch windows kept queued */
+#define POSTCOPY_PREFETCH_MAX_WINDOWS 16
+
+/* Dirty rate of one vCPU, measured from its dirty ring */
+typedef struct VcpuDirtyStat {
+    /* Whether pages_prev holds a sample already */
+    bool seen;
+    /* cpu->dirty_pages at the start of the period */
+    uint64_t pages_prev;
+    /* Bytes dirtied per second over the last period */
+    uint64_t rate;
+} VcpuDirtyStat;
+
 /* State of RAM for migration */
 struct RAMState {
     /* QEMUFile used for this migration */
@@ -289,6 +337,8 @@ struct RAMState {
     uint32_t last_version;
     /* We are in the first round */
     bool ram_bulk_stage;
+    /* Free page hints clear bits, so the first round must check them */
+    bool free_page_hints;
     /* How many times we have dirty too many pages */
     int dirty_rate_high_cnt;
     /* these variables are used for bitmap sync */
@@ -313,17 +363,82 @@ struct RAMState {
     /* Queue of outstanding page requests from the destination */
     QemuMutex src_page_req_mutex;
     QSIMPLEQ_HEAD(src_page_requests, RAMSrcPageRequest) src_page_requests;
+    /*
+     * Pages around recent requests, sent after the requested pages but
+     * before the background search; protected by src_page_req_mutex
+     */
+    struct src_page_requests src_prefetch_requests;
+    /* Number of entries in src_prefetch_requests */
+    unsigned int src_prefetch_count;
+    /* Per-vCPU dirty rates, indexed by cpu_index; protected by the BQL */
+    VcpuDirtyStat *vcpu_dirty;
+    int vcpu_dirty_count;
 };
 typedef struct RAMState RAMState;
 
 static RAMState *ram_state;
 
+static NotifierList precopy_notifier_list =
+    NOTIFIER_LIST_INITIALIZER(precopy_notifier_list);
+
+void precopy_add_notifier(Notifier *n)
+{
+    notifier_list_add(&precopy_notifier_list, n);
+}
+
+void precopy_remove_notifier(Notifier *n)
+{
+    notifier_remove(n);
+}
+
+static void precopy_notify(PrecopyNotifyReason reason)
+{
+    notifier_list_notify(&precopy_notifier_list, &reason);
+}
+
+void precopy_enable_free_page_hints(void)
+{
+    if (ram_state) {
+        ram_state->free_page_hints = true;
+        ram_state->ram_bulk_stage = false;
+    }
+}
+
 uint64_t ram_bytes_remaining(void)
 {
     return ram_state ? (ram_state->migration_dirty_pages * TARGET_PAGE_SIZE) :
                        0;
 }
 
+VcpuDirtyInfoList *ram_vcpu_dirty_info(void)
+{
+    VcpuDirtyInfoList *head = NULL, **tail = &head;
+    RAMState *rs = ram_state;
+    CPUState *cpu;
+
+    if (!rs) {
+        return NULL;
+    }
+
+    CPU_FOREACH(cpu) {
+        VcpuDirtyInfoList *entry;
+
+        if (cpu->cpu_index >= rs->vcpu_dirty_count ||
+            !rs->vcpu_dirty[cpu->cpu_index].seen) {
+            continue;
+        }
+        entry = g_new0(VcpuDirtyInfoList, 1);
+        entry->value = g_new0(VcpuDirtyInfo, 1);
+        entry->value->cpu_index = cpu->cpu_index;
+        entry->value->dirty_rate = rs->vcpu_dirty[cpu->cpu_index].rate;
+        entry->value->throttle_percentage =
+            cpu_throttle_get_vcpu_percentage(cpu);
+        *tail = entry;
+        tail = &entry->next;
+    }
+    return head;
+}
+
 MigrationStats ram_counters;
 
 /* used by the search for pages to send */
@@ -509,10 +624,20 @@ exit:
 /* Multiple fd's */
 
 #define MULTIFD_MAGIC 0x11223344U
-#define MULTIFD_VERSION 1
+#define MULTIFD_VERSION 2
 
 #define MULTIFD_FLAG_SYNC (1 << 0)
 
+/* We reserve 3 bits for compression methods */
+#define MULTIFD_FLAG_COMPRESSION_MASK (7 << 1)
+#define MULTIFD_FLAG_NOCOMP (0 << 1)
+#define MULTIFD_FLAG_ZLIB (1 << 1)
+#define MULTIFD_FLAG_ZSTD (2 << 1)
+#define MULTIFD_FLAG_LZ4 (3 << 1)
+
+/* The payload is a device state section instead of pages */
+#define MULTIFD_FLAG_DEVICE_STATE (1 << 4)
+
 typedef struct {
     uint32_t magic;
     uint32_t version;
@@ -526,6 +651,8 @@ typedef struct {
     uint32_t flags;
     uint32_t size;
     uint32_t used;
+    /* size of the payload that follows this packet */
+    uint32_t next_packet_size;
     uint64_t packet_num;
     char ramblock[256];
     uint64_t offset[];
@@ -580,8 +707,17 @@ typedef struct {
     uint64_t num_packets;
     /* pages sent through this channel */
     uint64_t num_pages;
+    /* size of the payload of the current packet */
+    uint32_t next_packet_size;
     /* syncs main thread and channels */
     QemuSemaphore sem_sync;
+    /* compression method private state, owned by the channel thread */
+    void *data;
+    /* pages are sent with MSG_ZEROCOPY */
+    bool zero_copy;
+    /* device state section to send instead of pages, owned by the job */
+    uint8_t *device_state;
+    uint32_t device_state_len;
 }  MultiFDSendParams;
 
 typedef struct {
@@ -613,10 +749,660 @@ typedef struct {
     uint64_t num_packets;
     /* pages sent through this channel */
     uint64_t num_pages;
+    /* size of the payload of the current packet */
+    uint32_t next_packet_size;
     /* syncs main thread and channels */
     QemuSemaphore sem_sync;
+    /* compression method private state, owned by the channel thread */
+    void *data;
 } MultiFDRecvParams;
 
+typedef struct {
+    /* flag carried by every packet compressed with this method */
+    uint32_t flag;
+    /* set up the per channel stream state */
+    int (*send_setup)(MultiFDSendParams *p, Error **errp);
+    /* release it */
+    void (*send_cleanup)(MultiFDSendParams *p);
+    /*
+     * Compress the @used pages in p->pages and set p->next_packet_size;
+     * the payload is then written by send_write.
+     */
+    int (*send_prepare)(MultiFDSendParams *p, uint32_t used, Error **errp);
+    int (*send_write)(MultiFDSendParams *p, uint32_t used, Error **errp);
+    int (*recv_setup)(MultiFDRecvParams *p, Error **errp);
+    void (*recv_cleanup)(MultiFDRecvParams *p);
+    /* read p->next_packet_size bytes and fill the @used pages */
+    int (*recv_pages)(MultiFDRecvParams *p, uint32_t used, Error **errp);
+} MultiFDMethods;
+
+/* Multifd without compression */
+
+static int nocomp_send_setup(MultiFDSendParams *p, Error **errp)
+{
+    return 0;
+}
+
+static void nocomp_send_cleanup(MultiFDSendParams *p)
+{
+}
+
+static int nocomp_send_prepare(MultiFDSendParams *p, uint32_t used,
+                               Error **errp)
+{
+    p->next_packet_size = used * TARGET_PAGE_SIZE;
+    return 0;
+}
+
+static int nocomp_send_write(MultiFDSendParams *p, uint32_t used,
+                             Error **errp)
+{
+    if (p->zero_copy) {
+        return qio_channel_writev_zero_copy_all(p->c, p->pages->iov, used,
+                                                errp);
+    }
+    return qio_channel_writev_all(p->c, p->pages->iov, used, errp);
+}
+
+static int nocomp_recv_setup(MultiFDRecvParams *p, Error **errp)
+{
+    return 0;
+}
+
+static void nocomp_recv_cleanup(MultiFDRecvParams *p)
+{
+}
+
+static int nocomp_recv_pages(MultiFDRecvParams *p, uint32_t used,
+                             Error **errp)
+{
+    if (p->next_packet_size != used * TARGET_PAGE_SIZE) {
+        error_setg(errp, "multifd %d: received packet size %d "
+                   "and expected %d", p->id, p->next_packet_size,
+                   used * (int)TARGET_PAGE_SIZE);
+        return -1;
+    }
+    return qio_channel_readv_all(p->c, p->pages->iov, used, errp);
+}
+
+static MultiFDMethods multifd_nocomp_ops = {
+    .flag = MULTIFD_FLAG_NOCOMP,
+    .send_setup = nocomp_send_setup,
+    .send_cleanup = nocomp_send_cleanup,
+    .send_prepare = nocomp_send_prepare,
+    .send_write = nocomp_send_write,
+    .recv_setup = nocomp_recv_setup,
+    .recv_cleanup = nocomp_recv_cleanup,
+    .recv_pages = nocomp_recv_pages,
+};
+
+/*
+ * Compressed payloads are built in a per channel buffer; the compression
+ * methods below share the way it is sent and received.
+ */
+static int multifd_zbuff_write(MultiFDSendParams *p, uint8_t *zbuff,
+                               Error **errp)
+{
+    return qio_channel_write_all(p->c, (char *)zbuff, p->next_packet_size,
+                                 errp);
+}
+
+static int multifd_zbuff_read(MultiFDRecvParams *p, uint8_t *zbuff,
+                              size_t zbuff_len, Error **errp)
+{
+    if (p->next_packet_size > zbuff_len) {
+        error_setg(errp, "multifd %d: compressed packet size %d "
+                   "larger than buffer size %zd", p->id,
+                   p->next_packet_size, zbuff_len);
+        return -1;
+    }
+    return qio_channel_read_all(p->c, (char *)zbuff, p->next_packet_size,
+                                errp);
+}
+
+/*
+ * Multifd zlib compression
+ *
+ * Each channel keeps its deflate/inflate stream for the whole
+ * migration, so the dictionary built on previous packets keeps being
+ * used; every packet ends with a sync flush so that the destination
+ * can decompress it on its own.  Pages are copied before compression
+ * because the guest can change them under our feet, and deflate does
+ * not cope with its input changing while it looks at it.
+ */
+
+struct zlib_data {
+    z_stream zs;
+    /* buffer for the compressed packet */
+    uint8_t *zbuff;
+    size_t zbuff_len;
+    /* stable copy of the page being compressed */
+    uint8_t *buf;
+};
+
+static int zlib_send_setup(MultiFDSendParams *p, Error **errp)
+{
+    struct zlib_data *z = g_new0(struct zlib_data, 1);
+
+    if (deflateInit(&z->zs, migrate_compress_level()) != Z_OK) {
+        g_free(z);
+        error_setg(errp, "multifd %d: deflate init failed", p->id);
+        return -1;
+    }
+    z->zbuff_len = migrate_multifd_page_count() * TARGET_PAGE_SIZE * 2;
+    z->zbuff = g_malloc(z->zbuff_len);
+    z->buf = g_malloc(TARGET_PAGE_SIZE);
+    p->data = z;
+    return 0;
+}
+
+static void zlib_send_cleanup(MultiFDSendParams *p)
+{
+    struct zlib_data *z = p->data;
+
+    deflateEnd(&z->zs);
+    g_free(z->zbuff);
+    g_free(z->buf);
+    g_free(z);
+    p->data = NULL;
+}
+
+static int zlib_send_prepare(MultiFDSendParams *p, uint32_t used,
+                             Error **errp)
+{
+    struct zlib_data *z = p->data;
+    z_stream *zs = &z->zs;
+    int ret = Z_OK;
+    uint32_t i;
+
+    zs->next_out = z->zbuff;
+    zs->avail_out = z->zbuff_len;
+
+    for (i = 0; i < used; i++) {
+        int flush = i == used - 1 ? Z_SYNC_FLUSH : Z_NO_FLUSH;
+
+        memcpy(z->buf, p->pages->iov[i].iov_base, TARGET_PAGE_SIZE);
+        zs->next_in = z->buf;
+        zs->avail_in = TARGET_PAGE_SIZE;
+
+        do {
+            ret = deflate(zs, flush);
+        } while (ret == Z_OK && zs->avail_in && zs->avail_out);
+
+        if (ret == Z_OK && zs->avail_in) {
+            error_setg(errp, "multifd %d: deflate failed to compress "
+                       "all input", p->id);
+            return -1;
+        }
+        if (ret != Z_OK) {
+            error_setg(errp, "multifd %d: deflate returned %d instead "
+                       "of Z_OK", p->id, ret);
+            return -1;
+        }
+    }
+    p->next_packet_size = z->zbuff_len - zs->avail_out;
+    return 0;
+}
+
+static int zlib_send_write(MultiFDSendParams *p, uint32_t used,
+                           Error **errp)
+{
+    struct zlib_data *z = p->data;
+
+    return multifd_zbuff_write(p, z->zbuff, errp);
+}
+
+static int zlib_recv_setup(MultiFDRecvParams *p, Error **errp)
+{
+    struct zlib_data *z = g_new0(struct zlib_data, 1);
+
+    if (inflateInit(&z->zs) != Z_OK) {
+        g_free(z);
+        error_setg(errp, "multifd %d: inflate init failed", p->id);
+        return -1;
+    }
+    /* Same size as the buffer on the source side */
+    z->zbuff_len = migrate_multifd_page_count() * TARGET_PAGE_SIZE * 2;
+    z->zbuff = g_malloc(z->zbuff_len);
+    p->data = z;
+    return 0;
+}
+
+static void zlib_recv_cleanup(MultiFDRecvParams *p)
+{
+    struct zlib_data *z = p->data;
+
+    inflateEnd(&z->zs);
+    g_free(z->zbuff);
+    g_free(z);
+    p->data = NULL;
+}
+
+static int zlib_recv_pages(MultiFDRecvParams *p, uint32_t used,
+                           Error **errp)
+{
+    struct zlib_data *z = p->data;
+    z_stream *zs = &z->zs;
+    unsigned long start = zs->total_out;
+    int ret = Z_OK;
+    uint32_t i;
+
+    if (!used) {
+        return 0;
+    }
+    if (multifd_zbuff_read(p, z->zbuff, z->zbuff_len, errp) != 0) {
+        return -1;
+    }
+
+    zs->next_in = z->zbuff;
+    zs->avail_in = p->next_packet_size;
+
+    for (i = 0; i < used; i++) {
+        int flush = i == used - 1 ? Z_SYNC_FLUSH : Z_NO_FLUSH;
+
+        zs->next_out = p->pages->iov[i].iov_base;
+        zs->avail_out = TARGET_PAGE_SIZE;
+
+        do {
+            ret = inflate(zs, flush);
+        } while (ret == Z_OK && zs->avail_in && zs->avail_out);
+
+        if (ret != Z_OK) {
+            error_setg(errp, "multifd %d: inflate returned %d instead "
+                       "of Z_OK", p->id, ret);
+            return -1;
+        }
+    }
+    if (zs->total_out - start != used * TARGET_PAGE_SIZE) {
+        error_setg(errp, "multifd %d: packet size received %lu "
+                   "and expected %d", p->id, zs->total_out - start,
+                   used * (int)TARGET_PAGE_SIZE);
+        return -1;
+    }
+    return 0;
+}
+
+static MultiFDMethods multifd_zlib_ops = {
+    .flag = MULTIFD_FLAG_ZLIB,
+    .send_setup = zlib_send_setup,
+    .send_cleanup = zlib_send_cleanup,
+    .send_prepare = zlib_send_prepare,
+    .send_write = zlib_send_write,
+    .recv_setup = zlib_recv_setup,
+    .recv_cleanup = zlib_recv_cleanup,
+    .recv_pages = zlib_recv_pages,
+};
+
+#ifdef CONFIG_ZSTD
+/*
+ * Multifd zstd compression
+ *
+ * Same scheme as zlib: one stream per channel, flushed at the end of
+ * every packet.
+ */
+
+struct zstd_data {
+    ZSTD_CStream *zcs;
+    ZSTD_DStream *zds;
+    uint8_t *zbuff;
+    size_t zbuff_len;
+    uint8_t *buf;
+};
+
+static int zstd_send_setup(MultiFDSendParams *p, Error **errp)
+{
+    struct zstd_data *z = g_new0(struct zstd_data, 1);
+    size_t ret;
+
+    z->zcs = ZSTD_createCStream();
+    if (!z->zcs) {
+        g_free(z);
+        error_setg(errp, "multifd %d: zstd createCStream failed", p->id);
+        return -1;
+    }
+    ret = ZSTD_initCStream(z->zcs, migrate_compress_level());
+    if (ZSTD_isError(ret)) {
+        ZSTD_freeCStream(z->zcs);
+        g_free(z);
+        error_setg(errp, "multifd %d: initCStream failed with error %s",
+                   p->id, ZSTD_getErrorName(ret));
+        return -1;
+    }
+    z->zbuff_len = migrate_multifd_page_count() * TARGET_PAGE_SIZE * 2;
+    z->zbuff = g_malloc(z->zbuff_len);
+    z->buf = g_malloc(TARGET_PAGE_SIZE);
+    p->data = z;
+    return 0;
+}
+
+static void zstd_send_cleanup(MultiFDSendParams *p)
+{
+    struct zstd_data *z = p->data;
+
+    ZSTD_freeCStream(z->zcs);
+    g_free(z->zbuff);
+    g_free(z->buf);
+    g_free(z);
+    p->data = NULL;
+}
+
+static int zstd_send_prepare(MultiFDSendParams *p, uint32_t used,
+                             Error **errp)
+{
+    struct zstd_data *z = p->data;
+    ZSTD_outBuffer out = { .dst = z->zbuff, .size = z->zbuff_len };
+    size_t ret = 0;
+    uint32_t i;
+
+    for (i = 0; i < used; i++) {
+        ZSTD_EndDirective flush = i == used - 1 ? ZSTD_e_flush
+                                                : ZSTD_e_continue;
+        ZSTD_inBuffer in = { .src = z->buf, .size = TARGET_PAGE_SIZE };
+
+        memcpy(z->buf, p->pages->iov[i].iov_base, TARGET_PAGE_SIZE);
+
+        do {
+            ret = ZSTD_compressStream2(z->zcs, &out, &in, flush);
+        } while (ret > 0 && !ZSTD_isError(ret) &&
+                 (in.pos < in.size || flush == ZSTD_e_flush) &&
+                 out.pos < out.size);
+
+        if (ZSTD_isError(ret)) {
+            error_setg(errp, "multifd %d: compressStream error %s",
+                       p->id, ZSTD_getErrorName(ret));
+            return -1;
+        }
+        if (in.pos < in.size || (flush == ZSTD_e_flush && ret > 0)) {
+            error_setg(errp, "multifd %d: compressStream buffer too small",
+                       p->id);
+            return -1;
+        }
+    }
+    p->next_packet_size = out.pos;
+    return 0;
+}
+
+static int zstd_send_write(MultiFDSendParams *p, uint32_t used,
+                           Error **errp)
+{
+    struct zstd_data *z = p->data;
+
+    return multifd_zbuff_write(p, z->zbuff, errp);
+}
+
+static int zstd_recv_setup(MultiFDRecvParams *p, Error **errp)
+{
+    struct zstd_data *z = g_new0(struct zstd_data, 1);
+    size_t ret;
+
+    z->zds = ZSTD_createDStream();
+    if (!z->zds) {
+        g_free(z);
+        error_setg(errp, "multifd %d: zstd createDStream failed", p->id);
+        return -1;
+    }
+    ret = ZSTD_initDStream(z->zds);
+    if (ZSTD_isError(ret)) {
+        ZSTD_freeDStream(z->zds);
+        g_free(z);
+        error_setg(errp, "multifd %d: initDStream failed with error %s",
+                   p->id, ZSTD_getErrorName(ret));
+        return -1;
+    }
+    z->zbuff_len = migrate_multifd_page_count() * TARGET_PAGE_SIZE * 2;
+    z->zbuff = g_malloc(z->zbuff_len);
+    p->data = z;
+    return 0;
+}
+
+static void zstd_recv_cleanup(MultiFDRecvParams *p)
+{
+    struct zstd_data *z = p->data;
+
+    ZSTD_freeDStream(z->zds);
+    g_free(z->zbuff);
+    g_free(z);
+    p->data = NULL;
+}
+
+static int zstd_recv_pages(MultiFDRecvParams *p, uint32_t used,
+                           Error **errp)
+{
+    struct zstd_data *z = p->data;
+    ZSTD_inBuffer in = { .src = z->zbuff };
+    size_t ret;
+    uint32_t i;
+
+    if (!used) {
+        return 0;
+    }
+    if (multifd_zbuff_read(p, z->zbuff, z->zbuff_len, errp) != 0) {
+        return -1;
+    }
+    in.size = p->next_packet_size;
+
+    for (i = 0; i < used; i++) {
+        ZSTD_outBuffer out = {
+            .dst = p->pages->iov[i].iov_base,
+            .size = TARGET_PAGE_SIZE,
+        };
+
+        do {
+            ret = ZSTD_decompressStream(z->zds, &out, &in);
+        } while (ret > 0 && !ZSTD_isError(ret) &&
+                 in.pos < in.size && out.pos < out.size);
+
+        if (ZSTD_isError(ret)) {
+            error_setg(errp, "multifd %d: decompressStream error %s",
+                       p->id, ZSTD_getErrorName(ret));
+            return -1;
+        }
+        if (out.pos != out.size) {
+            error_setg(errp, "multifd %d: decompressed page size %zd "
+                       "and expected %zd", p->id, out.pos, out.size);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static MultiFDMethods multifd_zstd_ops = {
+    .flag = MULTIFD_FLAG_ZSTD,
+    .send_setup = zstd_send_setup,
+    .send_cleanup = zstd_send_cleanup,
+    .send_prepare = zstd_send_prepare,
+    .send_write = zstd_send_write,
+    .recv_setup = zstd_recv_setup,
+    .recv_cleanup = zstd_recv_cleanup,
+    .recv_pages = zstd_recv_pages,
+};
+#endif /* CONFIG_ZSTD */
+
+#ifdef CONFIG_LZ4
+/*
+ * Multifd lz4 compression
+ *
+ * lz4 is a block compressor: the pages of a packet are gathered in a
+ * per channel buffer and compressed as one block, reusing the per
+ * channel compression state.  The level is ignored, lz4 is used for
+ * speed.
+ */
+
+struct lz4_data {
+    /* LZ4_sizeofState() bytes of compression state */
+    void *state;
+    uint8_t *zbuff;
+    size_t zbuff_len;
+    /* the pages of the packet, back to back */
+    uint8_t *buf;
+};
+
+static int lz4_send_setup(MultiFDSendParams *p, Error **errp)
+{
+    struct lz4_data *z = g_new0(struct lz4_data, 1);
+    uint32_t page_count = migrate_multifd_page_count();
+
+    z->state = g_malloc(LZ4_sizeofState());
+    z->zbuff_len = LZ4_compressBound(page_count * TARGET_PAGE_SIZE);
+    z->zbuff = g_malloc(z->zbuff_len);
+    z->buf = g_malloc(page_count * TARGET_PAGE_SIZE);
+    p->data = z;
+    return 0;
+}
+
+static void lz4_send_cleanup(MultiFDSendParams *p)
+{
+    struct lz4_data *z = p->data;
+
+    g_free(z->state);
+    g_free(z->zbuff);
+    g_free(z->buf);
+    g_free(z);
+    p->data = NULL;
+}
+
+static int lz4_send_prepare(MultiFDSendParams *p, uint32_t used,
+                            Error **errp)
+{
+    struct lz4_data *z = p->data;
+    size_t len = used * TARGET_PAGE_SIZE;
+    int ret;
+
+    if (!used) {
+        p->next_packet_size = 0;
+        return 0;
+    }
+    iov_to_buf(p->pages->iov, used, 0, z->buf, len);
+    ret = LZ4_compress_fast_extState(z->state, (const char *)z->buf,
+                                     (char *)z->zbuff, len, z->zbuff_len, 1);
+    if (ret <= 0) {
+        error_setg(errp, "multifd %d: lz4 compression failed", p->id);
+        return -1;
+    }
+    p->next_packet_size = ret;
+    return 0;
+}
+
+static int lz4_send_write(MultiFDSendParams *p, uint32_t used,
+                          Error **errp)
+{
+    struct lz4_data *z = p->data;
+
+    return multifd_zbuff_write(p, z->zbuff, errp);
+}
+
+static int lz4_recv_setup(MultiFDRecvParams *p, Error **errp)
+{
+    struct lz4_data *z = g_new0(struct lz4_data, 1);
+    uint32_t page_count = migrate_multifd_page_count();
+
+    z->zbuff_len = LZ4_compressBound(page_count * TARGET_PAGE_SIZE);
+    z->zbuff = g_malloc(z->zbuff_len);
+    z->buf = g_malloc(page_count * TARGET_PAGE_SIZE);
+    p->data = z;
+    return 0;
+}
+
+static void lz4_recv_cleanup(MultiFDRecvParams *p)
+{
+    struct lz4_data *z = p->data;
+
+    g_free(z->zbuff);
+    g_free(z->buf);
+    g_free(z);
+    p->data = NULL;
+}
+
+static int lz4_recv_pages(MultiFDRecvParams *p, uint32_t used,
+                          Error **errp)
+{
+    struct lz4_data *z = p->data;
+    int len = used * TARGET_PAGE_SIZE;
+    int ret;
+
+    if (!used) {
+        return 0;
+    }
+    if (multifd_zbuff_read(p, z->zbuff, z->zbuff_len, errp) != 0) {
+        return -1;
+    }
+    ret = LZ4_decompress_safe((const char *)z->zbuff, (char *)z->buf,
+                              p->next_packet_size, len);
+    if (ret != len) {
+        error_setg(errp, "multifd %d: lz4 decompressed size %d "
+                   "and expected %d", p->id, ret, len);
+        return -1;
+    }
+    iov_from_buf(p->pages->iov, used, 0, z->buf, len);
+    return 0;
+}
+
+static MultiFDMethods multifd_lz4_ops = {
+    .flag = MULTIFD_FLAG_LZ4,
+    .send_setup = lz4_send_setup,
+    .send_cleanup = lz4_send_cleanup,
+    .send_prepare = lz4_send_prepare,
+    .send_write = lz4_send_write,
+    .recv_setup = lz4_recv_setup,
+    .recv_cleanup = lz4_recv_cleanup,
+    .recv_pages = lz4_recv_pages,
+};
+#endif /* CONFIG_LZ4 */
+
+static MultiFDMethods *multifd_ops[MULTIFD_COMPRESSION__MAX] = {
+    [MULTIFD_COMPRESSION_NONE] = &multifd_nocomp_ops,
+    [MULTIFD_COMPRESSION_ZLIB] = &multifd_zlib_ops,
+#ifdef CONFIG_ZSTD
+    [MULTIFD_COMPRESSION_ZSTD] = &multifd_zstd_ops,
+#endif
+#ifdef CONFIG_LZ4
+    [MULTIFD_COMPRESSION_LZ4] = &multifd_lz4_ops,
+#endif
+};
+
+bool multifd_compression_supported(MultiFDCompression method)
+{
+    return method < MULTIFD_COMPRESSION__MAX && multifd_ops[method];
+}
+
+struct {
+    MultiFDSendParams *params;
+    /* number of created threads */
+    int count;
+    /* array of pages to sent */
+    MultiFDPages_t *pages;
+    /* syncs main thread and channels */
+    QemuSemaphore sem_sync;
+    /* global number of generated multifd packets */
+    uint64_t packet_num;
+    /* send channels ready */
+    QemuSemaphore channels_ready;
+    /* compression method */
+    MultiFDMethods *ops;
+} *multifd_send_state;
+
+struct {
+    MultiFDRecvParams *params;
+    /* number of created threads */
+    int count;
+    /* syncs main thread and channels */
+    QemuSemaphore sem_sync;
+    /* global number of generated multifd packets */
+    uint64_t packet_num;
+    /* compression method */
+    MultiFDMethods *ops;
+    /* protects device_states */
+    QemuMutex device_state_lock;
+    /* MultiFDDeviceState received and not loaded yet */
+    GSList *device_states;
+} *multifd_recv_state;
+
+typedef struct {
+    uint64_t packet_num;
+    uint8_t *data;
+    uint32_t len;
+} MultiFDDeviceState;
+
 static int multifd_send_initial_packet(MultiFDSendParams *p, Error **errp)
 {
     MultiFDInit_t msg;
@@ -710,7 +1496,7 @@ static void multifd_send_fill_packet(MultiFDSendParams *p)
 
     packet->magic = cpu_to_be32(MULTIFD_MAGIC);
     packet->version = cpu_to_be32(MULTIFD_VERSION);
-    packet->flags = cpu_to_be32(p->flags);
+    packet->flags = cpu_to_be32(p->flags | multifd_send_state->ops->flag);
     packet->size = cpu_to_be32(migrate_multifd_page_count());
     packet->used = cpu_to_be32(p->pages->used);
     packet->packet_num = cpu_to_be64(p->packet_num);
@@ -747,6 +1533,14 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
     }
 
     p->flags = be32_to_cpu(packet->flags);
+    if ((p->flags & MULTIFD_FLAG_COMPRESSION_MASK) !=
+        multifd_recv_state->ops->flag) {
+        error_setg(errp, "multifd: received packet "
+                   "compression flag %x and expected compression flag %x",
+                   p->flags & MULTIFD_FLAG_COMPRESSION_MASK,
+                   multifd_recv_state->ops->flag);
+        return -1;
+    }
 
     be32_to_cpus(&packet->size);
     if (packet->size > migrate_multifd_page_count()) {
@@ -764,6 +1558,7 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
         return -1;
     }
 
+    p->next_packet_size = be32_to_cpu(packet->next_packet_size);
     p->packet_num = be64_to_cpu(packet->packet_num);
 
     if (p->pages->used) {
@@ -793,20 +1588,6 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
     return 0;
 }
 
-struct {
-    MultiFDSendParams *params;
-    /* number of created threads */
-    int count;
-    /* array of pages to sent */
-    MultiFDPages_t *pages;
-    /* syncs main thread and channels */
-    QemuSemaphore sem_sync;
-    /* global number of generated multifd packets */
-    uint64_t packet_num;
-    /* send channels ready */
-    QemuSemaphore channels_ready;
-} *multifd_send_state;
-
 /*
  * How we use multifd_send_state->pages and channel->pages?
  *
@@ -858,6 +1639,14 @@ static void multifd_send_pages(void)
     qemu_sem_post(&p->sem);
 }
 
+static void multifd_device_state_free(gpointer opaque)
+{
+    MultiFDDeviceState *ds = opaque;
+
+    g_free(ds->data);
+    g_free(ds);
+}
+
 static void multifd_queue_page(RAMBlock *block, ram_addr_t offset)
 {
     MultiFDPages_t *pages = multifd_send_state->pages;
@@ -915,7 +1704,7 @@ int multifd_save_cleanup(Error **errp)
     int i;
     int ret = 0;
 
-    if (!migrate_use_multifd()) {
+    if (!migrate_use_multifd() || !multifd_send_state) {
         return 0;
     }
     multifd_send_terminate_threads(NULL);
@@ -927,6 +1716,11 @@ int multifd_save_cleanup(Error **errp)
         }
         socket_send_channel_destroy(p->c);
         p->c = NULL;
+        if (p->data) {
+            multifd_send_state->ops->send_cleanup(p);
+        }
+        g_free(p->device_state);
+        p->device_state = NULL;
         qemu_mutex_destroy(&p->mutex);
         qemu_sem_destroy(&p->sem);
         qemu_sem_destroy(&p->sem_sync);
@@ -989,6 +1783,15 @@ static void *multifd_send_thread(void *opaque)
 
     trace_multifd_send_thread_start(p->id);
 
+    if (p->zero_copy &&
+        !qio_channel_has_feature(p->c, QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY)) {
+        error_setg(&local_err, "multifd %d: channel does not support "
+                   "zero copy send", p->id);
+        goto out;
+    }
+    if (multifd_send_state->ops->send_setup(p, &local_err) < 0) {
+        goto out;
+    }
     if (multifd_send_initial_packet(p, &local_err) < 0) {
         goto out;
     }
@@ -1003,9 +1806,11 @@ static void *multifd_send_thread(void *opaque)
             uint32_t used = p->pages->used;
             uint64_t packet_num = p->packet_num;
             uint32_t flags = p->flags;
+            uint8_t *device_state = p->device_state;
 
             multifd_send_fill_packet(p);
             p->flags = 0;
+            p->device_state = NULL;
             p->num_packets++;
             p->num_pages += used;
             p->pages->used = 0;
@@ -1013,15 +1818,51 @@ static void *multifd_send_thread(void *opaque)
 
             trace_multifd_send(p->id, packet_num, used, flags);
 
+            if (device_state) {
+                p->next_packet_size = p->device_state_len;
+            } else {
+                /* The pages belong to this thread until pending_job drops */
+                ret = multifd_send_state->ops->send_prepare(p, used,
+                                                            &local_err);
+                if (ret != 0) {
+                    break;
+                }
+            }
+            p->packet->next_packet_size = cpu_to_be32(p->next_packet_size);
+
             ret = qio_channel_write_all(p->c, (void *)p->packet,
                                         p->packet_len, &local_err);
             if (ret != 0) {
                 break;
             }
 
-            ret = qio_channel_writev_all(p->c, p->pages->iov, used, &local_err);
-            if (ret != 0) {
-                break;
+            if (device_state) {
+                ret = qio_channel_write_all(p->c, (void *)device_state,
+                                            p->device_state_len, &local_err);
+                g_free(device_state);
+                if (ret != 0) {
+                    break;
+                }
+            } else if (used) {
+                ret = multifd_send_state->ops->send_write(p, used,
+                                                          &local_err);
+                if (ret != 0) {
+                    break;
+                }
+            }
+
+            /*
+             * With zero copy the kernel still references guest pages that
+             * were queued; wait for it at every sync point, so that nothing
+             * is in flight once the main thread moves to the next stage
+             * or tears RAM down.
+             */
+            if ((flags & MULTIFD_FLAG_SYNC) && p->zero_copy) {
+                ret = qio_channel_flush(p->c, &local_err);
+                if (ret < 0) {
+                    break;
+                }
+                trace_multifd_send_flush(p->id, ret);
             }
 
             qemu_mutex_lock(&p->mutex);
@@ -1034,6 +1875,9 @@ static void *multifd_send_thread(void *opaque)
             qemu_sem_post(&multifd_send_state->channels_ready);
         } else if (p->quit) {
             qemu_mutex_unlock(&p->mutex);
+            if (p->zero_copy) {
+                qio_channel_flush(p->c, &local_err);
+            }
             break;
         } else {
             qemu_mutex_unlock(&p->mutex);
@@ -1085,6 +1929,12 @@ int multifd_save_setup(void)
     if (!migrate_use_multifd()) {
         return 0;
     }
+    if (migrate_use_zero_copy_send() &&
+        migrate_multifd_compression() != MULTIFD_COMPRESSION_NONE) {
+        error_report("multifd: zero copy send is not compatible "
+                     "with compression");
+        return -1;
+    }
     thread_count = migrate_multifd_channels();
     multifd_send_state = g_malloc0(sizeof(*multifd_send_state));
     multifd_send_state->params = g_new0(MultiFDSendParams, thread_count);
@@ -1092,6 +1942,7 @@ int multifd_save_setup(void)
     multifd_send_state->pages = multifd_pages_init(page_count);
     qemu_sem_init(&multifd_send_state->sem_sync, 0);
     qemu_sem_init(&multifd_send_state->channels_ready, 0);
+    multifd_send_state->ops = multifd_ops[migrate_multifd_compression()];
 
     for (i = 0; i < thread_count; i++) {
         MultiFDSendParams *p = &multifd_send_state->params[i];
@@ -1107,21 +1958,12 @@ int multifd_save_setup(void)
                       + sizeof(ram_addr_t) * page_count;
         p->packet = g_malloc0(p->packet_len);
         p->name = g_strdup_printf("multifdsend_%d", i);
+        p->zero_copy = migrate_use_zero_copy_send();
         socket_send_channel_create(multifd_new_send_channel_async, p);
     }
     return 0;
 }
 
-struct {
-    MultiFDRecvParams *params;
-    /* number of created threads */
-    int count;
-    /* syncs main thread and channels */
-    QemuSemaphore sem_sync;
-    /* global number of generated multifd packets */
-    uint64_t packet_num;
-} *multifd_recv_state;
-
 static void multifd_recv_terminate_threads(Error *err)
 {
     int i;
@@ -1166,6 +2008,9 @@ int multifd_load_cleanup(Error **errp)
         }
         object_unref(OBJECT(p->c));
         p->c = NULL;
+        if (p->data) {
+            multifd_recv_state->ops->recv_cleanup(p);
+        }
         qemu_mutex_destroy(&p->mutex);
         qemu_sem_destroy(&p->sem_sync);
         g_free(p->name);
@@ -1177,6 +2022,9 @@ int multifd_load_cleanup(Error **errp)
         p->packet = NULL;
     }
     qemu_sem_destroy(&multifd_recv_state->sem_sync);
+    g_slist_free_full(multifd_recv_state->device_states,
+                      multifd_device_state_free);
+    qemu_mutex_destroy(&multifd_recv_state->device_state_lock);
     g_free(multifd_recv_state->params);
     multifd_recv_state->params = NULL;
     g_free(multifd_recv_state);
@@ -1247,9 +2095,35 @@ static void *multifd_recv_thread(void *opaque)
         p->num_pages += used;
         qemu_mutex_unlock(&p->mutex);
 
-        ret = qio_channel_readv_all(p->c, p->pages->iov, used, &local_err);
-        if (ret != 0) {
-            break;
+        if (flags & MULTIFD_FLAG_DEVICE_STATE) {
+            MultiFDDeviceState *ds = g_new0(MultiFDDeviceState, 1);
+
+            ds->packet_num = p->packet_num;
+            ds->len = p->next_packet_size;
+            ds->data = g_try_malloc(ds->len);
+            if (!ds->data && ds->len) {
+                error_setg(&local_err, "multifd %d: cannot allocate %u "
+                           "bytes of device state", p->id, ds->len);
+                g_free(ds);
+                break;
+            }
+            ret = qio_channel_read_all(p->c, (void *)ds->data, ds->len,
+                                       &local_err);
+            if (ret != 0) {
+                multifd_device_state_free(ds);
+                break;
+            }
+            trace_multifd_recv_device_state(p->id, ds->packet_num, ds->len);
+
+            qemu_mutex_lock(&multifd_recv_state->device_state_lock);
+            multifd_recv_state->device_states =
+                g_slist_prepend(multifd_recv_state->device_states, ds);
+            qemu_mutex_unlock(&multifd_recv_state->device_state_lock);
+        } else {
+            ret = multifd_recv_state->ops->recv_pages(p, used, &local_err);
+            if (ret != 0) {
+                break;
+            }
         }
 
         if (flags & MULTIFD_FLAG_SYNC) {
@@ -1284,9 +2158,12 @@ int multifd_load_setup(void)
     multifd_recv_state->params = g_new0(MultiFDRecvParams, thread_count);
     atomic_set(&multifd_recv_state->count, 0);
     qemu_sem_init(&multifd_recv_state->sem_sync, 0);
+    qemu_mutex_init(&multifd_recv_state->device_state_lock);
+    multifd_recv_state->ops = multifd_ops[migrate_multifd_compression()];
 
     for (i = 0; i < thread_count; i++) {
         MultiFDRecvParams *p = &multifd_recv_state->params[i];
+        Error *local_err = NULL;
 
         qemu_mutex_init(&p->mutex);
         qemu_sem_init(&p->sem_sync, 0);
@@ -1296,10 +2173,143 @@ int multifd_load_setup(void)
                       + sizeof(ram_addr_t) * page_count;
         p->packet = g_malloc0(p->packet_len);
         p->name = g_strdup_printf("multifdrecv_%d", i);
+        if (multifd_recv_state->ops->recv_setup(p, &local_err) < 0) {
+            error_report_err(local_err);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * multifd_device_state_active: whether device state goes to multifd
+ *
+ * True when the outgoing migration has multifd channels up and the
+ * x-multifd-device-state capability set.
+ */
+bool multifd_device_state_active(void)
+{
+    return migrate_use_multifd() && migrate_multifd_device_state() &&
+           multifd_send_state;
+}
+
+/**
+ * multifd_send_device_state: queue a device state section on a channel
+ *
+ * The section is sent by the first idle channel; the channel frees
+ * @data once it is written.  Packet numbers give the destination the
+ * order in which the sections have to be loaded.
+ *
+ * @data: section as qemu_loadvm_state_main() reads it, ending
+ *        with QEMU_VM_EOF
+ * @len: length of @data
+ */
+void multifd_send_device_state(uint8_t *data, uint32_t len)
+{
+    int i;
+    static int next_channel;
+    MultiFDSendParams *p = NULL; /* make happy gcc */
+    uint64_t transferred;
+
+    qemu_sem_wait(&multifd_send_state->channels_ready);
+    for (i = next_channel;; i = (i + 1) % migrate_multifd_channels()) {
+        p = &multifd_send_state->params[i];
+
+        qemu_mutex_lock(&p->mutex);
+        if (!p->pending_job) {
+            p->pending_job++;
+            next_channel = (i + 1) % migrate_multifd_channels();
+            break;
+        }
+        qemu_mutex_unlock(&p->mutex);
+    }
+    p->packet_num = multifd_send_state->packet_num++;
+    p->flags |= MULTIFD_FLAG_DEVICE_STATE;
+    p->device_state = data;
+    p->device_state_len = len;
+    transferred = len + p->packet_len;
+    ram_counters.multifd_bytes += transferred;
+    ram_counters.transferred += transferred;
+    qemu_mutex_unlock(&p->mutex);
+    qemu_sem_post(&p->sem);
+}
+
+/* Wait until all queued device state sections have been sent */
+void multifd_send_device_state_sync(void)
+{
+    multifd_send_sync_main();
+}
+
+static gint multifd_device_state_cmp(gconstpointer a, gconstpointer b)
+{
+    const MultiFDDeviceState *da = a, *db = b;
+
+    return da->packet_num < db->packet_num ? -1 :
+           da->packet_num > db->packet_num;
+}
+
+/**
+ * multifd_recv_device_state_sync: wait for the device state sections
+ *
+ * Returns 0 once @count sections have been received on the multifd
+ * channels, -1 if the channels delivered a different number.
+ *
+ * @count: number of sections announced on the main stream
+ */
+int multifd_recv_device_state_sync(uint32_t count)
+{
+    uint32_t received;
+
+    if (!migrate_use_multifd() || !multifd_recv_state) {
+        error_report("multifd: device state announced without multifd");
+        return -1;
+    }
+    multifd_recv_sync_main();
+
+    qemu_mutex_lock(&multifd_recv_state->device_state_lock);
+    received = g_slist_length(multifd_recv_state->device_states);
+    multifd_recv_state->device_states =
+        g_slist_sort(multifd_recv_state->device_states,
+                     multifd_device_state_cmp);
+    qemu_mutex_unlock(&multifd_recv_state->device_state_lock);
+
+    if (received != count) {
+        error_report("multifd: received %u device state sections, "
+                     "expected %u", received, count);
+        return -1;
     }
     return 0;
 }
 
+/**
+ * multifd_recv_device_state_pop: take the next device state section
+ *
+ * Returns false when there is none left; otherwise the caller owns
+ * *@data and has to g_free() it.
+ */
+bool multifd_recv_device_state_pop(uint8_t **data, uint32_t *len)
+{
+    MultiFDDeviceState *ds;
+
+    qemu_mutex_lock(&multifd_recv_state->device_state_lock);
+    ds = multifd_recv_state->device_states ?
+         multifd_recv_state->device_states->data : NULL;
+    if (ds) {
+        multifd_recv_state->device_states =
+            g_slist_delete_link(multifd_recv_state->device_states,
+                                multifd_recv_state->device_states);
+    }
+    qemu_mutex_unlock(&multifd_recv_state->device_state_lock);
+
+    if (!ds) {
+        return false;
+    }
+    *data = ds->data;
+    *len = ds->len;
+    g_free(ds);
+    return true;
+}
+
 bool multifd_recv_all_channels_created(void)
 {
     int thread_count = migrate_multifd_channels();
@@ -1379,24 +2389,84 @@ static size_t save_page_header(RAMState *rs, QEMUFile *f,  RAMBlock *block,
 /**
  * mig_throttle_guest_down: throotle down the guest
  *
- * Reduce amount of guest cpu execution to hopefully slow down memory
- * writes. If guest dirty memory rate is reduced below the rate at
- * which we can transfer pages to the destination then we should be
- * able to complete migration. Some workloads dirty memory way too
- * fast and will not effectively converge, even with auto-converge.
+ * Reduce amount of guest cpu execution to hopefully slow down memory
+ * writes. If guest dirty memory rate is reduced below the rate at
+ * which we can transfer pages to the destination then we should be
+ * able to complete migration. Some workloads dirty memory way too
+ * fast and will not effectively converge, even with auto-converge.
+ */
+static void mig_throttle_guest_down(void)
+{
+    MigrationState *s = migrate_get_current();
+    uint64_t pct_initial = s->parameters.cpu_throttle_initial;
+    uint64_t pct_icrement = s->parameters.cpu_throttle_increment;
+
+    /* We have not started throttling yet. Let's start it. */
+    if (!cpu_throttle_active()) {
+        cpu_throttle_set(pct_initial);
+    } else {
+        /* Throttling already on, just increase the rate */
+        cpu_throttle_set(cpu_throttle_get_percentage() + pct_icrement);
+    }
+}
+
+static VcpuDirtyStat *ram_vcpu_dirty_stat(RAMState *rs, CPUState *cpu)
+{
+    if (cpu->cpu_index >= rs->vcpu_dirty_count) {
+        int count = cpu->cpu_index + 1;
+
+        rs->vcpu_dirty = g_renew(VcpuDirtyStat, rs->vcpu_dirty, count);
+        memset(&rs->vcpu_dirty[rs->vcpu_dirty_count], 0,
+               (count - rs->vcpu_dirty_count) * sizeof(VcpuDirtyStat));
+        rs->vcpu_dirty_count = count;
+    }
+    return &rs->vcpu_dirty[cpu->cpu_index];
+}
+
+/*
+ * Per-vCPU throttling needs the pages dirtied by each vCPU, which only
+ * the dirty rings of TCG provide.
+ */
+static bool ram_vcpu_dirty_limit_active(void)
+{
+    return migrate_vcpu_dirty_limit() && migrate_use_dirty_ring() &&
+           tcg_enabled();
+}
+
+/**
+ * mig_throttle_vcpus_down: throttle the vCPUs that dirty memory too fast
+ *
+ * Unlike mig_throttle_guest_down, only slow down the vCPUs whose dirty
+ * rate is above x-vcpu-dirty-limit, so that idle and latency sensitive
+ * vCPUs keep running at full speed.  Once a throttled vCPU dirties less
+ * than half of the limit, its throttle is eased again.
+ *
+ * @rs: current RAM state
  */
-static void mig_throttle_guest_down(void)
+static void mig_throttle_vcpus_down(RAMState *rs)
 {
     MigrationState *s = migrate_get_current();
-    uint64_t pct_initial = s->parameters.cpu_throttle_initial;
-    uint64_t pct_icrement = s->parameters.cpu_throttle_increment;
+    int pct_initial = s->parameters.cpu_throttle_initial;
+    int pct_icrement = s->parameters.cpu_throttle_increment;
+    uint64_t limit = migrate_vcpu_dirty_limit();
+    CPUState *cpu;
 
-    /* We have not started throttling yet. Let's start it. */
-    if (!cpu_throttle_active()) {
-        cpu_throttle_set(pct_initial);
-    } else {
-        /* Throttling already on, just increase the rate */
-        cpu_throttle_set(cpu_throttle_get_percentage() + pct_icrement);
+    CPU_FOREACH(cpu) {
+        VcpuDirtyStat *stat = ram_vcpu_dirty_stat(rs, cpu);
+        int pct = cpu_throttle_get_vcpu_percentage(cpu);
+
+        if (!stat->seen) {
+            continue;
+        }
+        if (stat->rate > limit) {
+            pct = pct ? pct + pct_icrement : pct_initial;
+        } else if (pct && stat->rate < limit / 2) {
+            pct = MAX(pct - pct_icrement, 0);
+        } else {
+            continue;
+        }
+        trace_migration_throttle_vcpu(cpu->cpu_index, stat->rate, pct);
+        cpu_throttle_set_vcpu(cpu, pct);
     }
 }
 
@@ -1524,7 +2594,7 @@ unsigned long migration_bitmap_find_dirty(RAMState *rs, RAMBlock *rb,
     unsigned long *bitmap = rb->bmap;
     unsigned long next;
 
-    if (!qemu_ram_is_migratable(rb)) {
+    if (ramblock_is_ignored(rb)) {
         return size;
     }
 
@@ -1543,11 +2613,14 @@ static inline bool migration_bitmap_clear_dirty(RAMState *rs,
 {
     bool ret;
 
+    /* Free page hints clear the bitmap from the main thread */
+    qemu_mutex_lock(&rs->bitmap_mutex);
     ret = test_and_clear_bit(page, rb->bmap);
 
     if (ret) {
         rs->migration_dirty_pages--;
     }
+    qemu_mutex_unlock(&rs->bitmap_mutex);
     return ret;
 }
 
@@ -1559,6 +2632,193 @@ static void migration_bitmap_sync_range(RAMState *rs, RAMBlock *rb,
                                               &rs->num_dirty_pages_period);
 }
 
+/*
+ * Parallel dirty bitmap sync
+ *
+ * With hundreds of GB of guest RAM, moving the dirty log into the
+ * migration bitmaps is most of the time spent in migration_bitmap_sync().
+ * The blocks are cut into shards of BITMAP_SYNC_SHARD_SIZE bytes, shared
+ * between the migration thread and a few helper threads.  Shards start on
+ * a bitmap word boundary, so no two of them touch the same word of
+ * block->bmap.
+ */
+
+#define BITMAP_SYNC_SHARD_SIZE (1ULL << 30)
+
+typedef struct {
+    RAMBlock *block;
+    ram_addr_t start;
+    ram_addr_t length;
+} BitmapSyncShard;
+
+typedef struct {
+    QemuThread thread;
+    /* posted by the migration thread when there are shards to sync */
+    QemuSemaphore sem;
+    /* results of the current sync */
+    uint64_t num_dirty;
+    uint64_t real_dirty;
+} BitmapSyncWorker;
+
+static struct {
+    BitmapSyncWorker *workers;
+    int nr_workers;
+    bool quit;
+    /* posted by each worker once the shards are all taken */
+    QemuSemaphore done;
+    BitmapSyncShard *shards;
+    int nr_shards;
+    int allocated_shards;
+    /* next shard to sync, taken with atomic_fetch_inc */
+    int next_shard;
+} *bitmap_sync_state;
+
+static void bitmap_sync_shards(uint64_t *num_dirty, uint64_t *real_dirty)
+{
+    int i;
+
+    while ((i = atomic_fetch_inc(&bitmap_sync_state->next_shard)) <
+           bitmap_sync_state->nr_shards) {
+        BitmapSyncShard *shard = &bitmap_sync_state->shards[i];
+
+        *num_dirty += cpu_physical_memory_sync_dirty_bitmap(shard->block,
+                                                            shard->start,
+                                                            shard->length,
+                                                            real_dirty);
+    }
+}
+
+static void *bitmap_sync_thread(void *opaque)
+{
+    BitmapSyncWorker *w = opaque;
+
+    rcu_register_thread();
+    while (true) {
+        qemu_sem_wait(&w->sem);
+        if (atomic_read(&bitmap_sync_state->quit)) {
+            break;
+        }
+        w->num_dirty = 0;
+        w->real_dirty = 0;
+        bitmap_sync_shards(&w->num_dirty, &w->real_dirty);
+        qemu_sem_post(&bitmap_sync_state->done);
+    }
+    rcu_unregister_thread();
+
+    return NULL;
+}
+
+static void bitmap_sync_threads_setup(void)
+{
+    int i, thread_count = migrate_bitmap_sync_threads();
+
+    if (!thread_count) {
+        return;
+    }
+    bitmap_sync_state = g_new0(typeof(*bitmap_sync_state), 1);
+    bitmap_sync_state->workers = g_new0(BitmapSyncWorker, thread_count);
+    bitmap_sync_state->nr_workers = thread_count;
+    qemu_sem_init(&bitmap_sync_state->done, 0);
+
+    for (i = 0; i < thread_count; i++) {
+        BitmapSyncWorker *w = &bitmap_sync_state->workers[i];
+
+        qemu_sem_init(&w->sem, 0);
+        qemu_thread_create(&w->thread, "bitmapsync", bitmap_sync_thread, w,
+                           QEMU_THREAD_JOINABLE);
+    }
+}
+
+static void bitmap_sync_threads_cleanup(void)
+{
+    int i;
+
+    if (!bitmap_sync_state) {
+        return;
+    }
+    atomic_set(&bitmap_sync_state->quit, true);
+    for (i = 0; i < bitmap_sync_state->nr_workers; i++) {
+        qemu_sem_post(&bitmap_sync_state->workers[i].sem);
+    }
+    for (i = 0; i < bitmap_sync_state->nr_workers; i++) {
+        BitmapSyncWorker *w = &bitmap_sync_state->workers[i];
+
+        qemu_thread_join(&w->thread);
+        qemu_sem_destroy(&w->sem);
+    }
+    qemu_sem_destroy(&bitmap_sync_state->done);
+    g_free(bitmap_sync_state->workers);
+    g_free(bitmap_sync_state->shards);
+    g_free(bitmap_sync_state);
+    bitmap_sync_state = NULL;
+}
+
+/*
+ * migration_bitmap_sync_parallel: sync all migratable blocks using the
+ * helper threads
+ *
+ * Returns false, without syncing anything, if there are no helpers or
+ * not enough RAM to share between them.  Called with the RCU read lock
+ * held, which keeps the blocks alive while the helpers use them.
+ */
+static bool migration_bitmap_sync_parallel(RAMState *rs)
+{
+    RAMBlock *block;
+    uint64_t num_dirty = 0, real_dirty = 0;
+    int i, nr_wake;
+
+    if (!bitmap_sync_state) {
+        return false;
+    }
+
+    bitmap_sync_state->nr_shards = 0;
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        ram_addr_t start;
+
+        for (start = 0; start < block->used_length;
+             start += BITMAP_SYNC_SHARD_SIZE) {
+            BitmapSyncShard *shard;
+
+            if (bitmap_sync_state->nr_shards ==
+                bitmap_sync_state->allocated_shards) {
+                bitmap_sync_state->allocated_shards =
+                    MAX(16, bitmap_sync_state->allocated_shards * 2);
+                bitmap_sync_state->shards =
+                    g_renew(BitmapSyncShard, bitmap_sync_state->shards,
+                            bitmap_sync_state->allocated_shards);
+            }
+            shard = &bitmap_sync_state->shards[bitmap_sync_state->nr_shards++];
+            shard->block = block;
+            shard->start = start;
+            shard->length = MIN(BITMAP_SYNC_SHARD_SIZE,
+                                block->used_length - start);
+        }
+    }
+    if (bitmap_sync_state->nr_shards < 2) {
+        return false;
+    }
+
+    /* Only wake as many helpers as there is work for */
+    nr_wake = MIN(bitmap_sync_state->nr_workers,
+                  bitmap_sync_state->nr_shards - 1);
+    atomic_set(&bitmap_sync_state->next_shard, 0);
+    for (i = 0; i < nr_wake; i++) {
+        qemu_sem_post(&bitmap_sync_state->workers[i].sem);
+    }
+    bitmap_sync_shards(&num_dirty, &real_dirty);
+    for (i = 0; i < nr_wake; i++) {
+        qemu_sem_wait(&bitmap_sync_state->done);
+    }
+    for (i = 0; i < nr_wake; i++) {
+        num_dirty += bitmap_sync_state->workers[i].num_dirty;
+        real_dirty += bitmap_sync_state->workers[i].real_dirty;
+    }
+
+    rs->migration_dirty_pages += num_dirty;
+    rs->num_dirty_pages_period += real_dirty;
+    return true;
+}
+
 /**
  * ram_pagesize_summary: calculate all the pagesizes of a VM
  *
@@ -1573,7 +2833,7 @@ uint64_t ram_pagesize_summary(void)
     RAMBlock *block;
     uint64_t summary = 0;
 
-    RAMBLOCK_FOREACH_MIGRATABLE(block) {
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
         summary |= block->page_size;
     }
 
@@ -1599,6 +2859,28 @@ static void migration_update_rates(RAMState *rs, int64_t end_time)
     }
 }
 
+static void migration_update_vcpu_dirty_rates(RAMState *rs, int64_t end_time)
+{
+    int64_t period = end_time - rs->time_last_bitmap_sync;
+    CPUState *cpu;
+
+    if (!migrate_use_dirty_ring()) {
+        return;
+    }
+
+    CPU_FOREACH(cpu) {
+        VcpuDirtyStat *stat = ram_vcpu_dirty_stat(rs, cpu);
+        uint64_t pages = cpu->dirty_pages;
+
+        if (stat->seen) {
+            stat->rate = (pages - stat->pages_prev) * TARGET_PAGE_SIZE * 1000
+                         / period;
+        }
+        stat->seen = true;
+        stat->pages_prev = pages;
+    }
+}
+
 static void migration_bitmap_sync(RAMState *rs)
 {
     RAMBlock *block;
@@ -1616,8 +2898,14 @@ static void migration_bitmap_sync(RAMState *rs)
 
     qemu_mutex_lock(&rs->bitmap_mutex);
     rcu_read_lock();
-    RAMBLOCK_FOREACH_MIGRATABLE(block) {
-        migration_bitmap_sync_range(rs, block, 0, block->used_length);
+    if (!migrate_use_dirty_ring() ||
+        !cpu_physical_memory_sync_dirty_ring(&rs->migration_dirty_pages,
+                                             &rs->num_dirty_pages_period)) {
+        if (!migration_bitmap_sync_parallel(rs)) {
+            RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+                migration_bitmap_sync_range(rs, block, 0, block->used_length);
+            }
+        }
     }
     ram_counters.remaining = ram_bytes_remaining();
     rcu_read_unlock();
@@ -1631,6 +2919,8 @@ static void migration_bitmap_sync(RAMState *rs)
     if (end_time > rs->time_last_bitmap_sync + 1000) {
         bytes_xfer_now = ram_counters.transferred;
 
+        migration_update_vcpu_dirty_rates(rs, end_time);
+
         /* During block migration the auto-converge logic incorrectly detects
          * that ram migration makes no progress. Avoid this by disabling the
          * throttling logic during the bulk phase of block migration. */
@@ -1639,14 +2929,17 @@ static void migration_bitmap_sync(RAMState *rs)
                Check to see if the dirtied bytes is 50% more than the approx.
                amount of bytes that just got transferred since the last time we
                were in this routine. If that happens twice, start or increase
-               throttling */
-
-            if ((rs->num_dirty_pages_period * TARGET_PAGE_SIZE >
-                   (bytes_xfer_now - rs->bytes_xfer_prev) / 2) &&
-                (++rs->dirty_rate_high_cnt >= 2)) {
-                    trace_migration_throttle();
-                    rs->dirty_rate_high_cnt = 0;
-                    mig_throttle_guest_down();
+               throttling.  With a per-vCPU dirty limit, each vCPU is
+               checked against that limit instead. */
+
+            if (ram_vcpu_dirty_limit_active()) {
+                mig_throttle_vcpus_down(rs);
+            } else if ((rs->num_dirty_pages_period * TARGET_PAGE_SIZE >
+                        (bytes_xfer_now - rs->bytes_xfer_prev) / 2) &&
+                       (++rs->dirty_rate_high_cnt >= 2)) {
+                trace_migration_throttle();
+                rs->dirty_rate_high_cnt = 0;
+                mig_throttle_guest_down();
             }
         }
 
@@ -1664,6 +2957,18 @@ static void migration_bitmap_sync(RAMState *rs)
     }
 }
 
+/*
+ * Free page hints must not be applied to a bitmap that already includes
+ * pages the guest reused after the hint, so the notifiers stop them
+ * across the sync.
+ */
+static void migration_bitmap_sync_precopy(RAMState *rs)
+{
+    precopy_notify(PRECOPY_NOTIFY_BEFORE_BITMAP_SYNC);
+    migration_bitmap_sync(rs);
+    precopy_notify(PRECOPY_NOTIFY_AFTER_BITMAP_SYNC);
+}
+
 /**
  * save_zero_page: send the zero page to the stream
  *
@@ -1968,10 +3273,43 @@ static bool find_dirty_block(RAMState *rs, PageSearchStatus *pss, bool *again)
     }
 }
 
+/*
+ * Pops the next target page of the first request in @queue, or returns
+ * NULL if @queue is empty.  @drained is set once that request is done.
+ * Must be called with src_page_req_mutex held.
+ */
+static RAMBlock *unqueue_page_from(struct src_page_requests *queue,
+                                   ram_addr_t *offset, bool *drained)
+{
+    struct RAMSrcPageRequest *entry = QSIMPLEQ_FIRST(queue);
+    RAMBlock *block;
+
+    *drained = false;
+    if (!entry) {
+        return NULL;
+    }
+
+    block = entry->rb;
+    *offset = entry->offset;
+
+    if (entry->len > TARGET_PAGE_SIZE) {
+        entry->len -= TARGET_PAGE_SIZE;
+        entry->offset += TARGET_PAGE_SIZE;
+    } else {
+        memory_region_unref(block->mr);
+        QSIMPLEQ_REMOVE_HEAD(queue, next_req);
+        g_free(entry);
+        *drained = true;
+    }
+
+    return block;
+}
+
 /**
  * unqueue_page: gets a page of the queue
  *
- * Helper for 'get_queued_page' - gets a page off the queue
+ * Helper for 'get_queued_page' - gets a page off the queue,
+ * requested pages first, then the prefetch windows
  *
  * Returns the block of the page (or NULL if none available)
  *
@@ -1980,24 +3318,21 @@ static bool find_dirty_block(RAMState *rs, PageSearchStatus *pss, bool *again)
  */
 static RAMBlock *unqueue_page(RAMState *rs, ram_addr_t *offset)
 {
-    RAMBlock *block = NULL;
+    RAMBlock *block;
+    bool drained;
 
     qemu_mutex_lock(&rs->src_page_req_mutex);
-    if (!QSIMPLEQ_EMPTY(&rs->src_page_requests)) {
-        struct RAMSrcPageRequest *entry =
-                                QSIMPLEQ_FIRST(&rs->src_page_requests);
-        block = entry->rb;
-        *offset = entry->offset;
-
-        if (entry->len > TARGET_PAGE_SIZE) {
-            entry->len -= TARGET_PAGE_SIZE;
-            entry->offset += TARGET_PAGE_SIZE;
-        } else {
-            memory_region_unref(block->mr);
-            QSIMPLEQ_REMOVE_HEAD(&rs->src_page_requests, next_req);
-            g_free(entry);
+    block = unqueue_page_from(&rs->src_page_requests, offset, &drained);
+    if (block) {
+        if (drained) {
             migration_consume_urgent_request();
         }
+    } else {
+        block = unqueue_page_from(&rs->src_prefetch_requests, offset,
+                                  &drained);
+        if (drained) {
+            rs->src_prefetch_count--;
+        }
     }
     qemu_mutex_unlock(&rs->src_page_req_mutex);
 
@@ -2084,9 +3419,64 @@ static void migration_page_queue_free(RAMState *rs)
         QSIMPLEQ_REMOVE_HEAD(&rs->src_page_requests, next_req);
         g_free(mspr);
     }
+    QSIMPLEQ_FOREACH_SAFE(mspr, &rs->src_prefetch_requests, next_req,
+                          next_mspr) {
+        memory_region_unref(mspr->rb->mr);
+        QSIMPLEQ_REMOVE_HEAD(&rs->src_prefetch_requests, next_req);
+        g_free(mspr);
+    }
+    rs->src_prefetch_count = 0;
     rcu_read_unlock();
 }
 
+/**
+ * ram_save_queue_prefetch: queue the pages following a request
+ *
+ * The guest is likely to touch the pages next to the one it faulted
+ * on, so queue a window of them behind the requested pages.  They are
+ * sent before the background search but never ahead of a real request,
+ * and only the most recent windows are kept.
+ *
+ * Must be called with src_page_req_mutex held.
+ *
+ * @rs: current RAM state
+ * @rb: RAMBlock of the request
+ * @start: offset just past the requested pages
+ */
+static void ram_save_queue_prefetch(RAMState *rs, RAMBlock *rb,
+                                    ram_addr_t start)
+{
+    ram_addr_t len = (ram_addr_t)migrate_postcopy_prefetch_pages()
+                     << TARGET_PAGE_BITS;
+    struct RAMSrcPageRequest *entry;
+
+    if (!len || start >= rb->used_length) {
+        return;
+    }
+
+    /* Whole host pages only, as for the requests themselves */
+    len = ROUND_UP(len, qemu_ram_pagesize(rb));
+    len = MIN(len, rb->used_length - start);
+
+    if (rs->src_prefetch_count == POSTCOPY_PREFETCH_MAX_WINDOWS) {
+        /* Drop the oldest window, the guest has moved on */
+        entry = QSIMPLEQ_FIRST(&rs->src_prefetch_requests);
+        memory_region_unref(entry->rb->mr);
+        QSIMPLEQ_REMOVE_HEAD(&rs->src_prefetch_requests, next_req);
+        g_free(entry);
+        rs->src_prefetch_count--;
+    }
+
+    trace_ram_save_queue_prefetch(rb->idstr, start, len);
+    entry = g_new0(struct RAMSrcPageRequest, 1);
+    entry->rb = rb;
+    entry->offset = start;
+    entry->len = len;
+    memory_region_ref(rb->mr);
+    QSIMPLEQ_INSERT_TAIL(&rs->src_prefetch_requests, entry, next_req);
+    rs->src_prefetch_count++;
+}
+
 /**
  * ram_save_queue_pages: queue the page for transmission
  *
@@ -2146,6 +3536,7 @@ int ram_save_queue_pages(const char *rbname, ram_addr_t start, ram_addr_t len)
     qemu_mutex_lock(&rs->src_page_req_mutex);
     QSIMPLEQ_INSERT_TAIL(&rs->src_page_requests, new_entry, next_req);
     migration_make_urgent_request();
+    ram_save_queue_prefetch(rs, ramblock, start + len);
     qemu_mutex_unlock(&rs->src_page_req_mutex);
     rcu_read_unlock();
 
@@ -2259,7 +3650,7 @@ static int ram_save_host_page(RAMState *rs, PageSearchStatus *pss,
     size_t pagesize_bits =
         qemu_ram_pagesize(pss->block) >> TARGET_PAGE_BITS;
 
-    if (!qemu_ram_is_migratable(pss->block)) {
+    if (ramblock_is_ignored(pss->block)) {
         error_report("block %s should not be migrated !", pss->block->idstr);
         return 0;
     }
@@ -2343,6 +3734,70 @@ static int ram_find_and_save_block(RAMState *rs, bool last_stage)
     return pages;
 }
 
+/**
+ * ram_save_mapped_block: send a whole RAMBlock as one indexed record
+ *
+ * Used by snapshots with x-mapped-ram, where the guest is stopped and
+ * every page is sent exactly once.  The record holds a bitmap of the
+ * non-zero pages followed by those pages back to back, with no per-page
+ * header.  The loader copies each run of pages straight into guest
+ * memory, and the position of any page follows from the bitmap alone.
+ *
+ * Returns the number of pages written
+ *
+ * @rs: current RAM state
+ * @block: block to send
+ */
+static unsigned long ram_save_mapped_block(RAMState *rs, RAMBlock *block)
+{
+    unsigned long pages = block->used_length >> TARGET_PAGE_BITS;
+    /* The bitmap travels in 64-bit words whatever the host long size */
+    unsigned long *map = bitmap_new(pages + BITS_PER_LONG);
+    unsigned long *le_map = bitmap_new(pages + BITS_PER_LONG);
+    uint64_t map_size = DIV_ROUND_UP(pages, 64) * 8;
+    unsigned long page, end, sent = 0;
+
+    for (page = 0; page < pages; page++) {
+        if (!is_zero_range(block->host + (page << TARGET_PAGE_BITS),
+                           TARGET_PAGE_SIZE)) {
+            set_bit(page, map);
+        }
+    }
+
+    trace_ram_save_mapped_block(block->idstr, pages);
+    ram_counters.transferred +=
+        save_page_header(rs, rs->f, block, RAM_SAVE_FLAG_MAPPED);
+    qemu_put_be64(rs->f, pages);
+    bitmap_to_le(le_map, map, pages);
+    qemu_put_buffer(rs->f, (uint8_t *)le_map, map_size);
+    ram_counters.transferred += 8 + map_size;
+
+    for (page = find_first_bit(map, pages); page < pages;
+         page = find_next_bit(map, pages, end)) {
+        end = find_next_zero_bit(map, pages, page);
+        /*
+         * Copied rather than queued in place: adjacent queued buffers are
+         * merged, and a run of pages could exceed what a single vmstate
+         * write accepts.
+         */
+        qemu_put_buffer(rs->f, block->host + (page << TARGET_PAGE_BITS),
+                        (end - page) << TARGET_PAGE_BITS);
+        sent += end - page;
+    }
+
+    ram_counters.normal += sent;
+    ram_counters.duplicate += pages - sent;
+    ram_counters.transferred += (uint64_t)sent << TARGET_PAGE_BITS;
+
+    /* Everything is sent, nothing is left for the dirty page search */
+    rs->migration_dirty_pages -= bitmap_count_one(block->bmap, pages);
+    bitmap_clear(block->bmap, 0, pages);
+
+    g_free(le_map);
+    g_free(map);
+    return sent;
+}
+
 void acct_update_position(QEMUFile *f, size_t size, bool zero)
 {
     uint64_t pages = size / TARGET_PAGE_SIZE;
@@ -2356,19 +3811,30 @@ void acct_update_position(QEMUFile *f, size_t size, bool zero)
     }
 }
 
-uint64_t ram_bytes_total(void)
+static uint64_t ram_bytes_total_common(bool count_ignored)
 {
     RAMBlock *block;
     uint64_t total = 0;
 
     rcu_read_lock();
-    RAMBLOCK_FOREACH_MIGRATABLE(block) {
-        total += block->used_length;
+    if (count_ignored) {
+        RAMBLOCK_FOREACH_MIGRATABLE(block) {
+            total += block->used_length;
+        }
+    } else {
+        RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+            total += block->used_length;
+        }
     }
     rcu_read_unlock();
     return total;
 }
 
+uint64_t ram_bytes_total(void)
+{
+    return ram_bytes_total_common(false);
+}
+
 static void xbzrle_load_setup(void)
 {
     XBZRLE.decoded_buf = g_malloc(TARGET_PAGE_SIZE);
@@ -2386,6 +3852,7 @@ static void ram_state_cleanup(RAMState **rsp)
         migration_page_queue_free(*rsp);
         qemu_mutex_destroy(&(*rsp)->bitmap_mutex);
         qemu_mutex_destroy(&(*rsp)->src_page_req_mutex);
+        g_free((*rsp)->vcpu_dirty);
         g_free(*rsp);
         *rsp = NULL;
     }
@@ -2415,9 +3882,12 @@ static void ram_save_cleanup(void *opaque)
     /* caller have hold iothread lock or is in a bh, so there is
      * no writing race against this migration_bitmap
      */
+    precopy_notify(PRECOPY_NOTIFY_CLEANUP);
     memory_global_dirty_log_stop();
+    cpu_physical_memory_dirty_ring_stop();
+    bitmap_sync_threads_cleanup();
 
-    RAMBLOCK_FOREACH_MIGRATABLE(block) {
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
         g_free(block->bmap);
         block->bmap = NULL;
         g_free(block->unsentmap);
@@ -2429,13 +3899,59 @@ static void ram_save_cleanup(void *opaque)
     ram_state_cleanup(rsp);
 }
 
+/**
+ * qemu_guest_free_page_hint: skip RAM the guest reported as free
+ *
+ * The pages are cleared from the migration bitmap, so that they are not
+ * sent unless the guest writes to them again.  Called with the iothread
+ * lock held.
+ *
+ * @addr: host address of the free memory
+ * @len: its length in bytes
+ */
+void qemu_guest_free_page_hint(void *addr, size_t len)
+{
+    RAMState *rs = ram_state;
+    RAMBlock *block;
+    ram_addr_t offset;
+    size_t used_len;
+    unsigned long start, end;
+
+    if (!rs) {
+        return;
+    }
+
+    rcu_read_lock();
+    for (; len > 0; len -= used_len, addr = (char *)addr + used_len) {
+        block = qemu_ram_block_from_host(addr, false, &offset);
+        if (!block || !block->bmap || offset >= block->used_length) {
+            break;
+        }
+        used_len = MIN(len, block->used_length - offset);
+
+        /* Only whole target pages can be skipped */
+        start = DIV_ROUND_UP(offset, TARGET_PAGE_SIZE);
+        end = (offset + used_len) >> TARGET_PAGE_BITS;
+        if (end <= start) {
+            continue;
+        }
+
+        qemu_mutex_lock(&rs->bitmap_mutex);
+        rs->migration_dirty_pages -=
+            bitmap_count_one_with_offset(block->bmap, start, end - start);
+        bitmap_clear(block->bmap, start, end - start);
+        qemu_mutex_unlock(&rs->bitmap_mutex);
+    }
+    rcu_read_unlock();
+}
+
 static void ram_state_reset(RAMState *rs)
 {
     rs->last_seen_block = NULL;
     rs->last_sent_block = NULL;
     rs->last_page = 0;
     rs->last_version = ram_list.version;
-    rs->ram_bulk_stage = true;
+    rs->ram_bulk_stage = !rs->free_page_hints;
 }
 
 #define MAX_WAIT 50 /* ms, half buffered_file limit */
@@ -2480,7 +3996,7 @@ void ram_postcopy_migrated_memory_release(MigrationState *ms)
 {
     struct RAMBlock *block;
 
-    RAMBLOCK_FOREACH_MIGRATABLE(block) {
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
         unsigned long *bitmap = block->bmap;
         unsigned long range = block->used_length >> TARGET_PAGE_BITS;
         unsigned long run_start = find_next_zero_bit(bitmap, range, 0);
@@ -2558,7 +4074,7 @@ static int postcopy_each_ram_send_discard(MigrationState *ms)
     struct RAMBlock *block;
     int ret;
 
-    RAMBLOCK_FOREACH_MIGRATABLE(block) {
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
         PostcopyDiscardState *pds =
             postcopy_discard_send_init(ms, block->idstr);
 
@@ -2766,7 +4282,7 @@ int ram_postcopy_send_discard_bitmap(MigrationState *ms)
     rs->last_sent_block = NULL;
     rs->last_page = 0;
 
-    RAMBLOCK_FOREACH_MIGRATABLE(block) {
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
         unsigned long pages = block->used_length >> TARGET_PAGE_BITS;
         unsigned long *bitmap = block->bmap;
         unsigned long *unsentmap = block->unsentmap;
@@ -2913,6 +4429,7 @@ static int ram_state_init(RAMState **rsp)
     qemu_mutex_init(&(*rsp)->bitmap_mutex);
     qemu_mutex_init(&(*rsp)->src_page_req_mutex);
     QSIMPLEQ_INIT(&(*rsp)->src_page_requests);
+    QSIMPLEQ_INIT(&(*rsp)->src_prefetch_requests);
 
     /*
      * Count the total number of pages used by ram blocks not including any
@@ -2932,7 +4449,7 @@ static void ram_list_init_bitmaps(void)
 
     /* Skip setting bitmap if there is no RAM */
     if (ram_bytes_total()) {
-        RAMBLOCK_FOREACH_MIGRATABLE(block) {
+        RAMBLOCK_FOREACH_NOT_IGNORED(block) {
             pages = block->max_length >> TARGET_PAGE_BITS;
             block->bmap = bitmap_new(pages);
             bitmap_set(block->bmap, 0, pages);
@@ -2953,7 +4470,12 @@ static void ram_init_bitmaps(RAMState *rs)
 
     ram_list_init_bitmaps();
     memory_global_dirty_log_start();
-    migration_bitmap_sync(rs);
+    if (migrate_use_dirty_ring()) {
+        cpu_physical_memory_dirty_ring_start();
+    }
+    bitmap_sync_threads_setup();
+    precopy_notify(PRECOPY_NOTIFY_SETUP);
+    migration_bitmap_sync_precopy(rs);
 
     rcu_read_unlock();
     qemu_mutex_unlock_ramlist();
@@ -2987,7 +4509,7 @@ static void ram_state_resume_prepare(RAMState *rs, QEMUFile *out)
      * about dirty page logging as well.
      */
 
-    RAMBLOCK_FOREACH_MIGRATABLE(block) {
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
         pages += bitmap_count_one(block->bmap,
                                   block->used_length >> TARGET_PAGE_BITS);
     }
@@ -3046,7 +4568,7 @@ static int ram_save_setup(QEMUFile *f, void *opaque)
 
     rcu_read_lock();
 
-    qemu_put_be64(f, ram_bytes_total() | RAM_SAVE_FLAG_MEM_SIZE);
+    qemu_put_be64(f, ram_bytes_total_common(true) | RAM_SAVE_FLAG_MEM_SIZE);
 
     RAMBLOCK_FOREACH_MIGRATABLE(block) {
         qemu_put_byte(f, strlen(block->idstr));
@@ -3055,6 +4577,9 @@ static int ram_save_setup(QEMUFile *f, void *opaque)
         if (migrate_postcopy_ram() && block->page_size != qemu_host_page_size) {
             qemu_put_be64(f, block->page_size);
         }
+        if (migrate_ignore_shared()) {
+            qemu_put_be64(f, block->mr->addr);
+        }
     }
 
     rcu_read_unlock();
@@ -3093,6 +4618,12 @@ static int ram_save_iterate(QEMUFile *f, void *opaque)
         goto out;
     }
 
+    if (migrate_use_mapped_ram()) {
+        /* Snapshots with x-mapped-ram send all RAM in ram_save_complete */
+        done = 1;
+        goto out;
+    }
+
     rcu_read_lock();
     if (ram_list.version != rs->last_version) {
         ram_state_reset(rs);
@@ -3173,14 +4704,24 @@ static int ram_save_complete(QEMUFile *f, void *opaque)
     RAMState **temp = opaque;
     RAMState *rs = *temp;
 
+    precopy_notify(PRECOPY_NOTIFY_COMPLETE);
+
     rcu_read_lock();
 
     if (!migration_in_postcopy()) {
-        migration_bitmap_sync(rs);
+        migration_bitmap_sync_precopy(rs);
     }
 
     ram_control_before_iterate(f, RAM_CONTROL_FINISH);
 
+    if (migrate_use_mapped_ram()) {
+        RAMBlock *block;
+
+        RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+            ram_save_mapped_block(rs, block);
+        }
+    }
+
     /* try transferring iterative blocks of memory */
 
     /* flush all remaining blocks regardless of rate limiting */
@@ -3221,7 +4762,7 @@ static void ram_save_pending(QEMUFile *f, void *opaque, uint64_t max_size,
         remaining_size < max_size) {
         qemu_mutex_lock_iothread();
         rcu_read_lock();
-        migration_bitmap_sync(rs);
+        migration_bitmap_sync_precopy(rs);
         rcu_read_unlock();
         qemu_mutex_unlock_iothread();
         remaining_size = rs->migration_dirty_pages * TARGET_PAGE_SIZE;
@@ -3303,7 +4844,7 @@ static inline RAMBlock *ram_block_from_stream(QEMUFile *f, int flags)
         return NULL;
     }
 
-    if (!qemu_ram_is_migratable(block)) {
+    if (ramblock_is_ignored(block)) {
         error_report("block %s should not be migrated !", id);
         return NULL;
     }
@@ -3338,6 +4879,53 @@ void ram_handle_compressed(void *host, uint8_t ch, uint64_t size)
     }
 }
 
+/**
+ * ram_load_mapped_block: load a RAMBlock sent by ram_save_mapped_block
+ *
+ * Returns 0 for success or -errno in case of error
+ *
+ * @f: QEMUFile where to read the data from
+ * @block: block the record belongs to
+ */
+static int ram_load_mapped_block(QEMUFile *f, RAMBlock *block)
+{
+    uint64_t pages = qemu_get_be64(f);
+    unsigned long *map, *le_map;
+    unsigned long page, end;
+    uint64_t map_size;
+
+    if (pages != block->used_length >> TARGET_PAGE_BITS) {
+        error_report("Mapped RAM block %s has 0x%" PRIx64 " pages, "
+                     "expected 0x" RAM_ADDR_FMT, block->idstr, pages,
+                     block->used_length >> TARGET_PAGE_BITS);
+        return -EINVAL;
+    }
+
+    map = bitmap_new(pages + BITS_PER_LONG);
+    le_map = bitmap_new(pages + BITS_PER_LONG);
+    map_size = DIV_ROUND_UP(pages, 64) * 8;
+    qemu_get_buffer(f, (uint8_t *)le_map, map_size);
+    bitmap_from_le(map, le_map, pages);
+
+    for (page = 0; page < pages; page = end) {
+        void *host = block->host + (page << TARGET_PAGE_BITS);
+
+        if (test_bit(page, map)) {
+            end = find_next_zero_bit(map, pages, page);
+            qemu_get_buffer(f, host, (end - page) << TARGET_PAGE_BITS);
+        } else {
+            /* Not in the record, the page was zero */
+            end = find_next_bit(map, pages, page);
+            ram_handle_compressed(host, 0, (end - page) << TARGET_PAGE_BITS);
+        }
+    }
+    ramblock_recv_bitmap_set_range(block, block->host, pages);
+
+    g_free(le_map);
+    g_free(map);
+    return qemu_file_get_error(f);
+}
+
 /* return the size after decompression, or negative value on error */
 static int
 qemu_uncompress_data(z_stream *stream, uint8_t *dest, size_t dest_len,
@@ -3550,7 +5138,7 @@ static int ram_load_cleanup(void *opaque)
     xbzrle_load_cleanup();
     compress_threads_load_cleanup();
 
-    RAMBLOCK_FOREACH_MIGRATABLE(rb) {
+    RAMBLOCK_FOREACH_NOT_IGNORED(rb) {
         g_free(rb->receivedmap);
         rb->receivedmap = NULL;
     }
@@ -3771,6 +5359,7 @@ static int ram_load(QEMUFile *f, void *opaque, int version_id)
 
     while (!postcopy_running && !ret && !(flags & RAM_SAVE_FLAG_EOS)) {
         ram_addr_t addr, total_ram_bytes;
+        RAMBlock *block = NULL;
         void *host = NULL;
         uint8_t ch;
 
@@ -3788,8 +5377,9 @@ static int ram_load(QEMUFile *f, void *opaque, int version_id)
         }
 
         if (flags & (RAM_SAVE_FLAG_ZERO | RAM_SAVE_FLAG_PAGE |
-                     RAM_SAVE_FLAG_COMPRESS_PAGE | RAM_SAVE_FLAG_XBZRLE)) {
-            RAMBlock *block = ram_block_from_stream(f, flags);
+                     RAM_SAVE_FLAG_COMPRESS_PAGE | RAM_SAVE_FLAG_XBZRLE |
+                     RAM_SAVE_FLAG_MAPPED)) {
+            block = ram_block_from_stream(f, flags);
 
             host = host_from_ram_block_offset(block, addr);
             if (!host) {
@@ -3806,7 +5396,6 @@ static int ram_load(QEMUFile *f, void *opaque, int version_id)
             /* Synchronize RAM block list */
             total_ram_bytes = addr;
             while (!ret && total_ram_bytes) {
-                RAMBlock *block;
                 char id[256];
                 ram_addr_t length;
 
@@ -3841,6 +5430,18 @@ static int ram_load(QEMUFile *f, void *opaque, int version_id)
                             ret = -EINVAL;
                         }
                     }
+                    /* Shared blocks must be mapped at the same address */
+                    if (migrate_ignore_shared()) {
+                        hwaddr addr = qemu_get_be64(f);
+                        if (ramblock_is_ignored(block) &&
+                            block->mr->addr != addr) {
+                            error_report("Mismatched GPAs for block %s "
+                                         "0x%" PRIx64 " != 0x%" PRIx64,
+                                         id, (uint64_t)addr,
+                                         (uint64_t)block->mr->addr);
+                            ret = -EINVAL;
+                        }
+                    }
                     ram_control_load_hook(f, RAM_CONTROL_BLOCK_REG,
                                           block->idstr);
                 } else {
@@ -3880,6 +5481,10 @@ static int ram_load(QEMUFile *f, void *opaque, int version_id)
                 break;
             }
             break;
+        case RAM_SAVE_FLAG_MAPPED:
+            ret = ram_load_mapped_block(f, block);
+            break;
+
         case RAM_SAVE_FLAG_EOS:
             /* normal exit */
             multifd_recv_sync_main();
@@ -3918,7 +5523,7 @@ static int ram_dirty_bitmap_sync_all(MigrationState *s, RAMState *rs)
 
     trace_ram_dirty_bitmap_sync_start();
 
-    RAMBLOCK_FOREACH_MIGRATABLE(block) {
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
         qemu_savevm_send_recv_bitmap(file, block->idstr);
         trace_ram_dirty_bitmap_request(block->idstr);
         ramblock_count++;
@@ -37,8 +37,12 @@
 extern MigrationStats ram_counters;
 extern XBZRLECacheStats xbzrle_counters;
 
+bool ramblock_is_ignored(RAMBlock *block);
+int foreach_not_ignored_block(RAMBlockIterFunc func, void *opaque);
+
 int xbzrle_cache_resize(int64_t new_size, Error **errp);
 uint64_t ram_bytes_remaining(void);
+VcpuDirtyInfoList *ram_vcpu_dirty_info(void);
 uint64_t ram_bytes_total(void);
 
 int multifd_save_setup(void);
@@ -47,6 +51,12 @@ int multifd_load_setup(void);
 int multifd_load_cleanup(Error **errp);
 bool multifd_recv_all_channels_created(void);
 bool multifd_recv_new_channel(QIOChannel *ioc);
+bool multifd_compression_supported(MultiFDCompression method);
+bool multifd_device_state_active(void);
+void multifd_send_device_state(uint8_t *data, uint32_t len);
+void multifd_send_device_state_sync(void);
+int multifd_recv_device_state_sync(uint32_t count);
+bool multifd_recv_device_state_pop(uint8_t **data, uint32_t *len);
 
 uint64_t ram_pagesize_summary(void);
 int ram_save_queue_pages(const char *rbname, ram_addr_t start, ram_addr_t len);
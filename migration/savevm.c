@@ -84,6 +84,8 @@ enum qemu_vm_cmd {
     MIG_CMD_PACKAGED,          /* Send a wrapped stream within this stream */
     MIG_CMD_POSTCOPY_RESUME,   /* resume postcopy on dest */
     MIG_CMD_RECV_BITMAP,       /* Request for recved bitmap on dst */
+    MIG_CMD_MULTIFD_DEVICE_STATE, /* Load the device state sections that
+                                     came over the multifd channels */
     MIG_CMD_MAX
 };
 
@@ -103,6 +105,8 @@ static struct mig_cmd_args {
     [MIG_CMD_POSTCOPY_RESUME]  = { .len =  0, .name = "POSTCOPY_RESUME" },
     [MIG_CMD_PACKAGED]         = { .len =  4, .name = "PACKAGED" },
     [MIG_CMD_RECV_BITMAP]      = { .len = -1, .name = "RECV_BITMAP" },
+    [MIG_CMD_MULTIFD_DEVICE_STATE] = {
+                                   .len =  4, .name = "MULTIFD_DEVICE_STATE" },
     [MIG_CMD_MAX]              = { .len = -1, .name = "MAX" },
 };
 
@@ -980,6 +984,56 @@ void qemu_savevm_send_recv_bitmap(QEMUFile *f, char *block_name)
     qemu_savevm_command_send(f, MIG_CMD_RECV_BITMAP, len + 1, (uint8_t *)buf);
 }
 
+/* Tell the destination how many device state sections to expect on multifd */
+static void qemu_savevm_send_multifd_device_state(QEMUFile *f, uint32_t count)
+{
+    uint32_t buf = cpu_to_be32(count);
+
+    trace_savevm_send_multifd_device_state(count);
+    qemu_savevm_command_send(f, MIG_CMD_MULTIFD_DEVICE_STATE, sizeof(buf),
+                             (uint8_t *)&buf);
+}
+
+/*
+ * Serialize the state of one device into a buffer and queue it on the
+ * multifd channels.  The buffer holds the section exactly as it would
+ * appear on the main stream, followed by QEMU_VM_EOF.
+ */
+static int vmstate_save_multifd(SaveStateEntry *se, QJSON *vmdesc)
+{
+    QIOChannelBuffer *bioc;
+    QEMUFile *f;
+    int ret;
+
+    bioc = qio_channel_buffer_new(4096);
+    qio_channel_set_name(QIO_CHANNEL(bioc), "migration-device-state-buffer");
+    f = qemu_fopen_channel_output(QIO_CHANNEL(bioc));
+
+    save_section_header(f, se, QEMU_VM_SECTION_FULL);
+    ret = vmstate_save(f, se, vmdesc);
+    if (!ret) {
+        save_section_footer(f, se);
+        qemu_put_byte(f, QEMU_VM_EOF);
+        qemu_fflush(f);
+        ret = qemu_file_get_error(f);
+    }
+    if (!ret && bioc->usage > UINT32_MAX) {
+        error_report("%s: Unreasonably large device state: %zu",
+                     se->idstr, bioc->usage);
+        ret = -E2BIG;
+    }
+    if (!ret) {
+        /* The channel frees its data on close, so take it first */
+        multifd_send_device_state(bioc->data, bioc->usage);
+        bioc->data = NULL;
+        bioc->capacity = bioc->usage = 0;
+    }
+    qemu_fclose(f);
+    object_unref(OBJECT(bioc));
+
+    return ret;
+}
+
 bool qemu_savevm_state_blocked(Error **errp)
 {
     SaveStateEntry *se;
@@ -1172,6 +1226,8 @@ int qemu_savevm_state_complete_precopy(QEMUFile *f, bool iterable_only,
     SaveStateEntry *se;
     int ret;
     bool in_postcopy = migration_in_postcopy();
+    bool multifd_devices;
+    uint32_t multifd_sections = 0;
 
     trace_savevm_state_complete_precopy();
 
@@ -1208,6 +1264,8 @@ int qemu_savevm_state_complete_precopy(QEMUFile *f, bool iterable_only,
         return 0;
     }
 
+    multifd_devices = !in_postcopy && multifd_device_state_active();
+
     vmdesc = qjson_new();
     json_prop_int(vmdesc, "page_size", qemu_target_page_size());
     json_start_array(vmdesc, "devices");
@@ -1227,18 +1285,38 @@ int qemu_savevm_state_complete_precopy(QEMUFile *f, bool iterable_only,
         json_prop_str(vmdesc, "name", se->idstr);
         json_prop_int(vmdesc, "instance_id", se->instance_id);
 
-        save_section_header(f, se, QEMU_VM_SECTION_FULL);
-        ret = vmstate_save(f, se, vmdesc);
-        if (ret) {
-            qemu_file_set_error(f, ret);
-            return ret;
+        if (multifd_devices) {
+            ret = vmstate_save_multifd(se, vmdesc);
+            if (ret) {
+                qemu_file_set_error(f, ret);
+                return ret;
+            }
+            multifd_sections++;
+            trace_savevm_section_end(se->idstr, se->section_id, 0);
+        } else {
+            save_section_header(f, se, QEMU_VM_SECTION_FULL);
+            ret = vmstate_save(f, se, vmdesc);
+            if (ret) {
+                qemu_file_set_error(f, ret);
+                return ret;
+            }
+            trace_savevm_section_end(se->idstr, se->section_id, 0);
+            save_section_footer(f, se);
         }
-        trace_savevm_section_end(se->idstr, se->section_id, 0);
-        save_section_footer(f, se);
 
         json_end_object(vmdesc);
     }
 
+    if (multifd_sections) {
+        /*
+         * The sections have been going out on the multifd channels while
+         * the next devices were serialized; wait for the last ones before
+         * the destination is told to load them.
+         */
+        multifd_send_device_state_sync();
+        qemu_savevm_send_multifd_device_state(f, multifd_sections);
+    }
+
     if (inactivate_disks) {
         /* Inactivate before sending QEMU_VM_EOF so that the
          * bdrv_invalidate_cache_all() on the other end won't fail. */
@@ -1334,6 +1412,12 @@ static int qemu_savevm_state(QEMUFile *f, Error **errp)
         goto done;
     }
 
+    if (migrate_ignore_shared()) {
+        error_setg(errp, "x-ignore-shared and snapshots are incompatible");
+        ret = -EINVAL;
+        goto done;
+    }
+
     qemu_mutex_unlock_iothread();
     qemu_savevm_state_header(f);
     qemu_savevm_state_setup(f);
@@ -1875,6 +1959,49 @@ static int loadvm_handle_cmd_packaged(MigrationIncomingState *mis)
     return ret;
 }
 
+/*
+ * Load the device state sections that were sent over the multifd
+ * channels, in the order the source serialized them.  The order matters
+ * (e.g. a bus before the devices on it), so the sections are loaded one
+ * after the other from the main thread.
+ */
+static int loadvm_handle_multifd_device_state(MigrationIncomingState *mis)
+{
+    uint32_t count;
+    uint32_t len;
+    uint8_t *data;
+    QIOChannelBuffer *bioc;
+    QEMUFile *f;
+    int ret;
+
+    count = qemu_get_be32(mis->from_src_file);
+    trace_loadvm_handle_multifd_device_state(count);
+
+    ret = multifd_recv_device_state_sync(count);
+    if (ret) {
+        return ret;
+    }
+
+    while (multifd_recv_device_state_pop(&data, &len)) {
+        bioc = qio_channel_buffer_new(0);
+        qio_channel_set_name(QIO_CHANNEL(bioc),
+                             "migration-device-state-buffer");
+        g_free(bioc->data);
+        bioc->data = data;
+        bioc->capacity = bioc->usage = len;
+
+        f = qemu_fopen_channel_input(QIO_CHANNEL(bioc));
+        ret = qemu_loadvm_state_main(f, mis);
+        qemu_fclose(f);
+        object_unref(OBJECT(bioc));
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
 /*
  * Handle request that source requests for recved_bitmap on
  * destination. Payload format:
@@ -1997,6 +2124,9 @@ static int loadvm_process_command(QEMUFile *f)
 
     case MIG_CMD_RECV_BITMAP:
         return loadvm_handle_recv_bitmap(mis, len);
+
+    case MIG_CMD_MULTIFD_DEVICE_STATE:
+        return loadvm_handle_multifd_device_state(mis);
     }
 
     return 0;
@@ -26,6 +26,86 @@ static int vmstate_subsection_save(QEMUFile *f, const VMStateDescription *vmsd,
 static int vmstate_subsection_load(QEMUFile *f, const VMStateDescription *vmsd,
                                    void *opaque);
 
+/* Arrays of plain fixed-width integers are sent as one big-endian buffer
+ * instead of element by element.  The wire format is the same.  Returns the
+ * element width if @field can take this path, 0 otherwise. */
+static int vmstate_bulk_width(VMStateField *field, int n_elems, int size)
+{
+    const VMStateInfo *info = field->info;
+
+    if (n_elems < 2 ||
+        (field->flags & (VMS_STRUCT | VMS_VSTRUCT | VMS_ARRAY_OF_POINTER))) {
+        return 0;
+    }
+
+    if (info == &vmstate_info_uint8 || info == &vmstate_info_int8) {
+        return size == 1 ? 1 : 0;
+    } else if (info == &vmstate_info_uint16 || info == &vmstate_info_int16) {
+        return size == 2 ? 2 : 0;
+    } else if (info == &vmstate_info_uint32 || info == &vmstate_info_int32) {
+        return size == 4 ? 4 : 0;
+    } else if (info == &vmstate_info_uint64 || info == &vmstate_info_int64) {
+        return size == 8 ? 8 : 0;
+    }
+    return 0;
+}
+
+static void vmstate_bswap_bulk(void *buf, int n_elems, int width)
+{
+    int i;
+
+    switch (width) {
+    case 2:
+        for (i = 0; i < n_elems; i++) {
+            be16_to_cpus((uint16_t *)buf + i);
+        }
+        break;
+    case 4:
+        for (i = 0; i < n_elems; i++) {
+            be32_to_cpus((uint32_t *)buf + i);
+        }
+        break;
+    case 8:
+        for (i = 0; i < n_elems; i++) {
+            be64_to_cpus((uint64_t *)buf + i);
+        }
+        break;
+    }
+}
+
+static void vmstate_get_bulk(QEMUFile *f, void *buf, int n_elems, int width)
+{
+    qemu_get_buffer(f, buf, (size_t)n_elems * width);
+    if (width > 1) {
+        vmstate_bswap_bulk(buf, n_elems, width);
+    }
+}
+
+static void vmstate_put_bulk(QEMUFile *f, const void *buf, int n_elems,
+                             int width)
+{
+#ifdef HOST_WORDS_BIGENDIAN
+    qemu_put_buffer(f, buf, (size_t)n_elems * width);
+#else
+    uint64_t tmp[64];
+
+    if (width == 1) {
+        qemu_put_buffer(f, buf, n_elems);
+        return;
+    }
+
+    while (n_elems) {
+        int n = MIN(n_elems, sizeof(tmp) / width);
+
+        memcpy(tmp, buf, n * width);
+        vmstate_bswap_bulk(tmp, n, width);
+        qemu_put_buffer(f, (uint8_t *)tmp, n * width);
+        buf += n * width;
+        n_elems -= n;
+    }
+#endif
+}
+
 static int vmstate_n_elems(void *opaque, VMStateField *field)
 {
     int n_elems = 1;
@@ -117,12 +197,24 @@ int vmstate_load_state(QEMUFile *f, const VMStateDescription *vmsd,
             void *first_elem = opaque + field->offset;
             int i, n_elems = vmstate_n_elems(opaque, field);
             int size = vmstate_size(opaque, field);
+            int width = vmstate_bulk_width(field, n_elems, size);
 
             vmstate_handle_alloc(first_elem, field, opaque);
             if (field->flags & VMS_POINTER) {
                 first_elem = *(void **)first_elem;
                 assert(first_elem || !n_elems || !size);
             }
+            if (width) {
+                vmstate_get_bulk(f, first_elem, n_elems, width);
+                ret = qemu_file_get_error(f);
+                if (ret < 0) {
+                    error_report("Failed to load %s:%s", vmsd->name,
+                                 field->name);
+                    trace_vmstate_load_field_error(field->name, ret);
+                    return ret;
+                }
+                n_elems = 0;
+            }
             for (i = 0; i < n_elems; i++) {
                 void *curr_elem = first_elem + size * i;
 
@@ -352,12 +444,22 @@ int vmstate_save_state_v(QEMUFile *f, const VMStateDescription *vmsd,
             int size = vmstate_size(opaque, field);
             int64_t old_offset, written_bytes;
             QJSON *vmdesc_loop = vmdesc;
+            int width;
 
             trace_vmstate_save_state_loop(vmsd->name, field->name, n_elems);
             if (field->flags & VMS_POINTER) {
                 first_elem = *(void **)first_elem;
                 assert(first_elem || !n_elems || !size);
             }
+            /* The description of compressed arrays only covers the first
+             * element, which allows for the bulk path */
+            if (!field->field_exists &&
+                (width = vmstate_bulk_width(field, n_elems, size))) {
+                vmsd_desc_field_start(vmsd, vmdesc, field, 0, n_elems);
+                vmstate_put_bulk(f, first_elem, n_elems, width);
+                vmsd_desc_field_end(vmsd, vmdesc, field, width, 0);
+                n_elems = 0;
+            }
             for (i = 0; i < n_elems; i++) {
                 void *curr_elem = first_elem + size * i;
                 ret = 0;
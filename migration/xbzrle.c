@@ -12,8 +12,291 @@
  */
 #include "qemu/osdep.h"
 #include "qemu/cutils.h"
+#include "qemu/bswap.h"
+#include "qemu/host-utils.h"
 #include "xbzrle.h"
 
+/*
+ * Scanning for runs of equal and different bytes
+ *
+ * run_equal() returns the length of the longest prefix on which the two
+ * buffers agree, run_differ() the length of the longest prefix on which
+ * they differ at every byte.  The vector versions compare a whole vector
+ * per iteration and finish the tail with the integer version.
+ */
+
+static size_t run_equal_int(const uint8_t *a, const uint8_t *b, size_t len)
+{
+    size_t i = 0;
+
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t x = ldq_he_p(a + i) ^ ldq_he_p(b + i);
+
+        if (x) {
+#ifdef HOST_WORDS_BIGENDIAN
+            return i + clz64(x) / 8;
+#else
+            return i + ctz64(x) / 8;
+#endif
+        }
+    }
+    while (i < len && a[i] == b[i]) {
+        i++;
+    }
+    return i;
+}
+
+static size_t run_differ_int(const uint8_t *a, const uint8_t *b, size_t len)
+{
+    const uint64_t mask = 0x0101010101010101ULL;
+    size_t i = 0;
+
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t x = ldq_he_p(a + i) ^ ldq_he_p(b + i);
+
+        /* does this word contain an equal, i.e. zero, byte? */
+        if ((x - mask) & ~x & (mask << 7)) {
+            break;
+        }
+    }
+    while (i < len && a[i] != b[i]) {
+        i++;
+    }
+    return i;
+}
+
+#if defined(CONFIG_AVX2_OPT) || defined(__SSE2__)
+#ifdef CONFIG_AVX2_OPT
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#endif
+#include <emmintrin.h>
+
+static size_t run_equal_sse2(const uint8_t *a, const uint8_t *b, size_t len)
+{
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+        unsigned neq = ~_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) & 0xffff;
+
+        if (neq) {
+            return i + ctz32(neq);
+        }
+    }
+    return i + run_equal_int(a + i, b + i, len - i);
+}
+
+static size_t run_differ_sse2(const uint8_t *a, const uint8_t *b, size_t len)
+{
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+        unsigned eq = _mm_movemask_epi8(_mm_cmpeq_epi8(va, vb));
+
+        if (eq) {
+            return i + ctz32(eq);
+        }
+    }
+    return i + run_differ_int(a + i, b + i, len - i);
+}
+#ifdef CONFIG_AVX2_OPT
+#pragma GCC pop_options
+#endif
+
+#ifdef CONFIG_AVX2_OPT
+/* See util/bufferiszero.c for why the regions are nested this way.  */
+#pragma GCC push_options
+#pragma GCC target("sse4")
+#include <smmintrin.h>
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#include <immintrin.h>
+
+static size_t run_equal_avx2(const uint8_t *a, const uint8_t *b, size_t len)
+{
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+        uint32_t neq = ~_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+
+        if (neq) {
+            return i + ctz32(neq);
+        }
+    }
+    return i + run_equal_sse2(a + i, b + i, len - i);
+}
+
+static size_t run_differ_avx2(const uint8_t *a, const uint8_t *b, size_t len)
+{
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+        uint32_t eq = _mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb));
+
+        if (eq) {
+            return i + ctz32(eq);
+        }
+    }
+    return i + run_differ_sse2(a + i, b + i, len - i);
+}
+#pragma GCC pop_options
+#pragma GCC pop_options
+#endif /* CONFIG_AVX2_OPT */
+
+#define CACHE_AVX2    1
+#define CACHE_SSE2    2
+
+#ifdef CONFIG_AVX2_OPT
+# define INIT_CACHE 0
+# define INIT_EQUAL run_equal_int
+# define INIT_DIFFER run_differ_int
+#else
+# define INIT_CACHE CACHE_SSE2
+# define INIT_EQUAL run_equal_sse2
+# define INIT_DIFFER run_differ_sse2
+#endif
+
+static unsigned cpuid_cache = INIT_CACHE;
+static size_t (*run_equal)(const uint8_t *, const uint8_t *, size_t) =
+    INIT_EQUAL;
+static size_t (*run_differ)(const uint8_t *, const uint8_t *, size_t) =
+    INIT_DIFFER;
+
+static void init_accel(unsigned cache)
+{
+    run_equal = run_equal_int;
+    run_differ = run_differ_int;
+    if (cache & CACHE_SSE2) {
+        run_equal = run_equal_sse2;
+        run_differ = run_differ_sse2;
+    }
+#ifdef CONFIG_AVX2_OPT
+    if (cache & CACHE_AVX2) {
+        run_equal = run_equal_avx2;
+        run_differ = run_differ_avx2;
+    }
+#endif
+}
+
+#ifdef CONFIG_AVX2_OPT
+#include "qemu/cpuid.h"
+
+static void __attribute__((constructor)) init_cpuid_cache(void)
+{
+    int max = __get_cpuid_max(0, NULL);
+    int a, b, c, d;
+    unsigned cache = 0;
+
+    if (max >= 1) {
+        __cpuid(1, a, b, c, d);
+        if (d & bit_SSE2) {
+            cache |= CACHE_SSE2;
+        }
+
+        /* We must check that AVX is not just available, but usable.  */
+        if ((c & bit_OSXSAVE) && (c & bit_AVX) && max >= 7) {
+            int bv;
+            __asm("xgetbv" : "=a"(bv), "=d"(d) : "c"(0));
+            __cpuid_count(7, 0, a, b, c, d);
+            if ((bv & 6) == 6 && (b & bit_AVX2)) {
+                cache |= CACHE_AVX2;
+            }
+        }
+    }
+    cpuid_cache = cache;
+    init_accel(cache);
+}
+#endif /* CONFIG_AVX2_OPT */
+
+bool test_xbzrle_next_accel(void)
+{
+    if (cpuid_cache == 0) {
+        return false;
+    }
+    /* Disable the accelerator we used before and select a new one.  */
+    cpuid_cache &= cpuid_cache - 1;
+    init_accel(cpuid_cache);
+    return true;
+}
+
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+
+/*
+ * Narrow a byte compare result to 4 bits per byte, so that the first
+ * set byte can be found with ctz64.
+ */
+static inline uint64_t neon_byte_mask(uint8x16_t v)
+{
+    uint8x8_t n = vshrn_n_u16(vreinterpretq_u16_u8(v), 4);
+
+    return vget_lane_u64(vreinterpret_u64_u8(n), 0);
+}
+
+static size_t run_equal_neon(const uint8_t *a, const uint8_t *b, size_t len)
+{
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t eq = vceqq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+        uint64_t neq = neon_byte_mask(vmvnq_u8(eq));
+
+        if (neq) {
+            return i + ctz64(neq) / 4;
+        }
+    }
+    return i + run_equal_int(a + i, b + i, len - i);
+}
+
+static size_t run_differ_neon(const uint8_t *a, const uint8_t *b, size_t len)
+{
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t eq = vceqq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+        uint64_t m = neon_byte_mask(eq);
+
+        if (m) {
+            return i + ctz64(m) / 4;
+        }
+    }
+    return i + run_differ_int(a + i, b + i, len - i);
+}
+
+/* Advanced SIMD is mandatory on AArch64, so there is nothing to probe.  */
+static size_t (*run_equal)(const uint8_t *, const uint8_t *, size_t) =
+    run_equal_neon;
+static size_t (*run_differ)(const uint8_t *, const uint8_t *, size_t) =
+    run_differ_neon;
+
+bool test_xbzrle_next_accel(void)
+{
+    if (run_equal == run_equal_int) {
+        return false;
+    }
+    run_equal = run_equal_int;
+    run_differ = run_differ_int;
+    return true;
+}
+
+#else
+#define run_equal  run_equal_int
+#define run_differ run_differ_int
+bool test_xbzrle_next_accel(void)
+{
+    return false;
+}
+#endif
+
 /*
   page = zrun nzrun
        | zrun nzrun page
@@ -27,10 +310,8 @@
 int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
                          uint8_t *dst, int dlen)
 {
-    uint32_t zrun_len = 0, nzrun_len = 0;
+    uint32_t zrun_len, nzrun_len;
     int d = 0, i = 0;
-    long res;
-    uint8_t *nzrun_start = NULL;
 
     g_assert(!(((uintptr_t)old_buf | (uintptr_t)new_buf | slen) %
                sizeof(long)));
@@ -41,28 +322,8 @@ int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
             return -1;
         }
 
-        /* not aligned to sizeof(long) */
-        res = (slen - i) % sizeof(long);
-        while (res && old_buf[i] == new_buf[i]) {
-            zrun_len++;
-            i++;
-            res--;
-        }
-
-        /* word at a time for speed */
-        if (!res) {
-            while (i < slen &&
-                   (*(long *)(old_buf + i)) == (*(long *)(new_buf + i))) {
-                i += sizeof(long);
-                zrun_len += sizeof(long);
-            }
-
-            /* go over the rest */
-            while (i < slen && old_buf[i] == new_buf[i]) {
-                zrun_len++;
-                i++;
-            }
-        }
+        zrun_len = run_equal(old_buf + i, new_buf + i, slen - i);
+        i += zrun_len;
 
         /* buffer unchanged */
         if (zrun_len == slen) {
@@ -76,51 +337,21 @@ int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
 
         d += uleb128_encode_small(dst + d, zrun_len);
 
-        zrun_len = 0;
-        nzrun_start = new_buf + i;
-
         /* overflow */
         if (d + 2 > dlen) {
             return -1;
         }
-        /* not aligned to sizeof(long) */
-        res = (slen - i) % sizeof(long);
-        while (res && old_buf[i] != new_buf[i]) {
-            i++;
-            nzrun_len++;
-            res--;
-        }
-
-        /* word at a time for speed, use of 32-bit long okay */
-        if (!res) {
-            /* truncation to 32-bit long okay */
-            unsigned long mask = (unsigned long)0x0101010101010101ULL;
-            while (i < slen) {
-                unsigned long xor;
-                xor = *(unsigned long *)(old_buf + i)
-                    ^ *(unsigned long *)(new_buf + i);
-                if ((xor - mask) & ~xor & (mask << 7)) {
-                    /* found the end of an nzrun within the current long */
-                    while (old_buf[i] != new_buf[i]) {
-                        nzrun_len++;
-                        i++;
-                    }
-                    break;
-                } else {
-                    i += sizeof(long);
-                    nzrun_len += sizeof(long);
-                }
-            }
-        }
+
+        nzrun_len = run_differ(old_buf + i, new_buf + i, slen - i);
 
         d += uleb128_encode_small(dst + d, nzrun_len);
         /* overflow */
         if (d + nzrun_len > dlen) {
             return -1;
         }
-        memcpy(dst + d, nzrun_start, nzrun_len);
+        memcpy(dst + d, new_buf + i, nzrun_len);
         d += nzrun_len;
-        nzrun_len = 0;
+        i += nzrun_len;
     }
 
     return d;
@@ -70,6 +70,7 @@
 #endif
 #include "exec/memory.h"
 #include "exec/exec-all.h"
+#include "exec/tb-profile.h"
 #include "qemu/log.h"
 #include "qemu/option.h"
 #include "hmp.h"
@@ -1452,6 +1453,41 @@ static void hmp_info_opcount(Monitor *mon, const QDict *qdict)
 {
     dump_opcount_info((FILE *)mon, monitor_fprintf);
 }
+
+static void hmp_info_tb_profile(Monitor *mon, const QDict *qdict)
+{
+    int max = qdict_get_try_int(qdict, "max", 20);
+
+    if (!tcg_enabled()) {
+        error_report("TB profile is only available with accel=tcg");
+        return;
+    }
+
+    tb_profile_dump((FILE *)mon, monitor_fprintf, max);
+}
+
+static void hmp_tb_profile(Monitor *mon, const QDict *qdict)
+{
+    bool enable = qdict_get_bool(qdict, "enable");
+    const char *dir = qdict_get_try_str(qdict, "jitdump");
+    Error *err = NULL;
+
+    if (!tcg_enabled()) {
+        error_report("TB profile is only available with accel=tcg");
+        return;
+    }
+
+    if (!enable) {
+        tb_profile_stop();
+        tb_profile_jitdump_close();
+        return;
+    }
+    if (dir && !tb_profile_jitdump_open(dir, &err)) {
+        error_report_err(err);
+        return;
+    }
+    tb_profile_start();
+}
 #endif
 
 static void hmp_info_history(Monitor *mon, const QDict *qdict)
@@ -4245,18 +4281,15 @@ static void monitor_qmp_bh_dispatcher(void *data)
 
 #define  QMP_REQ_QUEUE_LEN_MAX  (8)
 
-static void handle_qmp_command(JSONMessageParser *parser, GQueue *tokens)
+static void handle_qmp_command(void *opaque, QObject *req, Error *err)
 {
-    QObject *req, *id = NULL;
+    QObject *id = NULL;
     QDict *qdict;
-    MonitorQMP *mon_qmp = container_of(parser, MonitorQMP, parser);
-    Monitor *mon = container_of(mon_qmp, Monitor, qmp);
-    Error *err = NULL;
+    Monitor *mon = opaque;
     QMPRequest *req_obj;
 
-    req = json_parser_parse_err(tokens, NULL, &err);
     if (!req && !err) {
-        /* json_parser_parse_err() sucks: can fail without setting @err */
+        /* The lexer rejected the input, or it exceeded the limits */
         error_setg(&err, QERR_JSON_PARSING);
     }
 
@@ -4452,7 +4485,8 @@ static void monitor_qmp_event(void *opaque, int event)
         monitor_qmp_response_flush(mon);
         monitor_qmp_cleanup_queues(mon);
         json_message_parser_destroy(&mon->qmp.parser);
-        json_message_parser_init(&mon->qmp.parser, handle_qmp_command);
+        json_message_parser_init(&mon->qmp.parser, handle_qmp_command,
+                                 mon, NULL);
         mon_refcount--;
         monitor_fdsets_cleanup();
         break;
@@ -4670,7 +4704,8 @@ void monitor_init(Chardev *chr, int flags)
 
     if (monitor_is_qmp(mon)) {
         qemu_chr_fe_set_echo(&mon->chr, true);
-        json_message_parser_init(&mon->qmp.parser, handle_qmp_command);
+        json_message_parser_init(&mon->qmp.parser, handle_qmp_command,
+                                 mon, NULL);
         if (mon->use_io_thread) {
             /*
              * Make sure the old iowatch is gone.  It's possible when
@@ -4737,6 +4772,22 @@ void monitor_cleanup(void)
     mon_iothread = NULL;
 }
 
+/*
+ * The child of x-vm-fork shares the monitors' chardevs with the parent.
+ * Let go of them; output, including the reply to x-vm-fork, is dropped.
+ * Called before the iothreads are restarted in the child.
+ */
+void monitor_fork_child(void)
+{
+    Monitor *mon;
+
+    qemu_mutex_lock(&monitor_lock);
+    QTAILQ_FOREACH(mon, &mon_list, entry) {
+        qemu_chr_fe_deinit(&mon->chr, false);
+    }
+    qemu_mutex_unlock(&monitor_lock);
+}
+
 QemuOptsList qemu_mon_opts = {
     .name = "mon",
     .implied_opt_name = "chardev",
@@ -19,8 +19,13 @@
 
 #include "qemu/osdep.h"
 #include "qapi/error.h"
+#include "block/block_int.h"
+#include "block/thread-pool.h"
 #include "trace.h"
 #include "nbd-internal.h"
+#ifdef CONFIG_SENDFILE
+#include <sys/sendfile.h>
+#endif
 
 #define NBD_META_ID_BASE_ALLOCATION 0
 #define NBD_META_ID_DIRTY_BITMAP 1
@@ -31,6 +36,10 @@
  * the reply as a denial of service attack. */
 #define NBD_MAX_BITMAP_EXTENTS (0x100000 / 8)
 
+/* Reads smaller than this are cheaper to bounce through user space than
+ * to hand to a worker thread for sendfile(). */
+#define NBD_ZERO_COPY_MIN (64 * 1024)
+
 static int system_errno_to_nbd_errno(int err)
 {
     switch (err) {
@@ -1776,6 +1785,178 @@ static int coroutine_fn nbd_co_send_structured_error(NBDClient *client,
     return nbd_co_send_iov(client, iov, 1 + !!iov[1].iov_len, errp);
 }
 
+#ifdef CONFIG_SENDFILE
+typedef struct NBDSendfileData {
+    int sockfd;
+    int fd;
+    off_t offset;
+    size_t size;
+    size_t done;
+} NBDSendfileData;
+
+/* Runs in a thread pool worker, so that the data of several clients is
+ * moved in parallel and off the export's AioContext.  Returns -EAGAIN
+ * when the socket is full; the caller waits for it to drain and
+ * resubmits. */
+static int nbd_sendfile_worker(void *opaque)
+{
+    NBDSendfileData *d = opaque;
+
+    while (d->done < d->size) {
+        ssize_t ret = sendfile(d->sockfd, d->fd, &d->offset,
+                               d->size - d->done);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return errno == EWOULDBLOCK ? -EAGAIN : -errno;
+        }
+        if (ret == 0) {
+            /* The file is shorter than the export */
+            return -EIO;
+        }
+        d->done += ret;
+    }
+    return 0;
+}
+
+/* nbd_lookup_host_fd
+ * Return the image file descriptor behind the export and translate
+ * @offset to it, or -errno if there is none.  The descriptor may change
+ * whenever the node is not busy, so callers must hold an in-flight
+ * reference from before the lookup until they are done with it.
+ */
+static int nbd_lookup_host_fd(NBDExport *exp, int64_t *offset)
+{
+    BlockDriverState *bs = blk_bs(exp->blk);
+
+    if (!bs) {
+        return -ENOMEDIUM;
+    }
+    *offset += exp->dev_offset;
+    return bdrv_get_host_fd(bs, offset);
+}
+
+/* nbd_co_send_read_zero_copy
+ * Send the reply to a read of @size bytes at @offset, with the payload
+ * going from the image file to the socket through sendfile() rather than
+ * @data.  Returns 0 without sending anything if the export or connection
+ * cannot do this, 1 once the reply was sent, and -errno if sending
+ * failed.  A read error after the header went out cannot be reported to
+ * the client any more, so it is a send failure too.
+ */
+static int coroutine_fn nbd_co_send_read_zero_copy(NBDClient *client,
+                                                   uint64_t handle,
+                                                   uint64_t offset,
+                                                   uint8_t *data,
+                                                   size_t size,
+                                                   bool final,
+                                                   Error **errp)
+{
+    NBDExport *exp = client->exp;
+    NBDSimpleReply simple;
+    NBDStructuredReadData chunk;
+    struct iovec iov;
+    int64_t host_offset = offset;
+    size_t done = 0;
+    int ret;
+
+    /* TLS has to see the data in user space */
+    if (client->ioc != QIO_CHANNEL(client->sioc) ||
+        size < NBD_ZERO_COPY_MIN || nbd_lookup_host_fd(exp, &host_offset) < 0) {
+        return 0;
+    }
+
+    trace_nbd_co_send_read_zero_copy(handle, offset, size);
+    if (client->structured_reply) {
+        set_be_chunk(&chunk.h, final ? NBD_REPLY_FLAG_DONE : 0,
+                     NBD_REPLY_TYPE_OFFSET_DATA, handle,
+                     sizeof(chunk) - sizeof(chunk.h) + size);
+        stq_be_p(&chunk.offset, offset);
+        iov = (struct iovec) { .iov_base = &chunk, .iov_len = sizeof(chunk) };
+    } else {
+        set_be_simple_reply(&simple, NBD_SUCCESS, handle);
+        iov = (struct iovec) { .iov_base = &simple, .iov_len = sizeof(simple) };
+    }
+
+    qemu_co_mutex_lock(&client->send_lock);
+    client->send_coroutine = qemu_coroutine_self();
+    qio_channel_set_cork(client->ioc, true);
+
+    if (qio_channel_writev_all(client->ioc, &iov, 1, errp) < 0) {
+        ret = -EIO;
+        goto out;
+    }
+
+    /* The node is only kept busy while a worker uses the descriptor, not
+     * while waiting for a slow client, so that draining is not held up */
+    for (;;) {
+        BlockDriverState *bs = blk_bs(exp->blk);
+        NBDSendfileData d = {
+            .sockfd = client->sioc->fd,
+            .size = size - done,
+        };
+
+        if (!bs) {
+            error_setg(errp, "export medium went away");
+            ret = -EIO;
+            goto out;
+        }
+        host_offset = offset + done;
+        bdrv_inc_in_flight(bs);
+        d.fd = nbd_lookup_host_fd(exp, &host_offset);
+        if (d.fd < 0) {
+            bdrv_dec_in_flight(bs);
+            ret = -ENOTSUP;
+            break;
+        }
+        d.offset = host_offset;
+        ret = thread_pool_submit_co(aio_get_thread_pool(exp->ctx),
+                                    nbd_sendfile_worker, &d);
+        bdrv_dec_in_flight(bs);
+
+        done += d.done;
+        if (ret != -EAGAIN) {
+            break;
+        }
+        qio_channel_yield(client->ioc, G_IO_OUT);
+    }
+
+    if (ret == -ENOTSUP || ret == -EINVAL || ret == -ENOSYS) {
+        /* The header is already out, so bounce whatever sendfile() could
+         * not move */
+        ret = blk_pread(exp->blk, offset + exp->dev_offset + done,
+                        data + done, size - done);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "reading from file failed");
+        } else if (qio_channel_write_all(client->ioc, (char *)data + done,
+                                         size - done, errp) < 0) {
+            ret = -EIO;
+        }
+    } else if (ret < 0) {
+        error_setg_errno(errp, -ret, "sendfile failed");
+    }
+    ret = ret < 0 ? -EIO : 1;
+
+out:
+    qio_channel_set_cork(client->ioc, false);
+    client->send_coroutine = NULL;
+    qemu_co_mutex_unlock(&client->send_lock);
+    return ret;
+}
+#else
+static int coroutine_fn nbd_co_send_read_zero_copy(NBDClient *client,
+                                                   uint64_t handle,
+                                                   uint64_t offset,
+                                                   uint8_t *data,
+                                                   size_t size,
+                                                   bool final,
+                                                   Error **errp)
+{
+    return 0;
+}
+#endif
+
 /* Do a sparse read and send the structured reply to the client.
  * Returns -errno if sending fails. bdrv_block_status_above() failure is
  * reported to the client, at which point this function succeeds.
@@ -1825,15 +2006,21 @@ static int coroutine_fn nbd_co_send_sparse_read(NBDClient *client,
             stl_be_p(&chunk.length, pnum);
             ret = nbd_co_send_iov(client, iov, 1, errp);
         } else {
-            ret = blk_pread(exp->blk, offset + progress + exp->dev_offset,
-                            data + progress, pnum);
-            if (ret < 0) {
-                error_setg_errno(errp, -ret, "reading from file failed");
-                break;
+            ret = nbd_co_send_read_zero_copy(client, handle, offset + progress,
+                                             data + progress, pnum, final,
+                                             errp);
+            if (ret == 0) {
+                ret = blk_pread(exp->blk, offset + progress + exp->dev_offset,
+                                data + progress, pnum);
+                if (ret < 0) {
+                    error_setg_errno(errp, -ret, "reading from file failed");
+                    break;
+                }
+                ret = nbd_co_send_structured_read(client, handle,
+                                                  offset + progress,
+                                                  data + progress, pnum, final,
+                                                  errp);
             }
-            ret = nbd_co_send_structured_read(client, handle, offset + progress,
-                                              data + progress, pnum, final,
-                                              errp);
         }
 
         if (ret < 0) {
@@ -2140,6 +2327,15 @@ static coroutine_fn int nbd_do_cmd_read(NBDClient *client, NBDRequest *request,
                                        data, request->len, errp);
     }
 
+    if (request->type == NBD_CMD_READ && request->len) {
+        ret = nbd_co_send_read_zero_copy(client, request->handle,
+                                         request->from, data, request->len,
+                                         true, errp);
+        if (ret) {
+            return ret < 0 ? ret : 0;
+        }
+    }
+
     ret = blk_pread(exp->blk, request->from + exp->dev_offset, data,
                     request->len);
     if (ret < 0 || request->type == NBD_CMD_CACHE) {
@@ -2439,6 +2635,10 @@ void nbd_export_bitmap(NBDExport *exp, const char *bitmap,
         return;
     }
 
+    if (bdrv_dirty_bitmap_load_all(bm, errp) < 0) {
+        return;
+    }
+
     bdrv_dirty_bitmap_set_qmp_locked(bm, true);
     exp->export_bitmap = bm;
     exp->export_bitmap_context =
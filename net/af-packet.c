@@ -0,0 +1,406 @@
+/*
+ * AF_PACKET network backend with memory-mapped TPACKET_V3 rings
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include <sys/mman.h>
+#include <net/if.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+
+#include "net/net.h"
+#include "clients.h"
+#include "qapi/error.h"
+#include "qemu/atomic.h"
+#include "qemu/iov.h"
+#include "qemu/main-loop.h"
+
+/*
+ * The kernel hands a receive block to userspace once it is full or once
+ * it has been open for AF_PACKET_RETIRE_TOV_MS, so one wakeup usually
+ * delivers many packets.  Transmit frames are fixed-size slots.
+ */
+#define AF_PACKET_FRAME_SIZE            2048
+#define AF_PACKET_DEFAULT_BLOCK_SIZE    (1 << 16)
+#define AF_PACKET_DEFAULT_BLOCK_COUNT   64
+#define AF_PACKET_DEFAULT_TX_FRAMES     256
+#define AF_PACKET_RETIRE_TOV_MS         1
+
+/* Bound the work done per wakeup so the main loop is not hogged */
+#define AF_PACKET_RX_BUDGET             256
+
+/* Offset of the packet data within a transmit frame */
+#define AF_PACKET_TX_DATA_OFFSET \
+    (TPACKET3_HDRLEN - sizeof(struct sockaddr_ll))
+#define AF_PACKET_TX_MAX_LEN \
+    (AF_PACKET_FRAME_SIZE - AF_PACKET_TX_DATA_OFFSET)
+
+typedef struct AfPacketState {
+    NetClientState nc;
+    int fd;
+    uint8_t *ring;
+    size_t ring_size;
+
+    /* Receive ring: block_count blocks of block_size bytes */
+    uint32_t block_size;
+    uint32_t block_count;
+    uint32_t rx_block;
+    uint32_t rx_pkts_left;
+    struct tpacket3_hdr *rx_pkt;    /* next packet, NULL if no block open */
+
+    /* Transmit ring, mapped right after the receive ring */
+    uint8_t *tx_ring;
+    uint32_t tx_frame_count;
+    uint32_t tx_frame;
+    QEMUBH *tx_bh;
+
+    bool read_poll;
+    bool write_poll;
+} AfPacketState;
+
+static void af_packet_send(void *opaque);
+static void af_packet_writable(void *opaque);
+
+static void af_packet_update_fd_handler(AfPacketState *s)
+{
+    qemu_set_fd_handler(s->fd,
+                        s->read_poll ? af_packet_send : NULL,
+                        s->write_poll ? af_packet_writable : NULL,
+                        s);
+}
+
+static void af_packet_read_poll(AfPacketState *s, bool enable)
+{
+    if (s->read_poll != enable) {
+        s->read_poll = enable;
+        af_packet_update_fd_handler(s);
+    }
+}
+
+static void af_packet_write_poll(AfPacketState *s, bool enable)
+{
+    if (s->write_poll != enable) {
+        s->write_poll = enable;
+        af_packet_update_fd_handler(s);
+    }
+}
+
+static void af_packet_poll(NetClientState *nc, bool enable)
+{
+    AfPacketState *s = DO_UPCAST(AfPacketState, nc, nc);
+
+    af_packet_write_poll(s, enable);
+    af_packet_read_poll(s, enable);
+}
+
+static void af_packet_writable(void *opaque)
+{
+    AfPacketState *s = opaque;
+
+    af_packet_write_poll(s, false);
+    qemu_flush_queued_packets(&s->nc);
+}
+
+/*
+ * Ask the kernel to transmit every frame marked TP_STATUS_SEND_REQUEST.
+ * This runs from a bottom half, so all packets the peer hands over in
+ * one flush of its queue leave with a single system call.  A failed kick
+ * leaves the frames marked; they go out with the next one.
+ */
+static void af_packet_tx_kick(void *opaque)
+{
+    AfPacketState *s = opaque;
+
+    send(s->fd, NULL, 0, MSG_DONTWAIT);
+}
+
+static struct tpacket3_hdr *af_packet_tx_frame(AfPacketState *s)
+{
+    return (struct tpacket3_hdr *)(s->tx_ring +
+                                   (size_t)s->tx_frame * AF_PACKET_FRAME_SIZE);
+}
+
+static bool af_packet_tx_frame_free(struct tpacket3_hdr *frame)
+{
+    uint32_t status = atomic_load_acquire(&frame->tp_status);
+
+    /* A frame the kernel refused to send can be reused as well */
+    return status == TP_STATUS_AVAILABLE || (status & TP_STATUS_WRONG_FORMAT);
+}
+
+static ssize_t af_packet_receive_iov(NetClientState *nc,
+                                     const struct iovec *iov, int iovcnt)
+{
+    AfPacketState *s = DO_UPCAST(AfPacketState, nc, nc);
+    size_t size = iov_size(iov, iovcnt);
+    struct tpacket3_hdr *frame;
+
+    if (size > AF_PACKET_TX_MAX_LEN) {
+        /* Drop. */
+        return size;
+    }
+
+    frame = af_packet_tx_frame(s);
+    if (!af_packet_tx_frame_free(frame)) {
+        /* Push out what is pending before waiting for a free frame */
+        af_packet_tx_kick(s);
+        if (!af_packet_tx_frame_free(frame)) {
+            af_packet_write_poll(s, true);
+            return 0;
+        }
+    }
+
+    iov_to_buf(iov, iovcnt, 0,
+               (uint8_t *)frame + AF_PACKET_TX_DATA_OFFSET, size);
+    frame->tp_len = size;
+    frame->tp_snaplen = size;
+    frame->tp_next_offset = 0;
+    atomic_store_release(&frame->tp_status, TP_STATUS_SEND_REQUEST);
+    s->tx_frame = (s->tx_frame + 1) % s->tx_frame_count;
+
+    qemu_bh_schedule(s->tx_bh);
+    return size;
+}
+
+static ssize_t af_packet_receive(NetClientState *nc,
+                                 const uint8_t *buf, size_t size)
+{
+    struct iovec iov = {
+        .iov_base = (void *)buf,
+        .iov_len = size,
+    };
+
+    return af_packet_receive_iov(nc, &iov, 1);
+}
+
+static void af_packet_send_completed(NetClientState *nc, ssize_t len)
+{
+    AfPacketState *s = DO_UPCAST(AfPacketState, nc, nc);
+
+    af_packet_read_poll(s, true);
+}
+
+static struct tpacket_block_desc *af_packet_rx_block(AfPacketState *s)
+{
+    return (struct tpacket_block_desc *)(s->ring +
+                                         (size_t)s->rx_block * s->block_size);
+}
+
+/*
+ * Deliver the packets of every block the kernel has retired to us.  A
+ * block goes back to the kernel only once all of its packets have been
+ * handed to the peer; if the peer stops accepting packets we remember
+ * the position and resume from af_packet_send_completed().
+ */
+static void af_packet_send(void *opaque)
+{
+    AfPacketState *s = opaque;
+    unsigned int budget = AF_PACKET_RX_BUDGET;
+
+    while (budget) {
+        struct tpacket_block_desc *bd = af_packet_rx_block(s);
+        struct tpacket3_hdr *pkt;
+        struct sockaddr_ll *sll;
+        ssize_t size;
+
+        if (!s->rx_pkt) {
+            if (!(atomic_load_acquire(&bd->hdr.bh1.block_status) &
+                  TP_STATUS_USER)) {
+                break;
+            }
+            s->rx_pkts_left = bd->hdr.bh1.num_pkts;
+            s->rx_pkt = (struct tpacket3_hdr *)((uint8_t *)bd +
+                                    bd->hdr.bh1.offset_to_first_pkt);
+        }
+
+        if (!s->rx_pkts_left) {
+            s->rx_pkt = NULL;
+            atomic_store_release(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL);
+            s->rx_block = (s->rx_block + 1) % s->block_count;
+            continue;
+        }
+
+        pkt = s->rx_pkt;
+        s->rx_pkt = (struct tpacket3_hdr *)((uint8_t *)pkt +
+                                            pkt->tp_next_offset);
+        s->rx_pkts_left--;
+        budget--;
+
+        /* Frames the host itself transmits are not meant for the guest */
+        sll = (struct sockaddr_ll *)((uint8_t *)pkt +
+                                     TPACKET_ALIGN(sizeof(*pkt)));
+        if (sll->sll_pkttype == PACKET_OUTGOING) {
+            continue;
+        }
+
+        size = qemu_send_packet_async(&s->nc, (uint8_t *)pkt + pkt->tp_mac,
+                                      pkt->tp_snaplen,
+                                      af_packet_send_completed);
+        if (size == 0) {
+            /* The packet was queued, stop reading until the peer drains */
+            af_packet_read_poll(s, false);
+            break;
+        }
+    }
+}
+
+static void af_packet_cleanup(NetClientState *nc)
+{
+    AfPacketState *s = DO_UPCAST(AfPacketState, nc, nc);
+
+    qemu_purge_queued_packets(nc);
+    af_packet_poll(nc, false);
+    qemu_bh_delete(s->tx_bh);
+    munmap(s->ring, s->ring_size);
+    close(s->fd);
+}
+
+static NetClientInfo net_af_packet_info = {
+    .type = NET_CLIENT_DRIVER_AF_PACKET,
+    .size = sizeof(AfPacketState),
+    .receive = af_packet_receive,
+    .receive_iov = af_packet_receive_iov,
+    .poll = af_packet_poll,
+    .cleanup = af_packet_cleanup,
+};
+
+int net_init_af_packet(const Netdev *netdev, const char *name,
+                       NetClientState *peer, Error **errp)
+{
+    const NetdevAfPacketOptions *opts;
+    uint32_t block_size = AF_PACKET_DEFAULT_BLOCK_SIZE;
+    uint32_t block_count = AF_PACKET_DEFAULT_BLOCK_COUNT;
+    uint32_t tx_frames = AF_PACKET_DEFAULT_TX_FRAMES;
+    uint32_t frames_per_block;
+    struct tpacket_req3 req;
+    struct packet_mreq mreq;
+    struct sockaddr_ll sll;
+    size_t rx_size, tx_size;
+    unsigned int ifindex;
+    NetClientState *nc;
+    AfPacketState *s;
+    uint8_t *ring;
+    int fd, version;
+
+    assert(netdev->type == NET_CLIENT_DRIVER_AF_PACKET);
+    opts = &netdev->u.af_packet;
+
+    if (opts->has_block_size) {
+        block_size = opts->block_size;
+    }
+    if (opts->has_block_count) {
+        block_count = opts->block_count;
+    }
+    if (opts->has_tx_frames) {
+        tx_frames = opts->tx_frames;
+    }
+    if (block_size < AF_PACKET_FRAME_SIZE ||
+        block_size % qemu_real_host_page_size) {
+        error_setg(errp, "block-size must be a multiple of the host page "
+                   "size and at least %d bytes", AF_PACKET_FRAME_SIZE);
+        return -1;
+    }
+    if (!block_count || !tx_frames) {
+        error_setg(errp, "block-count and tx-frames must be at least 1");
+        return -1;
+    }
+
+    ifindex = if_nametoindex(opts->ifname);
+    if (!ifindex) {
+        error_setg_errno(errp, errno, "Unknown interface '%s'",
+                         opts->ifname);
+        return -1;
+    }
+
+    fd = socket(AF_PACKET, SOCK_RAW, htons(ETH_P_ALL));
+    if (fd < 0) {
+        error_setg_errno(errp, errno, "Failed to create AF_PACKET socket");
+        return -1;
+    }
+
+    version = TPACKET_V3;
+    if (setsockopt(fd, SOL_PACKET, PACKET_VERSION,
+                   &version, sizeof(version)) < 0) {
+        error_setg_errno(errp, errno, "TPACKET_V3 is not supported");
+        goto fail;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = block_size;
+    req.tp_block_nr = block_count;
+    req.tp_frame_size = AF_PACKET_FRAME_SIZE;
+    req.tp_frame_nr = block_size / AF_PACKET_FRAME_SIZE * block_count;
+    req.tp_retire_blk_tov = AF_PACKET_RETIRE_TOV_MS;
+    if (setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+        error_setg_errno(errp, errno, "Failed to set up the receive ring");
+        goto fail;
+    }
+    rx_size = (size_t)block_size * block_count;
+
+    /* The transmit ring is made of page sized blocks of whole frames */
+    frames_per_block = qemu_real_host_page_size / AF_PACKET_FRAME_SIZE;
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = qemu_real_host_page_size;
+    req.tp_block_nr = DIV_ROUND_UP(tx_frames, frames_per_block);
+    req.tp_frame_size = AF_PACKET_FRAME_SIZE;
+    req.tp_frame_nr = req.tp_block_nr * frames_per_block;
+    if (setsockopt(fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) < 0) {
+        error_setg_errno(errp, errno, "Failed to set up the transmit ring");
+        goto fail;
+    }
+    tx_size = (size_t)req.tp_block_nr * qemu_real_host_page_size;
+
+    ring = mmap(NULL, rx_size + tx_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                fd, 0);
+    if (ring == MAP_FAILED) {
+        error_setg_errno(errp, errno, "Failed to map the packet rings");
+        goto fail;
+    }
+
+    /* Bind only once the rings exist, so no packet is lost on the way */
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_ALL);
+    sll.sll_ifindex = ifindex;
+    if (bind(fd, (struct sockaddr *)&sll, sizeof(sll)) < 0) {
+        error_setg_errno(errp, errno, "Failed to bind to '%s'",
+                         opts->ifname);
+        goto fail_unmap;
+    }
+
+    memset(&mreq, 0, sizeof(mreq));
+    mreq.mr_ifindex = ifindex;
+    mreq.mr_type = PACKET_MR_PROMISC;
+    if (setsockopt(fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP,
+                   &mreq, sizeof(mreq)) < 0) {
+        error_setg_errno(errp, errno, "Failed to put '%s' in promiscuous "
+                         "mode", opts->ifname);
+        goto fail_unmap;
+    }
+
+    nc = qemu_new_net_client(&net_af_packet_info, peer, "af-packet", name);
+    s = DO_UPCAST(AfPacketState, nc, nc);
+    s->fd = fd;
+    s->ring = ring;
+    s->ring_size = rx_size + tx_size;
+    s->block_size = block_size;
+    s->block_count = block_count;
+    s->tx_ring = ring + rx_size;
+    s->tx_frame_count = req.tp_frame_nr;
+    s->tx_bh = qemu_bh_new(af_packet_tx_kick, s);
+
+    snprintf(nc->info_str, sizeof(nc->info_str), "af-packet: ifname=%s",
+             opts->ifname);
+
+    af_packet_read_poll(s, true);
+    return 0;
+
+fail_unmap:
+    munmap(ring, rx_size + tx_size);
+fail:
+    close(fd);
+    return -1;
+}
@@ -20,24 +20,56 @@
 #include "net/checksum.h"
 #include "net/eth.h"
 
+/*
+ * The one's complement sum does not depend on byte order (RFC 1071):
+ * summing host-endian words and swapping the folded result gives the
+ * same value as summing big-endian words.  So load 64 bits at a time
+ * and add their 32-bit halves into a 64-bit accumulator, which cannot
+ * overflow for any length that fits in an int.
+ *
+ * The result is folded to 16 bits; callers only ever add such partial
+ * sums together and pass them through net_checksum_finish().
+ */
 uint32_t net_checksum_add_cont(int len, uint8_t *buf, int seq)
 {
-    uint32_t sum1 = 0, sum2 = 0;
-    int i;
-
-    for (i = 0; i < len - 1; i += 2) {
-        sum1 += (uint32_t)buf[i];
-        sum2 += (uint32_t)buf[i + 1];
+    uint64_t sum = 0;
+    uint64_t w;
+    uint8_t tail[2];
+
+    while (len >= 8) {
+        w = ldq_he_p(buf);
+        sum += (uint32_t)w;
+        sum += w >> 32;
+        buf += 8;
+        len -= 8;
     }
-    if (i < len) {
-        sum1 += (uint32_t)buf[i];
+    if (len >= 4) {
+        sum += ldl_he_p(buf);
+        buf += 4;
+        len -= 4;
+    }
+    if (len >= 2) {
+        sum += lduw_he_p(buf);
+        buf += 2;
+        len -= 2;
+    }
+    if (len) {
+        /* a trailing odd byte is the first byte of a zero-padded word */
+        tail[0] = buf[0];
+        tail[1] = 0;
+        sum += lduw_he_p(tail);
+    }
+
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
     }
+    sum = be16_to_cpu(sum);
 
+    /* data starting at an odd offset has its bytes in swapped lanes */
     if (seq & 1) {
-        return sum1 + (sum2 << 8);
-    } else {
-        return sum2 + (sum1 << 8);
+        sum = bswap16(sum);
     }
+    return sum;
 }
 
 uint16_t net_checksum_finish(uint32_t sum)
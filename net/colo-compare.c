@@ -103,13 +103,30 @@ static int compare_chr_send(CompareState *s,
                             uint32_t size,
                             uint32_t vnet_hdr_len);
 
-static gint seq_sorter(Packet *a, Packet *b, gpointer data)
+static inline bool after(uint32_t seq1, uint32_t seq2)
+{
+        return (int32_t)(seq1 - seq2) > 0;
+}
+
+/*
+ * Keep the queue sorted by sequence number.  Segments nearly always
+ * arrive in order, so search from the tail: the common case costs O(1)
+ * instead of a walk over the whole queue, and packets carrying the same
+ * sequence number (e.g. pure ACKs) stay in arrival order.
+ */
+static void colo_insert_sorted(GQueue *queue, Packet *pkt)
 {
-    struct tcphdr *atcp, *btcp;
+    GList *l;
+
+    for (l = queue->tail; l; l = l->prev) {
+        Packet *q = l->data;
 
-    atcp = (struct tcphdr *)(a->transport_header);
-    btcp = (struct tcphdr *)(b->transport_header);
-    return ntohl(atcp->th_seq) - ntohl(btcp->th_seq);
+        if (!after(q->tcp_seq, pkt->tcp_seq)) {
+            g_queue_insert_after(queue, l, pkt);
+            return;
+        }
+    }
+    g_queue_push_head(queue, pkt);
 }
 
 static void fill_pkt_tcp_info(void *data, uint32_t *max_ack)
@@ -138,10 +155,7 @@ static int colo_insert_packet(GQueue *queue, Packet *pkt, uint32_t *max_ack)
     if (g_queue_get_length(queue) <= MAX_QUEUE_SIZE) {
         if (pkt->ip->ip_p == IPPROTO_TCP) {
             fill_pkt_tcp_info(pkt, max_ack);
-            g_queue_insert_sorted(queue,
-                                  pkt,
-                                  (GCompareDataFunc)seq_sorter,
-                                  NULL);
+            colo_insert_sorted(queue, pkt);
         } else {
             g_queue_push_tail(queue, pkt);
         }
@@ -202,11 +216,6 @@ static int packet_enqueue(CompareState *s, int mode, Connection **con)
     return 0;
 }
 
-static inline bool after(uint32_t seq1, uint32_t seq2)
-{
-        return (int32_t)(seq1 - seq2) > 0;
-}
-
 static void colo_release_primary_pkt(CompareState *s, Packet *pkt)
 {
     int ret;
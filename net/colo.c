@@ -158,10 +158,19 @@ void connection_destroy(void *opaque)
 }
 
 Packet *packet_new(const void *data, int size, int vnet_hdr_len)
+{
+    return packet_new_nocopy(g_memdup(data, size), size, vnet_hdr_len);
+}
+
+/*
+ * Like packet_new(), but takes ownership of @data, which must have been
+ * allocated with g_malloc(); it is released by packet_destroy().
+ */
+Packet *packet_new_nocopy(void *data, int size, int vnet_hdr_len)
 {
     Packet *pkt = g_slice_new(Packet);
 
-    pkt->data = g_memdup(data, size);
+    pkt->data = data;
     pkt->size = size;
     pkt->creation_ms = qemu_clock_get_ms(QEMU_CLOCK_HOST);
     pkt->vnet_hdr_len = vnet_hdr_len;
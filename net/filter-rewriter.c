@@ -157,7 +157,7 @@ static ssize_t colo_rewriter_receive_iov(NetFilterState *nf,
     Packet *pkt;
     ssize_t size = iov_size(iov, iovcnt);
     ssize_t vnet_hdr_len = 0;
-    char *buf = g_malloc0(size);
+    char *buf = g_malloc(size);
 
     iov_to_buf(iov, iovcnt, 0, buf, size);
 
@@ -165,8 +165,8 @@ static ssize_t colo_rewriter_receive_iov(NetFilterState *nf,
         vnet_hdr_len = nf->netdev->vnet_hdr_len;
     }
 
-    pkt = packet_new(buf, size, vnet_hdr_len);
-    g_free(buf);
+    /* The linearized copy is handed over, no need to duplicate it again */
+    pkt = packet_new_nocopy(buf, size, vnet_hdr_len);
 
     /*
      * if we get tcp packet
@@ -49,6 +49,7 @@
 #include "qapi/opts-visitor.h"
 #include "sysemu/sysemu.h"
 #include "sysemu/qtest.h"
+#include "sysemu/stats.h"
 #include "net/filter.h"
 #include "qapi/string-output-visitor.h"
 
@@ -730,6 +731,11 @@ ssize_t qemu_deliver_packet_iov(NetClientState *sender,
 
     if (ret == 0) {
         nc->receive_disabled = 1;
+    } else if (ret > 0) {
+        stat64_add(&nc->rx_packets, 1);
+        stat64_add(&nc->rx_bytes, ret);
+        stat64_add(&sender->tx_packets, 1);
+        stat64_add(&sender->tx_bytes, ret);
     }
 
     return ret;
@@ -956,6 +962,12 @@ static int (* const net_client_init_fun[NET_CLIENT_DRIVER__MAX])(
 #ifdef CONFIG_L2TPV3
         [NET_CLIENT_DRIVER_L2TPV3]    = net_init_l2tpv3,
 #endif
+#ifdef CONFIG_AF_PACKET
+        [NET_CLIENT_DRIVER_AF_PACKET] = net_init_af_packet,
+#endif
+#ifdef CONFIG_AF_XDP
+        [NET_CLIENT_DRIVER_AF_XDP]    = net_init_af_xdp,
+#endif
 };
 
 
@@ -1075,6 +1087,12 @@ static void show_netdevs(void)
 #ifdef CONFIG_NETMAP
         "netmap",
 #endif
+#ifdef CONFIG_AF_PACKET
+        "af-packet",
+#endif
+#ifdef CONFIG_AF_XDP
+        "af-xdp",
+#endif
 #ifdef CONFIG_POSIX
         "vhost-user",
 #endif
@@ -1376,6 +1394,24 @@ void qmp_set_link(const char *name, bool up, Error **errp)
     }
 }
 
+void net_collect_stats(StatsResultList ***tail)
+{
+    NetClientState *nc;
+
+    QTAILQ_FOREACH(nc, &net_clients, next) {
+        char *id = nc->queue_index ?
+                   g_strdup_printf("%s.%u", nc->name, nc->queue_index) :
+                   g_strdup(nc->name);
+        StatsResult *result = stats_result_add(tail, STATS_TARGET_NET, id);
+
+        stats_add(result, "rx-packets", stat64_get(&nc->rx_packets));
+        stats_add(result, "rx-bytes", stat64_get(&nc->rx_bytes));
+        stats_add(result, "tx-packets", stat64_get(&nc->tx_packets));
+        stats_add(result, "tx-bytes", stat64_get(&nc->tx_bytes));
+        g_free(id);
+    }
+}
+
 static void net_vm_change_state_handler(void *opaque, int running,
                                         RunState state)
 {
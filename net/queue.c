@@ -40,12 +40,21 @@
  * unbounded queueing.
  */
 
+/* Packets up to NET_PACKET_POOL_SIZE bytes, enough for an MTU sized frame
+ * with a virtio-net header, are recycled through a per-queue free list
+ * instead of going back to the allocator.  Up to NET_PACKET_POOL_MAX of
+ * them are kept around.
+ */
+#define NET_PACKET_POOL_SIZE 2048
+#define NET_PACKET_POOL_MAX  256
+
 struct NetPacket {
     QTAILQ_ENTRY(NetPacket) entry;
     NetClientState *sender;
     unsigned flags;
     int size;
     NetPacketSent *sent_cb;
+    bool pooled;
     uint8_t data[0];
 };
 
@@ -57,6 +66,9 @@ struct NetQueue {
 
     QTAILQ_HEAD(packets, NetPacket) packets;
 
+    QTAILQ_HEAD(, NetPacket) free_packets;
+    uint32_t nq_free;
+
     unsigned delivering : 1;
 };
 
@@ -72,6 +84,8 @@ NetQueue *qemu_new_net_queue(NetQueueDeliverFunc *deliver, void *opaque)
     queue->deliver = deliver;
 
     QTAILQ_INIT(&queue->packets);
+    QTAILQ_INIT(&queue->free_packets);
+    queue->nq_free = 0;
 
     queue->delivering = 0;
 
@@ -87,9 +101,47 @@ void qemu_del_net_queue(NetQueue *queue)
         g_free(packet);
     }
 
+    QTAILQ_FOREACH_SAFE(packet, &queue->free_packets, entry, next) {
+        QTAILQ_REMOVE(&queue->free_packets, packet, entry);
+        g_free(packet);
+    }
+
     g_free(queue);
 }
 
+static NetPacket *qemu_net_queue_alloc_packet(NetQueue *queue, size_t size)
+{
+    NetPacket *packet;
+
+    if (size > NET_PACKET_POOL_SIZE) {
+        packet = g_malloc(sizeof(NetPacket) + size);
+        packet->pooled = false;
+        return packet;
+    }
+
+    packet = QTAILQ_FIRST(&queue->free_packets);
+    if (packet) {
+        QTAILQ_REMOVE(&queue->free_packets, packet, entry);
+        queue->nq_free--;
+        return packet;
+    }
+
+    packet = g_malloc(sizeof(NetPacket) + NET_PACKET_POOL_SIZE);
+    packet->pooled = true;
+    return packet;
+}
+
+static void qemu_net_queue_free_packet(NetQueue *queue, NetPacket *packet)
+{
+    if (packet->pooled && queue->nq_free < NET_PACKET_POOL_MAX) {
+        QTAILQ_INSERT_HEAD(&queue->free_packets, packet, entry);
+        queue->nq_free++;
+        return;
+    }
+
+    g_free(packet);
+}
+
 static void qemu_net_queue_append(NetQueue *queue,
                                   NetClientState *sender,
                                   unsigned flags,
@@ -102,7 +154,7 @@ static void qemu_net_queue_append(NetQueue *queue,
     if (queue->nq_count >= queue->nq_maxlen && !sent_cb) {
         return; /* drop if queue full and no callback */
     }
-    packet = g_malloc(sizeof(NetPacket) + size);
+    packet = qemu_net_queue_alloc_packet(queue, size);
     packet->sender = sender;
     packet->flags = flags;
     packet->size = size;
@@ -131,7 +183,7 @@ void qemu_net_queue_append_iov(NetQueue *queue,
         max_len += iov[i].iov_len;
     }
 
-    packet = g_malloc(sizeof(NetPacket) + max_len);
+    packet = qemu_net_queue_alloc_packet(queue, max_len);
     packet->sender = sender;
     packet->sent_cb = sent_cb;
     packet->flags = flags;
@@ -243,7 +295,7 @@ void qemu_net_queue_purge(NetQueue *queue, NetClientState *from)
             if (packet->sent_cb) {
                 packet->sent_cb(packet->sender, 0);
             }
-            g_free(packet);
+            qemu_net_queue_free_packet(queue, packet);
         }
     }
 }
@@ -273,7 +325,7 @@ bool qemu_net_queue_flush(NetQueue *queue)
             packet->sent_cb(packet->sender, ret);
         }
 
-        g_free(packet);
+        qemu_net_queue_free_packet(queue, packet);
     }
     return true;
 }
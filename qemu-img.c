@@ -37,6 +37,9 @@
 #include "qemu/option.h"
 #include "qemu/error-report.h"
 #include "qemu/log.h"
+#include "qemu/host-utils.h"
+#include "qemu/timer.h"
+#include "qemu/units.h"
 #include "qom/object_interfaces.h"
 #include "sysemu/sysemu.h"
 #include "sysemu/block-backend.h"
@@ -66,6 +69,7 @@ enum {
     OPTION_SIZE = 264,
     OPTION_PREALLOCATION = 265,
     OPTION_SHRINK = 266,
+    OPTION_RANDOM = 267,
 };
 
 typedef enum OutputFormat {
@@ -174,7 +178,8 @@ static void QEMU_NORETURN help(void)
            "\n"
            "Parameters to convert subcommand:\n"
            "  '-m' specifies how many coroutines work in parallel during the convert\n"
-           "       process (defaults to 8)\n"
+           "       process (defaults to 8, or to the number of host CPUs for\n"
+           "       compressed targets)\n"
            "  '-W' allow to write to the target out of order rather than sequential\n"
            "\n"
            "Parameters to snapshot subcommand:\n"
@@ -1085,18 +1090,13 @@ done:
  */
 static int64_t find_nonzero(const uint8_t *buf, int64_t n)
 {
-    int64_t i;
-    int64_t end = QEMU_ALIGN_DOWN(n, BDRV_SECTOR_SIZE);
+    size_t i = buffer_find_nonzero_offset(buf, n);
 
-    for (i = 0; i < end; i += BDRV_SECTOR_SIZE) {
-        if (!buffer_is_zero(buf + i, BDRV_SECTOR_SIZE)) {
-            return i;
-        }
-    }
-    if (i < n && !buffer_is_zero(buf + i, n - end)) {
-        return i;
+    QEMU_BUILD_BUG_ON(BDRV_SECTOR_SIZE % BUFFER_ZERO_LINE_SIZE);
+    if (i == n) {
+        return -1;
     }
-    return -1;
+    return QEMU_ALIGN_DOWN(i, BDRV_SECTOR_SIZE);
 }
 
 /*
@@ -1561,7 +1561,7 @@ enum ImgConvertBlockStatus {
     BLK_BACKING_FILE,
 };
 
-#define MAX_COROUTINES 16
+#define MAX_COROUTINES 64
 
 typedef struct ImgConvertState {
     BlockBackend **src;
@@ -2025,6 +2025,8 @@ static int img_convert(int argc, char **argv)
     int64_t ret = -EINVAL;
     bool force_share = false;
     bool explict_min_sparse = false;
+    bool explicit_copy_range = false;
+    bool explicit_num_coroutines = false;
 
     ImgConvertState s = (ImgConvertState) {
         /* Need at least 4k of zeros for sparse detection */
@@ -2070,6 +2072,7 @@ static int img_convert(int argc, char **argv)
             break;
         case 'C':
             s.copy_range = true;
+            explicit_copy_range = true;
             break;
         case 'c':
             s.compressed = true;
@@ -2140,6 +2143,7 @@ static int img_convert(int argc, char **argv)
                              " coroutines is between 1 and %d", MAX_COROUTINES);
                 goto fail_getopt;
             }
+            explicit_num_coroutines = true;
             break;
         case 'W':
             s.wr_in_order = false;
@@ -2175,6 +2179,13 @@ static int img_convert(int argc, char **argv)
         goto fail_getopt;
     }
 
+    if (!explicit_copy_range) {
+        /* Offload by default; convert_co_do_copy() falls back to copying
+         * through a buffer as soon as either end turns out not to support
+         * it.  Without -S, allocated zeros are then copied like data. */
+        s.copy_range = !s.compressed && !explict_min_sparse;
+    }
+
     if (s.compressed && s.copy_range) {
         error_report("Cannot enable copy offloading when -c is used");
         goto fail_getopt;
@@ -2455,6 +2466,20 @@ static int img_convert(int argc, char **argv)
         s.unallocated_blocks_are_zero = bdi.unallocated_blocks_are_zero;
     }
 
+    if (s.compressed) {
+        /* The format driver compresses inside each write request, on its
+         * AioContext's thread pool.  Writing in order would let only one
+         * request compress at a time, so keep enough of them in flight to
+         * use every host CPU instead. */
+        s.copy_range = false;
+        s.wr_in_order = false;
+        if (!explicit_num_coroutines) {
+            s.num_coroutines = MAX(s.num_coroutines,
+                                   MIN(g_get_num_processors(),
+                                       MAX_COROUTINES));
+        }
+    }
+
     ret = convert_do_copy(&s);
 out:
     if (!ret) {
@@ -3955,10 +3980,27 @@ out_no_progress:
     return 0;
 }
 
-typedef struct BenchData {
+/*
+ * Latencies are kept in a histogram with BENCH_LAT_SUB buckets for each
+ * power of two, which is precise to about 6% whatever the request count.
+ */
+#define BENCH_LAT_SUB_BITS  4
+#define BENCH_LAT_SUB       (1 << BENCH_LAT_SUB_BITS)
+#define BENCH_LAT_BUCKETS   ((64 - BENCH_LAT_SUB_BITS + 1) * BENCH_LAT_SUB)
+
+typedef struct BenchData BenchData;
+
+typedef struct BenchReq {
+    BenchData *b;
+    int64_t start_ns;
+    int slot;
+} BenchReq;
+
+struct BenchData {
     BlockBackend *blk;
     uint64_t image_size;
     bool write;
+    bool random;
     int bufsize;
     int step;
     int nrreq;
@@ -3967,11 +4009,91 @@ typedef struct BenchData {
     bool drain_on_flush;
     uint8_t *buf;
     QEMUIOVector *qiov;
+    BenchReq *reqs;
+    int *free_slots;
+    int nr_free;
 
     int in_flight;
     bool in_flush;
     uint64_t offset;
-} BenchData;
+    uint64_t rand_state;
+
+    uint64_t lat_hist[BENCH_LAT_BUCKETS];
+    uint64_t lat_sum_ns;
+    uint64_t lat_max_ns;
+    uint64_t completed;
+};
+
+static int bench_lat_bucket(uint64_t ns)
+{
+    int shift;
+
+    if (ns < BENCH_LAT_SUB) {
+        return ns;
+    }
+    shift = 63 - clz64(ns) - BENCH_LAT_SUB_BITS;
+    return (shift + 1) * BENCH_LAT_SUB + ((ns >> shift) & (BENCH_LAT_SUB - 1));
+}
+
+/* Lowest latency that falls into bucket @i */
+static uint64_t bench_lat_bucket_start(int i)
+{
+    int shift = i / BENCH_LAT_SUB - 1;
+
+    if (shift < 0) {
+        return i;
+    }
+    return (uint64_t)(BENCH_LAT_SUB + i % BENCH_LAT_SUB) << shift;
+}
+
+static uint64_t bench_lat_percentile(BenchData *b, double pct)
+{
+    uint64_t target = b->completed * pct / 100, seen = 0;
+    int i;
+
+    for (i = 0; i < BENCH_LAT_BUCKETS; i++) {
+        seen += b->lat_hist[i];
+        if (seen > target) {
+            return MIN(bench_lat_bucket_start(i), b->lat_max_ns);
+        }
+    }
+    return b->lat_max_ns;
+}
+
+/* xorshift64*, seeded with a constant so that runs are repeatable */
+static uint64_t bench_next_offset(BenchData *b)
+{
+    uint64_t offset = b->offset;
+
+    if (b->random) {
+        b->rand_state ^= b->rand_state >> 12;
+        b->rand_state ^= b->rand_state << 25;
+        b->rand_state ^= b->rand_state >> 27;
+        offset = (b->rand_state * 0x2545f4914f6cdd1dULL >> 11)
+                 % (b->image_size / b->bufsize) * b->bufsize;
+    } else {
+        b->offset += b->step;
+        b->offset %= b->image_size;
+    }
+    return offset;
+}
+
+static void bench_cb(void *opaque, int ret);
+
+static void bench_req_cb(void *opaque, int ret)
+{
+    BenchReq *req = opaque;
+    BenchData *b = req->b;
+    uint64_t ns = get_clock() - req->start_ns;
+
+    b->lat_hist[bench_lat_bucket(ns)]++;
+    b->lat_sum_ns += ns;
+    b->lat_max_ns = MAX(b->lat_max_ns, ns);
+    b->completed++;
+    b->free_slots[b->nr_free++] = req->slot;
+
+    bench_cb(b, ret);
+}
 
 static void bench_undrained_flush_cb(void *opaque, int ret)
 {
@@ -4026,18 +4148,22 @@ static void bench_cb(void *opaque, int ret)
     }
 
     while (b->n > b->in_flight && b->in_flight < b->nrreq) {
-        int64_t offset = b->offset;
+        BenchReq *req = &b->reqs[b->free_slots[--b->nr_free]];
+        int64_t offset;
+
         /* blk_aio_* might look for completed I/Os and kick bench_cb
          * again, so make sure this operation is counted by in_flight
          * and b->offset is ready for the next submission.
          */
         b->in_flight++;
-        b->offset += b->step;
-        b->offset %= b->image_size;
+        offset = bench_next_offset(b);
+        req->start_ns = get_clock();
         if (b->write) {
-            acb = blk_aio_pwritev(b->blk, offset, b->qiov, 0, bench_cb, b);
+            acb = blk_aio_pwritev(b->blk, offset, &b->qiov[req->slot], 0,
+                                  bench_req_cb, req);
         } else {
-            acb = blk_aio_preadv(b->blk, offset, b->qiov, 0, bench_cb, b);
+            acb = blk_aio_preadv(b->blk, offset, &b->qiov[req->slot], 0,
+                                 bench_req_cb, req);
         }
         if (!acb) {
             error_report("Failed to issue request");
@@ -4069,7 +4195,9 @@ static int img_bench(int argc, char **argv)
     struct timeval t1, t2;
     int i;
     bool force_share = false;
+    bool random = false;
     size_t buf_size;
+    double secs;
 
     for (;;) {
         static const struct option long_options[] = {
@@ -4079,6 +4207,8 @@ static int img_bench(int argc, char **argv)
             {"pattern", required_argument, 0, OPTION_PATTERN},
             {"no-drain", no_argument, 0, OPTION_NO_DRAIN},
             {"force-share", no_argument, 0, 'U'},
+            {"object", required_argument, 0, OPTION_OBJECT},
+            {"random", no_argument, 0, OPTION_RANDOM},
             {0, 0, 0, 0}
         };
         c = getopt_long(argc, argv, ":hc:d:f:no:qs:S:t:wU", long_options, NULL);
@@ -4206,6 +4336,17 @@ static int img_bench(int argc, char **argv)
         case OPTION_IMAGE_OPTS:
             image_opts = true;
             break;
+        case OPTION_OBJECT: {
+            QemuOpts *opts;
+            opts = qemu_opts_parse_noisily(&qemu_object_opts,
+                                           optarg, true);
+            if (!opts) {
+                return 1;
+            }
+        }   break;
+        case OPTION_RANDOM:
+            random = true;
+            break;
         }
     }
 
@@ -4214,6 +4355,12 @@ static int img_bench(int argc, char **argv)
     }
     filename = argv[argc - 1];
 
+    if (qemu_opts_foreach(&qemu_object_opts,
+                          user_creatable_add_opts_foreach,
+                          NULL, NULL)) {
+        return 1;
+    }
+
     if (!is_write && flush_interval) {
         error_report("--flush-interval is only available in write tests");
         ret = -1;
@@ -4237,6 +4384,11 @@ static int img_bench(int argc, char **argv)
         ret = image_size;
         goto out;
     }
+    if (random && image_size < bufsize) {
+        error_report("Image is smaller than the buffer size");
+        ret = -1;
+        goto out;
+    }
 
     data = (BenchData) {
         .blk            = blk,
@@ -4247,13 +4399,22 @@ static int img_bench(int argc, char **argv)
         .n              = count,
         .offset         = offset,
         .write          = is_write,
+        .random         = random,
+        .rand_state     = 0x9e3779b97f4a7c15ULL,
         .flush_interval = flush_interval,
         .drain_on_flush = drain_on_flush,
     };
-    printf("Sending %d %s requests, %d bytes each, %d in parallel "
-           "(starting at offset %" PRId64 ", step size %d)\n",
-           data.n, data.write ? "write" : "read", data.bufsize, data.nrreq,
-           data.offset, data.step);
+    if (random) {
+        printf("Sending %d random %s requests, %d bytes each, "
+               "%d in parallel\n",
+               data.n, data.write ? "write" : "read", data.bufsize,
+               data.nrreq);
+    } else {
+        printf("Sending %d %s requests, %d bytes each, %d in parallel "
+               "(starting at offset %" PRId64 ", step size %d)\n",
+               data.n, data.write ? "write" : "read", data.bufsize,
+               data.nrreq, data.offset, data.step);
+    }
     if (flush_interval) {
         printf("Sending flush every %d requests\n", flush_interval);
     }
@@ -4265,11 +4426,16 @@ static int img_bench(int argc, char **argv)
     blk_register_buf(blk, data.buf, buf_size);
 
     data.qiov = g_new(QEMUIOVector, data.nrreq);
+    data.reqs = g_new(BenchReq, data.nrreq);
+    data.free_slots = g_new(int, data.nrreq);
     for (i = 0; i < data.nrreq; i++) {
         qemu_iovec_init(&data.qiov[i], 1);
         qemu_iovec_add(&data.qiov[i],
                        data.buf + i * data.bufsize, data.bufsize);
+        data.reqs[i] = (BenchReq) { .b = &data, .slot = i };
+        data.free_slots[i] = i;
     }
+    data.nr_free = data.nrreq;
 
     gettimeofday(&t1, NULL);
     bench_cb(&data, 0);
@@ -4279,15 +4445,35 @@ static int img_bench(int argc, char **argv)
     }
     gettimeofday(&t2, NULL);
 
-    printf("Run completed in %3.3f seconds.\n",
-           (t2.tv_sec - t1.tv_sec)
-           + ((double)(t2.tv_usec - t1.tv_usec) / 1000000));
+    secs = (t2.tv_sec - t1.tv_sec)
+           + ((double)(t2.tv_usec - t1.tv_usec) / 1000000);
+    printf("Run completed in %3.3f seconds.\n", secs);
+    if (data.completed && secs > 0) {
+        printf("%.0f IOPS, %.2f MiB/s\n", data.completed / secs,
+               data.completed * data.bufsize / secs / MiB);
+        printf("Latency (us): avg %.1f, p50 %.1f, p90 %.1f, p99 %.1f, "
+               "p99.9 %.1f, max %.1f\n",
+               (double)data.lat_sum_ns / data.completed / 1000,
+               bench_lat_percentile(&data, 50) / 1000.0,
+               bench_lat_percentile(&data, 90) / 1000.0,
+               bench_lat_percentile(&data, 99) / 1000.0,
+               bench_lat_percentile(&data, 99.9) / 1000.0,
+               data.lat_max_ns / 1000.0);
+    }
 
 out:
     if (data.buf) {
         blk_unregister_buf(blk, data.buf);
     }
     qemu_vfree(data.buf);
+    if (data.qiov) {
+        for (i = 0; i < data.nrreq; i++) {
+            qemu_iovec_destroy(&data.qiov[i]);
+        }
+    }
+    g_free(data.qiov);
+    g_free(data.reqs);
+    g_free(data.free_slots);
     blk_unref(blk);
 
     if (ret) {
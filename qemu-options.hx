@@ -128,9 +128,10 @@ Select CPU model (@code{-cpu help} for list and additional feature selection)
 ETEXI
 
 DEF("accel", HAS_ARG, QEMU_OPTION_accel,
-    "-accel [accel=]accelerator[,thread=single|multi]\n"
+    "-accel [accel=]accelerator[,thread=single|multi][,superblocks=on|off]\n"
     "                select accelerator (kvm, xen, hax, hvf, whpx or tcg; use 'help' for a list)\n"
-    "                thread=single|multi (enable multi-threaded TCG)\n", QEMU_ARCH_ALL)
+    "                thread=single|multi (enable multi-threaded TCG)\n"
+    "                superblocks=on|off (translate across direct jumps)\n", QEMU_ARCH_ALL)
 STEXI
 @item -accel @var{name}[,prop=@var{value}[,...]]
 @findex -accel
@@ -144,6 +145,11 @@ Controls number of TCG threads. When the TCG is multi-threaded there will be one
 thread per vCPU therefor taking advantage of additional host cores. The default
 is to enable multi-threading where both the back-end and front-ends support it and
 no incompatible TCG features have been enabled (e.g. icount/replay).
+@item superblocks=on|off
+Lets front ends that support it continue a translation block at the target of
+a direct unconditional jump, as long as the target is further along the same
+guest page.  This makes larger blocks with fewer block exits.  The default is
+off.  Currently only the RISC-V front end makes use of it.
 @end table
 ETEXI
 
@@ -766,6 +772,12 @@ The maximum size of the refcount block cache in bytes
 Clean unused entries in the L2 and refcount caches. The interval is in seconds.
 The default value is 0 and it disables this feature.
 
+@item cluster-pool-size
+Allocate host clusters for new data in batches of this many bytes, so that
+sequential writes to unallocated areas do not update the refcounts for every
+request. Unused clusters are freed when the image is closed, but may show up
+as leaks after a crash (default: 0, which disables the pool; at most 1 GB)
+
 @item pass-discard-request
 Whether discard requests to the qcow2 device should be forwarded to the data
 source (on/off; default: on if discard=unmap is specified, off otherwise)
@@ -807,7 +819,7 @@ DEF("drive", HAS_ARG, QEMU_OPTION_drive,
     "       [,cyls=c,heads=h,secs=s[,trans=t]][,snapshot=on|off]\n"
     "       [,cache=writethrough|writeback|none|directsync|unsafe][,format=f]\n"
     "       [,serial=s][,addr=A][,rerror=ignore|stop|report]\n"
-    "       [,werror=ignore|stop|report|enospc][,id=name][,aio=threads|native]\n"
+    "       [,werror=ignore|stop|report|enospc][,id=name][,aio=threads|native|io_uring]\n"
     "       [,readonly=on|off][,copy-on-read=on|off]\n"
     "       [,discard=ignore|unmap][,detect-zeroes=on|off|unmap]\n"
     "       [[,bps=b]|[[,bps_rd=r][,bps_wr=w]]]\n"
@@ -879,7 +891,7 @@ unsafe       │ on                off            on
 The default mode is @option{cache=writeback}.
 
 @item aio=@var{aio}
-@var{aio} is "threads", or "native" and selects between pthread based disk I/O and native Linux AIO.
+@var{aio} is "threads", "native" or "io_uring" and selects between pthread based disk I/O, native Linux AIO and Linux io_uring.
 @item format=@var{format}
 Specify which disk @var{format} will be used rather than detecting
 the format.  Can be used to specify format=raw to avoid interpreting
@@ -1998,6 +2010,18 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
     "                VALE port (created on the fly) called 'name' ('nmname' is name of the \n"
     "                netmap device, defaults to '/dev/netmap')\n"
 #endif
+#ifdef CONFIG_AF_PACKET
+    "-netdev af-packet,id=str,ifname=name[,block-size=n][,block-count=n][,tx-frames=n]\n"
+    "                attach to the existing host network interface 'name' through\n"
+    "                memory-mapped AF_PACKET receive and transmit rings\n"
+#endif
+#ifdef CONFIG_AF_XDP
+    "-netdev af-xdp,id=str,ifname=name[,mode=native|skb][,force-copy=on|off]\n"
+    "         [,queues=n][,start-queue=m]\n"
+    "                attach to the existing network interface 'name' with AF_XDP sockets\n"
+    "                bound to 'n' interface queues starting at 'm' (default: 1 queue\n"
+    "                starting at 0)\n"
+#endif
 #ifdef CONFIG_POSIX
     "-netdev vhost-user,id=str,chardev=dev[,vhostforce=on|off]\n"
     "                configure a vhost-user network, backed by a chardev 'dev'\n"
@@ -2018,6 +2042,12 @@ DEF("nic", HAS_ARG, QEMU_OPTION_nic,
 #ifdef CONFIG_NETMAP
     "netmap|"
 #endif
+#ifdef CONFIG_AF_PACKET
+    "af-packet|"
+#endif
+#ifdef CONFIG_AF_XDP
+    "af-xdp|"
+#endif
 #ifdef CONFIG_POSIX
     "vhost-user|"
 #endif
@@ -2441,6 +2471,42 @@ vde_switch -F -sock /tmp/myswitch
 qemu-system-i386 linux.img -nic vde,sock=/tmp/myswitch
 @end example
 
+@item -netdev af-packet,id=@var{id},ifname=@var{name}[,block-size=@var{n}][,block-count=@var{n}][,tx-frames=@var{n}]
+Attach to the existing host network interface @var{name} with an AF_PACKET
+socket. Packets are exchanged through TPACKET_V3 rings shared with the host
+kernel: the receive ring holds @option{block-count} blocks of
+@option{block-size} bytes (64 blocks of 64 KiB by default) and the transmit
+ring holds @option{tx-frames} frames (256 by default). The interface is put
+in promiscuous mode. This requires the CAP_NET_RAW capability and a host
+kernel that supports transmit rings in TPACKET_V3 mode (Linux 4.11 or later).
+
+Example:
+@example
+qemu-system-x86_64 linux.img -netdev af-packet,id=n1,ifname=eth1 \
+                             -device virtio-net-pci,netdev=n1
+@end example
+
+@item -netdev af-xdp,id=@var{id},ifname=@var{name}[,mode=native|skb][,force-copy=on|off][,queues=@var{n}][,start-queue=@var{m}]
+Attach to queues @var{m} to @var{m}+@var{n}-1 of the host network interface
+@var{name} with one AF_XDP socket per queue. An XDP program that redirects
+the traffic of these queues to the sockets is loaded on the interface, in
+native (driver) mode if possible and in generic @option{skb} mode otherwise;
+@option{mode} forces one of them. Packet buffers live in a memory region
+shared with the kernel; drivers with AF_XDP zero-copy support receive and
+transmit into it directly unless @option{force-copy=on} is given.
+
+Steer the guest's traffic to the selected queues, for example with ethtool
+flow rules, since packets arriving on other queues do not reach the guest.
+This requires the CAP_NET_ADMIN and CAP_NET_RAW capabilities (or
+CAP_SYS_ADMIN on older kernels).
+
+Example:
+@example
+ethtool -L eth1 combined 2
+qemu-system-x86_64 linux.img -netdev af-xdp,id=n1,ifname=eth1,queues=2 \
+                             -device virtio-net-pci,mq=on,vectors=6,netdev=n1
+@end example
+
 @item -netdev vhost-user,chardev=@var{id}[,vhostforce=on|off][,queues=n]
 
 Establish a vhost-user netdev, backed by a chardev @var{id}. The chardev should
@@ -2619,6 +2685,18 @@ to a file to record all data transmitted via the backend. The @option{logappend}
 option controls whether the log file will be truncated or appended to when
 opened.
 
+The file descriptor based backends (@option{file}, @option{pipe},
+@option{serial}, @option{tty}, @option{stdio}) and the @option{socket}
+backend also accept @option{outbuf-size=@var{size}} and
+@option{outbuf-flush-ms=@var{ms}}.  With a non-zero @option{outbuf-size},
+output is collected in a buffer of that size and written out in one go
+when the buffer fills up, or at the latest @option{outbuf-flush-ms}
+milliseconds (default 10) after the first byte was queued.  When the
+buffer is full and the consumer is not reading, front ends that support
+it (for example the SiFive UART) report their transmitter as busy to the
+guest instead of stalling the virtual CPU.  Output buffering cannot be
+used with chardevs that pass file descriptors, such as vhost-user.
+
 @end table
 
 The available backends are:
@@ -3302,6 +3380,32 @@ STEXI
 Run the emulation in single step mode.
 ETEXI
 
+DEF("perfmap", 0, QEMU_OPTION_perfmap, \
+    "-perfmap        describe generated code in /tmp/perf-<pid>.map\n",
+    QEMU_ARCH_ALL)
+STEXI
+@item -perfmap
+@findex -perfmap
+Write the host address range and guest PC of each translation block to
+@file{/tmp/perf-@var{pid}.map}, so that @code{perf top} and
+@code{perf report} show guest code instead of unknown addresses.
+Entries are never removed, so after the translation cache is flushed
+or reused samples may be attributed to older code; @option{-perf-jitdump}
+does not have this problem.
+ETEXI
+
+DEF("perf-jitdump", HAS_ARG, QEMU_OPTION_perf_jitdump, \
+    "-perf-jitdump dir\n"
+    "                write a perf jitdump file for generated code to dir\n",
+    QEMU_ARCH_ALL)
+STEXI
+@item -perf-jitdump @var{dir}
+@findex -perf-jitdump
+Describe each translation block in @file{@var{dir}/jit-@var{pid}.dump},
+in the jitdump format of @code{perf}.  Record with @code{perf record -k 1}
+and run @code{perf inject --jit} before @code{perf report}.
+ETEXI
+
 DEF("preconfig", 0, QEMU_OPTION_preconfig, \
     "--preconfig     pause QEMU before machine is initialized (experimental)\n",
     QEMU_ARCH_ALL)
@@ -3578,12 +3682,12 @@ re-inject them.
 ETEXI
 
 DEF("icount", HAS_ARG, QEMU_OPTION_icount, \
-    "-icount [shift=N|auto][,align=on|off][,sleep=on|off,rr=record|replay,rrfile=<filename>,rrsnapshot=<snapshot>]\n" \
+    "-icount [shift=N|auto][,align=on|off][,sleep=on|off,rr=record|replay,rrfile=<filename>,rrsnapshot=<snapshot>,rrperiod=<seconds>]\n" \
     "                enable virtual instruction counter with 2^N clock ticks per\n" \
     "                instruction, enable aligning the host and virtual clocks\n" \
     "                or disable real time cpu sleeping\n", QEMU_ARCH_ALL)
 STEXI
-@item -icount [shift=@var{N}|auto][,rr=record|replay,rrfile=@var{filename},rrsnapshot=@var{snapshot}]
+@item -icount [shift=@var{N}|auto][,rr=record|replay,rrfile=@var{filename},rrsnapshot=@var{snapshot},rrperiod=@var{seconds}]
 @findex -icount
 Enable virtual instruction counter.  The virtual cpu will execute one
 instruction every 2^@var{N} ns of virtual time.  If @code{auto} is specified
@@ -3620,6 +3724,11 @@ read from this file in replay mode.
 Option rrsnapshot is used to create new vm snapshot named @var{snapshot}
 at the start of execution recording. In replay mode this option is used
 to load the initial VM state.
+
+Option rrperiod makes the recording take another snapshot every
+@var{seconds} of virtual time, named @var{snapshot}-@var{icount} after the
+instruction count it was taken at.  In replay mode the @code{replay-seek}
+QMP command restores the closest of these snapshots and runs from there.
 ETEXI
 
 DEF("watchdog", HAS_ARG, QEMU_OPTION_watchdog, \
@@ -4002,7 +4111,7 @@ property must be set.  These objects are placed in the
 
 @table @option
 
-@item -object memory-backend-file,id=@var{id},size=@var{size},mem-path=@var{dir},share=@var{on|off},discard-data=@var{on|off},merge=@var{on|off},dump=@var{on|off},prealloc=@var{on|off},host-nodes=@var{host-nodes},policy=@var{default|preferred|bind|interleave},align=@var{align}
+@item -object memory-backend-file,id=@var{id},size=@var{size},mem-path=@var{dir},share=@var{on|off},readonly=@var{on|off},discard-data=@var{on|off},merge=@var{on|off},dump=@var{on|off},prealloc=@var{on|off},host-nodes=@var{host-nodes},policy=@var{default|preferred|bind|interleave},align=@var{align}
 
 Creates a memory file backend object, which can be used to back
 the guest RAM with huge pages.
@@ -4070,6 +4179,28 @@ requires an alignment different than the default one used by QEMU, eg
 the device DAX /dev/dax0.0 requires 2M alignment rather than 4K. In
 such cases, users can specify the required alignment via this option.
 
+Setting the @option{readonly} boolean option to @var{on} opens an existing
+@option{mem-path} file read-only and maps it copy-on-write.  It requires
+@option{share=off}.  The guest starts with the contents of the file, pages
+are read in only when they are first touched, and guest writes never reach
+the file.  Together with the @code{x-ignore-shared} migration capability
+this restores a saved guest in a time that does not depend on its RAM size:
+
+@example
+# save: guest RAM lives in ram.img, only device state goes to vmstate
+qemu -object memory-backend-file,id=ram,size=1G,mem-path=ram.img,share=on \
+     -numa node,memdev=ram ...
+(qemu) migrate_set_capability x-ignore-shared on
+(qemu) stop
+(qemu) migrate "exec:cat > vmstate"
+
+# restore, as many times as needed; ram.img is never modified
+qemu -object memory-backend-file,id=ram,size=1G,mem-path=ram.img,\
+readonly=on -numa node,memdev=ram -incoming defer ...
+(qemu) migrate_set_capability x-ignore-shared on
+(qemu) migrate_incoming "exec:cat vmstate"
+@end example
+
 @item -object memory-backend-ram,id=@var{id},merge=@var{on|off},dump=@var{on|off},share=@var{on|off},prealloc=@var{on|off},size=@var{size},host-nodes=@var{host-nodes},policy=@var{default|preferred|bind|interleave}
 
 Creates a memory backend object, which can be used to back the guest RAM.
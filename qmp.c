@@ -29,6 +29,7 @@
 #include "hw/qdev.h"
 #include "sysemu/blockdev.h"
 #include "sysemu/block-backend.h"
+#include "sysemu/stats.h"
 #include "qom/qom-qobject.h"
 #include "qapi/error.h"
 #include "qapi/qapi-commands-block-core.h"
@@ -737,3 +738,56 @@ MemoryInfo *qmp_query_memory_size_summary(Error **errp)
 
     return mem_info;
 }
+
+StatsResult *stats_result_add(StatsResultList ***tail, StatsTarget target,
+                              const char *id)
+{
+    StatsResultList *elem = g_new0(StatsResultList, 1);
+    StatsResult *result = g_new0(StatsResult, 1);
+
+    result->target = target;
+    result->has_id = id != NULL;
+    result->id = g_strdup(id);
+
+    elem->value = result;
+    **tail = elem;
+    *tail = &elem->next;
+    return result;
+}
+
+void stats_add(StatsResult *result, const char *name, uint64_t value)
+{
+    StatList **prev = &result->stats;
+    StatList *elem = g_new0(StatList, 1);
+
+    elem->value = g_new0(Stat, 1);
+    elem->value->name = g_strdup(name);
+    elem->value->value = value;
+
+    while (*prev) {
+        prev = &(*prev)->next;
+    }
+    *prev = elem;
+}
+
+static void (*const stats_collectors[StatsTarget__MAX])(StatsResultList ***) = {
+    [STATS_TARGET_VCPU] = vcpu_collect_stats,
+    [STATS_TARGET_TLB] = tlb_collect_stats,
+    [STATS_TARGET_TB_CACHE] = tb_cache_collect_stats,
+    [STATS_TARGET_BLOCK] = block_collect_stats,
+    [STATS_TARGET_NET] = net_collect_stats,
+};
+
+StatsResultList *qmp_query_stats(bool has_target, StatsTarget target,
+                                 Error **errp)
+{
+    StatsResultList *head = NULL, **tail = &head;
+    int i;
+
+    for (i = 0; i < StatsTarget__MAX; i++) {
+        if (!has_target || i == target) {
+            stats_collectors[i](&tail);
+        }
+    }
+    return head;
+}
@@ -363,13 +363,53 @@ static int json_lexer_feed_char(JSONLexer *lexer, char ch, bool flush)
     return 0;
 }
 
-int json_lexer_feed(JSONLexer *lexer, const char *buffer, size_t size)
+/*
+ * Return the length of the prefix of @buffer, at most @size bytes long,
+ * that leaves the lexer in its current state.  These are the bodies of
+ * strings, numbers, keywords and whitespace.
+ */
+static size_t json_lexer_scan_run(JSONLexer *lexer, const char *buffer,
+                                  size_t size)
 {
+    const uint8_t *state_table = json_lexer[lexer->state];
+    uint8_t state = lexer->state;
     size_t i;
 
+    for (i = 0; i < size; i++) {
+        if (state_table[(uint8_t)buffer[i]] != state) {
+            break;
+        }
+        lexer->x++;
+        if (buffer[i] == '\n') {
+            lexer->x = 0;
+            lexer->y++;
+        }
+    }
+    return i;
+}
+
+int json_lexer_feed(JSONLexer *lexer, const char *buffer, size_t size)
+{
+    size_t i, run;
+
     for (i = 0; i < size; i++) {
         int err;
 
+        /*
+         * Append runs of characters that do not change the state in one
+         * go.  The token may grow to MAX_TOKEN_SIZE this way, the next
+         * character then goes through json_lexer_feed_char() and its
+         * size check.
+         */
+        run = json_lexer_scan_run(lexer, buffer + i,
+                                  MIN(size - i,
+                                      MAX_TOKEN_SIZE - lexer->token->len));
+        g_string_append_len(lexer->token, buffer + i, run);
+        i += run;
+        if (i == size) {
+            break;
+        }
+
         err = json_lexer_feed_char(lexer, buffer[i], false);
         if (err < 0) {
             return err;
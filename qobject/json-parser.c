@@ -23,44 +23,44 @@
 #include "qapi/qmp/qstring.h"
 #include "qapi/qmp/json-parser.h"
 #include "qapi/qmp/json-lexer.h"
-#include "qapi/qmp/json-streamer.h"
 
-typedef struct JSONParserContext
-{
-    Error *err;
-    JSONToken *current;
-    GQueue *buf;
-} JSONParserContext;
+enum json_parser_state {
+    JSON_PARSER_VALUE,          /* expecting a value */
+    JSON_PARSER_VALUE_OR_END,   /* after '[' */
+    JSON_PARSER_KEY,            /* after ',' in an object */
+    JSON_PARSER_KEY_OR_END,     /* after '{' */
+    JSON_PARSER_COLON,          /* after a key */
+    JSON_PARSER_SEPARATOR,      /* after a member or element */
+    JSON_PARSER_DONE,
+    JSON_PARSER_ERROR,
+};
+
+typedef struct JSONParserEntry {
+    QObject *container;
+    /* Key of the member being parsed, if container is a QDict */
+    QString *key;
+} JSONParserEntry;
 
 #define BUG_ON(cond) assert(!(cond))
 
-/**
- * TODO
- *
- * 0) make errors meaningful again
- * 1) add geometry information to tokens
- * 3) should we return a parsed size?
- * 4) deal with premature EOI
- */
-
-static QObject *parse_value(JSONParserContext *ctxt, va_list *ap);
-
 /**
  * Error handler
  */
-static void GCC_FMT_ATTR(3, 4) parse_error(JSONParserContext *ctxt,
-                                           JSONToken *token, const char *msg, ...)
+static void GCC_FMT_ATTR(2, 3) parse_error(JSONParser *parser,
+                                           const char *msg, ...)
 {
     va_list ap;
     char message[1024];
+
+    parser->state = JSON_PARSER_ERROR;
+    if (parser->err) {
+        /* Report the first error, the rest are consequences of it */
+        return;
+    }
     va_start(ap, msg);
     vsnprintf(message, sizeof(message), msg, ap);
     va_end(ap);
-    if (ctxt->err) {
-        error_free(ctxt->err);
-        ctxt->err = NULL;
-    }
-    error_setg(&ctxt->err, "JSON parse error, %s", message);
+    error_setg(&parser->err, "JSON parse error, %s", message);
 }
 
 /**
@@ -125,386 +125,148 @@ static int hex2decimal(char ch)
  *      \n
  *      \r
  *      \t
- *      \u four-hex-digits 
- */
-static QString *qstring_from_escaped_str(JSONParserContext *ctxt,
-                                         JSONToken *token)
-{
-    const char *ptr = token->str;
-    QString *str;
-    int double_quote = 1;
-
-    if (*ptr == '"') {
-        double_quote = 1;
-    } else {
-        double_quote = 0;
-    }
-    ptr++;
-
-    str = qstring_new();
-    while (*ptr && 
-           ((double_quote && *ptr != '"') || (!double_quote && *ptr != '\''))) {
-        if (*ptr == '\\') {
-            ptr++;
-
-            switch (*ptr) {
-            case '"':
-                qstring_append(str, "\"");
-                ptr++;
-                break;
-            case '\'':
-                qstring_append(str, "'");
-                ptr++;
-                break;
-            case '\\':
-                qstring_append(str, "\\");
-                ptr++;
-                break;
-            case '/':
-                qstring_append(str, "/");
-                ptr++;
-                break;
-            case 'b':
-                qstring_append(str, "\b");
-                ptr++;
-                break;
-            case 'f':
-                qstring_append(str, "\f");
-                ptr++;
-                break;
-            case 'n':
-                qstring_append(str, "\n");
-                ptr++;
-                break;
-            case 'r':
-                qstring_append(str, "\r");
-                ptr++;
-                break;
-            case 't':
-                qstring_append(str, "\t");
-                ptr++;
-                break;
-            case 'u': {
-                uint16_t unicode_char = 0;
-                char utf8_char[4];
-                int i = 0;
-
-                ptr++;
-
-                for (i = 0; i < 4; i++) {
-                    if (qemu_isxdigit(*ptr)) {
-                        unicode_char |= hex2decimal(*ptr) << ((3 - i) * 4);
-                    } else {
-                        parse_error(ctxt, token,
-                                    "invalid hex escape sequence in string");
-                        goto out;
-                    }
-                    ptr++;
-                }
-
-                wchar_to_utf8(unicode_char, utf8_char, sizeof(utf8_char));
-                qstring_append(str, utf8_char);
-            }   break;
-            default:
-                parse_error(ctxt, token, "invalid escape sequence in string");
-                goto out;
-            }
-        } else {
-            char dummy[2];
-
-            dummy[0] = *ptr++;
-            dummy[1] = 0;
-
-            qstring_append(str, dummy);
-        }
-    }
-
-    return str;
-
-out:
-    qobject_unref(str);
-    return NULL;
-}
-
-/* Note: the token object returned by parser_context_peek_token or
- * parser_context_pop_token is deleted as soon as parser_context_pop_token
- * is called again.
- */
-static JSONToken *parser_context_pop_token(JSONParserContext *ctxt)
-{
-    g_free(ctxt->current);
-    assert(!g_queue_is_empty(ctxt->buf));
-    ctxt->current = g_queue_pop_head(ctxt->buf);
-    return ctxt->current;
-}
-
-static JSONToken *parser_context_peek_token(JSONParserContext *ctxt)
-{
-    assert(!g_queue_is_empty(ctxt->buf));
-    return g_queue_peek_head(ctxt->buf);
-}
-
-static JSONParserContext *parser_context_new(GQueue *tokens)
-{
-    JSONParserContext *ctxt;
-
-    if (!tokens) {
-        return NULL;
-    }
-
-    ctxt = g_malloc0(sizeof(JSONParserContext));
-    ctxt->buf = tokens;
-
-    return ctxt;
-}
-
-/* to support error propagation, ctxt->err must be freed separately */
-static void parser_context_free(JSONParserContext *ctxt)
-{
-    if (ctxt) {
-        while (!g_queue_is_empty(ctxt->buf)) {
-            parser_context_pop_token(ctxt);
-        }
-        g_free(ctxt->current);
-        g_queue_free(ctxt->buf);
-        g_free(ctxt);
-    }
-}
-
-/**
- * Parsing rules
+ *      \u four-hex-digits
+ *
+ * @str includes the quotes.  The lexer has checked the escape sequences,
+ * so the characters between them are copied in bulk.
  */
-static int parse_pair(JSONParserContext *ctxt, QDict *dict, va_list *ap)
-{
-    QObject *value;
-    QString *key = NULL;
-    JSONToken *peek, *token;
-
-    peek = parser_context_peek_token(ctxt);
-    if (peek == NULL) {
-        parse_error(ctxt, NULL, "premature EOI");
-        goto out;
-    }
-
-    key = qobject_to(QString, parse_value(ctxt, ap));
-    if (!key) {
-        parse_error(ctxt, peek, "key is not a string in object");
-        goto out;
-    }
-
-    token = parser_context_pop_token(ctxt);
-    if (token == NULL) {
-        parse_error(ctxt, NULL, "premature EOI");
-        goto out;
-    }
-
-    if (token->type != JSON_COLON) {
-        parse_error(ctxt, token, "missing : in object pair");
-        goto out;
-    }
-
-    value = parse_value(ctxt, ap);
-    if (value == NULL) {
-        parse_error(ctxt, token, "Missing value in dict");
-        goto out;
-    }
-
-    qdict_put_obj(dict, qstring_get_str(key), value);
-
-    qobject_unref(key);
-
-    return 0;
-
-out:
-    qobject_unref(key);
-
-    return -1;
-}
-
-static QObject *parse_object(JSONParserContext *ctxt, va_list *ap)
+static QString *qstring_from_escaped_str(JSONParser *parser,
+                                         const char *str, size_t len)
 {
-    QDict *dict = NULL;
-    JSONToken *token, *peek;
-
-    token = parser_context_pop_token(ctxt);
-    assert(token && token->type == JSON_LCURLY);
-
-    dict = qdict_new();
-
-    peek = parser_context_peek_token(ctxt);
-    if (peek == NULL) {
-        parse_error(ctxt, NULL, "premature EOI");
-        goto out;
+    const char *ptr = str + 1;
+    const char *end = str + len - 1;
+    const char *run;
+    char *buf, *out;
+    QString *qstr = NULL;
+
+    /* Most strings have no escapes */
+    if (!memchr(ptr, '\\', end - ptr)) {
+        return qstring_from_substr(str, 1, len - 1);
     }
 
-    if (peek->type != JSON_RCURLY) {
-        if (parse_pair(ctxt, dict, ap) == -1) {
-            goto out;
+    /* Unescaping never makes the string longer */
+    buf = out = g_malloc(len);
+    while (ptr < end) {
+        if (*ptr != '\\') {
+            run = memchr(ptr, '\\', end - ptr) ?: end;
+            memcpy(out, ptr, run - ptr);
+            out += run - ptr;
+            ptr = run;
+            continue;
         }
 
-        token = parser_context_pop_token(ctxt);
-        if (token == NULL) {
-            parse_error(ctxt, NULL, "premature EOI");
-            goto out;
-        }
-
-        while (token->type != JSON_RCURLY) {
-            if (token->type != JSON_COMMA) {
-                parse_error(ctxt, token, "expected separator in dict");
-                goto out;
-            }
-
-            if (parse_pair(ctxt, dict, ap) == -1) {
-                goto out;
-            }
-
-            token = parser_context_pop_token(ctxt);
-            if (token == NULL) {
-                parse_error(ctxt, NULL, "premature EOI");
-                goto out;
+        ptr++;
+        switch (ptr < end ? *ptr++ : 0) {
+        case '"':
+            *out++ = '"';
+            break;
+        case '\'':
+            *out++ = '\'';
+            break;
+        case '\\':
+            *out++ = '\\';
+            break;
+        case '/':
+            *out++ = '/';
+            break;
+        case 'b':
+            *out++ = '\b';
+            break;
+        case 'f':
+            *out++ = '\f';
+            break;
+        case 'n':
+            *out++ = '\n';
+            break;
+        case 'r':
+            *out++ = '\r';
+            break;
+        case 't':
+            *out++ = '\t';
+            break;
+        case 'u': {
+            uint16_t unicode_char = 0;
+            char utf8_char[4];
+            int i;
+
+            for (i = 0; i < 4; i++) {
+                if (ptr >= end || !qemu_isxdigit(*ptr)) {
+                    parse_error(parser,
+                                "invalid hex escape sequence in string");
+                    goto fail;
+                }
+                unicode_char |= hex2decimal(*ptr) << ((3 - i) * 4);
+                ptr++;
             }
-        }
-    } else {
-        (void)parser_context_pop_token(ctxt);
-    }
-
-    return QOBJECT(dict);
-
-out:
-    qobject_unref(dict);
-    return NULL;
-}
-
-static QObject *parse_array(JSONParserContext *ctxt, va_list *ap)
-{
-    QList *list = NULL;
-    JSONToken *token, *peek;
-
-    token = parser_context_pop_token(ctxt);
-    assert(token && token->type == JSON_LSQUARE);
-
-    list = qlist_new();
-
-    peek = parser_context_peek_token(ctxt);
-    if (peek == NULL) {
-        parse_error(ctxt, NULL, "premature EOI");
-        goto out;
-    }
 
-    if (peek->type != JSON_RSQUARE) {
-        QObject *obj;
-
-        obj = parse_value(ctxt, ap);
-        if (obj == NULL) {
-            parse_error(ctxt, token, "expecting value");
-            goto out;
-        }
-
-        qlist_append_obj(list, obj);
-
-        token = parser_context_pop_token(ctxt);
-        if (token == NULL) {
-            parse_error(ctxt, NULL, "premature EOI");
-            goto out;
+            wchar_to_utf8(unicode_char, utf8_char, sizeof(utf8_char));
+            i = strlen(utf8_char);
+            memcpy(out, utf8_char, i);
+            out += i;
+            break;
         }
-
-        while (token->type != JSON_RSQUARE) {
-            if (token->type != JSON_COMMA) {
-                parse_error(ctxt, token, "expected separator in list");
-                goto out;
-            }
-
-            obj = parse_value(ctxt, ap);
-            if (obj == NULL) {
-                parse_error(ctxt, token, "expecting value");
-                goto out;
-            }
-
-            qlist_append_obj(list, obj);
-
-            token = parser_context_pop_token(ctxt);
-            if (token == NULL) {
-                parse_error(ctxt, NULL, "premature EOI");
-                goto out;
-            }
+        default:
+            parse_error(parser, "invalid escape sequence in string");
+            goto fail;
         }
-    } else {
-        (void)parser_context_pop_token(ctxt);
     }
 
-    return QOBJECT(list);
-
-out:
-    qobject_unref(list);
-    return NULL;
+    qstr = qstring_from_substr(buf, 0, out - buf);
+fail:
+    g_free(buf);
+    return qstr;
 }
 
-static QObject *parse_keyword(JSONParserContext *ctxt)
+static QObject *parse_keyword(JSONParser *parser, const char *str)
 {
-    JSONToken *token;
-
-    token = parser_context_pop_token(ctxt);
-    assert(token && token->type == JSON_KEYWORD);
-
-    if (!strcmp(token->str, "true")) {
+    if (!strcmp(str, "true")) {
         return QOBJECT(qbool_from_bool(true));
-    } else if (!strcmp(token->str, "false")) {
+    } else if (!strcmp(str, "false")) {
         return QOBJECT(qbool_from_bool(false));
-    } else if (!strcmp(token->str, "null")) {
+    } else if (!strcmp(str, "null")) {
         return QOBJECT(qnull());
     }
-    parse_error(ctxt, token, "invalid keyword '%s'", token->str);
+    parse_error(parser, "invalid keyword '%s'", str);
     return NULL;
 }
 
-static QObject *parse_escape(JSONParserContext *ctxt, va_list *ap)
+static QObject *parse_escape(JSONParser *parser, const char *str)
 {
-    JSONToken *token;
+    va_list *ap = parser->ap;
 
     if (ap == NULL) {
         return NULL;
     }
 
-    token = parser_context_pop_token(ctxt);
-    assert(token && token->type == JSON_ESCAPE);
-
-    if (!strcmp(token->str, "%p")) {
+    if (!strcmp(str, "%p")) {
         return va_arg(*ap, QObject *);
-    } else if (!strcmp(token->str, "%i")) {
+    } else if (!strcmp(str, "%i")) {
         return QOBJECT(qbool_from_bool(va_arg(*ap, int)));
-    } else if (!strcmp(token->str, "%d")) {
+    } else if (!strcmp(str, "%d")) {
         return QOBJECT(qnum_from_int(va_arg(*ap, int)));
-    } else if (!strcmp(token->str, "%ld")) {
+    } else if (!strcmp(str, "%ld")) {
         return QOBJECT(qnum_from_int(va_arg(*ap, long)));
-    } else if (!strcmp(token->str, "%lld") ||
-               !strcmp(token->str, "%I64d")) {
+    } else if (!strcmp(str, "%lld") ||
+               !strcmp(str, "%I64d")) {
         return QOBJECT(qnum_from_int(va_arg(*ap, long long)));
-    } else if (!strcmp(token->str, "%u")) {
+    } else if (!strcmp(str, "%u")) {
         return QOBJECT(qnum_from_uint(va_arg(*ap, unsigned int)));
-    } else if (!strcmp(token->str, "%lu")) {
+    } else if (!strcmp(str, "%lu")) {
         return QOBJECT(qnum_from_uint(va_arg(*ap, unsigned long)));
-    } else if (!strcmp(token->str, "%llu") ||
-               !strcmp(token->str, "%I64u")) {
+    } else if (!strcmp(str, "%llu") ||
+               !strcmp(str, "%I64u")) {
         return QOBJECT(qnum_from_uint(va_arg(*ap, unsigned long long)));
-    } else if (!strcmp(token->str, "%s")) {
+    } else if (!strcmp(str, "%s")) {
         return QOBJECT(qstring_from_str(va_arg(*ap, const char *)));
-    } else if (!strcmp(token->str, "%f")) {
+    } else if (!strcmp(str, "%f")) {
         return QOBJECT(qnum_from_double(va_arg(*ap, double)));
     }
     return NULL;
 }
 
-static QObject *parse_literal(JSONParserContext *ctxt)
+static QObject *parse_number(JSONTokenType type, const char *str)
 {
-    JSONToken *token;
-
-    token = parser_context_pop_token(ctxt);
-    assert(token);
-
-    switch (token->type) {
-    case JSON_STRING:
-        return QOBJECT(qstring_from_escaped_str(ctxt, token));
-    case JSON_INTEGER: {
+    if (type == JSON_INTEGER) {
         /*
          * Represent JSON_INTEGER as QNUM_I64 if possible, else as
          * QNUM_U64, else as QNUM_DOUBLE.  Note that qemu_strtoi64()
@@ -521,79 +283,233 @@ static QObject *parse_literal(JSONParserContext *ctxt)
         int64_t value;
         uint64_t uvalue;
 
-        ret = qemu_strtoi64(token->str, NULL, 10, &value);
+        ret = qemu_strtoi64(str, NULL, 10, &value);
         if (!ret) {
             return QOBJECT(qnum_from_int(value));
         }
         assert(ret == -ERANGE);
 
-        if (token->str[0] != '-') {
-            ret = qemu_strtou64(token->str, NULL, 10, &uvalue);
+        if (str[0] != '-') {
+            ret = qemu_strtou64(str, NULL, 10, &uvalue);
             if (!ret) {
                 return QOBJECT(qnum_from_uint(uvalue));
             }
             assert(ret == -ERANGE);
         }
-        /* fall through to JSON_FLOAT */
     }
+
+    /* FIXME dependent on locale; a pervasive issue in QEMU */
+    /* FIXME our lexer matches RFC 7159 in forbidding Inf or NaN,
+     * but those might be useful extensions beyond JSON */
+    return QOBJECT(qnum_from_double(strtod(str, NULL)));
+}
+
+/* Return the value of a token that is not a bracket, or NULL */
+static QObject *parse_scalar(JSONParser *parser, JSONTokenType type,
+                             const char *str, size_t len)
+{
+    switch (type) {
+    case JSON_STRING:
+        return QOBJECT(qstring_from_escaped_str(parser, str, len));
+    case JSON_INTEGER:
     case JSON_FLOAT:
-        /* FIXME dependent on locale; a pervasive issue in QEMU */
-        /* FIXME our lexer matches RFC 7159 in forbidding Inf or NaN,
-         * but those might be useful extensions beyond JSON */
-        return QOBJECT(qnum_from_double(strtod(token->str, NULL)));
+        return parse_number(type, str);
+    case JSON_KEYWORD:
+        return parse_keyword(parser, str);
+    case JSON_ESCAPE:
+        return parse_escape(parser, str);
     default:
-        abort();
+        return NULL;
     }
 }
 
-static QObject *parse_value(JSONParserContext *ctxt, va_list *ap)
+static JSONParserEntry *json_parser_top(JSONParser *parser)
 {
-    JSONToken *token;
+    assert(parser->stack->len);
+    return &g_array_index(parser->stack, JSONParserEntry,
+                          parser->stack->len - 1);
+}
 
-    token = parser_context_peek_token(ctxt);
-    if (token == NULL) {
-        parse_error(ctxt, NULL, "premature EOI");
-        return NULL;
+static void json_parser_push(JSONParser *parser, QObject *container)
+{
+    JSONParserEntry entry = { .container = container };
+
+    g_array_append_val(parser->stack, entry);
+}
+
+/* Store a complete value into the innermost container */
+static void json_parser_add(JSONParser *parser, QObject *value)
+{
+    JSONParserEntry *top;
+
+    if (!parser->stack->len) {
+        parser->result = value;
+        parser->state = JSON_PARSER_DONE;
+        return;
     }
 
-    switch (token->type) {
-    case JSON_LCURLY:
-        return parse_object(ctxt, ap);
-    case JSON_LSQUARE:
-        return parse_array(ctxt, ap);
-    case JSON_ESCAPE:
-        return parse_escape(ctxt, ap);
-    case JSON_INTEGER:
-    case JSON_FLOAT:
-    case JSON_STRING:
-        return parse_literal(ctxt);
-    case JSON_KEYWORD:
-        return parse_keyword(ctxt);
-    default:
-        parse_error(ctxt, token, "expecting value");
-        return NULL;
+    top = json_parser_top(parser);
+    if (top->key) {
+        qdict_put_obj(qobject_to(QDict, top->container),
+                      qstring_get_str(top->key), value);
+        qobject_unref(top->key);
+        top->key = NULL;
+    } else {
+        qlist_append_obj(qobject_to(QList, top->container), value);
     }
+    parser->state = JSON_PARSER_SEPARATOR;
 }
 
-QObject *json_parser_parse(GQueue *tokens, va_list *ap)
+static void json_parser_pop(JSONParser *parser)
 {
-    return json_parser_parse_err(tokens, ap, NULL);
+    QObject *container = json_parser_top(parser)->container;
+
+    g_array_set_size(parser->stack, parser->stack->len - 1);
+    json_parser_add(parser, container);
 }
 
-QObject *json_parser_parse_err(GQueue *tokens, va_list *ap, Error **errp)
+/**
+ * Parsing rules
+ *
+ * The grammar is the usual one, but it is applied one token at a time:
+ * @state says what may come next, and the objects and arrays that are
+ * still open are kept on a stack.
+ */
+void json_parser_feed(JSONParser *parser, JSONTokenType type,
+                      const char *str, size_t len)
 {
-    JSONParserContext *ctxt = parser_context_new(tokens);
-    QObject *result;
+    JSONParserEntry *top;
+    QObject *value;
 
-    if (!ctxt) {
-        return NULL;
+    switch (parser->state) {
+    case JSON_PARSER_DONE:
+    case JSON_PARSER_ERROR:
+        return;
+
+    case JSON_PARSER_KEY_OR_END:
+        if (type == JSON_RCURLY) {
+            json_parser_pop(parser);
+            return;
+        }
+        /* fall through */
+    case JSON_PARSER_KEY:
+        value = NULL;
+        if (type == JSON_STRING || type == JSON_ESCAPE) {
+            value = parse_scalar(parser, type, str, len);
+        }
+        top = json_parser_top(parser);
+        top->key = qobject_to(QString, value);
+        if (!top->key) {
+            qobject_unref(value);
+            parse_error(parser, "key is not a string in object");
+            return;
+        }
+        parser->state = JSON_PARSER_COLON;
+        return;
+
+    case JSON_PARSER_COLON:
+        if (type != JSON_COLON) {
+            parse_error(parser, "missing : in object pair");
+            return;
+        }
+        parser->state = JSON_PARSER_VALUE;
+        return;
+
+    case JSON_PARSER_SEPARATOR:
+        top = json_parser_top(parser);
+        if (qobject_type(top->container) == QTYPE_QDICT) {
+            if (type == JSON_RCURLY) {
+                json_parser_pop(parser);
+            } else if (type == JSON_COMMA) {
+                parser->state = JSON_PARSER_KEY;
+            } else {
+                parse_error(parser, "expected separator in dict");
+            }
+        } else {
+            if (type == JSON_RSQUARE) {
+                json_parser_pop(parser);
+            } else if (type == JSON_COMMA) {
+                parser->state = JSON_PARSER_VALUE;
+            } else {
+                parse_error(parser, "expected separator in list");
+            }
+        }
+        return;
+
+    case JSON_PARSER_VALUE_OR_END:
+        if (type == JSON_RSQUARE) {
+            json_parser_pop(parser);
+            return;
+        }
+        /* fall through */
+    case JSON_PARSER_VALUE:
+        if (type == JSON_LCURLY) {
+            json_parser_push(parser, QOBJECT(qdict_new()));
+            parser->state = JSON_PARSER_KEY_OR_END;
+            return;
+        }
+        if (type == JSON_LSQUARE) {
+            json_parser_push(parser, QOBJECT(qlist_new()));
+            parser->state = JSON_PARSER_VALUE_OR_END;
+            return;
+        }
+        value = parse_scalar(parser, type, str, len);
+        if (!value) {
+            parse_error(parser, "expecting value");
+            return;
+        }
+        json_parser_add(parser, value);
+        return;
+
+    default:
+        abort();
     }
+}
 
-    result = parse_value(ctxt, ap);
+void json_parser_reset(JSONParser *parser)
+{
+    JSONParserEntry *entry;
+    guint i;
+
+    for (i = 0; i < parser->stack->len; i++) {
+        entry = &g_array_index(parser->stack, JSONParserEntry, i);
+        qobject_unref(entry->container);
+        qobject_unref(entry->key);
+    }
+    g_array_set_size(parser->stack, 0);
+    qobject_unref(parser->result);
+    parser->result = NULL;
+    error_free(parser->err);
+    parser->err = NULL;
+    parser->state = JSON_PARSER_VALUE;
+}
 
-    error_propagate(errp, ctxt->err);
+QObject *json_parser_finish(JSONParser *parser, Error **errp)
+{
+    QObject *result = parser->result;
 
-    parser_context_free(ctxt);
+    if (parser->state != JSON_PARSER_DONE) {
+        parse_error(parser, "premature EOI");
+    }
+    error_propagate(errp, parser->err);
+    parser->err = NULL;
+    parser->result = NULL;
+    json_parser_reset(parser);
 
     return result;
 }
+
+void json_parser_init(JSONParser *parser, va_list *ap)
+{
+    parser->ap = ap;
+    parser->state = JSON_PARSER_VALUE;
+    parser->stack = g_array_new(false, false, sizeof(JSONParserEntry));
+    parser->result = NULL;
+    parser->err = NULL;
+}
+
+void json_parser_destroy(JSONParser *parser)
+{
+    json_parser_reset(parser);
+    g_array_free(parser->stack, true);
+}
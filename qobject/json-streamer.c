@@ -20,26 +20,12 @@
 #define MAX_TOKEN_COUNT (2ULL << 20)
 #define MAX_NESTING (1ULL << 10)
 
-static void json_message_free_token(void *token, void *opaque)
-{
-    g_free(token);
-}
-
-static void json_message_free_tokens(JSONMessageParser *parser)
-{
-    if (parser->tokens) {
-        g_queue_foreach(parser->tokens, json_message_free_token, NULL);
-        g_queue_free(parser->tokens);
-        parser->tokens = NULL;
-    }
-}
-
 static void json_message_process_token(JSONLexer *lexer, GString *input,
                                        JSONTokenType type, int x, int y)
 {
     JSONMessageParser *parser = container_of(lexer, JSONMessageParser, lexer);
-    JSONToken *token;
-    GQueue *tokens;
+    QObject *json = NULL;
+    Error *err = NULL;
 
     switch (type) {
     case JSON_LCURLY:
@@ -58,63 +44,59 @@ static void json_message_process_token(JSONLexer *lexer, GString *input,
         break;
     }
 
-    token = g_malloc(sizeof(JSONToken) + input->len + 1);
-    token->type = type;
-    memcpy(token->str, input->str, input->len);
-    token->str[input->len] = 0;
-    token->x = x;
-    token->y = y;
-
     parser->token_size += input->len;
-
-    g_queue_push_tail(parser->tokens, token);
-
-    if (type == JSON_ERROR) {
-        goto out_emit_bad;
-    } else if (parser->brace_count < 0 ||
-        parser->bracket_count < 0 ||
-        (parser->brace_count == 0 &&
-         parser->bracket_count == 0)) {
-        goto out_emit;
-    } else if (parser->token_size > MAX_TOKEN_SIZE ||
-               g_queue_get_length(parser->tokens) > MAX_TOKEN_COUNT ||
-               parser->bracket_count + parser->brace_count > MAX_NESTING) {
+    parser->token_count++;
+
+    if (type != JSON_ERROR) {
+        /* The token goes straight into the object being built */
+        json_parser_feed(&parser->parser, type, input->str, input->len);
+
+        if (parser->brace_count < 0 ||
+            parser->bracket_count < 0 ||
+            (parser->brace_count == 0 &&
+             parser->bracket_count == 0)) {
+            json = json_parser_finish(&parser->parser, &err);
+            goto out_emit;
+        }
+
+        if (parser->token_size <= MAX_TOKEN_SIZE &&
+            parser->token_count <= MAX_TOKEN_COUNT &&
+            parser->bracket_count + parser->brace_count <= MAX_NESTING) {
+            return;
+        }
         /* Security consideration, we limit total memory allocated per object
          * and the maximum recursion depth that a message can force.
          */
-        goto out_emit_bad;
     }
 
-    return;
-
-out_emit_bad:
     /*
-     * Clear out token list and tell the parser to emit an error
-     * indication by passing it a NULL list
+     * Throw away the partial object and tell the caller to emit an error
+     * indication by passing it NULL
      */
-    json_message_free_tokens(parser);
+    json_parser_reset(&parser->parser);
+
 out_emit:
-    /* send current list of tokens to parser and reset tokenizer */
+    /* reset tokenizer before handing the result out */
     parser->brace_count = 0;
     parser->bracket_count = 0;
-    /* parser->emit takes ownership of parser->tokens.  Remove our own
-     * reference to parser->tokens before handing it out to parser->emit.
-     */
-    tokens = parser->tokens;
-    parser->tokens = g_queue_new();
-    parser->emit(parser, tokens);
+    parser->token_count = 0;
     parser->token_size = 0;
+    parser->emit(parser->opaque, json, err);
 }
 
 void json_message_parser_init(JSONMessageParser *parser,
-                              void (*func)(JSONMessageParser *, GQueue *))
+                              void (*emit)(void *opaque, QObject *json,
+                                           Error *err),
+                              void *opaque, va_list *ap)
 {
-    parser->emit = func;
+    parser->emit = emit;
+    parser->opaque = opaque;
     parser->brace_count = 0;
     parser->bracket_count = 0;
-    parser->tokens = g_queue_new();
+    parser->token_count = 0;
     parser->token_size = 0;
 
+    json_parser_init(&parser->parser, ap);
     json_lexer_init(&parser->lexer, json_message_process_token);
 }
 
@@ -132,5 +114,5 @@ int json_message_parser_flush(JSONMessageParser *parser)
 void json_message_parser_destroy(JSONMessageParser *parser)
 {
     json_lexer_destroy(&parser->lexer);
-    json_message_free_tokens(parser);
+    json_parser_destroy(&parser->parser);
 }
@@ -853,10 +853,36 @@ typedef struct OCFData
 {
     void (*fn)(ObjectClass *klass, void *opaque);
     const char *implements_type;
+    TypeImpl *implements;
     bool include_abstract;
     void *opaque;
 } OCFData;
 
+/*
+ * Tell from the type information alone whether @type can be cast to
+ * @target, so that the class of a type that cannot does not have to be
+ * initialized just to be rejected.  object_class_dynamic_cast() remains
+ * the final word.
+ */
+static bool type_may_implement(TypeImpl *type, TypeImpl *target)
+{
+    int i;
+
+    for (; type; type = type_get_parent(type)) {
+        if (type == target) {
+            return true;
+        }
+        for (i = 0; i < type->num_interfaces; i++) {
+            TypeImpl *iface = type_get_by_name(type->interfaces[i].typename);
+
+            if (type_is_ancestor(iface, target)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
 static void object_class_foreach_tramp(gpointer key, gpointer value,
                                        gpointer opaque)
 {
@@ -864,6 +890,11 @@ static void object_class_foreach_tramp(gpointer key, gpointer value,
     TypeImpl *type = value;
     ObjectClass *k;
 
+    if (data->implements_type &&
+        (!data->implements || !type_may_implement(type, data->implements))) {
+        return;
+    }
+
     type_initialize(type);
     k = type->class;
 
@@ -883,7 +914,8 @@ void object_class_foreach(void (*fn)(ObjectClass *klass, void *opaque),
                           const char *implements_type, bool include_abstract,
                           void *opaque)
 {
-    OCFData data = { fn, implements_type, include_abstract, opaque };
+    OCFData data = { fn, implements_type, type_get_by_name(implements_type),
+                     include_abstract, opaque };
 
     enumerating_types = true;
     g_hash_table_foreach(type_table_get(), object_class_foreach_tramp, &data);
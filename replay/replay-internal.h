@@ -89,6 +89,11 @@ typedef struct ReplayState {
 } ReplayState;
 extern ReplayState replay_state;
 
+/*! Virtual time between periodic snapshots while recording, or 0 */
+extern int64_t replay_snapshot_period;
+/*! Instruction count at which replay pauses the VM, or -1 */
+extern uint64_t replay_break_icount;
+
 /* File for replay writing */
 extern FILE *replay_file;
 
@@ -189,5 +194,9 @@ void *replay_event_net_load(void);
    Should be called before virtual devices initialization
    to make cached timers available for post_load functions. */
 void replay_vmstate_register(void);
+/*! Starts taking snapshots every replay_snapshot_period while recording */
+void replay_snapshot_timer_init(void);
+/*! Pauses the VM when the replay reaches @icount */
+void replay_break(uint64_t icount);
 
 #endif
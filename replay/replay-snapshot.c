@@ -20,6 +20,17 @@
 #include "qemu/error-report.h"
 #include "migration/vmstate.h"
 #include "migration/snapshot.h"
+#include "qemu/cutils.h"
+#include "qemu/timer.h"
+#include "block/snapshot.h"
+#include "qapi/qapi-commands-misc.h"
+
+/* How often the periodic snapshot timer checks the virtual clock */
+#define REPLAY_SNAPSHOT_POLL_MS 100
+
+static QEMUTimer *replay_snapshot_timer;
+/* Virtual time of the last periodic snapshot */
+static int64_t replay_snapshot_last;
 
 static int replay_pre_save(void *opaque)
 {
@@ -95,3 +106,132 @@ bool replay_can_snapshot(void)
     return replay_mode == REPLAY_MODE_NONE
         || !replay_has_events();
 }
+
+/*
+ * Periodic snapshots are named after the initial one, followed by the
+ * instruction count that they were taken at, so that replay-seek can pick
+ * the right one in a later replay session.  The timer runs on the realtime
+ * clock, which does not take part in the replay log.
+ */
+static void replay_snapshot_timer_cb(void *opaque)
+{
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    Error *err = NULL;
+    char *name;
+
+    if (runstate_is_running() &&
+        now - replay_snapshot_last >= replay_snapshot_period &&
+        replay_can_snapshot()) {
+        vm_stop(RUN_STATE_SAVE_VM);
+        name = g_strdup_printf("%s-%" PRIu64, replay_snapshot,
+                               replay_get_current_step());
+        if (save_snapshot(name, &err) != 0) {
+            error_report_err(err);
+            error_report("Could not create periodic snapshot for icount "
+                         "record, disabling them");
+            g_free(name);
+            vm_start();
+            return;
+        }
+        g_free(name);
+        replay_snapshot_last = now;
+        vm_start();
+    }
+    timer_mod(replay_snapshot_timer,
+              qemu_clock_get_ms(QEMU_CLOCK_REALTIME) + REPLAY_SNAPSHOT_POLL_MS);
+}
+
+void replay_snapshot_timer_init(void)
+{
+    replay_snapshot_last = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    replay_snapshot_timer = timer_new_ms(QEMU_CLOCK_REALTIME,
+                                         replay_snapshot_timer_cb, NULL);
+    timer_mod(replay_snapshot_timer,
+              qemu_clock_get_ms(QEMU_CLOCK_REALTIME) + REPLAY_SNAPSHOT_POLL_MS);
+}
+
+/*
+ * Find the snapshot taken at the highest instruction count not above
+ * @icount.  Returns its name, or NULL if there is none.
+ */
+static char *replay_find_snapshot(uint64_t icount, uint64_t *snapshot_icount)
+{
+    BlockDriverState *bs;
+    QEMUSnapshotInfo *sn_tab = NULL;
+    AioContext *aio_context;
+    size_t prefix = strlen(replay_snapshot);
+    char *best = NULL;
+    uint64_t step;
+    int nb_sns, i;
+
+    bs = bdrv_all_find_vmstate_bs();
+    if (!bs) {
+        return NULL;
+    }
+    aio_context = bdrv_get_aio_context(bs);
+    aio_context_acquire(aio_context);
+    nb_sns = bdrv_snapshot_list(bs, &sn_tab);
+    aio_context_release(aio_context);
+
+    for (i = 0; i < nb_sns; i++) {
+        const char *name = sn_tab[i].name;
+
+        if (!strcmp(name, replay_snapshot)) {
+            step = 0;
+        } else if (strncmp(name, replay_snapshot, prefix) ||
+                   name[prefix] != '-' ||
+                   qemu_strtou64(name + prefix + 1, NULL, 10, &step)) {
+            continue;
+        }
+        if (step <= icount && (!best || step > *snapshot_icount)) {
+            g_free(best);
+            best = g_strdup(name);
+            *snapshot_icount = step;
+        }
+    }
+    g_free(sn_tab);
+    return best;
+}
+
+void qmp_replay_seek(int64_t icount, Error **errp)
+{
+    uint64_t current = replay_get_current_step();
+    uint64_t snapshot_icount = 0;
+    char *name = NULL;
+
+    if (replay_mode != REPLAY_MODE_PLAY) {
+        error_setg(errp, "replay-seek works only in replay mode");
+        return;
+    }
+    if (icount < 0) {
+        error_setg(errp, "Invalid instruction count %" PRId64, icount);
+        return;
+    }
+
+    if (replay_snapshot) {
+        name = replay_find_snapshot(icount, &snapshot_icount);
+    }
+    /* Going forward from where we are is quicker if no snapshot is closer */
+    if (current <= icount && (!name || snapshot_icount <= current)) {
+        g_free(name);
+        name = NULL;
+    } else if (!name) {
+        error_setg(errp, "No snapshot to replay from before instruction "
+                   "count %" PRId64, icount);
+        return;
+    }
+
+    vm_stop(RUN_STATE_PAUSED);
+    if (name) {
+        int ret = load_snapshot(name, errp);
+
+        g_free(name);
+        if (ret < 0) {
+            return;
+        }
+    }
+    if (replay_get_current_step() != icount) {
+        replay_break(icount);
+        vm_start();
+    }
+}
@@ -28,6 +28,9 @@
 
 ReplayMode replay_mode = REPLAY_MODE_NONE;
 char *replay_snapshot;
+int64_t replay_snapshot_period;
+uint64_t replay_break_icount = -1ULL;
+static QEMUTimer *replay_break_timer;
 
 /* Name of replay file  */
 static char *replay_filename;
@@ -73,11 +76,34 @@ int replay_get_instructions(void)
     replay_mutex_lock();
     if (replay_next_event_is(EVENT_INSTRUCTION)) {
         res = replay_state.instructions_count;
+        if (replay_break_icount != -1ULL) {
+            uint64_t current = replay_get_current_step();
+
+            /* Do not run past the breakpoint */
+            assert(replay_break_icount >= current);
+            if (current + res > replay_break_icount) {
+                res = replay_break_icount - current;
+            }
+        }
     }
     replay_mutex_unlock();
     return res;
 }
 
+static void replay_break_timer_cb(void *opaque)
+{
+    vm_stop(RUN_STATE_PAUSED);
+    replay_break_icount = -1ULL;
+}
+
+void replay_break(uint64_t icount)
+{
+    assert(replay_mode == REPLAY_MODE_PLAY);
+    assert(icount >= replay_get_current_step());
+
+    replay_break_icount = icount;
+}
+
 void replay_account_executed_instructions(void)
 {
     if (replay_mode == REPLAY_MODE_PLAY) {
@@ -91,6 +117,11 @@ void replay_account_executed_instructions(void)
 
             replay_state.instructions_count -= count;
             replay_state.current_step += count;
+            if (replay_state.current_step == replay_break_icount) {
+                /* Stop the VM from the main loop */
+                timer_mod_ns(replay_break_timer,
+                             qemu_clock_get_ns(QEMU_CLOCK_REALTIME));
+            }
             if (replay_state.instructions_count == 0) {
                 assert(replay_state.data_kind == EVENT_INSTRUCTION);
                 replay_finish_event();
@@ -309,6 +340,12 @@ void replay_configure(QemuOpts *opts)
     }
 
     replay_snapshot = g_strdup(qemu_opt_get(opts, "rrsnapshot"));
+    replay_snapshot_period = qemu_opt_get_number(opts, "rrperiod", 0)
+                             * NANOSECONDS_PER_SECOND;
+    if (replay_snapshot_period && !replay_snapshot) {
+        error_report("Option rrperiod requires rrsnapshot");
+        exit(1);
+    }
     replay_vmstate_register();
     replay_enable(fname, mode);
 
@@ -331,7 +368,13 @@ void replay_start(void)
         exit(1);
     }
 
-    /* Timer for snapshotting will be set up here. */
+    if (replay_mode == REPLAY_MODE_RECORD && replay_snapshot_period) {
+        replay_snapshot_timer_init();
+    }
+    if (replay_mode == REPLAY_MODE_PLAY) {
+        replay_break_timer = timer_new_ns(QEMU_CLOCK_REALTIME,
+                                          replay_break_timer_cb, NULL);
+    }
 
     replay_enable_events();
 }
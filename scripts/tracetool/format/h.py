@@ -46,6 +46,19 @@ def generate(events, backend, group):
                 enabled=enabled)
         out('#define TRACE_%s_ENABLED %d' % (e.name.upper(), enabled))
 
+    # static keys, see trace/static-key.h
+    for e in events:
+        out('',
+            'static inline bool %(api)s(void)',
+            '{',
+            '    TRACE_STATIC_KEY_BRANCH("%(dstate)s", l_enabled);',
+            '    return false;',
+            'l_enabled:',
+            '    return true;',
+            '}',
+            api=e.api(e.QEMU_STATIC_KEY),
+            dstate=e.api(e.QEMU_DSTATE))
+
     backend.generate_begin(events, group)
 
     for e in events:
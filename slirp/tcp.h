@@ -38,8 +38,14 @@ typedef	uint32_t tcp_seq;
 #define      PR_SLOWHZ       2               /* 2 slow timeouts per second (approx) */
 #define      PR_FASTHZ       5               /* 5 fast timeouts per second (not important) */
 
-#define TCP_SNDSPACE 8192
-#define TCP_RCVSPACE 8192
+/*
+ * Per-connection socket buffer sizes.  These bound the window we
+ * advertise to the guest and how much we read from the host socket
+ * at once, so keep them large enough for a LAN bandwidth-delay product;
+ * window scaling lets the guest see more than 64k of receive space.
+ */
+#define TCP_SNDSPACE (128 * 1024)
+#define TCP_RCVSPACE (128 * 1024)
 
 /*
  * TCP header.
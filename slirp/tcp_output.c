@@ -274,6 +274,20 @@ send:
 			mss = htons((uint16_t) tcp_mss(tp, 0));
 			memcpy((caddr_t)(opt + 2), (caddr_t)&mss, sizeof(mss));
 			optlen = 4;
+
+			/*
+			 * Request window scaling on an active open, or
+			 * answer the peer's request on a passive one.
+			 */
+			if ((tp->t_flags & TF_REQ_SCALE) &&
+			    ((flags & TH_ACK) == 0 ||
+			     (tp->t_flags & TF_RCVD_SCALE))) {
+				opt[optlen] = TCPOPT_NOP;
+				opt[optlen + 1] = TCPOPT_WINDOW;
+				opt[optlen + 2] = TCPOLEN_WINDOW;
+				opt[optlen + 3] = tp->request_r_scale;
+				optlen += 4;
+			}
 		}
  	}
 
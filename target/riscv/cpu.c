@@ -22,6 +22,7 @@
 #include "cpu.h"
 #include "exec/exec-all.h"
 #include "qapi/error.h"
+#include "hw/qdev-properties.h"
 #include "migration/vmstate.h"
 
 /* RISC-V CPU definitions */
@@ -58,7 +59,15 @@ const char * const riscv_excp_names[] = {
     "exec_page_fault",
     "load_page_fault",
     "reserved",
-    "store_page_fault"
+    "store_page_fault",
+    "reserved",
+    "reserved",
+    "reserved",
+    "reserved",
+    "guest_exec_page_fault",
+    "guest_load_page_fault",
+    "virtual_instruction",
+    "guest_store_page_fault"
 };
 
 const char * const riscv_intr_names[] = {
@@ -263,6 +272,10 @@ void restore_state_to_opc(CPURISCVState *env, TranslationBlock *tb,
                           target_ulong *data)
 {
     env->pc = data[0];
+    if (tb->flags & TB_FLAGS_INSN_COUNT) {
+        /* data[1] insns of the TB completed, it was counted in full */
+        env->instret -= tb->icount - data[1];
+    }
 }
 
 static void riscv_cpu_reset(CPUState *cs)
@@ -277,8 +290,24 @@ static void riscv_cpu_reset(CPUState *cs)
     env->mstatus &= ~(MSTATUS_MIE | MSTATUS_MPRV);
     env->mcause = 0;
     env->pc = env->resetvec;
+    riscv_ptw_cache_flush(env);
+    riscv_gstage_cache_flush(env);
+    env->virt_enabled = false;
+    if (riscv_has_ext(env, RVH)) {
+        env->mideleg |= VS_MODE_INTERRUPTS;
+    }
+    memset(env->mhpmevent, 0, sizeof(env->mhpmevent));
+    memset(env->mhpmcounter_offset, 0, sizeof(env->mhpmcounter_offset));
+    env->hpm_tb_flags = 0;
 #endif
     cs->exception_index = EXCP_NONE;
+    env->load_res = RISCV_RESERVATION_INVALID;
+    env->instret = 0;
+    env->vtype = VTYPE_VILL;
+    env->vl = 0;
+    env->vstart = 0;
+    env->vxrm = 0;
+    env->vxsat = 0;
     set_default_nan_mode(1, &env->fp_status);
 }
 
@@ -294,9 +323,37 @@ static void riscv_cpu_disas_set_info(CPUState *s, disassemble_info *info)
 static void riscv_cpu_realize(DeviceState *dev, Error **errp)
 {
     CPUState *cs = CPU(dev);
+    RISCVCPU *cpu = RISCV_CPU(dev);
     RISCVCPUClass *mcc = RISCV_CPU_GET_CLASS(dev);
     Error *local_err = NULL;
 
+    if (cpu->cfg.misaligned && strcmp(cpu->cfg.misaligned, "hw")) {
+        if (strcmp(cpu->cfg.misaligned, "trap")) {
+            error_setg(errp, "misaligned must be hw or trap");
+            return;
+        }
+        cpu->cfg.misaligned_trap = true;
+    }
+
+    if (cpu->cfg.ext_v) {
+        if (cpu->cfg.vlen != 128 && cpu->cfg.vlen != RV_VLEN_MAX) {
+            error_setg(errp, "vlen must be 128 or %d", RV_VLEN_MAX);
+            return;
+        }
+        cpu->env.misa |= RVV;
+    }
+
+    if (cpu->cfg.ext_h) {
+        if (cpu->env.priv_ver < PRIV_VERSION_1_10_0 ||
+            !riscv_has_ext(&cpu->env, RVS) ||
+            !riscv_feature(&cpu->env, RISCV_FEATURE_MMU)) {
+            error_setg(errp, "the H extension needs priv-1.10, S-mode "
+                       "and an MMU");
+            return;
+        }
+        cpu->env.misa |= RVH;
+    }
+
     cpu_exec_realizefn(cs, &local_err);
     if (local_err != NULL) {
         error_propagate(errp, local_err);
@@ -322,6 +379,20 @@ static const VMStateDescription vmstate_riscv_cpu = {
     .unmigratable = 1,
 };
 
+static Property riscv_cpu_properties[] = {
+    DEFINE_PROP_BOOL("x-sfence-broadcast", RISCVCPU, cfg.sfence_broadcast,
+                     false),
+    DEFINE_PROP_BOOL("x-insn-count", RISCVCPU, cfg.insn_count, false),
+    DEFINE_PROP_STRING("misaligned", RISCVCPU, cfg.misaligned),
+    DEFINE_PROP_BOOL("zba", RISCVCPU, cfg.ext_zba, false),
+    DEFINE_PROP_BOOL("zbb", RISCVCPU, cfg.ext_zbb, false),
+    DEFINE_PROP_BOOL("zbs", RISCVCPU, cfg.ext_zbs, false),
+    DEFINE_PROP_BOOL("x-v", RISCVCPU, cfg.ext_v, false),
+    DEFINE_PROP_UINT16("vlen", RISCVCPU, cfg.vlen, 128),
+    DEFINE_PROP_BOOL("x-h", RISCVCPU, cfg.ext_h, false),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
 static void riscv_cpu_class_init(ObjectClass *c, void *data)
 {
     RISCVCPUClass *mcc = RISCV_CPU_CLASS(c);
@@ -357,6 +428,7 @@ static void riscv_cpu_class_init(ObjectClass *c, void *data)
 #endif
     /* For now, mark unmigratable: */
     cc->vmsd = &vmstate_riscv_cpu;
+    dc->props = riscv_cpu_properties;
 }
 
 char *riscv_isa_string(RISCVCPU *cpu)
@@ -32,10 +32,18 @@
 #define TARGET_VIRT_ADDR_SPACE_BITS 32
 #endif
 
+/*
+ * RVWMO only orders memory accesses across FENCE, AMOs and LR/SC with
+ * aq/rl set, and all of those emit explicit barriers.  Hence every host
+ * is strong enough and MTTCG is used by default.
+ */
 #define TCG_GUEST_DEFAULT_MO 0
 
 #define CPUArchState struct CPURISCVState
 
+/* insn index within the TB, see restore_state_to_opc */
+#define TARGET_INSN_START_EXTRA_WORDS 1
+
 #include "qemu-common.h"
 #include "qom/cpu.h"
 #include "exec/cpu-defs.h"
@@ -79,6 +87,8 @@
 #define RVC RV('C')
 #define RVS RV('S')
 #define RVU RV('U')
+#define RVH RV('H')
+#define RVV RV('V')
 
 /* S extension denotes that Supervisor mode exists, however it is possible
    to have a core that support S mode but does not have an MMU and there
@@ -94,24 +104,98 @@ enum {
 
 #define TRANSLATE_FAIL 1
 #define TRANSLATE_SUCCESS 0
-#define NB_MMU_MODES 4
+#define TRANSLATE_G_STAGE_FAIL 2
+#define NB_MMU_MODES 6
 #define MMU_USER_IDX 3
 
+/* ORed into PRV_U or PRV_S for the mmu_idx of VU-mode and VS-mode, whose
+   TLB entries hold combined VS-stage and G-stage translations */
+#define MMU_VIRT_IDX 4
+#define MMU_PRIV_MASK 3
+
+/* mmu_idx values that may hold page-table translations (M-mode only does
+   so with mstatus.MPRV set) */
+#define RISCV_MMU_XLATE_IDXMAP ((1 << PRV_U) | (1 << PRV_S) | (1 << PRV_M))
+#define RISCV_MMU_VIRT_IDXMAP  ((1 << (MMU_VIRT_IDX | PRV_U)) | \
+                                (1 << (MMU_VIRT_IDX | PRV_S)))
+
+/* operands present in an sfence.vma (rs1 != x0, rs2 != x0) */
+#define SFENCE_VMA_VADDR 1
+#define SFENCE_VMA_ASID  2
+
+/* load_res value that no naturally aligned SC address can match */
+#define RISCV_RESERVATION_INVALID ((target_ulong)-1)
+
+/* mhpmevent values, anything else reads back as RISCV_HPM_EVENT_NONE */
+#define RISCV_HPM_EVENT_NONE     0
+#define RISCV_HPM_EVENT_TLB_MISS 1 /* softmmu TLB refills */
+#define RISCV_HPM_EVENT_TRAP     2 /* exceptions and interrupts taken */
+#define RISCV_HPM_EVENT_BRANCH   3 /* retired conditional branches */
+#define RISCV_HPM_EVENT_LOAD     4 /* retired integer and fp loads */
+#define RISCV_HPM_EVENT_STORE    5 /* retired integer and fp stores */
+#define RISCV_HPM_EVENT_MAX      6
+
+/* mhpmcounter3 ... mhpmcounter31 */
+#define RISCV_HPM_COUNTERS 29
+
 #define MAX_RISCV_PMPS (16)
 
+/* entries in the per-hart cache of last-level page table addresses */
+#define RISCV_PTW_CACHE_SIZE 16
+
+typedef struct RISCVPTWCacheEntry {
+    target_ulong tag;    /* vaddr >> (PGSHIFT + ptidxbits) */
+    hwaddr base;         /* (guest) physical address of the last table */
+    bool valid;
+} RISCVPTWCacheEntry;
+
+/* entries in the per-hart cache of G-stage (guest physical) translations */
+#define RISCV_GSTAGE_CACHE_SIZE 64
+
+typedef struct RISCVGStageCacheEntry {
+    hwaddr gpa;          /* guest physical page */
+    hwaddr pa;           /* supervisor physical page */
+    int prot;            /* PAGE_* permissions of the G-stage leaf */
+    bool valid;
+} RISCVGStageCacheEntry;
+
 typedef struct CPURISCVState CPURISCVState;
 
+/* largest cfg.vlen in bits */
+#define RV_VLEN_MAX 256
+
 #include "pmp.h"
 
 struct CPURISCVState {
     target_ulong gpr[32];
     uint64_t fpr[32]; /* assume both F and D extensions */
     target_ulong pc;
+    /* LR/SC reservation: address and value seen by LR, see gen_atomic */
     target_ulong load_res;
     target_ulong load_val;
 
     target_ulong frm;
 
+    /* V extension: register v<n> is at vreg[n * vlen / 64], so that
+       register groups are contiguous */
+    uint64_t vreg[32 * RV_VLEN_MAX / 64] QEMU_ALIGNED(16);
+    target_ulong vxrm;
+    target_ulong vxsat;
+    target_ulong vl;
+    target_ulong vstart;
+    target_ulong vtype;
+
+    /* retired instructions when counting with cfg.insn_count */
+    uint64_t instret;
+
+    /* hardware performance monitor: one running count per event, the
+       counters are the count of their mhpmevent plus an offset */
+    uint64_t hpm_count[RISCV_HPM_EVENT_MAX];
+    uint64_t mhpmcounter_offset[RISCV_HPM_COUNTERS];
+    target_ulong mhpmevent[RISCV_HPM_COUNTERS];
+    /* TB_FLAGS_HPM bits of the events some counter is programmed for */
+    uint32_t hpm_tb_flags;
+
     target_ulong badaddr;
 
     target_ulong user_ver;
@@ -126,6 +210,9 @@ struct CPURISCVState {
 
     target_ulong mhartid;
     target_ulong mstatus;
+#if defined(TARGET_RISCV32)
+    target_ulong mstatush;
+#endif
     /*
      * CAUTION! Unlike the rest of this struct, mip is accessed asynchonously
      * by I/O threads and other vCPUs, so hold the iothread mutex before
@@ -157,22 +244,53 @@ struct CPURISCVState {
     target_ulong sscratch;
     target_ulong mscratch;
 
+    /*
+     * H extension.  While V=1 the S-mode CSR fields above are the
+     * guest's VS-mode registers and the vs* fields below hold the HS-mode
+     * ones, riscv_cpu_set_virt_enabled swaps them.  vsatp is the
+     * exception, it always is the VS-stage root and satp the HS one.
+     */
+    bool virt_enabled;
+    target_ulong hstatus;
+    target_ulong hedeleg;
+    target_ulong hideleg;
+    target_ulong hcounteren;
+    target_ulong htval;
+    target_ulong hgatp;
+    target_ulong mtval2;
+    target_ulong vsstatus;  /* sstatus bits of mstatus */
+    target_ulong vstvec;
+    target_ulong vsscratch;
+    target_ulong vsepc;
+    target_ulong vscause;
+    target_ulong vstval;
+    target_ulong vsatp;
+    /* guest physical address of a G-stage fault, for htval and mtval2 */
+    hwaddr guest_phys_fault_addr;
+    /* the faulting access was translated in two stages, for the GVA bits */
+    bool two_stage_lookup;
+
     /* temporary htif regs */
     uint64_t mfromhost;
     uint64_t mtohost;
     uint64_t timecmp;
+    /* mtime of the platform timer for rdtime, set up by the CLINT */
+    uint64_t (*rdtime_fn)(void);
 
     /* physical memory protection */
     pmp_table_t pmp_state;
+
+    /* non-leaf page-table walk caches of the HS-stage and the VS-stage,
+       see riscv_ptw_cache_flush */
+    RISCVPTWCacheEntry ptw_cache[2][RISCV_PTW_CACHE_SIZE];
+    /* G-stage translations, see riscv_gstage_cache_flush */
+    RISCVGStageCacheEntry gstage_cache[RISCV_GSTAGE_CACHE_SIZE];
 #endif
 
     float_status fp_status;
 
     /* QEMU */
     CPU_COMMON
-
-    /* Fields from here on are preserved across CPU reset. */
-    QEMUTimer *timer; /* Internal timer */
 };
 
 #define RISCV_CPU_CLASS(klass) \
@@ -200,6 +318,7 @@ typedef struct RISCVCPUClass {
 /**
  * RISCVCPU:
  * @env: #CPURISCVState
+ * @cfg: user-configurable properties
  *
  * A RISCV CPU.
  */
@@ -208,6 +327,28 @@ typedef struct RISCVCPU {
     CPUState parent_obj;
     /*< public >*/
     CPURISCVState env;
+
+    struct {
+        /* sfence.vma applies to every hart, like a broadcast TLB
+           invalidate, so supervisors can skip remote fence IPIs */
+        bool sfence_broadcast;
+        /* cycle and instret count retired instructions without icount,
+           TBs add their length on entry */
+        bool insn_count;
+        /* misaligned loads and stores are done by QEMU with "hw", the
+           default, and raise address-misaligned exceptions with "trap" */
+        char *misaligned;
+        bool misaligned_trap;
+        /* the Zba, Zbb and Zbs bit-manipulation extensions */
+        bool ext_zba;
+        bool ext_zbb;
+        bool ext_zbs;
+        /* the H extension */
+        bool ext_h;
+        /* the V extension, with vector registers of vlen bits */
+        bool ext_v;
+        uint16_t vlen;
+    } cfg;
 } RISCVCPU;
 
 static inline RISCVCPU *riscv_env_get_cpu(CPURISCVState *env)
@@ -220,6 +361,14 @@ static inline int riscv_has_ext(CPURISCVState *env, target_ulong ext)
     return (env->misa & ext) != 0;
 }
 
+/* VLMAX of vtype, LMUL * VLEN / SEW */
+static inline uint32_t vext_get_vlmax(RISCVCPU *cpu, target_ulong vtype)
+{
+    int shift = sextract32(vtype, 0, 3) - extract32(vtype, 3, 3) - 3;
+
+    return shift >= 0 ? cpu->cfg.vlen << shift : cpu->cfg.vlen >> -shift;
+}
+
 static inline bool riscv_feature(CPURISCVState *env, int feature)
 {
     return env->features & (1ULL << feature);
@@ -228,6 +377,62 @@ static inline bool riscv_feature(CPURISCVState *env, int feature)
 #include "cpu_user.h"
 #include "cpu_bits.h"
 
+static inline bool riscv_cpu_virt_enabled(CPURISCVState *env)
+{
+#ifndef CONFIG_USER_ONLY
+    return env->virt_enabled;
+#else
+    return false;
+#endif
+}
+
+#ifndef CONFIG_USER_ONLY
+/* mstatus.MPV, which is in mstatush on RV32 */
+static inline bool riscv_cpu_get_mpv(CPURISCVState *env)
+{
+#if defined(TARGET_RISCV32)
+    return get_field(env->mstatush, MSTATUSH_MPV);
+#else
+    return get_field(env->mstatus, MSTATUS64_MPV);
+#endif
+}
+
+static inline void riscv_cpu_set_mpv(CPURISCVState *env, bool mpv)
+{
+#if defined(TARGET_RISCV32)
+    env->mstatush = set_field(env->mstatush, MSTATUSH_MPV, mpv);
+#else
+    env->mstatus = set_field(env->mstatus, MSTATUS64_MPV, mpv);
+#endif
+}
+
+static inline void riscv_cpu_set_mpv_gva(CPURISCVState *env, bool mpv,
+                                         bool gva)
+{
+#if defined(TARGET_RISCV32)
+    env->mstatush = set_field(env->mstatush, MSTATUSH_MPV, mpv);
+    env->mstatush = set_field(env->mstatush, MSTATUSH_GVA, gva);
+#else
+    env->mstatus = set_field(env->mstatus, MSTATUS64_MPV, mpv);
+    env->mstatus = set_field(env->mstatus, MSTATUS64_GVA, gva);
+#endif
+}
+
+/*
+ * mstatus.FS or mstatus.VS as they apply to the running mode: while V=1
+ * the state is off unless it is enabled both for the guest and, in the
+ * swapped out copy, for HS-mode.
+ */
+static inline target_ulong riscv_cpu_ext_status(CPURISCVState *env,
+                                                target_ulong mask)
+{
+    if (env->virt_enabled && !(env->vsstatus & mask)) {
+        return 0;
+    }
+    return env->mstatus & mask;
+}
+#endif
+
 extern const char * const riscv_int_regnames[];
 extern const char * const riscv_fpr_regnames[];
 extern const char * const riscv_excp_names[];
@@ -257,6 +462,7 @@ void riscv_cpu_list(FILE *f, fprintf_function cpu_fprintf);
 #define cpu_mmu_index riscv_cpu_mmu_index
 
 void riscv_set_mode(CPURISCVState *env, target_ulong newpriv);
+void riscv_cpu_set_virt_enabled(CPURISCVState *env, bool enable);
 
 void riscv_translate_init(void);
 RISCVCPU *cpu_riscv_init(const char *cpu_model);
@@ -268,7 +474,46 @@ target_ulong cpu_riscv_get_fflags(CPURISCVState *env);
 void cpu_riscv_set_fflags(CPURISCVState *env, target_ulong);
 
 #define TB_FLAGS_MMU_MASK  3
+#define TB_FLAGS_FRM_SHIFT 2
+#define TB_FLAGS_FRM_MASK  (7 << TB_FLAGS_FRM_SHIFT)
 #define TB_FLAGS_FP_ENABLE MSTATUS_FS
+#define TB_FLAGS_INSN_COUNT (1 << 5)
+/* events counted by translated code, see write_mhpmevent */
+#define TB_FLAGS_HPM(event) (1 << (6 + (event)))
+#define TB_FLAGS_HPM_MASK  (TB_FLAGS_HPM(RISCV_HPM_EVENT_BRANCH) | \
+                            TB_FLAGS_HPM(RISCV_HPM_EVENT_LOAD) | \
+                            TB_FLAGS_HPM(RISCV_HPM_EVENT_STORE))
+/* vector state the translator depends on, see riscv_tr_init_disas_context */
+#define TB_FLAGS_VS_ENABLE (1 << 15)
+#define TB_FLAGS_VILL      (1 << 16)
+#define TB_FLAGS_SEW_SHIFT 17
+#define TB_FLAGS_SEW_MASK  (3 << TB_FLAGS_SEW_SHIFT)
+#define TB_FLAGS_LMUL_SHIFT 19
+#define TB_FLAGS_LMUL_MASK (7 << TB_FLAGS_LMUL_SHIFT)
+/* vstart is 0 and vl is VLMAX, whole register groups are operated on */
+#define TB_FLAGS_VL_EQ_VLMAX (1 << 22)
+/* V=1, the TB runs in VS-mode or VU-mode */
+#define TB_FLAGS_VIRT      (1 << 23)
+
+/* simd_data of the vector helper descriptors */
+#define VDATA_VM           1    /* unmasked */
+#define VDATA_NREG_SHIFT   1    /* registers of whole register accesses */
+
+static inline uint32_t vext_tb_flags(CPURISCVState *env)
+{
+    RISCVCPU *cpu = riscv_env_get_cpu(env);
+    uint32_t flags = TB_FLAGS_VS_ENABLE;
+
+    if (env->vtype & VTYPE_VILL) {
+        return flags | TB_FLAGS_VILL;
+    }
+    flags |= extract32(env->vtype, 3, 2) << TB_FLAGS_SEW_SHIFT;
+    flags |= extract32(env->vtype, 0, 3) << TB_FLAGS_LMUL_SHIFT;
+    if (env->vstart == 0 && env->vl == vext_get_vlmax(cpu, env->vtype)) {
+        flags |= TB_FLAGS_VL_EQ_VLMAX;
+    }
+    return flags;
+}
 
 static inline void cpu_get_tb_cpu_state(CPURISCVState *env, target_ulong *pc,
                                         target_ulong *cs_base, uint32_t *flags)
@@ -278,16 +523,68 @@ static inline void cpu_get_tb_cpu_state(CPURISCVState *env, target_ulong *pc,
 #ifdef CONFIG_USER_ONLY
     *flags = TB_FLAGS_FP_ENABLE;
 #else
-    *flags = cpu_mmu_index(env, 0) | (env->mstatus & MSTATUS_FS);
+    *flags = env->priv | riscv_cpu_ext_status(env, MSTATUS_FS);
+    if (env->virt_enabled) {
+        *flags |= TB_FLAGS_VIRT;
+    }
 #endif
+    /* dynamic rounding mode, validated at translation time */
+    *flags |= (env->frm << TB_FLAGS_FRM_SHIFT) & TB_FLAGS_FRM_MASK;
+    if (riscv_env_get_cpu(env)->cfg.insn_count) {
+        *flags |= TB_FLAGS_INSN_COUNT;
+    }
+    *flags |= env->hpm_tb_flags;
+#ifdef CONFIG_USER_ONLY
+    if (riscv_has_ext(env, RVV)) {
+#else
+    if (riscv_has_ext(env, RVV) && riscv_cpu_ext_status(env, MSTATUS_VS)) {
+#endif
+        *flags |= vext_tb_flags(env);
+    }
 }
 
 void csr_write_helper(CPURISCVState *env, target_ulong val_to_write,
         target_ulong csrno);
 target_ulong csr_read_helper(CPURISCVState *env, target_ulong csrno);
 
+/* CSR function table, see csr.c */
+#define CSR_TABLE_SIZE 0x1000
+
+/* the CSR is a single env field, accessed as (value & wmask) at offset */
+#define RISCV_CSR_PLAIN   1
+/* accesses cannot change state the TB was translated for or make an
+   interrupt pending, so the TB need not end after a CSR instruction */
+#define RISCV_CSR_NO_EXIT 2
+
+/* returned by CSR callbacks for accesses that are virtual instruction
+   faults, i.e. legal outside of a guest but not while V=1 */
+#define RISCV_CSR_VIRT_FAULT -2
+
+typedef int (*riscv_csr_predicate_fn)(CPURISCVState *env, int csrno);
+typedef int (*riscv_csr_read_fn)(CPURISCVState *env, int csrno,
+                                 target_ulong *ret_value);
+typedef int (*riscv_csr_write_fn)(CPURISCVState *env, int csrno,
+                                  target_ulong new_value);
+
+typedef struct {
+    riscv_csr_predicate_fn predicate;
+    riscv_csr_read_fn read;
+    riscv_csr_write_fn write;
+    int flags;
+    size_t offset;
+    target_ulong wmask;
+} riscv_csr_operations;
+
+const riscv_csr_operations *riscv_get_csr_ops(int csrno);
+int riscv_csrrw(CPURISCVState *env, int csrno, target_ulong *ret_value,
+                target_ulong new_value, target_ulong write_mask);
+
 #ifndef CONFIG_USER_ONLY
 void riscv_set_local_interrupt(RISCVCPU *cpu, target_ulong mask, int value);
+void riscv_update_interrupt(RISCVCPU *cpu, target_ulong old_pending,
+                            target_ulong new_pending);
+void riscv_ptw_cache_flush(CPURISCVState *env);
+void riscv_gstage_cache_flush(CPURISCVState *env);
 #endif
 
 #include "exec/cpu-all.h"
@@ -29,6 +29,10 @@
 #define CSR_FFLAGS 0x1
 #define CSR_FRM 0x2
 #define CSR_FCSR 0x3
+#define CSR_VSTART 0x8
+#define CSR_VXSAT 0x9
+#define CSR_VXRM 0xa
+#define CSR_VCSR 0xf
 #define CSR_CYCLE 0xc00
 #define CSR_TIME 0xc01
 #define CSR_INSTRET 0xc02
@@ -61,6 +65,9 @@
 #define CSR_HPMCOUNTER29 0xc1d
 #define CSR_HPMCOUNTER30 0xc1e
 #define CSR_HPMCOUNTER31 0xc1f
+#define CSR_VL 0xc20
+#define CSR_VTYPE 0xc21
+#define CSR_VLENB 0xc22
 #define CSR_SSTATUS 0x100
 #define CSR_SIE 0x104
 #define CSR_STVEC 0x105
@@ -72,7 +79,29 @@
 #define CSR_SIP 0x144
 #define CSR_SPTBR 0x180
 #define CSR_SATP 0x180
+#define CSR_VSSTATUS 0x200
+#define CSR_VSIE 0x204
+#define CSR_VSTVEC 0x205
+#define CSR_VSSCRATCH 0x240
+#define CSR_VSEPC 0x241
+#define CSR_VSCAUSE 0x242
+#define CSR_VSTVAL 0x243
+#define CSR_VSIP 0x244
+#define CSR_VSATP 0x280
+#define CSR_HSTATUS 0x600
+#define CSR_HEDELEG 0x602
+#define CSR_HIDELEG 0x603
+#define CSR_HIE 0x604
+#define CSR_HCOUNTEREN 0x606
+#define CSR_HGEIE 0x607
+#define CSR_HTVAL 0x643
+#define CSR_HIP 0x644
+#define CSR_HVIP 0x645
+#define CSR_HTINST 0x64a
+#define CSR_HGATP 0x680
+#define CSR_HGEIP 0xe12
 #define CSR_MSTATUS 0x300
+#define CSR_MSTATUSH 0x310
 #define CSR_MISA 0x301
 #define CSR_MEDELEG 0x302
 #define CSR_MIDELEG 0x303
@@ -84,6 +113,8 @@
 #define CSR_MCAUSE 0x342
 #define CSR_MBADADDR 0x343
 #define CSR_MIP 0x344
+#define CSR_MTINST 0x34a
+#define CSR_MTVAL2 0x34b
 #define CSR_PMPCFG0 0x3a0
 #define CSR_PMPCFG1 0x3a1
 #define CSR_PMPCFG2 0x3a2
@@ -252,6 +283,7 @@
 #define MSTATUS_MPIE        0x00000080
 #define MSTATUS_SPP         0x00000100
 #define MSTATUS_HPP         0x00000600
+#define MSTATUS_VS          0x00000600 /* V extension */
 #define MSTATUS_MPP         0x00001800
 #define MSTATUS_FS          0x00006000
 #define MSTATUS_XS          0x00018000
@@ -266,6 +298,12 @@
 
 #define MSTATUS64_UXL       0x0000000300000000ULL
 #define MSTATUS64_SXL       0x0000000C00000000ULL
+#define MSTATUS64_GVA       0x0000004000000000ULL /* H extension */
+#define MSTATUS64_MPV       0x0000008000000000ULL /* H extension */
+
+/* mstatush bits, the upper half of mstatus on RV32 */
+#define MSTATUSH_GVA        0x00000040
+#define MSTATUSH_MPV        0x00000080
 
 #define MSTATUS32_SD        0x80000000
 #define MSTATUS64_SD        0x8000000000000000ULL
@@ -282,6 +320,7 @@
 #define SSTATUS_UPIE        0x00000010
 #define SSTATUS_SPIE        0x00000020
 #define SSTATUS_SPP         0x00000100
+#define SSTATUS_VS          0x00000600 /* V extension */
 #define SSTATUS_FS          0x00006000
 #define SSTATUS_XS          0x00018000
 #define SSTATUS_PUM         0x00040000 /* until: priv-1.9.1 */
@@ -297,6 +336,36 @@
 #define SSTATUS_SD SSTATUS64_SD
 #endif
 
+/* hstatus bits */
+#define HSTATUS_GVA         0x00000040
+#define HSTATUS_SPV         0x00000080
+#define HSTATUS_SPVP        0x00000100
+#define HSTATUS_HU          0x00000200
+#define HSTATUS_VTVM        0x00100000
+#define HSTATUS_VTW         0x00200000
+#define HSTATUS_VTSR        0x00400000
+
+/* hgatp modes and field masks, hgatp has a VMID in place of the ASID */
+#define HGATP_MODE_SV32X4   1
+#define HGATP_MODE_SV39X4   8
+#define HGATP_MODE_SV48X4   9
+
+#define HGATP32_VMID        0x1fc00000
+#define HGATP64_VMID        0x03FFF00000000000ULL
+
+#if defined(TARGET_RISCV32)
+#define HGATP_VMID HGATP32_VMID
+#elif defined(TARGET_RISCV64)
+#define HGATP_VMID HGATP64_VMID
+#endif
+
+/* vtype bits */
+#define VTYPE_VLMUL         0x00000007
+#define VTYPE_VSEW          0x00000038
+#define VTYPE_VTA           0x00000040
+#define VTYPE_VMA           0x00000080
+#define VTYPE_VILL          ((target_ulong)1 << (TARGET_LONG_BITS - 1))
+
 /* irqs */
 #define MIP_SSIP            (1 << IRQ_S_SOFT)
 #define MIP_HSIP            (1 << IRQ_H_SOFT)
@@ -308,6 +377,12 @@
 #define MIP_HEIP            (1 << IRQ_H_EXT)
 #define MIP_MEIP            (1 << IRQ_M_EXT)
 
+/* H extension, these replace the old H-mode interrupts */
+#define MIP_VSSIP           (1 << IRQ_VS_SOFT)
+#define MIP_VSTIP           (1 << IRQ_VS_TIMER)
+#define MIP_VSEIP           (1 << IRQ_VS_EXT)
+#define VS_MODE_INTERRUPTS  (MIP_VSSIP | MIP_VSTIP | MIP_VSEIP)
+
 #define SIP_SSIP            MIP_SSIP
 #define SIP_STIP            MIP_STIP
 #define SIP_SEIP            MIP_SEIP
@@ -347,6 +422,9 @@
 #define IRQ_H_EXT       10 /* until: priv-1.9.1 */
 #define IRQ_M_EXT       11 /* until: priv-1.9.1 */
 #define IRQ_X_COP       12 /* non-standard */
+#define IRQ_VS_SOFT     2  /* H extension */
+#define IRQ_VS_TIMER    6  /* H extension */
+#define IRQ_VS_EXT      10 /* H extension */
 
 /* Default addresses */
 #define DEFAULT_RSTVEC     0x00001000
@@ -387,10 +465,15 @@
                                                   fixes */
 #define RISCV_EXCP_S_ECALL                 0x9
 #define RISCV_EXCP_H_ECALL                 0xa
+#define RISCV_EXCP_VS_ECALL                0xa /* H extension */
 #define RISCV_EXCP_M_ECALL                 0xb
 #define RISCV_EXCP_INST_PAGE_FAULT         0xc /* since: priv-1.10.0 */
 #define RISCV_EXCP_LOAD_PAGE_FAULT         0xd /* since: priv-1.10.0 */
 #define RISCV_EXCP_STORE_PAGE_FAULT        0xf /* since: priv-1.10.0 */
+#define RISCV_EXCP_INST_GUEST_PAGE_FAULT   0x14 /* H extension */
+#define RISCV_EXCP_LOAD_GUEST_PAGE_FAULT   0x15
+#define RISCV_EXCP_VIRT_INSTRUCTION_FAULT  0x16
+#define RISCV_EXCP_STORE_GUEST_PAGE_FAULT  0x17
 
 #define RISCV_EXCP_INT_FLAG                0x80000000
 #define RISCV_EXCP_INT_MASK                0x7fffffff
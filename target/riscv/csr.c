@@ -0,0 +1,1186 @@
+/*
+ * RISC-V Control and Status Registers.
+ *
+ * Copyright (c) 2016-2017 Sagar Karandikar, sagark@eecs.berkeley.edu
+ * Copyright (c) 2017-2018 SiFive, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 or later, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/log.h"
+#include "cpu.h"
+#include "qemu/main-loop.h"
+#include "exec/exec-all.h"
+#include "exec/helper-proto.h"
+
+/*
+ * CSR accesses are dispatched through csr_ops[], indexed by CSR number.
+ * Each entry has a predicate, checked before any access, and read and
+ * write callbacks; all of them return 0 on success, -1 to raise an
+ * illegal instruction exception or RISCV_CSR_VIRT_FAULT to raise a
+ * virtual instruction one.  The privilege and read-only checks encoded
+ * in the CSR number itself are done by the callers.
+ *
+ * Adapted from Spike's processor_t::get_csr and processor_t::set_csr
+ */
+
+static const riscv_csr_operations csr_ops[CSR_TABLE_SIZE];
+
+/* Predicates */
+
+static int fs(CPURISCVState *env, int csrno)
+{
+#if !defined(CONFIG_USER_ONLY)
+    if (!riscv_cpu_ext_status(env, MSTATUS_FS)) {
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+static int ctr(CPURISCVState *env, int csrno)
+{
+#if !defined(CONFIG_USER_ONLY)
+    int bit = csrno & 31;
+    target_ulong ctr_en = env->priv == PRV_U ? env->scounteren :
+                          env->priv == PRV_S ? env->mcounteren : -1U;
+
+    if (env->virt_enabled) {
+        /* counters M-mode hides are illegal, those HS-mode hides virtual */
+        if (!((env->mcounteren >> bit) & 1)) {
+            return -1;
+        }
+        if (!((env->hcounteren >> bit) & 1) ||
+            (env->priv == PRV_U && !((env->scounteren >> bit) & 1))) {
+            return RISCV_CSR_VIRT_FAULT;
+        }
+        return 0;
+    }
+    if (!((ctr_en >> bit) & 1)) {
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+static int vs(CPURISCVState *env, int csrno)
+{
+    if (!riscv_has_ext(env, RVV)) {
+        return -1;
+    }
+#if !defined(CONFIG_USER_ONLY)
+    if (!riscv_cpu_ext_status(env, MSTATUS_VS)) {
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+#if !defined(CONFIG_USER_ONLY)
+static int any(CPURISCVState *env, int csrno)
+{
+    return 0;
+}
+
+static int priv_1_09(CPURISCVState *env, int csrno)
+{
+    return env->priv_ver <= PRIV_VERSION_1_09_1 ? 0 : -1;
+}
+
+static int priv_1_10(CPURISCVState *env, int csrno)
+{
+    return env->priv_ver >= PRIV_VERSION_1_10_0 ? 0 : -1;
+}
+
+/* the hypervisor and VS CSRs; V=1 accesses fault in validate_csr */
+static int hmode(CPURISCVState *env, int csrno)
+{
+    return riscv_has_ext(env, RVH) ? 0 : -1;
+}
+#endif
+
+/* CSRs backed by a plain env field, see RISCV_CSR_PLAIN */
+
+static int read_env(CPURISCVState *env, int csrno, target_ulong *val)
+{
+    *val = *(target_ulong *)((char *)env + csr_ops[csrno].offset);
+    return 0;
+}
+
+static int write_env(CPURISCVState *env, int csrno, target_ulong val)
+{
+    *(target_ulong *)((char *)env + csr_ops[csrno].offset) =
+        val & csr_ops[csrno].wmask;
+    return 0;
+}
+
+static int read_zero(CPURISCVState *env, int csrno, target_ulong *val)
+{
+    *val = 0;
+    return 0;
+}
+
+/* User Floating-Point CSRs */
+
+/* writes to the FP CSRs dirty the FP state like FP instructions do */
+static void mark_fs_dirty(CPURISCVState *env)
+{
+#if !defined(CONFIG_USER_ONLY)
+    env->mstatus |= MSTATUS_FS | MSTATUS_SD;
+#endif
+}
+
+static int read_fflags(CPURISCVState *env, int csrno, target_ulong *val)
+{
+    *val = cpu_riscv_get_fflags(env);
+    return 0;
+}
+
+static int write_fflags(CPURISCVState *env, int csrno, target_ulong val)
+{
+    cpu_riscv_set_fflags(env, val & (FSR_AEXC >> FSR_AEXC_SHIFT));
+    mark_fs_dirty(env);
+    return 0;
+}
+
+static int read_fcsr(CPURISCVState *env, int csrno, target_ulong *val)
+{
+    *val = (cpu_riscv_get_fflags(env) << FSR_AEXC_SHIFT)
+        | (env->frm << FSR_RD_SHIFT);
+    return 0;
+}
+
+static int write_fcsr(CPURISCVState *env, int csrno, target_ulong val)
+{
+    env->frm = (val & FSR_RD) >> FSR_RD_SHIFT;
+    cpu_riscv_set_fflags(env, (val & FSR_AEXC) >> FSR_AEXC_SHIFT);
+    mark_fs_dirty(env);
+    return 0;
+}
+
+/* User Vector CSRs */
+
+static int write_vstart(CPURISCVState *env, int csrno, target_ulong val)
+{
+    /* enough bits for the element index of LMUL=8, SEW=8 */
+    env->vstart = val & (riscv_env_get_cpu(env)->cfg.vlen - 1);
+    return 0;
+}
+
+static int read_vcsr(CPURISCVState *env, int csrno, target_ulong *val)
+{
+    *val = (env->vxrm << 1) | env->vxsat;
+    return 0;
+}
+
+static int write_vcsr(CPURISCVState *env, int csrno, target_ulong val)
+{
+    env->vxrm = (val >> 1) & 3;
+    env->vxsat = val & 1;
+    return 0;
+}
+
+static int read_vlenb(CPURISCVState *env, int csrno, target_ulong *val)
+{
+    *val = riscv_env_get_cpu(env)->cfg.vlen / 8;
+    return 0;
+}
+
+/* User Timers and Counters */
+
+static uint64_t get_ticks(CPURISCVState *env)
+{
+    if (riscv_env_get_cpu(env)->cfg.insn_count) {
+        /* the TB was counted in full on entry and ends after a counter
+           access, so leave out the reading instruction itself */
+        return env->instret - 1;
+    }
+#if !defined(CONFIG_USER_ONLY)
+    if (use_icount) {
+        return cpu_get_icount();
+    }
+#endif
+    return cpu_get_host_ticks();
+}
+
+static int read_instret(CPURISCVState *env, int csrno, target_ulong *val)
+{
+    *val = get_ticks(env);
+    return 0;
+}
+
+#if !defined(CONFIG_USER_ONLY)
+static int write_instret(CPURISCVState *env, int csrno, target_ulong val)
+{
+    /* only the instruction counter is writable, other sources are WARL */
+    if (riscv_env_get_cpu(env)->cfg.insn_count) {
+#if defined(TARGET_RISCV32)
+        env->instret = deposit64(env->instret, 0, 32, val);
+#else
+        env->instret = val;
+#endif
+    }
+    return 0;
+}
+#endif
+
+#if defined(TARGET_RISCV32)
+static int read_instreth(CPURISCVState *env, int csrno, target_ulong *val)
+{
+    *val = get_ticks(env) >> 32;
+    return 0;
+}
+
+#if !defined(CONFIG_USER_ONLY)
+static int write_instreth(CPURISCVState *env, int csrno, target_ulong val)
+{
+    if (riscv_env_get_cpu(env)->cfg.insn_count) {
+        env->instret = deposit64(env->instret, 32, 32, val);
+    }
+    return 0;
+}
+#endif
+#endif
+
+/* Hardware Performance Monitor, counters 3 to 31 as env index 0 to 28 */
+
+static uint64_t get_hpmcounter(CPURISCVState *env, int csrno)
+{
+    int i = (csrno & 31) - 3;
+
+    return env->hpm_count[env->mhpmevent[i]] + env->mhpmcounter_offset[i];
+}
+
+static int read_hpmcounter(CPURISCVState *env, int csrno, target_ulong *val)
+{
+    *val = get_hpmcounter(env, csrno);
+    return 0;
+}
+
+#if defined(TARGET_RISCV32)
+static int read_hpmcounterh(CPURISCVState *env, int csrno, target_ulong *val)
+{
+    *val = get_hpmcounter(env, csrno) >> 32;
+    return 0;
+}
+#endif
+
+#if !defined(CONFIG_USER_ONLY)
+static void set_hpmcounter(CPURISCVState *env, int csrno, uint64_t val)
+{
+    int i = (csrno & 31) - 3;
+
+    env->mhpmcounter_offset[i] = val - env->hpm_count[env->mhpmevent[i]];
+}
+
+static int write_mhpmcounter(CPURISCVState *env, int csrno, target_ulong val)
+{
+#if defined(TARGET_RISCV32)
+    set_hpmcounter(env, csrno, deposit64(get_hpmcounter(env, csrno),
+                                         0, 32, val));
+#else
+    set_hpmcounter(env, csrno, val);
+#endif
+    return 0;
+}
+
+#if defined(TARGET_RISCV32)
+static int write_mhpmcounterh(CPURISCVState *env, int csrno, target_ulong val)
+{
+    set_hpmcounter(env, csrno, deposit64(get_hpmcounter(env, csrno),
+                                         32, 32, val));
+    return 0;
+}
+#endif
+
+static int read_mhpmevent(CPURISCVState *env, int csrno, target_ulong *val)
+{
+    *val = env->mhpmevent[(csrno & 31) - 3];
+    return 0;
+}
+
+static int write_mhpmevent(CPURISCVState *env, int csrno, target_ulong val)
+{
+    uint64_t count = get_hpmcounter(env, csrno);
+    uint32_t tb_flags = 0;
+    int i;
+
+    /* WARL: unsupported events select no event */
+    env->mhpmevent[(csrno & 31) - 3] = val < RISCV_HPM_EVENT_MAX ?
+                                       val : RISCV_HPM_EVENT_NONE;
+    set_hpmcounter(env, csrno, count);
+
+    /* code counting an event is only generated while some counter is
+       programmed for it */
+    for (i = 0; i < RISCV_HPM_COUNTERS; i++) {
+        tb_flags |= TB_FLAGS_HPM(env->mhpmevent[i]);
+    }
+    env->hpm_tb_flags = tb_flags & TB_FLAGS_HPM_MASK;
+    return 0;
+}
+#endif
+
+/*
+ * time reads the platform timer, the same clock as the CLINT mtime.
+ * In linux-user mode it counts nanoseconds of the host's CLOCK_MONOTONIC,
+ * which is what the vDSO expects.
+ */
+static uint64_t get_time(CPURISCVState *env)
+{
+#if !defined(CONFIG_USER_ONLY)
+    return env->rdtime_fn();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static int rdtime(CPURISCVState *env, int csrno)
+{
+#if !defined(CONFIG_USER_ONLY)
+    /* without a timer device, leave rdtime to be emulated by firmware */
+    if (!env->rdtime_fn) {
+        return -1;
+    }
+#endif
+    return ctr(env, csrno);
+}
+
+static int read_time(CPURISCVState *env, int csrno, target_ulong *val)
+{
+    *val = get_time(env);
+    return 0;
+}
+
+#if defined(TARGET_RISCV32)
+static int read_timeh(CPURISCVState *env, int csrno, target_ulong *val)
+{
+    *val = get_time(env) >> 32;
+    return 0;
+}
+#endif
+
+#if !defined(CONFIG_USER_ONLY)
+
+/* Machine constants */
+
+static const target_ulong delegable_ints = MIP_SSIP | MIP_STIP | MIP_SEIP |
+                                           (1 << IRQ_X_COP);
+static const target_ulong all_ints = MIP_SSIP | MIP_STIP | MIP_SEIP |
+                                     (1 << IRQ_X_COP) | MIP_MSIP | MIP_MTIP;
+static const target_ulong delegable_excps =
+    (1ULL << (RISCV_EXCP_INST_ADDR_MIS)) |
+    (1ULL << (RISCV_EXCP_INST_ACCESS_FAULT)) |
+    (1ULL << (RISCV_EXCP_ILLEGAL_INST)) |
+    (1ULL << (RISCV_EXCP_BREAKPOINT)) |
+    (1ULL << (RISCV_EXCP_LOAD_ADDR_MIS)) |
+    (1ULL << (RISCV_EXCP_LOAD_ACCESS_FAULT)) |
+    (1ULL << (RISCV_EXCP_STORE_AMO_ADDR_MIS)) |
+    (1ULL << (RISCV_EXCP_STORE_AMO_ACCESS_FAULT)) |
+    (1ULL << (RISCV_EXCP_U_ECALL)) |
+    (1ULL << (RISCV_EXCP_S_ECALL)) |
+    (1ULL << (RISCV_EXCP_H_ECALL)) |
+    (1ULL << (RISCV_EXCP_M_ECALL)) |
+    (1ULL << (RISCV_EXCP_INST_PAGE_FAULT)) |
+    (1ULL << (RISCV_EXCP_LOAD_PAGE_FAULT)) |
+    (1ULL << (RISCV_EXCP_STORE_PAGE_FAULT)) |
+    (1ULL << (RISCV_EXCP_INST_GUEST_PAGE_FAULT)) |
+    (1ULL << (RISCV_EXCP_LOAD_GUEST_PAGE_FAULT)) |
+    (1ULL << (RISCV_EXCP_VIRT_INSTRUCTION_FAULT)) |
+    (1ULL << (RISCV_EXCP_STORE_GUEST_PAGE_FAULT));
+/* traps that are never taken in VS-mode stay in HS-mode */
+static const target_ulong vs_delegable_excps = delegable_excps &
+    ~((1ULL << (RISCV_EXCP_S_ECALL)) |
+      (1ULL << (RISCV_EXCP_VS_ECALL)) |
+      (1ULL << (RISCV_EXCP_M_ECALL)) |
+      (1ULL << (RISCV_EXCP_INST_GUEST_PAGE_FAULT)) |
+      (1ULL << (RISCV_EXCP_LOAD_GUEST_PAGE_FAULT)) |
+      (1ULL << (RISCV_EXCP_VIRT_INSTRUCTION_FAULT)) |
+      (1ULL << (RISCV_EXCP_STORE_GUEST_PAGE_FAULT)));
+static const target_ulong sstatus_v1_9_mask = SSTATUS_SIE | SSTATUS_SPIE |
+    SSTATUS_UIE | SSTATUS_UPIE | SSTATUS_SPP | SSTATUS_FS | SSTATUS_XS |
+    SSTATUS_SUM | SSTATUS_SD;
+static const target_ulong sstatus_v1_10_mask = SSTATUS_SIE | SSTATUS_SPIE |
+    SSTATUS_UIE | SSTATUS_UPIE | SSTATUS_SPP | SSTATUS_FS | SSTATUS_XS |
+    SSTATUS_SUM | SSTATUS_MXR | SSTATUS_SD | SSTATUS_VS;
+
+#if defined(TARGET_RISCV32)
+static const char valid_hgatp_mode[16] = {
+    [VM_1_10_MBARE] = 1,
+    [HGATP_MODE_SV32X4] = 1,
+};
+static const char valid_vm_1_09[16] = {
+    [VM_1_09_MBARE] = 1,
+    [VM_1_09_SV32] = 1,
+};
+static const char valid_vm_1_10[16] = {
+    [VM_1_10_MBARE] = 1,
+    [VM_1_10_SV32] = 1
+};
+#elif defined(TARGET_RISCV64)
+static const char valid_hgatp_mode[16] = {
+    [VM_1_10_MBARE] = 1,
+    [HGATP_MODE_SV39X4] = 1,
+    [HGATP_MODE_SV48X4] = 1,
+};
+static const char valid_vm_1_09[16] = {
+    [VM_1_09_MBARE] = 1,
+    [VM_1_09_SV39] = 1,
+    [VM_1_09_SV48] = 1,
+};
+static const char valid_vm_1_10[16] = {
+    [VM_1_10_MBARE] = 1,
+    [VM_1_10_SV39] = 1,
+    [VM_1_10_SV48] = 1,
+    [VM_1_10_SV57] = 1
+};
+#endif
+
+static int validate_vm(CPURISCVState *env, target_ulong vm)
+{
+    return (env->priv_ver >= PRIV_VERSION_1_10_0) ?
+        valid_vm_1_10[vm & 0xf] : valid_vm_1_09[vm & 0xf];
+}
+
+/* Machine Timers and Counters */
+
+static int write_warl_ignore(CPURISCVState *env, int csrno, target_ulong val)
+{
+    /* WARL register with no writable fields, so writes are ignored */
+    return 0;
+}
+
+/* Machine Trap Setup */
+
+static int write_mstatus(CPURISCVState *env, int csrno, target_ulong val)
+{
+    target_ulong mstatus = env->mstatus;
+    target_ulong mask = 0;
+    target_ulong mpp = get_field(val, MSTATUS_MPP);
+
+    /* flush tlb on mstatus fields that affect VM */
+    if (env->priv_ver <= PRIV_VERSION_1_09_1) {
+        if ((val ^ mstatus) & (MSTATUS_MXR | MSTATUS_MPP |
+                MSTATUS_MPRV | MSTATUS_SUM | MSTATUS_VM)) {
+            helper_tlb_flush(env);
+        }
+        mask = MSTATUS_SIE | MSTATUS_SPIE | MSTATUS_MIE | MSTATUS_MPIE |
+            MSTATUS_SPP | MSTATUS_FS | MSTATUS_MPRV | MSTATUS_SUM |
+            MSTATUS_MPP | MSTATUS_MXR |
+            (validate_vm(env, get_field(val, MSTATUS_VM)) ?
+                MSTATUS_VM : 0);
+    }
+    if (env->priv_ver >= PRIV_VERSION_1_10_0) {
+        if ((val ^ mstatus) & (MSTATUS_MXR | MSTATUS_MPP |
+                MSTATUS_MPRV | MSTATUS_SUM)) {
+            helper_tlb_flush(env);
+        }
+        mask = MSTATUS_SIE | MSTATUS_SPIE | MSTATUS_MIE | MSTATUS_MPIE |
+            MSTATUS_SPP | MSTATUS_FS | MSTATUS_MPRV | MSTATUS_SUM |
+            MSTATUS_MPP | MSTATUS_MXR;
+        if (riscv_has_ext(env, RVV)) {
+            mask |= MSTATUS_VS;
+        }
+#if defined(TARGET_RISCV64)
+        if (riscv_has_ext(env, RVH)) {
+            /* MPV changes how MPRV loads and stores are translated */
+            if ((val ^ mstatus) & MSTATUS64_MPV) {
+                helper_tlb_flush(env);
+            }
+            mask |= MSTATUS64_MPV | MSTATUS64_GVA;
+        }
+#endif
+    }
+
+    /* silenty discard mstatus.mpp writes for unsupported modes */
+    if (mpp == PRV_H ||
+        (!riscv_has_ext(env, RVS) && mpp == PRV_S) ||
+        (!riscv_has_ext(env, RVU) && mpp == PRV_U)) {
+        mask &= ~MSTATUS_MPP;
+    }
+
+    mstatus = (mstatus & ~mask) | (val & mask);
+
+    /* FP instructions set mstatus.FS to dirty, see mark_fs_dirty in
+       translate.c.  The vector state is not tracked, it is legal to
+       only report it off or dirty, at the expense of extra vector
+       save/restore. */
+    if (mstatus & MSTATUS_VS) {
+        mstatus |= MSTATUS_VS;
+    }
+
+    int dirty = ((mstatus & MSTATUS_FS) == MSTATUS_FS) |
+                ((mstatus & MSTATUS_XS) == MSTATUS_XS) |
+                ((mstatus & MSTATUS_VS) == MSTATUS_VS);
+    mstatus = set_field(mstatus, MSTATUS_SD, dirty);
+    env->mstatus = mstatus;
+
+    return 0;
+}
+
+#if defined(TARGET_RISCV32)
+static int write_mstatush(CPURISCVState *env, int csrno, target_ulong val)
+{
+    if ((val ^ env->mstatush) & MSTATUSH_MPV) {
+        helper_tlb_flush(env);
+    }
+    env->mstatush = val & (MSTATUSH_MPV | MSTATUSH_GVA);
+    return 0;
+}
+#endif
+
+static int write_medeleg(CPURISCVState *env, int csrno, target_ulong val)
+{
+    env->medeleg = (env->medeleg & ~delegable_excps) | (val & delegable_excps);
+    return 0;
+}
+
+static int write_mideleg(CPURISCVState *env, int csrno, target_ulong val)
+{
+    env->mideleg = (env->mideleg & ~delegable_ints) | (val & delegable_ints);
+    if (riscv_has_ext(env, RVH)) {
+        /* VS-level interrupts are always delegated to HS-mode */
+        env->mideleg |= VS_MODE_INTERRUPTS;
+    }
+    return 0;
+}
+
+static int write_mie(CPURISCVState *env, int csrno, target_ulong val)
+{
+    target_ulong old_mie = env->mie;
+    target_ulong mask = all_ints;
+    target_ulong mip;
+
+    if (riscv_has_ext(env, RVH)) {
+        mask |= VS_MODE_INTERRUPTS;
+    }
+    atomic_set(&env->mie, (old_mie & ~mask) | (val & mask));
+    /* pairs with riscv_set_local_interrupt: one of us sees both updates */
+    smp_mb();
+    mip = atomic_read(&env->mip);
+    riscv_update_interrupt(riscv_env_get_cpu(env), mip & old_mie,
+                           mip & env->mie);
+    return 0;
+}
+
+static int write_mtvec(CPURISCVState *env, int csrno, target_ulong val)
+{
+    /* bits [1:0] indicate mode; 0 = direct, 1 = vectored, 2 >= reserved */
+    if ((val & 3) == 0) {
+        env->mtvec = val >> 2 << 2;
+    } else {
+        qemu_log_mask(LOG_UNIMP, "CSR_MTVEC: vectored traps not supported\n");
+    }
+    return 0;
+}
+
+static int read_mcounteren(CPURISCVState *env, int csrno, target_ulong *val)
+{
+    *val = env->mcounteren;
+    return 0;
+}
+
+static int write_mcounteren(CPURISCVState *env, int csrno, target_ulong val)
+{
+    env->mcounteren = val;
+    return 0;
+}
+
+static int read_scounteren(CPURISCVState *env, int csrno, target_ulong *val)
+{
+    *val = env->scounteren;
+    return 0;
+}
+
+static int write_scounteren(CPURISCVState *env, int csrno, target_ulong val)
+{
+    env->scounteren = val;
+    return 0;
+}
+
+/* Machine Trap Handling */
+
+static int read_mip(CPURISCVState *env, int csrno, target_ulong *val)
+{
+    *val = atomic_read(&env->mip);
+    return 0;
+}
+
+static int write_mip(CPURISCVState *env, int csrno, target_ulong val)
+{
+    RISCVCPU *cpu = riscv_env_get_cpu(env);
+
+    /*
+     * Since the writeable bits in MIP are not set asynchrously by the
+     * CLINT, no additional locking is needed for read-modifiy-write
+     * CSR operations
+     */
+    riscv_set_local_interrupt(cpu, MIP_SSIP, (val & MIP_SSIP) != 0);
+    riscv_set_local_interrupt(cpu, MIP_STIP, (val & MIP_STIP) != 0);
+    if (riscv_has_ext(env, RVH)) {
+        /* an alias of hvip.VSSIP */
+        riscv_set_local_interrupt(cpu, MIP_VSSIP, (val & MIP_VSSIP) != 0);
+    }
+    /*
+     * csrs, csrc on mip.SEIP is not decomposable into separate read and
+     * write steps, so a different implementation is needed
+     */
+    return 0;
+}
+
+/* Supervisor Trap Setup */
+
+static int read_sstatus(CPURISCVState *env, int csrno, target_ulong *val)
+{
+    target_ulong mask = ((env->priv_ver >= PRIV_VERSION_1_10_0) ?
+                         sstatus_v1_10_mask : sstatus_v1_9_mask);
+    *val = env->mstatus & mask;
+    return 0;
+}
+
+static int write_sstatus(CPURISCVState *env, int csrno, target_ulong val)
+{
+    target_ulong mask = ((env->priv_ver >= PRIV_VERSION_1_10_0) ?
+                         sstatus_v1_10_mask : sstatus_v1_9_mask);
+    target_ulong newval = (env->mstatus & ~mask) | (val & mask);
+    return write_mstatus(env, CSR_MSTATUS, newval);
+}
+
+static int read_vsie(CPURISCVState *env, int csrno, target_ulong *val);
+static int write_vsie(CPURISCVState *env, int csrno, target_ulong val);
+static int read_vsip(CPURISCVState *env, int csrno, target_ulong *val);
+static int write_vsip(CPURISCVState *env, int csrno, target_ulong val);
+
+static int read_sie(CPURISCVState *env, int csrno, target_ulong *val)
+{
+    if (env->virt_enabled) {
+        return read_vsie(env, CSR_VSIE, val);
+    }
+    *val = env->mie & env->mideleg & ~VS_MODE_INTERRUPTS;
+    return 0;
+}
+
+static int write_sie(CPURISCVState *env, int csrno, target_ulong val)
+{
+    target_ulong mask = env->mideleg & ~VS_MODE_INTERRUPTS;
+
+    if (env->virt_enabled) {
+        return write_vsie(env, CSR_VSIE, val);
+    }
+    return write_mie(env, CSR_MIE, (env->mie & ~mask) | (val & mask));
+}
+
+static int write_stvec(CPURISCVState *env, int csrno, target_ulong val)
+{
+    /* bits [1:0] encode mode; 0 = direct, 1 = vectored, 2 >= reserved */
+    if ((val & 3) == 0) {
+        env->stvec = val >> 2 << 2;
+    } else {
+        qemu_log_mask(LOG_UNIMP, "CSR_STVEC: vectored traps not supported\n");
+    }
+    return 0;
+}
+
+/* Supervisor Trap Handling */
+
+static int read_sip(CPURISCVState *env, int csrno, target_ulong *val)
+{
+    if (env->virt_enabled) {
+        return read_vsip(env, CSR_VSIP, val);
+    }
+    qemu_mutex_lock_iothread();
+    *val = env->mip & env->mideleg & ~VS_MODE_INTERRUPTS;
+    qemu_mutex_unlock_iothread();
+    return 0;
+}
+
+static int write_sip(CPURISCVState *env, int csrno, target_ulong val)
+{
+    target_ulong mask = env->mideleg & ~VS_MODE_INTERRUPTS;
+
+    if (env->virt_enabled) {
+        return write_vsip(env, CSR_VSIP, val);
+    }
+    qemu_mutex_lock_iothread();
+    target_ulong newval = (env->mip & ~mask) | (val & mask);
+    qemu_mutex_unlock_iothread();
+    return write_mip(env, CSR_MIP, newval);
+}
+
+/* Supervisor Protection and Translation */
+
+static int read_vsatp(CPURISCVState *env, int csrno, target_ulong *val);
+static int write_vsatp(CPURISCVState *env, int csrno, target_ulong val);
+
+static int read_satp(CPURISCVState *env, int csrno, target_ulong *val)
+{
+    if (env->virt_enabled) {
+        if (get_field(env->hstatus, HSTATUS_VTVM)) {
+            return RISCV_CSR_VIRT_FAULT;
+        }
+        return read_vsatp(env, CSR_VSATP, val);
+    }
+    if (!riscv_feature(env, RISCV_FEATURE_MMU)) {
+        *val = 0;
+    } else if (env->priv_ver >= PRIV_VERSION_1_10_0) {
+        *val = env->satp;
+    } else {
+        *val = env->sptbr;
+    }
+    return 0;
+}
+
+static int write_satp(CPURISCVState *env, int csrno, target_ulong val)
+{
+    if (env->virt_enabled) {
+        if (get_field(env->hstatus, HSTATUS_VTVM)) {
+            return RISCV_CSR_VIRT_FAULT;
+        }
+        return write_vsatp(env, CSR_VSATP, val);
+    }
+    if (!riscv_feature(env, RISCV_FEATURE_MMU)) {
+        return 0;
+    }
+    if (env->priv_ver <= PRIV_VERSION_1_09_1 && (val ^ env->sptbr)) {
+        helper_tlb_flush(env);
+        env->sptbr = val & (((target_ulong)
+            1 << (TARGET_PHYS_ADDR_SPACE_BITS - PGSHIFT)) - 1);
+    }
+    if (env->priv_ver >= PRIV_VERSION_1_10_0 &&
+        validate_vm(env, get_field(val, SATP_MODE)) &&
+        ((val ^ env->satp) & (SATP_MODE | SATP_ASID | SATP_PPN)))
+    {
+        helper_tlb_flush(env);
+        env->satp = val;
+    }
+    return 0;
+}
+
+/* Hypervisor Trap Setup and Handling */
+
+static int write_hstatus(CPURISCVState *env, int csrno, target_ulong val)
+{
+    target_ulong mask = HSTATUS_GVA | HSTATUS_SPV | HSTATUS_SPVP |
+                        HSTATUS_HU | HSTATUS_VTVM | HSTATUS_VTW |
+                        HSTATUS_VTSR;
+
+    env->hstatus = (env->hstatus & ~mask) | (val & mask);
+    return 0;
+}
+
+static int write_hedeleg(CPURISCVState *env, int csrno, target_ulong val)
+{
+    env->hedeleg = val & vs_delegable_excps;
+    return 0;
+}
+
+static int write_hideleg(CPURISCVState *env, int csrno, target_ulong val)
+{
+    env->hideleg = val & VS_MODE_INTERRUPTS;
+    return 0;
+}
+
+static int read_hie(CPURISCVState *env, int csrno, target_ulong *val)
+{
+    *val = env->mie & VS_MODE_INTERRUPTS;
+    return 0;
+}
+
+static int write_hie(CPURISCVState *env, int csrno, target_ulong val)
+{
+    target_ulong newval = (env->mie & ~VS_MODE_INTERRUPTS) |
+                          (val & VS_MODE_INTERRUPTS);
+    return write_mie(env, CSR_MIE, newval);
+}
+
+static int read_hip(CPURISCVState *env, int csrno, target_ulong *val)
+{
+    *val = atomic_read(&env->mip) & VS_MODE_INTERRUPTS;
+    return 0;
+}
+
+static int write_hip(CPURISCVState *env, int csrno, target_ulong val)
+{
+    riscv_set_local_interrupt(riscv_env_get_cpu(env), MIP_VSSIP,
+                              (val & MIP_VSSIP) != 0);
+    return 0;
+}
+
+/* pending bits injected by the hypervisor, there is no other VS source */
+static int write_hvip(CPURISCVState *env, int csrno, target_ulong val)
+{
+    RISCVCPU *cpu = riscv_env_get_cpu(env);
+
+    riscv_set_local_interrupt(cpu, MIP_VSSIP, (val & MIP_VSSIP) != 0);
+    riscv_set_local_interrupt(cpu, MIP_VSTIP, (val & MIP_VSTIP) != 0);
+    riscv_set_local_interrupt(cpu, MIP_VSEIP, (val & MIP_VSEIP) != 0);
+    return 0;
+}
+
+/* Hypervisor Protection and Translation */
+
+static int write_hgatp(CPURISCVState *env, int csrno, target_ulong val)
+{
+    CPUState *cs = CPU(riscv_env_get_cpu(env));
+
+    if (!valid_hgatp_mode[get_field(val, SATP_MODE) & 0xf]) {
+        return 0;
+    }
+    /* the x4 root tables are 16KiB aligned */
+    val &= ~(target_ulong)3;
+    if ((val ^ env->hgatp) & (SATP_MODE | HGATP_VMID | SATP_PPN)) {
+        riscv_gstage_cache_flush(env);
+        tlb_flush_by_mmuidx(cs, RISCV_MMU_VIRT_IDXMAP | (1 << PRV_M));
+        env->hgatp = val;
+    }
+    return 0;
+}
+
+/* Virtual Supervisor Registers */
+
+static int read_vsie(CPURISCVState *env, int csrno, target_ulong *val)
+{
+    *val = (env->mie & env->hideleg & VS_MODE_INTERRUPTS) >> 1;
+    return 0;
+}
+
+static int write_vsie(CPURISCVState *env, int csrno, target_ulong val)
+{
+    target_ulong mask = env->hideleg & VS_MODE_INTERRUPTS;
+    target_ulong newval = (env->mie & ~mask) | ((val << 1) & mask);
+    return write_mie(env, CSR_MIE, newval);
+}
+
+static int write_vstvec(CPURISCVState *env, int csrno, target_ulong val)
+{
+    if ((val & 3) == 0) {
+        env->vstvec = val >> 2 << 2;
+    } else {
+        qemu_log_mask(LOG_UNIMP, "CSR_VSTVEC: vectored traps not supported\n");
+    }
+    return 0;
+}
+
+static int read_vsip(CPURISCVState *env, int csrno, target_ulong *val)
+{
+    *val = (atomic_read(&env->mip) & env->hideleg & VS_MODE_INTERRUPTS) >> 1;
+    return 0;
+}
+
+static int write_vsip(CPURISCVState *env, int csrno, target_ulong val)
+{
+    if (env->hideleg & MIP_VSSIP) {
+        riscv_set_local_interrupt(riscv_env_get_cpu(env), MIP_VSSIP,
+                                  (val & MIP_SSIP) != 0);
+    }
+    return 0;
+}
+
+static int read_vsatp(CPURISCVState *env, int csrno, target_ulong *val)
+{
+    *val = env->vsatp;
+    return 0;
+}
+
+static int write_vsatp(CPURISCVState *env, int csrno, target_ulong val)
+{
+    CPUState *cs = CPU(riscv_env_get_cpu(env));
+
+    if (validate_vm(env, get_field(val, SATP_MODE)) &&
+        ((val ^ env->vsatp) & (SATP_MODE | SATP_ASID | SATP_PPN))) {
+        riscv_ptw_cache_flush(env);
+        tlb_flush_by_mmuidx(cs, RISCV_MMU_VIRT_IDXMAP);
+        env->vsatp = val;
+    }
+    return 0;
+}
+
+/* Physical Memory Protection */
+
+static int read_pmpcfg(CPURISCVState *env, int csrno, target_ulong *val)
+{
+    *val = pmpcfg_csr_read(env, csrno - CSR_PMPCFG0);
+    return 0;
+}
+
+static int write_pmpcfg(CPURISCVState *env, int csrno, target_ulong val)
+{
+    pmpcfg_csr_write(env, csrno - CSR_PMPCFG0, val);
+    return 0;
+}
+
+static int read_pmpaddr(CPURISCVState *env, int csrno, target_ulong *val)
+{
+    *val = pmpaddr_csr_read(env, csrno - CSR_PMPADDR0);
+    return 0;
+}
+
+static int write_pmpaddr(CPURISCVState *env, int csrno, target_ulong val)
+{
+    pmpaddr_csr_write(env, csrno - CSR_PMPADDR0, val);
+    return 0;
+}
+
+#endif /* !CONFIG_USER_ONLY */
+
+/* Entry accessors */
+
+const riscv_csr_operations *riscv_get_csr_ops(int csrno)
+{
+    if (csrno < 0 || csrno >= CSR_TABLE_SIZE || !csr_ops[csrno].predicate) {
+        return NULL;
+    }
+    return &csr_ops[csrno];
+}
+
+/*
+ * riscv_csrrw - read and/or update a CSR
+ *
+ * The old value is returned in *ret_value unless it is NULL.  The CSR is
+ * written with (old & ~write_mask) | (new_value & write_mask) if write_mask
+ * is non-zero.  Returns 0 on success, -1 if the access is illegal or
+ * RISCV_CSR_VIRT_FAULT if it is only illegal while V=1.
+ */
+int riscv_csrrw(CPURISCVState *env, int csrno, target_ulong *ret_value,
+                target_ulong new_value, target_ulong write_mask)
+{
+    const riscv_csr_operations *ops = riscv_get_csr_ops(csrno);
+    target_ulong old_value = 0;
+
+    int ret;
+
+    if (!ops) {
+        return -1;
+    }
+    ret = ops->predicate(env, csrno);
+    if (ret < 0) {
+        return ret;
+    }
+    ret = ops->read(env, csrno, &old_value);
+    if (ret < 0) {
+        return ret;
+    }
+    if (write_mask) {
+        if (!ops->write) {
+            return -1;
+        }
+        new_value = (old_value & ~write_mask) | (new_value & write_mask);
+        ret = ops->write(env, csrno, new_value);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+    if (ret_value) {
+        *ret_value = old_value;
+    }
+    return 0;
+}
+
+/*
+ * Accessors for code outside the CSR instructions (gdbstub, signal frames,
+ * trap entry).  Illegal accesses read as zero and ignore writes.
+ */
+target_ulong csr_read_helper(CPURISCVState *env, target_ulong csrno)
+{
+    target_ulong val = 0;
+    riscv_csrrw(env, csrno, &val, 0, 0);
+    return val;
+}
+
+void csr_write_helper(CPURISCVState *env, target_ulong val_to_write,
+        target_ulong csrno)
+{
+    riscv_csrrw(env, csrno, NULL, val_to_write, -1);
+}
+
+#define CSR_ENV(pred, field, wmask, flags) \
+    { pred, read_env, write_env, (flags) | RISCV_CSR_PLAIN, \
+      offsetof(CPURISCVState, field), (wmask) }
+
+/* Control and Status Register function table */
+static const riscv_csr_operations csr_ops[CSR_TABLE_SIZE] = {
+    /* User Floating-Point CSRs */
+    [CSR_FFLAGS] =              { fs, read_fflags, write_fflags,
+                                  RISCV_CSR_NO_EXIT },
+    /* frm is part of the TB flags */
+    [CSR_FRM] =                 CSR_ENV(fs, frm, FSR_RD >> FSR_RD_SHIFT, 0),
+    [CSR_FCSR] =                { fs, read_fcsr, write_fcsr },
+
+    /* User Vector CSRs, vstart, vl and vtype are part of the TB flags */
+    [CSR_VSTART] =              { vs, read_env, write_vstart, 0,
+                                  offsetof(CPURISCVState, vstart) },
+    [CSR_VXSAT] =               CSR_ENV(vs, vxsat, 1, RISCV_CSR_NO_EXIT),
+    [CSR_VXRM] =                CSR_ENV(vs, vxrm, 3, RISCV_CSR_NO_EXIT),
+    [CSR_VCSR] =                { vs, read_vcsr, write_vcsr,
+                                  RISCV_CSR_NO_EXIT },
+    [CSR_VL] =                  { vs, read_env, NULL,
+                                  RISCV_CSR_PLAIN | RISCV_CSR_NO_EXIT,
+                                  offsetof(CPURISCVState, vl) },
+    [CSR_VTYPE] =               { vs, read_env, NULL,
+                                  RISCV_CSR_PLAIN | RISCV_CSR_NO_EXIT,
+                                  offsetof(CPURISCVState, vtype) },
+    [CSR_VLENB] =               { vs, read_vlenb, NULL, RISCV_CSR_NO_EXIT },
+
+    /* User Timers and Counters */
+    [CSR_CYCLE] =               { ctr, read_instret },
+    [CSR_INSTRET] =             { ctr, read_instret },
+    [CSR_HPMCOUNTER3 ... CSR_HPMCOUNTER31] = { ctr, read_hpmcounter, NULL,
+                                                RISCV_CSR_NO_EXIT },
+#if defined(TARGET_RISCV32)
+    [CSR_CYCLEH] =              { ctr, read_instreth },
+    [CSR_INSTRETH] =            { ctr, read_instreth },
+    [CSR_HPMCOUNTER3H ... CSR_HPMCOUNTER31H] = { ctr, read_hpmcounterh, NULL,
+                                                  RISCV_CSR_NO_EXIT },
+#endif
+    [CSR_TIME] =                { rdtime, read_time, NULL, RISCV_CSR_NO_EXIT },
+#if defined(TARGET_RISCV32)
+    [CSR_TIMEH] =               { rdtime, read_timeh, NULL,
+                                  RISCV_CSR_NO_EXIT },
+#endif
+
+#if !defined(CONFIG_USER_ONLY)
+    /* Machine Timers and Counters */
+    [CSR_MCYCLE] =              { any, read_instret, write_instret },
+    [CSR_MINSTRET] =            { any, read_instret, write_instret },
+#if defined(TARGET_RISCV32)
+    [CSR_MCYCLEH] =             { any, read_instreth, write_instreth },
+    [CSR_MINSTRETH] =           { any, read_instreth, write_instreth },
+#endif
+    [CSR_MHPMCOUNTER3 ... CSR_MHPMCOUNTER31] = { any, read_hpmcounter,
+                                                  write_mhpmcounter,
+                                                  RISCV_CSR_NO_EXIT },
+#if defined(TARGET_RISCV32)
+    [CSR_MHPMCOUNTER3H ... CSR_MHPMCOUNTER31H] = { any, read_hpmcounterh,
+                                                    write_mhpmcounterh,
+                                                    RISCV_CSR_NO_EXIT },
+#endif
+    /* mhpmevent changes the TB flags */
+    [CSR_MHPMEVENT3 ... CSR_MHPMEVENT31] = { any, read_mhpmevent,
+                                              write_mhpmevent },
+
+    /* Machine Information Registers */
+    [CSR_MVENDORID] =           { any, read_zero, NULL, RISCV_CSR_NO_EXIT },
+    [CSR_MARCHID] =             { any, read_zero, NULL, RISCV_CSR_NO_EXIT },
+    [CSR_MIMPID] =              { any, read_zero, NULL, RISCV_CSR_NO_EXIT },
+    [CSR_MHARTID] =             { any, read_env, NULL,
+                                  RISCV_CSR_NO_EXIT | RISCV_CSR_PLAIN,
+                                  offsetof(CPURISCVState, mhartid) },
+
+    /* Machine Trap Setup */
+    [CSR_MSTATUS] =             { any, read_env, write_mstatus, 0,
+                                  offsetof(CPURISCVState, mstatus) },
+    [CSR_MISA] =                { any, read_env, write_warl_ignore,
+                                  RISCV_CSR_NO_EXIT,
+                                  offsetof(CPURISCVState, misa) },
+    [CSR_MEDELEG] =             { any, read_env, write_medeleg,
+                                  RISCV_CSR_NO_EXIT,
+                                  offsetof(CPURISCVState, medeleg) },
+    [CSR_MIDELEG] =             { any, read_env, write_mideleg, 0,
+                                  offsetof(CPURISCVState, mideleg) },
+    [CSR_MIE] =                 { any, read_env, write_mie, 0,
+                                  offsetof(CPURISCVState, mie) },
+#if defined(TARGET_RISCV32)
+    [CSR_MSTATUSH] =            { hmode, read_env, write_mstatush, 0,
+                                  offsetof(CPURISCVState, mstatush) },
+#endif
+    [CSR_MTVEC] =               { any, read_env, write_mtvec,
+                                  RISCV_CSR_NO_EXIT,
+                                  offsetof(CPURISCVState, mtvec) },
+    [CSR_MCOUNTEREN] =          { priv_1_10, read_mcounteren,
+                                  write_mcounteren, RISCV_CSR_NO_EXIT },
+
+    /* Legacy Counter Setup (priv v1.9.1) */
+    [CSR_MUCOUNTEREN] =         { priv_1_09, read_scounteren,
+                                  write_scounteren, RISCV_CSR_NO_EXIT },
+    [CSR_MSCOUNTEREN] =         { priv_1_09, read_mcounteren,
+                                  write_mcounteren, RISCV_CSR_NO_EXIT },
+
+    /* Machine Trap Handling */
+    [CSR_MSCRATCH] =            CSR_ENV(any, mscratch, -1, RISCV_CSR_NO_EXIT),
+    [CSR_MEPC] =                CSR_ENV(any, mepc, -1, RISCV_CSR_NO_EXIT),
+    [CSR_MCAUSE] =              CSR_ENV(any, mcause, -1, RISCV_CSR_NO_EXIT),
+    [CSR_MBADADDR] =            CSR_ENV(any, mbadaddr, -1, RISCV_CSR_NO_EXIT),
+    [CSR_MIP] =                 { any, read_mip, write_mip },
+    [CSR_MTINST] =              { hmode, read_zero, write_warl_ignore,
+                                  RISCV_CSR_NO_EXIT },
+    [CSR_MTVAL2] =              CSR_ENV(hmode, mtval2, -1, RISCV_CSR_NO_EXIT),
+
+    /* Supervisor Trap Setup */
+    [CSR_SSTATUS] =             { any, read_sstatus, write_sstatus },
+    [CSR_SIE] =                 { any, read_sie, write_sie },
+    [CSR_STVEC] =               { any, read_env, write_stvec,
+                                  RISCV_CSR_NO_EXIT,
+                                  offsetof(CPURISCVState, stvec) },
+    [CSR_SCOUNTEREN] =          { priv_1_10, read_scounteren,
+                                  write_scounteren, RISCV_CSR_NO_EXIT },
+
+    /* Supervisor Trap Handling */
+    [CSR_SSCRATCH] =            CSR_ENV(any, sscratch, -1, RISCV_CSR_NO_EXIT),
+    [CSR_SEPC] =                CSR_ENV(any, sepc, -1, RISCV_CSR_NO_EXIT),
+    [CSR_SCAUSE] =              CSR_ENV(any, scause, -1, RISCV_CSR_NO_EXIT),
+    [CSR_SBADADDR] =            CSR_ENV(any, sbadaddr, -1, RISCV_CSR_NO_EXIT),
+    [CSR_SIP] =                 { any, read_sip, write_sip },
+
+    /* Supervisor Protection and Translation */
+    [CSR_SATP] =                { any, read_satp, write_satp },
+
+    /* Hypervisor Trap Setup */
+    [CSR_HSTATUS] =             { hmode, read_env, write_hstatus,
+                                  RISCV_CSR_NO_EXIT,
+                                  offsetof(CPURISCVState, hstatus) },
+    [CSR_HEDELEG] =             { hmode, read_env, write_hedeleg,
+                                  RISCV_CSR_NO_EXIT,
+                                  offsetof(CPURISCVState, hedeleg) },
+    [CSR_HIDELEG] =             { hmode, read_env, write_hideleg, 0,
+                                  offsetof(CPURISCVState, hideleg) },
+    [CSR_HIE] =                 { hmode, read_hie, write_hie },
+    [CSR_HCOUNTEREN] =          CSR_ENV(hmode, hcounteren, -1,
+                                        RISCV_CSR_NO_EXIT),
+    [CSR_HGEIE] =               { hmode, read_zero, write_warl_ignore,
+                                  RISCV_CSR_NO_EXIT },
+
+    /* Hypervisor Trap Handling */
+    [CSR_HTVAL] =               CSR_ENV(hmode, htval, -1, RISCV_CSR_NO_EXIT),
+    [CSR_HIP] =                 { hmode, read_hip, write_hip },
+    [CSR_HVIP] =                { hmode, read_hip, write_hvip },
+    [CSR_HTINST] =              { hmode, read_zero, write_warl_ignore,
+                                  RISCV_CSR_NO_EXIT },
+    [CSR_HGEIP] =               { hmode, read_zero, NULL, RISCV_CSR_NO_EXIT },
+
+    /* Hypervisor Protection and Translation */
+    [CSR_HGATP] =               { hmode, read_env, write_hgatp, 0,
+                                  offsetof(CPURISCVState, hgatp) },
+
+    /* Virtual Supervisor Registers, the swapped out guest copies */
+    [CSR_VSSTATUS] =            CSR_ENV(hmode, vsstatus, -1,
+                                        RISCV_CSR_NO_EXIT),
+    [CSR_VSIE] =                { hmode, read_vsie, write_vsie },
+    [CSR_VSTVEC] =              { hmode, read_env, write_vstvec,
+                                  RISCV_CSR_NO_EXIT,
+                                  offsetof(CPURISCVState, vstvec) },
+    [CSR_VSSCRATCH] =           CSR_ENV(hmode, vsscratch, -1,
+                                        RISCV_CSR_NO_EXIT),
+    [CSR_VSEPC] =               CSR_ENV(hmode, vsepc, -1, RISCV_CSR_NO_EXIT),
+    [CSR_VSCAUSE] =             CSR_ENV(hmode, vscause, -1, RISCV_CSR_NO_EXIT),
+    [CSR_VSTVAL] =              CSR_ENV(hmode, vstval, -1, RISCV_CSR_NO_EXIT),
+    [CSR_VSIP] =                { hmode, read_vsip, write_vsip },
+    [CSR_VSATP] =               { hmode, read_vsatp, write_vsatp },
+
+    /* Physical Memory Protection */
+    [CSR_PMPCFG0 ... CSR_PMPCFG3] = { any, read_pmpcfg, write_pmpcfg },
+    [CSR_PMPADDR0 ... CSR_PMPADDR15] = { any, read_pmpaddr, write_pmpaddr },
+#endif /* !CONFIG_USER_ONLY */
+};
@@ -18,6 +18,8 @@
 
 #include "qemu/osdep.h"
 #include <stdlib.h>
+#include <math.h>
+#include <float.h>
 #include "cpu.h"
 #include "qemu/host-utils.h"
 #include "exec/exec-all.h"
@@ -50,107 +52,218 @@ void cpu_riscv_set_fflags(CPURISCVState *env, target_ulong hard)
     set_float_exception_flags(soft, &env->fp_status);
 }
 
-void helper_set_rounding_mode(CPURISCVState *env, uint32_t rm)
+/*
+ * Host FPU fast path
+ *
+ * When the rounding mode is round-to-nearest-even and the inexact flag is
+ * already raised, an operation on zero or normal inputs that produces a
+ * normal result computes the same value and raises no other flags on the
+ * host FPU as in softfloat, so it is done natively.  Everything else
+ * (NaNs, infinities, denormals, overflow, underflow, other rounding modes
+ * or a clear inexact flag) goes through softfloat.  Hosts that evaluate
+ * float expressions with excess precision (x87) always use softfloat.
+ */
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+#define RISCV_HARDFLOAT 1
+#else
+#define RISCV_HARDFLOAT 0
+#endif
+
+typedef union {
+    float32 s;
+    float h;
+} union_float32;
+
+typedef union {
+    float64 s;
+    double h;
+} union_float64;
+
+static inline bool hardfloat_ok(CPURISCVState *env)
+{
+    return RISCV_HARDFLOAT &&
+        get_float_rounding_mode(&env->fp_status) == float_round_nearest_even &&
+        (get_float_exception_flags(&env->fp_status) & float_flag_inexact);
+}
+
+static inline bool f32_is_zon(union_float32 a)
+{
+    int c = fpclassify(a.h);
+    return c == FP_NORMAL || c == FP_ZERO;
+}
+
+static inline bool f64_is_zon(union_float64 a)
+{
+    int c = fpclassify(a.h);
+    return c == FP_NORMAL || c == FP_ZERO;
+}
+
+/* overflowed or possibly tiny results need softfloat to raise the flags */
+static inline bool f32_result_ok(union_float32 r)
+{
+    return !isinf(r.h) && fabsf(r.h) > FLT_MIN;
+}
+
+static inline bool f64_result_ok(union_float64 r)
+{
+    return !isinf(r.h) && fabs(r.h) > DBL_MIN;
+}
+
+static uint64_t do_fmadd_s(CPURISCVState *env, uint64_t frs1, uint64_t frs2,
+                           uint64_t frs3, int flags)
 {
-    int softrm;
+    union_float32 a = { .s = make_float32(frs1) };
+    union_float32 b = { .s = make_float32(frs2) };
+    union_float32 c = { .s = make_float32(frs3) };
+    union_float32 r;
 
-    if (rm == 7) {
-        rm = env->frm;
+    if (hardfloat_ok(env) && f32_is_zon(a) && f32_is_zon(b) &&
+        f32_is_zon(c)) {
+        if (flags & float_muladd_negate_product) {
+            a.h = -a.h;
+        }
+        if (flags & float_muladd_negate_c) {
+            c.h = -c.h;
+        }
+        r.h = fmaf(a.h, b.h, c.h);
+        if (f32_result_ok(r)) {
+            return float32_val(r.s);
+        }
     }
-    switch (rm) {
-    case 0:
-        softrm = float_round_nearest_even;
-        break;
-    case 1:
-        softrm = float_round_to_zero;
-        break;
-    case 2:
-        softrm = float_round_down;
-        break;
-    case 3:
-        softrm = float_round_up;
-        break;
-    case 4:
-        softrm = float_round_ties_away;
-        break;
-    default:
-        do_raise_exception_err(env, RISCV_EXCP_ILLEGAL_INST, GETPC());
+    return float32_muladd(frs1, frs2, frs3, flags, &env->fp_status);
+}
+
+static uint64_t do_fmadd_d(CPURISCVState *env, uint64_t frs1, uint64_t frs2,
+                           uint64_t frs3, int flags)
+{
+    union_float64 a = { .s = make_float64(frs1) };
+    union_float64 b = { .s = make_float64(frs2) };
+    union_float64 c = { .s = make_float64(frs3) };
+    union_float64 r;
+
+    if (hardfloat_ok(env) && f64_is_zon(a) && f64_is_zon(b) &&
+        f64_is_zon(c)) {
+        if (flags & float_muladd_negate_product) {
+            a.h = -a.h;
+        }
+        if (flags & float_muladd_negate_c) {
+            c.h = -c.h;
+        }
+        r.h = fma(a.h, b.h, c.h);
+        if (f64_result_ok(r)) {
+            return float64_val(r.s);
+        }
     }
-
-    set_float_rounding_mode(softrm, &env->fp_status);
+    return float64_muladd(frs1, frs2, frs3, flags, &env->fp_status);
 }
 
 uint64_t helper_fmadd_s(CPURISCVState *env, uint64_t frs1, uint64_t frs2,
                         uint64_t frs3)
 {
-    return float32_muladd(frs1, frs2, frs3, 0, &env->fp_status);
+    return do_fmadd_s(env, frs1, frs2, frs3, 0);
 }
 
 uint64_t helper_fmadd_d(CPURISCVState *env, uint64_t frs1, uint64_t frs2,
                         uint64_t frs3)
 {
-    return float64_muladd(frs1, frs2, frs3, 0, &env->fp_status);
+    return do_fmadd_d(env, frs1, frs2, frs3, 0);
 }
 
 uint64_t helper_fmsub_s(CPURISCVState *env, uint64_t frs1, uint64_t frs2,
                         uint64_t frs3)
 {
-    return float32_muladd(frs1, frs2, frs3, float_muladd_negate_c,
-                          &env->fp_status);
+    return do_fmadd_s(env, frs1, frs2, frs3, float_muladd_negate_c);
 }
 
 uint64_t helper_fmsub_d(CPURISCVState *env, uint64_t frs1, uint64_t frs2,
                         uint64_t frs3)
 {
-    return float64_muladd(frs1, frs2, frs3, float_muladd_negate_c,
-                          &env->fp_status);
+    return do_fmadd_d(env, frs1, frs2, frs3, float_muladd_negate_c);
 }
 
 uint64_t helper_fnmsub_s(CPURISCVState *env, uint64_t frs1, uint64_t frs2,
                          uint64_t frs3)
 {
-    return float32_muladd(frs1, frs2, frs3, float_muladd_negate_product,
-                          &env->fp_status);
+    return do_fmadd_s(env, frs1, frs2, frs3, float_muladd_negate_product);
 }
 
 uint64_t helper_fnmsub_d(CPURISCVState *env, uint64_t frs1, uint64_t frs2,
                          uint64_t frs3)
 {
-    return float64_muladd(frs1, frs2, frs3, float_muladd_negate_product,
-                          &env->fp_status);
+    return do_fmadd_d(env, frs1, frs2, frs3, float_muladd_negate_product);
 }
 
 uint64_t helper_fnmadd_s(CPURISCVState *env, uint64_t frs1, uint64_t frs2,
                          uint64_t frs3)
 {
-    return float32_muladd(frs1, frs2, frs3, float_muladd_negate_c |
-                          float_muladd_negate_product, &env->fp_status);
+    return do_fmadd_s(env, frs1, frs2, frs3, float_muladd_negate_c |
+                      float_muladd_negate_product);
 }
 
 uint64_t helper_fnmadd_d(CPURISCVState *env, uint64_t frs1, uint64_t frs2,
                          uint64_t frs3)
 {
-    return float64_muladd(frs1, frs2, frs3, float_muladd_negate_c |
-                          float_muladd_negate_product, &env->fp_status);
+    return do_fmadd_d(env, frs1, frs2, frs3, float_muladd_negate_c |
+                      float_muladd_negate_product);
 }
 
 uint64_t helper_fadd_s(CPURISCVState *env, uint64_t frs1, uint64_t frs2)
 {
+    union_float32 a = { .s = make_float32(frs1) };
+    union_float32 b = { .s = make_float32(frs2) };
+    union_float32 r;
+
+    if (hardfloat_ok(env) && f32_is_zon(a) && f32_is_zon(b)) {
+        r.h = a.h + b.h;
+        if (f32_result_ok(r)) {
+            return float32_val(r.s);
+        }
+    }
     return float32_add(frs1, frs2, &env->fp_status);
 }
 
 uint64_t helper_fsub_s(CPURISCVState *env, uint64_t frs1, uint64_t frs2)
 {
+    union_float32 a = { .s = make_float32(frs1) };
+    union_float32 b = { .s = make_float32(frs2) };
+    union_float32 r;
+
+    if (hardfloat_ok(env) && f32_is_zon(a) && f32_is_zon(b)) {
+        r.h = a.h - b.h;
+        if (f32_result_ok(r)) {
+            return float32_val(r.s);
+        }
+    }
     return float32_sub(frs1, frs2, &env->fp_status);
 }
 
 uint64_t helper_fmul_s(CPURISCVState *env, uint64_t frs1, uint64_t frs2)
 {
+    union_float32 a = { .s = make_float32(frs1) };
+    union_float32 b = { .s = make_float32(frs2) };
+    union_float32 r;
+
+    if (hardfloat_ok(env) && f32_is_zon(a) && f32_is_zon(b)) {
+        r.h = a.h * b.h;
+        if (f32_result_ok(r)) {
+            return float32_val(r.s);
+        }
+    }
     return float32_mul(frs1, frs2, &env->fp_status);
 }
 
 uint64_t helper_fdiv_s(CPURISCVState *env, uint64_t frs1, uint64_t frs2)
 {
+    union_float32 a = { .s = make_float32(frs1) };
+    union_float32 b = { .s = make_float32(frs2) };
+    union_float32 r;
+
+    if (hardfloat_ok(env) && f32_is_zon(a) && f32_is_zon(b) && b.h != 0) {
+        r.h = a.h / b.h;
+        if (f32_result_ok(r)) {
+            return float32_val(r.s);
+        }
+    }
     return float32_div(frs1, frs2, &env->fp_status);
 }
 
@@ -166,6 +279,12 @@ uint64_t helper_fmax_s(CPURISCVState *env, uint64_t frs1, uint64_t frs2)
 
 uint64_t helper_fsqrt_s(CPURISCVState *env, uint64_t frs1)
 {
+    union_float32 a = { .s = make_float32(frs1) }, r;
+
+    if (hardfloat_ok(env) && f32_is_zon(a) && (!signbit(a.h) || a.h == 0)) {
+        r.h = sqrtf(a.h);
+        return float32_val(r.s);
+    }
     return float32_sqrt(frs1, &env->fp_status);
 }
 
@@ -249,21 +368,61 @@ target_ulong helper_fclass_s(uint64_t frs1)
 
 uint64_t helper_fadd_d(CPURISCVState *env, uint64_t frs1, uint64_t frs2)
 {
+    union_float64 a = { .s = make_float64(frs1) };
+    union_float64 b = { .s = make_float64(frs2) };
+    union_float64 r;
+
+    if (hardfloat_ok(env) && f64_is_zon(a) && f64_is_zon(b)) {
+        r.h = a.h + b.h;
+        if (f64_result_ok(r)) {
+            return float64_val(r.s);
+        }
+    }
     return float64_add(frs1, frs2, &env->fp_status);
 }
 
 uint64_t helper_fsub_d(CPURISCVState *env, uint64_t frs1, uint64_t frs2)
 {
+    union_float64 a = { .s = make_float64(frs1) };
+    union_float64 b = { .s = make_float64(frs2) };
+    union_float64 r;
+
+    if (hardfloat_ok(env) && f64_is_zon(a) && f64_is_zon(b)) {
+        r.h = a.h - b.h;
+        if (f64_result_ok(r)) {
+            return float64_val(r.s);
+        }
+    }
     return float64_sub(frs1, frs2, &env->fp_status);
 }
 
 uint64_t helper_fmul_d(CPURISCVState *env, uint64_t frs1, uint64_t frs2)
 {
+    union_float64 a = { .s = make_float64(frs1) };
+    union_float64 b = { .s = make_float64(frs2) };
+    union_float64 r;
+
+    if (hardfloat_ok(env) && f64_is_zon(a) && f64_is_zon(b)) {
+        r.h = a.h * b.h;
+        if (f64_result_ok(r)) {
+            return float64_val(r.s);
+        }
+    }
     return float64_mul(frs1, frs2, &env->fp_status);
 }
 
 uint64_t helper_fdiv_d(CPURISCVState *env, uint64_t frs1, uint64_t frs2)
 {
+    union_float64 a = { .s = make_float64(frs1) };
+    union_float64 b = { .s = make_float64(frs2) };
+    union_float64 r;
+
+    if (hardfloat_ok(env) && f64_is_zon(a) && f64_is_zon(b) && b.h != 0) {
+        r.h = a.h / b.h;
+        if (f64_result_ok(r)) {
+            return float64_val(r.s);
+        }
+    }
     return float64_div(frs1, frs2, &env->fp_status);
 }
 
@@ -289,6 +448,12 @@ uint64_t helper_fcvt_d_s(CPURISCVState *env, uint64_t rs1)
 
 uint64_t helper_fsqrt_d(CPURISCVState *env, uint64_t frs1)
 {
+    union_float64 a = { .s = make_float64(frs1) }, r;
+
+    if (hardfloat_ok(env) && f64_is_zon(a) && (!signbit(a.h) || a.h == 0)) {
+        r.h = sqrt(a.h);
+        return float64_val(r.s);
+    }
     return float64_sqrt(frs1, &env->fp_status);
 }
 
@@ -30,7 +30,7 @@ int riscv_cpu_mmu_index(CPURISCVState *env, bool ifetch)
 #ifdef CONFIG_USER_ONLY
     return 0;
 #else
-    return env->priv;
+    return env->priv | (env->virt_enabled ? MMU_VIRT_IDX : 0);
 #endif
 }
 
@@ -50,11 +50,19 @@ static int riscv_cpu_hw_interrupts_pending(CPURISCVState *env)
     target_ulong enabled_interrupts = pending_interrupts &
                                       ~env->mideleg & -m_enabled;
 
+    /* VS-level interrupts are those in hideleg, and are only taken while
+       the guest runs; HS-level ones are always enabled at that time */
     target_ulong sie = get_field(env->mstatus, MSTATUS_SIE);
-    target_ulong s_enabled = env->priv < PRV_S || (env->priv == PRV_S && sie);
-    enabled_interrupts |= pending_interrupts & env->mideleg &
+    target_ulong s_enabled = env->virt_enabled || env->priv < PRV_S ||
+                             (env->priv == PRV_S && sie);
+    enabled_interrupts |= pending_interrupts & env->mideleg & ~env->hideleg &
                           -s_enabled;
 
+    target_ulong vs_enabled = env->virt_enabled &&
+                              (env->priv < PRV_S || sie);
+    enabled_interrupts |= pending_interrupts & env->mideleg & env->hideleg &
+                          -vs_enabled;
+
     if (enabled_interrupts) {
         return ctz64(enabled_interrupts); /* since non-zero */
     } else {
@@ -82,111 +90,292 @@ bool riscv_cpu_exec_interrupt(CPUState *cs, int interrupt_request)
 
 #if !defined(CONFIG_USER_ONLY)
 
-/* get_physical_address - get the physical address for this virtual address
- *
- * Do a page table walk to obtain the physical address corresponding to a
- * virtual address. Returns 0 if the translation was successful
+/*
+ * Page-table walk cache
  *
- * Adapted from Spike's mmu_t::translate and mmu_t::walk
+ * Caches the physical base of the last-level page table for recently
+ * walked virtual regions, so a TLB refill only has to read the leaf PTE.
+ * The HS-stage and the VS-stage have a cache each, the VS-stage one holds
+ * guest physical addresses.  Only non-leaf PTEs are cached; software must
+ * execute sfence.vma (hfence.vvma for a guest) after changing them, and
+ * satp changes go through a TLB flush, both of which invalidate the cache.
+ */
+static inline unsigned riscv_ptw_cache_index(target_ulong tag)
+{
+    return tag & (RISCV_PTW_CACHE_SIZE - 1);
+}
+
+static bool riscv_ptw_cache_lookup(CPURISCVState *env, bool virt,
+                                   target_ulong tag, hwaddr *base)
+{
+    RISCVPTWCacheEntry *e = &env->ptw_cache[virt][riscv_ptw_cache_index(tag)];
+
+    if (e->valid && e->tag == tag) {
+        *base = e->base;
+        return true;
+    }
+    return false;
+}
+
+static void riscv_ptw_cache_insert(CPURISCVState *env, bool virt,
+                                   target_ulong tag, hwaddr base)
+{
+    RISCVPTWCacheEntry *e = &env->ptw_cache[virt][riscv_ptw_cache_index(tag)];
+
+    e->tag = tag;
+    e->base = base;
+    e->valid = true;
+}
+
+void riscv_ptw_cache_flush(CPURISCVState *env)
+{
+    memset(env->ptw_cache, 0, sizeof(env->ptw_cache));
+}
+
+/*
+ * G-stage cache
  *
+ * Caches the G-stage translation of recently used guest physical pages,
+ * both those holding VS-stage page tables and the final ones, so that a
+ * TLB refill in VS-mode or VU-mode does not walk the G-stage for every
+ * level of the VS-stage.  The combined translation then goes into the
+ * softmmu TLB under the VS/VU mmu_idx, and later accesses hit there.
+ * hfence.gvma and hgatp writes invalidate the cache.
  */
-static int get_physical_address(CPURISCVState *env, hwaddr *physical,
-                                int *prot, target_ulong addr,
-                                int access_type, int mmu_idx)
+static inline unsigned riscv_gstage_cache_index(hwaddr gpa)
 {
-    /* NOTE: the env->pc value visible here will not be
-     * correct, but the value visible to the exception handler
-     * (riscv_cpu_do_interrupt) is correct */
+    return (gpa >> PGSHIFT) & (RISCV_GSTAGE_CACHE_SIZE - 1);
+}
 
-    int mode = mmu_idx;
+void riscv_gstage_cache_flush(CPURISCVState *env)
+{
+    memset(env->gstage_cache, 0, sizeof(env->gstage_cache));
+}
 
-    if (mode == PRV_M && access_type != MMU_INST_FETCH) {
-        if (get_field(env->mstatus, MSTATUS_MPRV)) {
-            mode = get_field(env->mstatus, MSTATUS_MPP);
-        }
+/*
+ * Return a host pointer to the PTE at pte_addr if the page table is in
+ * directly accessible RAM, or NULL if it has to be read through the memory
+ * API.  *writable tells whether A/D updates may be stored through it.
+ * Must be called within an RCU critical section, which the pointer does
+ * not outlive.
+ */
+static target_ulong *riscv_pte_host_ptr(CPUState *cs, hwaddr pte_addr,
+                                        bool *writable)
+{
+    MemoryRegion *mr;
+    hwaddr l = sizeof(target_ulong), addr1;
+
+    mr = address_space_translate(cs->as, pte_addr, &addr1, &l, false,
+                                 MEMTXATTRS_UNSPECIFIED);
+    if (l < sizeof(target_ulong) || !memory_access_is_direct(mr, false)) {
+        *writable = false;
+        return NULL;
     }
+    *writable = memory_access_is_direct(mr, true);
+    return qemu_map_ram_ptr(mr->ram_block, addr1);
+}
 
-    if (mode == PRV_M || !riscv_feature(env, RISCV_FEATURE_MMU)) {
-        *physical = addr;
-        *prot = PAGE_READ | PAGE_WRITE | PAGE_EXEC;
-        return TRANSLATE_SUCCESS;
+/* PTEs are little-endian in guest memory */
+static inline target_ulong pte_read(target_ulong *pte_ptr)
+{
+#if defined(TARGET_RISCV32)
+    return le32_to_cpu(atomic_read(pte_ptr));
+#elif TCG_OVERSIZED_GUEST
+    return ldq_le_p(pte_ptr);
+#else
+    return le64_to_cpu(atomic_read(pte_ptr));
+#endif
+}
+
+/*
+ * Replace old with new if the PTE still holds old; returns false if another
+ * hart (or a DMA master) changed it in the meantime.
+ */
+static inline bool pte_cmpxchg(target_ulong *pte_ptr, target_ulong old,
+                               target_ulong new)
+{
+#if defined(TARGET_RISCV32)
+    return atomic_cmpxchg(pte_ptr, cpu_to_le32(old), cpu_to_le32(new)) ==
+           cpu_to_le32(old);
+#elif TCG_OVERSIZED_GUEST
+    /* MTTCG is not enabled on oversized TCG guests so
+     * page table updates do not need to be atomic */
+    if (ldq_le_p(pte_ptr) != old) {
+        return false;
     }
+    stq_le_p(pte_ptr, new);
+    return true;
+#else
+    return atomic_cmpxchg(pte_ptr, cpu_to_le64(old), cpu_to_le64(new)) ==
+           cpu_to_le64(old);
+#endif
+}
 
-    *prot = 0;
+/* the translation stages; HS is the only one when V=0 */
+enum {
+    RISCV_STAGE_HS,
+    RISCV_STAGE_VS,
+    RISCV_STAGE_G,
+};
 
-    target_ulong base;
-    int levels, ptidxbits, ptesize, vm, sum;
-    int mxr = get_field(env->mstatus, MSTATUS_MXR);
+static int gstage_translate(CPURISCVState *env, hwaddr *physical, int *prot,
+                            hwaddr gpa, int access_type);
 
-    if (env->priv_ver >= PRIV_VERSION_1_10_0) {
-        base = get_field(env->satp, SATP_PPN) << PGSHIFT;
-        sum = get_field(env->mstatus, MSTATUS_SUM);
-        vm = get_field(env->satp, SATP_MODE);
-        switch (vm) {
-        case VM_1_10_SV32:
-          levels = 2; ptidxbits = 10; ptesize = 4; break;
-        case VM_1_10_SV39:
-          levels = 3; ptidxbits = 9; ptesize = 8; break;
-        case VM_1_10_SV48:
-          levels = 4; ptidxbits = 9; ptesize = 8; break;
-        case VM_1_10_SV57:
-          levels = 5; ptidxbits = 9; ptesize = 8; break;
-        case VM_1_10_MBARE:
-            *physical = addr;
-            *prot = PAGE_READ | PAGE_WRITE | PAGE_EXEC;
-            return TRANSLATE_SUCCESS;
-        default:
-          g_assert_not_reached();
-        }
+/* walk_page_table - translate addr by one stage of page tables
+ *
+ * Returns 0 if the translation was successful, with the size of the
+ * mapping (which may be a superpage) in *page_size.  The page tables of
+ * the VS-stage are in guest physical memory, if the G-stage does not map
+ * them TRANSLATE_G_STAGE_FAIL is returned.  The G-stage has a root table
+ * of four pages, and all of its leaves must be user pages.
+ *
+ * Adapted from Spike's mmu_t::walk
+ */
+static int walk_page_table(CPURISCVState *env, hwaddr *physical, int *prot,
+                           target_ulong *page_size, hwaddr addr,
+                           int access_type, int mode, int stage)
+{
+    /* NOTE: the env->pc value visible here will not be
+     * correct, but the value visible to the exception handler
+     * (riscv_cpu_do_interrupt) is correct */
+
+    *page_size = TARGET_PAGE_SIZE;
+    *prot = 0;
+
+    hwaddr base;
+    int levels, ptidxbits, ptesize, vm, sum, mxr;
+    int widened = 0;
+
+    if (stage == RISCV_STAGE_G) {
+        /* with V=1 the HS-mode sstatus bits are swapped out */
+        target_ulong hs_status = env->virt_enabled ? env->vsstatus :
+                                                     env->mstatus;
+        base = (hwaddr)get_field(env->hgatp, SATP_PPN) << PGSHIFT;
+        sum = 0;
+        mxr = get_field(hs_status, MSTATUS_MXR);
+        vm = get_field(env->hgatp, SATP_MODE);
+        widened = 2;
+    } else if (env->priv_ver >= PRIV_VERSION_1_10_0) {
+        /* hypervisor loads and stores walk the swapped out VS-stage */
+        target_ulong satp = stage == RISCV_STAGE_VS ? env->vsatp : env->satp;
+        target_ulong status = stage == RISCV_STAGE_VS &&
+                              !env->virt_enabled ? env->vsstatus :
+                                                   env->mstatus;
+        base = (hwaddr)get_field(satp, SATP_PPN) << PGSHIFT;
+        sum = get_field(status, MSTATUS_SUM);
+        mxr = get_field(status, MSTATUS_MXR);
+        vm = get_field(satp, SATP_MODE);
     } else {
-        base = env->sptbr << PGSHIFT;
+        base = (hwaddr)env->sptbr << PGSHIFT;
         sum = !get_field(env->mstatus, MSTATUS_PUM);
+        mxr = get_field(env->mstatus, MSTATUS_MXR);
         vm = get_field(env->mstatus, MSTATUS_VM);
         switch (vm) {
         case VM_1_09_SV32:
-          levels = 2; ptidxbits = 10; ptesize = 4; break;
+          vm = VM_1_10_SV32; break;
         case VM_1_09_SV39:
-          levels = 3; ptidxbits = 9; ptesize = 8; break;
+          vm = VM_1_10_SV39; break;
         case VM_1_09_SV48:
-          levels = 4; ptidxbits = 9; ptesize = 8; break;
+          vm = VM_1_10_SV48; break;
         case VM_1_09_MBARE:
-            *physical = addr;
-            *prot = PAGE_READ | PAGE_WRITE | PAGE_EXEC;
-            return TRANSLATE_SUCCESS;
+          vm = VM_1_10_MBARE; break;
         default:
           g_assert_not_reached();
         }
     }
 
+    /* hgatp uses the satp encoding of the modes */
+    switch (vm) {
+    case VM_1_10_SV32:
+      levels = 2; ptidxbits = 10; ptesize = 4; break;
+    case VM_1_10_SV39:
+      levels = 3; ptidxbits = 9; ptesize = 8; break;
+    case VM_1_10_SV48:
+      levels = 4; ptidxbits = 9; ptesize = 8; break;
+    case VM_1_10_SV57:
+      levels = 5; ptidxbits = 9; ptesize = 8; break;
+    case VM_1_10_MBARE:
+        *physical = addr;
+        *prot = PAGE_READ | PAGE_WRITE | PAGE_EXEC;
+        return TRANSLATE_SUCCESS;
+    default:
+      g_assert_not_reached();
+    }
+
     CPUState *cs = CPU(riscv_env_get_cpu(env));
-    int va_bits = PGSHIFT + levels * ptidxbits;
-    target_ulong mask = (1L << (TARGET_LONG_BITS - (va_bits - 1))) - 1;
-    target_ulong masked_msbs = (addr >> (va_bits - 1)) & mask;
-    if (masked_msbs != 0 && masked_msbs != mask) {
-        return TRANSLATE_FAIL;
+    int va_bits = PGSHIFT + levels * ptidxbits + widened;
+    if (stage == RISCV_STAGE_G) {
+        /* guest physical addresses are zero-extended */
+        if (addr >> va_bits) {
+            return TRANSLATE_FAIL;
+        }
+    } else {
+        target_ulong mask = (1L << (TARGET_LONG_BITS - (va_bits - 1))) - 1;
+        target_ulong masked_msbs = ((target_ulong)addr >> (va_bits - 1)) &
+                                   mask;
+        if (masked_msbs != 0 && masked_msbs != mask) {
+            return TRANSLATE_FAIL;
+        }
     }
 
-    int ptshift = (levels - 1) * ptidxbits;
+    /* virtual page number above the last level, tags the walk cache */
+    target_ulong ptw_tag = addr >> (PGSHIFT + ptidxbits);
+    bool use_ptw_cache = levels > 1 && stage != RISCV_STAGE_G;
+    bool ptw_virt = stage == RISCV_STAGE_VS;
+    hwaddr root = base;
+    int ret = TRANSLATE_FAIL;
+    int ptshift;
     int i;
 
-#if !TCG_OVERSIZED_GUEST
+    rcu_read_lock();
 restart:
-#endif
-    for (i = 0; i < levels; i++, ptshift -= ptidxbits) {
+    base = root;
+    ptshift = (levels - 1) * ptidxbits;
+    i = 0;
+    if (use_ptw_cache && riscv_ptw_cache_lookup(env, ptw_virt, ptw_tag,
+                                                &base)) {
+        /* resume at the last level, the non-leaf PTEs are cached */
+        i = levels - 1;
+        ptshift = 0;
+    }
+
+    for (; i < levels; i++, ptshift -= ptidxbits) {
+        int idxbits = ptidxbits + (i == 0 ? widened : 0);
         target_ulong idx = (addr >> (PGSHIFT + ptshift)) &
-                           ((1 << ptidxbits) - 1);
+                           ((1 << idxbits) - 1);
 
         /* check that physical address of PTE is legal */
-        target_ulong pte_addr = base + idx * ptesize;
+        hwaddr pte_addr = base + idx * ptesize;
+        int pte_prot = PAGE_READ | PAGE_WRITE;
+        if (stage == RISCV_STAGE_VS) {
+            int gret = gstage_translate(env, &pte_addr, &pte_prot,
+                                        base + idx * ptesize, MMU_DATA_LOAD);
+            if (gret != TRANSLATE_SUCCESS) {
+                ret = gret;
+                break;
+            }
+        }
+        bool pte_writable;
+        target_ulong *pte_ptr = riscv_pte_host_ptr(cs, pte_addr,
+                                                   &pte_writable);
+        target_ulong pte;
+
+        if (pte_ptr) {
+            pte = pte_read(pte_ptr);
+        } else {
 #if defined(TARGET_RISCV32)
-        target_ulong pte = ldl_phys(cs->as, pte_addr);
+            pte = ldl_phys(cs->as, pte_addr);
 #elif defined(TARGET_RISCV64)
-        target_ulong pte = ldq_phys(cs->as, pte_addr);
+            pte = ldq_phys(cs->as, pte_addr);
 #endif
+        }
         target_ulong ppn = pte >> PTE_PPN_SHIFT;
 
         if (PTE_TABLE(pte)) { /* next level of page table */
-            base = ppn << PGSHIFT;
+            base = (hwaddr)ppn << PGSHIFT;
+            if (use_ptw_cache && i == levels - 2) {
+                riscv_ptw_cache_insert(env, ptw_virt, ptw_tag, base);
+            }
         } else if ((pte & PTE_U) ? (mode == PRV_S) && !sum : !(mode == PRV_S)) {
             break;
         } else if (!(pte & PTE_V) || (!(pte & PTE_R) && (pte & PTE_W))) {
@@ -202,42 +391,41 @@ restart:
 
             /* Page table updates need to be atomic with MTTCG enabled */
             if (updated_pte != pte) {
-                /* if accessed or dirty bits need updating, and the PTE is
-                 * in RAM, then we do so atomically with a compare and swap.
-                 * if the PTE is in IO space, then it can't be updated.
-                 * if the PTE changed, then we must re-walk the page table
-                   as the PTE is no longer valid */
-                MemoryRegion *mr;
-                hwaddr l = sizeof(target_ulong), addr1;
-                mr = address_space_translate(cs->as, pte_addr,
-                    &addr1, &l, false, MEMTXATTRS_UNSPECIFIED);
-                if (memory_access_is_direct(mr, true)) {
-                    target_ulong *pte_pa =
-                        qemu_map_ram_ptr(mr->ram_block, addr1);
-#if TCG_OVERSIZED_GUEST
-                    /* MTTCG is not enabled on oversized TCG guests so
-                     * page table updates do not need to be atomic */
-                    *pte_pa = pte = updated_pte;
-#else
-                    target_ulong old_pte =
-                        atomic_cmpxchg(pte_pa, pte, updated_pte);
-                    if (old_pte != pte) {
-                        goto restart;
-                    } else {
-                        pte = updated_pte;
+                if (!(pte_prot & PAGE_WRITE)) {
+                    /* the G-stage must allow the VS-stage A/D update, and
+                       gets its own D bit set by the translation */
+                    int gret = gstage_translate(env, &pte_addr, &pte_prot,
+                                                base + idx * ptesize,
+                                                MMU_DATA_STORE);
+                    if (gret != TRANSLATE_SUCCESS) {
+                        ret = gret;
+                        break;
                     }
-#endif
-                } else {
+                    goto restart;
+                }
+                /* if accessed or dirty bits need updating, and the PTE is
+                 * in RAM, then we do so atomically with a compare and swap
+                 * on the host pointer used for the walk.  if the PTE is in
+                 * ROM or IO space, then it can't be updated.  if the PTE
+                 * changed, then we must re-walk the page table as the PTE
+                 * is no longer valid */
+                if (!pte_ptr || !pte_writable) {
                     /* misconfigured PTE in ROM (AD bits are not preset) or
                      * PTE is in IO space and can't be updated atomically */
-                    return TRANSLATE_FAIL;
+                    break;
                 }
+                if (!pte_cmpxchg(pte_ptr, pte, updated_pte)) {
+                    goto restart;
+                }
+                pte = updated_pte;
             }
 
             /* for superpage mappings, make a fake leaf PTE for the TLB's
                benefit. */
-            target_ulong vpn = addr >> PGSHIFT;
-            *physical = (ppn | (vpn & ((1L << ptshift) - 1))) << PGSHIFT;
+            hwaddr vpn = addr >> PGSHIFT;
+            *physical = ((hwaddr)ppn | (vpn & (((hwaddr)1 << ptshift) - 1)))
+                        << PGSHIFT;
+            *page_size = (target_ulong)1 << (PGSHIFT + ptshift);
 
             if ((pte & PTE_R)) {
                 *prot |= PAGE_READ;
@@ -252,46 +440,158 @@ restart:
                     (access_type == MMU_DATA_STORE || (pte & PTE_D))) {
                 *prot |= PAGE_WRITE;
             }
-            return TRANSLATE_SUCCESS;
+            ret = TRANSLATE_SUCCESS;
+            break;
+        }
+    }
+    rcu_read_unlock();
+    return ret;
+}
+
+/*
+ * Translate the guest physical address gpa by the G-stage, through the
+ * G-stage cache.  On failure gpa is left in env->guest_phys_fault_addr.
+ */
+static int gstage_translate(CPURISCVState *env, hwaddr *physical, int *prot,
+                            hwaddr gpa, int access_type)
+{
+    hwaddr page = gpa & ~(hwaddr)(TARGET_PAGE_SIZE - 1);
+    RISCVGStageCacheEntry *e =
+        &env->gstage_cache[riscv_gstage_cache_index(gpa)];
+    target_ulong page_size;
+
+    /* an entry made by a load of a clean page misses for stores, whose
+       walk then sets the D bit */
+    if (!(e->valid && e->gpa == page && (e->prot & (1 << access_type)))) {
+        if (walk_page_table(env, physical, prot, &page_size, gpa,
+                            access_type, PRV_U, RISCV_STAGE_G)) {
+            env->guest_phys_fault_addr = gpa;
+            return TRANSLATE_G_STAGE_FAIL;
+        }
+        e->gpa = page;
+        e->pa = *physical & ~(hwaddr)(TARGET_PAGE_SIZE - 1);
+        e->prot = *prot;
+        e->valid = true;
+    }
+    *physical = e->pa | (gpa & (TARGET_PAGE_SIZE - 1));
+    *prot = e->prot;
+    return TRANSLATE_SUCCESS;
+}
+
+/*
+ * Whether an access of mmu_idx goes through the VS-stage and the G-stage,
+ * which M-mode loads and stores do with mstatus.MPRV and MPV set.
+ */
+static bool riscv_cpu_two_stage_lookup(CPURISCVState *env, int mmu_idx,
+                                       int access_type)
+{
+    if (mmu_idx == PRV_M && access_type != MMU_INST_FETCH &&
+        get_field(env->mstatus, MSTATUS_MPRV) &&
+        get_field(env->mstatus, MSTATUS_MPP) != PRV_M) {
+        return riscv_has_ext(env, RVH) && riscv_cpu_get_mpv(env);
+    }
+    return mmu_idx & MMU_VIRT_IDX;
+}
+
+/* get_physical_address - get the physical address for this virtual address
+ *
+ * Do a page table walk to obtain the physical address corresponding to a
+ * virtual address. Returns 0 if the translation was successful, with the
+ * size of the mapping (which may be a superpage) in *page_size.
+ *
+ * In VS-mode and VU-mode the VS-stage gives a guest physical address that
+ * the G-stage translates in turn, a fault there (including one on the
+ * VS-stage page tables) returns TRANSLATE_G_STAGE_FAIL.
+ *
+ * Adapted from Spike's mmu_t::translate
+ *
+ */
+static int get_physical_address(CPURISCVState *env, hwaddr *physical,
+                                int *prot, target_ulong *page_size,
+                                target_ulong addr, int access_type,
+                                int mmu_idx)
+{
+    int mode = mmu_idx & MMU_PRIV_MASK;
+    bool two_stage = riscv_cpu_two_stage_lookup(env, mmu_idx, access_type);
+    int gprot;
+    int ret;
+
+    *page_size = TARGET_PAGE_SIZE;
+
+    if (mode == PRV_M && access_type != MMU_INST_FETCH) {
+        if (get_field(env->mstatus, MSTATUS_MPRV)) {
+            mode = get_field(env->mstatus, MSTATUS_MPP);
         }
     }
-    return TRANSLATE_FAIL;
+
+    if (mode == PRV_M || !riscv_feature(env, RISCV_FEATURE_MMU)) {
+        *physical = addr;
+        *prot = PAGE_READ | PAGE_WRITE | PAGE_EXEC;
+        return TRANSLATE_SUCCESS;
+    }
+
+    if (!two_stage) {
+        return walk_page_table(env, physical, prot, page_size, addr,
+                               access_type, mode, RISCV_STAGE_HS);
+    }
+
+    ret = walk_page_table(env, physical, prot, page_size, addr, access_type,
+                          mode, RISCV_STAGE_VS);
+    if (ret != TRANSLATE_SUCCESS) {
+        return ret;
+    }
+    /* the page size is that of the VS-stage, which sfence.vma of guest
+       virtual addresses has to see */
+    ret = gstage_translate(env, physical, &gprot,
+                           (*physical & ~(hwaddr)(TARGET_PAGE_SIZE - 1)) |
+                           (addr & ~TARGET_PAGE_MASK), access_type);
+    *prot &= gprot;
+    return ret;
 }
 
 static void raise_mmu_exception(CPURISCVState *env, target_ulong address,
-                                MMUAccessType access_type)
+                                MMUAccessType access_type, int ret,
+                                bool two_stage)
 {
     CPUState *cs = CPU(riscv_env_get_cpu(env));
+    bool g_stage_fault = ret == TRANSLATE_G_STAGE_FAIL;
     int page_fault_exceptions =
         (env->priv_ver >= PRIV_VERSION_1_10_0) &&
-        get_field(env->satp, SATP_MODE) != VM_1_10_MBARE;
+        get_field(two_stage ? env->vsatp : env->satp,
+                  SATP_MODE) != VM_1_10_MBARE;
     switch (access_type) {
     case MMU_INST_FETCH:
-        cs->exception_index = page_fault_exceptions ?
+        cs->exception_index = g_stage_fault ?
+            RISCV_EXCP_INST_GUEST_PAGE_FAULT : page_fault_exceptions ?
             RISCV_EXCP_INST_PAGE_FAULT : RISCV_EXCP_INST_ACCESS_FAULT;
         break;
     case MMU_DATA_LOAD:
-        cs->exception_index = page_fault_exceptions ?
+        cs->exception_index = g_stage_fault ?
+            RISCV_EXCP_LOAD_GUEST_PAGE_FAULT : page_fault_exceptions ?
             RISCV_EXCP_LOAD_PAGE_FAULT : RISCV_EXCP_LOAD_ACCESS_FAULT;
         break;
     case MMU_DATA_STORE:
-        cs->exception_index = page_fault_exceptions ?
+        cs->exception_index = g_stage_fault ?
+            RISCV_EXCP_STORE_GUEST_PAGE_FAULT : page_fault_exceptions ?
             RISCV_EXCP_STORE_PAGE_FAULT : RISCV_EXCP_STORE_AMO_ACCESS_FAULT;
         break;
     default:
         g_assert_not_reached();
     }
     env->badaddr = address;
+    env->two_stage_lookup = two_stage;
 }
 
 hwaddr riscv_cpu_get_phys_page_debug(CPUState *cs, vaddr addr)
 {
     RISCVCPU *cpu = RISCV_CPU(cs);
     hwaddr phys_addr;
+    target_ulong page_size;
     int prot;
     int mmu_idx = cpu_mmu_index(&cpu->env, false);
 
-    if (get_physical_address(&cpu->env, &phys_addr, &prot, addr, 0, mmu_idx)) {
+    if (get_physical_address(&cpu->env, &phys_addr, &prot, &page_size, addr, 0,
+                             mmu_idx)) {
         return -1;
     }
     return phys_addr;
@@ -326,7 +626,7 @@ void tlb_fill(CPUState *cs, target_ulong addr, int size,
 {
     int ret;
     ret = riscv_cpu_handle_mmu_fault(cs, addr, size, access_type, mmu_idx);
-    if (ret == TRANSLATE_FAIL) {
+    if (ret != TRANSLATE_SUCCESS) {
         RISCVCPU *cpu = RISCV_CPU(cs);
         CPURISCVState *env = &cpu->env;
         do_raise_exception_err(env, cs->exception_index, retaddr);
@@ -342,6 +642,7 @@ int riscv_cpu_handle_mmu_fault(CPUState *cs, vaddr address, int size,
     CPURISCVState *env = &cpu->env;
 #if !defined(CONFIG_USER_ONLY)
     hwaddr pa = 0;
+    target_ulong page_size = TARGET_PAGE_SIZE;
     int prot;
 #endif
     int ret = TRANSLATE_FAIL;
@@ -351,18 +652,36 @@ int riscv_cpu_handle_mmu_fault(CPUState *cs, vaddr address, int size,
              %d\n", __func__, env->pc, address, rw, mmu_idx);
 
 #if !defined(CONFIG_USER_ONLY)
-    ret = get_physical_address(env, &pa, &prot, address, rw, mmu_idx);
+    env->hpm_count[RISCV_HPM_EVENT_TLB_MISS]++;
+    ret = get_physical_address(env, &pa, &prot, &page_size, address, rw,
+                               mmu_idx);
     qemu_log_mask(CPU_LOG_MMU,
             "%s address=%" VADDR_PRIx " ret %d physical " TARGET_FMT_plx
              " prot %d\n", __func__, address, ret, pa, prot);
-    if (!pmp_hart_has_privs(env, pa, TARGET_PAGE_SIZE, 1 << rw)) {
-        ret = TRANSLATE_FAIL;
+    if (ret == TRANSLATE_SUCCESS) {
+        pa = (pa & TARGET_PAGE_MASK) | (address & ~TARGET_PAGE_MASK);
+        if (!pmp_hart_has_privs(env, pa, size, 1 << rw)) {
+            ret = TRANSLATE_FAIL;
+        }
     }
     if (ret == TRANSLATE_SUCCESS) {
+        pmp_priv_t pmp_privs;
+
+        if (pmp_get_page_privs(env, pa, &pmp_privs)) {
+            /* PMP_READ/WRITE/EXEC use the same bits as PAGE_* */
+            prot &= pmp_privs;
+        } else {
+            /* the page straddles PMP rules, check every access */
+            prot = 1 << rw;
+            page_size = 1;
+        }
+        /* Report superpages so that a later sfence.vma of any address
+           within them flushes every TLB entry they produced */
         tlb_set_page(cs, address & TARGET_PAGE_MASK, pa & TARGET_PAGE_MASK,
-                     prot, mmu_idx, TARGET_PAGE_SIZE);
-    } else if (ret == TRANSLATE_FAIL) {
-        raise_mmu_exception(env, address, rw);
+                     prot, mmu_idx, page_size);
+    } else {
+        raise_mmu_exception(env, address, rw, ret,
+                            riscv_cpu_two_stage_lookup(env, mmu_idx, rw));
     }
 #else
     switch (rw) {
@@ -404,6 +723,10 @@ void riscv_cpu_do_interrupt(CPUState *cs)
         }
     }
 
+    /* a trap breaks any LR/SC sequence in progress */
+    env->load_res = RISCV_RESERVATION_INVALID;
+    env->hpm_count[RISCV_HPM_EVENT_TRAP]++;
+
     target_ulong fixed_cause = 0;
     if (cs->exception_index & (RISCV_EXCP_INT_FLAG)) {
         /* hacky for now. the MSB (bit 63) indicates interrupt but cs->exception
@@ -418,7 +741,8 @@ void riscv_cpu_do_interrupt(CPUState *cs)
                 fixed_cause = RISCV_EXCP_U_ECALL;
                 break;
             case PRV_S:
-                fixed_cause = RISCV_EXCP_S_ECALL;
+                fixed_cause = env->virt_enabled ? RISCV_EXCP_VS_ECALL :
+                                                  RISCV_EXCP_S_ECALL;
                 break;
             case PRV_H:
                 fixed_cause = RISCV_EXCP_H_ECALL;
@@ -433,9 +757,11 @@ void riscv_cpu_do_interrupt(CPUState *cs)
     }
 
     target_ulong backup_epc = env->pc;
+    bool virt = env->virt_enabled;
 
     target_ulong bit = fixed_cause;
     target_ulong deleg = env->medeleg;
+    target_ulong hdeleg = env->hedeleg;
 
     int hasbadaddr =
         (fixed_cause == RISCV_EXCP_INST_ADDR_MIS) ||
@@ -446,14 +772,45 @@ void riscv_cpu_do_interrupt(CPUState *cs)
         (fixed_cause == RISCV_EXCP_STORE_AMO_ACCESS_FAULT) ||
         (fixed_cause == RISCV_EXCP_INST_PAGE_FAULT) ||
         (fixed_cause == RISCV_EXCP_LOAD_PAGE_FAULT) ||
-        (fixed_cause == RISCV_EXCP_STORE_PAGE_FAULT);
+        (fixed_cause == RISCV_EXCP_STORE_PAGE_FAULT) ||
+        (fixed_cause == RISCV_EXCP_INST_GUEST_PAGE_FAULT) ||
+        (fixed_cause == RISCV_EXCP_LOAD_GUEST_PAGE_FAULT) ||
+        (fixed_cause == RISCV_EXCP_STORE_GUEST_PAGE_FAULT);
+    bool g_stage_fault =
+        (fixed_cause == RISCV_EXCP_INST_GUEST_PAGE_FAULT) ||
+        (fixed_cause == RISCV_EXCP_LOAD_GUEST_PAGE_FAULT) ||
+        (fixed_cause == RISCV_EXCP_STORE_GUEST_PAGE_FAULT);
+    /* stval or mtval hold a guest virtual address */
+    bool gva = hasbadaddr && (virt || env->two_stage_lookup);
+    target_ulong gpa = g_stage_fault ? env->guest_phys_fault_addr >> 2 : 0;
+
+    env->two_stage_lookup = false;
 
     if (bit & ((target_ulong)1 << (TARGET_LONG_BITS - 1))) {
         deleg = env->mideleg;
+        hdeleg = env->hideleg;
         bit &= ~((target_ulong)1 << (TARGET_LONG_BITS - 1));
     }
 
     if (env->priv <= PRV_S && bit < 64 && ((deleg >> bit) & 1)) {
+        if (virt && ((hdeleg >> bit) & 1)) {
+            /* handle the trap in VS-mode, whose CSRs are the live S-mode
+               ones; VS-level interrupts are seen as S-level ones */
+            if (fixed_cause & ((target_ulong)1 << (TARGET_LONG_BITS - 1))) {
+                fixed_cause--;
+            }
+        } else if (riscv_has_ext(env, RVH)) {
+            /* handle the trap in HS-mode, leaving the guest */
+            target_ulong h = env->hstatus;
+            h = set_field(h, HSTATUS_SPV, virt);
+            if (virt) {
+                h = set_field(h, HSTATUS_SPVP, env->priv);
+            }
+            h = set_field(h, HSTATUS_GVA, gva);
+            env->hstatus = h;
+            env->htval = gpa;
+            riscv_cpu_set_virt_enabled(env, false);
+        }
         /* handle the trap in S-mode */
         /* No need to check STVEC for misaligned - lower 2 bits cannot be set */
         env->pc = env->stvec;
@@ -480,6 +837,11 @@ void riscv_cpu_do_interrupt(CPUState *cs)
         csr_write_helper(env, s, CSR_MSTATUS);
         riscv_set_mode(env, PRV_S);
     } else {
+        if (riscv_has_ext(env, RVH)) {
+            riscv_cpu_set_mpv_gva(env, virt, gva);
+            env->mtval2 = gpa;
+            riscv_cpu_set_virt_enabled(env, false);
+        }
         /* No need to check MTVEC for misaligned - lower 2 bits cannot be set */
         env->pc = env->mtvec;
         env->mepc = backup_epc;
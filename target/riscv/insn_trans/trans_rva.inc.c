@@ -0,0 +1,143 @@
+/*
+ * RISC-V translation routines for the RVXA Standard Extension.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 or later, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+static inline bool gen_amo(DisasContext *ctx, arg_atomic *a, uint32_t opc,
+                           TCGMemOp mop)
+{
+    gen_atomic(ctx, opc, a->rd, a->rs1, a->rs2, a->aq, a->rl, mop | MO_ALIGN);
+    return true;
+}
+
+static bool trans_lr_w(DisasContext *ctx, arg_lr_w *a, uint32_t insn)
+{
+    return gen_amo(ctx, a, OPC_RISC_LR, MO_TESL);
+}
+
+static bool trans_sc_w(DisasContext *ctx, arg_sc_w *a, uint32_t insn)
+{
+    return gen_amo(ctx, a, OPC_RISC_SC, MO_TESL);
+}
+
+static bool trans_amoswap_w(DisasContext *ctx, arg_amoswap_w *a, uint32_t insn)
+{
+    return gen_amo(ctx, a, OPC_RISC_AMOSWAP, MO_TESL);
+}
+
+static bool trans_amoadd_w(DisasContext *ctx, arg_amoadd_w *a, uint32_t insn)
+{
+    return gen_amo(ctx, a, OPC_RISC_AMOADD, MO_TESL);
+}
+
+static bool trans_amoxor_w(DisasContext *ctx, arg_amoxor_w *a, uint32_t insn)
+{
+    return gen_amo(ctx, a, OPC_RISC_AMOXOR, MO_TESL);
+}
+
+static bool trans_amoand_w(DisasContext *ctx, arg_amoand_w *a, uint32_t insn)
+{
+    return gen_amo(ctx, a, OPC_RISC_AMOAND, MO_TESL);
+}
+
+static bool trans_amoor_w(DisasContext *ctx, arg_amoor_w *a, uint32_t insn)
+{
+    return gen_amo(ctx, a, OPC_RISC_AMOOR, MO_TESL);
+}
+
+static bool trans_amomin_w(DisasContext *ctx, arg_amomin_w *a, uint32_t insn)
+{
+    return gen_amo(ctx, a, OPC_RISC_AMOMIN, MO_TESL);
+}
+
+static bool trans_amomax_w(DisasContext *ctx, arg_amomax_w *a, uint32_t insn)
+{
+    return gen_amo(ctx, a, OPC_RISC_AMOMAX, MO_TESL);
+}
+
+static bool trans_amominu_w(DisasContext *ctx, arg_amominu_w *a, uint32_t insn)
+{
+    return gen_amo(ctx, a, OPC_RISC_AMOMINU, MO_TESL);
+}
+
+static bool trans_amomaxu_w(DisasContext *ctx, arg_amomaxu_w *a, uint32_t insn)
+{
+    return gen_amo(ctx, a, OPC_RISC_AMOMAXU, MO_TESL);
+}
+
+static bool trans_lr_d(DisasContext *ctx, arg_lr_d *a, uint32_t insn)
+{
+    REQUIRE_64BIT(ctx);
+    return gen_amo(ctx, a, OPC_RISC_LR, MO_TEQ);
+}
+
+static bool trans_sc_d(DisasContext *ctx, arg_sc_d *a, uint32_t insn)
+{
+    REQUIRE_64BIT(ctx);
+    return gen_amo(ctx, a, OPC_RISC_SC, MO_TEQ);
+}
+
+static bool trans_amoswap_d(DisasContext *ctx, arg_amoswap_d *a, uint32_t insn)
+{
+    REQUIRE_64BIT(ctx);
+    return gen_amo(ctx, a, OPC_RISC_AMOSWAP, MO_TEQ);
+}
+
+static bool trans_amoadd_d(DisasContext *ctx, arg_amoadd_d *a, uint32_t insn)
+{
+    REQUIRE_64BIT(ctx);
+    return gen_amo(ctx, a, OPC_RISC_AMOADD, MO_TEQ);
+}
+
+static bool trans_amoxor_d(DisasContext *ctx, arg_amoxor_d *a, uint32_t insn)
+{
+    REQUIRE_64BIT(ctx);
+    return gen_amo(ctx, a, OPC_RISC_AMOXOR, MO_TEQ);
+}
+
+static bool trans_amoand_d(DisasContext *ctx, arg_amoand_d *a, uint32_t insn)
+{
+    REQUIRE_64BIT(ctx);
+    return gen_amo(ctx, a, OPC_RISC_AMOAND, MO_TEQ);
+}
+
+static bool trans_amoor_d(DisasContext *ctx, arg_amoor_d *a, uint32_t insn)
+{
+    REQUIRE_64BIT(ctx);
+    return gen_amo(ctx, a, OPC_RISC_AMOOR, MO_TEQ);
+}
+
+static bool trans_amomin_d(DisasContext *ctx, arg_amomin_d *a, uint32_t insn)
+{
+    REQUIRE_64BIT(ctx);
+    return gen_amo(ctx, a, OPC_RISC_AMOMIN, MO_TEQ);
+}
+
+static bool trans_amomax_d(DisasContext *ctx, arg_amomax_d *a, uint32_t insn)
+{
+    REQUIRE_64BIT(ctx);
+    return gen_amo(ctx, a, OPC_RISC_AMOMAX, MO_TEQ);
+}
+
+static bool trans_amominu_d(DisasContext *ctx, arg_amominu_d *a, uint32_t insn)
+{
+    REQUIRE_64BIT(ctx);
+    return gen_amo(ctx, a, OPC_RISC_AMOMINU, MO_TEQ);
+}
+
+static bool trans_amomaxu_d(DisasContext *ctx, arg_amomaxu_d *a, uint32_t insn)
+{
+    REQUIRE_64BIT(ctx);
+    return gen_amo(ctx, a, OPC_RISC_AMOMAXU, MO_TEQ);
+}
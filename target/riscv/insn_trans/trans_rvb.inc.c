@@ -0,0 +1,455 @@
+/*
+ * RISC-V translation routines for the Zba, Zbb and Zbs Bit-Manipulation
+ * Extensions.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 or later, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* the extensions are not in misa, they are enabled by CPU properties */
+#define REQUIRE_ZB(ctx, ext) do {                          \
+    if (!riscv_env_get_cpu((ctx)->env)->cfg.ext_##ext) {   \
+        return false;                                      \
+    }                                                      \
+} while (0)
+
+/*
+ * Most of these are a single TCG op, which the x86 and aarch64 backends
+ * emit as one host instruction where the host has it (lzcnt, tzcnt,
+ * popcnt, bswap, rol/ror, andn, min/max...).  The op reads its sources
+ * before it writes rd, so rd can be the global itself.
+ */
+static bool gen_unary(DisasContext *ctx, int rd, int rs1,
+                      void (*func)(TCGv, TCGv))
+{
+    func(dest_gpr(ctx, rd), get_gpr(ctx, rs1));
+    return true;
+}
+
+static bool gen_binary(DisasContext *ctx, arg_r *a,
+                       void (*func)(TCGv, TCGv, TCGv))
+{
+    func(dest_gpr(ctx, a->rd), get_gpr(ctx, a->rs1), get_gpr(ctx, a->rs2));
+    return true;
+}
+
+static bool gen_shift_imm(DisasContext *ctx, arg_shift *a,
+                          void (*func)(TCGv, TCGv, target_long))
+{
+    if (a->shamt >= TARGET_LONG_BITS) {
+        return false;
+    }
+    func(dest_gpr(ctx, a->rd), get_gpr(ctx, a->rs1), a->shamt);
+    return true;
+}
+
+/* Zba */
+
+static void gen_sh_add(TCGv ret, TCGv arg1, TCGv arg2, int shift)
+{
+    TCGv t = tcg_temp_new();
+
+    tcg_gen_shli_tl(t, arg1, shift);
+    tcg_gen_add_tl(ret, t, arg2);
+    tcg_temp_free(t);
+}
+
+#define GEN_TRANS_SHADD(NAME, SHIFT)                                    \
+static void gen_##NAME(TCGv ret, TCGv arg1, TCGv arg2)                  \
+{                                                                       \
+    gen_sh_add(ret, arg1, arg2, SHIFT);                                 \
+}                                                                       \
+                                                                        \
+static bool trans_##NAME(DisasContext *ctx, arg_##NAME *a, uint32_t insn) \
+{                                                                       \
+    REQUIRE_ZB(ctx, zba);                                               \
+    return gen_binary(ctx, a, gen_##NAME);                              \
+}
+
+GEN_TRANS_SHADD(sh1add, 1)
+GEN_TRANS_SHADD(sh2add, 2)
+GEN_TRANS_SHADD(sh3add, 3)
+
+/* the .uw forms zero-extend the low word of rs1 first */
+static void gen_sh_add_uw(TCGv ret, TCGv arg1, TCGv arg2, int shift)
+{
+    TCGv t = tcg_temp_new();
+
+    tcg_gen_ext32u_tl(t, arg1);
+    tcg_gen_shli_tl(t, t, shift);
+    tcg_gen_add_tl(ret, t, arg2);
+    tcg_temp_free(t);
+}
+
+#define GEN_TRANS_SHADD_UW(NAME, SHIFT)                                 \
+static void gen_##NAME(TCGv ret, TCGv arg1, TCGv arg2)                  \
+{                                                                       \
+    gen_sh_add_uw(ret, arg1, arg2, SHIFT);                              \
+}                                                                       \
+                                                                        \
+static bool trans_##NAME(DisasContext *ctx, arg_##NAME *a, uint32_t insn) \
+{                                                                       \
+    REQUIRE_64BIT(ctx);                                                 \
+    REQUIRE_ZB(ctx, zba);                                               \
+    return gen_binary(ctx, a, gen_##NAME);                              \
+}
+
+GEN_TRANS_SHADD_UW(add_uw, 0)
+GEN_TRANS_SHADD_UW(sh1add_uw, 1)
+GEN_TRANS_SHADD_UW(sh2add_uw, 2)
+GEN_TRANS_SHADD_UW(sh3add_uw, 3)
+
+static void gen_slli_uw(TCGv ret, TCGv arg1, target_long shamt)
+{
+    tcg_gen_deposit_z_tl(ret, arg1, shamt, MIN(32, TARGET_LONG_BITS - shamt));
+}
+
+static bool trans_slli_uw(DisasContext *ctx, arg_slli_uw *a, uint32_t insn)
+{
+    REQUIRE_64BIT(ctx);
+    REQUIRE_ZB(ctx, zba);
+    return gen_shift_imm(ctx, a, gen_slli_uw);
+}
+
+/* Zbb */
+
+#define GEN_TRANS_ZBB_R(NAME, FUNC)                                     \
+static bool trans_##NAME(DisasContext *ctx, arg_##NAME *a, uint32_t insn) \
+{                                                                       \
+    REQUIRE_ZB(ctx, zbb);                                               \
+    return gen_binary(ctx, a, FUNC);                                    \
+}
+
+#define GEN_TRANS_ZBB_UNARY(NAME, FUNC)                                 \
+static bool trans_##NAME(DisasContext *ctx, arg_##NAME *a, uint32_t insn) \
+{                                                                       \
+    REQUIRE_ZB(ctx, zbb);                                               \
+    return gen_unary(ctx, a->rd, a->rs1, FUNC);                         \
+}
+
+GEN_TRANS_ZBB_R(andn, tcg_gen_andc_tl)
+GEN_TRANS_ZBB_R(orn, tcg_gen_orc_tl)
+GEN_TRANS_ZBB_R(xnor, tcg_gen_eqv_tl)
+GEN_TRANS_ZBB_R(max, tcg_gen_smax_tl)
+GEN_TRANS_ZBB_R(maxu, tcg_gen_umax_tl)
+GEN_TRANS_ZBB_R(min, tcg_gen_smin_tl)
+GEN_TRANS_ZBB_R(minu, tcg_gen_umin_tl)
+
+static void gen_clz(TCGv ret, TCGv arg1)
+{
+    tcg_gen_clzi_tl(ret, arg1, TARGET_LONG_BITS);
+}
+
+static void gen_ctz(TCGv ret, TCGv arg1)
+{
+    tcg_gen_ctzi_tl(ret, arg1, TARGET_LONG_BITS);
+}
+
+GEN_TRANS_ZBB_UNARY(clz, gen_clz)
+GEN_TRANS_ZBB_UNARY(ctz, gen_ctz)
+GEN_TRANS_ZBB_UNARY(cpop, tcg_gen_ctpop_tl)
+GEN_TRANS_ZBB_UNARY(sext_b, tcg_gen_ext8s_tl)
+GEN_TRANS_ZBB_UNARY(sext_h, tcg_gen_ext16s_tl)
+
+/* zext.h has a different encoding on RV32 and RV64 */
+static bool trans_zext_h_32(DisasContext *ctx, arg_zext_h_32 *a,
+                            uint32_t insn)
+{
+#ifdef TARGET_RISCV64
+    return false;
+#else
+    REQUIRE_ZB(ctx, zbb);
+    return gen_unary(ctx, a->rd, a->rs1, tcg_gen_ext16u_tl);
+#endif
+}
+
+static bool trans_zext_h_64(DisasContext *ctx, arg_zext_h_64 *a,
+                            uint32_t insn)
+{
+    REQUIRE_64BIT(ctx);
+    REQUIRE_ZB(ctx, zbb);
+    return gen_unary(ctx, a->rd, a->rs1, tcg_gen_ext16u_tl);
+}
+
+static void gen_rol(TCGv ret, TCGv arg1, TCGv arg2)
+{
+    TCGv t = tcg_temp_new();
+
+    tcg_gen_andi_tl(t, arg2, TARGET_LONG_BITS - 1);
+    tcg_gen_rotl_tl(ret, arg1, t);
+    tcg_temp_free(t);
+}
+
+static void gen_ror(TCGv ret, TCGv arg1, TCGv arg2)
+{
+    TCGv t = tcg_temp_new();
+
+    tcg_gen_andi_tl(t, arg2, TARGET_LONG_BITS - 1);
+    tcg_gen_rotr_tl(ret, arg1, t);
+    tcg_temp_free(t);
+}
+
+GEN_TRANS_ZBB_R(rol, gen_rol)
+GEN_TRANS_ZBB_R(ror, gen_ror)
+
+static void gen_rori(TCGv ret, TCGv arg1, target_long shamt)
+{
+    tcg_gen_rotri_tl(ret, arg1, shamt);
+}
+
+static bool trans_rori(DisasContext *ctx, arg_rori *a, uint32_t insn)
+{
+    REQUIRE_ZB(ctx, zbb);
+    return gen_shift_imm(ctx, a, gen_rori);
+}
+
+/*
+ * Bytes become 0xff if they are nonzero: adding 0x7f to the low seven
+ * bits carries into bit 7 unless they are all zero, or-ing in the byte
+ * catches bit 7 itself.  Bit 7 of each byte is then spread over it.
+ */
+static void gen_orc_b(TCGv ret, TCGv arg1)
+{
+    TCGv t = tcg_temp_new();
+    target_ulong ones = (target_ulong)-1 / 0xff;
+
+    tcg_gen_andi_tl(t, arg1, ones * 0x7f);
+    tcg_gen_addi_tl(t, t, ones * 0x7f);
+    tcg_gen_or_tl(t, t, arg1);
+    tcg_gen_andi_tl(t, t, ones * 0x80);
+    tcg_gen_shri_tl(t, t, 7);
+    tcg_gen_muli_tl(ret, t, 0xff);
+    tcg_temp_free(t);
+}
+
+GEN_TRANS_ZBB_UNARY(orc_b, gen_orc_b)
+
+static void gen_rev8(TCGv ret, TCGv arg1)
+{
+#ifdef TARGET_RISCV64
+    tcg_gen_bswap64_i64(ret, arg1);
+#else
+    tcg_gen_bswap32_i32(ret, arg1);
+#endif
+}
+
+static bool trans_rev8_32(DisasContext *ctx, arg_rev8_32 *a, uint32_t insn)
+{
+#ifdef TARGET_RISCV64
+    return false;
+#else
+    REQUIRE_ZB(ctx, zbb);
+    return gen_unary(ctx, a->rd, a->rs1, gen_rev8);
+#endif
+}
+
+static bool trans_rev8_64(DisasContext *ctx, arg_rev8_64 *a, uint32_t insn)
+{
+    REQUIRE_64BIT(ctx);
+    REQUIRE_ZB(ctx, zbb);
+    return gen_unary(ctx, a->rd, a->rs1, gen_rev8);
+}
+
+/*
+ * The word forms operate on the low 32 bits with the 32-bit TCG ops,
+ * and sign-extend the result.  Only RV64 decodes them.
+ */
+static void gen_unary_w(TCGv ret, TCGv arg1,
+                        void (*func)(TCGv_i32, TCGv_i32))
+{
+    TCGv_i32 t = tcg_temp_new_i32();
+
+    tcg_gen_trunc_tl_i32(t, arg1);
+    func(t, t);
+    tcg_gen_ext_i32_tl(ret, t);
+    tcg_temp_free_i32(t);
+}
+
+static void gen_clz_i32(TCGv_i32 ret, TCGv_i32 arg1)
+{
+    tcg_gen_clzi_i32(ret, arg1, 32);
+}
+
+static void gen_ctz_i32(TCGv_i32 ret, TCGv_i32 arg1)
+{
+    tcg_gen_ctzi_i32(ret, arg1, 32);
+}
+
+static void gen_clzw(TCGv ret, TCGv arg1)
+{
+    gen_unary_w(ret, arg1, gen_clz_i32);
+}
+
+static void gen_ctzw(TCGv ret, TCGv arg1)
+{
+    gen_unary_w(ret, arg1, gen_ctz_i32);
+}
+
+static void gen_cpopw(TCGv ret, TCGv arg1)
+{
+    gen_unary_w(ret, arg1, tcg_gen_ctpop_i32);
+}
+
+static void gen_rotw(TCGv ret, TCGv arg1, TCGv arg2,
+                     void (*func)(TCGv_i32, TCGv_i32, TCGv_i32))
+{
+    TCGv_i32 t1 = tcg_temp_new_i32();
+    TCGv_i32 t2 = tcg_temp_new_i32();
+
+    tcg_gen_trunc_tl_i32(t1, arg1);
+    tcg_gen_trunc_tl_i32(t2, arg2);
+    tcg_gen_andi_i32(t2, t2, 31);
+    func(t1, t1, t2);
+    tcg_gen_ext_i32_tl(ret, t1);
+    tcg_temp_free_i32(t1);
+    tcg_temp_free_i32(t2);
+}
+
+static void gen_rolw(TCGv ret, TCGv arg1, TCGv arg2)
+{
+    gen_rotw(ret, arg1, arg2, tcg_gen_rotl_i32);
+}
+
+static void gen_rorw(TCGv ret, TCGv arg1, TCGv arg2)
+{
+    gen_rotw(ret, arg1, arg2, tcg_gen_rotr_i32);
+}
+
+static void gen_roriw(TCGv ret, TCGv arg1, target_long shamt)
+{
+    TCGv_i32 t = tcg_temp_new_i32();
+
+    tcg_gen_trunc_tl_i32(t, arg1);
+    tcg_gen_rotri_i32(t, t, shamt);
+    tcg_gen_ext_i32_tl(ret, t);
+    tcg_temp_free_i32(t);
+}
+
+#define GEN_TRANS_ZBB_UNARY_W(NAME)                                     \
+static bool trans_##NAME(DisasContext *ctx, arg_##NAME *a, uint32_t insn) \
+{                                                                       \
+    REQUIRE_64BIT(ctx);                                                 \
+    REQUIRE_ZB(ctx, zbb);                                               \
+    return gen_unary(ctx, a->rd, a->rs1, gen_##NAME);                   \
+}
+
+#define GEN_TRANS_ZBB_R_W(NAME)                                         \
+static bool trans_##NAME(DisasContext *ctx, arg_##NAME *a, uint32_t insn) \
+{                                                                       \
+    REQUIRE_64BIT(ctx);                                                 \
+    REQUIRE_ZB(ctx, zbb);                                               \
+    return gen_binary(ctx, a, gen_##NAME);                              \
+}
+
+GEN_TRANS_ZBB_UNARY_W(clzw)
+GEN_TRANS_ZBB_UNARY_W(ctzw)
+GEN_TRANS_ZBB_UNARY_W(cpopw)
+GEN_TRANS_ZBB_R_W(rolw)
+GEN_TRANS_ZBB_R_W(rorw)
+
+static bool trans_roriw(DisasContext *ctx, arg_roriw *a, uint32_t insn)
+{
+    REQUIRE_64BIT(ctx);
+    REQUIRE_ZB(ctx, zbb);
+    return gen_shift_imm(ctx, a, gen_roriw);
+}
+
+/* Zbs, the bit index is taken modulo XLEN */
+
+static void gen_bit(TCGv ret, TCGv arg2)
+{
+    TCGv one = tcg_const_tl(1);
+
+    tcg_gen_andi_tl(ret, arg2, TARGET_LONG_BITS - 1);
+    tcg_gen_shl_tl(ret, one, ret);
+    tcg_temp_free(one);
+}
+
+static void gen_bclr(TCGv ret, TCGv arg1, TCGv arg2)
+{
+    TCGv t = tcg_temp_new();
+
+    gen_bit(t, arg2);
+    tcg_gen_andc_tl(ret, arg1, t);
+    tcg_temp_free(t);
+}
+
+static void gen_binv(TCGv ret, TCGv arg1, TCGv arg2)
+{
+    TCGv t = tcg_temp_new();
+
+    gen_bit(t, arg2);
+    tcg_gen_xor_tl(ret, arg1, t);
+    tcg_temp_free(t);
+}
+
+static void gen_bset(TCGv ret, TCGv arg1, TCGv arg2)
+{
+    TCGv t = tcg_temp_new();
+
+    gen_bit(t, arg2);
+    tcg_gen_or_tl(ret, arg1, t);
+    tcg_temp_free(t);
+}
+
+static void gen_bext(TCGv ret, TCGv arg1, TCGv arg2)
+{
+    TCGv t = tcg_temp_new();
+
+    tcg_gen_andi_tl(t, arg2, TARGET_LONG_BITS - 1);
+    tcg_gen_shr_tl(t, arg1, t);
+    tcg_gen_andi_tl(ret, t, 1);
+    tcg_temp_free(t);
+}
+
+static void gen_bclri(TCGv ret, TCGv arg1, target_long shamt)
+{
+    tcg_gen_andi_tl(ret, arg1, ~((target_ulong)1 << shamt));
+}
+
+static void gen_binvi(TCGv ret, TCGv arg1, target_long shamt)
+{
+    tcg_gen_xori_tl(ret, arg1, (target_ulong)1 << shamt);
+}
+
+static void gen_bseti(TCGv ret, TCGv arg1, target_long shamt)
+{
+    tcg_gen_ori_tl(ret, arg1, (target_ulong)1 << shamt);
+}
+
+static void gen_bexti(TCGv ret, TCGv arg1, target_long shamt)
+{
+    tcg_gen_extract_tl(ret, arg1, shamt, 1);
+}
+
+#define GEN_TRANS_ZBS(NAME)                                             \
+static bool trans_##NAME(DisasContext *ctx, arg_##NAME *a, uint32_t insn) \
+{                                                                       \
+    REQUIRE_ZB(ctx, zbs);                                               \
+    return gen_binary(ctx, a, gen_##NAME);                              \
+}
+
+#define GEN_TRANS_ZBS_I(NAME)                                           \
+static bool trans_##NAME(DisasContext *ctx, arg_##NAME *a, uint32_t insn) \
+{                                                                       \
+    REQUIRE_ZB(ctx, zbs);                                               \
+    return gen_shift_imm(ctx, a, gen_##NAME);                           \
+}
+
+GEN_TRANS_ZBS(bclr)
+GEN_TRANS_ZBS(bext)
+GEN_TRANS_ZBS(binv)
+GEN_TRANS_ZBS(bset)
+GEN_TRANS_ZBS_I(bclri)
+GEN_TRANS_ZBS_I(bexti)
+GEN_TRANS_ZBS_I(binvi)
+GEN_TRANS_ZBS_I(bseti)
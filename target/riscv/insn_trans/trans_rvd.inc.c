@@ -0,0 +1,211 @@
+/*
+ * RISC-V translation routines for the RVD Standard Extension.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 or later, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+static bool trans_fld(DisasContext *ctx, arg_fld *a, uint32_t insn)
+{
+    gen_fp_load(ctx, OPC_RISC_FLD, a->rd, a->rs1, a->imm);
+    return true;
+}
+
+static bool trans_fsd(DisasContext *ctx, arg_fsd *a, uint32_t insn)
+{
+    gen_fp_store(ctx, OPC_RISC_FSD, a->rs1, a->rs2, a->imm);
+    return true;
+}
+
+static bool trans_fmadd_d(DisasContext *ctx, arg_fmadd_d *a, uint32_t insn)
+{
+    gen_fp_fmadd(ctx, OPC_RISC_FMADD_D, a->rd, a->rs1, a->rs2, a->rs3,
+                 a->rm);
+    return true;
+}
+
+static bool trans_fmsub_d(DisasContext *ctx, arg_fmsub_d *a, uint32_t insn)
+{
+    gen_fp_fmsub(ctx, OPC_RISC_FMSUB_D, a->rd, a->rs1, a->rs2, a->rs3,
+                 a->rm);
+    return true;
+}
+
+static bool trans_fnmsub_d(DisasContext *ctx, arg_fnmsub_d *a, uint32_t insn)
+{
+    gen_fp_fnmsub(ctx, OPC_RISC_FNMSUB_D, a->rd, a->rs1, a->rs2, a->rs3,
+                  a->rm);
+    return true;
+}
+
+static bool trans_fnmadd_d(DisasContext *ctx, arg_fnmadd_d *a, uint32_t insn)
+{
+    gen_fp_fnmadd(ctx, OPC_RISC_FNMADD_D, a->rd, a->rs1, a->rs2, a->rs3,
+                  a->rm);
+    return true;
+}
+
+static bool trans_fadd_d(DisasContext *ctx, arg_fadd_d *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FADD_D, a->rd, a->rs1, a->rs2, a->rm);
+    return true;
+}
+
+static bool trans_fsub_d(DisasContext *ctx, arg_fsub_d *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FSUB_D, a->rd, a->rs1, a->rs2, a->rm);
+    return true;
+}
+
+static bool trans_fmul_d(DisasContext *ctx, arg_fmul_d *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FMUL_D, a->rd, a->rs1, a->rs2, a->rm);
+    return true;
+}
+
+static bool trans_fdiv_d(DisasContext *ctx, arg_fdiv_d *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FDIV_D, a->rd, a->rs1, a->rs2, a->rm);
+    return true;
+}
+
+static bool trans_fsqrt_d(DisasContext *ctx, arg_fsqrt_d *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FSQRT_D, a->rd, a->rs1, 0, a->rm);
+    return true;
+}
+
+static bool trans_fsgnj_d(DisasContext *ctx, arg_fsgnj_d *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FSGNJ_D, a->rd, a->rs1, a->rs2, 0);
+    return true;
+}
+
+static bool trans_fsgnjn_d(DisasContext *ctx, arg_fsgnjn_d *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FSGNJ_D, a->rd, a->rs1, a->rs2, 1);
+    return true;
+}
+
+static bool trans_fsgnjx_d(DisasContext *ctx, arg_fsgnjx_d *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FSGNJ_D, a->rd, a->rs1, a->rs2, 2);
+    return true;
+}
+
+static bool trans_fmin_d(DisasContext *ctx, arg_fmin_d *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FMIN_D, a->rd, a->rs1, a->rs2, 0);
+    return true;
+}
+
+static bool trans_fmax_d(DisasContext *ctx, arg_fmax_d *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FMIN_D, a->rd, a->rs1, a->rs2, 1);
+    return true;
+}
+
+static bool trans_fcvt_s_d(DisasContext *ctx, arg_fcvt_s_d *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FCVT_S_D, a->rd, a->rs1, 1, a->rm);
+    return true;
+}
+
+static bool trans_fcvt_d_s(DisasContext *ctx, arg_fcvt_d_s *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FCVT_D_S, a->rd, a->rs1, 0, a->rm);
+    return true;
+}
+
+static bool trans_feq_d(DisasContext *ctx, arg_feq_d *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FEQ_D, a->rd, a->rs1, a->rs2, 2);
+    return true;
+}
+
+static bool trans_flt_d(DisasContext *ctx, arg_flt_d *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FEQ_D, a->rd, a->rs1, a->rs2, 1);
+    return true;
+}
+
+static bool trans_fle_d(DisasContext *ctx, arg_fle_d *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FEQ_D, a->rd, a->rs1, a->rs2, 0);
+    return true;
+}
+
+static bool trans_fclass_d(DisasContext *ctx, arg_fclass_d *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FCLASS_D, a->rd, a->rs1, 0, 1);
+    return true;
+}
+
+static bool trans_fcvt_w_d(DisasContext *ctx, arg_fcvt_w_d *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FCVT_W_D, a->rd, a->rs1, 0, a->rm);
+    return true;
+}
+
+static bool trans_fcvt_wu_d(DisasContext *ctx, arg_fcvt_wu_d *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FCVT_W_D, a->rd, a->rs1, 1, a->rm);
+    return true;
+}
+
+static bool trans_fcvt_d_w(DisasContext *ctx, arg_fcvt_d_w *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FCVT_D_W, a->rd, a->rs1, 0, a->rm);
+    return true;
+}
+
+static bool trans_fcvt_d_wu(DisasContext *ctx, arg_fcvt_d_wu *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FCVT_D_W, a->rd, a->rs1, 1, a->rm);
+    return true;
+}
+
+static bool trans_fcvt_l_d(DisasContext *ctx, arg_fcvt_l_d *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FCVT_W_D, a->rd, a->rs1, 2, a->rm);
+    return true;
+}
+
+static bool trans_fcvt_lu_d(DisasContext *ctx, arg_fcvt_lu_d *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FCVT_W_D, a->rd, a->rs1, 3, a->rm);
+    return true;
+}
+
+static bool trans_fmv_x_d(DisasContext *ctx, arg_fmv_x_d *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FMV_X_D, a->rd, a->rs1, 0, 0);
+    return true;
+}
+
+static bool trans_fcvt_d_l(DisasContext *ctx, arg_fcvt_d_l *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FCVT_D_W, a->rd, a->rs1, 2, a->rm);
+    return true;
+}
+
+static bool trans_fcvt_d_lu(DisasContext *ctx, arg_fcvt_d_lu *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FCVT_D_W, a->rd, a->rs1, 3, a->rm);
+    return true;
+}
+
+static bool trans_fmv_d_x(DisasContext *ctx, arg_fmv_d_x *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FMV_D_X, a->rd, a->rs1, 0, 0);
+    return true;
+}
@@ -0,0 +1,199 @@
+/*
+ * RISC-V translation routines for the RVF Standard Extension.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 or later, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+static bool trans_flw(DisasContext *ctx, arg_flw *a, uint32_t insn)
+{
+    gen_fp_load(ctx, OPC_RISC_FLW, a->rd, a->rs1, a->imm);
+    return true;
+}
+
+static bool trans_fsw(DisasContext *ctx, arg_fsw *a, uint32_t insn)
+{
+    gen_fp_store(ctx, OPC_RISC_FSW, a->rs1, a->rs2, a->imm);
+    return true;
+}
+
+static bool trans_fmadd_s(DisasContext *ctx, arg_fmadd_s *a, uint32_t insn)
+{
+    gen_fp_fmadd(ctx, OPC_RISC_FMADD_S, a->rd, a->rs1, a->rs2, a->rs3,
+                 a->rm);
+    return true;
+}
+
+static bool trans_fmsub_s(DisasContext *ctx, arg_fmsub_s *a, uint32_t insn)
+{
+    gen_fp_fmsub(ctx, OPC_RISC_FMSUB_S, a->rd, a->rs1, a->rs2, a->rs3,
+                 a->rm);
+    return true;
+}
+
+static bool trans_fnmsub_s(DisasContext *ctx, arg_fnmsub_s *a, uint32_t insn)
+{
+    gen_fp_fnmsub(ctx, OPC_RISC_FNMSUB_S, a->rd, a->rs1, a->rs2, a->rs3,
+                  a->rm);
+    return true;
+}
+
+static bool trans_fnmadd_s(DisasContext *ctx, arg_fnmadd_s *a, uint32_t insn)
+{
+    gen_fp_fnmadd(ctx, OPC_RISC_FNMADD_S, a->rd, a->rs1, a->rs2, a->rs3,
+                  a->rm);
+    return true;
+}
+
+static bool trans_fadd_s(DisasContext *ctx, arg_fadd_s *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FADD_S, a->rd, a->rs1, a->rs2, a->rm);
+    return true;
+}
+
+static bool trans_fsub_s(DisasContext *ctx, arg_fsub_s *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FSUB_S, a->rd, a->rs1, a->rs2, a->rm);
+    return true;
+}
+
+static bool trans_fmul_s(DisasContext *ctx, arg_fmul_s *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FMUL_S, a->rd, a->rs1, a->rs2, a->rm);
+    return true;
+}
+
+static bool trans_fdiv_s(DisasContext *ctx, arg_fdiv_s *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FDIV_S, a->rd, a->rs1, a->rs2, a->rm);
+    return true;
+}
+
+static bool trans_fsqrt_s(DisasContext *ctx, arg_fsqrt_s *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FSQRT_S, a->rd, a->rs1, 0, a->rm);
+    return true;
+}
+
+static bool trans_fsgnj_s(DisasContext *ctx, arg_fsgnj_s *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FSGNJ_S, a->rd, a->rs1, a->rs2, 0);
+    return true;
+}
+
+static bool trans_fsgnjn_s(DisasContext *ctx, arg_fsgnjn_s *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FSGNJ_S, a->rd, a->rs1, a->rs2, 1);
+    return true;
+}
+
+static bool trans_fsgnjx_s(DisasContext *ctx, arg_fsgnjx_s *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FSGNJ_S, a->rd, a->rs1, a->rs2, 2);
+    return true;
+}
+
+static bool trans_fmin_s(DisasContext *ctx, arg_fmin_s *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FMIN_S, a->rd, a->rs1, a->rs2, 0);
+    return true;
+}
+
+static bool trans_fmax_s(DisasContext *ctx, arg_fmax_s *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FMIN_S, a->rd, a->rs1, a->rs2, 1);
+    return true;
+}
+
+static bool trans_fcvt_w_s(DisasContext *ctx, arg_fcvt_w_s *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FCVT_W_S, a->rd, a->rs1, 0, a->rm);
+    return true;
+}
+
+static bool trans_fcvt_wu_s(DisasContext *ctx, arg_fcvt_wu_s *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FCVT_W_S, a->rd, a->rs1, 1, a->rm);
+    return true;
+}
+
+static bool trans_fmv_x_w(DisasContext *ctx, arg_fmv_x_w *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FMV_X_S, a->rd, a->rs1, 0, 0);
+    return true;
+}
+
+static bool trans_feq_s(DisasContext *ctx, arg_feq_s *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FEQ_S, a->rd, a->rs1, a->rs2, 2);
+    return true;
+}
+
+static bool trans_flt_s(DisasContext *ctx, arg_flt_s *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FEQ_S, a->rd, a->rs1, a->rs2, 1);
+    return true;
+}
+
+static bool trans_fle_s(DisasContext *ctx, arg_fle_s *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FEQ_S, a->rd, a->rs1, a->rs2, 0);
+    return true;
+}
+
+static bool trans_fclass_s(DisasContext *ctx, arg_fclass_s *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FMV_X_S, a->rd, a->rs1, 0, 1);
+    return true;
+}
+
+static bool trans_fcvt_s_w(DisasContext *ctx, arg_fcvt_s_w *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FCVT_S_W, a->rd, a->rs1, 0, a->rm);
+    return true;
+}
+
+static bool trans_fcvt_s_wu(DisasContext *ctx, arg_fcvt_s_wu *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FCVT_S_W, a->rd, a->rs1, 1, a->rm);
+    return true;
+}
+
+static bool trans_fmv_w_x(DisasContext *ctx, arg_fmv_w_x *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FMV_S_X, a->rd, a->rs1, 0, 0);
+    return true;
+}
+
+static bool trans_fcvt_l_s(DisasContext *ctx, arg_fcvt_l_s *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FCVT_W_S, a->rd, a->rs1, 2, a->rm);
+    return true;
+}
+
+static bool trans_fcvt_lu_s(DisasContext *ctx, arg_fcvt_lu_s *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FCVT_W_S, a->rd, a->rs1, 3, a->rm);
+    return true;
+}
+
+static bool trans_fcvt_s_l(DisasContext *ctx, arg_fcvt_s_l *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FCVT_S_W, a->rd, a->rs1, 2, a->rm);
+    return true;
+}
+
+static bool trans_fcvt_s_lu(DisasContext *ctx, arg_fcvt_s_lu *a, uint32_t insn)
+{
+    gen_fp_arith(ctx, OPC_RISC_FCVT_S_W, a->rd, a->rs1, 3, a->rm);
+    return true;
+}
@@ -0,0 +1,146 @@
+/*
+ * RISC-V translation routines for the H extension.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 or later, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The hypervisor instructions are for HS-mode and M-mode.  In VS-mode
+ * and VU-mode they raise virtual instruction exceptions, so that the
+ * hypervisor can emulate them for a nested guest.  The loads and stores
+ * are also allowed in U-mode with hstatus.HU set, which their helper
+ * checks.
+ */
+#define REQUIRE_HYP_INSN(ctx, user_ok) do {                            \
+    if (!riscv_has_ext((ctx)->env, RVH) ||                             \
+        (!(user_ok) && !(ctx)->virt && (ctx)->mem_idx < PRV_S)) {      \
+        return false;                                                  \
+    }                                                                  \
+    if ((ctx)->virt) {                                                 \
+        generate_exception(ctx, RISCV_EXCP_VIRT_INSTRUCTION_FAULT);    \
+        return true;                                                   \
+    }                                                                  \
+} while (0)
+
+#ifndef CONFIG_USER_ONLY
+static bool gen_hyp_load(DisasContext *ctx, arg_hlv_b *a, TCGMemOp memop)
+{
+    TCGv_i32 mop;
+
+    REQUIRE_HYP_INSN(ctx, true);
+    mop = tcg_const_i32(memop);
+    gen_helper_hyp_load(dest_gpr(ctx, a->rd), cpu_env, get_gpr(ctx, a->rs1),
+                        mop);
+    tcg_temp_free_i32(mop);
+    return true;
+}
+
+static bool gen_hyp_store(DisasContext *ctx, arg_hsv_b *a, TCGMemOp memop)
+{
+    TCGv_i32 mop;
+
+    REQUIRE_HYP_INSN(ctx, true);
+    mop = tcg_const_i32(memop);
+    gen_helper_hyp_store(cpu_env, get_gpr(ctx, a->rs1), get_gpr(ctx, a->rs2),
+                         mop);
+    tcg_temp_free_i32(mop);
+    return true;
+}
+#endif
+
+#ifndef CONFIG_USER_ONLY
+#define GEN_TRANS_HLV(NAME, MEMOP)                                     \
+static bool trans_##NAME(DisasContext *ctx, arg_##NAME *a, uint32_t insn) \
+{                                                                      \
+    return gen_hyp_load(ctx, a, MEMOP);                                \
+}
+#define GEN_TRANS_HSV(NAME, MEMOP)                                     \
+static bool trans_##NAME(DisasContext *ctx, arg_##NAME *a, uint32_t insn) \
+{                                                                      \
+    return gen_hyp_store(ctx, a, MEMOP);                               \
+}
+#else
+#define GEN_TRANS_HLV(NAME, MEMOP)                                     \
+static bool trans_##NAME(DisasContext *ctx, arg_##NAME *a, uint32_t insn) \
+{                                                                      \
+    return false;                                                      \
+}
+#define GEN_TRANS_HSV GEN_TRANS_HLV
+#endif
+
+GEN_TRANS_HLV(hlv_b, MO_SB)
+GEN_TRANS_HLV(hlv_bu, MO_UB)
+GEN_TRANS_HLV(hlv_h, MO_TESW)
+GEN_TRANS_HLV(hlv_hu, MO_TEUW)
+GEN_TRANS_HLV(hlv_w, MO_TESL)
+GEN_TRANS_HSV(hsv_b, MO_UB)
+GEN_TRANS_HSV(hsv_h, MO_TEUW)
+GEN_TRANS_HSV(hsv_w, MO_TEUL)
+
+static bool trans_hlv_wu(DisasContext *ctx, arg_hlv_wu *a, uint32_t insn)
+{
+    REQUIRE_64BIT(ctx);
+#ifndef CONFIG_USER_ONLY
+    return gen_hyp_load(ctx, a, MO_TEUL);
+#else
+    return false;
+#endif
+}
+
+static bool trans_hlv_d(DisasContext *ctx, arg_hlv_d *a, uint32_t insn)
+{
+    REQUIRE_64BIT(ctx);
+#ifndef CONFIG_USER_ONLY
+    return gen_hyp_load(ctx, a, MO_TEQ);
+#else
+    return false;
+#endif
+}
+
+static bool trans_hsv_d(DisasContext *ctx, arg_hsv_d *a, uint32_t insn)
+{
+    REQUIRE_64BIT(ctx);
+#ifndef CONFIG_USER_ONLY
+    return gen_hyp_store(ctx, a, MO_TEQ);
+#else
+    return false;
+#endif
+}
+
+/*
+ * The fences drop every VS-stage or G-stage translation of the guest,
+ * the TLB only ever holds those of the current vsatp and hgatp.
+ */
+static bool trans_hfence_vvma(DisasContext *ctx, arg_hfence_vvma *a,
+                              uint32_t insn)
+{
+#ifndef CONFIG_USER_ONLY
+    REQUIRE_HYP_INSN(ctx, false);
+    gen_helper_hfence_vvma(cpu_env);
+    return true;
+#else
+    return false;
+#endif
+}
+
+static bool trans_hfence_gvma(DisasContext *ctx, arg_hfence_gvma *a,
+                              uint32_t insn)
+{
+#ifndef CONFIG_USER_ONLY
+    REQUIRE_HYP_INSN(ctx, false);
+    gen_helper_hfence_gvma(cpu_env);
+    return true;
+#else
+    return false;
+#endif
+}
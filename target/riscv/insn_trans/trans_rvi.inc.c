@@ -0,0 +1,395 @@
+/*
+ * RISC-V translation routines for the RVXI Base Integer Instruction Set.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 or later, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+static bool trans_lui(DisasContext *ctx, arg_lui *a, uint32_t insn)
+{
+    if (a->rd != 0) {
+        tcg_gen_movi_tl(cpu_gpr[a->rd], a->imm);
+        gen_trace_gpr(a->rd);
+    }
+    return true;
+}
+
+static bool trans_auipc(DisasContext *ctx, arg_auipc *a, uint32_t insn)
+{
+    if (a->rd != 0) {
+        tcg_gen_movi_tl(cpu_gpr[a->rd], a->imm + ctx->base.pc_next);
+        gen_trace_gpr(a->rd);
+    }
+    return true;
+}
+
+static bool trans_jal(DisasContext *ctx, arg_jal *a, uint32_t insn)
+{
+    gen_jal(ctx->env, ctx, a->rd, a->imm);
+    return true;
+}
+
+static bool trans_jalr(DisasContext *ctx, arg_jalr *a, uint32_t insn)
+{
+    gen_jalr(ctx->env, ctx, OPC_RISC_JALR, a->rd, a->rs1, a->imm);
+    return true;
+}
+
+static bool trans_beq(DisasContext *ctx, arg_beq *a, uint32_t insn)
+{
+    gen_branch(ctx->env, ctx, OPC_RISC_BEQ, a->rs1, a->rs2, a->imm);
+    return true;
+}
+
+static bool trans_bne(DisasContext *ctx, arg_bne *a, uint32_t insn)
+{
+    gen_branch(ctx->env, ctx, OPC_RISC_BNE, a->rs1, a->rs2, a->imm);
+    return true;
+}
+
+static bool trans_blt(DisasContext *ctx, arg_blt *a, uint32_t insn)
+{
+    gen_branch(ctx->env, ctx, OPC_RISC_BLT, a->rs1, a->rs2, a->imm);
+    return true;
+}
+
+static bool trans_bge(DisasContext *ctx, arg_bge *a, uint32_t insn)
+{
+    gen_branch(ctx->env, ctx, OPC_RISC_BGE, a->rs1, a->rs2, a->imm);
+    return true;
+}
+
+static bool trans_bltu(DisasContext *ctx, arg_bltu *a, uint32_t insn)
+{
+    gen_branch(ctx->env, ctx, OPC_RISC_BLTU, a->rs1, a->rs2, a->imm);
+    return true;
+}
+
+static bool trans_bgeu(DisasContext *ctx, arg_bgeu *a, uint32_t insn)
+{
+    gen_branch(ctx->env, ctx, OPC_RISC_BGEU, a->rs1, a->rs2, a->imm);
+    return true;
+}
+
+static bool trans_lb(DisasContext *ctx, arg_lb *a, uint32_t insn)
+{
+    gen_load(ctx, OPC_RISC_LB, a->rd, a->rs1, a->imm);
+    return true;
+}
+
+static bool trans_lh(DisasContext *ctx, arg_lh *a, uint32_t insn)
+{
+    gen_load(ctx, OPC_RISC_LH, a->rd, a->rs1, a->imm);
+    return true;
+}
+
+static bool trans_lw(DisasContext *ctx, arg_lw *a, uint32_t insn)
+{
+    gen_load(ctx, OPC_RISC_LW, a->rd, a->rs1, a->imm);
+    return true;
+}
+
+static bool trans_lbu(DisasContext *ctx, arg_lbu *a, uint32_t insn)
+{
+    gen_load(ctx, OPC_RISC_LBU, a->rd, a->rs1, a->imm);
+    return true;
+}
+
+static bool trans_lhu(DisasContext *ctx, arg_lhu *a, uint32_t insn)
+{
+    gen_load(ctx, OPC_RISC_LHU, a->rd, a->rs1, a->imm);
+    return true;
+}
+
+static bool trans_lwu(DisasContext *ctx, arg_lwu *a, uint32_t insn)
+{
+    gen_load(ctx, OPC_RISC_LWU, a->rd, a->rs1, a->imm);
+    return true;
+}
+
+static bool trans_ld(DisasContext *ctx, arg_ld *a, uint32_t insn)
+{
+    gen_load(ctx, OPC_RISC_LD, a->rd, a->rs1, a->imm);
+    return true;
+}
+
+static bool trans_sb(DisasContext *ctx, arg_sb *a, uint32_t insn)
+{
+    gen_store(ctx, OPC_RISC_SB, a->rs1, a->rs2, a->imm);
+    return true;
+}
+
+static bool trans_sh(DisasContext *ctx, arg_sh *a, uint32_t insn)
+{
+    gen_store(ctx, OPC_RISC_SH, a->rs1, a->rs2, a->imm);
+    return true;
+}
+
+static bool trans_sw(DisasContext *ctx, arg_sw *a, uint32_t insn)
+{
+    gen_store(ctx, OPC_RISC_SW, a->rs1, a->rs2, a->imm);
+    return true;
+}
+
+static bool trans_sd(DisasContext *ctx, arg_sd *a, uint32_t insn)
+{
+    gen_store(ctx, OPC_RISC_SD, a->rs1, a->rs2, a->imm);
+    return true;
+}
+
+static bool gen_arith_imm_nop(DisasContext *ctx, arg_i *a, uint32_t opc)
+{
+    if (a->rd != 0) {
+        gen_arith_imm(ctx, opc, a->rd, a->rs1, a->imm);
+    }
+    return true;
+}
+
+static bool gen_arith_rr(DisasContext *ctx, arg_r *a, uint32_t opc)
+{
+    if (a->rd != 0) {
+        gen_arith(ctx, opc, a->rd, a->rs1, a->rs2);
+    }
+    return true;
+}
+
+static bool trans_addi(DisasContext *ctx, arg_addi *a, uint32_t insn)
+{
+    return gen_arith_imm_nop(ctx, a, OPC_RISC_ADDI);
+}
+
+static bool trans_slti(DisasContext *ctx, arg_slti *a, uint32_t insn)
+{
+    return gen_arith_imm_nop(ctx, a, OPC_RISC_SLTI);
+}
+
+static bool trans_sltiu(DisasContext *ctx, arg_sltiu *a, uint32_t insn)
+{
+    return gen_arith_imm_nop(ctx, a, OPC_RISC_SLTIU);
+}
+
+static bool trans_xori(DisasContext *ctx, arg_xori *a, uint32_t insn)
+{
+    return gen_arith_imm_nop(ctx, a, OPC_RISC_XORI);
+}
+
+static bool trans_ori(DisasContext *ctx, arg_ori *a, uint32_t insn)
+{
+    return gen_arith_imm_nop(ctx, a, OPC_RISC_ORI);
+}
+
+static bool trans_andi(DisasContext *ctx, arg_andi *a, uint32_t insn)
+{
+    return gen_arith_imm_nop(ctx, a, OPC_RISC_ANDI);
+}
+
+static bool trans_addiw(DisasContext *ctx, arg_addiw *a, uint32_t insn)
+{
+    return gen_arith_imm_nop(ctx, a, OPC_RISC_ADDIW);
+}
+
+static bool trans_slli(DisasContext *ctx, arg_slli *a, uint32_t insn)
+{
+    gen_arith_imm(ctx, OPC_RISC_SLLI, a->rd, a->rs1, a->shamt);
+    return true;
+}
+
+static bool trans_srli(DisasContext *ctx, arg_srli *a, uint32_t insn)
+{
+    gen_arith_imm(ctx, OPC_RISC_SHIFT_RIGHT_I, a->rd, a->rs1, a->shamt);
+    return true;
+}
+
+static bool trans_srai(DisasContext *ctx, arg_srai *a, uint32_t insn)
+{
+    gen_arith_imm(ctx, OPC_RISC_SHIFT_RIGHT_I, a->rd, a->rs1, a->shamt | 0x400);
+    return true;
+}
+
+static bool trans_slliw(DisasContext *ctx, arg_slliw *a, uint32_t insn)
+{
+    gen_arith_imm(ctx, OPC_RISC_SLLIW, a->rd, a->rs1, a->shamt);
+    return true;
+}
+
+static bool trans_srliw(DisasContext *ctx, arg_srliw *a, uint32_t insn)
+{
+    gen_arith_imm(ctx, OPC_RISC_SHIFT_RIGHT_IW, a->rd, a->rs1, a->shamt);
+    return true;
+}
+
+static bool trans_sraiw(DisasContext *ctx, arg_sraiw *a, uint32_t insn)
+{
+    gen_arith_imm(ctx, OPC_RISC_SHIFT_RIGHT_IW, a->rd, a->rs1,
+                  a->shamt | 0x400);
+    return true;
+}
+
+static bool trans_add(DisasContext *ctx, arg_add *a, uint32_t insn)
+{
+    return gen_arith_rr(ctx, a, OPC_RISC_ADD);
+}
+
+static bool trans_sub(DisasContext *ctx, arg_sub *a, uint32_t insn)
+{
+    return gen_arith_rr(ctx, a, OPC_RISC_SUB);
+}
+
+static bool trans_sll(DisasContext *ctx, arg_sll *a, uint32_t insn)
+{
+    return gen_arith_rr(ctx, a, OPC_RISC_SLL);
+}
+
+static bool trans_slt(DisasContext *ctx, arg_slt *a, uint32_t insn)
+{
+    return gen_arith_rr(ctx, a, OPC_RISC_SLT);
+}
+
+static bool trans_sltu(DisasContext *ctx, arg_sltu *a, uint32_t insn)
+{
+    return gen_arith_rr(ctx, a, OPC_RISC_SLTU);
+}
+
+static bool trans_xor(DisasContext *ctx, arg_xor *a, uint32_t insn)
+{
+    return gen_arith_rr(ctx, a, OPC_RISC_XOR);
+}
+
+static bool trans_srl(DisasContext *ctx, arg_srl *a, uint32_t insn)
+{
+    return gen_arith_rr(ctx, a, OPC_RISC_SRL);
+}
+
+static bool trans_sra(DisasContext *ctx, arg_sra *a, uint32_t insn)
+{
+    return gen_arith_rr(ctx, a, OPC_RISC_SRA);
+}
+
+static bool trans_or(DisasContext *ctx, arg_or *a, uint32_t insn)
+{
+    return gen_arith_rr(ctx, a, OPC_RISC_OR);
+}
+
+static bool trans_and(DisasContext *ctx, arg_and *a, uint32_t insn)
+{
+    return gen_arith_rr(ctx, a, OPC_RISC_AND);
+}
+
+static bool trans_addw(DisasContext *ctx, arg_addw *a, uint32_t insn)
+{
+    return gen_arith_rr(ctx, a, OPC_RISC_ADDW);
+}
+
+static bool trans_subw(DisasContext *ctx, arg_subw *a, uint32_t insn)
+{
+    return gen_arith_rr(ctx, a, OPC_RISC_SUBW);
+}
+
+static bool trans_sllw(DisasContext *ctx, arg_sllw *a, uint32_t insn)
+{
+    return gen_arith_rr(ctx, a, OPC_RISC_SLLW);
+}
+
+static bool trans_srlw(DisasContext *ctx, arg_srlw *a, uint32_t insn)
+{
+    return gen_arith_rr(ctx, a, OPC_RISC_SRLW);
+}
+
+static bool trans_sraw(DisasContext *ctx, arg_sraw *a, uint32_t insn)
+{
+    return gen_arith_rr(ctx, a, OPC_RISC_SRAW);
+}
+
+/* FENCE predecessor and successor set bits */
+#define FENCE_I   8
+#define FENCE_O   4
+#define FENCE_R   2
+#define FENCE_W   1
+#define FENCE_RW  (FENCE_R | FENCE_W)
+
+/* FENCE.TSO */
+#define FENCE_FM_TSO  8
+
+static bool trans_fence(DisasContext *ctx, arg_fence *a, uint32_t insn)
+{
+    /* Device input and output are ordered like loads and stores */
+    bool pr = a->pred & (FENCE_I | FENCE_R);
+    bool pw = a->pred & (FENCE_O | FENCE_W);
+    bool sr = a->succ & (FENCE_I | FENCE_R);
+    bool sw = a->succ & (FENCE_O | FENCE_W);
+    TCGBar bar = 0;
+
+    if (a->fm == FENCE_FM_TSO &&
+        a->pred == FENCE_RW && a->succ == FENCE_RW) {
+        /* Everything but store-to-load ordering */
+        bar = TCG_MO_LD_LD | TCG_MO_LD_ST | TCG_MO_ST_ST;
+    } else {
+        bar |= pr && sr ? TCG_MO_LD_LD : 0;
+        bar |= pr && sw ? TCG_MO_LD_ST : 0;
+        bar |= pw && sr ? TCG_MO_ST_LD : 0;
+        bar |= pw && sw ? TCG_MO_ST_ST : 0;
+    }
+
+    /* With an empty predecessor or successor set the FENCE is a hint */
+    if (bar) {
+        tcg_gen_mb(bar | TCG_BAR_SC);
+    }
+    return true;
+}
+
+static bool trans_fence_i(DisasContext *ctx, arg_fence_i *a, uint32_t insn)
+{
+#ifndef CONFIG_USER_ONLY
+    /* FENCE_I is a no-op in QEMU,
+     * however we need to end the translation block */
+    tcg_gen_movi_tl(cpu_pc, ctx->pc_succ_insn);
+    tcg_gen_exit_tb(NULL, 0);
+    ctx->base.is_jmp = DISAS_NORETURN;
+#endif
+    return true;
+}
+
+static bool trans_csrrw(DisasContext *ctx, arg_csrrw *a, uint32_t insn)
+{
+    gen_csr(ctx, OPC_RISC_CSRRW, a->rd, a->rs1, a->csr);
+    return true;
+}
+
+static bool trans_csrrs(DisasContext *ctx, arg_csrrs *a, uint32_t insn)
+{
+    gen_csr(ctx, OPC_RISC_CSRRS, a->rd, a->rs1, a->csr);
+    return true;
+}
+
+static bool trans_csrrc(DisasContext *ctx, arg_csrrc *a, uint32_t insn)
+{
+    gen_csr(ctx, OPC_RISC_CSRRC, a->rd, a->rs1, a->csr);
+    return true;
+}
+
+static bool trans_csrrwi(DisasContext *ctx, arg_csrrwi *a, uint32_t insn)
+{
+    gen_csr(ctx, OPC_RISC_CSRRWI, a->rd, a->rs1, a->csr);
+    return true;
+}
+
+static bool trans_csrrsi(DisasContext *ctx, arg_csrrsi *a, uint32_t insn)
+{
+    gen_csr(ctx, OPC_RISC_CSRRSI, a->rd, a->rs1, a->csr);
+    return true;
+}
+
+static bool trans_csrrci(DisasContext *ctx, arg_csrrci *a, uint32_t insn)
+{
+    gen_csr(ctx, OPC_RISC_CSRRCI, a->rd, a->rs1, a->csr);
+    return true;
+}
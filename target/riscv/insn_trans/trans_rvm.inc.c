@@ -0,0 +1,80 @@
+/*
+ * RISC-V translation routines for the RVXM Standard Extension.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 or later, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+static bool trans_mul(DisasContext *ctx, arg_mul *a, uint32_t insn)
+{
+    return gen_arith_rr(ctx, a, OPC_RISC_MUL);
+}
+
+static bool trans_mulh(DisasContext *ctx, arg_mulh *a, uint32_t insn)
+{
+    return gen_arith_rr(ctx, a, OPC_RISC_MULH);
+}
+
+static bool trans_mulhsu(DisasContext *ctx, arg_mulhsu *a, uint32_t insn)
+{
+    return gen_arith_rr(ctx, a, OPC_RISC_MULHSU);
+}
+
+static bool trans_mulhu(DisasContext *ctx, arg_mulhu *a, uint32_t insn)
+{
+    return gen_arith_rr(ctx, a, OPC_RISC_MULHU);
+}
+
+static bool trans_div(DisasContext *ctx, arg_div *a, uint32_t insn)
+{
+    return gen_arith_rr(ctx, a, OPC_RISC_DIV);
+}
+
+static bool trans_divu(DisasContext *ctx, arg_divu *a, uint32_t insn)
+{
+    return gen_arith_rr(ctx, a, OPC_RISC_DIVU);
+}
+
+static bool trans_rem(DisasContext *ctx, arg_rem *a, uint32_t insn)
+{
+    return gen_arith_rr(ctx, a, OPC_RISC_REM);
+}
+
+static bool trans_remu(DisasContext *ctx, arg_remu *a, uint32_t insn)
+{
+    return gen_arith_rr(ctx, a, OPC_RISC_REMU);
+}
+
+static bool trans_mulw(DisasContext *ctx, arg_mulw *a, uint32_t insn)
+{
+    return gen_arith_rr(ctx, a, OPC_RISC_MULW);
+}
+
+static bool trans_divw(DisasContext *ctx, arg_divw *a, uint32_t insn)
+{
+    return gen_arith_rr(ctx, a, OPC_RISC_DIVW);
+}
+
+static bool trans_divuw(DisasContext *ctx, arg_divuw *a, uint32_t insn)
+{
+    return gen_arith_rr(ctx, a, OPC_RISC_DIVUW);
+}
+
+static bool trans_remw(DisasContext *ctx, arg_remw *a, uint32_t insn)
+{
+    return gen_arith_rr(ctx, a, OPC_RISC_REMW);
+}
+
+static bool trans_remuw(DisasContext *ctx, arg_remuw *a, uint32_t insn)
+{
+    return gen_arith_rr(ctx, a, OPC_RISC_REMUW);
+}
@@ -0,0 +1,1092 @@
+/*
+ * RISC-V translation routines for the RVV Standard Extension.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 or later, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Operations on whole register groups, without a mask, and with vstart 0
+ * and vl equal to VLMAX (TB_FLAGS_VL_EQ_VLMAX) are expanded inline with
+ * the generic vector ops.  Everything else calls an out of line helper
+ * from vector_helper.c, which leaves the tail and the inactive elements
+ * undisturbed.  Helpers get the mask in bit VDATA_VM of the descriptor;
+ * their oprsz is a single register and is not used.
+ */
+
+static uint32_t vlenb(DisasContext *ctx)
+{
+    return ctx->vlen / 8;
+}
+
+/* offset of vector register reg in CPURISCVState */
+static uint32_t vreg_ofs(DisasContext *ctx, int reg)
+{
+    return offsetof(CPURISCVState, vreg) + reg * vlenb(ctx);
+}
+
+/* offset of element 0 in a register, see the Hn macros of vector_helper.c */
+static uint32_t vreg_elem0_ofs(DisasContext *ctx, int reg)
+{
+#ifdef HOST_WORDS_BIGENDIAN
+    return vreg_ofs(ctx, reg) + 8 - (1 << ctx->sew);
+#else
+    return vreg_ofs(ctx, reg);
+#endif
+}
+
+/* bytes of a register group, fractional LMUL uses part of a register */
+static uint32_t vreg_group_size(DisasContext *ctx)
+{
+    return vlenb(ctx) << MAX(ctx->lmul, 0);
+}
+
+static bool vext_use_gvec(DisasContext *ctx, int vm)
+{
+    return vm && ctx->vl_eq_vlmax && ctx->lmul >= 0;
+}
+
+static uint32_t vext_desc(DisasContext *ctx, uint32_t data)
+{
+    return simd_desc(vlenb(ctx), vlenb(ctx), data);
+}
+
+/* vector instructions leave vstart at 0 */
+static void gen_reset_vstart(DisasContext *ctx)
+{
+    if (!ctx->vl_eq_vlmax) {
+        TCGv zero = tcg_const_tl(0);
+        tcg_gen_st_tl(zero, cpu_env, offsetof(CPURISCVState, vstart));
+        tcg_temp_free(zero);
+    }
+}
+
+static bool require_rvv(DisasContext *ctx)
+{
+    return (ctx->flags & TB_FLAGS_VS_ENABLE) != 0;
+}
+
+static bool require_vtype(DisasContext *ctx)
+{
+    return require_rvv(ctx) && !ctx->vill;
+}
+
+/* a register group is aligned to its size of 2^lmul registers */
+static bool require_align(int reg, int lmul)
+{
+    return lmul <= 0 || extract32(reg, 0, lmul) == 0;
+}
+
+/* masked instructions cannot write v0, unless the result is a mask */
+static bool require_vm(int vm, int vd)
+{
+    return vm || vd != 0;
+}
+
+/* a mask result overlaps a source group only at its lowest register */
+static bool require_mask_dest(int vd, int vs, int lmul)
+{
+    return vd <= vs || vd >= vs + (1 << MAX(lmul, 0));
+}
+
+/* floating-point operations are implemented for SEW 32 and 64 */
+static bool require_rvf(DisasContext *ctx)
+{
+    if (!(ctx->flags & TB_FLAGS_FP_ENABLE)) {
+        return false;
+    }
+    switch (ctx->sew) {
+    case MO_32:
+        return riscv_has_ext(ctx->env, RVF);
+    case MO_64:
+        return riscv_has_ext(ctx->env, RVD);
+    default:
+        return false;
+    }
+}
+
+/* Configuration */
+
+/*
+ * vl and vtype are part of the TB flags, continue in a TB built for the
+ * new values.
+ */
+static bool do_vsetvl(DisasContext *ctx, int rd, TCGv avl, TCGv vtype)
+{
+    TCGv dst = tcg_temp_new();
+
+    gen_helper_vsetvl(dst, cpu_env, avl, vtype);
+    gen_set_gpr(rd, dst);
+    tcg_temp_free(dst);
+    tcg_gen_movi_tl(cpu_pc, ctx->pc_succ_insn);
+    lookup_and_goto_ptr(ctx);
+    ctx->base.is_jmp = DISAS_NORETURN;
+    return true;
+}
+
+/* AVL of vsetvl and vsetvli: rs1, VLMAX, or the current vl */
+static TCGv gen_avl(int rd, int rs1)
+{
+    TCGv avl = tcg_temp_new();
+
+    if (rs1 != 0) {
+        gen_get_gpr(avl, rs1);
+    } else if (rd != 0) {
+        tcg_gen_movi_tl(avl, -1);
+    } else {
+        tcg_gen_ld_tl(avl, cpu_env, offsetof(CPURISCVState, vl));
+    }
+    return avl;
+}
+
+static bool trans_vsetvl(DisasContext *ctx, arg_vsetvl *a, uint32_t insn)
+{
+    TCGv avl, vtype;
+
+    if (!require_rvv(ctx)) {
+        return false;
+    }
+    avl = gen_avl(a->rd, a->rs1);
+    vtype = tcg_temp_new();
+    gen_get_gpr(vtype, a->rs2);
+    do_vsetvl(ctx, a->rd, avl, vtype);
+    tcg_temp_free(avl);
+    tcg_temp_free(vtype);
+    return true;
+}
+
+static bool trans_vsetvli(DisasContext *ctx, arg_vsetvli *a, uint32_t insn)
+{
+    TCGv avl, vtype;
+
+    if (!require_rvv(ctx)) {
+        return false;
+    }
+    avl = gen_avl(a->rd, a->rs1);
+    vtype = tcg_const_tl(a->zimm);
+    do_vsetvl(ctx, a->rd, avl, vtype);
+    tcg_temp_free(avl);
+    tcg_temp_free(vtype);
+    return true;
+}
+
+static bool trans_vsetivli(DisasContext *ctx, arg_vsetivli *a, uint32_t insn)
+{
+    TCGv avl, vtype;
+
+    if (!require_rvv(ctx)) {
+        return false;
+    }
+    avl = tcg_const_tl(a->uimm);
+    vtype = tcg_const_tl(a->zimm);
+    do_vsetvl(ctx, a->rd, avl, vtype);
+    tcg_temp_free(avl);
+    tcg_temp_free(vtype);
+    return true;
+}
+
+/* Loads and Stores */
+
+typedef void gen_helper_ldst_us(TCGv_ptr, TCGv_ptr, TCGv, TCGv_env, TCGv_i32);
+typedef void gen_helper_ldst_stride(TCGv_ptr, TCGv_ptr, TCGv, TCGv, TCGv_env,
+                                    TCGv_i32);
+
+/* the register group of an access with EEW eew is aligned to EMUL */
+static bool ldst_check(DisasContext *ctx, int vd, int vm, int eew,
+                       bool is_load)
+{
+    int emul = eew - ctx->sew + ctx->lmul;
+
+    return require_vtype(ctx) && emul >= -3 && emul <= 3 &&
+           require_align(vd, emul) && (!is_load || require_vm(vm, vd));
+}
+
+static void gen_ldst_us(DisasContext *ctx, int vd, int rs1, uint32_t data,
+                        gen_helper_ldst_us *fn)
+{
+    TCGv_ptr dest = tcg_temp_new_ptr();
+    TCGv_ptr mask = tcg_temp_new_ptr();
+    TCGv base = tcg_temp_new();
+    TCGv_i32 desc = tcg_const_i32(vext_desc(ctx, data));
+
+    gen_get_gpr(base, rs1);
+    tcg_gen_addi_ptr(dest, cpu_env, vreg_ofs(ctx, vd));
+    tcg_gen_addi_ptr(mask, cpu_env, vreg_ofs(ctx, 0));
+    fn(dest, mask, base, cpu_env, desc);
+
+    tcg_temp_free_ptr(dest);
+    tcg_temp_free_ptr(mask);
+    tcg_temp_free(base);
+    tcg_temp_free_i32(desc);
+}
+
+static void gen_ldst_stride(DisasContext *ctx, int vd, int rs1, int rs2,
+                            uint32_t data, gen_helper_ldst_stride *fn)
+{
+    TCGv_ptr dest = tcg_temp_new_ptr();
+    TCGv_ptr mask = tcg_temp_new_ptr();
+    TCGv base = tcg_temp_new();
+    TCGv stride = tcg_temp_new();
+    TCGv_i32 desc = tcg_const_i32(vext_desc(ctx, data));
+
+    gen_get_gpr(base, rs1);
+    gen_get_gpr(stride, rs2);
+    tcg_gen_addi_ptr(dest, cpu_env, vreg_ofs(ctx, vd));
+    tcg_gen_addi_ptr(mask, cpu_env, vreg_ofs(ctx, 0));
+    fn(dest, mask, base, stride, cpu_env, desc);
+
+    tcg_temp_free_ptr(dest);
+    tcg_temp_free_ptr(mask);
+    tcg_temp_free(base);
+    tcg_temp_free(stride);
+    tcg_temp_free_i32(desc);
+}
+
+#define GEN_VEXT_LDST_US_TRANS(NAME, EEW, IS_LOAD)                        \
+static bool trans_##NAME(DisasContext *ctx, arg_rmrr *a, uint32_t insn)   \
+{                                                                         \
+    if (!ldst_check(ctx, a->rd, a->vm, EEW, IS_LOAD)) {                   \
+        return false;                                                     \
+    }                                                                     \
+    gen_ldst_us(ctx, a->rd, a->rs1, a->vm ? VDATA_VM : 0,                 \
+                gen_helper_##NAME);                                       \
+    return true;                                                          \
+}
+
+GEN_VEXT_LDST_US_TRANS(vle8_v, MO_8, true)
+GEN_VEXT_LDST_US_TRANS(vle16_v, MO_16, true)
+GEN_VEXT_LDST_US_TRANS(vle32_v, MO_32, true)
+GEN_VEXT_LDST_US_TRANS(vle64_v, MO_64, true)
+GEN_VEXT_LDST_US_TRANS(vse8_v, MO_8, false)
+GEN_VEXT_LDST_US_TRANS(vse16_v, MO_16, false)
+GEN_VEXT_LDST_US_TRANS(vse32_v, MO_32, false)
+GEN_VEXT_LDST_US_TRANS(vse64_v, MO_64, false)
+
+#define GEN_VEXT_LDST_STRIDE_TRANS(NAME, EEW, IS_LOAD)                    \
+static bool trans_##NAME(DisasContext *ctx, arg_rmrr *a, uint32_t insn)   \
+{                                                                         \
+    if (!ldst_check(ctx, a->rd, a->vm, EEW, IS_LOAD)) {                   \
+        return false;                                                     \
+    }                                                                     \
+    gen_ldst_stride(ctx, a->rd, a->rs1, a->rs2, a->vm ? VDATA_VM : 0,     \
+                    gen_helper_##NAME);                                   \
+    return true;                                                          \
+}
+
+GEN_VEXT_LDST_STRIDE_TRANS(vlse8_v, MO_8, true)
+GEN_VEXT_LDST_STRIDE_TRANS(vlse16_v, MO_16, true)
+GEN_VEXT_LDST_STRIDE_TRANS(vlse32_v, MO_32, true)
+GEN_VEXT_LDST_STRIDE_TRANS(vlse64_v, MO_64, true)
+GEN_VEXT_LDST_STRIDE_TRANS(vsse8_v, MO_8, false)
+GEN_VEXT_LDST_STRIDE_TRANS(vsse16_v, MO_16, false)
+GEN_VEXT_LDST_STRIDE_TRANS(vsse32_v, MO_32, false)
+GEN_VEXT_LDST_STRIDE_TRANS(vsse64_v, MO_64, false)
+
+/* mask loads and stores transfer ceil(vl / 8) bytes */
+static bool trans_vlm_v(DisasContext *ctx, arg_vlm_v *a, uint32_t insn)
+{
+    if (!require_vtype(ctx)) {
+        return false;
+    }
+    gen_ldst_us(ctx, a->rd, a->rs1, VDATA_VM, gen_helper_vlm_v);
+    return true;
+}
+
+static bool trans_vsm_v(DisasContext *ctx, arg_vsm_v *a, uint32_t insn)
+{
+    if (!require_vtype(ctx)) {
+        return false;
+    }
+    gen_ldst_us(ctx, a->rd, a->rs1, VDATA_VM, gen_helper_vsm_v);
+    return true;
+}
+
+/* whole register accesses do not depend on vtype */
+static bool ldst_whole_trans(DisasContext *ctx, int vd, int rs1, int nreg,
+                             gen_helper_ldst_us *fn)
+{
+    if (!require_rvv(ctx) || !require_align(vd, ctz32(nreg))) {
+        return false;
+    }
+    gen_ldst_us(ctx, vd, rs1, VDATA_VM | (nreg << VDATA_NREG_SHIFT), fn);
+    return true;
+}
+
+#define GEN_VEXT_LDST_WHOLE_TRANS(NAME, NREG, HELPER)                     \
+static bool trans_##NAME(DisasContext *ctx, arg_##NAME *a, uint32_t insn)  \
+{                                                                         \
+    return ldst_whole_trans(ctx, a->rd, a->rs1, NREG,                     \
+                            gen_helper_##HELPER);                         \
+}
+
+GEN_VEXT_LDST_WHOLE_TRANS(vl1re8_v, 1, vlre8_v)
+GEN_VEXT_LDST_WHOLE_TRANS(vl1re16_v, 1, vlre16_v)
+GEN_VEXT_LDST_WHOLE_TRANS(vl1re32_v, 1, vlre32_v)
+GEN_VEXT_LDST_WHOLE_TRANS(vl1re64_v, 1, vlre64_v)
+GEN_VEXT_LDST_WHOLE_TRANS(vl2re8_v, 2, vlre8_v)
+GEN_VEXT_LDST_WHOLE_TRANS(vl2re16_v, 2, vlre16_v)
+GEN_VEXT_LDST_WHOLE_TRANS(vl2re32_v, 2, vlre32_v)
+GEN_VEXT_LDST_WHOLE_TRANS(vl2re64_v, 2, vlre64_v)
+GEN_VEXT_LDST_WHOLE_TRANS(vl4re8_v, 4, vlre8_v)
+GEN_VEXT_LDST_WHOLE_TRANS(vl4re16_v, 4, vlre16_v)
+GEN_VEXT_LDST_WHOLE_TRANS(vl4re32_v, 4, vlre32_v)
+GEN_VEXT_LDST_WHOLE_TRANS(vl4re64_v, 4, vlre64_v)
+GEN_VEXT_LDST_WHOLE_TRANS(vl8re8_v, 8, vlre8_v)
+GEN_VEXT_LDST_WHOLE_TRANS(vl8re16_v, 8, vlre16_v)
+GEN_VEXT_LDST_WHOLE_TRANS(vl8re32_v, 8, vlre32_v)
+GEN_VEXT_LDST_WHOLE_TRANS(vl8re64_v, 8, vlre64_v)
+GEN_VEXT_LDST_WHOLE_TRANS(vs1r_v, 1, vsr_v)
+GEN_VEXT_LDST_WHOLE_TRANS(vs2r_v, 2, vsr_v)
+GEN_VEXT_LDST_WHOLE_TRANS(vs4r_v, 4, vsr_v)
+GEN_VEXT_LDST_WHOLE_TRANS(vs8r_v, 8, vsr_v)
+
+/* Integer Arithmetic */
+
+typedef void GVecGen3Fn(unsigned, uint32_t, uint32_t, uint32_t,
+                        uint32_t, uint32_t);
+typedef void GVecGen2sFn(unsigned, uint32_t, uint32_t, TCGv_i64,
+                         uint32_t, uint32_t);
+typedef void GVecGen2iFn(unsigned, uint32_t, uint32_t, int64_t,
+                         uint32_t, uint32_t);
+typedef void gen_helper_opivx(TCGv_ptr, TCGv_ptr, TCGv, TCGv_ptr,
+                              TCGv_env, TCGv_i32);
+typedef void gen_helper_opfvf(TCGv_ptr, TCGv_ptr, TCGv_i64, TCGv_ptr,
+                              TCGv_env, TCGv_i32);
+
+static bool opivv_check(DisasContext *ctx, arg_rmrr *a)
+{
+    return require_vtype(ctx) && require_vm(a->vm, a->rd) &&
+           require_align(a->rd, ctx->lmul) &&
+           require_align(a->rs1, ctx->lmul) &&
+           require_align(a->rs2, ctx->lmul);
+}
+
+static bool opivx_check(DisasContext *ctx, arg_rmrr *a)
+{
+    return require_vtype(ctx) && require_vm(a->vm, a->rd) &&
+           require_align(a->rd, ctx->lmul) &&
+           require_align(a->rs2, ctx->lmul);
+}
+
+/* compares write a mask register */
+static bool opivv_cmp_check(DisasContext *ctx, arg_rmrr *a)
+{
+    return require_vtype(ctx) &&
+           require_align(a->rs1, ctx->lmul) &&
+           require_align(a->rs2, ctx->lmul) &&
+           require_mask_dest(a->rd, a->rs1, ctx->lmul) &&
+           require_mask_dest(a->rd, a->rs2, ctx->lmul);
+}
+
+static bool opivx_cmp_check(DisasContext *ctx, arg_rmrr *a)
+{
+    return require_vtype(ctx) &&
+           require_align(a->rs2, ctx->lmul) &&
+           require_mask_dest(a->rd, a->rs2, ctx->lmul);
+}
+
+/* vd, vs1 and the result are element 0 of single registers */
+static bool reduction_check(DisasContext *ctx, arg_rmrr *a)
+{
+    return require_vtype(ctx) && require_align(a->rs2, ctx->lmul);
+}
+
+static void gen_opivv(DisasContext *ctx, arg_rmrr *a, GVecGen3Fn *gvec_fn,
+                      gen_helper_gvec_4_ptr *fn)
+{
+    if (gvec_fn && vext_use_gvec(ctx, a->vm)) {
+        gvec_fn(ctx->sew, vreg_ofs(ctx, a->rd), vreg_ofs(ctx, a->rs2),
+                vreg_ofs(ctx, a->rs1), vreg_group_size(ctx),
+                vreg_group_size(ctx));
+    } else {
+        tcg_gen_gvec_4_ptr(vreg_ofs(ctx, a->rd), vreg_ofs(ctx, 0),
+                           vreg_ofs(ctx, a->rs1), vreg_ofs(ctx, a->rs2),
+                           cpu_env, vlenb(ctx), vlenb(ctx),
+                           a->vm ? VDATA_VM : 0, fn);
+    }
+}
+
+static void gen_opivx_ool(DisasContext *ctx, int vd, int vm, TCGv s1,
+                          int vs2, gen_helper_opivx *fn)
+{
+    TCGv_ptr dest = tcg_temp_new_ptr();
+    TCGv_ptr mask = tcg_temp_new_ptr();
+    TCGv_ptr src2 = tcg_temp_new_ptr();
+    TCGv_i32 desc = tcg_const_i32(vext_desc(ctx, vm ? VDATA_VM : 0));
+
+    tcg_gen_addi_ptr(dest, cpu_env, vreg_ofs(ctx, vd));
+    tcg_gen_addi_ptr(mask, cpu_env, vreg_ofs(ctx, 0));
+    tcg_gen_addi_ptr(src2, cpu_env, vreg_ofs(ctx, vs2));
+    fn(dest, mask, s1, src2, cpu_env, desc);
+
+    tcg_temp_free_ptr(dest);
+    tcg_temp_free_ptr(mask);
+    tcg_temp_free_ptr(src2);
+    tcg_temp_free_i32(desc);
+}
+
+/* x[rs1] is sign-extended to SEW on RV32 */
+static void gen_opivx(DisasContext *ctx, arg_rmrr *a, GVecGen2sFn *gvec_fn,
+                      gen_helper_opivx *fn)
+{
+    TCGv s1 = get_gpr(ctx, a->rs1);
+
+    if (gvec_fn && vext_use_gvec(ctx, a->vm)) {
+        TCGv_i64 t = tcg_temp_new_i64();
+
+        tcg_gen_ext_tl_i64(t, s1);
+        gvec_fn(ctx->sew, vreg_ofs(ctx, a->rd), vreg_ofs(ctx, a->rs2), t,
+                vreg_group_size(ctx), vreg_group_size(ctx));
+        tcg_temp_free_i64(t);
+    } else {
+        gen_opivx_ool(ctx, a->rd, a->vm, s1, a->rs2, fn);
+    }
+}
+
+/* the immediate is simm5, or uimm5 for shifts */
+static void gen_opivi(DisasContext *ctx, arg_rmrr *a, bool zext,
+                      GVecGen2iFn *gvec_fn, gen_helper_opivx *fn)
+{
+    int64_t imm = zext ? extract32(a->rs1, 0, 5) : sextract32(a->rs1, 0, 5);
+
+    if (gvec_fn && vext_use_gvec(ctx, a->vm)) {
+        if (zext) {
+            imm &= (8 << ctx->sew) - 1;
+        }
+        gvec_fn(ctx->sew, vreg_ofs(ctx, a->rd), vreg_ofs(ctx, a->rs2), imm,
+                vreg_group_size(ctx), vreg_group_size(ctx));
+    } else {
+        TCGv s1 = tcg_const_tl(imm);
+
+        gen_opivx_ool(ctx, a->rd, a->vm, s1, a->rs2, fn);
+        tcg_temp_free(s1);
+    }
+}
+
+#define GEN_VEXT_FNS(NAME)                                                \
+    {                                                                     \
+        gen_helper_##NAME##_b, gen_helper_##NAME##_h,                     \
+        gen_helper_##NAME##_w, gen_helper_##NAME##_d,                     \
+    }
+
+#define GEN_OPIVV_TRANS(NAME, CHECK, GVEC)                                \
+static bool trans_##NAME(DisasContext *ctx, arg_rmrr *a, uint32_t insn)   \
+{                                                                         \
+    static gen_helper_gvec_4_ptr * const fns[4] = GEN_VEXT_FNS(NAME);     \
+                                                                          \
+    if (!CHECK(ctx, a)) {                                                 \
+        return false;                                                     \
+    }                                                                     \
+    gen_opivv(ctx, a, GVEC, fns[ctx->sew]);                               \
+    gen_reset_vstart(ctx);                                                \
+    return true;                                                          \
+}
+
+#define GEN_OPIVX_TRANS(NAME, CHECK, GVEC)                                \
+static bool trans_##NAME(DisasContext *ctx, arg_rmrr *a, uint32_t insn)   \
+{                                                                         \
+    static gen_helper_opivx * const fns[4] = GEN_VEXT_FNS(NAME);          \
+                                                                          \
+    if (!CHECK(ctx, a)) {                                                 \
+        return false;                                                     \
+    }                                                                     \
+    gen_opivx(ctx, a, GVEC, fns[ctx->sew]);                               \
+    gen_reset_vstart(ctx);                                                \
+    return true;                                                          \
+}
+
+/* .vi forms use the helpers of the .vx forms */
+#define GEN_OPIVI_TRANS(NAME, CHECK, ZEXT, OPIVX, GVEC)                   \
+static bool trans_##NAME(DisasContext *ctx, arg_rmrr *a, uint32_t insn)   \
+{                                                                         \
+    static gen_helper_opivx * const fns[4] = GEN_VEXT_FNS(OPIVX);         \
+                                                                          \
+    if (!CHECK(ctx, a)) {                                                 \
+        return false;                                                     \
+    }                                                                     \
+    gen_opivi(ctx, a, ZEXT, GVEC, fns[ctx->sew]);                         \
+    gen_reset_vstart(ctx);                                                \
+    return true;                                                          \
+}
+
+GEN_OPIVV_TRANS(vadd_vv, opivv_check, tcg_gen_gvec_add)
+GEN_OPIVX_TRANS(vadd_vx, opivx_check, tcg_gen_gvec_adds)
+GEN_OPIVI_TRANS(vadd_vi, opivx_check, false, vadd_vx, tcg_gen_gvec_addi)
+GEN_OPIVV_TRANS(vsub_vv, opivv_check, tcg_gen_gvec_sub)
+GEN_OPIVX_TRANS(vsub_vx, opivx_check, tcg_gen_gvec_subs)
+GEN_OPIVX_TRANS(vrsub_vx, opivx_check, NULL)
+GEN_OPIVI_TRANS(vrsub_vi, opivx_check, false, vrsub_vx, NULL)
+GEN_OPIVV_TRANS(vminu_vv, opivv_check, NULL)
+GEN_OPIVX_TRANS(vminu_vx, opivx_check, NULL)
+GEN_OPIVV_TRANS(vmin_vv, opivv_check, NULL)
+GEN_OPIVX_TRANS(vmin_vx, opivx_check, NULL)
+GEN_OPIVV_TRANS(vmaxu_vv, opivv_check, NULL)
+GEN_OPIVX_TRANS(vmaxu_vx, opivx_check, NULL)
+GEN_OPIVV_TRANS(vmax_vv, opivv_check, NULL)
+GEN_OPIVX_TRANS(vmax_vx, opivx_check, NULL)
+GEN_OPIVV_TRANS(vand_vv, opivv_check, tcg_gen_gvec_and)
+GEN_OPIVX_TRANS(vand_vx, opivx_check, tcg_gen_gvec_ands)
+GEN_OPIVI_TRANS(vand_vi, opivx_check, false, vand_vx, tcg_gen_gvec_andi)
+GEN_OPIVV_TRANS(vor_vv, opivv_check, tcg_gen_gvec_or)
+GEN_OPIVX_TRANS(vor_vx, opivx_check, tcg_gen_gvec_ors)
+GEN_OPIVI_TRANS(vor_vi, opivx_check, false, vor_vx, tcg_gen_gvec_ori)
+GEN_OPIVV_TRANS(vxor_vv, opivv_check, tcg_gen_gvec_xor)
+GEN_OPIVX_TRANS(vxor_vx, opivx_check, tcg_gen_gvec_xors)
+GEN_OPIVI_TRANS(vxor_vi, opivx_check, false, vxor_vx, tcg_gen_gvec_xori)
+
+GEN_OPIVV_TRANS(vsll_vv, opivv_check, NULL)
+GEN_OPIVX_TRANS(vsll_vx, opivx_check, NULL)
+GEN_OPIVI_TRANS(vsll_vi, opivx_check, true, vsll_vx, tcg_gen_gvec_shli)
+GEN_OPIVV_TRANS(vsrl_vv, opivv_check, NULL)
+GEN_OPIVX_TRANS(vsrl_vx, opivx_check, NULL)
+GEN_OPIVI_TRANS(vsrl_vi, opivx_check, true, vsrl_vx, tcg_gen_gvec_shri)
+GEN_OPIVV_TRANS(vsra_vv, opivv_check, NULL)
+GEN_OPIVX_TRANS(vsra_vx, opivx_check, NULL)
+GEN_OPIVI_TRANS(vsra_vi, opivx_check, true, vsra_vx, tcg_gen_gvec_sari)
+
+GEN_OPIVV_TRANS(vmseq_vv, opivv_cmp_check, NULL)
+GEN_OPIVX_TRANS(vmseq_vx, opivx_cmp_check, NULL)
+GEN_OPIVI_TRANS(vmseq_vi, opivx_cmp_check, false, vmseq_vx, NULL)
+GEN_OPIVV_TRANS(vmsne_vv, opivv_cmp_check, NULL)
+GEN_OPIVX_TRANS(vmsne_vx, opivx_cmp_check, NULL)
+GEN_OPIVI_TRANS(vmsne_vi, opivx_cmp_check, false, vmsne_vx, NULL)
+GEN_OPIVV_TRANS(vmsltu_vv, opivv_cmp_check, NULL)
+GEN_OPIVX_TRANS(vmsltu_vx, opivx_cmp_check, NULL)
+GEN_OPIVV_TRANS(vmslt_vv, opivv_cmp_check, NULL)
+GEN_OPIVX_TRANS(vmslt_vx, opivx_cmp_check, NULL)
+GEN_OPIVV_TRANS(vmsleu_vv, opivv_cmp_check, NULL)
+GEN_OPIVX_TRANS(vmsleu_vx, opivx_cmp_check, NULL)
+GEN_OPIVI_TRANS(vmsleu_vi, opivx_cmp_check, false, vmsleu_vx, NULL)
+GEN_OPIVV_TRANS(vmsle_vv, opivv_cmp_check, NULL)
+GEN_OPIVX_TRANS(vmsle_vx, opivx_cmp_check, NULL)
+GEN_OPIVI_TRANS(vmsle_vi, opivx_cmp_check, false, vmsle_vx, NULL)
+GEN_OPIVX_TRANS(vmsgtu_vx, opivx_cmp_check, NULL)
+GEN_OPIVI_TRANS(vmsgtu_vi, opivx_cmp_check, false, vmsgtu_vx, NULL)
+GEN_OPIVX_TRANS(vmsgt_vx, opivx_cmp_check, NULL)
+GEN_OPIVI_TRANS(vmsgt_vi, opivx_cmp_check, false, vmsgt_vx, NULL)
+
+GEN_OPIVV_TRANS(vmul_vv, opivv_check, tcg_gen_gvec_mul)
+GEN_OPIVX_TRANS(vmul_vx, opivx_check, tcg_gen_gvec_muls)
+GEN_OPIVV_TRANS(vmulh_vv, opivv_check, NULL)
+GEN_OPIVX_TRANS(vmulh_vx, opivx_check, NULL)
+GEN_OPIVV_TRANS(vmulhu_vv, opivv_check, NULL)
+GEN_OPIVX_TRANS(vmulhu_vx, opivx_check, NULL)
+GEN_OPIVV_TRANS(vmulhsu_vv, opivv_check, NULL)
+GEN_OPIVX_TRANS(vmulhsu_vx, opivx_check, NULL)
+GEN_OPIVV_TRANS(vdivu_vv, opivv_check, NULL)
+GEN_OPIVX_TRANS(vdivu_vx, opivx_check, NULL)
+GEN_OPIVV_TRANS(vdiv_vv, opivv_check, NULL)
+GEN_OPIVX_TRANS(vdiv_vx, opivx_check, NULL)
+GEN_OPIVV_TRANS(vremu_vv, opivv_check, NULL)
+GEN_OPIVX_TRANS(vremu_vx, opivx_check, NULL)
+GEN_OPIVV_TRANS(vrem_vv, opivv_check, NULL)
+GEN_OPIVX_TRANS(vrem_vx, opivx_check, NULL)
+GEN_OPIVV_TRANS(vmacc_vv, opivv_check, NULL)
+GEN_OPIVX_TRANS(vmacc_vx, opivx_check, NULL)
+GEN_OPIVV_TRANS(vnmsac_vv, opivv_check, NULL)
+GEN_OPIVX_TRANS(vnmsac_vx, opivx_check, NULL)
+GEN_OPIVV_TRANS(vmadd_vv, opivv_check, NULL)
+GEN_OPIVX_TRANS(vmadd_vx, opivx_check, NULL)
+GEN_OPIVV_TRANS(vnmsub_vv, opivv_check, NULL)
+GEN_OPIVX_TRANS(vnmsub_vx, opivx_check, NULL)
+
+/* vmerge is masked, vd[i] = v0.mask[i] ? vs1[i] : vs2[i] */
+GEN_OPIVV_TRANS(vmerge_vvm, opivv_check, NULL)
+GEN_OPIVX_TRANS(vmerge_vxm, opivx_check, NULL)
+GEN_OPIVI_TRANS(vmerge_vim, opivx_check, false, vmerge_vxm, NULL)
+
+/* vmv.v.* are the unmasked forms of vmerge */
+static bool trans_vmv_v_v(DisasContext *ctx, arg_vmv_v_v *a, uint32_t insn)
+{
+    static gen_helper_gvec_4_ptr * const fns[4] = GEN_VEXT_FNS(vmerge_vvm);
+
+    if (!require_vtype(ctx) || !require_align(a->rd, ctx->lmul) ||
+        !require_align(a->rs1, ctx->lmul)) {
+        return false;
+    }
+    if (vext_use_gvec(ctx, 1)) {
+        tcg_gen_gvec_mov(ctx->sew, vreg_ofs(ctx, a->rd),
+                         vreg_ofs(ctx, a->rs1),
+                         vreg_group_size(ctx), vreg_group_size(ctx));
+    } else {
+        tcg_gen_gvec_4_ptr(vreg_ofs(ctx, a->rd), vreg_ofs(ctx, 0),
+                           vreg_ofs(ctx, a->rs1), vreg_ofs(ctx, a->rs1),
+                           cpu_env, vlenb(ctx), vlenb(ctx), VDATA_VM,
+                           fns[ctx->sew]);
+        gen_reset_vstart(ctx);
+    }
+    return true;
+}
+
+static void gen_vmv_v_x(DisasContext *ctx, int vd, TCGv s1)
+{
+    static gen_helper_opivx * const fns[4] = GEN_VEXT_FNS(vmerge_vxm);
+
+    if (vext_use_gvec(ctx, 1)) {
+        TCGv_i64 t = tcg_temp_new_i64();
+
+        tcg_gen_ext_tl_i64(t, s1);
+        tcg_gen_gvec_dup_i64(ctx->sew, vreg_ofs(ctx, vd),
+                             vreg_group_size(ctx), vreg_group_size(ctx), t);
+        tcg_temp_free_i64(t);
+    } else {
+        gen_opivx_ool(ctx, vd, 1, s1, vd, fns[ctx->sew]);
+        gen_reset_vstart(ctx);
+    }
+}
+
+static bool trans_vmv_v_x(DisasContext *ctx, arg_vmv_v_x *a, uint32_t insn)
+{
+    if (!require_vtype(ctx) || !require_align(a->rd, ctx->lmul)) {
+        return false;
+    }
+    gen_vmv_v_x(ctx, a->rd, get_gpr(ctx, a->rs1));
+    return true;
+}
+
+static bool trans_vmv_v_i(DisasContext *ctx, arg_vmv_v_i *a, uint32_t insn)
+{
+    TCGv s1;
+
+    if (!require_vtype(ctx) || !require_align(a->rd, ctx->lmul)) {
+        return false;
+    }
+    s1 = tcg_const_tl(sextract32(a->rs1, 0, 5));
+    gen_vmv_v_x(ctx, a->rd, s1);
+    tcg_temp_free(s1);
+    return true;
+}
+
+/* vmv<nr>r.v copies whole registers, regardless of vtype */
+static bool vmv_whole_trans(DisasContext *ctx, int vd, int vs2, int nreg)
+{
+    if (!require_rvv(ctx) || !require_align(vd, ctz32(nreg)) ||
+        !require_align(vs2, ctz32(nreg))) {
+        return false;
+    }
+    if (vd != vs2) {
+        tcg_gen_gvec_mov(MO_8, vreg_ofs(ctx, vd), vreg_ofs(ctx, vs2),
+                         nreg * vlenb(ctx), nreg * vlenb(ctx));
+    }
+    gen_reset_vstart(ctx);
+    return true;
+}
+
+#define GEN_VMV_WHOLE_TRANS(NAME, NREG)                                   \
+static bool trans_##NAME(DisasContext *ctx, arg_##NAME *a, uint32_t insn) \
+{                                                                         \
+    return vmv_whole_trans(ctx, a->rd, a->rs2, NREG);                     \
+}
+
+GEN_VMV_WHOLE_TRANS(vmv1r_v, 1)
+GEN_VMV_WHOLE_TRANS(vmv2r_v, 2)
+GEN_VMV_WHOLE_TRANS(vmv4r_v, 4)
+GEN_VMV_WHOLE_TRANS(vmv8r_v, 8)
+
+/* Integer Reductions */
+
+GEN_OPIVV_TRANS(vredsum_vs, reduction_check, NULL)
+GEN_OPIVV_TRANS(vredand_vs, reduction_check, NULL)
+GEN_OPIVV_TRANS(vredor_vs, reduction_check, NULL)
+GEN_OPIVV_TRANS(vredxor_vs, reduction_check, NULL)
+GEN_OPIVV_TRANS(vredminu_vs, reduction_check, NULL)
+GEN_OPIVV_TRANS(vredmin_vs, reduction_check, NULL)
+GEN_OPIVV_TRANS(vredmaxu_vs, reduction_check, NULL)
+GEN_OPIVV_TRANS(vredmax_vs, reduction_check, NULL)
+
+/* Element 0 Moves */
+
+static void gen_ld_elem0(DisasContext *ctx, TCGv_i64 dest, int reg,
+                         bool sign)
+{
+    uint32_t ofs = vreg_elem0_ofs(ctx, reg);
+
+    switch (ctx->sew) {
+    case MO_8:
+        if (sign) {
+            tcg_gen_ld8s_i64(dest, cpu_env, ofs);
+        } else {
+            tcg_gen_ld8u_i64(dest, cpu_env, ofs);
+        }
+        break;
+    case MO_16:
+        if (sign) {
+            tcg_gen_ld16s_i64(dest, cpu_env, ofs);
+        } else {
+            tcg_gen_ld16u_i64(dest, cpu_env, ofs);
+        }
+        break;
+    case MO_32:
+        if (sign) {
+            tcg_gen_ld32s_i64(dest, cpu_env, ofs);
+        } else {
+            tcg_gen_ld32u_i64(dest, cpu_env, ofs);
+        }
+        break;
+    default:
+        tcg_gen_ld_i64(dest, cpu_env, ofs);
+        break;
+    }
+}
+
+/* element 0 is written if vstart < vl */
+static void gen_st_elem0(DisasContext *ctx, TCGv_i64 val, int reg)
+{
+    uint32_t ofs = vreg_elem0_ofs(ctx, reg);
+    TCGLabel *over = gen_new_label();
+    TCGv vl = tcg_temp_new();
+    TCGv vstart = tcg_temp_new();
+
+    tcg_gen_ld_tl(vl, cpu_env, offsetof(CPURISCVState, vl));
+    tcg_gen_ld_tl(vstart, cpu_env, offsetof(CPURISCVState, vstart));
+    tcg_gen_brcond_tl(TCG_COND_GEU, vstart, vl, over);
+    switch (ctx->sew) {
+    case MO_8:
+        tcg_gen_st8_i64(val, cpu_env, ofs);
+        break;
+    case MO_16:
+        tcg_gen_st16_i64(val, cpu_env, ofs);
+        break;
+    case MO_32:
+        tcg_gen_st32_i64(val, cpu_env, ofs);
+        break;
+    default:
+        tcg_gen_st_i64(val, cpu_env, ofs);
+        break;
+    }
+    gen_set_label(over);
+    tcg_temp_free(vl);
+    tcg_temp_free(vstart);
+}
+
+static bool trans_vmv_x_s(DisasContext *ctx, arg_vmv_x_s *a, uint32_t insn)
+{
+    TCGv_i64 t;
+    TCGv dest;
+
+    if (!require_vtype(ctx)) {
+        return false;
+    }
+    t = tcg_temp_new_i64();
+    dest = tcg_temp_new();
+    gen_ld_elem0(ctx, t, a->rs2, true);
+    tcg_gen_trunc_i64_tl(dest, t);
+    gen_set_gpr(a->rd, dest);
+    tcg_temp_free_i64(t);
+    tcg_temp_free(dest);
+    gen_reset_vstart(ctx);
+    return true;
+}
+
+static bool trans_vmv_s_x(DisasContext *ctx, arg_vmv_s_x *a, uint32_t insn)
+{
+    TCGv_i64 t;
+
+    if (!require_vtype(ctx)) {
+        return false;
+    }
+    t = tcg_temp_new_i64();
+    tcg_gen_ext_tl_i64(t, get_gpr(ctx, a->rs1));
+    gen_st_elem0(ctx, t, a->rd);
+    tcg_temp_free_i64(t);
+    gen_reset_vstart(ctx);
+    return true;
+}
+
+/* Mask Instructions */
+
+#define GEN_MM_TRANS(NAME)                                                \
+static bool trans_##NAME(DisasContext *ctx, arg_r *a, uint32_t insn)      \
+{                                                                         \
+    if (!require_vtype(ctx)) {                                            \
+        return false;                                                     \
+    }                                                                     \
+    tcg_gen_gvec_4_ptr(vreg_ofs(ctx, a->rd), vreg_ofs(ctx, 0),            \
+                       vreg_ofs(ctx, a->rs1), vreg_ofs(ctx, a->rs2),      \
+                       cpu_env, vlenb(ctx), vlenb(ctx), VDATA_VM,         \
+                       gen_helper_##NAME);                                \
+    gen_reset_vstart(ctx);                                                \
+    return true;                                                          \
+}
+
+GEN_MM_TRANS(vmand_mm)
+GEN_MM_TRANS(vmnand_mm)
+GEN_MM_TRANS(vmandn_mm)
+GEN_MM_TRANS(vmxor_mm)
+GEN_MM_TRANS(vmor_mm)
+GEN_MM_TRANS(vmnor_mm)
+GEN_MM_TRANS(vmorn_mm)
+GEN_MM_TRANS(vmxnor_mm)
+
+typedef void gen_helper_vmask_scalar(TCGv, TCGv_ptr, TCGv_ptr, TCGv_env,
+                                     TCGv_i32);
+
+static bool vmask_scalar_trans(DisasContext *ctx, arg_rmr *a,
+                               gen_helper_vmask_scalar *fn)
+{
+    TCGv_ptr mask, src2;
+    TCGv_i32 desc;
+    TCGv dest;
+
+    if (!require_vtype(ctx)) {
+        return false;
+    }
+    mask = tcg_temp_new_ptr();
+    src2 = tcg_temp_new_ptr();
+    desc = tcg_const_i32(vext_desc(ctx, a->vm ? VDATA_VM : 0));
+    dest = tcg_temp_new();
+    tcg_gen_addi_ptr(mask, cpu_env, vreg_ofs(ctx, 0));
+    tcg_gen_addi_ptr(src2, cpu_env, vreg_ofs(ctx, a->rs2));
+    fn(dest, mask, src2, cpu_env, desc);
+    gen_set_gpr(a->rd, dest);
+
+    tcg_temp_free_ptr(mask);
+    tcg_temp_free_ptr(src2);
+    tcg_temp_free_i32(desc);
+    tcg_temp_free(dest);
+    return true;
+}
+
+static bool trans_vcpop_m(DisasContext *ctx, arg_rmr *a, uint32_t insn)
+{
+    return vmask_scalar_trans(ctx, a, gen_helper_vcpop_m);
+}
+
+static bool trans_vfirst_m(DisasContext *ctx, arg_rmr *a, uint32_t insn)
+{
+    return vmask_scalar_trans(ctx, a, gen_helper_vfirst_m);
+}
+
+static bool trans_vid_v(DisasContext *ctx, arg_vid_v *a, uint32_t insn)
+{
+    static gen_helper_gvec_2_ptr * const fns[4] = GEN_VEXT_FNS(vid_v);
+
+    if (!require_vtype(ctx) || !require_vm(a->vm, a->rd) ||
+        !require_align(a->rd, ctx->lmul)) {
+        return false;
+    }
+    tcg_gen_gvec_2_ptr(vreg_ofs(ctx, a->rd), vreg_ofs(ctx, 0), cpu_env,
+                       vlenb(ctx), vlenb(ctx), a->vm ? VDATA_VM : 0,
+                       fns[ctx->sew]);
+    gen_reset_vstart(ctx);
+    return true;
+}
+
+/* Floating-Point */
+
+static bool opfvv_check(DisasContext *ctx, arg_rmrr *a)
+{
+    return opivv_check(ctx, a) && require_rvf(ctx);
+}
+
+static bool opfvf_check(DisasContext *ctx, arg_rmrr *a)
+{
+    return opivx_check(ctx, a) && require_rvf(ctx);
+}
+
+static bool opfvv_cmp_check(DisasContext *ctx, arg_rmrr *a)
+{
+    return opivv_cmp_check(ctx, a) && require_rvf(ctx);
+}
+
+static bool opfvf_cmp_check(DisasContext *ctx, arg_rmrr *a)
+{
+    return opivx_cmp_check(ctx, a) && require_rvf(ctx);
+}
+
+static bool freduction_check(DisasContext *ctx, arg_rmrr *a)
+{
+    return reduction_check(ctx, a) && require_rvf(ctx);
+}
+
+static void gen_opfvf(DisasContext *ctx, int vd, int vm, TCGv_i64 s1,
+                      int vs2, gen_helper_opfvf *fn)
+{
+    TCGv_ptr dest = tcg_temp_new_ptr();
+    TCGv_ptr mask = tcg_temp_new_ptr();
+    TCGv_ptr src2 = tcg_temp_new_ptr();
+    TCGv_i32 desc = tcg_const_i32(vext_desc(ctx, vm ? VDATA_VM : 0));
+
+    tcg_gen_addi_ptr(dest, cpu_env, vreg_ofs(ctx, vd));
+    tcg_gen_addi_ptr(mask, cpu_env, vreg_ofs(ctx, 0));
+    tcg_gen_addi_ptr(src2, cpu_env, vreg_ofs(ctx, vs2));
+    fn(dest, mask, s1, src2, cpu_env, desc);
+
+    tcg_temp_free_ptr(dest);
+    tcg_temp_free_ptr(mask);
+    tcg_temp_free_ptr(src2);
+    tcg_temp_free_i32(desc);
+}
+
+#define GEN_VEXT_FP_FNS(NAME)                                             \
+    { gen_helper_##NAME##_w, gen_helper_##NAME##_d }
+
+/* the dynamic rounding mode applies, require_rvf leaves SEW 32 or 64 */
+#define GEN_OPFVV_TRANS(NAME, CHECK)                                      \
+static bool trans_##NAME(DisasContext *ctx, arg_rmrr *a, uint32_t insn)   \
+{                                                                         \
+    static gen_helper_gvec_4_ptr * const fns[2] = GEN_VEXT_FP_FNS(NAME);  \
+                                                                          \
+    if (!CHECK(ctx, a)) {                                                 \
+        return false;                                                     \
+    }                                                                     \
+    gen_set_rm(ctx, 7);                                                   \
+    mark_fs_dirty(ctx);                                                   \
+    tcg_gen_gvec_4_ptr(vreg_ofs(ctx, a->rd), vreg_ofs(ctx, 0),            \
+                       vreg_ofs(ctx, a->rs1), vreg_ofs(ctx, a->rs2),      \
+                       cpu_env, vlenb(ctx), vlenb(ctx),                   \
+                       a->vm ? VDATA_VM : 0, fns[ctx->sew - MO_32]);      \
+    gen_reset_vstart(ctx);                                                \
+    return true;                                                          \
+}
+
+#define GEN_OPFVF_TRANS(NAME, CHECK)                                      \
+static bool trans_##NAME(DisasContext *ctx, arg_rmrr *a, uint32_t insn)   \
+{                                                                         \
+    static gen_helper_opfvf * const fns[2] = GEN_VEXT_FP_FNS(NAME);       \
+                                                                          \
+    if (!CHECK(ctx, a)) {                                                 \
+        return false;                                                     \
+    }                                                                     \
+    gen_set_rm(ctx, 7);                                                   \
+    mark_fs_dirty(ctx);                                                   \
+    gen_opfvf(ctx, a->rd, a->vm, cpu_fpr[a->rs1], a->rs2,                 \
+              fns[ctx->sew - MO_32]);                                     \
+    gen_reset_vstart(ctx);                                                \
+    return true;                                                          \
+}
+
+GEN_OPFVV_TRANS(vfadd_vv, opfvv_check)
+GEN_OPFVF_TRANS(vfadd_vf, opfvf_check)
+GEN_OPFVV_TRANS(vfsub_vv, opfvv_check)
+GEN_OPFVF_TRANS(vfsub_vf, opfvf_check)
+GEN_OPFVF_TRANS(vfrsub_vf, opfvf_check)
+GEN_OPFVV_TRANS(vfmul_vv, opfvv_check)
+GEN_OPFVF_TRANS(vfmul_vf, opfvf_check)
+GEN_OPFVV_TRANS(vfdiv_vv, opfvv_check)
+GEN_OPFVF_TRANS(vfdiv_vf, opfvf_check)
+GEN_OPFVF_TRANS(vfrdiv_vf, opfvf_check)
+GEN_OPFVV_TRANS(vfmin_vv, opfvv_check)
+GEN_OPFVF_TRANS(vfmin_vf, opfvf_check)
+GEN_OPFVV_TRANS(vfmax_vv, opfvv_check)
+GEN_OPFVF_TRANS(vfmax_vf, opfvf_check)
+GEN_OPFVV_TRANS(vfsgnj_vv, opfvv_check)
+GEN_OPFVF_TRANS(vfsgnj_vf, opfvf_check)
+GEN_OPFVV_TRANS(vfsgnjn_vv, opfvv_check)
+GEN_OPFVF_TRANS(vfsgnjn_vf, opfvf_check)
+GEN_OPFVV_TRANS(vfsgnjx_vv, opfvv_check)
+GEN_OPFVF_TRANS(vfsgnjx_vf, opfvf_check)
+
+GEN_OPFVV_TRANS(vfmacc_vv, opfvv_check)
+GEN_OPFVF_TRANS(vfmacc_vf, opfvf_check)
+GEN_OPFVV_TRANS(vfnmacc_vv, opfvv_check)
+GEN_OPFVF_TRANS(vfnmacc_vf, opfvf_check)
+GEN_OPFVV_TRANS(vfmsac_vv, opfvv_check)
+GEN_OPFVF_TRANS(vfmsac_vf, opfvf_check)
+GEN_OPFVV_TRANS(vfnmsac_vv, opfvv_check)
+GEN_OPFVF_TRANS(vfnmsac_vf, opfvf_check)
+GEN_OPFVV_TRANS(vfmadd_vv, opfvv_check)
+GEN_OPFVF_TRANS(vfmadd_vf, opfvf_check)
+GEN_OPFVV_TRANS(vfnmadd_vv, opfvv_check)
+GEN_OPFVF_TRANS(vfnmadd_vf, opfvf_check)
+GEN_OPFVV_TRANS(vfmsub_vv, opfvv_check)
+GEN_OPFVF_TRANS(vfmsub_vf, opfvf_check)
+GEN_OPFVV_TRANS(vfnmsub_vv, opfvv_check)
+GEN_OPFVF_TRANS(vfnmsub_vf, opfvf_check)
+
+GEN_OPFVV_TRANS(vmfeq_vv, opfvv_cmp_check)
+GEN_OPFVF_TRANS(vmfeq_vf, opfvf_cmp_check)
+GEN_OPFVV_TRANS(vmfne_vv, opfvv_cmp_check)
+GEN_OPFVF_TRANS(vmfne_vf, opfvf_cmp_check)
+GEN_OPFVV_TRANS(vmflt_vv, opfvv_cmp_check)
+GEN_OPFVF_TRANS(vmflt_vf, opfvf_cmp_check)
+GEN_OPFVV_TRANS(vmfle_vv, opfvv_cmp_check)
+GEN_OPFVF_TRANS(vmfle_vf, opfvf_cmp_check)
+GEN_OPFVF_TRANS(vmfgt_vf, opfvf_cmp_check)
+GEN_OPFVF_TRANS(vmfge_vf, opfvf_cmp_check)
+
+GEN_OPFVF_TRANS(vfmerge_vfm, opfvf_check)
+
+/* an ordered sum is also a valid unordered one */
+GEN_OPFVV_TRANS(vfredosum_vs, freduction_check)
+GEN_OPFVV_TRANS(vfredmin_vs, freduction_check)
+GEN_OPFVV_TRANS(vfredmax_vs, freduction_check)
+
+static bool trans_vfredusum_vs(DisasContext *ctx, arg_rmrr *a, uint32_t insn)
+{
+    return trans_vfredosum_vs(ctx, a, insn);
+}
+
+static bool trans_vfsqrt_v(DisasContext *ctx, arg_rmr *a, uint32_t insn)
+{
+    static gen_helper_gvec_3_ptr * const fns[2] = GEN_VEXT_FP_FNS(vfsqrt_v);
+
+    if (!require_vtype(ctx) || !require_rvf(ctx) ||
+        !require_vm(a->vm, a->rd) || !require_align(a->rd, ctx->lmul) ||
+        !require_align(a->rs2, ctx->lmul)) {
+        return false;
+    }
+    gen_set_rm(ctx, 7);
+    mark_fs_dirty(ctx);
+    tcg_gen_gvec_3_ptr(vreg_ofs(ctx, a->rd), vreg_ofs(ctx, 0),
+                       vreg_ofs(ctx, a->rs2), cpu_env,
+                       vlenb(ctx), vlenb(ctx), a->vm ? VDATA_VM : 0,
+                       fns[ctx->sew - MO_32]);
+    gen_reset_vstart(ctx);
+    return true;
+}
+
+static bool trans_vfmv_v_f(DisasContext *ctx, arg_vfmv_v_f *a, uint32_t insn)
+{
+    static gen_helper_opfvf * const fns[2] = GEN_VEXT_FP_FNS(vfmerge_vfm);
+
+    if (!require_vtype(ctx) || !require_rvf(ctx) ||
+        !require_align(a->rd, ctx->lmul)) {
+        return false;
+    }
+    if (vext_use_gvec(ctx, 1)) {
+        tcg_gen_gvec_dup_i64(ctx->sew, vreg_ofs(ctx, a->rd),
+                             vreg_group_size(ctx), vreg_group_size(ctx),
+                             cpu_fpr[a->rs1]);
+    } else {
+        gen_opfvf(ctx, a->rd, 1, cpu_fpr[a->rs1], a->rd,
+                  fns[ctx->sew - MO_32]);
+        gen_reset_vstart(ctx);
+    }
+    return true;
+}
+
+/* single precision values in f registers are NaN-boxed */
+static bool trans_vfmv_f_s(DisasContext *ctx, arg_vfmv_f_s *a, uint32_t insn)
+{
+    if (!require_vtype(ctx) || !require_rvf(ctx)) {
+        return false;
+    }
+    mark_fs_dirty(ctx);
+    gen_ld_elem0(ctx, cpu_fpr[a->rd], a->rs2, false);
+    if (ctx->sew == MO_32) {
+        tcg_gen_ori_i64(cpu_fpr[a->rd], cpu_fpr[a->rd],
+                        MAKE_64BIT_MASK(32, 32));
+    }
+    gen_reset_vstart(ctx);
+    return true;
+}
+
+static bool trans_vfmv_s_f(DisasContext *ctx, arg_vfmv_s_f *a, uint32_t insn)
+{
+    if (!require_vtype(ctx) || !require_rvf(ctx)) {
+        return false;
+    }
+    gen_st_elem0(ctx, cpu_fpr[a->rs1], a->rd);
+    gen_reset_vstart(ctx);
+    return true;
+}
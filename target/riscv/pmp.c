@@ -28,6 +28,7 @@
 #include "qapi/error.h"
 #include "cpu.h"
 #include "qemu-common.h"
+#include "exec/exec-all.h"
 
 #ifndef CONFIG_USER_ONLY
 
@@ -147,16 +148,10 @@ static void pmp_decode_napot(target_ulong a, target_ulong *sa, target_ulong *ea)
 
 
 /* Convert cfg/addr reg values here into simple 'sa' --> start address and 'ea'
- *   end address values.
- *   This function is called relatively infrequently whereas the check that
- *   an address is within a pmp rule is called often, so optimise that one
+ *   end address values.  An entry that matches nothing gets sa > ea.
  */
-static void pmp_update_rule(CPURISCVState *env, uint32_t pmp_index)
+static void pmp_decode_rule(CPURISCVState *env, uint32_t pmp_index)
 {
-    int i;
-
-    env->pmp_state.num_rules = 0;
-
     uint8_t this_cfg = env->pmp_state.pmp[pmp_index].cfg_reg;
     target_ulong this_addr = env->pmp_state.pmp[pmp_index].addr_reg;
     target_ulong prev_addr = 0u;
@@ -168,55 +163,179 @@ static void pmp_update_rule(CPURISCVState *env, uint32_t pmp_index)
     }
 
     switch (pmp_get_a_field(this_cfg)) {
-    case PMP_AMATCH_OFF:
-        sa = 0u;
-        ea = -1;
-        break;
-
     case PMP_AMATCH_TOR:
         sa = prev_addr << 2; /* shift up from [xx:0] to [xx+2:2] */
         ea = (this_addr << 2) - 1u;
+        if ((this_addr << 2) <= sa) {
+            /* empty range */
+            sa = 1u;
+            ea = 0u;
+        }
         break;
 
     case PMP_AMATCH_NA4:
         sa = this_addr << 2; /* shift up from [xx:0] to [xx+2:2] */
-        ea = (this_addr + 4u) - 1u;
+        ea = sa + 3u;
         break;
 
     case PMP_AMATCH_NAPOT:
         pmp_decode_napot(this_addr, &sa, &ea);
         break;
 
+    case PMP_AMATCH_OFF:
     default:
-        sa = 0u;
+        sa = 1u;
         ea = 0u;
         break;
     }
 
     env->pmp_state.addr[pmp_index].sa = sa;
     env->pmp_state.addr[pmp_index].ea = ea;
+}
 
+static inline bool pmp_rule_is_active(CPURISCVState *env, int pmp_index)
+{
+    return env->pmp_state.addr[pmp_index].sa <=
+           env->pmp_state.addr[pmp_index].ea;
+}
+
+static int pmp_cmp_boundary(const void *a, const void *b)
+{
+    target_ulong x = *(const target_ulong *)a;
+    target_ulong y = *(const target_ulong *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * Rebuild the segment table from the decoded rules.  This function is
+ * called relatively infrequently whereas the lookup of the rule covering
+ * an address is called on every TLB fill, so optimise that one.
+ */
+static void pmp_build_segments(CPURISCVState *env)
+{
+    pmp_table_t *t = &env->pmp_state;
+    target_ulong bounds[MAX_RISCV_PMP_SEGS];
+    uint32_t nb_bounds = 0;
+    uint32_t i, j;
+
+    bounds[nb_bounds++] = 0;
+    for (i = 0; i < MAX_RISCV_PMPS; i++) {
+        if (pmp_rule_is_active(env, i)) {
+            bounds[nb_bounds++] = t->addr[i].sa;
+            if (t->addr[i].ea != (target_ulong)-1) {
+                bounds[nb_bounds++] = t->addr[i].ea + 1;
+            }
+        }
+    }
+    qsort(bounds, nb_bounds, sizeof(bounds[0]), pmp_cmp_boundary);
+
+    t->num_segs = 0;
+    for (i = 0; i < nb_bounds; i++) {
+        int32_t rule = -1;
+
+        if (i > 0 && bounds[i] == bounds[i - 1]) {
+            continue;
+        }
+        /* 1.10 draft priv spec states there is an implicit order
+             from low to high */
+        for (j = 0; j < MAX_RISCV_PMPS; j++) {
+            if (bounds[i] >= t->addr[j].sa && bounds[i] <= t->addr[j].ea) {
+                rule = j;
+                break;
+            }
+        }
+        if (t->num_segs > 0 && t->seg[t->num_segs - 1].rule == rule) {
+            continue;
+        }
+        t->seg[t->num_segs].sa = bounds[i];
+        t->seg[t->num_segs].rule = rule;
+        t->num_segs++;
+    }
+}
+
+static void pmp_update_rule(CPURISCVState *env, uint32_t pmp_index)
+{
+    int i;
+
+    /* A TOR rule also depends on the address of the entry below it, so
+       decode everything rather than just pmp_index */
+    env->pmp_state.num_rules = 0;
     for (i = 0; i < MAX_RISCV_PMPS; i++) {
-        const uint8_t a_field =
-            pmp_get_a_field(env->pmp_state.pmp[i].cfg_reg);
-        if (PMP_AMATCH_OFF != a_field) {
+        pmp_decode_rule(env, i);
+        if (pmp_rule_is_active(env, i)) {
             env->pmp_state.num_rules++;
         }
     }
+    pmp_build_segments(env);
+
+    /* TLB entries carry permissions derived from the old rules */
+    tlb_flush(CPU(riscv_env_get_cpu(env)));
 }
 
-static int pmp_is_in_range(CPURISCVState *env, int pmp_index, target_ulong addr)
+/*
+ * Binary search for the segment containing addr
+ */
+static uint32_t pmp_find_segment(CPURISCVState *env, target_ulong addr)
 {
-    int result = 0;
+    const pmp_seg_t *seg = env->pmp_state.seg;
+    uint32_t lo = 0, hi = env->pmp_state.num_segs - 1;
 
-    if ((addr >= env->pmp_state.addr[pmp_index].sa)
-        && (addr <= env->pmp_state.addr[pmp_index].ea)) {
-        result = 1;
-    } else {
-        result = 0;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi + 1) / 2;
+        if (seg[mid].sa <= addr) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+/*
+ * Find the rule governing the access [addr, addr + size - 1].  Returns the
+ * rule index, -1 if no rule matches, or -2 if the highest-priority matching
+ * rule only covers part of the access.
+ */
+static int pmp_find_rule(CPURISCVState *env, target_ulong addr,
+                         target_ulong size)
+{
+    target_ulong end = addr + (size ? size - 1 : 0);
+    uint32_t first = pmp_find_segment(env, addr);
+    uint32_t last = pmp_find_segment(env, end);
+    int rule = -1;
+    uint32_t i;
+
+    for (i = first; i <= last; i++) {
+        int r = env->pmp_state.seg[i].rule;
+        if (r >= 0 && (rule < 0 || r < rule)) {
+            rule = r;
+        }
+    }
+
+    if (rule >= 0 && (addr < env->pmp_state.addr[rule].sa ||
+                      end > env->pmp_state.addr[rule].ea)) {
+        PMP_DEBUG("pmp violation - access is partially inside");
+        return -2;
+    }
+    return rule;
+}
+
+static pmp_priv_t pmp_rule_privs(CPURISCVState *env, int rule)
+{
+    pmp_priv_t allowed_privs = PMP_READ | PMP_WRITE | PMP_EXEC;
+
+    if (rule < 0) {
+        /* Privileged spec v1.10 states if no PMP entry matches an M-Mode
+         * access, the access succeeds.  Other modes are not allowed to
+         * succeed if they don't match a rule, but there are rules. */
+        return env->priv == PRV_M ? allowed_privs : 0;
     }
 
-    return result;
+    if ((env->priv != PRV_M) || pmp_is_locked(env, rule)) {
+        allowed_privs &= env->pmp_state.pmp[rule].cfg_reg;
+    }
+    return allowed_privs;
 }
 
 
@@ -230,66 +349,41 @@ static int pmp_is_in_range(CPURISCVState *env, int pmp_index, target_ulong addr)
 bool pmp_hart_has_privs(CPURISCVState *env, target_ulong addr,
     target_ulong size, pmp_priv_t privs)
 {
-    int i = 0;
-    int ret = -1;
-    target_ulong s = 0;
-    target_ulong e = 0;
-    pmp_priv_t allowed_privs = 0;
+    int rule;
 
     /* Short cut if no rules */
     if (0 == pmp_get_num_rules(env)) {
         return true;
     }
 
-    /* 1.10 draft priv spec states there is an implicit order
-         from low to high */
-    for (i = 0; i < MAX_RISCV_PMPS; i++) {
-        s = pmp_is_in_range(env, i, addr);
-        e = pmp_is_in_range(env, i, addr + size);
-
-        /* partially inside */
-        if ((s + e) == 1) {
-            PMP_DEBUG("pmp violation - access is partially inside");
-            ret = 0;
-            break;
-        }
-
-        /* fully inside */
-        const uint8_t a_field =
-            pmp_get_a_field(env->pmp_state.pmp[i].cfg_reg);
-        if ((s + e) == 2) {
-            if (PMP_AMATCH_OFF == a_field) {
-                return 1;
-            }
+    rule = pmp_find_rule(env, addr, size);
+    if (rule == -2) {
+        return false;
+    }
+    return (privs & pmp_rule_privs(env, rule)) == privs;
+}
 
-            allowed_privs = PMP_READ | PMP_WRITE | PMP_EXEC;
-            if ((env->priv != PRV_M) || pmp_is_locked(env, i)) {
-                allowed_privs &= env->pmp_state.pmp[i].cfg_reg;
-            }
+/*
+ * Get the privileges that apply uniformly to the whole target page holding
+ * addr.  Returns false if different rules cover different parts of the page,
+ * in which case every access needs checking separately.
+ */
+bool pmp_get_page_privs(CPURISCVState *env, target_ulong addr,
+    pmp_priv_t *privs)
+{
+    target_ulong page = addr & TARGET_PAGE_MASK;
 
-            if ((privs & allowed_privs) == privs) {
-                ret = 1;
-                break;
-            } else {
-                ret = 0;
-                break;
-            }
-        }
+    if (0 == pmp_get_num_rules(env)) {
+        *privs = PMP_READ | PMP_WRITE | PMP_EXEC;
+        return true;
     }
 
-    /* No rule matched */
-    if (ret == -1) {
-        if (env->priv == PRV_M) {
-            ret = 1; /* Privileged spec v1.10 states if no PMP entry matches an
-                      * M-Mode access, the access succeeds */
-        } else {
-            ret = 0; /* Other modes are not allowed to succeed if they don't
-                      * match a rule, but there are rules.  We've checked for
-                      * no rule earlier in this function. */
-        }
+    if (pmp_find_segment(env, page) !=
+        pmp_find_segment(env, page + TARGET_PAGE_SIZE - 1)) {
+        return false;
     }
-
-    return ret == 1 ? true : false;
+    *privs = pmp_rule_privs(env, pmp_find_rule(env, page, TARGET_PAGE_SIZE));
+    return true;
 }
 
 
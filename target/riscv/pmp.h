@@ -46,10 +46,25 @@ typedef struct {
     target_ulong ea;
 } pmp_addr_t;
 
+/*
+ * The active rules flattened into a sorted partition of the physical
+ * address space.  Segment i covers [seg[i].sa, seg[i + 1].sa - 1] (the
+ * last one extends to the top of memory) and records the lowest-numbered
+ * rule matching it, which is the one that takes priority, or -1.
+ */
+typedef struct {
+    target_ulong sa;
+    int32_t rule;
+} pmp_seg_t;
+
+#define MAX_RISCV_PMP_SEGS (2 * MAX_RISCV_PMPS + 1)
+
 typedef struct {
     pmp_entry_t pmp[MAX_RISCV_PMPS];
     pmp_addr_t  addr[MAX_RISCV_PMPS];
     uint32_t num_rules;
+    pmp_seg_t seg[MAX_RISCV_PMP_SEGS];
+    uint32_t num_segs;
 } pmp_table_t;
 
 void pmpcfg_csr_write(CPURISCVState *env, uint32_t reg_index,
@@ -60,5 +75,7 @@ void pmpaddr_csr_write(CPURISCVState *env, uint32_t addr_index,
 target_ulong pmpaddr_csr_read(CPURISCVState *env, uint32_t addr_index);
 bool pmp_hart_has_privs(CPURISCVState *env, target_ulong addr,
     target_ulong size, pmp_priv_t priv);
+bool pmp_get_page_privs(CPURISCVState *env, target_ulong addr,
+    pmp_priv_t *privs);
 
 #endif
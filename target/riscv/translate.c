@@ -20,6 +20,7 @@
 #include "qemu/log.h"
 #include "cpu.h"
 #include "tcg-op.h"
+#include "tcg-op-gvec.h"
 #include "disas/disas.h"
 #include "exec/cpu_ldst.h"
 #include "exec/exec-all.h"
@@ -28,6 +29,7 @@
 
 #include "exec/translator.h"
 #include "exec/log.h"
+#include "trace.h"
 
 #include "instmap.h"
 
@@ -41,17 +43,37 @@ static TCGv load_val;
 
 typedef struct DisasContext {
     DisasContextBase base;
+    CPURISCVState *env;
     /* pc_succ_insn points to the instruction following base.pc_next */
     target_ulong pc_succ_insn;
     uint32_t opcode;
     uint32_t flags;
+    /* the privilege level, ORed with MMU_VIRT_IDX in VS-mode and VU-mode */
     uint32_t mem_idx;
+    bool virt;
     /* Remember the rounding mode encoded in the previous fp instruction,
        which we have already installed into env->fp_status.  Or -1 for
-       no previous fp instruction.  Note that we exit the TB when writing
-       to any system register, which includes CSR_FRM, so we do not have
-       to reset this known value.  */
+       no previous fp instruction.  The dynamic rounding mode is resolved
+       from the TB flags, and writes to CSR_FRM end the TB, so we do not
+       have to reset this known value.  */
     int frm;
+    /* mstatus.FS from the TB flags, dirty once the TB has set it so */
+    target_ulong mstatus_fs;
+    /* follow jal x0 forward within the first page, see tcg_superblocks */
+    bool superblocks;
+    /* x0 as a source and as a destination, freed after each instruction */
+    TCGv zero;
+    TCGv sink;
+    /* immediate holding the number of insns added to env->instret */
+    TCGOp *insn_count_op;
+    /* MO_ALIGN if misaligned loads and stores trap, else MO_UNALN */
+    TCGMemOp misalign;
+    /* vector state from the TB flags, lmul is log2(LMUL) */
+    uint16_t vlen;
+    int8_t lmul;
+    uint8_t sew;
+    bool vill;
+    bool vl_eq_vlmax;
 } DisasContext;
 
 /* convert riscv funct3 to qemu memop for load/store */
@@ -74,8 +96,37 @@ static const int tcg_memop_lookup[8] = {
 #define CASE_OP_32_64(X) case X
 #endif
 
+/* the TB was counted in full on entry, take back an insn that traps */
+static void gen_uncount_insn(DisasContext *ctx)
+{
+    TCGv_i64 t;
+
+    if (ctx->flags & TB_FLAGS_INSN_COUNT) {
+        t = tcg_temp_new_i64();
+        tcg_gen_ld_i64(t, cpu_env, offsetof(CPURISCVState, instret));
+        tcg_gen_subi_i64(t, t, 1);
+        tcg_gen_st_i64(t, cpu_env, offsetof(CPURISCVState, instret));
+        tcg_temp_free_i64(t);
+    }
+}
+
+/* count a hardware performance monitor event, if a counter wants it */
+static void gen_hpm_count(DisasContext *ctx, int event)
+{
+    TCGv_i64 t;
+
+    if (ctx->flags & TB_FLAGS_HPM(event)) {
+        t = tcg_temp_new_i64();
+        tcg_gen_ld_i64(t, cpu_env, offsetof(CPURISCVState, hpm_count[event]));
+        tcg_gen_addi_i64(t, t, 1);
+        tcg_gen_st_i64(t, cpu_env, offsetof(CPURISCVState, hpm_count[event]));
+        tcg_temp_free_i64(t);
+    }
+}
+
 static void generate_exception(DisasContext *ctx, int excp)
 {
+    gen_uncount_insn(ctx);
     tcg_gen_movi_tl(cpu_pc, ctx->base.pc_next);
     TCGv_i32 helper_tmp = tcg_const_i32(excp);
     gen_helper_raise_exception(cpu_env, helper_tmp);
@@ -85,6 +136,7 @@ static void generate_exception(DisasContext *ctx, int excp)
 
 static void generate_exception_mbadaddr(DisasContext *ctx, int excp)
 {
+    gen_uncount_insn(ctx);
     tcg_gen_movi_tl(cpu_pc, ctx->base.pc_next);
     tcg_gen_st_tl(cpu_pc, cpu_env, offsetof(CPURISCVState, badaddr));
     TCGv_i32 helper_tmp = tcg_const_i32(excp);
@@ -123,6 +175,18 @@ static inline bool use_goto_tb(DisasContext *ctx, target_ulong dest)
 #endif
 }
 
+/* Jump to the TB for the pc already stored in cpu_pc, looking it up in
+ * the jump cache rather than returning to the main loop.
+ */
+static void lookup_and_goto_ptr(DisasContext *ctx)
+{
+    if (ctx->base.singlestep_enabled) {
+        gen_exception_debug();
+    } else {
+        tcg_gen_lookup_and_goto_ptr();
+    }
+}
+
 static void gen_goto_tb(DisasContext *ctx, int n, target_ulong dest)
 {
     if (use_goto_tb(ctx, dest)) {
@@ -132,11 +196,7 @@ static void gen_goto_tb(DisasContext *ctx, int n, target_ulong dest)
         tcg_gen_exit_tb(ctx->base.tb, n);
     } else {
         tcg_gen_movi_tl(cpu_pc, dest);
-        if (ctx->base.singlestep_enabled) {
-            gen_exception_debug();
-        } else {
-            tcg_gen_exit_tb(NULL, 0);
-        }
+        lookup_and_goto_ptr(ctx);
     }
 }
 
@@ -157,13 +217,55 @@ static inline void gen_get_gpr(TCGv t, int reg_num)
  * since we usually avoid calling the OP_TYPE_gen function if we see a write to
  * $zero
  */
+static inline void gen_trace_gpr(int reg_num)
+{
+    if (trace_event_get_state_backends(TRACE_RISCV_REG_WRITE)) {
+        TCGv_i32 reg = tcg_const_i32(reg_num);
+
+        gen_helper_trace_reg_write(cpu_env, reg, cpu_gpr[reg_num]);
+        tcg_temp_free_i32(reg);
+    }
+}
+
 static inline void gen_set_gpr(int reg_num_dst, TCGv t)
 {
     if (reg_num_dst != 0) {
         tcg_gen_mov_tl(cpu_gpr[reg_num_dst], t);
+        gen_trace_gpr(reg_num_dst);
     }
 }
 
+/*
+ * Operands that are only read can use the global in place, without a
+ * copy through gen_get_gpr.  x0 reads as a constant.
+ */
+static TCGv get_gpr(DisasContext *ctx, int reg_num)
+{
+    if (reg_num == 0) {
+        if (!ctx->zero) {
+            ctx->zero = tcg_const_tl(0);
+        }
+        return ctx->zero;
+    }
+    return cpu_gpr[reg_num];
+}
+
+/*
+ * Destination for ops that write rd directly.  Those must not read their
+ * sources after writing the destination, as rd may be one of them.  Writes
+ * to x0 go to a scratch temporary.
+ */
+static TCGv dest_gpr(DisasContext *ctx, int reg_num)
+{
+    if (reg_num == 0) {
+        if (!ctx->sink) {
+            ctx->sink = tcg_temp_new();
+        }
+        return ctx->sink;
+    }
+    return cpu_gpr[reg_num];
+}
+
 static void gen_mulhsu(TCGv ret, TCGv arg1, TCGv arg2)
 {
     TCGv rl = tcg_temp_new();
@@ -217,8 +319,8 @@ static void gen_fsgnj(DisasContext *ctx, uint32_t rd, uint32_t rs1,
     }
 }
 
-static void gen_arith(DisasContext *ctx, uint32_t opc, int rd, int rs1,
-        int rs2)
+static void gen_muldiv(DisasContext *ctx, uint32_t opc, int rd, int rs1,
+                       int rs2)
 {
     TCGv source1, source2, cond1, cond2, zeroreg, resultopt1;
     source1 = tcg_temp_new();
@@ -227,65 +329,6 @@ static void gen_arith(DisasContext *ctx, uint32_t opc, int rd, int rs1,
     gen_get_gpr(source2, rs2);
 
     switch (opc) {
-    CASE_OP_32_64(OPC_RISC_ADD):
-        tcg_gen_add_tl(source1, source1, source2);
-        break;
-    CASE_OP_32_64(OPC_RISC_SUB):
-        tcg_gen_sub_tl(source1, source1, source2);
-        break;
-#if defined(TARGET_RISCV64)
-    case OPC_RISC_SLLW:
-        tcg_gen_andi_tl(source2, source2, 0x1F);
-        tcg_gen_shl_tl(source1, source1, source2);
-        break;
-#endif
-    case OPC_RISC_SLL:
-        tcg_gen_andi_tl(source2, source2, TARGET_LONG_BITS - 1);
-        tcg_gen_shl_tl(source1, source1, source2);
-        break;
-    case OPC_RISC_SLT:
-        tcg_gen_setcond_tl(TCG_COND_LT, source1, source1, source2);
-        break;
-    case OPC_RISC_SLTU:
-        tcg_gen_setcond_tl(TCG_COND_LTU, source1, source1, source2);
-        break;
-    case OPC_RISC_XOR:
-        tcg_gen_xor_tl(source1, source1, source2);
-        break;
-#if defined(TARGET_RISCV64)
-    case OPC_RISC_SRLW:
-        /* clear upper 32 */
-        tcg_gen_ext32u_tl(source1, source1);
-        tcg_gen_andi_tl(source2, source2, 0x1F);
-        tcg_gen_shr_tl(source1, source1, source2);
-        break;
-#endif
-    case OPC_RISC_SRL:
-        tcg_gen_andi_tl(source2, source2, TARGET_LONG_BITS - 1);
-        tcg_gen_shr_tl(source1, source1, source2);
-        break;
-#if defined(TARGET_RISCV64)
-    case OPC_RISC_SRAW:
-        /* first, trick to get it to act like working on 32 bits (get rid of
-        upper 32, sign extend to fill space) */
-        tcg_gen_ext32s_tl(source1, source1);
-        tcg_gen_andi_tl(source2, source2, 0x1F);
-        tcg_gen_sar_tl(source1, source1, source2);
-        break;
-#endif
-    case OPC_RISC_SRA:
-        tcg_gen_andi_tl(source2, source2, TARGET_LONG_BITS - 1);
-        tcg_gen_sar_tl(source1, source1, source2);
-        break;
-    case OPC_RISC_OR:
-        tcg_gen_or_tl(source1, source1, source2);
-        break;
-    case OPC_RISC_AND:
-        tcg_gen_and_tl(source1, source1, source2);
-        break;
-    CASE_OP_32_64(OPC_RISC_MUL):
-        tcg_gen_mul_tl(source1, source1, source2);
-        break;
     case OPC_RISC_MULH:
         tcg_gen_muls2_tl(source2, source1, source1, source2);
         break;
@@ -425,84 +468,172 @@ static void gen_arith(DisasContext *ctx, uint32_t opc, int rd, int rs1,
     tcg_temp_free(source2);
 }
 
+static void gen_arith(DisasContext *ctx, uint32_t opc, int rd, int rs1,
+        int rs2)
+{
+    TCGv source1 = get_gpr(ctx, rs1);
+    TCGv source2 = get_gpr(ctx, rs2);
+    TCGv dest = dest_gpr(ctx, rd);
+    TCGv t0, t1;
+
+    switch (opc) {
+    CASE_OP_32_64(OPC_RISC_ADD):
+        tcg_gen_add_tl(dest, source1, source2);
+        break;
+    CASE_OP_32_64(OPC_RISC_SUB):
+        tcg_gen_sub_tl(dest, source1, source2);
+        break;
+    case OPC_RISC_SLT:
+        tcg_gen_setcond_tl(TCG_COND_LT, dest, source1, source2);
+        break;
+    case OPC_RISC_SLTU:
+        tcg_gen_setcond_tl(TCG_COND_LTU, dest, source1, source2);
+        break;
+    case OPC_RISC_XOR:
+        tcg_gen_xor_tl(dest, source1, source2);
+        break;
+    case OPC_RISC_OR:
+        tcg_gen_or_tl(dest, source1, source2);
+        break;
+    case OPC_RISC_AND:
+        tcg_gen_and_tl(dest, source1, source2);
+        break;
+    CASE_OP_32_64(OPC_RISC_MUL):
+        tcg_gen_mul_tl(dest, source1, source2);
+        break;
+    case OPC_RISC_SLL:
+    case OPC_RISC_SRL:
+    case OPC_RISC_SRA:
+        t0 = tcg_temp_new();
+        tcg_gen_andi_tl(t0, source2, TARGET_LONG_BITS - 1);
+        if (opc == OPC_RISC_SLL) {
+            tcg_gen_shl_tl(dest, source1, t0);
+        } else if (opc == OPC_RISC_SRL) {
+            tcg_gen_shr_tl(dest, source1, t0);
+        } else {
+            tcg_gen_sar_tl(dest, source1, t0);
+        }
+        tcg_temp_free(t0);
+        break;
+#if defined(TARGET_RISCV64)
+    case OPC_RISC_SLLW:
+        t0 = tcg_temp_new();
+        tcg_gen_andi_tl(t0, source2, 0x1F);
+        tcg_gen_shl_tl(dest, source1, t0);
+        tcg_temp_free(t0);
+        break;
+    case OPC_RISC_SRLW:
+    case OPC_RISC_SRAW:
+        t0 = tcg_temp_new();
+        t1 = tcg_temp_new();
+        tcg_gen_andi_tl(t0, source2, 0x1F);
+        if (opc == OPC_RISC_SRLW) {
+            /* clear upper 32 */
+            tcg_gen_ext32u_tl(t1, source1);
+            tcg_gen_shr_tl(dest, t1, t0);
+        } else {
+            /* sign extend to act like working on 32 bits */
+            tcg_gen_ext32s_tl(t1, source1);
+            tcg_gen_sar_tl(dest, t1, t0);
+        }
+        tcg_temp_free(t0);
+        tcg_temp_free(t1);
+        break;
+#endif
+    default:
+        /* multi-op sequences that read their operands late */
+        gen_muldiv(ctx, opc, rd, rs1, rs2);
+        return;
+    }
+
+    if (opc & 0x8) { /* sign extend for W instructions */
+        tcg_gen_ext32s_tl(dest, dest);
+    }
+}
+
 static void gen_arith_imm(DisasContext *ctx, uint32_t opc, int rd,
         int rs1, target_long imm)
 {
-    TCGv source1 = tcg_temp_new();
+    TCGv source1 = get_gpr(ctx, rs1);
+    TCGv dest;
     int shift_len = TARGET_LONG_BITS;
     int shift_a;
 
-    gen_get_gpr(source1, rs1);
+    /* reject invalid shift amounts before anything is written to rd */
+    switch (opc) {
+#if defined(TARGET_RISCV64)
+    case OPC_RISC_SLLIW:
+    case OPC_RISC_SHIFT_RIGHT_IW:
+        shift_len = 32;
+        /* FALLTHRU */
+#endif
+    case OPC_RISC_SLLI:
+    case OPC_RISC_SHIFT_RIGHT_I:
+        if ((imm & 0x3ff) >= shift_len) {
+            gen_exception_illegal(ctx);
+            return;
+        }
+        break;
+    }
 
+    dest = dest_gpr(ctx, rd);
     switch (opc) {
     case OPC_RISC_ADDI:
 #if defined(TARGET_RISCV64)
     case OPC_RISC_ADDIW:
 #endif
-        tcg_gen_addi_tl(source1, source1, imm);
+        tcg_gen_addi_tl(dest, source1, imm);
         break;
     case OPC_RISC_SLTI:
-        tcg_gen_setcondi_tl(TCG_COND_LT, source1, source1, imm);
+        tcg_gen_setcondi_tl(TCG_COND_LT, dest, source1, imm);
         break;
     case OPC_RISC_SLTIU:
-        tcg_gen_setcondi_tl(TCG_COND_LTU, source1, source1, imm);
+        tcg_gen_setcondi_tl(TCG_COND_LTU, dest, source1, imm);
         break;
     case OPC_RISC_XORI:
-        tcg_gen_xori_tl(source1, source1, imm);
+        tcg_gen_xori_tl(dest, source1, imm);
         break;
     case OPC_RISC_ORI:
-        tcg_gen_ori_tl(source1, source1, imm);
+        tcg_gen_ori_tl(dest, source1, imm);
         break;
     case OPC_RISC_ANDI:
-        tcg_gen_andi_tl(source1, source1, imm);
+        tcg_gen_andi_tl(dest, source1, imm);
         break;
 #if defined(TARGET_RISCV64)
     case OPC_RISC_SLLIW:
-        shift_len = 32;
-        /* FALLTHRU */
 #endif
     case OPC_RISC_SLLI:
-        if (imm >= shift_len) {
-            goto do_illegal;
-        }
-        tcg_gen_shli_tl(source1, source1, imm);
+        tcg_gen_shli_tl(dest, source1, imm);
         break;
 #if defined(TARGET_RISCV64)
     case OPC_RISC_SHIFT_RIGHT_IW:
-        shift_len = 32;
-        /* FALLTHRU */
 #endif
     case OPC_RISC_SHIFT_RIGHT_I:
         /* differentiate on IMM */
         shift_a = imm & 0x400;
         imm &= 0x3ff;
-        if (imm >= shift_len) {
-            goto do_illegal;
-        }
         if (imm != 0) {
             if (shift_a) {
                 /* SRAI[W] */
-                tcg_gen_sextract_tl(source1, source1, imm, shift_len - imm);
+                tcg_gen_sextract_tl(dest, source1, imm, shift_len - imm);
             } else {
                 /* SRLI[W] */
-                tcg_gen_extract_tl(source1, source1, imm, shift_len - imm);
+                tcg_gen_extract_tl(dest, source1, imm, shift_len - imm);
             }
             /* No further sign-extension needed for W instructions.  */
             opc &= ~0x8;
+        } else {
+            tcg_gen_mov_tl(dest, source1);
         }
         break;
     default:
-    do_illegal:
         gen_exception_illegal(ctx);
         return;
     }
 
     if (opc & 0x8) { /* sign-extend for W instructions */
-        tcg_gen_ext32s_tl(source1, source1);
+        tcg_gen_ext32s_tl(dest, dest);
     }
-
-    gen_set_gpr(rd, source1);
-    tcg_temp_free(source1);
 }
 
 static void gen_jal(CPURISCVState *env, DisasContext *ctx, int rd,
@@ -520,6 +651,14 @@ static void gen_jal(CPURISCVState *env, DisasContext *ctx, int rd,
     }
     if (rd != 0) {
         tcg_gen_movi_tl(cpu_gpr[rd], ctx->pc_succ_insn);
+        gen_trace_gpr(rd);
+    } else if (ctx->superblocks && next_pc > ctx->base.pc_next &&
+               ((next_pc ^ ctx->base.pc_first) & TARGET_PAGE_MASK) == 0) {
+        /* Keep translating at the target.  Only forward jumps are followed
+           so the TB still covers [pc_first, pc_next) of a single page,
+           which is what code invalidation and tb->size rely on.  */
+        ctx->pc_succ_insn = next_pc;
+        return;
     }
 
     gen_goto_tb(ctx, 0, ctx->base.pc_next + imm); /* must use this for safety */
@@ -529,7 +668,6 @@ static void gen_jal(CPURISCVState *env, DisasContext *ctx, int rd,
 static void gen_jalr(CPURISCVState *env, DisasContext *ctx, uint32_t opc,
                      int rd, int rs1, target_long imm)
 {
-    /* no chaining with JALR */
     TCGLabel *misaligned = NULL;
     TCGv t0 = tcg_temp_new();
 
@@ -547,8 +685,10 @@ static void gen_jalr(CPURISCVState *env, DisasContext *ctx, uint32_t opc,
 
         if (rd != 0) {
             tcg_gen_movi_tl(cpu_gpr[rd], ctx->pc_succ_insn);
+            gen_trace_gpr(rd);
         }
-        tcg_gen_exit_tb(NULL, 0);
+        /* the target is only known at run time, so chain via the jump cache */
+        lookup_and_goto_ptr(ctx);
 
         if (misaligned) {
             gen_set_label(misaligned);
@@ -568,12 +708,11 @@ static void gen_branch(CPURISCVState *env, DisasContext *ctx, uint32_t opc,
                        int rs1, int rs2, target_long bimm)
 {
     TCGLabel *l = gen_new_label();
-    TCGv source1, source2;
-    source1 = tcg_temp_new();
-    source2 = tcg_temp_new();
-    gen_get_gpr(source1, rs1);
-    gen_get_gpr(source2, rs2);
+    TCGv source1 = get_gpr(ctx, rs1);
+    TCGv source2 = get_gpr(ctx, rs2);
 
+    /* before the brcond, so both ways out of the branch are counted */
+    gen_hpm_count(ctx, RISCV_HPM_EVENT_BRANCH);
     switch (opc) {
     case OPC_RISC_BEQ:
         tcg_gen_brcond_tl(TCG_COND_EQ, source1, source2, l);
@@ -597,8 +736,6 @@ static void gen_branch(CPURISCVState *env, DisasContext *ctx, uint32_t opc,
         gen_exception_illegal(ctx);
         return;
     }
-    tcg_temp_free(source1);
-    tcg_temp_free(source2);
 
     gen_goto_tb(ctx, 1, ctx->pc_succ_insn);
     gen_set_label(l); /* branch taken */
@@ -614,41 +751,63 @@ static void gen_branch(CPURISCVState *env, DisasContext *ctx, uint32_t opc,
 static void gen_load(DisasContext *ctx, uint32_t opc, int rd, int rs1,
         target_long imm)
 {
-    TCGv t0 = tcg_temp_new();
-    TCGv t1 = tcg_temp_new();
-    gen_get_gpr(t0, rs1);
-    tcg_gen_addi_tl(t0, t0, imm);
     int memop = tcg_memop_lookup[(opc >> 12) & 0x7];
+    TCGv t0;
 
     if (memop < 0) {
         gen_exception_illegal(ctx);
         return;
     }
 
-    tcg_gen_qemu_ld_tl(t1, t0, ctx->mem_idx, memop);
-    gen_set_gpr(rd, t1);
+    t0 = tcg_temp_new();
+    tcg_gen_addi_tl(t0, get_gpr(ctx, rs1), imm);
+    tcg_gen_qemu_ld_tl(dest_gpr(ctx, rd), t0, ctx->mem_idx,
+                       memop | ctx->misalign);
+    gen_hpm_count(ctx, RISCV_HPM_EVENT_LOAD);
     tcg_temp_free(t0);
-    tcg_temp_free(t1);
 }
 
 static void gen_store(DisasContext *ctx, uint32_t opc, int rs1, int rs2,
         target_long imm)
 {
-    TCGv t0 = tcg_temp_new();
-    TCGv dat = tcg_temp_new();
-    gen_get_gpr(t0, rs1);
-    tcg_gen_addi_tl(t0, t0, imm);
-    gen_get_gpr(dat, rs2);
     int memop = tcg_memop_lookup[(opc >> 12) & 0x7];
+    TCGv t0;
 
     if (memop < 0) {
         gen_exception_illegal(ctx);
         return;
     }
 
-    tcg_gen_qemu_st_tl(dat, t0, ctx->mem_idx, memop);
+    t0 = tcg_temp_new();
+    tcg_gen_addi_tl(t0, get_gpr(ctx, rs1), imm);
+    tcg_gen_qemu_st_tl(get_gpr(ctx, rs2), t0, ctx->mem_idx,
+                       memop | ctx->misalign);
+    gen_hpm_count(ctx, RISCV_HPM_EVENT_STORE);
     tcg_temp_free(t0);
-    tcg_temp_free(dat);
+}
+
+/*
+ * Instructions that write the f registers or fflags set mstatus.FS to
+ * dirty.  FS at the start of the TB is known from its flags, so only the
+ * first of them in a TB emits the store, and none does in a TB that starts
+ * dirty.  TBs are straight-line code, later ones are looked up with the
+ * flags after the store.  Off was rejected at translation time by then.
+ */
+static void mark_fs_dirty(DisasContext *ctx)
+{
+#ifndef CONFIG_USER_ONLY
+    TCGv t;
+
+    if (ctx->mstatus_fs == MSTATUS_FS) {
+        return;
+    }
+    ctx->mstatus_fs = MSTATUS_FS;
+    t = tcg_temp_new();
+    tcg_gen_ld_tl(t, cpu_env, offsetof(CPURISCVState, mstatus));
+    tcg_gen_ori_tl(t, t, MSTATUS_FS | MSTATUS_SD);
+    tcg_gen_st_tl(t, cpu_env, offsetof(CPURISCVState, mstatus));
+    tcg_temp_free(t);
+#endif
 }
 
 static void gen_fp_load(DisasContext *ctx, uint32_t opc, int rd,
@@ -660,6 +819,7 @@ static void gen_fp_load(DisasContext *ctx, uint32_t opc, int rd,
         gen_exception_illegal(ctx);
         return;
     }
+    mark_fs_dirty(ctx);
 
     t0 = tcg_temp_new();
     gen_get_gpr(t0, rs1);
@@ -667,17 +827,20 @@ static void gen_fp_load(DisasContext *ctx, uint32_t opc, int rd,
 
     switch (opc) {
     case OPC_RISC_FLW:
-        tcg_gen_qemu_ld_i64(cpu_fpr[rd], t0, ctx->mem_idx, MO_TEUL);
+        tcg_gen_qemu_ld_i64(cpu_fpr[rd], t0, ctx->mem_idx,
+                            MO_TEUL | ctx->misalign);
         /* RISC-V requires NaN-boxing of narrower width floating point values */
         tcg_gen_ori_i64(cpu_fpr[rd], cpu_fpr[rd], 0xffffffff00000000ULL);
         break;
     case OPC_RISC_FLD:
-        tcg_gen_qemu_ld_i64(cpu_fpr[rd], t0, ctx->mem_idx, MO_TEQ);
+        tcg_gen_qemu_ld_i64(cpu_fpr[rd], t0, ctx->mem_idx,
+                            MO_TEQ | ctx->misalign);
         break;
     default:
         gen_exception_illegal(ctx);
         break;
     }
+    gen_hpm_count(ctx, RISCV_HPM_EVENT_LOAD);
     tcg_temp_free(t0);
 }
 
@@ -697,48 +860,32 @@ static void gen_fp_store(DisasContext *ctx, uint32_t opc, int rs1,
 
     switch (opc) {
     case OPC_RISC_FSW:
-        tcg_gen_qemu_st_i64(cpu_fpr[rs2], t0, ctx->mem_idx, MO_TEUL);
+        tcg_gen_qemu_st_i64(cpu_fpr[rs2], t0, ctx->mem_idx,
+                            MO_TEUL | ctx->misalign);
         break;
     case OPC_RISC_FSD:
-        tcg_gen_qemu_st_i64(cpu_fpr[rs2], t0, ctx->mem_idx, MO_TEQ);
+        tcg_gen_qemu_st_i64(cpu_fpr[rs2], t0, ctx->mem_idx,
+                            MO_TEQ | ctx->misalign);
         break;
     default:
         gen_exception_illegal(ctx);
         break;
     }
+    gen_hpm_count(ctx, RISCV_HPM_EVENT_STORE);
 
     tcg_temp_free(t0);
 }
 
-static void gen_atomic(DisasContext *ctx, uint32_t opc,
-                      int rd, int rs1, int rs2)
+static void gen_atomic(DisasContext *ctx, uint32_t opc, int rd, int rs1,
+                       int rs2, bool aq, bool rl, TCGMemOp mop)
 {
     TCGv src1, src2, dat;
     TCGLabel *l1, *l2;
-    TCGMemOp mop;
-    bool aq, rl;
-
-    /* Extract the size of the atomic operation.  */
-    switch (extract32(opc, 12, 3)) {
-    case 2: /* 32-bit */
-        mop = MO_ALIGN | MO_TESL;
-        break;
-#if defined(TARGET_RISCV64)
-    case 3: /* 64-bit */
-        mop = MO_ALIGN | MO_TEQ;
-        break;
-#endif
-    default:
-        gen_exception_illegal(ctx);
-        return;
-    }
-    rl = extract32(opc, 25, 1);
-    aq = extract32(opc, 26, 1);
 
     src1 = tcg_temp_new();
     src2 = tcg_temp_new();
 
-    switch (MASK_OP_ATOMIC_NO_AQ_RL_SZ(opc)) {
+    switch (opc) {
     case OPC_RISC_LR:
         /* Put addr in load_res, data in load_val.  */
         gen_get_gpr(src1, rs1);
@@ -778,6 +925,8 @@ static void gen_atomic(DisasContext *ctx, uint32_t opc,
         gen_set_gpr(rd, dat);
 
         gen_set_label(l2);
+        /* SC always clears the reservation, whether it succeeded or not */
+        tcg_gen_movi_tl(load_res, RISCV_RESERVATION_INVALID);
         tcg_temp_free(dat);
         break;
 
@@ -847,22 +996,47 @@ static void gen_atomic(DisasContext *ctx, uint32_t opc,
     tcg_temp_free(src2);
 }
 
+/* softfloat rounding modes for the rm field, -1 for reserved encodings */
+static const int8_t riscv_softfloat_rm[8] = {
+    [0] = float_round_nearest_even,
+    [1] = float_round_to_zero,
+    [2] = float_round_down,
+    [3] = float_round_up,
+    [4] = float_round_ties_away,
+    [5 ... 7] = -1,
+};
+
 static void gen_set_rm(DisasContext *ctx, int rm)
 {
     TCGv_i32 t0;
 
+    if (rm == 7) {
+        /* dynamic rounding mode, frm is part of the TB flags */
+        rm = (ctx->flags & TB_FLAGS_FRM_MASK) >> TB_FLAGS_FRM_SHIFT;
+    }
     if (ctx->frm == rm) {
         return;
     }
+    if (riscv_softfloat_rm[rm] < 0) {
+        gen_exception_illegal(ctx);
+        return;
+    }
     ctx->frm = rm;
-    t0 = tcg_const_i32(rm);
-    gen_helper_set_rounding_mode(cpu_env, t0);
+    t0 = tcg_const_i32(riscv_softfloat_rm[rm]);
+    tcg_gen_st8_i32(t0, cpu_env,
+                    offsetof(CPURISCVState, fp_status.float_rounding_mode));
     tcg_temp_free_i32(t0);
 }
 
 static void gen_fp_fmadd(DisasContext *ctx, uint32_t opc, int rd,
                          int rs1, int rs2, int rs3, int rm)
 {
+    if (!(ctx->flags & TB_FLAGS_FP_ENABLE)) {
+        gen_exception_illegal(ctx);
+        return;
+    }
+    mark_fs_dirty(ctx);
+
     switch (opc) {
     case OPC_RISC_FMADD_S:
         gen_set_rm(ctx, rm);
@@ -883,6 +1057,12 @@ static void gen_fp_fmadd(DisasContext *ctx, uint32_t opc, int rd,
 static void gen_fp_fmsub(DisasContext *ctx, uint32_t opc, int rd,
                          int rs1, int rs2, int rs3, int rm)
 {
+    if (!(ctx->flags & TB_FLAGS_FP_ENABLE)) {
+        gen_exception_illegal(ctx);
+        return;
+    }
+    mark_fs_dirty(ctx);
+
     switch (opc) {
     case OPC_RISC_FMSUB_S:
         gen_set_rm(ctx, rm);
@@ -903,6 +1083,12 @@ static void gen_fp_fmsub(DisasContext *ctx, uint32_t opc, int rd,
 static void gen_fp_fnmsub(DisasContext *ctx, uint32_t opc, int rd,
                           int rs1, int rs2, int rs3, int rm)
 {
+    if (!(ctx->flags & TB_FLAGS_FP_ENABLE)) {
+        gen_exception_illegal(ctx);
+        return;
+    }
+    mark_fs_dirty(ctx);
+
     switch (opc) {
     case OPC_RISC_FNMSUB_S:
         gen_set_rm(ctx, rm);
@@ -923,6 +1109,12 @@ static void gen_fp_fnmsub(DisasContext *ctx, uint32_t opc, int rd,
 static void gen_fp_fnmadd(DisasContext *ctx, uint32_t opc, int rd,
                           int rs1, int rs2, int rs3, int rm)
 {
+    if (!(ctx->flags & TB_FLAGS_FP_ENABLE)) {
+        gen_exception_illegal(ctx);
+        return;
+    }
+    mark_fs_dirty(ctx);
+
     switch (opc) {
     case OPC_RISC_FNMADD_S:
         gen_set_rm(ctx, rm);
@@ -948,6 +1140,10 @@ static void gen_fp_arith(DisasContext *ctx, uint32_t opc, int rd,
     if (!(ctx->flags & TB_FLAGS_FP_ENABLE)) {
         goto do_illegal;
     }
+    /* fmv.x and fclass only read an f register */
+    if (opc != OPC_RISC_FMV_X_S && opc != OPC_RISC_FMV_X_D) {
+        mark_fs_dirty(ctx);
+    }
 
     switch (opc) {
     case OPC_RISC_FADD_S:
@@ -1273,114 +1469,176 @@ static void gen_fp_arith(DisasContext *ctx, uint32_t opc, int rd,
     }
 }
 
-static void gen_system(CPURISCVState *env, DisasContext *ctx, uint32_t opc,
-                      int rd, int rs1, int csr)
-{
-    TCGv source1, csr_store, dest, rs1_pass, imm_rs1;
-    source1 = tcg_temp_new();
-    csr_store = tcg_temp_new();
-    dest = tcg_temp_new();
-    rs1_pass = tcg_temp_new();
-    imm_rs1 = tcg_temp_new();
-    gen_get_gpr(source1, rs1);
-    tcg_gen_movi_tl(cpu_pc, ctx->base.pc_next);
-    tcg_gen_movi_tl(rs1_pass, rs1);
-    tcg_gen_movi_tl(csr_store, csr); /* copy into temp reg to feed to helper */
-
 #ifndef CONFIG_USER_ONLY
-    /* Extract funct7 value and check whether it matches SFENCE.VMA */
-    if ((opc == OPC_RISC_ECALL) && ((csr >> 5) == 9)) {
-        /* sfence.vma */
-        /* TODO: handle ASID specific fences */
-        gen_helper_tlb_flush(cpu_env);
-        return;
+static void gen_sfence_vma(CPURISCVState *env, DisasContext *ctx,
+                           int rs1, int rs2)
+{
+    TCGv vaddr = tcg_temp_new();
+    TCGv asid = tcg_temp_new();
+    TCGv_i32 flags;
+
+    gen_get_gpr(vaddr, rs1);
+    gen_get_gpr(asid, rs2);
+    flags = tcg_const_i32((rs1 ? SFENCE_VMA_VADDR : 0) |
+                          (rs2 ? SFENCE_VMA_ASID : 0));
+    gen_helper_sfence_vma(cpu_env, vaddr, asid, flags);
+    tcg_temp_free_i32(flags);
+    tcg_temp_free(vaddr);
+    tcg_temp_free(asid);
+
+    if (riscv_env_get_cpu(env)->cfg.sfence_broadcast) {
+        /* the local flush is queued as safe work, which only runs once we
+           leave the TB, so stop before the next instruction */
+        tcg_gen_movi_tl(cpu_pc, ctx->pc_succ_insn);
+        tcg_gen_exit_tb(NULL, 0);
+        ctx->base.is_jmp = DISAS_NORETURN;
     }
+}
 #endif
 
+/*
+ * Translate a CSR instruction on a RISCV_CSR_PLAIN register as a load and
+ * store of its env field.  The privilege, read-only and predicate checks
+ * are done at translation time, which is valid as long as predicates of
+ * plain CSRs only depend on the privilege level, mstatus.FS and mstatus.VS,
+ * all of which are part of the TB flags.  Plain CSRs without RISCV_CSR_NO_EXIT
+ * are part of the TB flags themselves, so the TB ends after a write.
+ * Returns false if the access has to go through a helper.
+ */
+static bool gen_csr_inline(CPURISCVState *env, DisasContext *ctx,
+                           uint32_t opc, int rd, int rs1, int csr)
+{
+    const riscv_csr_operations *ops = riscv_get_csr_ops(csr);
+    bool write;
+    TCGv old, val;
+
+    if (!ops || !(ops->flags & RISCV_CSR_PLAIN)) {
+        return false;
+    }
     switch (opc) {
-    case OPC_RISC_ECALL:
-        switch (csr) {
-        case 0x0: /* ECALL */
-            /* always generates U-level ECALL, fixed in do_interrupt handler */
-            generate_exception(ctx, RISCV_EXCP_U_ECALL);
-            tcg_gen_exit_tb(NULL, 0); /* no chaining */
-            ctx->base.is_jmp = DISAS_NORETURN;
-            break;
-        case 0x1: /* EBREAK */
-            generate_exception(ctx, RISCV_EXCP_BREAKPOINT);
-            tcg_gen_exit_tb(NULL, 0); /* no chaining */
-            ctx->base.is_jmp = DISAS_NORETURN;
-            break;
-#ifndef CONFIG_USER_ONLY
-        case 0x002: /* URET */
-            gen_exception_illegal(ctx);
-            break;
-        case 0x102: /* SRET */
-            if (riscv_has_ext(env, RVS)) {
-                gen_helper_sret(cpu_pc, cpu_env, cpu_pc);
-                tcg_gen_exit_tb(NULL, 0); /* no chaining */
-                ctx->base.is_jmp = DISAS_NORETURN;
-            } else {
-                gen_exception_illegal(ctx);
-            }
-            break;
-        case 0x202: /* HRET */
-            gen_exception_illegal(ctx);
-            break;
-        case 0x302: /* MRET */
-            gen_helper_mret(cpu_pc, cpu_env, cpu_pc);
-            tcg_gen_exit_tb(NULL, 0); /* no chaining */
-            ctx->base.is_jmp = DISAS_NORETURN;
-            break;
-        case 0x7b2: /* DRET */
-            gen_exception_illegal(ctx);
-            break;
-        case 0x105: /* WFI */
-            tcg_gen_movi_tl(cpu_pc, ctx->pc_succ_insn);
-            gen_helper_wfi(cpu_env);
-            break;
-        case 0x104: /* SFENCE.VM */
-            gen_helper_tlb_flush(cpu_env);
-            break;
-#endif
-        default:
-            gen_exception_illegal(ctx);
-            break;
-        }
+    case OPC_RISC_CSRRW:
+    case OPC_RISC_CSRRWI:
+        write = true;
+        break;
+    case OPC_RISC_CSRRS:
+    case OPC_RISC_CSRRC:
+    case OPC_RISC_CSRRSI:
+    case OPC_RISC_CSRRCI:
+        write = rs1 != 0;
         break;
     default:
-        tcg_gen_movi_tl(imm_rs1, rs1);
-        gen_io_start();
+        return false;
+    }
+#ifndef CONFIG_USER_ONLY
+    if ((ctx->mem_idx & MMU_PRIV_MASK) < get_field(csr, 0x300) ||
+        (write && get_field(csr, 0xC00) == 3)) {
+        return false;
+    }
+#endif
+    if ((write && !ops->write) || ops->predicate(env, csr) < 0) {
+        return false;
+    }
+
+    old = tcg_temp_new();
+    tcg_gen_ld_tl(old, cpu_env, ops->offset);
+    if (write) {
+        val = tcg_temp_new();
         switch (opc) {
         case OPC_RISC_CSRRW:
-            gen_helper_csrrw(dest, cpu_env, source1, csr_store);
+            gen_get_gpr(val, rs1);
             break;
         case OPC_RISC_CSRRS:
-            gen_helper_csrrs(dest, cpu_env, source1, csr_store, rs1_pass);
+            gen_get_gpr(val, rs1);
+            tcg_gen_or_tl(val, old, val);
             break;
         case OPC_RISC_CSRRC:
-            gen_helper_csrrc(dest, cpu_env, source1, csr_store, rs1_pass);
+            gen_get_gpr(val, rs1);
+            tcg_gen_andc_tl(val, old, val);
             break;
         case OPC_RISC_CSRRWI:
-            gen_helper_csrrw(dest, cpu_env, imm_rs1, csr_store);
+            tcg_gen_movi_tl(val, rs1);
             break;
         case OPC_RISC_CSRRSI:
-            gen_helper_csrrs(dest, cpu_env, imm_rs1, csr_store, rs1_pass);
+            tcg_gen_ori_tl(val, old, rs1);
             break;
         case OPC_RISC_CSRRCI:
-            gen_helper_csrrc(dest, cpu_env, imm_rs1, csr_store, rs1_pass);
+            tcg_gen_andi_tl(val, old, ~(target_ulong)rs1);
             break;
-        default:
-            gen_exception_illegal(ctx);
-            return;
         }
+        tcg_gen_andi_tl(val, val, ops->wmask);
+        tcg_gen_st_tl(val, cpu_env, ops->offset);
+        tcg_temp_free(val);
+        if (csr >= CSR_FFLAGS && csr <= CSR_FCSR) {
+            mark_fs_dirty(ctx);
+        }
+    }
+    gen_set_gpr(rd, old);
+    tcg_temp_free(old);
+    if (write && !(ops->flags & RISCV_CSR_NO_EXIT)) {
+        /* the CSR is part of the TB flags, continue in a TB built for it */
+        tcg_gen_movi_tl(cpu_pc, ctx->pc_succ_insn);
+        lookup_and_goto_ptr(ctx);
+        ctx->base.is_jmp = DISAS_NORETURN;
+    }
+    return true;
+}
+
+static void gen_csr(DisasContext *ctx, uint32_t opc, int rd, int rs1, int csr)
+{
+    CPURISCVState *env = ctx->env;
+    TCGv source1, csr_store, dest, rs1_pass, imm_rs1;
+    const riscv_csr_operations *csr_ops;
+    bool no_exit;
+
+    if (gen_csr_inline(env, ctx, opc, rd, rs1, csr)) {
+        return;
+    }
+
+    source1 = tcg_temp_new();
+    csr_store = tcg_temp_new();
+    dest = tcg_temp_new();
+    rs1_pass = tcg_temp_new();
+    imm_rs1 = tcg_temp_new();
+    gen_get_gpr(source1, rs1);
+    tcg_gen_movi_tl(cpu_pc, ctx->base.pc_next);
+    tcg_gen_movi_tl(rs1_pass, rs1);
+    tcg_gen_movi_tl(csr_store, csr); /* copy into temp reg to feed to helper */
+    tcg_gen_movi_tl(imm_rs1, rs1);
+
+    csr_ops = riscv_get_csr_ops(csr);
+    no_exit = csr_ops && (csr_ops->flags & RISCV_CSR_NO_EXIT);
+    if (!no_exit) {
+        gen_io_start();
+    }
+    switch (opc) {
+    case OPC_RISC_CSRRW:
+        gen_helper_csrrw(dest, cpu_env, source1, csr_store);
+        break;
+    case OPC_RISC_CSRRS:
+        gen_helper_csrrs(dest, cpu_env, source1, csr_store, rs1_pass);
+        break;
+    case OPC_RISC_CSRRC:
+        gen_helper_csrrc(dest, cpu_env, source1, csr_store, rs1_pass);
+        break;
+    case OPC_RISC_CSRRWI:
+        gen_helper_csrrw(dest, cpu_env, imm_rs1, csr_store);
+        break;
+    case OPC_RISC_CSRRSI:
+        gen_helper_csrrs(dest, cpu_env, imm_rs1, csr_store, rs1_pass);
+        break;
+    case OPC_RISC_CSRRCI:
+        gen_helper_csrrc(dest, cpu_env, imm_rs1, csr_store, rs1_pass);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+    gen_set_gpr(rd, dest);
+    if (!no_exit) {
         gen_io_end();
-        gen_set_gpr(rd, dest);
         /* end tb since we may be changing priv modes, to get mmu_index right */
         tcg_gen_movi_tl(cpu_pc, ctx->pc_succ_insn);
         tcg_gen_exit_tb(NULL, 0); /* no chaining */
         ctx->base.is_jmp = DISAS_NORETURN;
-        break;
     }
     tcg_temp_free(source1);
     tcg_temp_free(csr_store);
@@ -1389,419 +1647,308 @@ static void gen_system(CPURISCVState *env, DisasContext *ctx, uint32_t opc,
     tcg_temp_free(imm_rs1);
 }
 
-static void decode_RV32_64C0(DisasContext *ctx)
+#ifdef TARGET_RISCV64
+#define REQUIRE_64BIT(ctx) do { } while (0)
+#else
+#define REQUIRE_64BIT(ctx) return false
+#endif
+
+/* Include the auto-generated decoder for 32 bit insn */
+static int ex_shift_1(int imm)
+{
+    return imm << 1;
+}
+
+static int ex_shift_12(int imm)
+{
+    return imm << 12;
+}
+
+bool decode_insn32(DisasContext *ctx, uint32_t insn);
+#include "decode_insn32.inc.c"
+#include "insn_trans/trans_privileged.inc.c"
+#include "insn_trans/trans_rvh.inc.c"
+#include "insn_trans/trans_rvi.inc.c"
+#include "insn_trans/trans_rvm.inc.c"
+#include "insn_trans/trans_rva.inc.c"
+#include "insn_trans/trans_rvf.inc.c"
+#include "insn_trans/trans_rvd.inc.c"
+#include "insn_trans/trans_rvb.inc.c"
+#include "insn_trans/trans_rvv.inc.c"
+
+/*
+ * Compressed instructions are translated by expanding them into the
+ * equivalent 32-bit encoding and running that through decode_insn32.
+ * The expansion only depends on the parcel itself and on XLEN, so it is
+ * done once for all 2^16 parcels when TCG is initialised.  Zero marks the
+ * reserved encodings, every valid expansion has its two low bits set.
+ */
+static uint32_t rvc_expand_table[1 << 16];
+
+static uint32_t rvc_r(uint32_t opc, int rd, int rs1, int rs2)
+{
+    return opc | (rd << 7) | (rs1 << 15) | (rs2 << 20);
+}
+
+static uint32_t rvc_i(uint32_t opc, int rd, int rs1, target_long imm)
+{
+    return opc | (rd << 7) | (rs1 << 15) | (extract32(imm, 0, 12) << 20);
+}
+
+static uint32_t rvc_s(uint32_t opc, int rs1, int rs2, target_long imm)
 {
-    uint8_t funct3 = extract32(ctx->opcode, 13, 3);
-    uint8_t rd_rs2 = GET_C_RS2S(ctx->opcode);
-    uint8_t rs1s = GET_C_RS1S(ctx->opcode);
+    return opc | (extract32(imm, 0, 5) << 7) | (rs1 << 15) | (rs2 << 20) |
+           (extract32(imm, 5, 7) << 25);
+}
+
+static uint32_t rvc_b(uint32_t opc, int rs1, int rs2, target_long imm)
+{
+    return opc | (extract32(imm, 11, 1) << 7) | (extract32(imm, 1, 4) << 8) |
+           (rs1 << 15) | (rs2 << 20) | (extract32(imm, 5, 6) << 25) |
+           (extract32(imm, 12, 1) << 31);
+}
 
-    switch (funct3) {
+static uint32_t rvc_j(uint32_t opc, int rd, target_long imm)
+{
+    return opc | (rd << 7) | (extract32(imm, 12, 8) << 12) |
+           (extract32(imm, 11, 1) << 20) | (extract32(imm, 1, 10) << 21) |
+           (extract32(imm, 20, 1) << 31);
+}
+
+static uint32_t rvc_expand_q0(uint32_t insn)
+{
+    int rd_rs2 = GET_C_RS2S(insn);
+    int rs1s = GET_C_RS1S(insn);
+
+    switch (extract32(insn, 13, 3)) {
     case 0:
-        /* illegal */
-        if (ctx->opcode == 0) {
-            gen_exception_illegal(ctx);
-        } else {
-            /* C.ADDI4SPN -> addi rd', x2, zimm[9:2]*/
-            gen_arith_imm(ctx, OPC_RISC_ADDI, rd_rs2, 2,
-                          GET_C_ADDI4SPN_IMM(ctx->opcode));
+        /* C.ADDI4SPN -> addi rd', x2, zimm[9:2], zimm == 0 is reserved */
+        if (GET_C_ADDI4SPN_IMM(insn) == 0) {
+            return 0;
         }
-        break;
+        return rvc_i(OPC_RISC_ADDI, rd_rs2, 2, GET_C_ADDI4SPN_IMM(insn));
     case 1:
         /* C.FLD -> fld rd', offset[7:3](rs1')*/
-        gen_fp_load(ctx, OPC_RISC_FLD, rd_rs2, rs1s,
-                    GET_C_LD_IMM(ctx->opcode));
-        /* C.LQ(RV128) */
-        break;
+        return rvc_i(OPC_RISC_FLD, rd_rs2, rs1s, GET_C_LD_IMM(insn));
     case 2:
         /* C.LW -> lw rd', offset[6:2](rs1') */
-        gen_load(ctx, OPC_RISC_LW, rd_rs2, rs1s,
-                 GET_C_LW_IMM(ctx->opcode));
-        break;
+        return rvc_i(OPC_RISC_LW, rd_rs2, rs1s, GET_C_LW_IMM(insn));
     case 3:
 #if defined(TARGET_RISCV64)
         /* C.LD(RV64/128) -> ld rd', offset[7:3](rs1')*/
-        gen_load(ctx, OPC_RISC_LD, rd_rs2, rs1s,
-                 GET_C_LD_IMM(ctx->opcode));
+        return rvc_i(OPC_RISC_LD, rd_rs2, rs1s, GET_C_LD_IMM(insn));
 #else
         /* C.FLW (RV32) -> flw rd', offset[6:2](rs1')*/
-        gen_fp_load(ctx, OPC_RISC_FLW, rd_rs2, rs1s,
-                    GET_C_LW_IMM(ctx->opcode));
+        return rvc_i(OPC_RISC_FLW, rd_rs2, rs1s, GET_C_LW_IMM(insn));
 #endif
-        break;
-    case 4:
-        /* reserved */
-        gen_exception_illegal(ctx);
-        break;
     case 5:
         /* C.FSD(RV32/64) -> fsd rs2', offset[7:3](rs1') */
-        gen_fp_store(ctx, OPC_RISC_FSD, rs1s, rd_rs2,
-                     GET_C_LD_IMM(ctx->opcode));
-        /* C.SQ (RV128) */
-        break;
+        return rvc_s(OPC_RISC_FSD, rs1s, rd_rs2, GET_C_LD_IMM(insn));
     case 6:
         /* C.SW -> sw rs2', offset[6:2](rs1')*/
-        gen_store(ctx, OPC_RISC_SW, rs1s, rd_rs2,
-                  GET_C_LW_IMM(ctx->opcode));
-        break;
+        return rvc_s(OPC_RISC_SW, rs1s, rd_rs2, GET_C_LW_IMM(insn));
     case 7:
 #if defined(TARGET_RISCV64)
         /* C.SD (RV64/128) -> sd rs2', offset[7:3](rs1')*/
-        gen_store(ctx, OPC_RISC_SD, rs1s, rd_rs2,
-                  GET_C_LD_IMM(ctx->opcode));
+        return rvc_s(OPC_RISC_SD, rs1s, rd_rs2, GET_C_LD_IMM(insn));
 #else
         /* C.FSW (RV32) -> fsw rs2', offset[6:2](rs1')*/
-        gen_fp_store(ctx, OPC_RISC_FSW, rs1s, rd_rs2,
-                     GET_C_LW_IMM(ctx->opcode));
+        return rvc_s(OPC_RISC_FSW, rs1s, rd_rs2, GET_C_LW_IMM(insn));
 #endif
-        break;
+    default:
+        /* reserved */
+        return 0;
     }
 }
 
-static void decode_RV32_64C1(CPURISCVState *env, DisasContext *ctx)
+static uint32_t rvc_expand_q1(uint32_t insn)
 {
-    uint8_t funct3 = extract32(ctx->opcode, 13, 3);
-    uint8_t rd_rs1 = GET_C_RS1(ctx->opcode);
-    uint8_t rs1s, rs2s;
-    uint8_t funct2;
+    int rd_rs1 = GET_C_RS1(insn);
+    int rs1s = GET_C_RS1S(insn);
+    int rs2s = GET_C_RS2S(insn);
 
-    switch (funct3) {
+    switch (extract32(insn, 13, 3)) {
     case 0:
         /* C.ADDI -> addi rd, rd, nzimm[5:0] */
-        gen_arith_imm(ctx, OPC_RISC_ADDI, rd_rs1, rd_rs1,
-                      GET_C_IMM(ctx->opcode));
-        break;
+        return rvc_i(OPC_RISC_ADDI, rd_rs1, rd_rs1, GET_C_IMM(insn));
     case 1:
 #if defined(TARGET_RISCV64)
         /* C.ADDIW (RV64/128) -> addiw rd, rd, imm[5:0]*/
-        gen_arith_imm(ctx, OPC_RISC_ADDIW, rd_rs1, rd_rs1,
-                      GET_C_IMM(ctx->opcode));
+        if (rd_rs1 == 0) {
+            return 0;
+        }
+        return rvc_i(OPC_RISC_ADDIW, rd_rs1, rd_rs1, GET_C_IMM(insn));
 #else
         /* C.JAL(RV32) -> jal x1, offset[11:1] */
-        gen_jal(env, ctx, 1, GET_C_J_IMM(ctx->opcode));
+        return rvc_j(OPC_RISC_JAL, 1, GET_C_J_IMM(insn));
 #endif
-        break;
     case 2:
         /* C.LI -> addi rd, x0, imm[5:0]*/
-        gen_arith_imm(ctx, OPC_RISC_ADDI, rd_rs1, 0, GET_C_IMM(ctx->opcode));
-        break;
+        return rvc_i(OPC_RISC_ADDI, rd_rs1, 0, GET_C_IMM(insn));
     case 3:
+        if (GET_C_IMM(insn) == 0) {
+            return 0;
+        }
         if (rd_rs1 == 2) {
             /* C.ADDI16SP -> addi x2, x2, nzimm[9:4]*/
-            gen_arith_imm(ctx, OPC_RISC_ADDI, 2, 2,
-                          GET_C_ADDI16SP_IMM(ctx->opcode));
-        } else if (rd_rs1 != 0) {
-            /* C.LUI (rs1/rd =/= {0,2}) -> lui rd, nzimm[17:12]*/
-            tcg_gen_movi_tl(cpu_gpr[rd_rs1],
-                            GET_C_IMM(ctx->opcode) << 12);
+            return rvc_i(OPC_RISC_ADDI, 2, 2, GET_C_ADDI16SP_IMM(insn));
         }
-        break;
+        /* C.LUI (rs1/rd =/= {0,2}) -> lui rd, nzimm[17:12]*/
+        return OPC_RISC_LUI | (rd_rs1 << 7) |
+               (extract32(GET_C_IMM(insn), 0, 20) << 12);
     case 4:
-        funct2 = extract32(ctx->opcode, 10, 2);
-        rs1s = GET_C_RS1S(ctx->opcode);
-        switch (funct2) {
-        case 0: /* C.SRLI(RV32) -> srli rd', rd', shamt[5:0] */
-            gen_arith_imm(ctx, OPC_RISC_SHIFT_RIGHT_I, rs1s, rs1s,
-                               GET_C_ZIMM(ctx->opcode));
-            /* C.SRLI64(RV128) */
-            break;
+        switch (extract32(insn, 10, 2)) {
+        case 0:
+            /* C.SRLI -> srli rd', rd', shamt[5:0] */
+            return rvc_i(OPC_RISC_SHIFT_RIGHT_I, rs1s, rs1s, GET_C_ZIMM(insn));
         case 1:
             /* C.SRAI -> srai rd', rd', shamt[5:0]*/
-            gen_arith_imm(ctx, OPC_RISC_SHIFT_RIGHT_I, rs1s, rs1s,
-                            GET_C_ZIMM(ctx->opcode) | 0x400);
-            /* C.SRAI64(RV128) */
-            break;
+            return rvc_i(OPC_RISC_SHIFT_RIGHT_I, rs1s, rs1s,
+                         GET_C_ZIMM(insn) | 0x400);
         case 2:
             /* C.ANDI -> andi rd', rd', imm[5:0]*/
-            gen_arith_imm(ctx, OPC_RISC_ANDI, rs1s, rs1s,
-                          GET_C_IMM(ctx->opcode));
-            break;
+            return rvc_i(OPC_RISC_ANDI, rs1s, rs1s, GET_C_IMM(insn));
+        }
+        switch (extract32(insn, 5, 2) | (extract32(insn, 12, 1) << 2)) {
+        case 0:
+            /* C.SUB -> sub rd', rd', rs2' */
+            return rvc_r(OPC_RISC_SUB, rs1s, rs1s, rs2s);
+        case 1:
+            /* C.XOR -> xor rs1', rs1', rs2' */
+            return rvc_r(OPC_RISC_XOR, rs1s, rs1s, rs2s);
+        case 2:
+            /* C.OR -> or rs1', rs1', rs2' */
+            return rvc_r(OPC_RISC_OR, rs1s, rs1s, rs2s);
         case 3:
-            funct2 = extract32(ctx->opcode, 5, 2);
-            rs2s = GET_C_RS2S(ctx->opcode);
-            switch (funct2) {
-            case 0:
-                /* C.SUB -> sub rd', rd', rs2' */
-                if (extract32(ctx->opcode, 12, 1) == 0) {
-                    gen_arith(ctx, OPC_RISC_SUB, rs1s, rs1s, rs2s);
-                }
+            /* C.AND -> and rs1', rs1', rs2' */
+            return rvc_r(OPC_RISC_AND, rs1s, rs1s, rs2s);
 #if defined(TARGET_RISCV64)
-                else {
-                    gen_arith(ctx, OPC_RISC_SUBW, rs1s, rs1s, rs2s);
-                }
+        case 4:
+            /* C.SUBW (RV64/128) -> subw rs1', rs1', rs2' */
+            return rvc_r(OPC_RISC_SUBW, rs1s, rs1s, rs2s);
+        case 5:
+            /* C.ADDW (RV64/128) -> addw rs1', rs1', rs2' */
+            return rvc_r(OPC_RISC_ADDW, rs1s, rs1s, rs2s);
 #endif
-                break;
-            case 1:
-                /* C.XOR -> xor rs1', rs1', rs2' */
-                if (extract32(ctx->opcode, 12, 1) == 0) {
-                    gen_arith(ctx, OPC_RISC_XOR, rs1s, rs1s, rs2s);
-                }
-#if defined(TARGET_RISCV64)
-                else {
-                    /* C.ADDW (RV64/128) */
-                    gen_arith(ctx, OPC_RISC_ADDW, rs1s, rs1s, rs2s);
-                }
-#endif
-                break;
-            case 2:
-                /* C.OR -> or rs1', rs1', rs2' */
-                gen_arith(ctx, OPC_RISC_OR, rs1s, rs1s, rs2s);
-                break;
-            case 3:
-                /* C.AND -> and rs1', rs1', rs2' */
-                gen_arith(ctx, OPC_RISC_AND, rs1s, rs1s, rs2s);
-                break;
-            }
-            break;
+        default:
+            return 0;
         }
-        break;
     case 5:
         /* C.J -> jal x0, offset[11:1]*/
-        gen_jal(env, ctx, 0, GET_C_J_IMM(ctx->opcode));
-        break;
+        return rvc_j(OPC_RISC_JAL, 0, GET_C_J_IMM(insn));
     case 6:
         /* C.BEQZ -> beq rs1', x0, offset[8:1]*/
-        rs1s = GET_C_RS1S(ctx->opcode);
-        gen_branch(env, ctx, OPC_RISC_BEQ, rs1s, 0, GET_C_B_IMM(ctx->opcode));
-        break;
-    case 7:
+        return rvc_b(OPC_RISC_BEQ, rs1s, 0, GET_C_B_IMM(insn));
+    default:
         /* C.BNEZ -> bne rs1', x0, offset[8:1]*/
-        rs1s = GET_C_RS1S(ctx->opcode);
-        gen_branch(env, ctx, OPC_RISC_BNE, rs1s, 0, GET_C_B_IMM(ctx->opcode));
-        break;
+        return rvc_b(OPC_RISC_BNE, rs1s, 0, GET_C_B_IMM(insn));
     }
 }
 
-static void decode_RV32_64C2(CPURISCVState *env, DisasContext *ctx)
+static uint32_t rvc_expand_q2(uint32_t insn)
 {
-    uint8_t rd, rs2;
-    uint8_t funct3 = extract32(ctx->opcode, 13, 3);
-
+    int rd = GET_RD(insn);
+    int rs2 = GET_C_RS2(insn);
 
-    rd = GET_RD(ctx->opcode);
-
-    switch (funct3) {
-    case 0: /* C.SLLI -> slli rd, rd, shamt[5:0]
-               C.SLLI64 -> */
-        gen_arith_imm(ctx, OPC_RISC_SLLI, rd, rd, GET_C_ZIMM(ctx->opcode));
-        break;
-    case 1: /* C.FLDSP(RV32/64DC) -> fld rd, offset[8:3](x2) */
-        gen_fp_load(ctx, OPC_RISC_FLD, rd, 2, GET_C_LDSP_IMM(ctx->opcode));
-        break;
-    case 2: /* C.LWSP -> lw rd, offset[7:2](x2) */
-        gen_load(ctx, OPC_RISC_LW, rd, 2, GET_C_LWSP_IMM(ctx->opcode));
-        break;
+    switch (extract32(insn, 13, 3)) {
+    case 0:
+        /* C.SLLI -> slli rd, rd, shamt[5:0] */
+        return rvc_i(OPC_RISC_SLLI, rd, rd, GET_C_ZIMM(insn));
+    case 1:
+        /* C.FLDSP(RV32/64DC) -> fld rd, offset[8:3](x2) */
+        return rvc_i(OPC_RISC_FLD, rd, 2, GET_C_LDSP_IMM(insn));
+    case 2:
+        /* C.LWSP -> lw rd, offset[7:2](x2) */
+        if (rd == 0) {
+            return 0;
+        }
+        return rvc_i(OPC_RISC_LW, rd, 2, GET_C_LWSP_IMM(insn));
     case 3:
 #if defined(TARGET_RISCV64)
         /* C.LDSP(RVC64) -> ld rd, offset[8:3](x2) */
-        gen_load(ctx, OPC_RISC_LD, rd, 2, GET_C_LDSP_IMM(ctx->opcode));
+        if (rd == 0) {
+            return 0;
+        }
+        return rvc_i(OPC_RISC_LD, rd, 2, GET_C_LDSP_IMM(insn));
 #else
         /* C.FLWSP(RV32FC) -> flw rd, offset[7:2](x2) */
-        gen_fp_load(ctx, OPC_RISC_FLW, rd, 2, GET_C_LWSP_IMM(ctx->opcode));
+        return rvc_i(OPC_RISC_FLW, rd, 2, GET_C_LWSP_IMM(insn));
 #endif
-        break;
     case 4:
-        rs2 = GET_C_RS2(ctx->opcode);
-
-        if (extract32(ctx->opcode, 12, 1) == 0) {
-            if (rs2 == 0) {
-                /* C.JR -> jalr x0, rs1, 0*/
-                gen_jalr(env, ctx, OPC_RISC_JALR, 0, rd, 0);
-            } else {
+        if (extract32(insn, 12, 1) == 0) {
+            if (rs2 != 0) {
                 /* C.MV -> add rd, x0, rs2 */
-                gen_arith(ctx, OPC_RISC_ADD, rd, 0, rs2);
-            }
-        } else {
-            if (rd == 0) {
-                /* C.EBREAK -> ebreak*/
-                gen_system(env, ctx, OPC_RISC_ECALL, 0, 0, 0x1);
-            } else {
-                if (rs2 == 0) {
-                    /* C.JALR -> jalr x1, rs1, 0*/
-                    gen_jalr(env, ctx, OPC_RISC_JALR, 1, rd, 0);
-                } else {
-                    /* C.ADD -> add rd, rd, rs2 */
-                    gen_arith(ctx, OPC_RISC_ADD, rd, rd, rs2);
-                }
+                return rvc_r(OPC_RISC_ADD, rd, 0, rs2);
             }
+            /* C.JR -> jalr x0, rs1, 0*/
+            return rd ? rvc_i(OPC_RISC_JALR, 0, rd, 0) : 0;
         }
-        break;
+        if (rs2 != 0) {
+            /* C.ADD -> add rd, rd, rs2 */
+            return rvc_r(OPC_RISC_ADD, rd, rd, rs2);
+        }
+        if (rd == 0) {
+            /* C.EBREAK -> ebreak*/
+            return rvc_i(OPC_RISC_EBREAK, 0, 0, 1);
+        }
+        /* C.JALR -> jalr x1, rs1, 0*/
+        return rvc_i(OPC_RISC_JALR, 1, rd, 0);
     case 5:
         /* C.FSDSP -> fsd rs2, offset[8:3](x2)*/
-        gen_fp_store(ctx, OPC_RISC_FSD, 2, GET_C_RS2(ctx->opcode),
-                     GET_C_SDSP_IMM(ctx->opcode));
-        /* C.SQSP */
-        break;
-    case 6: /* C.SWSP -> sw rs2, offset[7:2](x2)*/
-        gen_store(ctx, OPC_RISC_SW, 2, GET_C_RS2(ctx->opcode),
-                  GET_C_SWSP_IMM(ctx->opcode));
-        break;
-    case 7:
+        return rvc_s(OPC_RISC_FSD, 2, rs2, GET_C_SDSP_IMM(insn));
+    case 6:
+        /* C.SWSP -> sw rs2, offset[7:2](x2)*/
+        return rvc_s(OPC_RISC_SW, 2, rs2, GET_C_SWSP_IMM(insn));
+    default:
 #if defined(TARGET_RISCV64)
         /* C.SDSP(Rv64/128) -> sd rs2, offset[8:3](x2)*/
-        gen_store(ctx, OPC_RISC_SD, 2, GET_C_RS2(ctx->opcode),
-                  GET_C_SDSP_IMM(ctx->opcode));
+        return rvc_s(OPC_RISC_SD, 2, rs2, GET_C_SDSP_IMM(insn));
 #else
         /* C.FSWSP(RV32) -> fsw rs2, offset[7:2](x2) */
-        gen_fp_store(ctx, OPC_RISC_FSW, 2, GET_C_RS2(ctx->opcode),
-                     GET_C_SWSP_IMM(ctx->opcode));
+        return rvc_s(OPC_RISC_FSW, 2, rs2, GET_C_SWSP_IMM(insn));
 #endif
-        break;
     }
 }
 
-static void decode_RV32_64C(CPURISCVState *env, DisasContext *ctx)
+static void rvc_expand_init(void)
 {
-    uint8_t op = extract32(ctx->opcode, 0, 2);
+    uint32_t insn;
 
-    switch (op) {
-    case 0:
-        decode_RV32_64C0(ctx);
-        break;
-    case 1:
-        decode_RV32_64C1(env, ctx);
-        break;
-    case 2:
-        decode_RV32_64C2(env, ctx);
-        break;
-    }
-}
-
-static void decode_RV32_64G(CPURISCVState *env, DisasContext *ctx)
-{
-    int rs1;
-    int rs2;
-    int rd;
-    uint32_t op;
-    target_long imm;
-
-    /* We do not do misaligned address check here: the address should never be
-     * misaligned at this point. Instructions that set PC must do the check,
-     * since epc must be the address of the instruction that caused us to
-     * perform the misaligned instruction fetch */
-
-    op = MASK_OP_MAJOR(ctx->opcode);
-    rs1 = GET_RS1(ctx->opcode);
-    rs2 = GET_RS2(ctx->opcode);
-    rd = GET_RD(ctx->opcode);
-    imm = GET_IMM(ctx->opcode);
-
-    switch (op) {
-    case OPC_RISC_LUI:
-        if (rd == 0) {
-            break; /* NOP */
-        }
-        tcg_gen_movi_tl(cpu_gpr[rd], sextract64(ctx->opcode, 12, 20) << 12);
-        break;
-    case OPC_RISC_AUIPC:
-        if (rd == 0) {
-            break; /* NOP */
-        }
-        tcg_gen_movi_tl(cpu_gpr[rd], (sextract64(ctx->opcode, 12, 20) << 12) +
-               ctx->base.pc_next);
-        break;
-    case OPC_RISC_JAL:
-        imm = GET_JAL_IMM(ctx->opcode);
-        gen_jal(env, ctx, rd, imm);
-        break;
-    case OPC_RISC_JALR:
-        gen_jalr(env, ctx, MASK_OP_JALR(ctx->opcode), rd, rs1, imm);
-        break;
-    case OPC_RISC_BRANCH:
-        gen_branch(env, ctx, MASK_OP_BRANCH(ctx->opcode), rs1, rs2,
-                   GET_B_IMM(ctx->opcode));
-        break;
-    case OPC_RISC_LOAD:
-        gen_load(ctx, MASK_OP_LOAD(ctx->opcode), rd, rs1, imm);
-        break;
-    case OPC_RISC_STORE:
-        gen_store(ctx, MASK_OP_STORE(ctx->opcode), rs1, rs2,
-                  GET_STORE_IMM(ctx->opcode));
-        break;
-    case OPC_RISC_ARITH_IMM:
-#if defined(TARGET_RISCV64)
-    case OPC_RISC_ARITH_IMM_W:
-#endif
-        if (rd == 0) {
-            break; /* NOP */
-        }
-        gen_arith_imm(ctx, MASK_OP_ARITH_IMM(ctx->opcode), rd, rs1, imm);
-        break;
-    case OPC_RISC_ARITH:
-#if defined(TARGET_RISCV64)
-    case OPC_RISC_ARITH_W:
-#endif
-        if (rd == 0) {
-            break; /* NOP */
-        }
-        gen_arith(ctx, MASK_OP_ARITH(ctx->opcode), rd, rs1, rs2);
-        break;
-    case OPC_RISC_FP_LOAD:
-        gen_fp_load(ctx, MASK_OP_FP_LOAD(ctx->opcode), rd, rs1, imm);
-        break;
-    case OPC_RISC_FP_STORE:
-        gen_fp_store(ctx, MASK_OP_FP_STORE(ctx->opcode), rs1, rs2,
-                     GET_STORE_IMM(ctx->opcode));
-        break;
-    case OPC_RISC_ATOMIC:
-        gen_atomic(ctx, MASK_OP_ATOMIC(ctx->opcode), rd, rs1, rs2);
-        break;
-    case OPC_RISC_FMADD:
-        gen_fp_fmadd(ctx, MASK_OP_FP_FMADD(ctx->opcode), rd, rs1, rs2,
-                     GET_RS3(ctx->opcode), GET_RM(ctx->opcode));
-        break;
-    case OPC_RISC_FMSUB:
-        gen_fp_fmsub(ctx, MASK_OP_FP_FMSUB(ctx->opcode), rd, rs1, rs2,
-                     GET_RS3(ctx->opcode), GET_RM(ctx->opcode));
-        break;
-    case OPC_RISC_FNMSUB:
-        gen_fp_fnmsub(ctx, MASK_OP_FP_FNMSUB(ctx->opcode), rd, rs1, rs2,
-                      GET_RS3(ctx->opcode), GET_RM(ctx->opcode));
-        break;
-    case OPC_RISC_FNMADD:
-        gen_fp_fnmadd(ctx, MASK_OP_FP_FNMADD(ctx->opcode), rd, rs1, rs2,
-                      GET_RS3(ctx->opcode), GET_RM(ctx->opcode));
-        break;
-    case OPC_RISC_FP_ARITH:
-        gen_fp_arith(ctx, MASK_OP_FP_ARITH(ctx->opcode), rd, rs1, rs2,
-                     GET_RM(ctx->opcode));
-        break;
-    case OPC_RISC_FENCE:
-#ifndef CONFIG_USER_ONLY
-        if (ctx->opcode & 0x1000) {
-            /* FENCE_I is a no-op in QEMU,
-             * however we need to end the translation block */
-            tcg_gen_movi_tl(cpu_pc, ctx->pc_succ_insn);
-            tcg_gen_exit_tb(NULL, 0);
-            ctx->base.is_jmp = DISAS_NORETURN;
-        } else {
-            /* FENCE is a full memory barrier. */
-            tcg_gen_mb(TCG_MO_ALL | TCG_BAR_SC);
+    for (insn = 0; insn < ARRAY_SIZE(rvc_expand_table); insn++) {
+        switch (extract32(insn, 0, 2)) {
+        case 0:
+            rvc_expand_table[insn] = rvc_expand_q0(insn);
+            break;
+        case 1:
+            rvc_expand_table[insn] = rvc_expand_q1(insn);
+            break;
+        case 2:
+            rvc_expand_table[insn] = rvc_expand_q2(insn);
+            break;
+        default:
+            /* not a compressed instruction */
+            break;
         }
-#endif
-        break;
-    case OPC_RISC_SYSTEM:
-        gen_system(env, ctx, MASK_OP_SYSTEM(ctx->opcode), rd, rs1,
-                   (ctx->opcode & 0xFFF00000) >> 20);
-        break;
-    default:
-        gen_exception_illegal(ctx);
-        break;
     }
 }
 
 static void decode_opc(CPURISCVState *env, DisasContext *ctx)
 {
+    uint32_t insn = ctx->opcode;
+
     /* check for compressed insn */
     if (extract32(ctx->opcode, 0, 2) != 3) {
         if (!riscv_has_ext(env, RVC)) {
             gen_exception_illegal(ctx);
-        } else {
-            ctx->pc_succ_insn = ctx->base.pc_next + 2;
-            decode_RV32_64C(env, ctx);
+            return;
         }
+        ctx->pc_succ_insn = ctx->base.pc_next + 2;
+        insn = rvc_expand_table[ctx->opcode];
     } else {
         ctx->pc_succ_insn = ctx->base.pc_next + 4;
-        decode_RV32_64G(env, ctx);
+    }
+    if (!insn || !decode_insn32(ctx, insn)) {
+        gen_exception_illegal(ctx);
     }
 }
 
@@ -1809,21 +1956,59 @@ static void riscv_tr_init_disas_context(DisasContextBase *dcbase, CPUState *cs)
 {
     DisasContext *ctx = container_of(dcbase, DisasContext, base);
 
+    ctx->env = cs->env_ptr;
     ctx->pc_succ_insn = ctx->base.pc_first;
     ctx->flags = ctx->base.tb->flags;
-    ctx->mem_idx = ctx->base.tb->flags & TB_FLAGS_MMU_MASK;
+    ctx->virt = ctx->flags & TB_FLAGS_VIRT;
+    ctx->mem_idx = (ctx->flags & TB_FLAGS_MMU_MASK) |
+                   (ctx->virt ? MMU_VIRT_IDX : 0);
     ctx->frm = -1;  /* unknown rounding mode */
+    ctx->mstatus_fs = ctx->flags & TB_FLAGS_FP_ENABLE;
+    ctx->superblocks = tcg_superblocks && !ctx->base.singlestep_enabled;
+    ctx->zero = NULL;
+    ctx->sink = NULL;
+    ctx->insn_count_op = NULL;
+    ctx->vlen = RISCV_CPU(cs)->cfg.vlen;
+    ctx->misalign = RISCV_CPU(cs)->cfg.misaligned_trap ? MO_ALIGN : MO_UNALN;
+    ctx->vill = ctx->flags & TB_FLAGS_VILL;
+    ctx->sew = extract32(ctx->flags, TB_FLAGS_SEW_SHIFT, 2);
+    ctx->lmul = sextract32(ctx->flags, TB_FLAGS_LMUL_SHIFT, 3);
+    ctx->vl_eq_vlmax = ctx->flags & TB_FLAGS_VL_EQ_VLMAX;
 }
 
 static void riscv_tr_tb_start(DisasContextBase *db, CPUState *cpu)
 {
+    DisasContext *ctx = container_of(db, DisasContext, base);
+    TCGv_i32 n;
+    TCGv_i64 t, count;
+
+    if (!(ctx->flags & TB_FLAGS_INSN_COUNT)) {
+        return;
+    }
+
+    /* Count the whole TB on entry.  The insn count is patched in at
+       tb_stop; instructions that do not complete are subtracted again
+       by gen_uncount_insn or, for faults in helpers and memory accesses,
+       by restore_state_to_opc.  */
+    n = tcg_temp_new_i32();
+    t = tcg_temp_new_i64();
+    count = tcg_temp_new_i64();
+    tcg_gen_movi_i32(n, 0);
+    ctx->insn_count_op = tcg_last_op();
+    tcg_gen_extu_i32_i64(t, n);
+    tcg_gen_ld_i64(count, cpu_env, offsetof(CPURISCVState, instret));
+    tcg_gen_add_i64(count, count, t);
+    tcg_gen_st_i64(count, cpu_env, offsetof(CPURISCVState, instret));
+    tcg_temp_free_i64(count);
+    tcg_temp_free_i64(t);
+    tcg_temp_free_i32(n);
 }
 
 static void riscv_tr_insn_start(DisasContextBase *dcbase, CPUState *cpu)
 {
     DisasContext *ctx = container_of(dcbase, DisasContext, base);
 
-    tcg_gen_insn_start(ctx->base.pc_next);
+    tcg_gen_insn_start(ctx->base.pc_next, ctx->base.num_insns - 1);
 }
 
 static bool riscv_tr_breakpoint_check(DisasContextBase *dcbase, CPUState *cpu,
@@ -1831,6 +2016,7 @@ static bool riscv_tr_breakpoint_check(DisasContextBase *dcbase, CPUState *cpu,
 {
     DisasContext *ctx = container_of(dcbase, DisasContext, base);
 
+    gen_uncount_insn(ctx);
     tcg_gen_movi_tl(cpu_pc, ctx->base.pc_next);
     ctx->base.is_jmp = DISAS_NORETURN;
     gen_exception_debug();
@@ -1848,9 +2034,35 @@ static void riscv_tr_translate_insn(DisasContextBase *dcbase, CPUState *cpu)
     DisasContext *ctx = container_of(dcbase, DisasContext, base);
     CPURISCVState *env = cpu->env_ptr;
 
-    ctx->opcode = cpu_ldl_code(env, ctx->base.pc_next);
+    /* only fetch the second parcel if there is one, it may be on the
+       next page */
+    ctx->opcode = cpu_lduw_code(env, ctx->base.pc_next);
+    if (extract32(ctx->opcode, 0, 2) == 3) {
+        ctx->opcode |= cpu_lduw_code(env, ctx->base.pc_next + 2) << 16;
+    }
+    /* Instruction log for comparing against other models, e.g. with the
+     * binary simple trace backend.  Together with riscv_reg_write and the
+     * generic guest_mem_before_exec event it records retired PCs, register
+     * writes and memory accesses; all three are only instrumented in TBs
+     * translated while they are enabled.  */
+    if (trace_event_get_state_backends(TRACE_RISCV_INSN_EXEC)) {
+        TCGv pc = tcg_const_tl(ctx->base.pc_next);
+        TCGv_i32 insn = tcg_const_i32(ctx->opcode);
+
+        gen_helper_trace_insn(cpu_env, pc, insn);
+        tcg_temp_free(pc);
+        tcg_temp_free_i32(insn);
+    }
     decode_opc(env, ctx);
     ctx->base.pc_next = ctx->pc_succ_insn;
+    if (ctx->zero) {
+        tcg_temp_free(ctx->zero);
+        ctx->zero = NULL;
+    }
+    if (ctx->sink) {
+        tcg_temp_free(ctx->sink);
+        ctx->sink = NULL;
+    }
 
     if (ctx->base.is_jmp == DISAS_NEXT) {
         target_ulong page_start;
@@ -1866,14 +2078,14 @@ static void riscv_tr_tb_stop(DisasContextBase *dcbase, CPUState *cpu)
 {
     DisasContext *ctx = container_of(dcbase, DisasContext, base);
 
+    if (ctx->insn_count_op) {
+        tcg_set_insn_param(ctx->insn_count_op, 1, ctx->base.num_insns);
+    }
+
     switch (ctx->base.is_jmp) {
     case DISAS_TOO_MANY:
         tcg_gen_movi_tl(cpu_pc, ctx->base.pc_next);
-        if (ctx->base.singlestep_enabled) {
-            gen_exception_debug();
-        } else {
-            tcg_gen_exit_tb(NULL, 0);
-        }
+        lookup_and_goto_ptr(ctx);
         break;
     case DISAS_NORETURN:
         break;
@@ -1929,4 +2141,6 @@ void riscv_translate_init(void)
                              "load_res");
     load_val = tcg_global_mem_new(cpu_env, offsetof(CPURISCVState, load_val),
                              "load_val");
+
+    rvc_expand_init();
 }
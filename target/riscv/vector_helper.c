@@ -0,0 +1,1084 @@
+/*
+ * RISC-V Vector Extension Helpers for QEMU.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms and conditions of the GNU General Public License,
+ * version 2 or later, as published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "cpu.h"
+#include "qemu/host-utils.h"
+#include "exec/exec-all.h"
+#include "exec/cpu_ldst.h"
+#include "exec/helper-proto.h"
+#include "tcg/tcg-gvec-desc.h"
+
+/*
+ * Vector registers are arrays of uint64_t in host order, element i of
+ * SEW bits is at bits [i * SEW, (i + 1) * SEW) of the register group.
+ * On a big-endian host, the index of a smaller element within its
+ * uint64_t is swapped.
+ */
+#ifdef HOST_WORDS_BIGENDIAN
+#define H1(x)   ((x) ^ 7)
+#define H2(x)   ((x) ^ 3)
+#define H4(x)   ((x) ^ 1)
+#else
+#define H1(x)   (x)
+#define H2(x)   (x)
+#define H4(x)   (x)
+#endif
+#define H8(x)   (x)
+
+static inline uint32_t vext_vm(uint32_t desc)
+{
+    return simd_data(desc) & VDATA_VM;
+}
+
+static inline uint32_t vext_nreg(uint32_t desc)
+{
+    return simd_data(desc) >> VDATA_NREG_SHIFT;
+}
+
+/* mask bit i of a mask register is bit i of the register */
+static inline int vext_elem_mask(void *v0, uint32_t index)
+{
+    return (((uint64_t *)v0)[index / 64] >> (index % 64)) & 1;
+}
+
+static inline void vext_set_elem_mask(void *vd, uint32_t index, int value)
+{
+    uint64_t *word = (uint64_t *)vd + index / 64;
+
+    *word = deposit64(*word, index % 64, 1, value);
+}
+
+static inline bool vext_active(void *v0, uint32_t vm, uint32_t index)
+{
+    return vm || vext_elem_mask(v0, index);
+}
+
+/* Configuration */
+
+target_ulong HELPER(vsetvl)(CPURISCVState *env, target_ulong s1,
+                            target_ulong s2)
+{
+    RISCVCPU *cpu = riscv_env_get_cpu(env);
+    int vlmul = sextract32(s2, 0, 3);
+    int vsew = extract32(s2, 3, 3);
+    uint32_t vlmax;
+
+    /* reserved LMUL and vtype bits, SEW above ELEN * LMUL for LMUL < 1 */
+    if (vlmul == -4 || vsew > 3 + MIN(vlmul, 0) || (s2 >> 8) != 0) {
+        env->vtype = VTYPE_VILL;
+        env->vl = 0;
+        env->vstart = 0;
+        return 0;
+    }
+    vlmax = vext_get_vlmax(cpu, s2);
+    env->vtype = s2;
+    env->vl = MIN(s1, vlmax);
+    env->vstart = 0;
+    return env->vl;
+}
+
+/* Loads and Stores */
+
+typedef void vext_ldst_elem_fn(CPURISCVState *env, target_ulong addr,
+                               uint32_t idx, void *vd, uintptr_t ra);
+
+#define GEN_VEXT_LD_ELEM(NAME, ETYPE, H, LDSUF)                         \
+static void NAME(CPURISCVState *env, target_ulong addr,                 \
+                 uint32_t idx, void *vd, uintptr_t ra)                  \
+{                                                                       \
+    *((ETYPE *)vd + H(idx)) = cpu_##LDSUF##_data_ra(env, addr, ra);     \
+}
+
+GEN_VEXT_LD_ELEM(lde_b, uint8_t, H1, ldub)
+GEN_VEXT_LD_ELEM(lde_h, uint16_t, H2, lduw)
+GEN_VEXT_LD_ELEM(lde_w, uint32_t, H4, ldl)
+GEN_VEXT_LD_ELEM(lde_d, uint64_t, H8, ldq)
+
+#define GEN_VEXT_ST_ELEM(NAME, ETYPE, H, STSUF)                         \
+static void NAME(CPURISCVState *env, target_ulong addr,                 \
+                 uint32_t idx, void *vd, uintptr_t ra)                  \
+{                                                                       \
+    cpu_##STSUF##_data_ra(env, addr, *((ETYPE *)vd + H(idx)), ra);      \
+}
+
+GEN_VEXT_ST_ELEM(ste_b, uint8_t, H1, stb)
+GEN_VEXT_ST_ELEM(ste_h, uint16_t, H2, stw)
+GEN_VEXT_ST_ELEM(ste_w, uint32_t, H4, stl)
+GEN_VEXT_ST_ELEM(ste_d, uint64_t, H8, stq)
+
+/*
+ * Elements from vstart to evl, one at a time.  vstart tracks the element
+ * being accessed, so that the instruction restarts there after a fault.
+ */
+static void vext_ldst_stride(void *vd, void *v0, target_ulong base,
+                             target_ulong stride, CPURISCVState *env,
+                             uint32_t vm, uint32_t evl,
+                             vext_ldst_elem_fn *ldst_elem, uintptr_t ra)
+{
+    uint32_t i;
+
+    for (i = env->vstart; i < evl; i++) {
+        if (vext_active(v0, vm, i)) {
+            env->vstart = i;
+            ldst_elem(env, base + stride * i, i, vd, ra);
+        }
+    }
+    env->vstart = 0;
+}
+
+/*
+ * An unmasked unit-stride access within a page that the TLB maps to host
+ * memory is a single copy, as the register group has the layout of the
+ * memory on a little-endian host.  Returns false if the access has to go
+ * element by element.
+ */
+static bool vext_ldst_host(void *vd, target_ulong base, CPURISCVState *env,
+                           uint32_t evl, uint32_t esz, int access_type)
+{
+#if !defined(CONFIG_USER_ONLY) && !defined(HOST_WORDS_BIGENDIAN)
+    uint32_t start = env->vstart * esz;
+    target_ulong addr = base + start;
+    uint32_t len;
+    void *host;
+
+    if (env->vstart >= evl) {
+        env->vstart = 0;
+        return true;
+    }
+    len = evl * esz - start;
+    if ((addr ^ (addr + len - 1)) & TARGET_PAGE_MASK) {
+        return false;
+    }
+    host = tlb_vaddr_to_host(env, addr, access_type,
+                             cpu_mmu_index(env, false));
+    if (!host) {
+        return false;
+    }
+    if (access_type == MMU_DATA_LOAD) {
+        memcpy((uint8_t *)vd + start, host, len);
+    } else {
+        memcpy(host, (uint8_t *)vd + start, len);
+    }
+    env->vstart = 0;
+    return true;
+#else
+    return false;
+#endif
+}
+
+static void vext_ldst_us(void *vd, void *v0, target_ulong base,
+                         CPURISCVState *env, uint32_t vm, uint32_t evl,
+                         uint32_t esz, vext_ldst_elem_fn *ldst_elem,
+                         int access_type, uintptr_t ra)
+{
+    if (vm && vext_ldst_host(vd, base, env, evl, esz, access_type)) {
+        return;
+    }
+    vext_ldst_stride(vd, v0, base, esz, env, vm, evl, ldst_elem, ra);
+}
+
+#define GEN_VEXT_LD_US(NAME, ETYPE, LD_FN)                              \
+void HELPER(NAME)(void *vd, void *v0, target_ulong base,                \
+                  CPURISCVState *env, uint32_t desc)                    \
+{                                                                       \
+    vext_ldst_us(vd, v0, base, env, vext_vm(desc), env->vl,             \
+                 sizeof(ETYPE), LD_FN, MMU_DATA_LOAD, GETPC());         \
+}
+
+GEN_VEXT_LD_US(vle8_v, uint8_t, lde_b)
+GEN_VEXT_LD_US(vle16_v, uint16_t, lde_h)
+GEN_VEXT_LD_US(vle32_v, uint32_t, lde_w)
+GEN_VEXT_LD_US(vle64_v, uint64_t, lde_d)
+
+#define GEN_VEXT_ST_US(NAME, ETYPE, ST_FN)                              \
+void HELPER(NAME)(void *vd, void *v0, target_ulong base,                \
+                  CPURISCVState *env, uint32_t desc)                    \
+{                                                                       \
+    vext_ldst_us(vd, v0, base, env, vext_vm(desc), env->vl,             \
+                 sizeof(ETYPE), ST_FN, MMU_DATA_STORE, GETPC());        \
+}
+
+GEN_VEXT_ST_US(vse8_v, uint8_t, ste_b)
+GEN_VEXT_ST_US(vse16_v, uint16_t, ste_h)
+GEN_VEXT_ST_US(vse32_v, uint32_t, ste_w)
+GEN_VEXT_ST_US(vse64_v, uint64_t, ste_d)
+
+void HELPER(vlm_v)(void *vd, void *v0, target_ulong base,
+                   CPURISCVState *env, uint32_t desc)
+{
+    vext_ldst_us(vd, v0, base, env, 1, DIV_ROUND_UP(env->vl, 8), 1,
+                 lde_b, MMU_DATA_LOAD, GETPC());
+}
+
+void HELPER(vsm_v)(void *vd, void *v0, target_ulong base,
+                   CPURISCVState *env, uint32_t desc)
+{
+    vext_ldst_us(vd, v0, base, env, 1, DIV_ROUND_UP(env->vl, 8), 1,
+                 ste_b, MMU_DATA_STORE, GETPC());
+}
+
+/* whole register accesses, evl covers the registers in the descriptor */
+#define GEN_VEXT_LD_WHOLE(NAME, ETYPE, LD_FN)                           \
+void HELPER(NAME)(void *vd, void *v0, target_ulong base,                \
+                  CPURISCVState *env, uint32_t desc)                    \
+{                                                                       \
+    uint32_t evl = vext_nreg(desc) * simd_maxsz(desc) / sizeof(ETYPE);  \
+                                                                        \
+    vext_ldst_us(vd, v0, base, env, 1, evl, sizeof(ETYPE), LD_FN,       \
+                 MMU_DATA_LOAD, GETPC());                               \
+}
+
+GEN_VEXT_LD_WHOLE(vlre8_v, uint8_t, lde_b)
+GEN_VEXT_LD_WHOLE(vlre16_v, uint16_t, lde_h)
+GEN_VEXT_LD_WHOLE(vlre32_v, uint32_t, lde_w)
+GEN_VEXT_LD_WHOLE(vlre64_v, uint64_t, lde_d)
+
+void HELPER(vsr_v)(void *vd, void *v0, target_ulong base,
+                   CPURISCVState *env, uint32_t desc)
+{
+    uint32_t evl = vext_nreg(desc) * simd_maxsz(desc);
+
+    vext_ldst_us(vd, v0, base, env, 1, evl, 1, ste_b, MMU_DATA_STORE,
+                 GETPC());
+}
+
+#define GEN_VEXT_LDST_STRIDE(NAME, LD_FN)                                 \
+void HELPER(NAME)(void *vd, void *v0, target_ulong base,                \
+                  target_ulong stride, CPURISCVState *env,              \
+                  uint32_t desc)                                        \
+{                                                                       \
+    vext_ldst_stride(vd, v0, base, stride, env, vext_vm(desc),          \
+                     env->vl, LD_FN, GETPC());                          \
+}
+
+GEN_VEXT_LDST_STRIDE(vlse8_v, lde_b)
+GEN_VEXT_LDST_STRIDE(vlse16_v, lde_h)
+GEN_VEXT_LDST_STRIDE(vlse32_v, lde_w)
+GEN_VEXT_LDST_STRIDE(vlse64_v, lde_d)
+GEN_VEXT_LDST_STRIDE(vsse8_v, ste_b)
+GEN_VEXT_LDST_STRIDE(vsse16_v, ste_h)
+GEN_VEXT_LDST_STRIDE(vsse32_v, ste_w)
+GEN_VEXT_LDST_STRIDE(vsse64_v, ste_d)
+
+/* Integer Arithmetic */
+
+/*
+ * N is the element of vs2, M the one of vs1 or the scalar, D the one of
+ * vd.  Products are computed in uint64_t, promoting narrow unsigned
+ * types to int would overflow.
+ */
+#define DO_ADD(N, M)    ((N) + (M))
+#define DO_SUB(N, M)    ((N) - (M))
+#define DO_RSUB(N, M)   ((M) - (N))
+#define DO_AND(N, M)    ((N) & (M))
+#define DO_OR(N, M)     ((N) | (M))
+#define DO_XOR(N, M)    ((N) ^ (M))
+#define DO_MIN(N, M)    ((N) <= (M) ? (N) : (M))
+#define DO_MAX(N, M)    ((N) >= (M) ? (N) : (M))
+#define DO_SLL(N, M)    ((N) << ((M) & (sizeof(N) * 8 - 1)))
+#define DO_SRL(N, M)    ((N) >> ((M) & (sizeof(N) * 8 - 1)))
+#define DO_MUL(N, M)    ((N) * (uint64_t)(M))
+#define DO_MACC(N, M, D)  ((M) * (uint64_t)(N) + (D))
+#define DO_NMSAC(N, M, D) ((D) - (M) * (uint64_t)(N))
+#define DO_MADD(N, M, D)  ((M) * (uint64_t)(D) + (N))
+#define DO_NMSUB(N, M, D) ((N) - (M) * (uint64_t)(D))
+
+/* division by zero and overflow have results instead of traps */
+#define DO_SMIN_OF(N)   ((__typeof(N))(1ULL << (sizeof(N) * 8 - 1)))
+#define DO_DIVU(N, M)   (unlikely((M) == 0) ? (__typeof(N))-1 : (N) / (M))
+#define DO_REMU(N, M)   (unlikely((M) == 0) ? (N) : (N) % (M))
+#define DO_DIV(N, M)    (unlikely((M) == 0) ? (__typeof(N))-1 :            \
+                         unlikely((N) == DO_SMIN_OF(N) && (M) == -1) ?     \
+                         (N) : (N) / (M))
+#define DO_REM(N, M)    (unlikely((M) == 0) ? (N) :                        \
+                         unlikely((N) == DO_SMIN_OF(N) && (M) == -1) ?     \
+                         0 : (N) % (M))
+
+static int8_t do_mulh_b(int8_t n, int8_t m)
+{
+    return ((int32_t)n * m) >> 8;
+}
+
+static int16_t do_mulh_h(int16_t n, int16_t m)
+{
+    return ((int32_t)n * m) >> 16;
+}
+
+static int32_t do_mulh_w(int32_t n, int32_t m)
+{
+    return ((int64_t)n * m) >> 32;
+}
+
+static int64_t do_mulh_d(int64_t n, int64_t m)
+{
+    uint64_t lo, hi;
+
+    muls64(&lo, &hi, n, m);
+    return hi;
+}
+
+static uint8_t do_mulhu_b(uint8_t n, uint8_t m)
+{
+    return ((uint32_t)n * m) >> 8;
+}
+
+static uint16_t do_mulhu_h(uint16_t n, uint16_t m)
+{
+    return ((uint32_t)n * m) >> 16;
+}
+
+static uint32_t do_mulhu_w(uint32_t n, uint32_t m)
+{
+    return ((uint64_t)n * m) >> 32;
+}
+
+static uint64_t do_mulhu_d(uint64_t n, uint64_t m)
+{
+    uint64_t lo, hi;
+
+    mulu64(&lo, &hi, n, m);
+    return hi;
+}
+
+/* vs2 is signed, vs1 unsigned */
+static int8_t do_mulhsu_b(int8_t n, uint8_t m)
+{
+    return ((int32_t)n * m) >> 8;
+}
+
+static int16_t do_mulhsu_h(int16_t n, uint16_t m)
+{
+    return ((int64_t)n * m) >> 16;
+}
+
+static int32_t do_mulhsu_w(int32_t n, uint32_t m)
+{
+    return ((int64_t)n * m) >> 32;
+}
+
+static int64_t do_mulhsu_d(int64_t n, uint64_t m)
+{
+    uint64_t lo, hi;
+
+    mulu64(&lo, &hi, n, m);
+    if (n < 0) {
+        hi -= m;
+    }
+    return hi;
+}
+
+/* vd[i] = OP(vs2[i], vs1[i]) */
+#define GEN_VEXT_VV(NAME, ETYPE, H, OP)                                 \
+void HELPER(NAME)(void *vd, void *v0, void *vs1, void *vs2,             \
+                  CPURISCVState *env, uint32_t desc)                    \
+{                                                                       \
+    uint32_t vm = vext_vm(desc);                                        \
+    uint32_t i;                                                         \
+                                                                        \
+    for (i = env->vstart; i < env->vl; i++) {                           \
+        if (vext_active(v0, vm, i)) {                                   \
+            ETYPE s1 = *((ETYPE *)vs1 + H(i));                          \
+            ETYPE s2 = *((ETYPE *)vs2 + H(i));                          \
+            *((ETYPE *)vd + H(i)) = OP(s2, s1);                         \
+        }                                                               \
+    }                                                                   \
+    env->vstart = 0;                                                    \
+}
+
+/* vd[i] = OP(vs2[i], x), x is sign-extended from XLEN to SEW */
+#define GEN_VEXT_VX(NAME, ETYPE, H, OP)                                 \
+void HELPER(NAME)(void *vd, void *v0, target_ulong s1, void *vs2,       \
+                  CPURISCVState *env, uint32_t desc)                    \
+{                                                                       \
+    uint32_t vm = vext_vm(desc);                                        \
+    ETYPE x = (ETYPE)(target_long)s1;                                   \
+    uint32_t i;                                                         \
+                                                                        \
+    for (i = env->vstart; i < env->vl; i++) {                           \
+        if (vext_active(v0, vm, i)) {                                   \
+            ETYPE s2 = *((ETYPE *)vs2 + H(i));                          \
+            *((ETYPE *)vd + H(i)) = OP(s2, x);                          \
+        }                                                               \
+    }                                                                   \
+    env->vstart = 0;                                                    \
+}
+
+/* vd[i] = OP(vs2[i], vs1[i], vd[i]) */
+#define GEN_VEXT_VV3(NAME, ETYPE, H, OP)                                \
+void HELPER(NAME)(void *vd, void *v0, void *vs1, void *vs2,             \
+                  CPURISCVState *env, uint32_t desc)                    \
+{                                                                       \
+    uint32_t vm = vext_vm(desc);                                        \
+    uint32_t i;                                                         \
+                                                                        \
+    for (i = env->vstart; i < env->vl; i++) {                           \
+        if (vext_active(v0, vm, i)) {                                   \
+            ETYPE s1 = *((ETYPE *)vs1 + H(i));                          \
+            ETYPE s2 = *((ETYPE *)vs2 + H(i));                          \
+            ETYPE d = *((ETYPE *)vd + H(i));                            \
+            *((ETYPE *)vd + H(i)) = OP(s2, s1, d);                      \
+        }                                                               \
+    }                                                                   \
+    env->vstart = 0;                                                    \
+}
+
+#define GEN_VEXT_VX3(NAME, ETYPE, H, OP)                                \
+void HELPER(NAME)(void *vd, void *v0, target_ulong s1, void *vs2,       \
+                  CPURISCVState *env, uint32_t desc)                    \
+{                                                                       \
+    uint32_t vm = vext_vm(desc);                                        \
+    ETYPE x = (ETYPE)(target_long)s1;                                   \
+    uint32_t i;                                                         \
+                                                                        \
+    for (i = env->vstart; i < env->vl; i++) {                           \
+        if (vext_active(v0, vm, i)) {                                   \
+            ETYPE s2 = *((ETYPE *)vs2 + H(i));                          \
+            ETYPE d = *((ETYPE *)vd + H(i));                            \
+            *((ETYPE *)vd + H(i)) = OP(s2, x, d);                       \
+        }                                                               \
+    }                                                                   \
+    env->vstart = 0;                                                    \
+}
+
+#define GEN_VEXT_U(GEN, NAME, OP)                                       \
+    GEN(NAME##_b, uint8_t, H1, OP)                                      \
+    GEN(NAME##_h, uint16_t, H2, OP)                                     \
+    GEN(NAME##_w, uint32_t, H4, OP)                                     \
+    GEN(NAME##_d, uint64_t, H8, OP)
+
+#define GEN_VEXT_S(GEN, NAME, OP)                                       \
+    GEN(NAME##_b, int8_t, H1, OP)                                       \
+    GEN(NAME##_h, int16_t, H2, OP)                                      \
+    GEN(NAME##_w, int32_t, H4, OP)                                      \
+    GEN(NAME##_d, int64_t, H8, OP)
+
+#define GEN_VEXT_SIZED(GEN, NAME, ET, OP)                               \
+    GEN(NAME##_b, ET##8_t, H1, OP##_b)                                  \
+    GEN(NAME##_h, ET##16_t, H2, OP##_h)                                 \
+    GEN(NAME##_w, ET##32_t, H4, OP##_w)                                 \
+    GEN(NAME##_d, ET##64_t, H8, OP##_d)
+
+GEN_VEXT_U(GEN_VEXT_VV, vadd_vv, DO_ADD)
+GEN_VEXT_U(GEN_VEXT_VX, vadd_vx, DO_ADD)
+GEN_VEXT_U(GEN_VEXT_VV, vsub_vv, DO_SUB)
+GEN_VEXT_U(GEN_VEXT_VX, vsub_vx, DO_SUB)
+GEN_VEXT_U(GEN_VEXT_VX, vrsub_vx, DO_RSUB)
+GEN_VEXT_U(GEN_VEXT_VV, vminu_vv, DO_MIN)
+GEN_VEXT_U(GEN_VEXT_VX, vminu_vx, DO_MIN)
+GEN_VEXT_S(GEN_VEXT_VV, vmin_vv, DO_MIN)
+GEN_VEXT_S(GEN_VEXT_VX, vmin_vx, DO_MIN)
+GEN_VEXT_U(GEN_VEXT_VV, vmaxu_vv, DO_MAX)
+GEN_VEXT_U(GEN_VEXT_VX, vmaxu_vx, DO_MAX)
+GEN_VEXT_S(GEN_VEXT_VV, vmax_vv, DO_MAX)
+GEN_VEXT_S(GEN_VEXT_VX, vmax_vx, DO_MAX)
+GEN_VEXT_U(GEN_VEXT_VV, vand_vv, DO_AND)
+GEN_VEXT_U(GEN_VEXT_VX, vand_vx, DO_AND)
+GEN_VEXT_U(GEN_VEXT_VV, vor_vv, DO_OR)
+GEN_VEXT_U(GEN_VEXT_VX, vor_vx, DO_OR)
+GEN_VEXT_U(GEN_VEXT_VV, vxor_vv, DO_XOR)
+GEN_VEXT_U(GEN_VEXT_VX, vxor_vx, DO_XOR)
+GEN_VEXT_U(GEN_VEXT_VV, vsll_vv, DO_SLL)
+GEN_VEXT_U(GEN_VEXT_VX, vsll_vx, DO_SLL)
+GEN_VEXT_U(GEN_VEXT_VV, vsrl_vv, DO_SRL)
+GEN_VEXT_U(GEN_VEXT_VX, vsrl_vx, DO_SRL)
+GEN_VEXT_S(GEN_VEXT_VV, vsra_vv, DO_SRL)
+GEN_VEXT_S(GEN_VEXT_VX, vsra_vx, DO_SRL)
+GEN_VEXT_U(GEN_VEXT_VV, vmul_vv, DO_MUL)
+GEN_VEXT_U(GEN_VEXT_VX, vmul_vx, DO_MUL)
+GEN_VEXT_SIZED(GEN_VEXT_VV, vmulh_vv, int, do_mulh)
+GEN_VEXT_SIZED(GEN_VEXT_VX, vmulh_vx, int, do_mulh)
+GEN_VEXT_SIZED(GEN_VEXT_VV, vmulhu_vv, uint, do_mulhu)
+GEN_VEXT_SIZED(GEN_VEXT_VX, vmulhu_vx, uint, do_mulhu)
+GEN_VEXT_SIZED(GEN_VEXT_VV, vmulhsu_vv, int, do_mulhsu)
+GEN_VEXT_SIZED(GEN_VEXT_VX, vmulhsu_vx, int, do_mulhsu)
+GEN_VEXT_U(GEN_VEXT_VV, vdivu_vv, DO_DIVU)
+GEN_VEXT_U(GEN_VEXT_VX, vdivu_vx, DO_DIVU)
+GEN_VEXT_S(GEN_VEXT_VV, vdiv_vv, DO_DIV)
+GEN_VEXT_S(GEN_VEXT_VX, vdiv_vx, DO_DIV)
+GEN_VEXT_U(GEN_VEXT_VV, vremu_vv, DO_REMU)
+GEN_VEXT_U(GEN_VEXT_VX, vremu_vx, DO_REMU)
+GEN_VEXT_S(GEN_VEXT_VV, vrem_vv, DO_REM)
+GEN_VEXT_S(GEN_VEXT_VX, vrem_vx, DO_REM)
+GEN_VEXT_U(GEN_VEXT_VV3, vmacc_vv, DO_MACC)
+GEN_VEXT_U(GEN_VEXT_VX3, vmacc_vx, DO_MACC)
+GEN_VEXT_U(GEN_VEXT_VV3, vnmsac_vv, DO_NMSAC)
+GEN_VEXT_U(GEN_VEXT_VX3, vnmsac_vx, DO_NMSAC)
+GEN_VEXT_U(GEN_VEXT_VV3, vmadd_vv, DO_MADD)
+GEN_VEXT_U(GEN_VEXT_VX3, vmadd_vx, DO_MADD)
+GEN_VEXT_U(GEN_VEXT_VV3, vnmsub_vv, DO_NMSUB)
+GEN_VEXT_U(GEN_VEXT_VX3, vnmsub_vx, DO_NMSUB)
+
+/*
+ * vmerge takes vs1 or x where the mask is set and vs2 elsewhere; its
+ * unmasked form is vmv.v.*, which does not read vs2.
+ */
+#define GEN_VEXT_VMERGE_VV(NAME, ETYPE, H, UNUSED)                      \
+void HELPER(NAME)(void *vd, void *v0, void *vs1, void *vs2,             \
+                  CPURISCVState *env, uint32_t desc)                    \
+{                                                                       \
+    uint32_t vm = vext_vm(desc);                                        \
+    uint32_t i;                                                         \
+                                                                        \
+    for (i = env->vstart; i < env->vl; i++) {                           \
+        ETYPE *src = vext_active(v0, vm, i) ? vs1 : vs2;                \
+        *((ETYPE *)vd + H(i)) = *(src + H(i));                          \
+    }                                                                   \
+    env->vstart = 0;                                                    \
+}
+
+#define GEN_VEXT_VMERGE_VX(NAME, ETYPE, H, UNUSED)                      \
+void HELPER(NAME)(void *vd, void *v0, target_ulong s1, void *vs2,       \
+                  CPURISCVState *env, uint32_t desc)                    \
+{                                                                       \
+    uint32_t vm = vext_vm(desc);                                        \
+    ETYPE x = (ETYPE)(target_long)s1;                                   \
+    uint32_t i;                                                         \
+                                                                        \
+    for (i = env->vstart; i < env->vl; i++) {                           \
+        *((ETYPE *)vd + H(i)) = vext_active(v0, vm, i) ? x :            \
+                                *((ETYPE *)vs2 + H(i));                 \
+    }                                                                   \
+    env->vstart = 0;                                                    \
+}
+
+GEN_VEXT_U(GEN_VEXT_VMERGE_VV, vmerge_vvm, 0)
+GEN_VEXT_U(GEN_VEXT_VMERGE_VX, vmerge_vxm, 0)
+
+/* Integer Compares, the result is a mask */
+
+#define DO_MSEQ(N, M)   ((N) == (M))
+#define DO_MSNE(N, M)   ((N) != (M))
+#define DO_MSLT(N, M)   ((N) < (M))
+#define DO_MSLE(N, M)   ((N) <= (M))
+#define DO_MSGT(N, M)   ((N) > (M))
+
+/*
+ * Writing bit i of vd does not change elements j > i of a source that
+ * vd overlaps, as they are at byte offsets of at least j.
+ */
+#define GEN_VEXT_CMP_VV(NAME, ETYPE, H, OP)                             \
+void HELPER(NAME)(void *vd, void *v0, void *vs1, void *vs2,             \
+                  CPURISCVState *env, uint32_t desc)                    \
+{                                                                       \
+    uint32_t vm = vext_vm(desc);                                        \
+    uint32_t i;                                                         \
+                                                                        \
+    for (i = env->vstart; i < env->vl; i++) {                           \
+        if (vext_active(v0, vm, i)) {                                   \
+            ETYPE s1 = *((ETYPE *)vs1 + H(i));                          \
+            ETYPE s2 = *((ETYPE *)vs2 + H(i));                          \
+            vext_set_elem_mask(vd, i, OP(s2, s1));                      \
+        }                                                               \
+    }                                                                   \
+    env->vstart = 0;                                                    \
+}
+
+#define GEN_VEXT_CMP_VX(NAME, ETYPE, H, OP)                             \
+void HELPER(NAME)(void *vd, void *v0, target_ulong s1, void *vs2,       \
+                  CPURISCVState *env, uint32_t desc)                    \
+{                                                                       \
+    uint32_t vm = vext_vm(desc);                                        \
+    ETYPE x = (ETYPE)(target_long)s1;                                   \
+    uint32_t i;                                                         \
+                                                                        \
+    for (i = env->vstart; i < env->vl; i++) {                           \
+        if (vext_active(v0, vm, i)) {                                   \
+            ETYPE s2 = *((ETYPE *)vs2 + H(i));                          \
+            vext_set_elem_mask(vd, i, OP(s2, x));                       \
+        }                                                               \
+    }                                                                   \
+    env->vstart = 0;                                                    \
+}
+
+GEN_VEXT_U(GEN_VEXT_CMP_VV, vmseq_vv, DO_MSEQ)
+GEN_VEXT_U(GEN_VEXT_CMP_VX, vmseq_vx, DO_MSEQ)
+GEN_VEXT_U(GEN_VEXT_CMP_VV, vmsne_vv, DO_MSNE)
+GEN_VEXT_U(GEN_VEXT_CMP_VX, vmsne_vx, DO_MSNE)
+GEN_VEXT_U(GEN_VEXT_CMP_VV, vmsltu_vv, DO_MSLT)
+GEN_VEXT_U(GEN_VEXT_CMP_VX, vmsltu_vx, DO_MSLT)
+GEN_VEXT_S(GEN_VEXT_CMP_VV, vmslt_vv, DO_MSLT)
+GEN_VEXT_S(GEN_VEXT_CMP_VX, vmslt_vx, DO_MSLT)
+GEN_VEXT_U(GEN_VEXT_CMP_VV, vmsleu_vv, DO_MSLE)
+GEN_VEXT_U(GEN_VEXT_CMP_VX, vmsleu_vx, DO_MSLE)
+GEN_VEXT_S(GEN_VEXT_CMP_VV, vmsle_vv, DO_MSLE)
+GEN_VEXT_S(GEN_VEXT_CMP_VX, vmsle_vx, DO_MSLE)
+GEN_VEXT_U(GEN_VEXT_CMP_VX, vmsgtu_vx, DO_MSGT)
+GEN_VEXT_S(GEN_VEXT_CMP_VX, vmsgt_vx, DO_MSGT)
+
+/* Integer Reductions, vd[0] = OP(vs1[0], vs2[*]) */
+
+#define GEN_VEXT_RED(NAME, ETYPE, H, OP)                                \
+void HELPER(NAME)(void *vd, void *v0, void *vs1, void *vs2,             \
+                  CPURISCVState *env, uint32_t desc)                    \
+{                                                                       \
+    uint32_t vm = vext_vm(desc);                                        \
+    ETYPE acc = *((ETYPE *)vs1 + H(0));                                 \
+    uint32_t i;                                                         \
+                                                                        \
+    if (env->vl == 0) {                                                 \
+        return;                                                         \
+    }                                                                   \
+    for (i = 0; i < env->vl; i++) {                                     \
+        if (vext_active(v0, vm, i)) {                                   \
+            acc = OP(acc, *((ETYPE *)vs2 + H(i)));                      \
+        }                                                               \
+    }                                                                   \
+    *((ETYPE *)vd + H(0)) = acc;                                        \
+    env->vstart = 0;                                                    \
+}
+
+GEN_VEXT_U(GEN_VEXT_RED, vredsum_vs, DO_ADD)
+GEN_VEXT_U(GEN_VEXT_RED, vredand_vs, DO_AND)
+GEN_VEXT_U(GEN_VEXT_RED, vredor_vs, DO_OR)
+GEN_VEXT_U(GEN_VEXT_RED, vredxor_vs, DO_XOR)
+GEN_VEXT_U(GEN_VEXT_RED, vredminu_vs, DO_MIN)
+GEN_VEXT_S(GEN_VEXT_RED, vredmin_vs, DO_MIN)
+GEN_VEXT_U(GEN_VEXT_RED, vredmaxu_vs, DO_MAX)
+GEN_VEXT_S(GEN_VEXT_RED, vredmax_vs, DO_MAX)
+
+/* Mask Instructions */
+
+#define DO_NAND(N, M)   (!((N) & (M)))
+#define DO_ANDNOT(N, M) ((N) & !(M))
+#define DO_NOR(N, M)    (!((N) | (M)))
+#define DO_ORNOT(N, M)  ((N) | !(M))
+#define DO_XNOR(N, M)   (!((N) ^ (M)))
+
+#define GEN_VEXT_MASK_VV(NAME, OP)                                      \
+void HELPER(NAME)(void *vd, void *v0, void *vs1, void *vs2,             \
+                  CPURISCVState *env, uint32_t desc)                    \
+{                                                                       \
+    uint32_t i;                                                         \
+                                                                        \
+    for (i = env->vstart; i < env->vl; i++) {                           \
+        int a = vext_elem_mask(vs1, i);                                 \
+        int b = vext_elem_mask(vs2, i);                                 \
+        vext_set_elem_mask(vd, i, OP(b, a));                            \
+    }                                                                   \
+    env->vstart = 0;                                                    \
+}
+
+GEN_VEXT_MASK_VV(vmand_mm, DO_AND)
+GEN_VEXT_MASK_VV(vmnand_mm, DO_NAND)
+GEN_VEXT_MASK_VV(vmandn_mm, DO_ANDNOT)
+GEN_VEXT_MASK_VV(vmxor_mm, DO_XOR)
+GEN_VEXT_MASK_VV(vmor_mm, DO_OR)
+GEN_VEXT_MASK_VV(vmnor_mm, DO_NOR)
+GEN_VEXT_MASK_VV(vmorn_mm, DO_ORNOT)
+GEN_VEXT_MASK_VV(vmxnor_mm, DO_XNOR)
+
+target_ulong HELPER(vcpop_m)(void *v0, void *vs2, CPURISCVState *env,
+                             uint32_t desc)
+{
+    uint32_t vm = vext_vm(desc);
+    target_ulong cnt = 0;
+    uint32_t i;
+
+    for (i = 0; i < env->vl; i++) {
+        if (vext_active(v0, vm, i) && vext_elem_mask(vs2, i)) {
+            cnt++;
+        }
+    }
+    env->vstart = 0;
+    return cnt;
+}
+
+target_ulong HELPER(vfirst_m)(void *v0, void *vs2, CPURISCVState *env,
+                              uint32_t desc)
+{
+    uint32_t vm = vext_vm(desc);
+    uint32_t i;
+
+    env->vstart = 0;
+    for (i = 0; i < env->vl; i++) {
+        if (vext_active(v0, vm, i) && vext_elem_mask(vs2, i)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+#define GEN_VEXT_VID_V(NAME, ETYPE, H, UNUSED)                          \
+void HELPER(NAME)(void *vd, void *v0, CPURISCVState *env,               \
+                  uint32_t desc)                                        \
+{                                                                       \
+    uint32_t vm = vext_vm(desc);                                        \
+    uint32_t i;                                                         \
+                                                                        \
+    for (i = env->vstart; i < env->vl; i++) {                           \
+        if (vext_active(v0, vm, i)) {                                   \
+            *((ETYPE *)vd + H(i)) = i;                                  \
+        }                                                               \
+    }                                                                   \
+    env->vstart = 0;                                                    \
+}
+
+GEN_VEXT_U(GEN_VEXT_VID_V, vid_v, 0)
+
+/* Floating-Point */
+
+/*
+ * The operations of the F and D extensions are reused for single and
+ * double precision elements, their inputs are NaN-boxed or not as the
+ * scalar helpers accept.  OP(env, vs2[i], vs1[i]) order as for integers.
+ */
+static uint64_t do_frsub_s(CPURISCVState *env, uint64_t n, uint64_t m)
+{
+    return helper_fsub_s(env, m, n);
+}
+
+static uint64_t do_frsub_d(CPURISCVState *env, uint64_t n, uint64_t m)
+{
+    return helper_fsub_d(env, m, n);
+}
+
+static uint64_t do_frdiv_s(CPURISCVState *env, uint64_t n, uint64_t m)
+{
+    return helper_fdiv_s(env, m, n);
+}
+
+static uint64_t do_frdiv_d(CPURISCVState *env, uint64_t n, uint64_t m)
+{
+    return helper_fdiv_d(env, m, n);
+}
+
+/* the sign comes from vs1, the rest from vs2 */
+static uint64_t do_fsgnj_s(CPURISCVState *env, uint64_t n, uint64_t m)
+{
+    return deposit64(m, 0, 31, n);
+}
+
+static uint64_t do_fsgnj_d(CPURISCVState *env, uint64_t n, uint64_t m)
+{
+    return deposit64(m, 0, 63, n);
+}
+
+static uint64_t do_fsgnjn_s(CPURISCVState *env, uint64_t n, uint64_t m)
+{
+    return deposit64(~m, 0, 31, n);
+}
+
+static uint64_t do_fsgnjn_d(CPURISCVState *env, uint64_t n, uint64_t m)
+{
+    return deposit64(~m, 0, 63, n);
+}
+
+static uint64_t do_fsgnjx_s(CPURISCVState *env, uint64_t n, uint64_t m)
+{
+    return deposit64(m ^ n, 0, 31, n);
+}
+
+static uint64_t do_fsgnjx_d(CPURISCVState *env, uint64_t n, uint64_t m)
+{
+    return deposit64(m ^ n, 0, 63, n);
+}
+
+/*
+ * Fused multiply-adds, with D the element of vd:
+ * vfmacc  +(vs1 * vs2) + vd     vfmadd  +(vs1 * vd) + vs2
+ * vfnmacc -(vs1 * vs2) - vd     vfnmadd -(vs1 * vd) - vs2
+ * vfmsac  +(vs1 * vs2) - vd     vfmsub  +(vs1 * vd) - vs2
+ * vfnmsac -(vs1 * vs2) + vd     vfnmsub -(vs1 * vd) + vs2
+ */
+#define GEN_VEXT_FMA(SUF, FSUF)                                         \
+static uint64_t do_fmacc_##SUF(CPURISCVState *env, uint64_t n,          \
+                               uint64_t m, uint64_t d)                  \
+{                                                                       \
+    return helper_fmadd_##FSUF(env, m, n, d);                           \
+}                                                                       \
+static uint64_t do_fnmacc_##SUF(CPURISCVState *env, uint64_t n,         \
+                                uint64_t m, uint64_t d)                 \
+{                                                                       \
+    return helper_fnmadd_##FSUF(env, m, n, d);                          \
+}                                                                       \
+static uint64_t do_fmsac_##SUF(CPURISCVState *env, uint64_t n,          \
+                               uint64_t m, uint64_t d)                  \
+{                                                                       \
+    return helper_fmsub_##FSUF(env, m, n, d);                           \
+}                                                                       \
+static uint64_t do_fnmsac_##SUF(CPURISCVState *env, uint64_t n,         \
+                                uint64_t m, uint64_t d)                 \
+{                                                                       \
+    return helper_fnmsub_##FSUF(env, m, n, d);                          \
+}                                                                       \
+static uint64_t do_fmadd_##SUF(CPURISCVState *env, uint64_t n,          \
+                               uint64_t m, uint64_t d)                  \
+{                                                                       \
+    return helper_fmadd_##FSUF(env, m, d, n);                           \
+}                                                                       \
+static uint64_t do_fnmadd_##SUF(CPURISCVState *env, uint64_t n,         \
+                                uint64_t m, uint64_t d)                 \
+{                                                                       \
+    return helper_fnmadd_##FSUF(env, m, d, n);                          \
+}                                                                       \
+static uint64_t do_fmsub_##SUF(CPURISCVState *env, uint64_t n,          \
+                               uint64_t m, uint64_t d)                  \
+{                                                                       \
+    return helper_fmsub_##FSUF(env, m, d, n);                           \
+}                                                                       \
+static uint64_t do_fnmsub_##SUF(CPURISCVState *env, uint64_t n,         \
+                                uint64_t m, uint64_t d)                 \
+{                                                                       \
+    return helper_fnmsub_##FSUF(env, m, d, n);                          \
+}
+
+GEN_VEXT_FMA(s, s)
+GEN_VEXT_FMA(d, d)
+
+/* compares, vmfgt and vmfge only have a .vf form */
+static target_ulong do_fne_s(CPURISCVState *env, uint64_t n, uint64_t m)
+{
+    return !helper_feq_s(env, n, m);
+}
+
+static target_ulong do_fne_d(CPURISCVState *env, uint64_t n, uint64_t m)
+{
+    return !helper_feq_d(env, n, m);
+}
+
+static target_ulong do_fgt_s(CPURISCVState *env, uint64_t n, uint64_t m)
+{
+    return helper_flt_s(env, m, n);
+}
+
+static target_ulong do_fgt_d(CPURISCVState *env, uint64_t n, uint64_t m)
+{
+    return helper_flt_d(env, m, n);
+}
+
+static target_ulong do_fge_s(CPURISCVState *env, uint64_t n, uint64_t m)
+{
+    return helper_fle_s(env, m, n);
+}
+
+static target_ulong do_fge_d(CPURISCVState *env, uint64_t n, uint64_t m)
+{
+    return helper_fle_d(env, m, n);
+}
+
+#define GEN_VEXT_FVV(NAME, ETYPE, H, OP)                                \
+void HELPER(NAME)(void *vd, void *v0, void *vs1, void *vs2,             \
+                  CPURISCVState *env, uint32_t desc)                    \
+{                                                                       \
+    uint32_t vm = vext_vm(desc);                                        \
+    uint32_t i;                                                         \
+                                                                        \
+    for (i = env->vstart; i < env->vl; i++) {                           \
+        if (vext_active(v0, vm, i)) {                                   \
+            ETYPE s1 = *((ETYPE *)vs1 + H(i));                          \
+            ETYPE s2 = *((ETYPE *)vs2 + H(i));                          \
+            *((ETYPE *)vd + H(i)) = OP(env, s2, s1);                    \
+        }                                                               \
+    }                                                                   \
+    env->vstart = 0;                                                    \
+}
+
+#define GEN_VEXT_FVF(NAME, ETYPE, H, OP)                                \
+void HELPER(NAME)(void *vd, void *v0, uint64_t s1, void *vs2,           \
+                  CPURISCVState *env, uint32_t desc)                    \
+{                                                                       \
+    uint32_t vm = vext_vm(desc);                                        \
+    uint32_t i;                                                         \
+                                                                        \
+    for (i = env->vstart; i < env->vl; i++) {                           \
+        if (vext_active(v0, vm, i)) {                                   \
+            ETYPE s2 = *((ETYPE *)vs2 + H(i));                          \
+            *((ETYPE *)vd + H(i)) = OP(env, s2, (ETYPE)s1);             \
+        }                                                               \
+    }                                                                   \
+    env->vstart = 0;                                                    \
+}
+
+#define GEN_VEXT_FVV3(NAME, ETYPE, H, OP)                               \
+void HELPER(NAME)(void *vd, void *v0, void *vs1, void *vs2,             \
+                  CPURISCVState *env, uint32_t desc)                    \
+{                                                                       \
+    uint32_t vm = vext_vm(desc);                                        \
+    uint32_t i;                                                         \
+                                                                        \
+    for (i = env->vstart; i < env->vl; i++) {                           \
+        if (vext_active(v0, vm, i)) {                                   \
+            ETYPE s1 = *((ETYPE *)vs1 + H(i));                          \
+            ETYPE s2 = *((ETYPE *)vs2 + H(i));                          \
+            ETYPE d = *((ETYPE *)vd + H(i));                            \
+            *((ETYPE *)vd + H(i)) = OP(env, s2, s1, d);                 \
+        }                                                               \
+    }                                                                   \
+    env->vstart = 0;                                                    \
+}
+
+#define GEN_VEXT_FVF3(NAME, ETYPE, H, OP)                               \
+void HELPER(NAME)(void *vd, void *v0, uint64_t s1, void *vs2,           \
+                  CPURISCVState *env, uint32_t desc)                    \
+{                                                                       \
+    uint32_t vm = vext_vm(desc);                                        \
+    uint32_t i;                                                         \
+                                                                        \
+    for (i = env->vstart; i < env->vl; i++) {                           \
+        if (vext_active(v0, vm, i)) {                                   \
+            ETYPE s2 = *((ETYPE *)vs2 + H(i));                          \
+            ETYPE d = *((ETYPE *)vd + H(i));                            \
+            *((ETYPE *)vd + H(i)) = OP(env, s2, (ETYPE)s1, d);          \
+        }                                                               \
+    }                                                                   \
+    env->vstart = 0;                                                    \
+}
+
+#define GEN_VEXT_FCMP_VV(NAME, ETYPE, H, OP)                            \
+void HELPER(NAME)(void *vd, void *v0, void *vs1, void *vs2,             \
+                  CPURISCVState *env, uint32_t desc)                    \
+{                                                                       \
+    uint32_t vm = vext_vm(desc);                                        \
+    uint32_t i;                                                         \
+                                                                        \
+    for (i = env->vstart; i < env->vl; i++) {                           \
+        if (vext_active(v0, vm, i)) {                                   \
+            ETYPE s1 = *((ETYPE *)vs1 + H(i));                          \
+            ETYPE s2 = *((ETYPE *)vs2 + H(i));                          \
+            vext_set_elem_mask(vd, i, OP(env, s2, s1));                 \
+        }                                                               \
+    }                                                                   \
+    env->vstart = 0;                                                    \
+}
+
+#define GEN_VEXT_FCMP_VF(NAME, ETYPE, H, OP)                            \
+void HELPER(NAME)(void *vd, void *v0, uint64_t s1, void *vs2,           \
+                  CPURISCVState *env, uint32_t desc)                    \
+{                                                                       \
+    uint32_t vm = vext_vm(desc);                                        \
+    uint32_t i;                                                         \
+                                                                        \
+    for (i = env->vstart; i < env->vl; i++) {                           \
+        if (vext_active(v0, vm, i)) {                                   \
+            ETYPE s2 = *((ETYPE *)vs2 + H(i));                          \
+            vext_set_elem_mask(vd, i, OP(env, s2, (ETYPE)s1));          \
+        }                                                               \
+    }                                                                   \
+    env->vstart = 0;                                                    \
+}
+
+/* ordered, which is also a valid result of the unordered sum */
+#define GEN_VEXT_FRED(NAME, ETYPE, H, OP)                               \
+void HELPER(NAME)(void *vd, void *v0, void *vs1, void *vs2,             \
+                  CPURISCVState *env, uint32_t desc)                    \
+{                                                                       \
+    uint32_t vm = vext_vm(desc);                                        \
+    ETYPE acc = *((ETYPE *)vs1 + H(0));                                 \
+    uint32_t i;                                                         \
+                                                                        \
+    if (env->vl == 0) {                                                 \
+        return;                                                         \
+    }                                                                   \
+    for (i = 0; i < env->vl; i++) {                                     \
+        if (vext_active(v0, vm, i)) {                                   \
+            acc = OP(env, acc, *((ETYPE *)vs2 + H(i)));                 \
+        }                                                               \
+    }                                                                   \
+    *((ETYPE *)vd + H(0)) = acc;                                        \
+    env->vstart = 0;                                                    \
+}
+
+#define GEN_VEXT_FP(GEN, NAME, OP)                                      \
+    GEN(NAME##_w, uint32_t, H4, OP##_s)                                 \
+    GEN(NAME##_d, uint64_t, H8, OP##_d)
+
+GEN_VEXT_FP(GEN_VEXT_FVV, vfadd_vv, helper_fadd)
+GEN_VEXT_FP(GEN_VEXT_FVF, vfadd_vf, helper_fadd)
+GEN_VEXT_FP(GEN_VEXT_FVV, vfsub_vv, helper_fsub)
+GEN_VEXT_FP(GEN_VEXT_FVF, vfsub_vf, helper_fsub)
+GEN_VEXT_FP(GEN_VEXT_FVF, vfrsub_vf, do_frsub)
+GEN_VEXT_FP(GEN_VEXT_FVV, vfmul_vv, helper_fmul)
+GEN_VEXT_FP(GEN_VEXT_FVF, vfmul_vf, helper_fmul)
+GEN_VEXT_FP(GEN_VEXT_FVV, vfdiv_vv, helper_fdiv)
+GEN_VEXT_FP(GEN_VEXT_FVF, vfdiv_vf, helper_fdiv)
+GEN_VEXT_FP(GEN_VEXT_FVF, vfrdiv_vf, do_frdiv)
+GEN_VEXT_FP(GEN_VEXT_FVV, vfmin_vv, helper_fmin)
+GEN_VEXT_FP(GEN_VEXT_FVF, vfmin_vf, helper_fmin)
+GEN_VEXT_FP(GEN_VEXT_FVV, vfmax_vv, helper_fmax)
+GEN_VEXT_FP(GEN_VEXT_FVF, vfmax_vf, helper_fmax)
+GEN_VEXT_FP(GEN_VEXT_FVV, vfsgnj_vv, do_fsgnj)
+GEN_VEXT_FP(GEN_VEXT_FVF, vfsgnj_vf, do_fsgnj)
+GEN_VEXT_FP(GEN_VEXT_FVV, vfsgnjn_vv, do_fsgnjn)
+GEN_VEXT_FP(GEN_VEXT_FVF, vfsgnjn_vf, do_fsgnjn)
+GEN_VEXT_FP(GEN_VEXT_FVV, vfsgnjx_vv, do_fsgnjx)
+GEN_VEXT_FP(GEN_VEXT_FVF, vfsgnjx_vf, do_fsgnjx)
+
+GEN_VEXT_FP(GEN_VEXT_FVV3, vfmacc_vv, do_fmacc)
+GEN_VEXT_FP(GEN_VEXT_FVF3, vfmacc_vf, do_fmacc)
+GEN_VEXT_FP(GEN_VEXT_FVV3, vfnmacc_vv, do_fnmacc)
+GEN_VEXT_FP(GEN_VEXT_FVF3, vfnmacc_vf, do_fnmacc)
+GEN_VEXT_FP(GEN_VEXT_FVV3, vfmsac_vv, do_fmsac)
+GEN_VEXT_FP(GEN_VEXT_FVF3, vfmsac_vf, do_fmsac)
+GEN_VEXT_FP(GEN_VEXT_FVV3, vfnmsac_vv, do_fnmsac)
+GEN_VEXT_FP(GEN_VEXT_FVF3, vfnmsac_vf, do_fnmsac)
+GEN_VEXT_FP(GEN_VEXT_FVV3, vfmadd_vv, do_fmadd)
+GEN_VEXT_FP(GEN_VEXT_FVF3, vfmadd_vf, do_fmadd)
+GEN_VEXT_FP(GEN_VEXT_FVV3, vfnmadd_vv, do_fnmadd)
+GEN_VEXT_FP(GEN_VEXT_FVF3, vfnmadd_vf, do_fnmadd)
+GEN_VEXT_FP(GEN_VEXT_FVV3, vfmsub_vv, do_fmsub)
+GEN_VEXT_FP(GEN_VEXT_FVF3, vfmsub_vf, do_fmsub)
+GEN_VEXT_FP(GEN_VEXT_FVV3, vfnmsub_vv, do_fnmsub)
+GEN_VEXT_FP(GEN_VEXT_FVF3, vfnmsub_vf, do_fnmsub)
+
+GEN_VEXT_FP(GEN_VEXT_FCMP_VV, vmfeq_vv, helper_feq)
+GEN_VEXT_FP(GEN_VEXT_FCMP_VF, vmfeq_vf, helper_feq)
+GEN_VEXT_FP(GEN_VEXT_FCMP_VV, vmfne_vv, do_fne)
+GEN_VEXT_FP(GEN_VEXT_FCMP_VF, vmfne_vf, do_fne)
+GEN_VEXT_FP(GEN_VEXT_FCMP_VV, vmflt_vv, helper_flt)
+GEN_VEXT_FP(GEN_VEXT_FCMP_VF, vmflt_vf, helper_flt)
+GEN_VEXT_FP(GEN_VEXT_FCMP_VV, vmfle_vv, helper_fle)
+GEN_VEXT_FP(GEN_VEXT_FCMP_VF, vmfle_vf, helper_fle)
+GEN_VEXT_FP(GEN_VEXT_FCMP_VF, vmfgt_vf, do_fgt)
+GEN_VEXT_FP(GEN_VEXT_FCMP_VF, vmfge_vf, do_fge)
+
+GEN_VEXT_FP(GEN_VEXT_FRED, vfredosum_vs, helper_fadd)
+GEN_VEXT_FP(GEN_VEXT_FRED, vfredmin_vs, helper_fmin)
+GEN_VEXT_FP(GEN_VEXT_FRED, vfredmax_vs, helper_fmax)
+
+#define GEN_VEXT_FSQRT(NAME, ETYPE, H, OP)                              \
+void HELPER(NAME)(void *vd, void *v0, void *vs2,                        \
+                  CPURISCVState *env, uint32_t desc)                    \
+{                                                                       \
+    uint32_t vm = vext_vm(desc);                                        \
+    uint32_t i;                                                         \
+                                                                        \
+    for (i = env->vstart; i < env->vl; i++) {                           \
+        if (vext_active(v0, vm, i)) {                                   \
+            *((ETYPE *)vd + H(i)) = OP(env, *((ETYPE *)vs2 + H(i)));    \
+        }                                                               \
+    }                                                                   \
+    env->vstart = 0;                                                    \
+}
+
+GEN_VEXT_FP(GEN_VEXT_FSQRT, vfsqrt_v, helper_fsqrt)
+
+/* vfmerge and its unmasked form vfmv.v.f */
+#define GEN_VEXT_VFMERGE(NAME, ETYPE, H, UNUSED)                        \
+void HELPER(NAME)(void *vd, void *v0, uint64_t s1, void *vs2,           \
+                  CPURISCVState *env, uint32_t desc)                    \
+{                                                                       \
+    uint32_t vm = vext_vm(desc);                                        \
+    uint32_t i;                                                         \
+                                                                        \
+    for (i = env->vstart; i < env->vl; i++) {                           \
+        *((ETYPE *)vd + H(i)) = vext_active(v0, vm, i) ? (ETYPE)s1 :    \
+                                *((ETYPE *)vs2 + H(i));                 \
+    }                                                                   \
+    env->vstart = 0;                                                    \
+}
+
+GEN_VEXT_FP(GEN_VEXT_VFMERGE, vfmerge_vfm, 0)
@@ -43,6 +43,29 @@ struct tcg_temp_info {
     TCGTemp *next_copy;
     tcg_target_ulong val;
     tcg_target_ulong mask;
+    tcg_target_ulong s_mask;
+    uint32_t version;
+};
+
+/* Value numbering table, used to find an earlier op of the current basic
+   block that computed the same value as the current op.  An entry is
+   valid only while neither its output nor its inputs have been redefined,
+   which is tracked by comparing the temps' versions.  Loads from memory
+   are additionally invalidated by every op that may write memory.  */
+#define VN_TABLE_BITS  6
+#define VN_MAX_IARGS   4
+
+struct vn_entry {
+    TCGOp *op;
+    uint32_t gen;
+    uint32_t mem_gen;
+    uint32_t version[1 + VN_MAX_IARGS];
+};
+
+struct vn_state {
+    struct vn_entry table[1 << VN_TABLE_BITS];
+    uint32_t gen;
+    uint32_t mem_gen;
 };
 
 static inline struct tcg_temp_info *ts_info(TCGTemp *ts)
@@ -83,6 +106,8 @@ static void reset_ts(TCGTemp *ts)
     ti->prev_copy = ts;
     ti->is_const = false;
     ti->mask = -1;
+    ti->s_mask = 0;
+    ti->version++;
 }
 
 static void reset_temp(TCGArg arg)
@@ -103,6 +128,8 @@ static void init_ts_info(struct tcg_temp_info *infos,
         ti->prev_copy = ts;
         ti->is_const = false;
         ti->mask = -1;
+        ti->s_mask = 0;
+        ti->version = 0;
         set_bit(idx, temps_used->l);
     }
 }
@@ -168,6 +195,143 @@ static bool args_are_copies(TCGArg arg1, TCGArg arg2)
     return ts_are_copies(arg_temp(arg1), arg_temp(arg2));
 }
 
+static bool vn_op_is_load(TCGOpcode opc)
+{
+    switch (opc) {
+    CASE_OP_32_64(ld8u):
+    CASE_OP_32_64(ld8s):
+    CASE_OP_32_64(ld16u):
+    CASE_OP_32_64(ld16s):
+    case INDEX_op_ld_i32:
+    case INDEX_op_ld32u_i64:
+    case INDEX_op_ld32s_i64:
+    case INDEX_op_ld_i64:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool vn_op_may_write_memory(const TCGOp *op, int nb_oargs,
+                                   int nb_iargs)
+{
+    switch (op->opc) {
+    CASE_OP_32_64(st8):
+    CASE_OP_32_64(st16):
+    case INDEX_op_st_i32:
+    case INDEX_op_st32_i64:
+    case INDEX_op_st_i64:
+    case INDEX_op_st_vec:
+    case INDEX_op_mb:
+        return true;
+    case INDEX_op_call:
+        return !(op->args[nb_oargs + nb_iargs + 1] & TCG_CALL_NO_SIDE_EFFECTS);
+    default:
+        return tcg_op_defs[op->opc].flags & TCG_OPF_SIDE_EFFECTS;
+    }
+}
+
+static bool vn_op_is_candidate(const TCGOp *op)
+{
+    const TCGOpDef *def = &tcg_op_defs[op->opc];
+
+    /* Moves are NOT_PRESENT, and already handled by copy propagation.  */
+    return def->nb_oargs == 1 && def->nb_iargs <= VN_MAX_IARGS
+        && !(def->flags & (TCG_OPF_BB_END | TCG_OPF_SIDE_EFFECTS
+                           | TCG_OPF_NOT_PRESENT | TCG_OPF_VECTOR));
+}
+
+static struct vn_entry *vn_slot(struct vn_state *vn, const TCGOp *op)
+{
+    const TCGOpDef *def = &tcg_op_defs[op->opc];
+    int i, nb_args = def->nb_iargs + def->nb_cargs;
+    uint64_t h = op->opc;
+
+    for (i = 1; i <= nb_args; i++) {
+        h = (h ^ op->args[i]) * 0x9e3779b97f4a7c15ull;
+    }
+    return &vn->table[h >> (64 - VN_TABLE_BITS)];
+}
+
+/* Return a temp that still holds the value computed by OP, or NULL.  */
+static TCGTemp *vn_find(struct vn_state *vn, const TCGOp *op)
+{
+    const TCGOpDef *def = &tcg_op_defs[op->opc];
+    struct vn_entry *e;
+    TCGTemp *ts;
+    int i;
+
+    if (!vn_op_is_candidate(op)) {
+        return NULL;
+    }
+    e = vn_slot(vn, op);
+    if (e->op == NULL || e->gen != vn->gen || e->op->opc != op->opc) {
+        return NULL;
+    }
+    if (vn_op_is_load(op->opc) && e->mem_gen != vn->mem_gen) {
+        return NULL;
+    }
+    for (i = 1; i <= def->nb_iargs + def->nb_cargs; i++) {
+        if (e->op->args[i] != op->args[i]) {
+            return NULL;
+        }
+    }
+    for (i = 1; i <= def->nb_iargs; i++) {
+        if (arg_info(op->args[i])->version != e->version[i]) {
+            return NULL;
+        }
+    }
+    ts = arg_temp(e->op->args[0]);
+    if (ts_info(ts)->version != e->version[0]) {
+        return NULL;
+    }
+    return ts;
+}
+
+/* Remember OP, whose output has just been (re)defined.  */
+static void vn_record(struct vn_state *vn, TCGOp *op)
+{
+    const TCGOpDef *def = &tcg_op_defs[op->opc];
+    struct vn_entry *e;
+    int i;
+
+    if (!vn_op_is_candidate(op)) {
+        return;
+    }
+    /* The inputs' values are gone if the output overwrote one of them.  */
+    for (i = 1; i <= def->nb_iargs; i++) {
+        if (op->args[i] == op->args[0]) {
+            return;
+        }
+    }
+    e = vn_slot(vn, op);
+    e->op = op;
+    e->gen = vn->gen;
+    e->mem_gen = vn->mem_gen;
+    for (i = 0; i <= def->nb_iargs; i++) {
+        e->version[i] = arg_info(op->args[i])->version;
+    }
+}
+
+/* The sign mask of a 64-bit value is a left-aligned set of bits, each of
+   which is known to be equal to the bit just below it.  A value that is
+   sign-extended from N bits thus has all of bits 63..N set in its mask.  */
+static tcg_target_ulong smask_from_value(tcg_target_ulong value)
+{
+    int rep = clrsb64(value);
+    return ~(~0ull >> rep);
+}
+
+static tcg_target_ulong smask_from_zmask(tcg_target_ulong mask)
+{
+    /* N leading known-zero bits give N-1 bits equal to the one below.  */
+    int rep = clz64(mask);
+    if (rep == 0) {
+        return 0;
+    }
+    return ~(~0ull >> (rep - 1));
+}
+
 static void tcg_opt_gen_movi(TCGContext *s, TCGOp *op, TCGArg dst, TCGArg val)
 {
     const TCGOpDef *def;
@@ -197,6 +361,9 @@ static void tcg_opt_gen_movi(TCGContext *s, TCGOp *op, TCGArg dst, TCGArg val)
         mask |= ~0xffffffffull;
     }
     di->mask = mask;
+    if (TCG_TARGET_REG_BITS == 64 && new_op == INDEX_op_movi_i64) {
+        di->s_mask = smask_from_value(val);
+    }
 }
 
 static void tcg_opt_gen_mov(TCGContext *s, TCGOp *op, TCGArg dst, TCGArg src)
@@ -236,6 +403,9 @@ static void tcg_opt_gen_mov(TCGContext *s, TCGOp *op, TCGArg dst, TCGArg src)
         mask |= ~0xffffffffull;
     }
     di->mask = mask;
+    if (new_op == INDEX_op_mov_i64) {
+        di->s_mask = si->s_mask;
+    }
 
     if (src_ts->type == dst_ts->type) {
         struct tcg_temp_info *ni = ts_info(si->next_copy);
@@ -593,6 +763,7 @@ void tcg_optimize(TCGContext *s)
     int nb_temps, nb_globals;
     TCGOp *op, *op_next, *prev_mb = NULL;
     struct tcg_temp_info *infos;
+    struct vn_state *vn;
     TCGTempSet temps_used;
 
     /* Array VALS has an element for each temp.
@@ -604,11 +775,14 @@ void tcg_optimize(TCGContext *s)
     nb_globals = s->nb_globals;
     bitmap_zero(temps_used.l, nb_temps);
     infos = tcg_malloc(sizeof(struct tcg_temp_info) * nb_temps);
+    vn = tcg_malloc(sizeof(struct vn_state));
+    memset(vn, 0, sizeof(struct vn_state));
 
     QTAILQ_FOREACH_SAFE(op, &s->ops, link, op_next) {
-        tcg_target_ulong mask, partmask, affected;
+        tcg_target_ulong mask, partmask, affected, s_mask;
         int nb_oargs, nb_iargs, i;
         TCGArg tmp;
+        TCGTemp *vn_ts;
         TCGOpcode opc = op->opc;
         const TCGOpDef *def = &tcg_op_defs[opc];
 
@@ -631,6 +805,14 @@ void tcg_optimize(TCGContext *s)
             }
         }
 
+        /* Invalidate remembered values that may no longer be current.  */
+        if (def->flags & TCG_OPF_BB_END) {
+            vn->gen++;
+        }
+        if (vn_op_may_write_memory(op, nb_oargs, nb_iargs)) {
+            vn->mem_gen++;
+        }
+
         /* Do copy propagation */
         for (i = nb_oargs; i < nb_oargs + nb_iargs; i++) {
             TCGTemp *ts = arg_temp(op->args[i]);
@@ -835,6 +1017,96 @@ void tcg_optimize(TCGContext *s)
             break;
         }
 
+        /* Simplify using known sign bits.  A sign extension of a value
+           whose high bits are already copies of its sign bit (e.g. the
+           result of ext32s or of a signed 32-bit load) is a plain move.  */
+        s_mask = 0;
+        switch (opc) {
+        case INDEX_op_ext8s_i64:
+            tmp = 8;
+            goto do_sext;
+        case INDEX_op_ext16s_i64:
+            tmp = 16;
+            goto do_sext;
+        case INDEX_op_ext32s_i64:
+            tmp = 32;
+        do_sext:
+            s_mask = ~0ull << tmp;
+            if ((arg_info(op->args[1])->s_mask & s_mask) == s_mask) {
+                tcg_opt_gen_mov(s, op, op->args[0], op->args[1]);
+                continue;
+            }
+            break;
+        case INDEX_op_sextract_i64:
+            if (op->args[3] < 64) {
+                s_mask = ~0ull << op->args[3];
+                if (op->args[2] == 0
+                    && (arg_info(op->args[1])->s_mask & s_mask) == s_mask) {
+                    tcg_opt_gen_mov(s, op, op->args[0], op->args[1]);
+                    continue;
+                }
+            }
+            break;
+        case INDEX_op_ext_i32_i64:
+            s_mask = ~0ull << 32;
+            break;
+
+        case INDEX_op_ld8s_i64:
+            s_mask = ~0ull << 8;
+            break;
+        case INDEX_op_ld16s_i64:
+            s_mask = ~0ull << 16;
+            break;
+        case INDEX_op_ld32s_i64:
+            s_mask = ~0ull << 32;
+            break;
+        case INDEX_op_qemu_ld_i64:
+            {
+                TCGMemOpIdx oi = op->args[nb_oargs + nb_iargs];
+                TCGMemOp mop = get_memop(oi);
+                if ((mop & MO_SIGN) && (mop & MO_SIZE) < MO_64) {
+                    s_mask = ~0ull << (8 << (mop & MO_SIZE));
+                }
+            }
+            break;
+
+        case INDEX_op_and_i64:
+        case INDEX_op_or_i64:
+        case INDEX_op_xor_i64:
+        case INDEX_op_andc_i64:
+        case INDEX_op_orc_i64:
+        case INDEX_op_eqv_i64:
+        case INDEX_op_nand_i64:
+        case INDEX_op_nor_i64:
+            s_mask = arg_info(op->args[1])->s_mask
+                     & arg_info(op->args[2])->s_mask;
+            break;
+        case INDEX_op_not_i64:
+            s_mask = arg_info(op->args[1])->s_mask;
+            break;
+        case INDEX_op_movcond_i64:
+            s_mask = arg_info(op->args[3])->s_mask
+                     & arg_info(op->args[4])->s_mask;
+            break;
+
+        case INDEX_op_sar_i64:
+            if (arg_is_const(op->args[2])) {
+                tmp = arg_info(op->args[2])->val & 63;
+                s_mask = ~(~0ull >> tmp)
+                         | (int64_t)arg_info(op->args[1])->s_mask >> tmp;
+            }
+            break;
+        case INDEX_op_shl_i64:
+            if (arg_is_const(op->args[2])) {
+                tmp = arg_info(op->args[2])->val & 63;
+                s_mask = arg_info(op->args[1])->s_mask << tmp;
+            }
+            break;
+
+        default:
+            break;
+        }
+
         /* Simplify using known-zero bits. Currently only ops with a single
            output argument is supported. */
         mask = -1;
@@ -1451,6 +1723,12 @@ void tcg_optimize(TCGContext *s)
             if (def->flags & TCG_OPF_BB_END) {
                 bitmap_zero(temps_used.l, nb_temps);
             } else {
+                /* Reuse the result of an identical earlier computation.  */
+                vn_ts = vn_find(vn, op);
+                if (vn_ts) {
+                    tcg_opt_gen_mov(s, op, op->args[0], temp_arg(vn_ts));
+                    break;
+                }
         do_reset_output:
                 for (i = 0; i < nb_oargs; i++) {
                     reset_temp(op->args[i]);
@@ -1458,8 +1736,16 @@ void tcg_optimize(TCGContext *s)
                        first output argument (only one supported so far). */
                     if (i == 0) {
                         arg_info(op->args[i])->mask = mask;
+                        /* Leading known-zero bits are sign bits as well.  */
+                        if (TCG_TARGET_REG_BITS == 64
+                            && (def->flags & TCG_OPF_64BIT)
+                            && !(def->flags & TCG_OPF_VECTOR)) {
+                            arg_info(op->args[i])->s_mask
+                                = s_mask | smask_from_zmask(mask);
+                        }
                     }
                 }
+                vn_record(vn, op);
             }
             break;
         }
@@ -30,6 +30,7 @@
 /* Define to jump the ELF file used to communicate with GDB.  */
 #undef DEBUG_JIT
 
+#include "qemu/bitmap.h"
 #include "qemu/cutils.h"
 #include "qemu/host-utils.h"
 #include "qemu/timer.h"
@@ -133,6 +134,10 @@ static bool tcg_out_ldst_finalize(TCGContext *s);
 
 static TCGContext **tcg_ctxs;
 static unsigned int n_tcg_ctxs;
+#ifdef CONFIG_USER_ONLY
+/* Bit i set if tcg_ctxs[i] is claimed for translation; see tcg_ctx_claim */
+static unsigned long *tcg_ctxs_busy;
+#endif
 TCGv_env cpu_env = 0;
 
 struct tcg_region_tree {
@@ -161,6 +166,9 @@ struct tcg_region_state {
     /* fields protected by the lock */
     size_t current; /* current region index */
     size_t agg_size_full; /* aggregate size of full regions */
+    unsigned long *evicted; /* regions free for reuse after eviction */
+    uint64_t *alloc_seq; /* order in which regions were last allocated */
+    uint64_t next_seq;
 };
 
 static struct tcg_region_state region;
@@ -297,10 +305,16 @@ static void tcg_out_label(TCGContext *s, TCGLabel *l, tcg_insn_unit *ptr)
 TCGLabel *gen_new_label(void)
 {
     TCGContext *s = tcg_ctx;
-    TCGLabel *l = tcg_malloc(sizeof(TCGLabel));
+    int id = s->nb_labels++;
+    TCGLabel *l;
 
+    if (likely(id < s->label_arena_size)) {
+        l = &s->label_arena[id];
+    } else {
+        l = tcg_malloc(sizeof(TCGLabel));
+    }
     *l = (TCGLabel){
-        .id = s->nb_labels++
+        .id = id
     };
 
     return l;
@@ -522,11 +536,19 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
 
 static bool tcg_region_alloc__locked(TCGContext *s)
 {
-    if (region.current == region.n) {
-        return true;
+    size_t curr_region;
+
+    if (region.current < region.n) {
+        curr_region = region.current++;
+    } else {
+        curr_region = find_first_bit(region.evicted, region.n);
+        if (curr_region == region.n) {
+            return true;
+        }
+        clear_bit(curr_region, region.evicted);
     }
-    tcg_region_assign(s, region.current);
-    region.current++;
+    tcg_region_assign(s, curr_region);
+    region.alloc_seq[curr_region] = region.next_seq++;
     return false;
 }
 
@@ -567,6 +589,7 @@ void tcg_region_reset_all(void)
     qemu_mutex_lock(&region.lock);
     region.current = 0;
     region.agg_size_full = 0;
+    bitmap_zero(region.evicted, region.n);
 
     for (i = 0; i < n_ctxs; i++) {
         TCGContext *s = atomic_read(&tcg_ctxs[i]);
@@ -579,12 +602,83 @@ void tcg_region_reset_all(void)
     tcg_region_tree_reset_all();
 }
 
+static bool tcg_region_in_use__locked(size_t curr_region)
+{
+    unsigned int n_ctxs = atomic_read(&n_tcg_ctxs);
+    void *start, *end;
+    unsigned int i;
+
+    tcg_region_bounds(curr_region, &start, &end);
+    for (i = 0; i < n_ctxs; i++) {
+        TCGContext *s = atomic_read(&tcg_ctxs[i]);
+
+        if (s->code_gen_buffer == start) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Evict the region that was allocated least recently among the full regions
+ * that no context is translating into.  @func is called on each TB of the
+ * region, which must unlink the TB from everything that can still reach it;
+ * the region is then made available to tcg_region_alloc again.
+ *
+ * Call from a safe-work context.  Returns false if no region can be evicted,
+ * in which case the caller has to fall back to a full flush.
+ */
+bool tcg_region_evict(GTraverseFunc func, gpointer user_data)
+{
+    struct tcg_region_tree *rt;
+    size_t victim = region.n;
+    void *start, *end;
+    size_t i;
+
+    qemu_mutex_lock(&region.lock);
+    for (i = 0; i < region.current; i++) {
+        if (test_bit(i, region.evicted) || tcg_region_in_use__locked(i)) {
+            continue;
+        }
+        if (victim == region.n ||
+            region.alloc_seq[i] < region.alloc_seq[victim]) {
+            victim = i;
+        }
+    }
+    if (victim == region.n) {
+        qemu_mutex_unlock(&region.lock);
+        return false;
+    }
+    tcg_region_bounds(victim, &start, &end);
+    region.agg_size_full -= end - start - TCG_HIGHWATER;
+    set_bit(victim, region.evicted);
+    qemu_mutex_unlock(&region.lock);
+
+    rt = region_trees + victim * tree_size;
+    qemu_mutex_lock(&rt->lock);
+    g_tree_foreach(rt->tree, func, user_data);
+    /* Increment the refcount first so that destroy acts as a reset */
+    g_tree_ref(rt->tree);
+    g_tree_destroy(rt->tree);
+    qemu_mutex_unlock(&rt->lock);
+    return true;
+}
+
 #ifdef CONFIG_USER_ONLY
-static size_t tcg_n_regions(void)
+#define TCG_MAX_USER_CTXS 8
+
+/*
+ * The number of contexts in user-mode, including tcg_init_ctx.
+ * There is no point in having more of them than host CPUs.
+ */
+static unsigned int tcg_n_user_ctxs(void)
 {
-    return 1;
+    long host_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return MAX(1, MIN(host_cpus, TCG_MAX_USER_CTXS));
 }
-#else
+#endif
+
 /*
  * It is likely that some vCPUs will translate more code than others, so we
  * first try to set more regions than max_cpus, with those regions being of
@@ -593,29 +687,64 @@ static size_t tcg_n_regions(void)
  */
 static size_t tcg_n_regions(void)
 {
+#ifdef CONFIG_USER_ONLY
+    size_t n_threads = tcg_n_user_ctxs();
+#else
+    size_t n_threads = qemu_tcg_mttcg_enabled() ? max_cpus : 1;
+#endif
     size_t i;
 
-    /* Use a single region if all we have is one vCPU thread */
-    if (max_cpus == 1 || !qemu_tcg_mttcg_enabled()) {
-        return 1;
-    }
-
-    /* Try to have more regions than max_cpus, with each region being >= 2 MB */
+    /*
+     * Try to have more regions than TCG threads, with each region being
+     * >= 2 MB.  Spare regions are what lets tcg_region_evict free up space
+     * without flushing the whole buffer, so do this even with a single
+     * vCPU thread.
+     */
     for (i = 8; i > 0; i--) {
         size_t regions_per_thread = i;
         size_t region_size;
 
         region_size = tcg_init_ctx.code_gen_buffer_size;
-        region_size /= max_cpus * regions_per_thread;
+        region_size /= n_threads * regions_per_thread;
 
         if (region_size >= 2 * 1024u * 1024) {
-            return max_cpus * regions_per_thread;
+            return n_threads * regions_per_thread;
         }
     }
     /* If we can't, then just allocate one region per vCPU thread */
-    return max_cpus;
+    return n_threads;
+}
+
+/*
+ * Copy tcg_init_ctx, including the target's TCG globals, into a context
+ * of its own.  Code generation state is reset by tcg_func_start().
+ */
+static TCGContext *tcg_context_clone(void)
+{
+    TCGContext *s = g_malloc(sizeof(*s));
+    unsigned int i, n;
+
+    *s = tcg_init_ctx;
+
+    /* Relink mem_base.  */
+    for (i = 0, n = tcg_init_ctx.nb_globals; i < n; ++i) {
+        if (tcg_init_ctx.temps[i].mem_base) {
+            ptrdiff_t b = tcg_init_ctx.temps[i].mem_base - tcg_init_ctx.temps;
+            tcg_debug_assert(b >= 0 && b < n);
+            s->temps[i].mem_base = &s->temps[b];
+        }
+    }
+
+    /* The memory pool and arenas, if already in use, belong to tcg_init_ctx */
+    s->pool_first = s->pool_current = s->pool_first_large = NULL;
+    s->pool_large_spare = NULL;
+    s->pool_cur = s->pool_end = NULL;
+    s->op_arena = NULL;
+    s->op_arena_size = s->op_arena_used = 0;
+    s->label_arena = NULL;
+    s->label_arena_size = 0;
+    return s;
 }
-#endif
 
 /*
  * Initializes region partitioning.
@@ -628,22 +757,20 @@ static size_t tcg_n_regions(void)
  * code in parallel without synchronization.
  *
  * In softmmu the number of TCG threads is bounded by max_cpus, so we use at
- * least max_cpus regions in MTTCG. In !MTTCG we use a single region.
+ * least max_cpus regions in MTTCG. In !MTTCG we still try to use several
+ * regions, so that filling up the buffer can evict a region instead of
+ * flushing everything.
  * Note that the TCG options from the command-line (i.e. -accel accel=tcg,[...])
  * must have been parsed before calling this function, since it calls
  * qemu_tcg_mttcg_enabled().
  *
- * In user-mode we use a single region.  Having multiple regions in user-mode
- * is not supported, because the number of vCPU threads (recall that each thread
- * spawned by the guest corresponds to a vCPU thread) is only bounded by the
- * OS, and usually this number is huge (tens of thousands is not uncommon).
- * Thus, given this large bound on the number of vCPU threads and the fact
- * that code_gen_buffer is allocated at compile-time, we cannot guarantee
- * that the availability of at least one region per vCPU thread.
- *
- * However, this user-mode limitation is unlikely to be a significant problem
- * in practice. Multi-threaded guests share most if not all of their translated
- * code, which makes parallel code generation less appealing than in softmmu.
+ * In user-mode contexts are not tied to vCPU threads, because the number of
+ * those (recall that each thread spawned by the guest corresponds to a vCPU
+ * thread) is only bounded by the OS, and usually this number is huge (tens
+ * of thousands is not uncommon).  Instead, a small pool of contexts is
+ * created here, each with its own region, and a thread claims one of them
+ * with tcg_ctx_claim() for the duration of a translation.  tcg_init_ctx is
+ * part of the pool; it is used by whoever finds all other contexts taken.
  */
 void tcg_region_init(void)
 {
@@ -682,6 +809,8 @@ void tcg_region_init(void)
     region.end = QEMU_ALIGN_PTR_DOWN(buf + size, page_size);
     /* account for that last guard page */
     region.end -= page_size;
+    region.evicted = bitmap_new(region.n);
+    region.alloc_seq = g_new0(uint64_t, region.n);
 
     /* set guard pages */
     for (i = 0; i < region.n; i++) {
@@ -695,12 +824,22 @@ void tcg_region_init(void)
 
     tcg_region_trees_init();
 
-    /* In user-mode we support only one ctx, so do the initial allocation now */
+    /* In user-mode the contexts are created here, so allocate for them now */
 #ifdef CONFIG_USER_ONLY
     {
-        bool err = tcg_region_initial_alloc__locked(tcg_ctx);
+        unsigned int n = tcg_n_user_ctxs();
+        bool err;
 
-        g_assert(!err);
+        tcg_ctxs_busy = bitmap_new(n);
+        for (i = 1; i < n; i++) {
+            tcg_ctxs[i] = tcg_context_clone();
+        }
+        n_tcg_ctxs = n;
+
+        for (i = 0; i < n; i++) {
+            err = tcg_region_initial_alloc__locked(tcg_ctxs[i]);
+            g_assert(!err);
+        }
     }
 #endif
 }
@@ -710,8 +849,9 @@ void tcg_region_init(void)
  * and registered the target's TCG globals) must register with this function
  * before initiating translation.
  *
- * In user-mode we just point tcg_ctx to tcg_init_ctx. See the documentation
- * of tcg_region_init() for the reasoning behind this.
+ * In user-mode we just point tcg_ctx to tcg_init_ctx; tcg_ctx_claim() may
+ * switch to another context for a translation. See the documentation of
+ * tcg_region_init() for the reasoning behind this.
  *
  * In softmmu each caller registers its context in tcg_ctxs[]. Note that in
  * softmmu tcg_ctxs[] does not track tcg_ctx_init, since the initial context
@@ -719,31 +859,76 @@ void tcg_region_init(void)
  *
  * Not tracking tcg_init_ctx in tcg_ctxs[] in softmmu keeps code that iterates
  * over the array (e.g. tcg_code_size() the same for both softmmu and user-mode.
+ *
+ * After tcg_fork_child(), threads first take over the contexts that the
+ * threads of the parent process left behind.
  */
 #ifdef CONFIG_USER_ONLY
 void tcg_register_thread(void)
 {
     tcg_ctx = &tcg_init_ctx;
 }
+
+/*
+ * Point tcg_ctx to a context of the pool that no other thread is using.
+ * While it is claimed the caller may drop the mmap_lock around code
+ * generation, as long as it takes it again before publishing the TB.
+ * Returns false, leaving tcg_ctx at tcg_init_ctx, if all are taken; the
+ * caller must then keep the mmap_lock for the whole translation.
+ *
+ * Called with mmap_lock held, which also protects tcg_ctxs_busy.
+ */
+bool tcg_ctx_claim(void)
+{
+    unsigned long i = find_next_zero_bit(tcg_ctxs_busy, n_tcg_ctxs, 1);
+
+    if (i >= n_tcg_ctxs) {
+        return false;
+    }
+    set_bit(i, tcg_ctxs_busy);
+    tcg_ctx = tcg_ctxs[i];
+    return true;
+}
+
+/* Give back the context claimed by tcg_ctx_claim(), with mmap_lock held */
+void tcg_ctx_release(void)
+{
+    unsigned int i;
+
+    for (i = 1; i < n_tcg_ctxs; i++) {
+        if (tcg_ctxs[i] == tcg_ctx) {
+            clear_bit(i, tcg_ctxs_busy);
+            break;
+        }
+    }
+    tcg_ctx = &tcg_init_ctx;
+}
 #else
+/* tcg_ctxs[] entries whose thread did not survive fork(); region.lock */
+static unsigned int n_tcg_ctxs_orphaned;
+
+void tcg_fork_child(void)
+{
+    n_tcg_ctxs_orphaned = n_tcg_ctxs;
+}
+
 void tcg_register_thread(void)
 {
-    TCGContext *s = g_malloc(sizeof(*s));
-    unsigned int i, n;
+    TCGContext *s;
+    unsigned int n;
     bool err;
 
-    *s = tcg_init_ctx;
-
-    /* Relink mem_base.  */
-    for (i = 0, n = tcg_init_ctx.nb_globals; i < n; ++i) {
-        if (tcg_init_ctx.temps[i].mem_base) {
-            ptrdiff_t b = tcg_init_ctx.temps[i].mem_base - tcg_init_ctx.temps;
-            tcg_debug_assert(b >= 0 && b < n);
-            s->temps[i].mem_base = &s->temps[b];
-        }
+    qemu_mutex_lock(&region.lock);
+    if (n_tcg_ctxs_orphaned) {
+        /* The code of the region the context was using stays valid */
+        tcg_ctx = tcg_ctxs[n_tcg_ctxs - n_tcg_ctxs_orphaned--];
+        qemu_mutex_unlock(&region.lock);
+        return;
     }
+    qemu_mutex_unlock(&region.lock);
 
     /* Claim an entry in tcg_ctxs */
+    s = tcg_context_clone();
     n = atomic_fetch_inc(&n_tcg_ctxs);
     g_assert(n < max_cpus);
     atomic_set(&tcg_ctxs[n], s);
@@ -813,6 +998,21 @@ size_t tcg_tb_phys_invalidate_count(void)
     return total;
 }
 
+void tcg_tb_lookup_ptr_count(size_t *hits, size_t *misses)
+{
+    unsigned int n_ctxs = atomic_read(&n_tcg_ctxs);
+    unsigned int i;
+
+    *hits = 0;
+    *misses = 0;
+    for (i = 0; i < n_ctxs; i++) {
+        const TCGContext *s = atomic_read(&tcg_ctxs[i]);
+
+        *hits += atomic_read(&s->tb_lookup_ptr_hit_count);
+        *misses += atomic_read(&s->tb_lookup_ptr_miss_count);
+    }
+}
+
 /* pool based memory allocation */
 void *tcg_malloc_internal(TCGContext *s, int size)
 {
@@ -820,9 +1020,14 @@ void *tcg_malloc_internal(TCGContext *s, int size)
     int pool_size;
     
     if (size > TCG_POOL_CHUNK_SIZE) {
-        /* big malloc: insert a new pool (XXX: could optimize) */
-        p = g_malloc(sizeof(TCGPool) + size);
-        p->size = size;
+        /* big malloc: insert a new pool, reusing the last TB's if it fits */
+        p = s->pool_large_spare;
+        if (p && p->size >= size) {
+            s->pool_large_spare = NULL;
+        } else {
+            p = g_malloc(sizeof(TCGPool) + size);
+            p->size = size;
+        }
         p->next = s->pool_first_large;
         s->pool_first_large = p;
         return p->data;
@@ -859,7 +1064,13 @@ void tcg_pool_reset(TCGContext *s)
     TCGPool *p, *t;
     for (p = s->pool_first_large; p; p = t) {
         t = p->next;
-        g_free(p);
+        /* a front end that needed a large chunk likely needs it again */
+        if (!s->pool_large_spare || p->size > s->pool_large_spare->size) {
+            g_free(s->pool_large_spare);
+            s->pool_large_spare = p;
+        } else {
+            g_free(p);
+        }
     }
     s->pool_first_large = NULL;
     s->pool_cur = s->pool_end = NULL;
@@ -946,13 +1157,14 @@ void tcg_context_init(TCGContext *s)
 
     tcg_ctx = s;
     /*
-     * In user-mode we simply share the init context among threads, since we
-     * use a single region. See the documentation tcg_region_init() for the
-     * reasoning behind this.
+     * In user-mode the init context is the first of a small pool, which is
+     * filled by tcg_region_init(). See the documentation tcg_region_init()
+     * for the reasoning behind this.
      * In softmmu we will have at most max_cpus TCG threads.
      */
 #ifdef CONFIG_USER_ONLY
-    tcg_ctxs = &tcg_ctx;
+    tcg_ctxs = g_new(TCGContext *, tcg_n_user_ctxs());
+    tcg_ctxs[0] = s;
     n_tcg_ctxs = 1;
 #else
     tcg_ctxs = g_new(TCGContext *, max_cpus);
@@ -1071,9 +1283,34 @@ void tcg_prologue_init(TCGContext *s)
     }
 }
 
+/* Make an arena big enough for the @used entries the last TB needed */
+static void *tcg_arena_fit(void *arena, int *size, int used,
+                           size_t elt_size, int init, int max)
+{
+    int n;
+
+    if (arena && (used <= *size || *size >= max)) {
+        return arena;
+    }
+    n = MAX(*size, init);
+    while (n < used && n < max) {
+        n *= 2;
+    }
+    g_free(arena);
+    *size = n;
+    return g_malloc(n * elt_size);
+}
+
 void tcg_func_start(TCGContext *s)
 {
     tcg_pool_reset(s);
+    s->op_arena = tcg_arena_fit(s->op_arena, &s->op_arena_size,
+                                s->op_arena_used, sizeof(TCGOp),
+                                TCG_OP_ARENA_INIT, TCG_OP_ARENA_MAX);
+    s->op_arena_used = 0;
+    s->label_arena = tcg_arena_fit(s->label_arena, &s->label_arena_size,
+                                   s->nb_labels, sizeof(TCGLabel),
+                                   TCG_LABEL_ARENA_INIT, TCG_LABEL_ARENA_MAX);
     s->nb_temps = s->nb_globals;
 
     /* No temps have been previously allocated for size or locality.  */
@@ -2183,7 +2420,12 @@ static TCGOp *tcg_op_alloc(TCGOpcode opc)
     TCGOp *op;
 
     if (likely(QTAILQ_EMPTY(&s->free_ops))) {
-        op = tcg_malloc(sizeof(TCGOp));
+        if (likely(s->op_arena_used < s->op_arena_size)) {
+            op = &s->op_arena[s->op_arena_used];
+        } else {
+            op = tcg_malloc(sizeof(TCGOp));
+        }
+        s->op_arena_used++;
     } else {
         op = QTAILQ_FIRST(&s->free_ops);
         QTAILQ_REMOVE(&s->free_ops, op, link);
@@ -261,6 +261,16 @@ typedef struct TCGPool {
 
 #define TCG_POOL_CHUNK_SIZE 32768
 
+/*
+ * Ops and labels are taken from per-context arrays that are reused for
+ * every TB, so that emission order is also memory order.  The arrays
+ * grow at the start of the next TB when one overflowed into the pool.
+ */
+#define TCG_OP_ARENA_INIT     1024
+#define TCG_OP_ARENA_MAX      (64 * 1024)
+#define TCG_LABEL_ARENA_INIT  64
+#define TCG_LABEL_ARENA_MAX   4096
+
 #define TCG_MAX_TEMPS 512
 #define TCG_MAX_INSNS 512
 
@@ -651,6 +661,12 @@ typedef struct TCGProfile {
 struct TCGContext {
     uint8_t *pool_cur, *pool_end;
     TCGPool *pool_first, *pool_current, *pool_first_large;
+    TCGPool *pool_large_spare;  /* biggest large chunk of the last TB */
+    TCGOp *op_arena;
+    int op_arena_size;
+    int op_arena_used;          /* may exceed op_arena_size */
+    TCGLabel *label_arena;
+    int label_arena_size;
     int nb_labels;
     int nb_globals;
     int nb_temps;
@@ -697,6 +713,11 @@ struct TCGContext {
 
     size_t tb_phys_invalidate_count;
 
+    /* Indirect jumps resolved by helper_lookup_tb_ptr without (hit) or
+       with (miss) a return to the main loop */
+    size_t tb_lookup_ptr_hit_count;
+    size_t tb_lookup_ptr_miss_count;
+
     /* Track which vCPU triggers events */
     CPUState *cpu;                      /* *_trans */
 
@@ -859,13 +880,17 @@ static inline bool tcg_op_buf_full(void)
 
 /* pool based memory allocation */
 
-/* user-mode: mmap_lock must be held for tcg_malloc_internal. */
+/*
+ * user-mode: mmap_lock must be held for tcg_malloc_internal, unless
+ * tcg_ctx was claimed with tcg_ctx_claim().
+ */
 void *tcg_malloc_internal(TCGContext *s, int size);
 void tcg_pool_reset(TCGContext *s);
 TranslationBlock *tcg_tb_alloc(TCGContext *s);
 
 void tcg_region_init(void);
 void tcg_region_reset_all(void);
+bool tcg_region_evict(GTraverseFunc func, gpointer user_data);
 
 size_t tcg_code_size(void);
 size_t tcg_code_capacity(void);
@@ -873,11 +898,12 @@ size_t tcg_code_capacity(void);
 void tcg_tb_insert(TranslationBlock *tb);
 void tcg_tb_remove(TranslationBlock *tb);
 size_t tcg_tb_phys_invalidate_count(void);
+void tcg_tb_lookup_ptr_count(size_t *hits, size_t *misses);
 TranslationBlock *tcg_tb_lookup(uintptr_t tc_ptr);
 void tcg_tb_foreach(GTraverseFunc func, gpointer user_data);
 size_t tcg_nb_tbs(void);
 
-/* user-mode: Called with mmap_lock held.  */
+/* user-mode: Called with mmap_lock held, or tcg_ctx claimed.  */
 static inline void *tcg_malloc(int size)
 {
     TCGContext *s = tcg_ctx;
@@ -898,6 +924,14 @@ static inline void *tcg_malloc(int size)
 
 void tcg_context_init(TCGContext *s);
 void tcg_register_thread(void);
+#ifndef CONFIG_USER_ONLY
+/* Called in the child after fork(), before any vCPU thread is started */
+void tcg_fork_child(void);
+#endif
+#ifdef CONFIG_USER_ONLY
+bool tcg_ctx_claim(void);
+void tcg_ctx_release(void);
+#endif
 void tcg_prologue_init(TCGContext *s);
 void tcg_func_start(TCGContext *s);
 
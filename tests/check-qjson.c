@@ -16,6 +16,7 @@
 #include "qapi/error.h"
 #include "qapi/qmp/qbool.h"
 #include "qapi/qmp/qjson.h"
+#include "qapi/qmp/json-streamer.h"
 #include "qapi/qmp/qlit.h"
 #include "qapi/qmp/qnull.h"
 #include "qapi/qmp/qnum.h"
@@ -1417,6 +1418,43 @@ static void limits_nesting(void)
     g_assert(obj == NULL);
 }
 
+static void split_message_emit(void *opaque, QObject *json, Error *err)
+{
+    QObject **result = opaque;
+
+    g_assert(!err);
+    g_assert(!*result);
+    *result = json;
+}
+
+static void split_message(void)
+{
+    const char *json = "{ \"str\": \"a\\\"b\\u00e9c\\n\", 'sq': 'x y',"
+                       " \"num\": [ -12345, 1.5e10, 0 ], \"kw\": true }";
+    size_t len = strlen(json);
+    JSONMessageParser parser;
+    QObject *expected, *obj;
+    size_t chunk, i;
+
+    expected = qobject_from_json(json, &error_abort);
+    g_assert(expected);
+
+    /* Token boundaries must not depend on how the input is split */
+    for (chunk = 1; chunk <= len; chunk++) {
+        obj = NULL;
+        json_message_parser_init(&parser, split_message_emit, &obj, NULL);
+        for (i = 0; i < len; i += chunk) {
+            json_message_parser_feed(&parser, json + i, MIN(chunk, len - i));
+        }
+        json_message_parser_flush(&parser);
+        json_message_parser_destroy(&parser);
+
+        g_assert(qobject_is_equal(obj, expected));
+        qobject_unref(obj);
+    }
+    qobject_unref(expected);
+}
+
 int main(int argc, char **argv)
 {
     g_test_init(&argc, &argv, NULL);
@@ -1455,5 +1493,7 @@ int main(int argc, char **argv)
     g_test_add_func("/errors/unterminated/literal", unterminated_literal);
     g_test_add_func("/errors/limits/nesting", limits_nesting);
 
+    g_test_add_func("/stream/split_message", split_message);
+
     return g_test_run();
 }
@@ -0,0 +1,202 @@
+/*
+ * QTest memory dispatch benchmark
+ *
+ * Measures accesses to RAM, ROM, an alias and MMIO through the qtest
+ * protocol, and how long a FlatView rebuild takes depending on how
+ * many PCI BARs are mapped.  Every qtest access is a round trip over
+ * the qtest socket, so absolute times mostly measure the protocol;
+ * the interesting numbers are the differences, which are reported as
+ * well: MMIO minus RAM is the cost of dispatching to a device, and a
+ * PCI_COMMAND write that unmaps a BAR minus one that changes nothing
+ * is the cost of rebuilding the memory map.
+ *
+ * Results are reported with g_test_minimized_result(), which gtester
+ * records in its XML log ("make check-report.xml SPEED=perf"), and
+ * printed one per line as "memory-bench,<name>,<value>,<unit>".
+ * Without -m perf only a few iterations are done, to keep the
+ * benchmark working as a test.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "libqtest.h"
+#include "libqos/pci-pc.h"
+#include "hw/pci/pci.h"
+#include "hw/pci/pci_regs.h"
+
+#define RAM_ADDR        0x100000        /* ram-below-4g */
+#define ROM_ADDR        0xfffffff0      /* pc.bios */
+#define ROM_ALIAS_ADDR  0xffff0         /* isa-bios, an alias of pc.bios */
+
+static int iterations(void)
+{
+    return g_test_perf() ? 20000 : 200;
+}
+
+static void report(const char *name, double value, const char *unit)
+{
+    g_test_minimized_result(value, "%s %.1f %s", name, value, unit);
+    g_print("memory-bench,%s,%.1f,%s\n", name, value, unit);
+}
+
+/* Average time per readl of @addr, in ns */
+static double time_readl(uint64_t addr, int n)
+{
+    int i;
+
+    g_test_timer_start();
+    for (i = 0; i < n; i++) {
+        readl(addr);
+    }
+    return g_test_timer_elapsed() * 1e9 / n;
+}
+
+typedef struct PCIDevs {
+    QPCIDevice *devs[32];
+    QPCIBar bars[32];
+    int n;
+} PCIDevs;
+
+static void add_testdev(QPCIDevice *dev, int devfn, void *opaque)
+{
+    PCIDevs *d = opaque;
+
+    g_assert_cmpint(d->n, <, ARRAY_SIZE(d->devs));
+    d->bars[d->n] = qpci_iomap(dev, 0, NULL);
+    qpci_device_enable(dev);
+    d->devs[d->n++] = dev;
+}
+
+static QPCIBus *start_with_testdevs(int count, PCIDevs *d)
+{
+    GString *args = g_string_new("-machine pc -m 128");
+    QPCIBus *bus;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        g_string_append(args, " -device pci-testdev");
+    }
+    qtest_start(args->str);
+    g_string_free(args, true);
+
+    bus = qpci_init_pc(global_qtest, NULL);
+    d->n = 0;
+    qpci_device_foreach(bus, PCI_VENDOR_ID_REDHAT, PCI_DEVICE_ID_REDHAT_TEST,
+                        add_testdev, d);
+    g_assert_cmpint(d->n, ==, count);
+    return bus;
+}
+
+static void stop(QPCIBus *bus, PCIDevs *d)
+{
+    int i;
+
+    for (i = 0; i < d->n; i++) {
+        g_free(d->devs[i]);
+    }
+    qpci_free_pc(bus);
+    qtest_end();
+}
+
+static void test_dispatch(void)
+{
+    int n = iterations();
+    PCIDevs d;
+    QPCIBus *bus = start_with_testdevs(1, &d);
+    double ram, rom, alias, mmio, pio;
+    uint8_t *buf;
+    int i;
+
+    ram = time_readl(RAM_ADDR, n);
+    rom = time_readl(ROM_ADDR, n);
+    alias = time_readl(ROM_ALIAS_ADDR, n);
+    mmio = time_readl(d.bars[0].addr, n);
+
+    g_test_timer_start();
+    for (i = 0; i < n; i++) {
+        inl(0xcf8);
+    }
+    pio = g_test_timer_elapsed() * 1e9 / n;
+
+    report("readl-ram", ram, "ns");
+    report("readl-rom", rom, "ns");
+    report("readl-rom-alias", alias, "ns");
+    report("readl-mmio", mmio, "ns");
+    report("inl-pio", pio, "ns");
+    report("mmio-over-ram", mmio - ram, "ns");
+
+    /* One large memread is a single address_space_read of RAM */
+    buf = g_malloc(1 * MiB);
+    g_test_timer_start();
+    for (i = 0; i < n / 100 + 1; i++) {
+        memread(RAM_ADDR, buf, 1 * MiB);
+    }
+    report("memread-ram-1M",
+           g_test_timer_elapsed() * 1e6 / (n / 100 + 1), "us");
+    g_free(buf);
+
+    stop(bus, &d);
+}
+
+static void test_flatview_rebuild(gconstpointer data)
+{
+    int count = GPOINTER_TO_INT(data);
+    int n = iterations() / 10;
+    PCIDevs d;
+    QPCIBus *bus = start_with_testdevs(count, &d);
+    QPCIDevice *dev;
+    uint16_t cmd;
+    double same, toggle;
+    char *name;
+    int i;
+
+    dev = d.devs[0];
+    cmd = qpci_config_readw(dev, PCI_COMMAND);
+
+    g_test_timer_start();
+    for (i = 0; i < n; i++) {
+        qpci_config_writew(dev, PCI_COMMAND, cmd);
+        qpci_config_writew(dev, PCI_COMMAND, cmd);
+    }
+    same = g_test_timer_elapsed() * 1e9 / (2 * n);
+
+    /* Each write maps or unmaps both BARs and commits a transaction */
+    g_test_timer_start();
+    for (i = 0; i < n; i++) {
+        qpci_config_writew(dev, PCI_COMMAND,
+                           cmd & ~(PCI_COMMAND_MEMORY | PCI_COMMAND_IO));
+        qpci_config_writew(dev, PCI_COMMAND, cmd);
+    }
+    toggle = g_test_timer_elapsed() * 1e9 / (2 * n);
+
+    g_assert_cmphex(qpci_config_readw(dev, PCI_COMMAND), ==, cmd);
+
+    name = g_strdup_printf("flatview-rebuild-%d-devs", count);
+    report(name, toggle - same, "ns");
+    g_free(name);
+
+    stop(bus, &d);
+}
+
+int main(int argc, char **argv)
+{
+    static const int counts[] = { 1, 8, 24 };
+    char *name;
+    int i;
+
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/memory-bench/dispatch", test_dispatch);
+    for (i = 0; i < ARRAY_SIZE(counts); i++) {
+        name = g_strdup_printf("/memory-bench/flatview-rebuild/%d",
+                               counts[i]);
+        qtest_add_data_func(name, GINT_TO_POINTER(counts[i]),
+                            test_flatview_rebuild);
+        g_free(name);
+    }
+
+    return g_test_run();
+}
@@ -0,0 +1,229 @@
+/*
+ * QTest migration benchmark
+ *
+ * Migrates a guest whose RAM is dirtied by the x-dirty-gen device to a
+ * second QEMU over a UNIX socket, and reports total time, downtime,
+ * throughput and the number of dirty bitmap syncs (iterations).  Each
+ * test case enables a different set of migration features.
+ *
+ * The workload can be changed with environment variables:
+ *   MIGRATION_BENCH_MEM      guest RAM size (default 256M)
+ *   MIGRATION_BENCH_SIZE     size of the dirtied region (default 64M)
+ *   MIGRATION_BENCH_RATE     pages dirtied per second (default 20000)
+ *   MIGRATION_BENCH_PATTERN  seq, random or hotspot (default random)
+ *
+ * Results are printed one per line as
+ * "migration-bench,<case>,<metric>,<value>" and the times are also
+ * reported with g_test_minimized_result().  Without -m perf only the
+ * plain precopy case runs, with a small guest.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest.h"
+#include "qapi/qmp/qdict.h"
+
+#define TIMEOUT_SECS 60
+
+typedef struct BenchCase {
+    const char *name;
+    const char *capability;
+    const char *parameter;
+    const char *value;
+} BenchCase;
+
+static const BenchCase cases[] = {
+    { "precopy" },
+    { "xbzrle", "xbzrle", "xbzrle-cache-size", "67108864" },
+    { "compress", "compress", "compress-threads", "4" },
+    { "multifd-4", "x-multifd", "x-multifd-channels", "4" },
+};
+
+static char *tmpdir;
+
+static const char *env_or(const char *name, const char *def)
+{
+    const char *val = getenv(name);
+
+    return val && *val ? val : def;
+}
+
+/* Discard events, they can get in the way of the responses */
+static QDict *bench_qmp(QTestState *who, const char *command)
+{
+    QDict *rsp = qtest_qmp(who, command);
+
+    while (qdict_haskey(rsp, "event")) {
+        qobject_unref(rsp);
+        rsp = qtest_qmp_receive(who);
+    }
+    return rsp;
+}
+
+static void bench_qmp_ok(QTestState *who, const char *command)
+{
+    QDict *rsp = bench_qmp(who, command);
+
+    g_assert(qdict_haskey(rsp, "return"));
+    qobject_unref(rsp);
+}
+
+static void set_capability(QTestState *who, const char *capability)
+{
+    char *cmd = g_strdup_printf("{ 'execute': 'migrate-set-capabilities',"
+                                "  'arguments': { 'capabilities': [ {"
+                                "  'capability': '%s', 'state': true } ] } }",
+                                capability);
+
+    bench_qmp_ok(who, cmd);
+    g_free(cmd);
+}
+
+static void set_parameter(QTestState *who, const char *parameter,
+                          const char *value)
+{
+    char *cmd = g_strdup_printf("{ 'execute': 'migrate-set-parameters',"
+                                "  'arguments': { '%s': %s } }",
+                                parameter, value);
+
+    bench_qmp_ok(who, cmd);
+    g_free(cmd);
+}
+
+static QDict *query_migrate(QTestState *who)
+{
+    QDict *rsp = bench_qmp(who, "{ 'execute': 'query-migrate' }");
+    QDict *ret = qdict_get_qdict(rsp, "return");
+
+    g_assert(ret);
+    qobject_ref(ret);
+    qobject_unref(rsp);
+    return ret;
+}
+
+static uint64_t dirty_pages_written(QTestState *who)
+{
+    QDict *rsp = bench_qmp(who, "{ 'execute': 'qom-get', 'arguments': {"
+                           " 'path': '/machine/peripheral/gen',"
+                           " 'property': 'written' } }");
+    uint64_t written = qdict_get_int(rsp, "return");
+
+    qobject_unref(rsp);
+    return written;
+}
+
+static void report(const char *name, const char *metric, double value)
+{
+    g_print("migration-bench,%s,%s,%.1f\n", name, metric, value);
+}
+
+static void test_migration_bench(gconstpointer opaque)
+{
+    const BenchCase *c = opaque;
+    bool perf = g_test_perf();
+    const char *mem = env_or("MIGRATION_BENCH_MEM", perf ? "256M" : "64M");
+    const char *size = env_or("MIGRATION_BENCH_SIZE", perf ? "64M" : "16M");
+    const char *rate = env_or("MIGRATION_BENCH_RATE", "20000");
+    const char *pattern = env_or("MIGRATION_BENCH_PATTERN", "random");
+    char *uri = g_strdup_printf("unix:%s/migsocket", tmpdir);
+    QTestState *from, *to;
+    QDict *info, *ram;
+    char *status = NULL;
+    uint64_t written;
+    int64_t deadline;
+    char *cmd;
+
+    from = qtest_startf("-m %s -device x-dirty-gen,id=gen,size=%s,rate=%s,"
+                        "pattern=%s", mem, size, rate, pattern);
+    to = qtest_startf("-m %s -incoming %s", mem, uri);
+
+    if (c->capability) {
+        set_capability(from, c->capability);
+        set_capability(to, c->capability);
+        set_parameter(from, c->parameter, c->value);
+        set_parameter(to, c->parameter, c->value);
+    }
+    /* Let the link, not the rate limit, bound the throughput */
+    set_parameter(from, "max-bandwidth", "100000000000");
+
+    /* Let the workload reach its rate before starting */
+    g_usleep(200 * 1000);
+    written = dirty_pages_written(from);
+
+    cmd = g_strdup_printf("{ 'execute': 'migrate',"
+                          "  'arguments': { 'uri': '%s' } }", uri);
+    bench_qmp_ok(from, cmd);
+    g_free(cmd);
+
+    deadline = g_get_monotonic_time() + TIMEOUT_SECS * G_USEC_PER_SEC;
+    for (;;) {
+        info = query_migrate(from);
+        g_free(status);
+        status = g_strdup(qdict_get_str(info, "status"));
+        g_assert_cmpstr(status, !=, "failed");
+        if (!strcmp(status, "completed") ||
+            g_get_monotonic_time() > deadline) {
+            break;
+        }
+        qobject_unref(info);
+        g_usleep(10 * 1000);
+    }
+
+    if (strcmp(status, "completed")) {
+        report(c->name, "converged", 0);
+        bench_qmp_ok(from, "{ 'execute': 'migrate_cancel' }");
+    } else {
+        double total = qdict_get_int(info, "total-time");
+        double downtime = qdict_get_int(info, "downtime");
+
+        ram = qdict_get_qdict(info, "ram");
+        report(c->name, "converged", 1);
+        report(c->name, "total-time-ms", total);
+        report(c->name, "downtime-ms", downtime);
+        report(c->name, "setup-time-ms", qdict_get_int(info, "setup-time"));
+        report(c->name, "iterations", qdict_get_int(ram, "dirty-sync-count"));
+        report(c->name, "transferred-bytes",
+               qdict_get_int(ram, "transferred"));
+        report(c->name, "mbps", qdict_get_number(ram, "mbps"));
+        report(c->name, "dirty-pages-per-sec",
+               (dirty_pages_written(from) - written) * 1000.0 / total);
+        g_test_minimized_result(total / 1000, "%s total %.0f ms",
+                                c->name, total);
+        g_test_minimized_result(downtime / 1000, "%s downtime %.0f ms",
+                                c->name, downtime);
+    }
+
+    qobject_unref(info);
+    g_free(status);
+    qtest_quit(from);
+    qtest_quit(to);
+    unlink(uri + strlen("unix:"));
+    g_free(uri);
+}
+
+int main(int argc, char **argv)
+{
+    char template[] = "/tmp/migration-bench-XXXXXX";
+    char *name;
+    int ret, i;
+
+    g_test_init(&argc, &argv, NULL);
+
+    tmpdir = mkdtemp(template);
+    g_assert(tmpdir);
+
+    for (i = 0; i < ARRAY_SIZE(cases); i++) {
+        if (i && !g_test_perf()) {
+            break;
+        }
+        name = g_strdup_printf("/migration-bench/%s", cases[i].name);
+        qtest_add_data_func(name, &cases[i], test_migration_bench);
+        g_free(name);
+    }
+
+    ret = g_test_run();
+    rmdir(tmpdir);
+    return ret;
+}
@@ -60,6 +60,7 @@ static uint64_t resize_threshold;
 
 static size_t qht_n_elems = DEFAULT_QHT_N_ELEMS;
 static int qht_mode;
+static bool populate_bulk;
 
 static bool test_start;
 static bool test_stop;
@@ -81,6 +82,8 @@ static const char commands_string[] =
     "\n"
     " -u = update rate (0.0 to 100.0), 50/50 split of insertions/removals\n"
     "\n"
+    " -b = populate the table with qht_insert_bulk\n"
+    "\n"
     " -R = enable auto-resize\n"
     " -S = resize rate (0.0 to 100.0)\n"
     " -D = delay (in us) between potential resizes\n"
@@ -258,6 +261,7 @@ static void pr_params(void)
     printf(" initial size hint: %zu\n", qht_n_elems);
     printf(" auto-resize:       %s\n",
            qht_mode & QHT_MODE_AUTO_RESIZE ? "on" : "off");
+    printf(" bulk populate:     %s\n", populate_bulk ? "on" : "off");
     if (resize_rate) {
         printf(" resize_rate:       %f%%\n", resize_rate * 100.0);
         printf(" resize range:      %zu-%zu\n", resize_min, resize_max);
@@ -314,6 +318,27 @@ static void htable_init(void)
     pr_params();
 
     fprintf(stderr, "Initialization: populating %zu items...", init_size);
+    if (populate_bulk) {
+        void **ps = g_new(void *, init_size);
+        uint32_t *hashes = g_new(uint32_t, init_size);
+        size_t n = 0;
+
+        while (n < init_size) {
+            size_t batch = init_size - n;
+
+            for (i = 0; i < batch; i++) {
+                r = xorshift64star(r);
+                ps[i] = &keys[r & (init_range - 1)];
+                hashes[i] = h(*(long *)ps[i]);
+            }
+            n += qht_insert_bulk(&ht, ps, hashes, batch);
+            retries++;
+        }
+        g_free(hashes);
+        g_free(ps);
+        fprintf(stderr, " populated after %zu bulk insertions\n", retries);
+        return;
+    }
     for (i = 0; i < init_size; i++) {
         for (;;) {
             uint32_t hash;
@@ -362,6 +387,15 @@ static void pr_stats(void)
 
     printf("Results:\n");
 
+    if (qht_mode & QHT_MODE_AUTO_RESIZE || resize_rate) {
+        struct qht_stats hst;
+
+        qht_statistics_init(&ht, &hst);
+        printf(" Head buckets:      %zu (%zu entries)\n",
+               hst.head_buckets, hst.entries);
+        qht_statistics_destroy(&hst);
+    }
+
     if (resize_rate) {
         printf(" Resizes:           %zu (%.2f%% of %zu)\n",
                s.rz, (double)s.rz / (s.rz + s.not_rz) * 100, s.rz + s.not_rz);
@@ -412,11 +446,14 @@ static void parse_args(int argc, char *argv[])
     int c;
 
     for (;;) {
-        c = getopt(argc, argv, "d:D:g:k:K:l:hn:N:o:r:Rs:S:u:");
+        c = getopt(argc, argv, "bd:D:g:k:K:l:hn:N:o:r:Rs:S:u:");
         if (c < 0) {
             break;
         }
         switch (c) {
+        case 'b':
+            populate_bulk = true;
+            break;
         case 'd':
             duration = atoi(optarg);
             break;
@@ -330,6 +330,8 @@ static bool query_is_blacklisted(const char *cmd)
         /* Success depends on Host or Hypervisor SEV support */
         "query-sev",
         "query-sev-capabilities",
+        /* Success depends on accel=tcg */
+        "query-tlb-stats",
         NULL
     };
     int i;
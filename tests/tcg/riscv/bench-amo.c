@@ -0,0 +1,68 @@
+/*
+ * Contended atomics: amoadd.w and an lr.w/sc.w retry loop on shared
+ * counters from several threads.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * later. See the COPYING file in the top-level directory.
+ */
+
+#include <pthread.h>
+#include "bench.h"
+
+#define THREADS 4
+#define ITERS   100000
+
+static uint32_t amo_counter;
+static uint32_t lrsc_counter;
+
+static void *amo_thread(void *arg)
+{
+    int i;
+
+    for (i = 0; i < ITERS; i++) {
+        __atomic_fetch_add(&amo_counter, 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+static void *lrsc_thread(void *arg)
+{
+    uint32_t tmp, fail;
+    int i;
+
+    for (i = 0; i < ITERS; i++) {
+        asm volatile("1:\n\t"
+                     "lr.w   %0, (%2)\n\t"
+                     "addi   %0, %0, 1\n\t"
+                     "sc.w   %1, %0, (%2)\n\t"
+                     "bnez   %1, 1b"
+                     : "=&r" (tmp), "=&r" (fail)
+                     : "r" (&lrsc_counter)
+                     : "memory");
+    }
+    return NULL;
+}
+
+static void run(const char *name, void *(*fn)(void *), uint32_t *counter)
+{
+    pthread_t threads[THREADS];
+    BenchTimer t;
+    int i;
+
+    bench_start(&t);
+    for (i = 0; i < THREADS; i++) {
+        pthread_create(&threads[i], NULL, fn, NULL);
+    }
+    for (i = 0; i < THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    bench_stop(&t, name, (uint64_t)THREADS * ITERS);
+    bench_check(name, *counter, (uint64_t)THREADS * ITERS);
+}
+
+int main(void)
+{
+    run("amoadd", amo_thread, &amo_counter);
+    run("lr-sc", lrsc_thread, &lrsc_counter);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,95 @@
+/*
+ * Indirect branches: calls through a function pointer table and a
+ * switch-based bytecode interpreter, neither of which can be chained
+ * directly from TB to TB.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * later. See the COPYING file in the top-level directory.
+ */
+
+#include "bench.h"
+
+#define CALL_ITERS   1000000
+#define SWITCH_ITERS 500000
+
+typedef uint32_t (*OpFn)(uint32_t);
+
+static uint32_t op_inc(uint32_t x) { return x + 1; }
+static uint32_t op_xor(uint32_t x) { return x ^ 0x5a5a5a5a; }
+static uint32_t op_mul(uint32_t x) { return x * 3; }
+static uint32_t op_rot(uint32_t x) { return (x >> 3) | (x << 29); }
+static uint32_t op_sub(uint32_t x) { return x - 0x12345; }
+static uint32_t op_not(uint32_t x) { return ~x; }
+static uint32_t op_mix(uint32_t x) { return x + (x >> 5); }
+static uint32_t op_mul2(uint32_t x) { return x * 0x10001; }
+
+static const OpFn ops[8] = {
+    op_inc, op_xor, op_mul, op_rot, op_sub, op_not, op_mix, op_mul2
+};
+
+static uint32_t indirect_calls(uint32_t n)
+{
+    uint32_t x = 1, i;
+
+    for (i = 0; i < n; i++) {
+        x = ops[(x ^ i) & 7](x);
+    }
+    return x;
+}
+
+static const uint8_t prog[16] = {
+    0, 3, 1, 5, 2, 7, 4, 6, 1, 0, 2, 3, 7, 5, 6, 4
+};
+
+static uint32_t interpreter(uint32_t n)
+{
+    uint32_t acc = 0, i;
+
+    for (i = 0; i < n; i++) {
+        switch (prog[(i + acc) & 15]) {
+        case 0:
+            acc += i;
+            break;
+        case 1:
+            acc ^= i << 1;
+            break;
+        case 2:
+            acc *= 5;
+            break;
+        case 3:
+            acc >>= 1;
+            break;
+        case 4:
+            acc -= i;
+            break;
+        case 5:
+            acc |= 1;
+            break;
+        case 6:
+            acc += 0x777;
+            break;
+        default:
+            acc ^= acc >> 7;
+            break;
+        }
+    }
+    return acc;
+}
+
+int main(void)
+{
+    BenchTimer t;
+    uint64_t r;
+
+    bench_start(&t);
+    r = indirect_calls(CALL_ITERS);
+    bench_stop(&t, "indirect-call", CALL_ITERS);
+    bench_check("indirect-call", r, 0x7fa7af70);
+
+    bench_start(&t);
+    r = interpreter(SWITCH_ITERS);
+    bench_stop(&t, "switch-dispatch", SWITCH_ITERS);
+    bench_check("switch-dispatch", r, 0xaab8a8);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,64 @@
+/*
+ * CSR-heavy code: rounding mode and exception flag updates, as done
+ * around FP library calls, and counter reads.  A frm write changes the
+ * translation flags, so it also measures the cost of the TB exit.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * later. See the COPYING file in the top-level directory.
+ */
+
+#include "bench.h"
+
+#define FCSR_ITERS    200000
+#define COUNTER_ITERS 200000
+
+static uint64_t fcsr_loop(uint32_t n)
+{
+    uint64_t sum = 0;
+    unsigned long rm, flags, fcsr;
+    uint32_t i;
+
+    for (i = 0; i < n; i++) {
+        asm volatile("fsrm %0" : : "r" ((unsigned long)(i % 5)));
+        asm volatile("fsflags %0" : : "r" ((unsigned long)(i & 31)));
+        asm volatile("frrm %0" : "=r" (rm));
+        asm volatile("frflags %0" : "=r" (flags));
+        asm volatile("frcsr %0" : "=r" (fcsr));
+        sum += rm + flags + fcsr;
+    }
+    asm volatile("fscsr zero");
+    return sum;
+}
+
+static int counter_loop(uint32_t n)
+{
+    unsigned long last = 0, now;
+    uint32_t i;
+
+    for (i = 0; i < n; i++) {
+        asm volatile("rdtime %0" : "=r" (now));
+        if ((long)(now - last) < 0) {
+            return 0;
+        }
+        last = now;
+    }
+    return 1;
+}
+
+int main(void)
+{
+    BenchTimer t;
+    uint64_t r;
+
+    bench_start(&t);
+    r = fcsr_loop(FCSR_ITERS);
+    bench_stop(&t, "frm-fflags", FCSR_ITERS);
+    bench_check("frm-fflags", r, 0x1280540);
+
+    bench_start(&t);
+    r = counter_loop(COUNTER_ITERS);
+    bench_stop(&t, "rdtime", COUNTER_ITERS);
+    bench_check("rdtime", r, 1);
+
+    return EXIT_SUCCESS;
+}
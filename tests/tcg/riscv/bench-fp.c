@@ -0,0 +1,69 @@
+/*
+ * Double precision kernels: daxpy, a dot product, sqrt and divide.
+ * All values are small integers, so the results are exact whatever
+ * the evaluation order.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * later. See the COPYING file in the top-level directory.
+ */
+
+#include <math.h>
+#include "bench.h"
+
+#define N    1024
+#define REPS 100
+
+static double x[N], y[N];
+
+static double daxpy_dot(void)
+{
+    double dot = 0;
+    int i, r;
+
+    for (r = 0; r < REPS; r++) {
+        for (i = 0; i < N; i++) {
+            y[i] = y[i] + 2.0 * x[i];
+        }
+    }
+    for (i = 0; i < N; i++) {
+        dot += x[i] * y[i];
+    }
+    return dot;
+}
+
+static double sqrt_div(void)
+{
+    double sum = 0;
+    int i, r;
+
+    for (r = 0; r < REPS; r++) {
+        for (i = 0; i < N; i++) {
+            sum += sqrt(x[i] * x[i]) + (3.0 * x[i]) / 3.0;
+        }
+    }
+    return sum;
+}
+
+int main(void)
+{
+    BenchTimer t;
+    double r;
+    int i;
+
+    for (i = 0; i < N; i++) {
+        x[i] = i;
+        y[i] = N - i;
+    }
+
+    bench_start(&t);
+    r = daxpy_dot();
+    bench_stop(&t, "daxpy-dot", (uint64_t)N * REPS);
+    bench_check("daxpy-dot", (uint64_t)r, 71656921600ull);
+
+    bench_start(&t);
+    r = sqrt_div();
+    bench_stop(&t, "sqrt-div", (uint64_t)N * REPS);
+    bench_check("sqrt-div", (uint64_t)r, 104755200ull);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,60 @@
+/*
+ * Integer loops: shifts, xor and multiplies, then divides and
+ * data-dependent branches.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * later. See the COPYING file in the top-level directory.
+ */
+
+#include "bench.h"
+
+#define XORSHIFT_ITERS 1000000
+#define GCD_ITERS      200000
+
+static uint64_t xorshift(uint64_t n)
+{
+    uint64_t x = 88172645463325252ull, sum = 0, i;
+
+    for (i = 0; i < n; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        sum += (x * 0x9e3779b97f4a7c15ull) >> 32;
+    }
+    return sum ^ x;
+}
+
+static uint32_t gcd_sum(uint32_t n)
+{
+    uint32_t sum = 0, i;
+
+    for (i = 1; i <= n; i++) {
+        uint32_t a = i, b = (i * 7919) % 65521 + 1;
+
+        while (b) {
+            uint32_t t = a % b;
+            a = b;
+            b = t;
+        }
+        sum += a;
+    }
+    return sum;
+}
+
+int main(void)
+{
+    BenchTimer t;
+    uint64_t r;
+
+    bench_start(&t);
+    r = xorshift(XORSHIFT_ITERS);
+    bench_stop(&t, "xorshift-mul", XORSHIFT_ITERS);
+    bench_check("xorshift-mul", r, 0x652b58624ed40db5ull);
+
+    bench_start(&t);
+    r = gcd_sum(GCD_ITERS);
+    bench_stop(&t, "gcd-divrem", GCD_ITERS);
+    bench_check("gcd-divrem", r, 0x16d965);
+
+    return EXIT_SUCCESS;
+}
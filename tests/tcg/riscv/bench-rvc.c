@@ -0,0 +1,54 @@
+/*
+ * A loop made only of compressed instructions, to exercise the
+ * 16-bit decoder and the pc + 2 bookkeeping in the translator.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * later. See the COPYING file in the top-level directory.
+ */
+
+#include "bench.h"
+
+#define ITERS 1000000
+
+#if __riscv_xlen == 32
+#define EXPECTED 0x979066eaull
+#else
+#define EXPECTED 0xa23008e5979066eaull
+#endif
+
+static unsigned long rvc_loop(unsigned long n)
+{
+    register unsigned long a1 asm("a1") = 1;
+    register unsigned long a2 asm("a2") = 1;
+    register unsigned long a3 asm("a3") = 0;
+    register unsigned long a4 asm("a4") = n;
+    register unsigned long a5 asm("a5") = 0;
+
+    asm volatile(".option push\n\t"
+                 ".option rvc\n"
+                 "1:\n\t"
+                 "c.mv   a3, a2\n\t"
+                 "c.add  a2, a1\n\t"
+                 "c.mv   a1, a3\n\t"
+                 "c.xor  a3, a2\n\t"
+                 "c.srli a3, 1\n\t"
+                 "c.add  a5, a3\n\t"
+                 "c.addi a4, -1\n\t"
+                 "c.bnez a4, 1b\n\t"
+                 ".option pop"
+                 : "+r" (a1), "+r" (a2), "+r" (a3), "+r" (a4), "+r" (a5));
+    return a5;
+}
+
+int main(void)
+{
+    BenchTimer t;
+    unsigned long r;
+
+    bench_start(&t);
+    r = rvc_loop(ITERS);
+    bench_stop(&t, "rvc-loop", ITERS);
+    bench_check("rvc-loop", r, EXPECTED);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,81 @@
+/*
+ * Timing support for the RISC-V TCG benchmarks
+ *
+ * Each benchmark checks the result of its kernel, so that it also
+ * works as a test, and prints the host time per iteration and per
+ * guest instruction.  The instruction counts come from rdinstret,
+ * which QEMU only makes exact with the x-insn-count CPU property
+ * (see Makefile.target); without it they are host ticks.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * later. See the COPYING file in the top-level directory.
+ */
+
+#ifndef RISCV_BENCH_H
+#define RISCV_BENCH_H
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+typedef struct BenchTimer {
+    uint64_t ns;
+    uint64_t insns;
+} BenchTimer;
+
+static inline uint64_t bench_rdinstret(void)
+{
+#if __riscv_xlen == 32
+    uint32_t lo, hi, hi2;
+
+    do {
+        asm volatile("rdinstreth %0" : "=r" (hi));
+        asm volatile("rdinstret %0" : "=r" (lo));
+        asm volatile("rdinstreth %0" : "=r" (hi2));
+    } while (hi != hi2);
+    return ((uint64_t)hi << 32) | lo;
+#else
+    uint64_t val;
+
+    asm volatile("rdinstret %0" : "=r" (val));
+    return val;
+#endif
+}
+
+static inline uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static inline void bench_start(BenchTimer *t)
+{
+    t->ns = bench_now_ns();
+    t->insns = bench_rdinstret();
+}
+
+static inline void bench_stop(BenchTimer *t, const char *name,
+                              uint64_t iters)
+{
+    uint64_t insns = bench_rdinstret() - t->insns;
+    uint64_t ns = bench_now_ns() - t->ns;
+
+    printf("%-20s %10" PRIu64 " iters %12" PRIu64 " insns "
+           "%9.2f ns/iter %7.3f ns/insn\n", name, iters, insns,
+           (double)ns / iters, insns ? (double)ns / insns : 0.0);
+}
+
+static inline void bench_check(const char *name, uint64_t got,
+                               uint64_t expected)
+{
+    if (got != expected) {
+        fprintf(stderr, "%s: got 0x%" PRIx64 ", expected 0x%" PRIx64 "\n",
+                name, got, expected);
+        exit(EXIT_FAILURE);
+    }
+}
+
+#endif /* RISCV_BENCH_H */
@@ -58,13 +58,34 @@ static void test_1(void)
     }
 }
 
+static void test_find(void)
+{
+    size_t s, a, o;
+
+    g_assert_cmpuint(buffer_find_nonzero_offset(buffer, sizeof(buffer)), ==,
+                     sizeof(buffer));
+
+    for (a = 1; a <= 64; a++) {
+        for (s = 1; s < 4096; s += 61) {
+            for (o = 0; o < s; o += 7) {
+                buffer[a + o] = 1;
+                g_assert_cmpuint(buffer_find_nonzero_offset(buffer + a, s), ==,
+                                 QEMU_ALIGN_DOWN(o, BUFFER_ZERO_LINE_SIZE));
+                buffer[a + o] = 0;
+            }
+        }
+    }
+}
+
 static void test_2(void)
 {
     if (g_test_perf()) {
         test_1();
+        test_find();
     } else {
         do {
             test_1();
+            test_find();
         } while (test_buffer_is_zero_next_accel());
     }
 }
@@ -672,6 +672,66 @@ static void char_file_test(void)
     char_file_test_internal(NULL, NULL);
 }
 
+#ifndef _WIN32
+static gsize file_length(const char *path)
+{
+    char *contents = NULL;
+    gsize length = 0;
+
+    g_assert(g_file_get_contents(path, &contents, &length, NULL));
+    g_free(contents);
+    return length;
+}
+
+static void char_file_outbuf_test(void)
+{
+    char *tmp_path = g_dir_make_tmp("qemu-test-char.XXXXXX", NULL);
+    char *out = g_build_filename(tmp_path, "out", NULL);
+    ChardevFile file = { .out = out,
+                         .has_outbuf_size = true, .outbuf_size = 8,
+                         .has_outbuf_flush_ms = true, .outbuf_flush_ms = 1 };
+    ChardevBackend backend = { .type = CHARDEV_BACKEND_KIND_FILE,
+                               .u.file.data = &file };
+    ChardevCommon common = { .has_outbuf_size = true, .outbuf_size = 8 };
+    ChardevBackend null_backend = { .type = CHARDEV_BACKEND_KIND_NULL,
+                                    .u.null.data = &common };
+    Error *err = NULL;
+    Chardev *chr;
+    int ret;
+
+    chr = qemu_chardev_new(NULL, TYPE_CHARDEV_FILE, &backend, &error_abort);
+
+    /* small writes stay in the buffer... */
+    ret = qemu_chr_write_all(chr, (uint8_t *)"hello", 5);
+    g_assert_cmpint(ret, ==, 5);
+    g_assert_cmpint(file_length(out), ==, 0);
+
+    /* ...until it fills up... */
+    ret = qemu_chr_write_all(chr, (uint8_t *)" world", 6);
+    g_assert_cmpint(ret, ==, 6);
+    g_assert_cmpint(file_length(out), ==, 8);
+
+    /* ...or the flush timer expires */
+    while (file_length(out) != 11) {
+        main_loop_wait(false);
+    }
+
+    ret = qemu_chr_write_all(chr, (uint8_t *)"!", 1);
+    g_assert_cmpint(ret, ==, 1);
+    object_unref(OBJECT(chr));
+    g_assert_cmpint(file_length(out), ==, 12);
+
+    chr = qemu_chardev_new(NULL, TYPE_CHARDEV_NULL, &null_backend, &err);
+    g_assert(chr == NULL);
+    error_free_or_abort(&err);
+
+    g_unlink(out);
+    g_rmdir(tmp_path);
+    g_free(tmp_path);
+    g_free(out);
+}
+#endif
+
 static void char_null_test(void)
 {
     Error *err = NULL;
@@ -821,6 +881,7 @@ int main(int argc, char **argv)
     g_test_add_func("/char/file", char_file_test);
 #ifndef _WIN32
     g_test_add_func("/char/file-fifo", char_file_fifo_test);
+    g_test_add_func("/char/file-outbuf", char_file_outbuf_test);
 #endif
     g_test_add_func("/char/socket/basic", char_socket_basic_test);
     g_test_add_func("/char/socket/fdpass", char_socket_fdpass_test);
@@ -426,8 +426,9 @@ static void perf_yield(void)
     }
     duration = g_test_timer_elapsed();
 
-    g_test_message("Yield %u iterations: %f s\n",
-        maxcycles, duration);
+    /* Each iteration enters the coroutine and yields back out of it */
+    g_test_message("Yield %u iterations: %f s, %.1f ns per switch\n",
+        maxcycles, duration, duration * 1e9 / (2.0 * maxcycles));
 }
 
 static __attribute__((noinline)) void dummy(unsigned *i)
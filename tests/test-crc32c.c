@@ -0,0 +1,71 @@
+/*
+ * QEMU crc32c test
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/crc32c.h"
+
+static uint8_t buffer[64 * 1024];
+
+/* Bit at a time, straight from the definition */
+static uint32_t crc32c_ref(uint32_t crc, const uint8_t *data, size_t length)
+{
+    int i;
+
+    while (length--) {
+        crc ^= *data++;
+        for (i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (crc & 1 ? 0x82f63b78 : 0);
+        }
+    }
+    return crc ^ 0xffffffff;
+}
+
+static void test_1(void)
+{
+    size_t len, ofs;
+
+    g_assert_cmphex(crc32c(0xffffffff, (const uint8_t *)"123456789", 9),
+                    ==, 0xe3069283);
+
+    /* Cover the alignment prologue, all three loops and the tail */
+    for (ofs = 0; ofs < 16; ofs++) {
+        for (len = 0; len < 1024; len += 7) {
+            g_assert_cmphex(crc32c(0xffffffff, buffer + ofs, len), ==,
+                            crc32c_ref(0xffffffff, buffer + ofs, len));
+        }
+    }
+    for (len = 3 * 256 - 9; len < sizeof(buffer) - 16; len += 3 * 1021) {
+        g_assert_cmphex(crc32c(0x12345678, buffer + 3, len), ==,
+                        crc32c_ref(0x12345678, buffer + 3, len));
+    }
+}
+
+static void test_2(void)
+{
+    if (g_test_perf()) {
+        test_1();
+    } else {
+        do {
+            test_1();
+        } while (test_crc32c_next_accel());
+    }
+}
+
+int main(int argc, char **argv)
+{
+    size_t i;
+
+    g_test_init(&argc, &argv, NULL);
+
+    for (i = 0; i < sizeof(buffer); i++) {
+        buffer[i] = i * 37 + (i >> 8);
+    }
+
+    g_test_add_func("/crc32c/crc32c", test_2);
+
+    return g_test_run();
+}
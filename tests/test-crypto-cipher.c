@@ -781,6 +781,56 @@ static void test_cipher_short_plaintext(void)
     qcrypto_cipher_free(cipher);
 }
 
+static void test_cipher_sectors(const void *opaque)
+{
+    QCryptoCipherMode mode = (uintptr_t)opaque;
+    QCryptoCipher *cipher;
+    uint8_t key[64];
+    uint8_t ivs[8 * 16];
+    uint8_t plaintext[8 * 512];
+    uint8_t ciphertext1[8 * 512];
+    uint8_t ciphertext2[8 * 512];
+    size_t nkey = mode == QCRYPTO_CIPHER_MODE_XTS ? 64 : 32;
+    size_t i;
+
+    for (i = 0; i < sizeof(key); i++) {
+        key[i] = i;
+    }
+    for (i = 0; i < sizeof(ivs); i++) {
+        ivs[i] = i * 7;
+    }
+    for (i = 0; i < sizeof(plaintext); i++) {
+        plaintext[i] = i * 13;
+    }
+
+    cipher = qcrypto_cipher_new(QCRYPTO_CIPHER_ALG_AES_256, mode,
+                                key, nkey, &error_abort);
+
+    /* One sector at a time... */
+    for (i = 0; i < 8; i++) {
+        g_assert(qcrypto_cipher_setiv(cipher, ivs + i * 16, 16,
+                                      &error_abort) == 0);
+        g_assert(qcrypto_cipher_encrypt(cipher, plaintext + i * 512,
+                                        ciphertext1 + i * 512, 512,
+                                        &error_abort) == 0);
+    }
+
+    /* ...must give the same result as all of them at once */
+    g_assert(qcrypto_cipher_encrypt_sectors(cipher, ivs, 16, 512,
+                                            plaintext, ciphertext2,
+                                            sizeof(plaintext),
+                                            &error_abort) == 0);
+    g_assert(memcmp(ciphertext1, ciphertext2, sizeof(ciphertext1)) == 0);
+
+    g_assert(qcrypto_cipher_decrypt_sectors(cipher, ivs, 16, 512,
+                                            ciphertext2, ciphertext2,
+                                            sizeof(ciphertext2),
+                                            &error_abort) == 0);
+    g_assert(memcmp(plaintext, ciphertext2, sizeof(plaintext)) == 0);
+
+    qcrypto_cipher_free(cipher);
+}
+
 int main(int argc, char **argv)
 {
     size_t i;
@@ -801,5 +851,18 @@ int main(int argc, char **argv)
     g_test_add_func("/crypto/cipher/short-plaintext",
                     test_cipher_short_plaintext);
 
+    if (qcrypto_cipher_supports(QCRYPTO_CIPHER_ALG_AES_256,
+                                QCRYPTO_CIPHER_MODE_CBC)) {
+        g_test_add_data_func("/crypto/cipher/sectors/cbc",
+                             (void *)(uintptr_t)QCRYPTO_CIPHER_MODE_CBC,
+                             test_cipher_sectors);
+    }
+    if (qcrypto_cipher_supports(QCRYPTO_CIPHER_ALG_AES_256,
+                                QCRYPTO_CIPHER_MODE_XTS)) {
+        g_test_add_data_func("/crypto/cipher/sectors/xts",
+                             (void *)(uintptr_t)QCRYPTO_CIPHER_MODE_XTS,
+                             test_cipher_sectors);
+    }
+
     return g_test_run();
 }
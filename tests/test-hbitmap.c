@@ -914,6 +914,51 @@ static void test_hbitmap_serialize_zeroes(TestHBitmapData *data,
     }
 }
 
+static void test_hbitmap_serialize_or(TestHBitmapData *data,
+                                      const void *unused)
+{
+    int i;
+    size_t buf_size;
+    uint8_t *buf;
+    HBitmapIter iter;
+    int64_t next, count = 0;
+    uint64_t stored[] = { 0, L1, L2 + 1, L3 - 1 };
+    uint64_t live[] = { 1, L1, L2 - 1 };
+
+    hbitmap_test_init(data, L3, 0);
+    buf_size = hbitmap_serialization_size(data->hb, 0, data->size);
+    buf = g_malloc0(buf_size);
+
+    for (i = 0; i < ARRAY_SIZE(stored); i++) {
+        hbitmap_set(data->hb, stored[i], 1);
+    }
+    hbitmap_serialize_part(data->hb, buf, 0, data->size);
+    hbitmap_reset_all(data->hb);
+
+    for (i = 0; i < ARRAY_SIZE(live); i++) {
+        hbitmap_set(data->hb, live[i], 1);
+    }
+    hbitmap_deserialize_or(data->hb, buf, 0, data->size);
+
+    /* L1 is in both sets */
+    g_assert_cmpint(hbitmap_count(data->hb), ==, 6);
+
+    hbitmap_iter_init(&iter, data->hb, 0);
+    while ((next = hbitmap_iter_next(&iter, true)) >= 0) {
+        count++;
+    }
+    g_assert_cmpint(count, ==, 6);
+
+    for (i = 0; i < ARRAY_SIZE(stored); i++) {
+        g_assert(hbitmap_get(data->hb, stored[i]));
+    }
+    for (i = 0; i < ARRAY_SIZE(live); i++) {
+        g_assert(hbitmap_get(data->hb, live[i]));
+    }
+
+    g_free(buf);
+}
+
 static void hbitmap_test_add(const char *testpath,
                                    void (*test_func)(TestHBitmapData *data, const void *user_data))
 {
@@ -992,6 +1037,32 @@ static void test_hbitmap_next_zero_4(TestHBitmapData *data, const void *unused)
     test_hbitmap_next_zero_do(data, 4);
 }
 
+/* Merge a bitmap with a single range set into the HBitmap.  */
+static void hbitmap_test_merge(TestHBitmapData *data,
+                               uint64_t first, uint64_t count)
+{
+    HBitmap *b = hbitmap_alloc(data->size, data->granularity);
+
+    hbitmap_set(b, first, count);
+    g_assert(hbitmap_merge(data->hb, b));
+    hbitmap_free(b);
+
+    /* Mirror it in the shadow bitmap; this also checks the count */
+    hbitmap_test_set(data, first, count);
+}
+
+static void test_hbitmap_merge(TestHBitmapData *data, const void *unused)
+{
+    hbitmap_test_init(data, L3, 0);
+    hbitmap_test_set(data, 0, L1 + 3);
+    hbitmap_test_set(data, L2 + 7, 2);
+
+    hbitmap_test_merge(data, L1, 10);
+    hbitmap_test_merge(data, L2, L1);
+    hbitmap_test_merge(data, L3 - 1, 1);
+    hbitmap_test_merge(data, 0, L3);
+}
+
 int main(int argc, char **argv)
 {
     g_test_init(&argc, &argv, NULL);
@@ -1049,6 +1120,8 @@ int main(int argc, char **argv)
                      test_hbitmap_serialize_part);
     hbitmap_test_add("/hbitmap/serialize/zeroes",
                      test_hbitmap_serialize_zeroes);
+    hbitmap_test_add("/hbitmap/serialize/or",
+                     test_hbitmap_serialize_or);
 
     hbitmap_test_add("/hbitmap/iter/iter_and_reset",
                      test_hbitmap_iter_and_reset);
@@ -1058,6 +1131,8 @@ int main(int argc, char **argv)
     hbitmap_test_add("/hbitmap/next_zero/next_zero_4",
                      test_hbitmap_next_zero_4);
 
+    hbitmap_test_add("/hbitmap/merge", test_hbitmap_merge);
+
     g_test_run();
 
     return 0;
@@ -20,6 +20,35 @@ static void test_qht(int n_threads, int update_rate, int duration)
     g_assert_cmpint(rc, ==, 0);
 }
 
+/*
+ * Start from a tiny table and let auto-resize grow it while the threads
+ * insert and remove keys from a large range.
+ */
+#define TEST_QHT_GROW_STRING "tests/qht-bench 1>/dev/null 2>&1 -R " \
+    "-s 16 -k 16 -K 16 -l 16 -r 65536 "
+
+static void test_qht_grow(int n_threads, int duration)
+{
+    char *str;
+    int rc;
+
+    str = g_strdup_printf(TEST_QHT_GROW_STRING "-n %d -u 50 -d %d",
+                          n_threads, duration);
+    rc = system(str);
+    g_free(str);
+    g_assert_cmpint(rc, ==, 0);
+}
+
+static void test_2th_grow1s(void)
+{
+    test_qht_grow(2, 1);
+}
+
+static void test_4th_grow5s(void)
+{
+    test_qht_grow(4, 5);
+}
+
 static void test_2th0u1s(void)
 {
     test_qht(2, 0, 1);
@@ -47,9 +76,11 @@ int main(int argc, char *argv[])
     if (g_test_quick()) {
         g_test_add_func("/qht/parallel/2threads-0%updates-1s", test_2th0u1s);
         g_test_add_func("/qht/parallel/2threads-20%updates-1s", test_2th20u1s);
+        g_test_add_func("/qht/parallel/2threads-grow-1s", test_2th_grow1s);
     } else {
         g_test_add_func("/qht/parallel/2threads-0%updates-5s", test_2th0u5s);
         g_test_add_func("/qht/parallel/2threads-20%updates-5s", test_2th20u5s);
+        g_test_add_func("/qht/parallel/4threads-grow-5s", test_4th_grow5s);
     }
     return g_test_run();
 }
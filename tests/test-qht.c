@@ -41,6 +41,25 @@ static void insert(int a, int b)
     }
 }
 
+static void insert_bulk(int a, int b)
+{
+    void **ps = g_new(void *, b - a);
+    uint32_t *hashes = g_new(uint32_t, b - a);
+    int i;
+
+    for (i = a; i < b; i++) {
+        arr[i] = i;
+        ps[i - a] = &arr[i];
+        hashes[i - a] = i;
+    }
+    g_assert_cmpuint(qht_insert_bulk(&ht, ps, hashes, b - a), ==, b - a);
+    /* a second pass finds all of them already there */
+    g_assert_cmpuint(qht_insert_bulk(&ht, ps, hashes, b - a), ==, 0);
+
+    g_free(hashes);
+    g_free(ps);
+}
+
 static void rm(int init, int end)
 {
     int i;
@@ -144,6 +163,13 @@ static void qht_do_test(unsigned int mode, size_t init_entries)
     check_n(0);
     check(0, N, false);
 
+    insert_bulk(0, N);
+    check(0, N, true);
+    check_n(N);
+    iter_check(N);
+    qht_reset(&ht);
+    check_n(0);
+
     qht_destroy(&ht);
 }
 
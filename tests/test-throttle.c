@@ -667,6 +667,48 @@ static void test_accounting(void)
                                 (64.0 / 13)));
 }
 
+static void test_budget(void)
+{
+    ThrottleConfig cfg;
+    double units, bytes;
+
+    throttle_config_init(&cfg);
+    cfg.buckets[THROTTLE_BPS_TOTAL].avg = 2000000;
+    cfg.buckets[THROTTLE_BPS_READ].avg = 1000000;
+    cfg.buckets[THROTTLE_OPS_WRITE].avg = 100000;
+
+    throttle_init(&ts);
+    throttle_timers_init(tt, ctx, QEMU_CLOCK_VIRTUAL,
+                         read_timer_cb, write_timer_cb, &ts);
+    throttle_config(&ts, QEMU_CLOCK_VIRTUAL, &cfg);
+
+    /* The lowest configured rate wins, unconfigured ones keep the cap */
+    units = 64;
+    bytes = 1e12;
+    throttle_budget(&ts, false, SCALE_MS, &units, &bytes);
+    g_assert(double_cmp(units, 64));
+    g_assert(double_cmp(bytes, 1000));
+
+    units = 1000;
+    bytes = 1e12;
+    throttle_budget(&ts, true, SCALE_MS, &units, &bytes);
+    g_assert(double_cmp(units, 100));
+    g_assert(double_cmp(bytes, 2000));
+
+    /* Only configured buckets are charged, and refunds stop at zero */
+    throttle_account_budget(&ts, false, 64, 1000);
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_BPS_TOTAL].level, 1000));
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_BPS_READ].level, 1000));
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_OPS_READ].level, 0));
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_OPS_TOTAL].level, 0));
+
+    throttle_account_budget(&ts, false, -64, -1500);
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_BPS_TOTAL].level, 0));
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_BPS_READ].level, 0));
+
+    throttle_timers_destroy(tt);
+}
+
 static void test_groups(void)
 {
     ThrottleConfig cfg1, cfg2;
@@ -760,6 +802,7 @@ int main(int argc, char **argv)
                     test_iops_size_is_missing_limit);
     g_test_add_func("/throttle/config_functions",   test_config_functions);
     g_test_add_func("/throttle/accounting",         test_accounting);
+    g_test_add_func("/throttle/budget",             test_budget);
     g_test_add_func("/throttle/groups",             test_groups);
     return g_test_run();
 }
@@ -619,6 +619,65 @@ static void test_arr_ptr_prim_0_load(void)
     }
 }
 
+/* test arrays of integers, which are transferred in bulk */
+typedef struct TestIntArrays {
+    uint8_t  u8[3];
+    uint16_t u16[3];
+    int32_t  i32[2];
+    uint64_t u64[2];
+} TestIntArrays;
+
+static const VMStateDescription vmstate_int_arrays = {
+    .name = "test/int_arrays",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (VMStateField[]) {
+        VMSTATE_UINT8_ARRAY(u8, TestIntArrays, 3),
+        VMSTATE_UINT16_ARRAY(u16, TestIntArrays, 3),
+        VMSTATE_INT32_ARRAY(i32, TestIntArrays, 2),
+        VMSTATE_UINT64_ARRAY(u64, TestIntArrays, 2),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static uint8_t wire_int_arrays[] = {
+    /* u8 */  0x01, 0x02, 0x03,
+    /* u16 */ 0x01, 0x02, 0x03, 0x04, 0xff, 0xfe,
+    /* i32 */ 0x00, 0x00, 0x00, 0x2a, 0xff, 0xff, 0xff, 0xfe,
+    /* u64 */ 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+              0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01,
+    QEMU_VM_EOF, /* just to ensure we won't get EOF reported prematurely */
+};
+
+static void test_int_arrays_save(void)
+{
+    TestIntArrays obj = {
+        .u8 = { 1, 2, 3 },
+        .u16 = { 0x0102, 0x0304, 0xfffe },
+        .i32 = { 42, -2 },
+        .u64 = { 0x0102030405060708ULL, 1 },
+    };
+
+    save_vmstate(&vmstate_int_arrays, &obj);
+    compare_vmstate(wire_int_arrays, sizeof(wire_int_arrays));
+}
+
+static void test_int_arrays_load(void)
+{
+    TestIntArrays obj = {};
+
+    save_buffer(wire_int_arrays, sizeof(wire_int_arrays));
+    SUCCESS(load_vmstate_one(&vmstate_int_arrays, &obj, 1, wire_int_arrays,
+                             sizeof(wire_int_arrays)));
+    g_assert_cmpint(obj.u8[2], ==, 3);
+    g_assert_cmpint(obj.u16[0], ==, 0x0102);
+    g_assert_cmpint(obj.u16[2], ==, 0xfffe);
+    g_assert_cmpint(obj.i32[0], ==, 42);
+    g_assert_cmpint(obj.i32[1], ==, -2);
+    g_assert_cmpint(obj.u64[0], ==, 0x0102030405060708ULL);
+    g_assert_cmpint(obj.u64[1], ==, 1);
+}
+
 /* test QTAILQ migration */
 typedef struct TestQtailqElement TestQtailqElement;
 
@@ -880,6 +939,8 @@ int main(int argc, char **argv)
                     test_arr_ptr_prim_0_save);
     g_test_add_func("/vmstate/array/ptr/prim/0/load",
                     test_arr_ptr_prim_0_load);
+    g_test_add_func("/vmstate/array/int/save", test_int_arrays_save);
+    g_test_add_func("/vmstate/array/int/load", test_int_arrays_load);
     g_test_add_func("/vmstate/qtailq/save/saveq", test_save_q);
     g_test_add_func("/vmstate/qtailq/load/loadq", test_load_q);
     g_test_add_func("/vmstate/tmp_struct", test_tmp_struct);
@@ -169,9 +169,11 @@ static void test_encode_decode(void)
 {
     int i;
 
-    for (i = 0; i < 10000; i++) {
-        encode_decode_range();
-    }
+    do {
+        for (i = 0; i < 10000; i++) {
+            encode_decode_range();
+        }
+    } while (test_xbzrle_next_accel());
 }
 
 int main(int argc, char **argv)
@@ -52,7 +52,8 @@ static inline bool trace_event_get_state_static(TraceEvent *ev)
 
 /* it's on fast path, avoid consistency checks (asserts) */
 #define trace_event_get_state_dynamic_by_id(id) \
-    (unlikely(trace_events_enabled_count) && _ ## id ## _DSTATE)
+    (id ## _STATIC_KEY() && \
+     unlikely(trace_events_enabled_count) && _ ## id ## _DSTATE)
 
 static inline bool trace_event_get_state_dynamic(TraceEvent *ev)
 {
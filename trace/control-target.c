@@ -30,6 +30,7 @@ void trace_event_set_state_dynamic_init(TraceEvent *ev, bool state)
             trace_events_enabled_count--;
             *ev->dstate = 0;
         }
+        trace_static_key_update(ev->dstate);
     }
 }
 
@@ -56,6 +57,7 @@ void trace_event_set_state_dynamic(TraceEvent *ev, bool state)
                 trace_events_enabled_count--;
                 *ev->dstate = 0;
             }
+            trace_static_key_update(ev->dstate);
         }
     }
 }
@@ -87,6 +89,7 @@ void trace_event_set_vcpu_state_dynamic(CPUState *vcpu,
             clear_bit(vcpu_id, vcpu->trace_dstate_delayed);
             (*ev->dstate)--;
         }
+        trace_static_key_update(ev->dstate);
         if (vcpu->created) {
             /*
              * Delay changes until next TB; we want all TBs to be built from a
@@ -306,6 +306,7 @@ bool trace_init_backends(void)
     openlog(NULL, LOG_PID, LOG_DAEMON);
 #endif
 
+    trace_static_keys_init();
     return true;
 }
 
@@ -12,6 +12,7 @@
 
 #include "qemu-common.h"
 #include "event-internal.h"
+#include "static-key.h"
 
 typedef struct TraceEventIter {
     size_t event;
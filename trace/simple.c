@@ -11,6 +11,7 @@
 #include "qemu/osdep.h"
 #ifndef _WIN32
 #include <pthread.h>
+#include <sys/mman.h>
 #endif
 #include "qemu/timer.h"
 #include "trace/control.h"
@@ -44,18 +45,50 @@ static bool trace_available;
 static bool trace_writeout_enabled;
 
 enum {
-    TRACE_BUF_LEN = 4096 * 64,
+    TRACE_BUF_LEN = 4096 * 32,
     TRACE_BUF_FLUSH_THRESHOLD = TRACE_BUF_LEN / 4,
 };
 
-uint8_t trace_buf[TRACE_BUF_LEN];
-static volatile gint trace_idx;
-static unsigned int writeout_idx;
-static volatile gint dropped_events;
+/*
+ * Every thread that records events owns a ring, so that tracing does not
+ * bounce a shared index between CPUs.  The owner is the only producer and
+ * the writeout thread the only consumer.  Rings are never freed; the ring
+ * of a thread that exits is taken over by the next thread that needs one.
+ */
+typedef struct TraceRing {
+    uint8_t buf[TRACE_BUF_LEN];
+    volatile gint idx;              /* bumped by the owner */
+    volatile gint writeout_idx;     /* bumped by the writeout thread */
+    volatile gint dropped_events;
+    volatile gint in_use;
+    struct TraceRing *next;
+} TraceRing;
+
+static TraceRing *trace_rings;
+static __thread TraceRing *trace_ring;
+
+static void trace_ring_release(gpointer opaque);
+static GPrivate trace_ring_key = G_PRIVATE_INIT(trace_ring_release);
+
 static uint32_t trace_pid;
 static FILE *trace_fp;
 static char *trace_file_name;
 
+#ifndef _WIN32
+/*
+ * After the header, records are copied straight into a shared mapping of
+ * the trace file, one window at a time, rather than through stdio.  The
+ * file is truncated to the data actually written when tracing stops.
+ */
+enum {
+    TRACE_MAP_LEN = 4 * 1024 * 1024,
+};
+
+static uint8_t *trace_map;
+static off_t trace_map_offset;
+static size_t trace_map_pos;
+#endif
+
 #define TRACE_RECORD_TYPE_MAPPING 0
 #define TRACE_RECORD_TYPE_EVENT   1
 
@@ -75,52 +108,82 @@ typedef struct {
 } TraceLogHeader;
 
 
-static void read_from_buffer(unsigned int idx, void *dataptr, size_t size);
-static unsigned int write_to_buffer(unsigned int idx, void *dataptr, size_t size);
+static void read_from_buffer(TraceRing *ring, unsigned int idx,
+                             void *dataptr, size_t size);
+static unsigned int write_to_buffer(TraceRing *ring, unsigned int idx,
+                                    void *dataptr, size_t size);
 
-static void clear_buffer_range(unsigned int idx, size_t len)
+static void clear_buffer_range(TraceRing *ring, unsigned int idx, size_t len)
 {
-    uint32_t num = 0;
-    while (num < len) {
-        if (idx >= TRACE_BUF_LEN) {
-            idx = idx % TRACE_BUF_LEN;
+    size_t n = MIN(len, TRACE_BUF_LEN - idx);
+
+    memset(&ring->buf[idx], 0, n);
+    memset(&ring->buf[0], 0, len - n);
+}
+
+static void trace_ring_release(gpointer opaque)
+{
+    TraceRing *ring = opaque;
+
+    trace_ring = NULL;
+    g_atomic_int_set(&ring->in_use, 0);
+}
+
+/**
+ * Return the calling thread's ring, claiming or allocating one if needed
+ */
+static TraceRing *trace_ring_get(void)
+{
+    TraceRing *ring = trace_ring;
+
+    if (likely(ring)) {
+        return ring;
+    }
+
+    for (ring = g_atomic_pointer_get(&trace_rings); ring; ring = ring->next) {
+        if (g_atomic_int_compare_and_exchange(&ring->in_use, 0, 1)) {
+            goto out;
         }
-        trace_buf[idx++] = 0;
-        num++;
     }
+
+    /* don't use g_malloc, can deadlock when traced */
+    ring = calloc(1, sizeof(*ring));
+    if (!ring) {
+        return NULL;
+    }
+    ring->in_use = 1;
+    do {
+        ring->next = g_atomic_pointer_get(&trace_rings);
+    } while (!g_atomic_pointer_compare_and_exchange(&trace_rings,
+                                                    ring->next, ring));
+
+out:
+    trace_ring = ring;
+    g_private_set(&trace_ring_key, ring);
+    return ring;
 }
+
 /**
- * Read a trace record from the trace buffer
+ * Read the header of the oldest unwritten record of a ring
  *
- * @idx         Trace buffer index
- * @record      Trace record to fill
+ * @ring        Trace ring
+ * @record      Trace record header to fill
  *
  * Returns false if the record is not valid.
  */
-static bool get_trace_record(unsigned int idx, TraceRecord **recordptr)
+static bool peek_trace_record(TraceRing *ring, TraceRecord *record)
 {
-    uint64_t event_flag = 0;
-    TraceRecord record;
+    unsigned int idx = g_atomic_int_get(&ring->writeout_idx) % TRACE_BUF_LEN;
+
     /* read the event flag to see if its a valid record */
-    read_from_buffer(idx, &record, sizeof(event_flag));
+    read_from_buffer(ring, idx, record, sizeof(record->event));
 
-    if (!(record.event & TRACE_RECORD_VALID)) {
+    if (!(record->event & TRACE_RECORD_VALID)) {
         return false;
     }
 
     smp_rmb(); /* read memory barrier before accessing record */
-    /* read the record header to know record length */
-    read_from_buffer(idx, &record, sizeof(TraceRecord));
-    *recordptr = malloc(record.length); /* don't use g_malloc, can deadlock when traced */
-    /* make a copy of record to avoid being overwritten */
-    read_from_buffer(idx, *recordptr, record.length);
-    smp_rmb(); /* memory barrier before clearing valid flag */
-    (*recordptr)->event &= ~TRACE_RECORD_VALID;
-    /* clear the trace buffer range for consumed record otherwise any byte
-     * with its MSB set may be considered as a valid event id when the writer
-     * thread crosses this range of buffer again.
-     */
-    clear_buffer_range(idx, record.length);
+    read_from_buffer(ring, idx, record, sizeof(TraceRecord));
     return true;
 }
 
@@ -153,41 +216,171 @@ static void wait_for_trace_records_available(void)
     g_mutex_unlock(&trace_lock);
 }
 
+#ifndef _WIN32
+/**
+ * Map the window of the trace file that starts at @offset
+ *
+ * Falls back to stdio if the file cannot be mapped, e.g. because it is a
+ * pipe.
+ */
+static void trace_file_map(off_t offset)
+{
+    int fd = fileno(trace_fp);
+    int unused __attribute__ ((unused));
+    void *map;
+
+    if (trace_map) {
+        munmap(trace_map, TRACE_MAP_LEN);
+        trace_map = NULL;
+    }
+
+    if (ftruncate(fd, offset + TRACE_MAP_LEN) == 0) {
+        map = mmap(NULL, TRACE_MAP_LEN, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   fd, offset);
+        if (map != MAP_FAILED) {
+            trace_map = map;
+            trace_map_offset = offset;
+            trace_map_pos = 0;
+            return;
+        }
+        unused = ftruncate(fd, offset);
+    }
+    fseeko(trace_fp, offset, SEEK_SET);
+}
+
+static void trace_file_map_start(void)
+{
+    off_t offset;
+
+    fflush(trace_fp);
+    offset = ftello(trace_fp);
+    if (offset < 0) {
+        return;
+    }
+
+    trace_file_map(offset & -(off_t)qemu_real_host_page_size);
+    if (trace_map) {
+        trace_map_pos = offset - trace_map_offset;
+    }
+}
+
+static void trace_file_map_end(void)
+{
+    int unused __attribute__ ((unused));
+
+    if (trace_map) {
+        munmap(trace_map, TRACE_MAP_LEN);
+        trace_map = NULL;
+        unused = ftruncate(fileno(trace_fp), trace_map_offset + trace_map_pos);
+    }
+}
+#endif
+
+static void trace_file_write(const void *dataptr, size_t size)
+{
+    const uint8_t *data_ptr = dataptr;
+    size_t unused __attribute__ ((unused));
+
+#ifndef _WIN32
+    while (trace_map && size) {
+        size_t n = MIN(size, TRACE_MAP_LEN - trace_map_pos);
+
+        memcpy(trace_map + trace_map_pos, data_ptr, n);
+        trace_map_pos += n;
+        data_ptr += n;
+        size -= n;
+        if (trace_map_pos == TRACE_MAP_LEN) {
+            trace_file_map(trace_map_offset + TRACE_MAP_LEN);
+        }
+    }
+    if (!size) {
+        return;
+    }
+#endif
+    unused = fwrite(data_ptr, size, 1, trace_fp);
+}
+
+/**
+ * Write out the oldest record of a ring and release its space
+ *
+ * @ring        Trace ring
+ * @record      Header of the record, as returned by peek_trace_record()
+ */
+static void write_trace_record(TraceRing *ring, TraceRecord *record)
+{
+    unsigned int writeout_idx = g_atomic_int_get(&ring->writeout_idx);
+    unsigned int idx = writeout_idx % TRACE_BUF_LEN;
+    unsigned int args = (idx + sizeof(TraceRecord)) % TRACE_BUF_LEN;
+    size_t len = record->length - sizeof(TraceRecord);
+    size_t n = MIN(len, TRACE_BUF_LEN - args);
+    uint64_t type = TRACE_RECORD_TYPE_EVENT;
+
+    record->event &= ~TRACE_RECORD_VALID;
+    trace_file_write(&type, sizeof(type));
+    trace_file_write(record, sizeof(TraceRecord));
+    trace_file_write(&ring->buf[args], n);
+    trace_file_write(&ring->buf[0], len - n);
+
+    smp_mb(); /* finish reading the record before it can be overwritten */
+
+    /* clear the trace buffer range for consumed record otherwise any byte
+     * with its MSB set may be considered as a valid event id when the writer
+     * thread crosses this range of buffer again.
+     */
+    clear_buffer_range(ring, idx, record->length);
+    g_atomic_int_set(&ring->writeout_idx, writeout_idx + record->length);
+}
+
 static gpointer writeout_thread(gpointer opaque)
 {
-    TraceRecord *recordptr;
     union {
         TraceRecord rec;
         uint8_t bytes[sizeof(TraceRecord) + sizeof(uint64_t)];
     } dropped;
-    unsigned int idx = 0;
-    int dropped_count;
-    size_t unused __attribute__ ((unused));
+    TraceRing *ring, *oldest;
+    TraceRecord record, oldest_record = { 0 };
+    int dropped_count, count;
     uint64_t type = TRACE_RECORD_TYPE_EVENT;
 
     for (;;) {
         wait_for_trace_records_available();
 
-        if (g_atomic_int_get(&dropped_events)) {
+        dropped_count = 0;
+        for (ring = g_atomic_pointer_get(&trace_rings); ring;
+             ring = ring->next) {
+            do {
+                count = g_atomic_int_get(&ring->dropped_events);
+            } while (!g_atomic_int_compare_and_exchange(&ring->dropped_events,
+                                                        count, 0));
+            dropped_count += count;
+        }
+
+        if (dropped_count) {
             dropped.rec.event = DROPPED_EVENT_ID,
             dropped.rec.timestamp_ns = get_clock();
             dropped.rec.length = sizeof(TraceRecord) + sizeof(uint64_t),
             dropped.rec.pid = trace_pid;
-            do {
-                dropped_count = g_atomic_int_get(&dropped_events);
-            } while (!g_atomic_int_compare_and_exchange(&dropped_events,
-                                                        dropped_count, 0));
             dropped.rec.arguments[0] = dropped_count;
-            unused = fwrite(&type, sizeof(type), 1, trace_fp);
-            unused = fwrite(&dropped.rec, dropped.rec.length, 1, trace_fp);
+            trace_file_write(&type, sizeof(type));
+            trace_file_write(&dropped.rec, dropped.rec.length);
         }
 
-        while (get_trace_record(idx, &recordptr)) {
-            unused = fwrite(&type, sizeof(type), 1, trace_fp);
-            unused = fwrite(recordptr, recordptr->length, 1, trace_fp);
-            writeout_idx += recordptr->length;
-            free(recordptr); /* don't use g_free, can deadlock when traced */
-            idx = writeout_idx % TRACE_BUF_LEN;
+        /* Merge the rings, so that the file is ordered by timestamp */
+        for (;;) {
+            oldest = NULL;
+            for (ring = g_atomic_pointer_get(&trace_rings); ring;
+                 ring = ring->next) {
+                if (peek_trace_record(ring, &record) &&
+                    (!oldest ||
+                     record.timestamp_ns < oldest_record.timestamp_ns)) {
+                    oldest = ring;
+                    oldest_record = record;
+                }
+            }
+            if (!oldest) {
+                break;
+            }
+            write_trace_record(oldest, &oldest_record);
         }
 
         fflush(trace_fp);
@@ -197,50 +390,63 @@ static gpointer writeout_thread(gpointer opaque)
 
 void trace_record_write_u64(TraceBufferRecord *rec, uint64_t val)
 {
-    rec->rec_off = write_to_buffer(rec->rec_off, &val, sizeof(uint64_t));
+    rec->rec_off = write_to_buffer(rec->ring, rec->rec_off,
+                                   &val, sizeof(uint64_t));
 }
 
 void trace_record_write_str(TraceBufferRecord *rec, const char *s, uint32_t slen)
 {
     /* Write string length first */
-    rec->rec_off = write_to_buffer(rec->rec_off, &slen, sizeof(slen));
+    rec->rec_off = write_to_buffer(rec->ring, rec->rec_off,
+                                   &slen, sizeof(slen));
     /* Write actual string now */
-    rec->rec_off = write_to_buffer(rec->rec_off, (void*)s, slen);
+    rec->rec_off = write_to_buffer(rec->ring, rec->rec_off, (void*)s, slen);
 }
 
 int trace_record_start(TraceBufferRecord *rec, uint32_t event, size_t datasize)
 {
+    TraceRing *ring = trace_ring_get();
     unsigned int idx, rec_off, old_idx, new_idx;
     uint32_t rec_len = sizeof(TraceRecord) + datasize;
     uint64_t event_u64 = event;
     uint64_t timestamp_ns = get_clock();
 
+    if (!ring) {
+        return -ENOMEM;
+    }
+
+    /* Only the owner thread allocates from the ring, but a signal handler
+     * may record an event while we are here; hence the cmpxchg.
+     */
     do {
-        old_idx = g_atomic_int_get(&trace_idx);
+        old_idx = g_atomic_int_get(&ring->idx);
         smp_rmb();
         new_idx = old_idx + rec_len;
 
-        if (new_idx - writeout_idx > TRACE_BUF_LEN) {
+        if (new_idx - g_atomic_int_get(&ring->writeout_idx) > TRACE_BUF_LEN) {
             /* Trace Buffer Full, Event dropped ! */
-            g_atomic_int_inc(&dropped_events);
+            g_atomic_int_inc(&ring->dropped_events);
             return -ENOSPC;
         }
-    } while (!g_atomic_int_compare_and_exchange(&trace_idx, old_idx, new_idx));
+    } while (!g_atomic_int_compare_and_exchange(&ring->idx, old_idx, new_idx));
 
     idx = old_idx % TRACE_BUF_LEN;
 
     rec_off = idx;
-    rec_off = write_to_buffer(rec_off, &event_u64, sizeof(event_u64));
-    rec_off = write_to_buffer(rec_off, &timestamp_ns, sizeof(timestamp_ns));
-    rec_off = write_to_buffer(rec_off, &rec_len, sizeof(rec_len));
-    rec_off = write_to_buffer(rec_off, &trace_pid, sizeof(trace_pid));
+    rec_off = write_to_buffer(ring, rec_off, &event_u64, sizeof(event_u64));
+    rec_off = write_to_buffer(ring, rec_off, &timestamp_ns,
+                              sizeof(timestamp_ns));
+    rec_off = write_to_buffer(ring, rec_off, &rec_len, sizeof(rec_len));
+    rec_off = write_to_buffer(ring, rec_off, &trace_pid, sizeof(trace_pid));
 
+    rec->ring = ring;
     rec->tbuf_idx = idx;
     rec->rec_off  = (idx + sizeof(TraceRecord)) % TRACE_BUF_LEN;
     return 0;
 }
 
-static void read_from_buffer(unsigned int idx, void *dataptr, size_t size)
+static void read_from_buffer(TraceRing *ring, unsigned int idx,
+                             void *dataptr, size_t size)
 {
     uint8_t *data_ptr = dataptr;
     uint32_t x = 0;
@@ -248,11 +454,12 @@ static void read_from_buffer(unsigned int idx, void *dataptr, size_t size)
         if (idx >= TRACE_BUF_LEN) {
             idx = idx % TRACE_BUF_LEN;
         }
-        data_ptr[x++] = trace_buf[idx++];
+        data_ptr[x++] = ring->buf[idx++];
     }
 }
 
-static unsigned int write_to_buffer(unsigned int idx, void *dataptr, size_t size)
+static unsigned int write_to_buffer(TraceRing *ring, unsigned int idx,
+                                    void *dataptr, size_t size)
 {
     uint8_t *data_ptr = dataptr;
     uint32_t x = 0;
@@ -260,20 +467,22 @@ static unsigned int write_to_buffer(unsigned int idx, void *dataptr, size_t size
         if (idx >= TRACE_BUF_LEN) {
             idx = idx % TRACE_BUF_LEN;
         }
-        trace_buf[idx++] = data_ptr[x++];
+        ring->buf[idx++] = data_ptr[x++];
     }
     return idx; /* most callers wants to know where to write next */
 }
 
 void trace_record_finish(TraceBufferRecord *rec)
 {
+    TraceRing *ring = rec->ring;
     TraceRecord record;
-    read_from_buffer(rec->tbuf_idx, &record, sizeof(TraceRecord));
+    read_from_buffer(ring, rec->tbuf_idx, &record, sizeof(TraceRecord));
     smp_wmb(); /* write barrier before marking as valid */
     record.event |= TRACE_RECORD_VALID;
-    write_to_buffer(rec->tbuf_idx, &record, sizeof(TraceRecord));
+    write_to_buffer(ring, rec->tbuf_idx, &record, sizeof(TraceRecord));
 
-    if (((unsigned int)g_atomic_int_get(&trace_idx) - writeout_idx)
+    if (((unsigned int)g_atomic_int_get(&ring->idx) -
+         (unsigned int)g_atomic_int_get(&ring->writeout_idx))
         > TRACE_BUF_FLUSH_THRESHOLD) {
         flush_trace_file(false);
     }
@@ -332,10 +541,17 @@ void st_set_trace_file_enabled(bool enable)
             return;
         }
 
+#ifndef _WIN32
+        trace_file_map_start();
+#endif
+
         /* Resume trace writeout */
         trace_writeout_enabled = true;
         flush_trace_file(false);
     } else {
+#ifndef _WIN32
+        trace_file_map_end();
+#endif
         fclose(trace_fp);
         trace_fp = NULL;
     }
@@ -374,6 +590,12 @@ void st_flush_trace_buffer(void)
     flush_trace_file(true);
 }
 
+static void st_exit(void)
+{
+    /* Write out pending records and trim the mapped file to its length */
+    st_set_trace_file_enabled(false);
+}
+
 /* Helper function to create a thread with signals blocked.  Use glib's
  * portable threads since QEMU abstractions cannot be used due to reentrancy in
  * the tracer.  Also note the signal masking on POSIX hosts so that the thread
@@ -410,6 +632,6 @@ bool st_init(void)
         return false;
     }
 
-    atexit(st_flush_trace_buffer);
+    atexit(st_exit);
     return true;
 }
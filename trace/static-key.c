@@ -0,0 +1,140 @@
+/*
+ * Static keys for tracepoints
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/atomic.h"
+#include "trace/control.h"
+
+#ifdef TRACE_STATIC_KEYS
+
+typedef struct TraceStaticKeyEntry {
+    uintptr_t code;
+    uintptr_t target;
+    uint16_t *dstate;
+} TraceStaticKeyEntry;
+
+/* Provided by the linker; weak in case no object uses tracepoints */
+extern TraceStaticKeyEntry __start_trace_static_keys[] __attribute__((weak));
+extern TraceStaticKeyEntry __stop_trace_static_keys[] __attribute__((weak));
+
+static bool trace_static_keys_patched;
+
+/* Page currently made writable by patch_begin(), or 0 */
+static uintptr_t patch_page;
+
+static void patch_end(void)
+{
+    if (patch_page) {
+        mprotect((void *)patch_page, qemu_real_host_page_size,
+                 PROT_READ | PROT_EXEC);
+        patch_page = 0;
+    }
+}
+
+static bool patch_begin(uintptr_t code)
+{
+    uintptr_t page = code & -qemu_real_host_page_size;
+
+    if (page == patch_page) {
+        return true;
+    }
+    patch_end();
+    if (mprotect((void *)page, qemu_real_host_page_size,
+                 PROT_READ | PROT_WRITE | PROT_EXEC)) {
+        return false;
+    }
+    patch_page = page;
+    return true;
+}
+
+/*
+ * Other threads may be executing the instruction while it is rewritten.
+ * Both the old and the new instruction are valid, and they are swapped
+ * with a single aligned store, so a CPU sees one or the other.
+ */
+static bool patch_site(TraceStaticKeyEntry *e, bool enable)
+{
+#if defined(__x86_64__)
+    uint64_t *word = (uint64_t *)(e->code & ~(uintptr_t)7);
+    unsigned int shift = (e->code & 7) * 8;
+    uint64_t mask = 0xffffffffffULL << shift;
+    uint64_t insn;
+
+    if (shift > 24 || !patch_begin((uintptr_t)word)) {
+        return false;
+    }
+    if (enable) {
+        /* jmp rel32 */
+        insn = 0xe9 | (uint64_t)(uint32_t)(e->target - (e->code + 5)) << 8;
+    } else {
+        /* nopl 0x0(%rax,%rax,1) */
+        insn = 0x0000441f0fULL;
+    }
+    atomic_set(word, (atomic_read(word) & ~mask) | insn << shift);
+#elif defined(__aarch64__)
+    uint32_t *code = (uint32_t *)e->code;
+
+    if (!patch_begin(e->code)) {
+        return false;
+    }
+    if (enable) {
+        /* b target */
+        atomic_set(code, 0x14000000 |
+                   (((e->target - e->code) >> 2) & 0x03ffffff));
+    } else {
+        /* nop */
+        atomic_set(code, 0xd503201f);
+    }
+    __builtin___clear_cache((char *)code, (char *)(code + 1));
+#endif
+    return true;
+}
+
+void trace_static_keys_init(void)
+{
+    TraceStaticKeyEntry *e, *done;
+
+    for (e = __start_trace_static_keys; e < __stop_trace_static_keys; e++) {
+        if (!*e->dstate && !patch_site(e, false)) {
+            /* Code is not writable here, put back the jumps and give up */
+            for (done = __start_trace_static_keys; done < e; done++) {
+                patch_site(done, true);
+            }
+            patch_end();
+            return;
+        }
+    }
+    patch_end();
+    trace_static_keys_patched = true;
+}
+
+void trace_static_key_update(uint16_t *dstate)
+{
+    TraceStaticKeyEntry *e;
+
+    if (!trace_static_keys_patched) {
+        return;
+    }
+    for (e = __start_trace_static_keys; e < __stop_trace_static_keys; e++) {
+        if (e->dstate == dstate) {
+            patch_site(e, *dstate != 0);
+        }
+    }
+    patch_end();
+}
+
+#else
+
+void trace_static_keys_init(void)
+{
+}
+
+void trace_static_key_update(uint16_t *dstate)
+{
+}
+
+#endif
@@ -0,0 +1,69 @@
+/*
+ * Static keys for tracepoints
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef TRACE__STATIC_KEY_H
+#define TRACE__STATIC_KEY_H
+
+/*
+ * Every place that checks the dynamic state of an event starts out as a
+ * jump to the usual check of the event's dstate variable.  The address of
+ * the jump, its target and the dstate variable are recorded in the
+ * trace_static_keys section.  Once the backends are initialized, the jumps
+ * of disabled events are patched into NOPs, so that a disabled tracepoint
+ * costs neither a load nor a branch.  They are patched back whenever the
+ * event is enabled.
+ *
+ * If the code cannot be patched, the jumps stay and tracepoints behave
+ * exactly as they do without static keys.
+ */
+
+#if defined(CONFIG_LINUX) && defined(CONFIG_ASM_GOTO) && \
+    (defined(__x86_64__) || defined(__aarch64__))
+#define TRACE_STATIC_KEYS 1
+
+#define TRACE_STATIC_KEY_ENTRY(key, label)                              \
+        ".pushsection trace_static_keys, \"aw\"\n"                      \
+        ".balign 8\n"                                                   \
+        ".quad 1b, %l[" #label "], " key "\n"                           \
+        ".popsection\n"
+
+#if defined(__x86_64__)
+/* The 5-byte jump is aligned so that it can be rewritten with one store */
+#define TRACE_STATIC_KEY_BRANCH(key, label)                             \
+    asm goto(".p2align 3\n"                                             \
+             "1: .byte 0xe9\n"                                          \
+             ".long %l[" #label "] - 2f\n"                              \
+             "2:\n"                                                     \
+             TRACE_STATIC_KEY_ENTRY(key, label)                         \
+             : : : : label)
+#else
+#define TRACE_STATIC_KEY_BRANCH(key, label)                             \
+    asm goto("1: b %l[" #label "]\n"                                    \
+             TRACE_STATIC_KEY_ENTRY(key, label)                         \
+             : : : : label)
+#endif
+
+#else
+#define TRACE_STATIC_KEY_BRANCH(key, label) goto label
+#endif
+
+/**
+ * trace_static_keys_init:
+ *
+ * Patch out the static keys of all events that are disabled.
+ */
+void trace_static_keys_init(void);
+
+/**
+ * trace_static_key_update:
+ * @dstate: Dynamic state variable of an event.
+ *
+ * Patch the static keys of the event after its dynamic state changed.
+ */
+void trace_static_key_update(uint16_t *dstate);
+
+#endif /* TRACE__STATIC_KEY_H */
@@ -2937,10 +2937,12 @@ static int vnc_refresh_server_surface(VncDisplay *vd)
     int height = MIN(pixman_image_get_height(vd->guest.fb),
                      pixman_image_get_height(vd->server));
     int cmp_bytes, server_stride, line_bytes, guest_ll, guest_stride, y = 0;
+    int tiles = DIV_ROUND_UP(width, VNC_DIRTY_PIXELS_PER_BIT);
     uint8_t *guest_row0 = NULL, *server_row0;
     VncState *vs;
     int has_dirty = 0;
     pixman_image_t *tmpbuf = NULL;
+    DECLARE_BITMAP(changed, VNC_DIRTY_BITS);
 
     struct timeval tv = { 0, 0 };
 
@@ -2972,7 +2974,8 @@ static int vnc_refresh_server_surface(VncDisplay *vd)
     line_bytes = MIN(server_stride, guest_ll);
 
     for (;;) {
-        int x;
+        int x, i;
+        bool row_changed = false;
         uint8_t *guest_ptr, *server_ptr;
         unsigned long offset = find_next_bit((unsigned long *) &vd->guest.dirty,
                                              height * VNC_DIRTY_BPL(&vd->guest),
@@ -2984,7 +2987,7 @@ static int vnc_refresh_server_surface(VncDisplay *vd)
         y = offset / VNC_DIRTY_BPL(&vd->guest);
         x = offset % VNC_DIRTY_BPL(&vd->guest);
 
-        server_ptr = server_row0 + y * server_stride + x * cmp_bytes;
+        server_ptr = server_row0 + y * server_stride;
 
         if (vd->guest.format != VNC_SERVER_FB_FORMAT) {
             qemu_pixman_linebuf_fill(tmpbuf, vd->guest.fb, width, 0, y);
@@ -2992,32 +2995,67 @@ static int vnc_refresh_server_surface(VncDisplay *vd)
         } else {
             guest_ptr = guest_row0 + y * guest_stride;
         }
-        guest_ptr += x * cmp_bytes;
 
-        for (; x < DIV_ROUND_UP(width, VNC_DIRTY_PIXELS_PER_BIT);
-             x++, guest_ptr += cmp_bytes, server_ptr += cmp_bytes) {
-            int _cmp_bytes = cmp_bytes;
-            if (!test_and_clear_bit(x, vd->guest.dirty[y])) {
-                continue;
-            }
-            if ((x + 1) * cmp_bytes > line_bytes) {
-                _cmp_bytes = line_bytes - x * cmp_bytes;
+        /*
+         * Work on one word of the dirty bitmap at a time.  If its dirty
+         * tiles are contiguous, first compare all of them with a single
+         * memcmp: when a guest redraws a large area with the same contents,
+         * one long compare, which the C library vectorizes, replaces one
+         * call per 16 pixels.
+         */
+        for (i = x / BITS_PER_LONG; i < BITS_TO_LONGS(tiles); i++) {
+            unsigned long bits = vd->guest.dirty[y][i];
+            int x0 = i * BITS_PER_LONG;
+
+            if (i == BITS_TO_LONGS(tiles) - 1) {
+                bits &= BITMAP_LAST_WORD_MASK(tiles);
             }
-            assert(_cmp_bytes >= 0);
-            if (memcmp(server_ptr, guest_ptr, _cmp_bytes) == 0) {
+            if (!bits) {
                 continue;
             }
-            memcpy(server_ptr, guest_ptr, _cmp_bytes);
-            if (!vd->non_adaptive) {
-                vnc_rect_updated(vd, x * VNC_DIRTY_PIXELS_PER_BIT,
-                                 y, &tv);
+            vd->guest.dirty[y][i] &= ~bits;
+
+            if (((bits >> ctzl(bits)) & ((bits >> ctzl(bits)) + 1)) == 0) {
+                int start = (x0 + ctzl(bits)) * cmp_bytes;
+                int len = MIN(ctpopl(bits) * cmp_bytes, line_bytes - start);
+
+                if (memcmp(server_ptr + start, guest_ptr + start, len) == 0) {
+                    continue;
+                }
             }
-            QTAILQ_FOREACH(vs, &vd->clients, next) {
-                set_bit(x, vs->dirty[y]);
+
+            for (; bits; bits &= bits - 1) {
+                int _cmp_bytes = cmp_bytes;
+
+                x = x0 + ctzl(bits);
+                if ((x + 1) * cmp_bytes > line_bytes) {
+                    _cmp_bytes = line_bytes - x * cmp_bytes;
+                }
+                assert(_cmp_bytes >= 0);
+                if (memcmp(server_ptr + x * cmp_bytes,
+                           guest_ptr + x * cmp_bytes, _cmp_bytes) == 0) {
+                    continue;
+                }
+                memcpy(server_ptr + x * cmp_bytes, guest_ptr + x * cmp_bytes,
+                       _cmp_bytes);
+                if (!vd->non_adaptive) {
+                    vnc_rect_updated(vd, x * VNC_DIRTY_PIXELS_PER_BIT,
+                                     y, &tv);
+                }
+                if (!row_changed) {
+                    bitmap_zero(changed, tiles);
+                    row_changed = true;
+                }
+                set_bit(x, changed);
+                has_dirty++;
             }
-            has_dirty++;
         }
 
+        if (row_changed) {
+            QTAILQ_FOREACH(vs, &vd->clients, next) {
+                bitmap_or(vs->dirty[y], vs->dirty[y], changed, tiles);
+            }
+        }
         y++;
     }
     qemu_pixman_image_unref(tmpbuf);
@@ -19,6 +19,8 @@
 #include "qemu/rcu_queue.h"
 #include "qemu/sockets.h"
 #include "qemu/cutils.h"
+#include "qemu/host-utils.h"
+#include "qemu/loop-profile.h"
 #include "trace.h"
 #ifdef CONFIG_EPOLL_CREATE1
 #include <sys/epoll.h>
@@ -35,7 +37,14 @@ struct AioHandler
     int deleted;
     void *opaque;
     bool is_external;
+    int64_t poll_idle_timeout;  /* when busy polling stops calling io_poll */
+    bool poll_idle;             /* io_poll had no work for a long time */
     QLIST_ENTRY(AioHandler) node;
+#ifdef CONFIG_LINUX_IO_URING
+    QSLIST_ENTRY(AioHandler) node_submitted;
+    unsigned uring_flags;   /* AIO_URING_* */
+    int uring_events;       /* poll mask of the in-flight request */
+#endif
 };
 
 #ifdef CONFIG_EPOLL_CREATE1
@@ -187,6 +196,284 @@ static bool aio_epoll_check_poll(AioContext *ctx, GPollFD *pfds,
 
 #endif
 
+#ifdef CONFIG_LINUX_IO_URING
+
+/* Number of submission queue entries, the completion queue is twice that */
+#define AIO_URING_ENTRIES 128
+
+enum {
+    AIO_URING_SUBMITTED = 1 << 0,   /* on ctx->submit_list */
+    AIO_URING_INFLIGHT  = 1 << 1,   /* poll request owned by the kernel */
+    AIO_URING_REMOVE    = 1 << 2,   /* in-flight request must be cancelled */
+    AIO_URING_DEFERRED  = 1 << 3,   /* on ctx->deleted_aio_handlers */
+};
+
+static bool aio_uring_setup(AioContext *ctx)
+{
+    int ret;
+
+    ret = io_uring_queue_init(AIO_URING_ENTRIES, &ctx->fdmon_io_uring, 0);
+    if (ret != 0) {
+        return false;
+    }
+
+    QSLIST_INIT(&ctx->submit_list);
+    QLIST_INIT(&ctx->deleted_aio_handlers);
+    ctx->io_uring_multishot = true;
+    ctx->io_uring_available = true;
+    return true;
+}
+
+static void aio_uring_enqueue(AioContext *ctx, AioHandler *node)
+{
+    if (!(node->uring_flags & AIO_URING_SUBMITTED)) {
+        node->uring_flags |= AIO_URING_SUBMITTED;
+        QSLIST_INSERT_HEAD(&ctx->submit_list, node, node_submitted);
+    }
+}
+
+/* Called when the handler's fd or events changed, or it was removed */
+static void aio_uring_update(AioContext *ctx, AioHandler *node, bool deleted)
+{
+    if (!ctx->io_uring_available) {
+        return;
+    }
+
+    if (node->uring_flags & AIO_URING_INFLIGHT) {
+        if (!deleted && node->uring_events == node->pfd.events) {
+            return;         /* the armed poll request is still good */
+        }
+        node->uring_flags |= AIO_URING_REMOVE;
+    } else if (deleted) {
+        return;             /* nothing was armed, nothing to cancel */
+    }
+    aio_uring_enqueue(ctx, node);
+}
+
+/* Returns true if the handler can be freed now */
+static bool aio_uring_can_free(AioContext *ctx, AioHandler *node)
+{
+    if (!ctx->io_uring_available ||
+        !(node->uring_flags & (AIO_URING_SUBMITTED | AIO_URING_INFLIGHT))) {
+        return true;
+    }
+
+    /* The kernel still refers to it, wait for the final completion */
+    node->uring_flags |= AIO_URING_DEFERRED;
+    QLIST_INSERT_HEAD(&ctx->deleted_aio_handlers, node, node);
+    return false;
+}
+
+static void aio_uring_try_free(AioHandler *node)
+{
+    if ((node->uring_flags & AIO_URING_DEFERRED) &&
+        !(node->uring_flags & (AIO_URING_SUBMITTED | AIO_URING_INFLIGHT))) {
+        QLIST_REMOVE(node, node);
+        g_free(node);
+    }
+}
+
+static struct io_uring_sqe *aio_uring_get_sqe(AioContext *ctx)
+{
+    struct io_uring *ring = &ctx->fdmon_io_uring;
+    struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+    int ret;
+
+    if (likely(sqe)) {
+        return sqe;
+    }
+
+    /* No free sqes left, submit pending sqes first */
+    do {
+        ret = io_uring_submit(ring);
+    } while (ret == -EINTR);
+    assert(ret > 0);
+
+    sqe = io_uring_get_sqe(ring);
+    assert(sqe);
+    return sqe;
+}
+
+/* Turn the registration changes queued since the last call into sqes */
+static void aio_uring_prepare_sqes(AioContext *ctx)
+{
+    AioHandler *node;
+    struct io_uring_sqe *sqe;
+
+    while ((node = QSLIST_FIRST(&ctx->submit_list))) {
+        QSLIST_REMOVE_HEAD(&ctx->submit_list, node_submitted);
+        node->uring_flags &= ~AIO_URING_SUBMITTED;
+
+        if (node->uring_flags & AIO_URING_REMOVE) {
+            node->uring_flags &= ~AIO_URING_REMOVE;
+            sqe = aio_uring_get_sqe(ctx);
+            io_uring_prep_poll_remove(sqe, node);
+            io_uring_sqe_set_data(sqe, NULL);
+        }
+
+        /*
+         * A new request is armed once the old one has completed, so that
+         * completions can be told apart by their AioHandler pointer.
+         */
+        if (!(node->uring_flags & (AIO_URING_INFLIGHT | AIO_URING_DEFERRED)) &&
+            !node->deleted && node->pfd.events) {
+            sqe = aio_uring_get_sqe(ctx);
+            /* G_IO_* values are the poll(2) event bits on POSIX hosts */
+            if (ctx->io_uring_multishot) {
+                io_uring_prep_poll_multishot(sqe, node->pfd.fd,
+                                             node->pfd.events);
+            } else {
+                io_uring_prep_poll_add(sqe, node->pfd.fd, node->pfd.events);
+            }
+            io_uring_sqe_set_data(sqe, node);
+            node->uring_events = node->pfd.events;
+            node->uring_flags |= AIO_URING_INFLIGHT;
+        }
+
+        aio_uring_try_free(node);
+    }
+}
+
+/*
+ * Reap completions.  If @dispatch is true the handlers become ready for
+ * aio_dispatch_handlers(), otherwise the events were already reported by
+ * another poll mechanism and only the bookkeeping is done.
+ */
+static int aio_uring_process_cqes(AioContext *ctx, bool dispatch)
+{
+    struct io_uring *ring = &ctx->fdmon_io_uring;
+    struct io_uring_cqe *cqe;
+    unsigned head, reaped = 0;
+    int ready = 0;
+
+    io_uring_for_each_cqe(ring, head, cqe) {
+        AioHandler *node = io_uring_cqe_get_data(cqe);
+
+        reaped++;
+        if (!node) {
+            continue;       /* timeout or poll removal */
+        }
+
+        if (cqe->res > 0 && dispatch && !node->deleted) {
+            node->pfd.revents |= cqe->res & node->pfd.events;
+            ready++;
+        }
+
+        if (cqe->flags & IORING_CQE_F_MORE) {
+            continue;       /* multishot request is still armed */
+        }
+
+        node->uring_flags &= ~AIO_URING_INFLIGHT;
+        if (cqe->res == -EINVAL && ctx->io_uring_multishot) {
+            /* Kernel without multishot poll, use oneshot requests */
+            ctx->io_uring_multishot = false;
+        }
+        if (node->uring_flags & AIO_URING_DEFERRED) {
+            aio_uring_try_free(node);
+        } else if (!node->deleted) {
+            aio_uring_enqueue(ctx, node);   /* re-arm */
+        }
+    }
+    io_uring_cq_advance(ring, reaped);
+
+    return ready;
+}
+
+/* Catch up with completions while another poll mechanism is in use */
+static void aio_uring_drain(AioContext *ctx)
+{
+    if (ctx->io_uring_available) {
+        aio_uring_process_cqes(ctx, false);
+    }
+}
+
+static bool aio_uring_enabled(AioContext *ctx)
+{
+    /*
+     * Fall back to ppoll when external clients are disabled: their fds
+     * would keep completing without being dispatched.
+     */
+    return ctx->io_uring_available && !aio_external_disabled(ctx);
+}
+
+/*
+ * Submit the queued registration changes and wait for events with a
+ * single io_uring_enter(2) call.  The deadline is a timeout request
+ * that completes as soon as any other completion arrives.
+ */
+static int aio_uring_wait(AioContext *ctx, int64_t timeout)
+{
+    struct io_uring *ring = &ctx->fdmon_io_uring;
+    struct __kernel_timespec ts;
+    unsigned wait_nr = 1;
+    int ret;
+
+    aio_uring_prepare_sqes(ctx);
+
+    if (timeout == 0) {
+        wait_nr = 0;
+    } else if (timeout > 0) {
+        struct io_uring_sqe *sqe = aio_uring_get_sqe(ctx);
+
+        ts = (struct __kernel_timespec) {
+            .tv_sec = timeout / NANOSECONDS_PER_SECOND,
+            .tv_nsec = timeout % NANOSECONDS_PER_SECOND,
+        };
+        io_uring_prep_timeout(sqe, &ts, 1, 0);
+        io_uring_sqe_set_data(sqe, NULL);
+    }
+
+    do {
+        ret = io_uring_submit_and_wait(ring, wait_nr);
+    } while (ret == -EINTR);
+    assert(ret >= 0);
+
+    return aio_uring_process_cqes(ctx, true);
+}
+
+static void aio_uring_destroy(AioContext *ctx)
+{
+    AioHandler *node, *tmp;
+
+    if (!ctx->io_uring_available) {
+        return;
+    }
+    ctx->io_uring_available = false;
+    io_uring_queue_exit(&ctx->fdmon_io_uring);
+
+    QLIST_FOREACH_SAFE(node, &ctx->deleted_aio_handlers, node, tmp) {
+        QLIST_REMOVE(node, node);
+        g_free(node);
+    }
+}
+
+#else
+
+static void aio_uring_update(AioContext *ctx, AioHandler *node, bool deleted)
+{
+}
+
+static bool aio_uring_can_free(AioContext *ctx, AioHandler *node)
+{
+    return true;
+}
+
+static void aio_uring_drain(AioContext *ctx)
+{
+}
+
+static bool aio_uring_enabled(AioContext *ctx)
+{
+    return false;
+}
+
+static int aio_uring_wait(AioContext *ctx, int64_t timeout)
+{
+    assert(false);
+}
+
+#endif
+
 static AioHandler *find_aio_handler(AioContext *ctx, int fd)
 {
     AioHandler *node;
@@ -248,6 +535,14 @@ void aio_set_fd_handler(AioContext *ctx,
         if (!node->io_poll) {
             ctx->poll_disable_cnt--;
         }
+        if (node->poll_idle) {
+            ctx->poll_idle_cnt--;
+        }
+
+        aio_uring_update(ctx, node, true);
+        if (deleted) {
+            deleted = aio_uring_can_free(ctx, node);
+        }
     } else {
         if (node == NULL) {
             /* Alloc and insert if it's not already there */
@@ -272,6 +567,8 @@ void aio_set_fd_handler(AioContext *ctx,
 
         node->pfd.events = (io_read ? G_IO_IN | G_IO_HUP | G_IO_ERR : 0);
         node->pfd.events |= (io_write ? G_IO_OUT | G_IO_ERR : 0);
+
+        aio_uring_update(ctx, node, false);
     }
 
     aio_epoll_update(ctx, node, is_new);
@@ -331,7 +628,8 @@ static void poll_set_started(AioContext *ctx, bool started)
     QLIST_FOREACH_RCU(node, &ctx->aio_handlers, node) {
         IOHandler *fn;
 
-        if (node->deleted) {
+        /* Idle handlers already had ->io_poll_end() called on them */
+        if (node->deleted || node->poll_idle) {
             continue;
         }
 
@@ -388,6 +686,23 @@ bool aio_pending(AioContext *ctx)
     return result;
 }
 
+/* An idle handler got an fd event, let busy polling consider it again */
+static void poll_handler_wake(AioContext *ctx, AioHandler *node)
+{
+    if (!node->poll_idle) {
+        return;
+    }
+
+    trace_poll_handler_wake(ctx, node, node->pfd.fd);
+    node->poll_idle = false;
+    node->poll_idle_timeout = 0;
+    ctx->poll_idle_cnt--;
+
+    if (ctx->poll_started && node->io_poll_begin) {
+        node->io_poll_begin(node->opaque);
+    }
+}
+
 static bool aio_dispatch_handlers(AioContext *ctx)
 {
     AioHandler *node, *tmp;
@@ -399,11 +714,19 @@ static bool aio_dispatch_handlers(AioContext *ctx)
         revents = node->pfd.revents & node->pfd.events;
         node->pfd.revents = 0;
 
+        if (revents && !node->deleted) {
+            poll_handler_wake(ctx, node);
+        }
+
         if (!node->deleted &&
             (revents & (G_IO_IN | G_IO_HUP | G_IO_ERR)) &&
             aio_node_check(ctx, node->is_external) &&
             node->io_read) {
+            int64_t start = loop_profile_start();
+
             node->io_read(node->opaque);
+            loop_profile_end(LOOP_PROFILE_KIND_FD_HANDLER, node->io_read,
+                             start);
 
             /* aio_notify() does not count as progress */
             if (node->opaque != &ctx->notifier) {
@@ -414,14 +737,20 @@ static bool aio_dispatch_handlers(AioContext *ctx)
             (revents & (G_IO_OUT | G_IO_ERR)) &&
             aio_node_check(ctx, node->is_external) &&
             node->io_write) {
+            int64_t start = loop_profile_start();
+
             node->io_write(node->opaque);
+            loop_profile_end(LOOP_PROFILE_KIND_FD_HANDLER, node->io_write,
+                             start);
             progress = true;
         }
 
         if (node->deleted) {
             if (qemu_lockcnt_dec_if_lock(&ctx->list_lock)) {
                 QLIST_REMOVE(node, node);
-                g_free(node);
+                if (aio_uring_can_free(ctx, node)) {
+                    g_free(node);
+                }
                 qemu_lockcnt_inc_and_unlock(&ctx->list_lock);
             }
         }
@@ -433,6 +762,7 @@ static bool aio_dispatch_handlers(AioContext *ctx)
 void aio_dispatch(AioContext *ctx)
 {
     qemu_lockcnt_inc(&ctx->list_lock);
+    aio_uring_drain(ctx);
     aio_bh_poll(ctx);
     aio_dispatch_handlers(ctx);
     qemu_lockcnt_dec(&ctx->list_lock);
@@ -486,16 +816,25 @@ static void add_pollfd(AioHandler *node)
     npfd++;
 }
 
-static bool run_poll_handlers_once(AioContext *ctx)
+/* How long a handler may go without work before busy polling skips it */
+#define POLL_IDLE_INTERVAL_NS (7 * NANOSECONDS_PER_SECOND)
+
+static bool run_poll_handlers_once(AioContext *ctx, int64_t now)
 {
     bool progress = false;
     AioHandler *node;
 
     QLIST_FOREACH_RCU(node, &ctx->aio_handlers, node) {
-        if (!node->deleted && node->io_poll &&
-            aio_node_check(ctx, node->is_external) &&
-            node->io_poll(node->opaque)) {
+        if (node->deleted || !node->io_poll || node->poll_idle ||
+            !aio_node_check(ctx, node->is_external)) {
+            continue;
+        }
+
+        if (node->io_poll(node->opaque)) {
+            node->poll_idle_timeout = now + POLL_IDLE_INTERVAL_NS;
             progress = true;
+        } else if (!node->poll_idle_timeout) {
+            node->poll_idle_timeout = now + POLL_IDLE_INTERVAL_NS;
         }
 
         /* Caller handles freeing deleted nodes.  Don't do it here. */
@@ -504,6 +843,37 @@ static bool run_poll_handlers_once(AioContext *ctx)
     return progress;
 }
 
+/* Stop busy polling handlers that have had no work for a long time.  They
+ * are monitored through their file descriptor until it becomes ready.
+ *
+ * Returns: true if the final poll of a handler made progress
+ */
+static bool poll_set_idle_handlers(AioContext *ctx, int64_t now)
+{
+    bool progress = false;
+    AioHandler *node;
+
+    QLIST_FOREACH_RCU(node, &ctx->aio_handlers, node) {
+        if (node->deleted || !node->io_poll || node->poll_idle ||
+            !node->poll_idle_timeout || now < node->poll_idle_timeout) {
+            continue;
+        }
+
+        trace_poll_handler_idle(ctx, node, node->pfd.fd);
+        node->poll_idle = true;
+        ctx->poll_idle_cnt++;
+
+        if (ctx->poll_started && node->io_poll_end) {
+            node->io_poll_end(node->opaque);
+
+            /* Final poll in case ->io_poll_end() races with an event */
+            progress |= node->io_poll(node->opaque);
+        }
+    }
+
+    return progress;
+}
+
 /* run_poll_handlers:
  * @ctx: the AioContext
  * @max_ns: maximum time to poll for, in nanoseconds
@@ -520,7 +890,7 @@ static bool run_poll_handlers_once(AioContext *ctx)
 static bool run_poll_handlers(AioContext *ctx, int64_t max_ns)
 {
     bool progress;
-    int64_t end_time;
+    int64_t now, end_time;
 
     assert(ctx->notify_me);
     assert(qemu_lockcnt_count(&ctx->list_lock) > 0);
@@ -528,11 +898,15 @@ static bool run_poll_handlers(AioContext *ctx, int64_t max_ns)
 
     trace_run_poll_handlers_begin(ctx, max_ns);
 
-    end_time = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) + max_ns;
+    now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    end_time = now + max_ns;
 
     do {
-        progress = run_poll_handlers_once(ctx);
-    } while (!progress && qemu_clock_get_ns(QEMU_CLOCK_REALTIME) < end_time);
+        progress = run_poll_handlers_once(ctx, now);
+        now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    } while (!progress && now < end_time);
+
+    progress |= poll_set_idle_handlers(ctx, now);
 
     trace_run_poll_handlers_end(ctx, progress);
 
@@ -570,7 +944,7 @@ static bool try_poll_mode(AioContext *ctx, bool blocking)
     /* Even if we don't run busy polling, try polling once in case it can make
      * progress and the caller will be able to avoid ppoll(2)/epoll_wait(2).
      */
-    return run_poll_handlers_once(ctx);
+    return run_poll_handlers_once(ctx, qemu_clock_get_ns(QEMU_CLOCK_REALTIME));
 }
 
 bool aio_poll(AioContext *ctx, bool blocking)
@@ -600,7 +974,10 @@ bool aio_poll(AioContext *ctx, bool blocking)
     }
 
     progress = try_poll_mode(ctx, blocking);
-    if (!progress) {
+    if (!progress && aio_uring_enabled(ctx)) {
+        timeout = blocking ? aio_compute_timeout(ctx) : 0;
+        ret = aio_uring_wait(ctx, timeout);
+    } else if (!progress) {
         assert(npfd == 0);
 
         /* fill pollfds */
@@ -628,6 +1005,7 @@ bool aio_poll(AioContext *ctx, bool blocking)
         } else  {
             ret = qemu_poll_ns(pollfds, npfd, timeout);
         }
+        aio_uring_drain(ctx);
     }
 
     if (blocking) {
@@ -637,6 +1015,15 @@ bool aio_poll(AioContext *ctx, bool blocking)
     /* Adjust polling time */
     if (ctx->poll_max_ns) {
         int64_t block_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start;
+        int bucket = block_ns < 1024 ? 0 : 64 - clz64(block_ns >> 10);
+
+        if (progress) {
+            ctx->poll_hits++;
+        } else {
+            ctx->poll_misses++;
+        }
+        ctx->poll_wait_histogram[MIN(bucket,
+                                     AIO_POLL_HISTOGRAM_BUCKETS - 1)]++;
 
         if (block_ns <= ctx->poll_ns) {
             /* This is the sweet spot, no adjustment needed */
@@ -701,6 +1088,11 @@ bool aio_poll(AioContext *ctx, bool blocking)
 
 void aio_context_setup(AioContext *ctx)
 {
+#ifdef CONFIG_LINUX_IO_URING
+    if (aio_uring_setup(ctx)) {
+        return;
+    }
+#endif
 #ifdef CONFIG_EPOLL_CREATE1
     assert(!ctx->epollfd);
     ctx->epollfd = epoll_create1(EPOLL_CLOEXEC);
@@ -715,6 +1107,9 @@ void aio_context_setup(AioContext *ctx)
 
 void aio_context_destroy(AioContext *ctx)
 {
+#ifdef CONFIG_LINUX_IO_URING
+    aio_uring_destroy(ctx);
+#endif
 #ifdef CONFIG_EPOLL_CREATE1
     aio_epoll_disable(ctx);
 #endif
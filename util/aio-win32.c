@@ -22,6 +22,7 @@
 #include "qemu/sockets.h"
 #include "qapi/error.h"
 #include "qemu/rcu_queue.h"
+#include "qemu/loop-profile.h"
 
 struct AioHandler {
     EventNotifier *e;
@@ -283,11 +284,19 @@ static bool aio_dispatch_handlers(AioContext *ctx, HANDLE event)
             (node->io_read || node->io_write)) {
             node->pfd.revents = 0;
             if ((revents & G_IO_IN) && node->io_read) {
+                int64_t start = loop_profile_start();
+
                 node->io_read(node->opaque);
+                loop_profile_end(LOOP_PROFILE_KIND_FD_HANDLER, node->io_read,
+                                 start);
                 progress = true;
             }
             if ((revents & G_IO_OUT) && node->io_write) {
+                int64_t start = loop_profile_start();
+
                 node->io_write(node->opaque);
+                loop_profile_end(LOOP_PROFILE_KIND_FD_HANDLER, node->io_write,
+                                 start);
                 progress = true;
             }
 
@@ -32,6 +32,7 @@
 #include "qemu/atomic.h"
 #include "block/raw-aio.h"
 #include "qemu/coroutine_int.h"
+#include "qemu/loop-profile.h"
 #include "trace.h"
 
 /***********************************************************/
@@ -87,7 +88,10 @@ QEMUBH *aio_bh_new(AioContext *ctx, QEMUBHFunc *cb, void *opaque)
 
 void aio_bh_call(QEMUBH *bh)
 {
+    int64_t start = loop_profile_start();
+
     bh->cb(bh->opaque);
+    loop_profile_end(LOOP_PROFILE_KIND_BOTTOM_HALF, bh->cb, start);
 }
 
 /* Multiple occurrences of aio_bh_poll cannot be called concurrently.
@@ -269,6 +273,10 @@ aio_ctx_finalize(GSource     *source)
 
     thread_pool_free(ctx->thread_pool);
 
+    while (ctx->bounce_pool_len) {
+        qemu_vfree(ctx->bounce_pool[--ctx->bounce_pool_len]);
+    }
+
 #ifdef CONFIG_LINUX_AIO
     if (ctx->linux_aio) {
         laio_detach_aio_context(ctx->linux_aio, ctx);
@@ -277,6 +285,14 @@ aio_ctx_finalize(GSource     *source)
     }
 #endif
 
+#ifdef CONFIG_LINUX_IO_URING
+    if (ctx->linux_io_uring) {
+        luring_detach_aio_context(ctx->linux_io_uring, ctx);
+        luring_cleanup(ctx->linux_io_uring);
+        ctx->linux_io_uring = NULL;
+    }
+#endif
+
     assert(QSLIST_EMPTY(&ctx->scheduled_coroutines));
     qemu_bh_delete(ctx->co_schedule_bh);
 
@@ -322,6 +338,26 @@ ThreadPool *aio_get_thread_pool(AioContext *ctx)
     return ctx->thread_pool;
 }
 
+bool aio_context_fork_prepare(AioContext *ctx, Error **errp)
+{
+#ifdef CONFIG_LINUX_AIO
+    if (ctx->linux_aio) {
+        error_setg(errp, "aio=native cannot be used across fork()");
+        return false;
+    }
+#endif
+#ifdef CONFIG_LINUX_IO_URING
+    if (ctx->linux_io_uring) {
+        error_setg(errp, "aio=io_uring cannot be used across fork()");
+        return false;
+    }
+#endif
+
+    thread_pool_free(ctx->thread_pool);
+    ctx->thread_pool = NULL;
+    return true;
+}
+
 #ifdef CONFIG_LINUX_AIO
 LinuxAioState *aio_setup_linux_aio(AioContext *ctx, Error **errp)
 {
@@ -341,6 +377,42 @@ LinuxAioState *aio_get_linux_aio(AioContext *ctx)
 }
 #endif
 
+#ifdef CONFIG_LINUX_IO_URING
+LuringState *aio_setup_linux_io_uring(AioContext *ctx, Error **errp)
+{
+    if (!ctx->linux_io_uring) {
+        ctx->linux_io_uring = luring_init(errp);
+        if (ctx->linux_io_uring) {
+            luring_attach_aio_context(ctx->linux_io_uring, ctx);
+        }
+    }
+    return ctx->linux_io_uring;
+}
+
+LuringState *aio_get_linux_io_uring(AioContext *ctx)
+{
+    assert(ctx->linux_io_uring);
+    return ctx->linux_io_uring;
+}
+#endif
+
+void *aio_bounce_buffer_get(AioContext *ctx)
+{
+    if (ctx->bounce_pool_len) {
+        return ctx->bounce_pool[--ctx->bounce_pool_len];
+    }
+    return qemu_memalign(qemu_real_host_page_size, AIO_BOUNCE_BUFFER_SIZE);
+}
+
+void aio_bounce_buffer_put(AioContext *ctx, void *buf)
+{
+    if (ctx->bounce_pool_len < AIO_BOUNCE_POOL_SIZE) {
+        ctx->bounce_pool[ctx->bounce_pool_len++] = buf;
+    } else {
+        qemu_vfree(buf);
+    }
+}
+
 void aio_notify(AioContext *ctx)
 {
     /* Write e.g. bh->scheduled before reading ctx->notify_me.  Pairs
@@ -431,6 +503,9 @@ AioContext *aio_context_new(Error **errp)
                            event_notifier_poll);
 #ifdef CONFIG_LINUX_AIO
     ctx->linux_aio = NULL;
+#endif
+#ifdef CONFIG_LINUX_IO_URING
+    ctx->linux_io_uring = NULL;
 #endif
     ctx->thread_pool = NULL;
     qemu_rec_mutex_init(&ctx->lock);
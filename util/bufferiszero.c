@@ -188,12 +188,49 @@ buffer_zero_avx2(const void *buf, size_t len)
 #pragma GCC pop_options
 #endif /* CONFIG_AVX2_OPT */
 
+#ifdef CONFIG_AVX512F_OPT
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#include <immintrin.h>
+
+/* Note that this function requires len >= 256.  */
+
+static bool
+buffer_zero_avx512(const void *buf, size_t len)
+{
+    /* Begin with an unaligned head of 64 bytes.  */
+    __m512i t = _mm512_loadu_si512(buf);
+    __m512i *p = (__m512i *)(((uintptr_t)buf + 5 * 64) & -64);
+    __m512i *e = (__m512i *)(((uintptr_t)buf + len) & -64);
+
+    /* Loop over 64-byte aligned blocks of 256.  */
+    while (likely(p <= e)) {
+        __builtin_prefetch(p);
+        if (unlikely(_mm512_test_epi64_mask(t, t))) {
+            return false;
+        }
+        t = p[-4] | p[-3] | p[-2] | p[-1];
+        p += 4;
+    }
+
+    /* Finish the last block of 256 unaligned.  */
+    t |= _mm512_loadu_si512(buf + len - 4 * 64);
+    t |= _mm512_loadu_si512(buf + len - 3 * 64);
+    t |= _mm512_loadu_si512(buf + len - 2 * 64);
+    t |= _mm512_loadu_si512(buf + len - 1 * 64);
+
+    return !_mm512_test_epi64_mask(t, t);
+}
+#pragma GCC pop_options
+#endif /* CONFIG_AVX512F_OPT */
+
 /* Note that for test_buffer_is_zero_next_accel, the most preferred
  * ISA must have the least significant bit.
  */
-#define CACHE_AVX2    1
-#define CACHE_SSE4    2
-#define CACHE_SSE2    4
+#define CACHE_AVX512F 1
+#define CACHE_AVX2    2
+#define CACHE_SSE4    4
+#define CACHE_SSE2    8
 
 /* Make sure that these variables are appropriately initialized when
  * SSE2 is enabled on the compiler command-line, but the compiler is
@@ -212,10 +249,13 @@ buffer_zero_avx2(const void *buf, size_t len)
 
 static unsigned cpuid_cache = INIT_CACHE;
 static bool (*buffer_accel)(const void *, size_t) = INIT_ACCEL;
+static size_t length_to_accel = 64;
 
 static void init_accel(unsigned cache)
 {
     bool (*fn)(const void *, size_t) = buffer_zero_int;
+    size_t len = 64;
+
     if (cache & CACHE_SSE2) {
         fn = buffer_zero_sse2;
     }
@@ -226,8 +266,15 @@ static void init_accel(unsigned cache)
     if (cache & CACHE_AVX2) {
         fn = buffer_zero_avx2;
     }
+#endif
+#ifdef CONFIG_AVX512F_OPT
+    if (cache & CACHE_AVX512F) {
+        fn = buffer_zero_avx512;
+        len = 256;
+    }
 #endif
     buffer_accel = fn;
+    length_to_accel = len;
 }
 
 #ifdef CONFIG_AVX2_OPT
@@ -256,6 +303,10 @@ static void __attribute__((constructor)) init_cpuid_cache(void)
             if ((bv & 6) == 6 && (b & bit_AVX2)) {
                 cache |= CACHE_AVX2;
             }
+            /* 0xe6: the opmask and upper ZMM states must be enabled too */
+            if ((bv & 0xe6) == 0xe6 && (b & bit_AVX512F)) {
+                cache |= CACHE_AVX512F;
+            }
         }
     }
     cpuid_cache = cache;
@@ -278,12 +329,65 @@ bool test_buffer_is_zero_next_accel(void)
 
 static bool select_accel_fn(const void *buf, size_t len)
 {
-    if (likely(len >= 64)) {
+    if (likely(len >= length_to_accel)) {
         return buffer_accel(buf, len);
     }
     return buffer_zero_int(buf, len);
 }
 
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+
+/* Note that this function requires len >= 64.  */
+
+static bool
+buffer_zero_neon(const void *buf, size_t len)
+{
+    uint64x2_t t = vreinterpretq_u64_u8(vld1q_u8(buf));
+    const uint64x2_t *p = (uint64x2_t *)(((uintptr_t)buf + 5 * 16) & -16);
+    const uint64x2_t *e = (uint64x2_t *)(((uintptr_t)buf + len) & -16);
+
+    /* Loop over 16-byte aligned blocks of 64.  */
+    while (likely(p <= e)) {
+        __builtin_prefetch(p);
+        if (unlikely(vmaxvq_u32(vreinterpretq_u32_u64(t)))) {
+            return false;
+        }
+        t = p[-4] | p[-3] | p[-2] | p[-1];
+        p += 4;
+    }
+
+    /* Finish the aligned tail.  */
+    t |= e[-3];
+    t |= e[-2];
+    t |= e[-1];
+
+    /* Finish the unaligned tail.  */
+    t |= vreinterpretq_u64_u8(vld1q_u8(buf + len - 16));
+
+    return !vmaxvq_u32(vreinterpretq_u32_u64(t));
+}
+
+/* Advanced SIMD is mandatory on AArch64, so there is nothing to probe.  */
+static bool use_neon = true;
+
+bool test_buffer_is_zero_next_accel(void)
+{
+    if (!use_neon) {
+        return false;
+    }
+    use_neon = false;
+    return true;
+}
+
+static bool select_accel_fn(const void *buf, size_t len)
+{
+    if (likely(len >= 64) && use_neon) {
+        return buffer_zero_neon(buf, len);
+    }
+    return buffer_zero_int(buf, len);
+}
+
 #else
 #define select_accel_fn  buffer_zero_int
 bool test_buffer_is_zero_next_accel(void)
@@ -308,3 +412,30 @@ bool buffer_is_zero(const void *buf, size_t len)
        includes a check for an unrolled loop over 64-bit integers.  */
     return select_accel_fn(buf, len);
 }
+
+/*
+ * Returns the offset of the first BUFFER_ZERO_LINE_SIZE-byte line of
+ * @buf that contains a non-zero byte, or @len if the buffer is all
+ * zeroes.  Lines are counted from @buf; the last one may be short.
+ */
+size_t buffer_find_nonzero_offset(const void *buf, size_t len)
+{
+    /* Large enough for the accelerated loops to pay off, small enough
+       that rescanning a non-zero chunk line by line is cheap.  */
+    const size_t chunk = 16 * BUFFER_ZERO_LINE_SIZE;
+    size_t i, j, n;
+
+    for (i = 0; i < len; i += chunk) {
+        n = MIN(chunk, len - i);
+        if (buffer_is_zero(buf + i, n)) {
+            continue;
+        }
+        for (j = 0; j < n; j += BUFFER_ZERO_LINE_SIZE) {
+            if (!buffer_is_zero(buf + i + j,
+                                MIN(BUFFER_ZERO_LINE_SIZE, n - j))) {
+                return i + j;
+            }
+        }
+    }
+    return len;
+}
@@ -0,0 +1,270 @@
+/*
+ * Host-specific assembly coroutine switching
+ *
+ * The context switch only exchanges the stack pointer (plus the frame
+ * pointer and resume address where the architecture needs them); all
+ * other registers are declared as clobbered, so the compiler saves
+ * exactly the values that are live across qemu_coroutine_switch().
+ * Unlike the ucontext and sigsetjmp based backends, no signal mask or
+ * full register file is saved and no system call is ever made.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+#include "qemu/coroutine_int.h"
+
+#ifdef CONFIG_VALGRIND_H
+#include <valgrind/valgrind.h>
+#endif
+
+#if defined(__SANITIZE_ADDRESS__) || __has_feature(address_sanitizer)
+#ifdef CONFIG_ASAN_IFACE_FIBER
+#define CONFIG_ASAN 1
+#include <sanitizer/asan_interface.h>
+#endif
+#endif
+
+typedef struct {
+    Coroutine base;
+    void *sp;               /* NULL until the coroutine first runs */
+
+    /* Resume address and frame pointer, only used on AArch64 */
+    uintptr_t pc;
+    uintptr_t fp;
+
+    void *stack;
+    size_t stack_size;
+
+#ifdef CONFIG_VALGRIND_H
+    unsigned int valgrind_stack_id;
+#endif
+} CoroutineAsm;
+
+/**
+ * Per-thread coroutine bookkeeping
+ */
+static __thread CoroutineAsm leader;
+static __thread Coroutine *current;
+
+static void finish_switch_fiber(void *fake_stack_save)
+{
+#ifdef CONFIG_ASAN
+    const void *bottom_old;
+    size_t size_old;
+
+    __sanitizer_finish_switch_fiber(fake_stack_save, &bottom_old, &size_old);
+
+    if (!leader.stack) {
+        leader.stack = (void *)bottom_old;
+        leader.stack_size = size_old;
+    }
+#endif
+}
+
+static void start_switch_fiber(void **fake_stack_save,
+                               const void *bottom, size_t size)
+{
+#ifdef CONFIG_ASAN
+    __sanitizer_start_switch_fiber(fake_stack_save, bottom, size);
+#endif
+}
+
+static void __attribute__((__used__, __noreturn__))
+coroutine_trampoline(CoroutineAsm *self)
+{
+    Coroutine *co = &self->base;
+
+    finish_switch_fiber(NULL);
+
+    while (true) {
+        co->entry(co->entry_arg);
+        qemu_coroutine_switch(co, co->caller, COROUTINE_TERMINATE);
+    }
+}
+
+#if defined(__x86_64__)
+
+/*
+ * The source pushes %rbp and a return address into itself, then saves
+ * %rsp.  Switching to it later is a plain "ret" from the destination.
+ * The red zone of the enclosing function is skipped first, because the
+ * compiler cannot know that the asm writes below the stack pointer.
+ * %rax carries the CoroutineAction, %rdi the destination, which is
+ * also the argument of coroutine_trampoline() for a new coroutine.
+ */
+#define CO_SWITCH(from, to, action, jump) ({                                \
+    int action_ = (action);                                                 \
+    void *from_ = (from);                                                   \
+    void *to_ = (to);                                                       \
+    asm volatile(                                                           \
+        "lea -128(%%rsp), %%rsp\n"                                          \
+        "pushq %%rbp\n"                                                     \
+        "call 1f\n"                     /* source resumes at "jmp 2f" */    \
+        "jmp 2f\n"                                                          \
+        "1: movq %%rsp, %c[SP](%[FROM])\n"                                  \
+        "movq %c[SP](%[TO]), %%rsp\n"                                       \
+        jump "\n"                                                           \
+        "2: popq %%rbp\n"                                                   \
+        "lea 128(%%rsp), %%rsp\n"                                           \
+        : "+a" (action_), [FROM] "+b" (from_), [TO] "+D" (to_)              \
+        : [SP] "i" (offsetof(CoroutineAsm, sp))                             \
+        : "rcx", "rdx", "rsi", "r8", "r9", "r10", "r11",                    \
+          "r12", "r13", "r14", "r15",                                       \
+          "xmm0", "xmm1", "xmm2", "xmm3", "xmm4", "xmm5", "xmm6", "xmm7",   \
+          "xmm8", "xmm9", "xmm10", "xmm11", "xmm12", "xmm13", "xmm14",      \
+          "xmm15", "cc", "memory");                                         \
+    action_;                                                                \
+})
+
+/* "call" leaves the new stack aligned as the ABI expects on entry */
+#define CO_SWITCH_NEW(from, to) \
+    CO_SWITCH(from, to, 0, "call coroutine_trampoline")
+#define CO_SWITCH_RET(from, to, action) \
+    CO_SWITCH(from, to, action, "ret")
+
+#elif defined(__aarch64__)
+
+/*
+ * Save the resume address, stack pointer and frame pointer of the source
+ * and load those of the destination.  x0 carries the CoroutineAction; a
+ * new coroutine starts at coroutine_trampoline() with x0 pointing to it.
+ */
+#define CO_SWITCH_RET(from, to, action) ({                                  \
+    register uintptr_t action_ __asm__("x0") = (action);                    \
+    register void *from_ __asm__("x16") = (from);                           \
+    register void *to_ __asm__("x1") = (to);                                \
+    asm volatile(                                                           \
+        "adr x30, 1f\n"                                                     \
+        "str x30, [x16, %[PC]]\n"                                           \
+        "mov x30, sp\n"                                                     \
+        "str x30, [x16, %[SP]]\n"                                           \
+        "str x29, [x16, %[FP]]\n"                                           \
+        "ldr x30, [x1, %[PC]]\n"                                            \
+        "ldr x29, [x1, %[FP]]\n"                                            \
+        "ldr x1, [x1, %[SP]]\n"                                             \
+        "mov sp, x1\n"                                                      \
+        "br x30\n"                                                          \
+        "1:\n"                                                              \
+        : "+r" (action_), "+r" (from_), "+r" (to_)                          \
+        : [PC] "i" (offsetof(CoroutineAsm, pc)),                            \
+          [SP] "i" (offsetof(CoroutineAsm, sp)),                            \
+          [FP] "i" (offsetof(CoroutineAsm, fp))                             \
+        : "x2", "x3", "x4", "x5", "x6", "x7", "x8", "x9", "x10", "x11",     \
+          "x12", "x13", "x14", "x15", "x17", "x19", "x20", "x21", "x22",    \
+          "x23", "x24", "x25", "x26", "x27", "x28", "x30",                  \
+          "v0", "v1", "v2", "v3", "v4", "v5", "v6", "v7", "v8", "v9",       \
+          "v10", "v11", "v12", "v13", "v14", "v15", "v16", "v17", "v18",    \
+          "v19", "v20", "v21", "v22", "v23", "v24", "v25", "v26", "v27",    \
+          "v28", "v29", "v30", "v31", "cc", "memory");                      \
+    (int)action_;                                                           \
+})
+
+#define CO_SWITCH_NEW(from, to) ({                                          \
+    (to)->pc = (uintptr_t)coroutine_trampoline;                             \
+    (to)->fp = 0;                                                           \
+    CO_SWITCH_RET(from, to, (uintptr_t)(to));                               \
+})
+
+#else
+#error "coroutine-asm.c only supports x86-64 and AArch64 hosts"
+#endif
+
+Coroutine *qemu_coroutine_new(void)
+{
+    CoroutineAsm *co;
+
+    co = g_malloc0(sizeof(*co));
+    co->stack_size = COROUTINE_STACK_SIZE;
+    co->stack = qemu_alloc_stack(&co->stack_size);
+
+#ifdef CONFIG_VALGRIND_H
+    co->valgrind_stack_id =
+        VALGRIND_STACK_REGISTER(co->stack, co->stack + co->stack_size);
+#endif
+
+    return &co->base;
+}
+
+#ifdef CONFIG_VALGRIND_H
+#if defined(CONFIG_PRAGMA_DIAGNOSTIC_AVAILABLE) && !defined(__clang__)
+/* Work around an unused variable in the valgrind.h macro... */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-but-set-variable"
+#endif
+static inline void valgrind_stack_deregister(CoroutineAsm *co)
+{
+    VALGRIND_STACK_DEREGISTER(co->valgrind_stack_id);
+}
+#if defined(CONFIG_PRAGMA_DIAGNOSTIC_AVAILABLE) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+void qemu_coroutine_delete(Coroutine *co_)
+{
+    CoroutineAsm *co = DO_UPCAST(CoroutineAsm, base, co_);
+
+#ifdef CONFIG_VALGRIND_H
+    valgrind_stack_deregister(co);
+#endif
+
+    qemu_free_stack(co->stack, co->stack_size);
+    g_free(co);
+}
+
+/* This function is marked noinline for the same reason as in
+ * coroutine-ucontext.c: the switch may return in a different thread, so
+ * the address of the TLS variable "current" must not be hoisted out of
+ * the trampoline's loop.
+ */
+CoroutineAction __attribute__((noinline))
+qemu_coroutine_switch(Coroutine *from_, Coroutine *to_,
+                      CoroutineAction action)
+{
+    CoroutineAsm *from = DO_UPCAST(CoroutineAsm, base, from_);
+    CoroutineAsm *to = DO_UPCAST(CoroutineAsm, base, to_);
+    void *fake_stack_save = NULL;
+
+    current = to_;
+
+    start_switch_fiber(action == COROUTINE_TERMINATE ?
+                       NULL : &fake_stack_save, to->stack, to->stack_size);
+
+    if (!to->sp) {
+        /* Coroutines are recycled by looping in coroutine_trampoline() */
+        to->sp = to->stack + to->stack_size;
+        action = CO_SWITCH_NEW(from, to);
+    } else {
+        action = CO_SWITCH_RET(from, to, action);
+    }
+
+    finish_switch_fiber(fake_stack_save);
+
+    return action;
+}
+
+Coroutine *qemu_coroutine_self(void)
+{
+    if (!current) {
+        current = &leader.base;
+    }
+    return current;
+}
+
+bool qemu_in_coroutine(void)
+{
+    return current && current->caller;
+}
@@ -192,6 +192,25 @@ void hbitmap_iter_init(HBitmapIter *hbi, const HBitmap *hb, uint64_t first)
     }
 }
 
+/* Return the index of the first word from @pos on that is not all ones,
+ * or @sz if there is none.  Four words are tested per iteration, which
+ * keeps long runs of dirty clusters cheap to skip.
+ */
+static size_t hb_find_not_full(const unsigned long *words, size_t pos,
+                               size_t sz)
+{
+    for (; pos + 4 <= sz; pos += 4) {
+        if ((words[pos] & words[pos + 1] &
+             words[pos + 2] & words[pos + 3]) != (unsigned long)-1) {
+            break;
+        }
+    }
+    while (pos < sz && words[pos] == (unsigned long)-1) {
+        pos++;
+    }
+    return pos;
+}
+
 int64_t hbitmap_next_zero(const HBitmap *hb, uint64_t start)
 {
     size_t pos = (start >> hb->granularity) >> BITS_PER_LEVEL;
@@ -206,9 +225,7 @@ int64_t hbitmap_next_zero(const HBitmap *hb, uint64_t start)
     assert((start >> hb->granularity) < hb->size);
 
     if (cur == (unsigned long)-1) {
-        do {
-            pos++;
-        } while (pos < sz && last_lev[pos] == (unsigned long)-1);
+        pos = hb_find_not_full(last_lev, pos + 1, sz);
 
         if (pos >= sz) {
             return -1;
@@ -517,6 +534,9 @@ uint64_t hbitmap_serialization_size(const HBitmap *hb,
 {
     uint64_t el_count;
     unsigned long *cur;
+#ifdef HOST_WORDS_BIGENDIAN
+    unsigned long *end;
+#endif
 
     if (!count) {
         return 0;
@@ -530,12 +550,19 @@ void hbitmap_serialize_part(const HBitmap *hb, uint8_t *buf,
                             uint64_t start, uint64_t count)
 {
     uint64_t el_count;
-    unsigned long *cur, *end;
+    unsigned long *cur;
+#ifdef HOST_WORDS_BIGENDIAN
+    unsigned long *end;
+#endif
 
     if (!count) {
         return;
     }
     serialization_chunk(hb, start, count, &cur, &el_count);
+#ifndef HOST_WORDS_BIGENDIAN
+    /* The serialized format is the little-endian image of the words.  */
+    memcpy(buf, cur, el_count * sizeof(unsigned long));
+#else
     end = cur + el_count;
 
     while (cur != end) {
@@ -546,6 +573,7 @@ void hbitmap_serialize_part(const HBitmap *hb, uint8_t *buf,
         buf += sizeof(el);
         cur++;
     }
+#endif
 }
 
 void hbitmap_deserialize_part(HBitmap *hb, uint8_t *buf,
@@ -553,12 +581,18 @@ void hbitmap_deserialize_part(HBitmap *hb, uint8_t *buf,
                               bool finish)
 {
     uint64_t el_count;
-    unsigned long *cur, *end;
+    unsigned long *cur;
+#ifdef HOST_WORDS_BIGENDIAN
+    unsigned long *end;
+#endif
 
     if (!count) {
         return;
     }
     serialization_chunk(hb, start, count, &cur, &el_count);
+#ifndef HOST_WORDS_BIGENDIAN
+    memcpy(cur, buf, el_count * sizeof(unsigned long));
+#else
     end = cur + el_count;
 
     while (cur != end) {
@@ -573,6 +607,7 @@ void hbitmap_deserialize_part(HBitmap *hb, uint8_t *buf,
         buf += sizeof(unsigned long);
         cur++;
     }
+#endif
     if (finish) {
         hbitmap_deserialize_finish(hb);
     }
@@ -612,6 +647,43 @@ void hbitmap_deserialize_ones(HBitmap *hb, uint64_t start, uint64_t count,
     }
 }
 
+void hbitmap_deserialize_or(HBitmap *hb, const uint8_t *buf,
+                            uint64_t start, uint64_t count)
+{
+    uint64_t el_count, pos, last_pos, i;
+    unsigned long *cur;
+
+    if (!count) {
+        return;
+    }
+    serialization_chunk(hb, start, count, &cur, &el_count);
+    pos = cur - hb->levels[HBITMAP_LEVELS - 1];
+    last_pos = (hb->size - 1) >> BITS_PER_LEVEL;
+
+    for (i = 0; i < el_count; i++) {
+        unsigned long el, new_bits;
+
+        memcpy(&el, buf + i * sizeof(el), sizeof(el));
+        if (BITS_PER_LONG == 32) {
+            le32_to_cpus((uint32_t *)&el);
+        } else {
+            le64_to_cpus((uint64_t *)&el);
+        }
+
+        /* Ignore any garbage past the end of the bitmap */
+        if (pos + i == last_pos && (hb->size & (BITS_PER_LONG - 1))) {
+            el &= (1UL << (hb->size & (BITS_PER_LONG - 1))) - 1;
+        }
+
+        new_bits = el & ~cur[i];
+        if (new_bits) {
+            cur[i] |= new_bits;
+            hb->count += ctpopl(new_bits);
+            hb_set_between(hb, HBITMAP_LEVELS - 2, pos + i, pos + i);
+        }
+    }
+}
+
 void hbitmap_deserialize_finish(HBitmap *bitmap)
 {
     int64_t i, size, prev_size;
@@ -733,7 +805,7 @@ void hbitmap_truncate(HBitmap *hb, uint64_t size)
  */
 bool hbitmap_merge(HBitmap *a, const HBitmap *b)
 {
-    int i;
+    int i, last;
     uint64_t j;
 
     if ((a->size != b->size) || (a->granularity != b->granularity)) {
@@ -744,11 +816,25 @@ bool hbitmap_merge(HBitmap *a, const HBitmap *b)
         return true;
     }
 
-    /* This merge is O(size), as BITS_PER_LONG and HBITMAP_LEVELS are constant.
-     * It may be possible to improve running times for sparsely populated maps
-     * by using hbitmap_iter_next, but this is suboptimal for dense maps.
+    /* Only the last-level words that are nonzero in @b need to be merged,
+     * and the level above tells which ones they are.  This makes the merge
+     * O(size / BITS_PER_LONG) plus the number of dirty words in @b, and
+     * lets @a's count be updated on the way.
      */
-    for (i = HBITMAP_LEVELS - 1; i >= 0; i--) {
+    last = HBITMAP_LEVELS - 1;
+    for (j = 0; j < b->sizes[last - 1]; j++) {
+        unsigned long words = b->levels[last - 1][j];
+
+        while (words) {
+            uint64_t k = (j << BITS_PER_LEVEL) + ctzl(words);
+            unsigned long add = b->levels[last][k] & ~a->levels[last][k];
+
+            a->count += ctpopl(add);
+            a->levels[last][k] |= add;
+            words &= words - 1;
+        }
+    }
+    for (i = last - 1; i >= 0; i--) {
         for (j = 0; j < a->sizes[i]; j++) {
             a->levels[i][j] |= b->levels[i][j];
         }
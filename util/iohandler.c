@@ -74,11 +74,12 @@ void event_notifier_set_handler(EventNotifier *e,
                            handler, NULL);
 }
 
-/* reaping of zombies.  right now we're not passing the status to
-   anyone, but it would be possible to add a callback.  */
+/* reaping of zombies */
 #ifndef _WIN32
 typedef struct ChildProcessRecord {
     int pid;
+    ChildWatchFunc *cb;
+    void *opaque;
     QLIST_ENTRY(ChildProcessRecord) next;
 } ChildProcessRecord;
 
@@ -95,10 +96,14 @@ static void sigchld_handler(int signal)
 static void sigchld_bh_handler(void *opaque)
 {
     ChildProcessRecord *rec, *next;
+    int status;
 
     QLIST_FOREACH_SAFE(rec, &child_watches, next, next) {
-        if (waitpid(rec->pid, NULL, WNOHANG) == rec->pid) {
+        if (waitpid(rec->pid, &status, WNOHANG) == rec->pid) {
             QLIST_REMOVE(rec, next);
+            if (rec->cb) {
+                rec->cb(rec->pid, status, rec->opaque);
+            }
             g_free(rec);
         }
     }
@@ -115,7 +120,7 @@ static void qemu_init_child_watch(void)
     sigaction(SIGCHLD, &act, NULL);
 }
 
-int qemu_add_child_watch(pid_t pid)
+int qemu_add_child_watch_full(pid_t pid, ChildWatchFunc *cb, void *opaque)
 {
     ChildProcessRecord *rec;
 
@@ -130,7 +135,14 @@ int qemu_add_child_watch(pid_t pid)
     }
     rec = g_malloc0(sizeof(ChildProcessRecord));
     rec->pid = pid;
+    rec->cb = cb;
+    rec->opaque = opaque;
     QLIST_INSERT_HEAD(&child_watches, rec, next);
     return 0;
 }
+
+int qemu_add_child_watch(pid_t pid)
+{
+    return qemu_add_child_watch_full(pid, NULL, NULL);
+}
 #endif
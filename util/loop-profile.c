@@ -0,0 +1,129 @@
+/*
+ * Event loop and vCPU latency profiler
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/host-utils.h"
+#include "qemu/loop-profile.h"
+#include "qemu/thread.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-misc.h"
+
+typedef struct LoopProfileStats {
+    LoopProfileKind kind;
+    const void *callback;
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t histogram[LOOP_PROFILE_HISTOGRAM_BUCKETS];
+} LoopProfileStats;
+
+bool loop_profile_enabled;
+
+/* Protects loop_profile_stats, which maps (kind, callback) to statistics */
+static QemuMutex loop_profile_lock;
+static GHashTable *loop_profile_stats;
+
+static guint loop_profile_hash(gconstpointer key)
+{
+    const LoopProfileStats *s = key;
+
+    return g_direct_hash(s->callback) ^ s->kind;
+}
+
+static gboolean loop_profile_equal(gconstpointer a, gconstpointer b)
+{
+    const LoopProfileStats *sa = a, *sb = b;
+
+    return sa->kind == sb->kind && sa->callback == sb->callback;
+}
+
+void loop_profile_record(LoopProfileKind kind, const void *callback,
+                         int64_t start)
+{
+    LoopProfileStats key = { .kind = kind, .callback = callback };
+    LoopProfileStats *s;
+    uint64_t ns = MAX(get_clock() - start, 0);
+    int bucket = ns < 1024 ? 0 : 64 - clz64(ns >> 10);
+
+    qemu_mutex_lock(&loop_profile_lock);
+    s = g_hash_table_lookup(loop_profile_stats, &key);
+    if (!s) {
+        s = g_new(LoopProfileStats, 1);
+        *s = key;
+        g_hash_table_add(loop_profile_stats, s);
+    }
+    s->count++;
+    s->total_ns += ns;
+    s->max_ns = MAX(s->max_ns, ns);
+    s->histogram[MIN(bucket, LOOP_PROFILE_HISTOGRAM_BUCKETS - 1)]++;
+    qemu_mutex_unlock(&loop_profile_lock);
+}
+
+void qmp_set_loop_profile(bool enable, Error **errp)
+{
+    qemu_mutex_lock(&loop_profile_lock);
+    if (enable && !loop_profile_enabled) {
+        g_hash_table_remove_all(loop_profile_stats);
+    }
+    atomic_set(&loop_profile_enabled, enable);
+    qemu_mutex_unlock(&loop_profile_lock);
+}
+
+static gint loop_profile_compare(gconstpointer a, gconstpointer b)
+{
+    const LoopProfileStats *sa = a, *sb = b;
+
+    /* Most expensive first */
+    if (sa->total_ns != sb->total_ns) {
+        return sa->total_ns < sb->total_ns ? 1 : -1;
+    }
+    return 0;
+}
+
+LoopProfileEntryList *qmp_query_loop_profile(Error **errp)
+{
+    LoopProfileEntryList *head = NULL, **prev = &head;
+    GList *stats, *l;
+    int i;
+
+    qemu_mutex_lock(&loop_profile_lock);
+    stats = g_list_sort(g_hash_table_get_values(loop_profile_stats),
+                        loop_profile_compare);
+    for (l = stats; l; l = l->next) {
+        LoopProfileStats *s = l->data;
+        LoopProfileEntryList *elem = g_new0(LoopProfileEntryList, 1);
+        LoopProfileEntry *info = g_new0(LoopProfileEntry, 1);
+        uint64List **hist = &info->histogram;
+
+        info->kind = s->kind;
+        info->callback = (uintptr_t)s->callback;
+        info->count = s->count;
+        info->total_ns = s->total_ns;
+        info->max_ns = s->max_ns;
+        for (i = 0; i < LOOP_PROFILE_HISTOGRAM_BUCKETS; i++) {
+            *hist = g_new0(uint64List, 1);
+            (*hist)->value = s->histogram[i];
+            hist = &(*hist)->next;
+        }
+
+        elem->value = info;
+        *prev = elem;
+        prev = &elem->next;
+    }
+    qemu_mutex_unlock(&loop_profile_lock);
+
+    g_list_free(stats);
+    return head;
+}
+
+static void __attribute__((__constructor__)) loop_profile_init(void)
+{
+    qemu_mutex_init(&loop_profile_lock);
+    loop_profile_stats = g_hash_table_new_full(loop_profile_hash,
+                                               loop_profile_equal,
+                                               g_free, NULL);
+}
@@ -38,6 +38,7 @@
 #include <libgen.h>
 #include <sys/signal.h>
 #include "qemu/cutils.h"
+#include "qemu/bitops.h"
 
 #ifdef CONFIG_LINUX
 #include <sys/syscall.h>
@@ -59,8 +60,19 @@
 #include "qemu/error-report.h"
 #endif
 
+#ifdef __linux__
+#include <sched.h>
+
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+#endif
+
 #define MAX_MEM_PREALLOC_THREAD_COUNT 16
 
+/* The threads account their progress every this many bytes */
+#define MEM_PREALLOC_CHUNK (64 * 1024 * 1024)
+
 struct MemsetThread {
     char *addr;
     size_t numpages;
@@ -73,6 +85,16 @@ typedef struct MemsetThread MemsetThread;
 static MemsetThread *memset_thread;
 static int memset_num_threads;
 static bool memset_thread_failed;
+/* Fault the pages in with MADV_POPULATE_WRITE instead of touching them */
+static bool memset_populate;
+/* Bytes preallocated so far, and thread completions */
+static size_t memset_done;
+static QemuSemaphore memset_sem;
+#ifdef __linux__
+/* The CPUs of the memory's host NUMA nodes, if binding the threads */
+static cpu_set_t memset_cpus;
+static bool memset_bind;
+#endif
 
 int qemu_get_thread_id(void)
 {
@@ -307,11 +329,31 @@ static void sigbus_handler(int signal)
     }
 }
 
+/* Returns false if the pages could not be allocated */
+static bool populate_pages(char *addr, size_t numpages, size_t hpagesize)
+{
+#ifdef __linux__
+    while (madvise(addr, numpages * hpagesize, MADV_POPULATE_WRITE)) {
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+#endif
+    return true;
+}
+
 static void *do_touch_pages(void *arg)
 {
     MemsetThread *memset_args = (MemsetThread *)arg;
     sigset_t set, oldset;
 
+#ifdef __linux__
+    /* Allocate from the nodes' local CPUs; this is only an optimization */
+    if (memset_bind) {
+        sched_setaffinity(0, sizeof(memset_cpus), &memset_cpus);
+    }
+#endif
+
     /* unblock SIGBUS */
     sigemptyset(&set);
     sigaddset(&set, SIGBUS);
@@ -323,25 +365,37 @@ static void *do_touch_pages(void *arg)
         char *addr = memset_args->addr;
         size_t numpages = memset_args->numpages;
         size_t hpagesize = memset_args->hpagesize;
-        size_t i;
-        for (i = 0; i < numpages; i++) {
-            /*
-             * Read & write back the same value, so we don't
-             * corrupt existing user/app data that might be
-             * stored.
-             *
-             * 'volatile' to stop compiler optimizing this away
-             * to a no-op
-             *
-             * TODO: get a better solution from kernel so we
-             * don't need to write at all so we don't cause
-             * wear on the storage backing the region...
-             */
-            *(volatile char *)addr = *addr;
-            addr += hpagesize;
+        size_t chunk = MAX(MEM_PREALLOC_CHUNK / hpagesize, 1);
+        size_t i, n;
+
+        while (numpages) {
+            n = MIN(numpages, chunk);
+            if (memset_populate) {
+                if (!populate_pages(addr, n, hpagesize)) {
+                    memset_thread_failed = true;
+                    break;
+                }
+                addr += n * hpagesize;
+            } else {
+                for (i = 0; i < n; i++) {
+                    /*
+                     * Read & write back the same value, so we don't
+                     * corrupt existing user/app data that might be
+                     * stored.
+                     *
+                     * 'volatile' to stop compiler optimizing this away
+                     * to a no-op
+                     */
+                    *(volatile char *)addr = *addr;
+                    addr += hpagesize;
+                }
+            }
+            atomic_add(&memset_done, n * hpagesize);
+            numpages -= n;
         }
     }
     pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+    qemu_sem_post(&memset_sem);
     return NULL;
 }
 
@@ -357,16 +411,69 @@ static inline int get_memset_num_threads(int smp_cpus)
     return ret;
 }
 
+#ifdef __linux__
+/* Add the CPUs of host NUMA node @node to @set, as listed in sysfs */
+static void add_node_cpus(unsigned long node, cpu_set_t *set)
+{
+    char *path = g_strdup_printf("/sys/devices/system/node/node%lu/cpulist",
+                                 node);
+    unsigned long first, last;
+    gchar *contents;
+    const char *p;
+
+    if (g_file_get_contents(path, &contents, NULL, NULL)) {
+        p = contents;
+        while (!qemu_strtoul(p, &p, 10, &first)) {
+            last = first;
+            if (*p == '-' && qemu_strtoul(p + 1, &p, 10, &last)) {
+                break;
+            }
+            for (; first <= last && first < CPU_SETSIZE; first++) {
+                CPU_SET(first, set);
+            }
+            if (*p != ',') {
+                break;
+            }
+            p++;
+        }
+        g_free(contents);
+    }
+    g_free(path);
+}
+#endif
+
 static bool touch_all_pages(char *area, size_t hpagesize, size_t numpages,
-                            int smp_cpus)
+                            int smp_cpus, const unsigned long *host_nodes,
+                            unsigned long max_node,
+                            MemPreallocProgress *progress, void *opaque)
 {
     size_t numpages_per_thread;
     size_t size_per_thread;
+    size_t total = numpages * hpagesize;
     char *addr = area;
     int i = 0;
 
     memset_thread_failed = false;
     memset_num_threads = get_memset_num_threads(smp_cpus);
+#ifdef __linux__
+    memset_bind = false;
+    if (host_nodes && find_first_bit(host_nodes, max_node) < max_node) {
+        unsigned long node;
+
+        CPU_ZERO(&memset_cpus);
+        for (node = find_first_bit(host_nodes, max_node); node < max_node;
+             node = find_next_bit(host_nodes, max_node, node + 1)) {
+            add_node_cpus(node, &memset_cpus);
+        }
+        if (CPU_COUNT(&memset_cpus)) {
+            memset_bind = true;
+            memset_num_threads = MIN(memset_num_threads,
+                                     CPU_COUNT(&memset_cpus));
+        }
+    }
+#endif
+    atomic_set(&memset_done, 0);
+    qemu_sem_init(&memset_sem, 0);
     memset_thread = g_new0(MemsetThread, memset_num_threads);
     numpages_per_thread = (numpages / memset_num_threads);
     size_per_thread = (hpagesize * numpages_per_thread);
@@ -381,16 +488,27 @@ static bool touch_all_pages(char *area, size_t hpagesize, size_t numpages,
         addr += size_per_thread;
         numpages -= numpages_per_thread;
     }
+    /* Report progress about once a second until all threads are done */
+    for (i = 0; i < memset_num_threads; ) {
+        if (qemu_sem_timedwait(&memset_sem, 1000) == 0) {
+            i++;
+        } else if (progress) {
+            progress(atomic_read(&memset_done), total, opaque);
+        }
+    }
     for (i = 0; i < memset_num_threads; i++) {
         qemu_thread_join(&memset_thread[i].pgthread);
     }
     g_free(memset_thread);
     memset_thread = NULL;
+    qemu_sem_destroy(&memset_sem);
 
     return memset_thread_failed;
 }
 
 void os_mem_prealloc(int fd, char *area, size_t memory, int smp_cpus,
+                     const unsigned long *host_nodes, unsigned long max_node,
+                     MemPreallocProgress *progress, void *opaque,
                      Error **errp)
 {
     int ret;
@@ -409,8 +527,19 @@ void os_mem_prealloc(int fd, char *area, size_t memory, int smp_cpus,
         return;
     }
 
+#ifdef __linux__
+    /*
+     * Faulting the pages in from the kernel avoids both writing to every
+     * page and relying on SIGBUS to detect failures.  It is available
+     * since Linux 5.14; older kernels fail with EINVAL.
+     */
+    memset_populate = !madvise(area, hpagesize, MADV_POPULATE_WRITE) ||
+                      errno != EINVAL;
+#endif
+
     /* touch pages simultaneously */
-    if (touch_all_pages(area, hpagesize, numpages, smp_cpus)) {
+    if (touch_all_pages(area, hpagesize, numpages, smp_cpus,
+                        host_nodes, max_node, progress, opaque)) {
         error_setg(errp, "os_mem_prealloc: Insufficient free host memory "
             "pages available to allocate guest RAM");
     }
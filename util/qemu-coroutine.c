@@ -23,8 +23,18 @@
 
 enum {
     POOL_BATCH_SIZE = 64,
+    POOL_MAX_SIZE = 4096,
 };
 
+/* Coroutines created and not yet terminated, and the recent peak of that
+ * number.  The peak sizes release_pool so that workloads with more
+ * requests in flight than the default can recycle all of their
+ * coroutines; it decays back towards the current usage over time.
+ * Both are heuristics and updated without further synchronization.
+ */
+static unsigned int coroutines_in_use;
+static unsigned int coroutines_peak;
+
 /** Free list to speed up creation */
 static QSLIST_HEAD(, Coroutine) release_pool = QSLIST_HEAD_INITIALIZER(pool);
 static unsigned int release_pool_size;
@@ -43,6 +53,32 @@ static void coroutine_pool_cleanup(Notifier *n, void *value)
     }
 }
 
+static void coroutine_pool_account(void)
+{
+    unsigned int in_use = atomic_fetch_inc(&coroutines_in_use) + 1;
+
+    if (in_use > atomic_read(&coroutines_peak)) {
+        atomic_set(&coroutines_peak, in_use);
+    }
+}
+
+/* Called every time a thread refills its alloc_pool, i.e. roughly once
+ * per POOL_BATCH_SIZE coroutines created.
+ */
+static void coroutine_pool_decay(void)
+{
+    unsigned int peak = atomic_read(&coroutines_peak);
+
+    atomic_set(&coroutines_peak,
+               MAX(peak - peak / 16, atomic_read(&coroutines_in_use)));
+}
+
+static unsigned int coroutine_release_pool_max(void)
+{
+    return MIN(MAX(POOL_BATCH_SIZE * 2, atomic_read(&coroutines_peak)),
+               POOL_MAX_SIZE);
+}
+
 Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque)
 {
     Coroutine *co = NULL;
@@ -64,12 +100,15 @@ Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque)
                 alloc_pool_size = atomic_xchg(&release_pool_size, 0);
                 QSLIST_MOVE_ATOMIC(&alloc_pool, &release_pool);
                 co = QSLIST_FIRST(&alloc_pool);
+
+                coroutine_pool_decay();
             }
         }
         if (co) {
             QSLIST_REMOVE_HEAD(&alloc_pool, pool_next);
             alloc_pool_size--;
         }
+        coroutine_pool_account();
     }
 
     if (!co) {
@@ -87,7 +126,9 @@ static void coroutine_delete(Coroutine *co)
     co->caller = NULL;
 
     if (CONFIG_COROUTINE_POOL) {
-        if (release_pool_size < POOL_BATCH_SIZE * 2) {
+        atomic_dec(&coroutines_in_use);
+
+        if (release_pool_size < coroutine_release_pool_max()) {
             QSLIST_INSERT_HEAD_ATOMIC(&release_pool, co, pool_next);
             atomic_inc(&release_pool_size);
             return;
@@ -65,10 +65,20 @@ static QEMUClock qemu_clocks[QEMU_CLOCK_MAX];
  * reenabling the clock can call all the notifiers.
  */
 
+/* Active timers are kept in a binary min-heap ordered by expiry time,
+ * so arming and deleting a timer is O(log n).  active_timers always
+ * points to the root of the heap, i.e. the timer that expires first,
+ * and is what the lockless fast paths look at.
+ */
+
 struct QEMUTimerList {
     QEMUClock *clock;
     QemuMutex active_timers_lock;
     QEMUTimer *active_timers;
+    QEMUTimer **heap;
+    size_t heap_len;
+    size_t heap_size;
+    uint64_t next_seq;
     QLIST_ENTRY(QEMUTimerList) list;
     QEMUTimerListNotifyCB *notify_cb;
     void *notify_opaque;
@@ -119,6 +129,7 @@ void timerlist_free(QEMUTimerList *timer_list)
         QLIST_REMOVE(timer_list, list);
     }
     qemu_mutex_destroy(&timer_list->active_timers_lock);
+    g_free(timer_list->heap);
     g_free(timer_list);
 }
 
@@ -356,43 +367,102 @@ void timer_deinit(QEMUTimer *ts)
     ts->timer_list = NULL;
 }
 
-static void timer_del_locked(QEMUTimerList *timer_list, QEMUTimer *ts)
+/* Timers with the same expiry time fire in the order they were armed */
+static bool timer_before(QEMUTimer *a, QEMUTimer *b)
 {
-    QEMUTimer **pt, *t;
+    return a->expire_time < b->expire_time ||
+           (a->expire_time == b->expire_time && a->seq < b->seq);
+}
 
-    ts->expire_time = -1;
-    pt = &timer_list->active_timers;
-    for(;;) {
-        t = *pt;
-        if (!t)
-            break;
-        if (t == ts) {
-            atomic_set(pt, t->next);
+static void timerlist_heap_set(QEMUTimerList *timer_list, size_t i,
+                               QEMUTimer *ts)
+{
+    timer_list->heap[i] = ts;
+    ts->heap_index = i;
+}
+
+static void timerlist_heap_sift_up(QEMUTimerList *timer_list, size_t i)
+{
+    QEMUTimer *ts = timer_list->heap[i];
+
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+
+        if (!timer_before(ts, timer_list->heap[parent])) {
             break;
         }
-        pt = &t->next;
+        timerlist_heap_set(timer_list, i, timer_list->heap[parent]);
+        i = parent;
     }
+    timerlist_heap_set(timer_list, i, ts);
 }
 
-static bool timer_mod_ns_locked(QEMUTimerList *timer_list,
-                                QEMUTimer *ts, int64_t expire_time)
+static void timerlist_heap_sift_down(QEMUTimerList *timer_list, size_t i)
 {
-    QEMUTimer **pt, *t;
+    QEMUTimer *ts = timer_list->heap[i];
 
-    /* add the timer in the sorted list */
-    pt = &timer_list->active_timers;
     for (;;) {
-        t = *pt;
-        if (!timer_expired_ns(t, expire_time)) {
+        size_t child = 2 * i + 1;
+
+        if (child >= timer_list->heap_len) {
             break;
         }
-        pt = &t->next;
+        if (child + 1 < timer_list->heap_len &&
+            timer_before(timer_list->heap[child + 1],
+                         timer_list->heap[child])) {
+            child++;
+        }
+        if (!timer_before(timer_list->heap[child], ts)) {
+            break;
+        }
+        timerlist_heap_set(timer_list, i, timer_list->heap[child]);
+        i = child;
     }
+    timerlist_heap_set(timer_list, i, ts);
+}
+
+static void timerlist_update_first(QEMUTimerList *timer_list)
+{
+    atomic_set(&timer_list->active_timers,
+               timer_list->heap_len ? timer_list->heap[0] : NULL);
+}
+
+static void timer_del_locked(QEMUTimerList *timer_list, QEMUTimer *ts)
+{
+    size_t i = ts->heap_index;
+    QEMUTimer *last;
+
+    if (!timer_pending(ts)) {
+        return;
+    }
+    ts->expire_time = -1;
+
+    assert(i < timer_list->heap_len && timer_list->heap[i] == ts);
+    last = timer_list->heap[--timer_list->heap_len];
+    if (last != ts) {
+        timerlist_heap_set(timer_list, i, last);
+        timerlist_heap_sift_down(timer_list, i);
+        timerlist_heap_sift_up(timer_list, last->heap_index);
+    }
+    timerlist_update_first(timer_list);
+}
+
+static bool timer_mod_ns_locked(QEMUTimerList *timer_list,
+                                QEMUTimer *ts, int64_t expire_time)
+{
+    if (timer_list->heap_len == timer_list->heap_size) {
+        timer_list->heap_size = MAX(timer_list->heap_size * 2, 16);
+        timer_list->heap = g_renew(QEMUTimer *, timer_list->heap,
+                                   timer_list->heap_size);
+    }
+
     ts->expire_time = MAX(expire_time, 0);
-    ts->next = *pt;
-    atomic_set(pt, ts);
+    ts->seq = timer_list->next_seq++;
+    timer_list->heap[timer_list->heap_len] = ts;
+    timerlist_heap_sift_up(timer_list, timer_list->heap_len++);
+    timerlist_update_first(timer_list);
 
-    return pt == &timer_list->active_timers;
+    return timer_list->heap[0] == ts;
 }
 
 static void timerlist_rearm(QEMUTimerList *timer_list)
@@ -525,9 +595,7 @@ bool timerlist_run_timers(QEMUTimerList *timer_list)
         }
 
         /* remove timer from the list before calling the callback */
-        timer_list->active_timers = ts->next;
-        ts->next = NULL;
-        ts->expire_time = -1;
+        timer_del_locked(timer_list, ts);
         cb = ts->cb;
         opaque = ts->opaque;
         qemu_mutex_unlock(&timer_list->active_timers_lock);
@@ -48,6 +48,15 @@
  * ht->map pointer is set, and the old map is freed once no RCU readers can see
  * it anymore.
  *
+ * Doubling the number of buckets, which is what auto-resizing does, is instead
+ * done incrementally: the new map is published right away with a pointer to
+ * the old one, and each old bucket is migrated to the two new buckets it splits
+ * into either by the resizing thread or by the first writer that needs one of
+ * them, whichever comes first. Lookups on a bucket that has not been migrated
+ * yet are redirected to the old map. This way writers only ever wait for the
+ * migration of the bucket they are about to modify, instead of for the whole
+ * table to be copied.
+ *
  * Writers check for concurrent resizes by comparing ht->map before and after
  * acquiring their bucket lock. If they don't match, a resize has occured
  * while the bucket spinlock was being acquired.
@@ -68,6 +77,7 @@
 #include "qemu/osdep.h"
 #include "qemu/qht.h"
 #include "qemu/atomic.h"
+#include "qemu/bitops.h"
 #include "qemu/rcu.h"
 
 //#define QHT_DEBUG
@@ -119,6 +129,10 @@ QEMU_BUILD_BUG_ON(sizeof(struct qht_bucket) > QHT_BUCKET_ALIGN);
  * @n_added_buckets: number of added (i.e. "non-head") buckets
  * @n_added_buckets_threshold: threshold to trigger an upward resize once the
  *                             number of added buckets surpasses it.
+ * @old: map with half as many buckets whose entries are still being migrated
+ *       to this one, or NULL.
+ * @migrated: bitmap with one bit per bucket of @old, set once that bucket has
+ *            been migrated. Only valid while @old is set.
  *
  * Buckets are tracked in what we call a "map", i.e. this structure.
  */
@@ -128,6 +142,8 @@ struct qht_map {
     size_t n_buckets;
     size_t n_added_buckets;
     size_t n_added_buckets_threshold;
+    struct qht_map *old;
+    unsigned long *migrated;
 };
 
 /* trigger a resize when n_added_buckets > n_buckets / div */
@@ -136,6 +152,10 @@ struct qht_map {
 static void qht_do_resize_reset(struct qht *ht, struct qht_map *new,
                                 bool reset);
 static void qht_grow_maybe(struct qht *ht);
+static void *qht_insert__locked(struct qht *ht, struct qht_map *map,
+                                struct qht_bucket *head, void *p, uint32_t hash,
+                                bool *needs_resize);
+static void qht_map_migrate_all(struct qht *ht, struct qht_map *map);
 
 #ifdef QHT_DEBUG
 
@@ -201,6 +221,74 @@ struct qht_bucket *qht_map_to_bucket(struct qht_map *map, uint32_t hash)
     return &map->buckets[hash & (map->n_buckets - 1)];
 }
 
+/* @old must be @map->old, read under an RCU read-critical section */
+static inline bool
+qht_map_bucket_migrated(struct qht_map *map, struct qht_map *old, uint32_t hash)
+{
+    size_t idx = hash & (old->n_buckets - 1);
+    unsigned long word = atomic_read(&map->migrated[BIT_WORD(idx)]);
+
+    /* pairs with the atomic_or in qht_map_migrate_bucket */
+    smp_rmb();
+    return word & BIT_MASK(idx);
+}
+
+/*
+ * Move the entries of bucket @idx of @old into the two buckets of @map it
+ * splits into. @old's chain is left untouched, since lookups that started
+ * before the migration may still be walking it; it is freed together with
+ * @old once the whole map has been migrated and RCU readers are done.
+ *
+ * Lock order: the old bucket first, then the new buckets in increasing order.
+ * Call with no bucket lock held.
+ */
+static void qht_map_migrate_bucket(struct qht *ht, struct qht_map *map,
+                                   struct qht_map *old, size_t idx)
+{
+    struct qht_bucket *from = &old->buckets[idx];
+    struct qht_bucket *lo = &map->buckets[idx];
+    struct qht_bucket *hi = &map->buckets[idx + old->n_buckets];
+    struct qht_bucket *b;
+    int i;
+
+    qemu_spin_lock(&from->lock);
+    qemu_spin_lock(&lo->lock);
+    qemu_spin_lock(&hi->lock);
+
+    if (!(map->migrated[BIT_WORD(idx)] & BIT_MASK(idx))) {
+        for (b = from; b; b = b->next) {
+            for (i = 0; i < QHT_BUCKET_ENTRIES; i++) {
+                void *p = b->pointers[i];
+                uint32_t hash = b->hashes[i];
+
+                if (p == NULL) {
+                    goto done;
+                }
+                qht_insert__locked(ht, map, qht_map_to_bucket(map, hash), p,
+                                   hash, NULL);
+            }
+        }
+    done:
+        /* readers must see the copied entries before the bit */
+        atomic_or(&map->migrated[BIT_WORD(idx)], BIT_MASK(idx));
+    }
+
+    qemu_spin_unlock(&hi->lock);
+    qemu_spin_unlock(&lo->lock);
+    qemu_spin_unlock(&from->lock);
+}
+
+/* make sure the bucket for @hash has been migrated; call with no locks held */
+static inline void qht_map_migrate_maybe(struct qht *ht, struct qht_map *map,
+                                         uint32_t hash)
+{
+    struct qht_map *old = atomic_rcu_read(&map->old);
+
+    if (unlikely(old) && !qht_map_bucket_migrated(map, old, hash)) {
+        qht_map_migrate_bucket(ht, map, old, hash & (old->n_buckets - 1));
+    }
+}
+
 /* acquire all bucket locks from a map */
 static void qht_map_lock_buckets(struct qht_map *map)
 {
@@ -246,6 +334,7 @@ void qht_map_lock_buckets__no_stale(struct qht *ht, struct qht_map **pmap)
     struct qht_map *map;
 
     map = atomic_rcu_read(&ht->map);
+    qht_map_migrate_all(ht, map);
     qht_map_lock_buckets(map);
     if (likely(!qht_map_is_stale__locked(ht, map))) {
         *pmap = map;
@@ -256,6 +345,7 @@ void qht_map_lock_buckets__no_stale(struct qht *ht, struct qht_map **pmap)
     /* we raced with a resize; acquire ht->lock to see the updated ht->map */
     qemu_mutex_lock(&ht->lock);
     map = ht->map;
+    qht_map_migrate_all(ht, map);
     qht_map_lock_buckets(map);
     qemu_mutex_unlock(&ht->lock);
     *pmap = map;
@@ -278,6 +368,7 @@ struct qht_bucket *qht_bucket_lock__no_stale(struct qht *ht, uint32_t hash,
     struct qht_map *map;
 
     map = atomic_rcu_read(&ht->map);
+    qht_map_migrate_maybe(ht, map, hash);
     b = qht_map_to_bucket(map, hash);
 
     qemu_spin_lock(&b->lock);
@@ -287,7 +378,10 @@ struct qht_bucket *qht_bucket_lock__no_stale(struct qht *ht, uint32_t hash,
     }
     qemu_spin_unlock(&b->lock);
 
-    /* we raced with a resize; acquire ht->lock to see the updated ht->map */
+    /*
+     * We raced with a resize; acquire ht->lock to see the updated ht->map.
+     * The resizer migrates the whole map before releasing ht->lock.
+     */
     qemu_mutex_lock(&ht->lock);
     map = ht->map;
     b = qht_map_to_bucket(map, hash);
@@ -323,6 +417,7 @@ static void qht_map_destroy(struct qht_map *map)
         qht_chain_destroy(&map->buckets[i]);
     }
     qemu_vfree(map->buckets);
+    g_free(map->migrated);
     g_free(map);
 }
 
@@ -333,6 +428,8 @@ static struct qht_map *qht_map_create(size_t n_buckets)
 
     map = g_malloc(sizeof(*map));
     map->n_buckets = n_buckets;
+    map->old = NULL;
+    map->migrated = NULL;
 
     map->n_added_buckets = 0;
     map->n_added_buckets_threshold = n_buckets /
@@ -482,15 +579,47 @@ void *qht_lookup__slowpath(struct qht_bucket *b, qht_lookup_func_t func,
     return ret;
 }
 
+/*
+ * Lookup in a map that is being migrated to. The new bucket's seqlock
+ * protects the check of the migrated bit: if the bucket is migrated, or
+ * written to after migration, while we are looking at the old bucket, we
+ * retry.
+ */
+static __attribute__((noinline))
+void *qht_lookup__migrating(struct qht_map *map, struct qht_map *old,
+                            qht_lookup_func_t func, const void *userp,
+                            uint32_t hash)
+{
+    struct qht_bucket *b = qht_map_to_bucket(map, hash);
+    unsigned int version;
+    void *ret;
+
+    do {
+        version = seqlock_read_begin(&b->sequence);
+        if (qht_map_bucket_migrated(map, old, hash)) {
+            ret = qht_do_lookup(b, func, userp, hash);
+        } else {
+            ret = qht_lookup__slowpath(qht_map_to_bucket(old, hash), func,
+                                       userp, hash);
+        }
+    } while (seqlock_read_retry(&b->sequence, version));
+    return ret;
+}
+
 void *qht_lookup_custom(struct qht *ht, const void *userp, uint32_t hash,
                         qht_lookup_func_t func)
 {
     struct qht_bucket *b;
     struct qht_map *map;
+    struct qht_map *old;
     unsigned int version;
     void *ret;
 
     map = atomic_rcu_read(&ht->map);
+    old = atomic_rcu_read(&map->old);
+    if (unlikely(old)) {
+        return qht_lookup__migrating(map, old, func, userp, hash);
+    }
     b = qht_map_to_bucket(map, hash);
 
     version = seqlock_read_begin(&b->sequence);
@@ -557,6 +686,46 @@ static void *qht_insert__locked(struct qht *ht, struct qht_map *map,
     return NULL;
 }
 
+/* migrate every bucket of @map's old map; call with no bucket lock held */
+static void qht_map_migrate_all(struct qht *ht, struct qht_map *map)
+{
+    struct qht_map *old = atomic_rcu_read(&map->old);
+    size_t i;
+
+    if (likely(old == NULL)) {
+        return;
+    }
+    for (i = 0; i < old->n_buckets; i++) {
+        if (!qht_map_bucket_migrated(map, old, i)) {
+            qht_map_migrate_bucket(ht, map, old, i);
+        }
+    }
+}
+
+/*
+ * Double the number of buckets, migrating the entries incrementally; see the
+ * comment at the top of this file. Concurrent writers keep going, and help
+ * with the migration of the buckets they touch.
+ * Call with ht->lock held.
+ */
+static void qht_do_grow(struct qht *ht)
+{
+    struct qht_map *old = ht->map;
+    struct qht_map *new = qht_map_create(old->n_buckets * 2);
+
+    new->migrated = bitmap_new(old->n_buckets);
+    new->old = old;
+    atomic_rcu_set(&ht->map, new);
+
+    /*
+     * Writers that locked one of @old's buckets before @new was published
+     * may still be writing to it; qht_map_migrate_bucket waits for them.
+     */
+    qht_map_migrate_all(ht, new);
+    atomic_set(&new->old, NULL);
+    call_rcu(old, qht_map_destroy, rcu);
+}
+
 static __attribute__((noinline)) void qht_grow_maybe(struct qht *ht)
 {
     struct qht_map *map;
@@ -571,9 +740,7 @@ static __attribute__((noinline)) void qht_grow_maybe(struct qht *ht)
     map = ht->map;
     /* another thread might have just performed the resize we were after */
     if (qht_map_needs_resize(map)) {
-        struct qht_map *new = qht_map_create(map->n_buckets * 2);
-
-        qht_do_resize(ht, new);
+        qht_do_grow(ht);
     }
     qemu_mutex_unlock(&ht->lock);
 }
@@ -605,6 +772,48 @@ bool qht_insert(struct qht *ht, void *p, uint32_t hash, void **existing)
     return false;
 }
 
+size_t qht_insert_bulk(struct qht *ht, void *const *ps, const uint32_t *hashes,
+                       size_t n)
+{
+    bool needs_resize = false;
+    size_t inserted = 0;
+    size_t i;
+
+    /* size the table once for all the new entries, then fill it */
+    if (ht->mode & QHT_MODE_AUTO_RESIZE) {
+        size_t n_buckets = qht_elems_to_buckets(n);
+
+        qemu_mutex_lock(&ht->lock);
+        if (n_buckets > ht->map->n_buckets) {
+            qht_do_resize(ht, qht_map_create(n_buckets));
+        }
+        qemu_mutex_unlock(&ht->lock);
+    }
+
+    for (i = 0; i < n; i++) {
+        struct qht_bucket *b;
+        struct qht_map *map;
+        void *prev;
+
+        /* NULL pointers are not supported */
+        qht_debug_assert(ps[i]);
+
+        b = qht_bucket_lock__no_stale(ht, hashes[i], &map);
+        prev = qht_insert__locked(ht, map, b, ps[i], hashes[i], &needs_resize);
+        qht_bucket_debug__locked(b);
+        qemu_spin_unlock(&b->lock);
+
+        if (prev == NULL) {
+            inserted++;
+        }
+    }
+
+    if (unlikely(needs_resize) && ht->mode & QHT_MODE_AUTO_RESIZE) {
+        qht_grow_maybe(ht);
+    }
+    return inserted;
+}
+
 static inline bool qht_entry_is_last(struct qht_bucket *b, int pos)
 {
     if (pos == QHT_BUCKET_ENTRIES - 1) {
@@ -739,6 +948,7 @@ void qht_iter(struct qht *ht, qht_iter_func_t func, void *userp)
     struct qht_map *map;
 
     map = atomic_rcu_read(&ht->map);
+    qht_map_migrate_all(ht, map);
     qht_map_lock_buckets(map);
     /* Note: ht here is merely for carrying ht->mode; ht->map won't be read */
     qht_map_iter__all_locked(ht, map, func, userp);
@@ -789,7 +999,10 @@ bool qht_resize(struct qht *ht, size_t n_elems)
     size_t ret = false;
 
     qemu_mutex_lock(&ht->lock);
-    if (n_buckets != ht->map->n_buckets) {
+    if (n_buckets == ht->map->n_buckets * 2) {
+        qht_do_grow(ht);
+        ret = true;
+    } else if (n_buckets != ht->map->n_buckets) {
         struct qht_map *new;
 
         new = qht_map_create(n_buckets);
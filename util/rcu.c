@@ -49,6 +49,13 @@ QemuEvent rcu_gp_event;
 static QemuMutex rcu_registry_lock;
 static QemuMutex rcu_sync_lock;
 
+/*
+ * Grace period sequence number, odd while synchronize_rcu is waiting for
+ * readers.  Written under rcu_sync_lock.  It lets concurrent callers of
+ * synchronize_rcu share a single grace period.
+ */
+static unsigned long rcu_gp_seq;
+
 /*
  * Check whether a quiescent state was crossed between the beginning of
  * update_counter_and_wait and now.
@@ -142,7 +149,23 @@ static void wait_for_readers(void)
 
 void synchronize_rcu(void)
 {
+    unsigned long snap;
+
+    /* Any grace period that starts after the sequence number is read
+     * covers the caller's earlier updates.  If one is in progress now,
+     * it may have started too early, so the next one is needed: round
+     * up to the end of the second grace period in that case.
+     */
+    smp_mb();
+    snap = (atomic_read(&rcu_gp_seq) + 3) & ~1UL;
+
     qemu_mutex_lock(&rcu_sync_lock);
+    if ((long)(rcu_gp_seq - snap) >= 0) {
+        /* Somebody else did the work while we waited for the lock.  */
+        qemu_mutex_unlock(&rcu_sync_lock);
+        return;
+    }
+    atomic_set(&rcu_gp_seq, rcu_gp_seq + 1);
 
     /* Write RCU-protected pointers before reading p_rcu_reader->ctr.
      * Pairs with smp_mb_placeholder() in rcu_read_lock().
@@ -172,30 +195,49 @@ void synchronize_rcu(void)
     }
 
     qemu_mutex_unlock(&rcu_registry_lock);
+    atomic_store_release(&rcu_gp_seq, rcu_gp_seq + 1);
     qemu_mutex_unlock(&rcu_sync_lock);
 }
 
 
 #define RCU_CALL_MIN_SIZE        30
+#define RCU_CALL_QUEUES          8
 
 /* Multi-producer, single-consumer queue based on urcu/static/wfqueue.h
  * from liburcu.  Note that head is only used by the consumer.
+ *
+ * Producers are spread over several queues, so that bursts of call_rcu
+ * from different threads (for example TB invalidation in vCPU threads)
+ * do not all bounce the same tail and counter cache line.  Each thread
+ * always uses the same queue, so its callbacks still run in order.
  */
-static struct rcu_head dummy;
-static struct rcu_head *head = &dummy, **tail = &dummy.next;
-static int rcu_call_count;
+typedef struct RCUCallQueue {
+    /* Written by producers */
+    struct rcu_head **tail;
+    int count;
+
+    /* Used by the consumer only */
+    struct rcu_head *head QEMU_ALIGNED(64);
+    struct rcu_head dummy;
+} QEMU_ALIGNED(64) RCUCallQueue;
+
+static RCUCallQueue rcu_call_queues[RCU_CALL_QUEUES];
+
+static unsigned int rcu_call_queue_next;
+static __thread RCUCallQueue *rcu_call_queue;
+
 static QemuEvent rcu_call_ready_event;
 
-static void enqueue(struct rcu_head *node)
+static void enqueue(RCUCallQueue *q, struct rcu_head *node)
 {
     struct rcu_head **old_tail;
 
     node->next = NULL;
-    old_tail = atomic_xchg(&tail, &node->next);
+    old_tail = atomic_xchg(&q->tail, &node->next);
     atomic_mb_set(old_tail, node);
 }
 
-static struct rcu_head *try_dequeue(void)
+static struct rcu_head *try_dequeue(RCUCallQueue *q)
 {
     struct rcu_head *node, *next;
 
@@ -206,15 +248,15 @@ retry:
      * The tail, because it is the first step in the enqueuing.
      * It is only the next pointers that might be inconsistent.
      */
-    if (head == &dummy && atomic_mb_read(&tail) == &dummy.next) {
+    if (q->head == &q->dummy && atomic_mb_read(&q->tail) == &q->dummy.next) {
         abort();
     }
 
     /* If the head node has NULL in its next pointer, the value is
      * wrong and we need to wait until its enqueuer finishes the update.
      */
-    node = head;
-    next = atomic_mb_read(&head->next);
+    node = q->head;
+    next = atomic_mb_read(&q->head->next);
     if (!next) {
         return NULL;
     }
@@ -224,26 +266,38 @@ retry:
      * dummy node, and the one being removed.  So we do not need to update
      * the tail pointer.
      */
-    head = next;
+    q->head = next;
 
     /* If we dequeued the dummy node, add it back at the end and retry.  */
-    if (node == &dummy) {
-        enqueue(node);
+    if (node == &q->dummy) {
+        enqueue(q, node);
         goto retry;
     }
 
     return node;
 }
 
+static int rcu_call_count(void)
+{
+    int i, n = 0;
+
+    for (i = 0; i < RCU_CALL_QUEUES; i++) {
+        n += atomic_read(&rcu_call_queues[i].count);
+    }
+    return n;
+}
+
 static void *call_rcu_thread(void *opaque)
 {
     struct rcu_head *node;
+    int batch[RCU_CALL_QUEUES];
+    int i;
 
     rcu_register_thread();
 
     for (;;) {
         int tries = 0;
-        int n = atomic_read(&rcu_call_count);
+        int n = rcu_call_count();
 
         /* Heuristically wait for a decent number of callbacks to pile up.
          * Fetch rcu_call_count now, we only must process elements that were
@@ -253,7 +307,7 @@ static void *call_rcu_thread(void *opaque)
             g_usleep(10000);
             if (n == 0) {
                 qemu_event_reset(&rcu_call_ready_event);
-                n = atomic_read(&rcu_call_count);
+                n = rcu_call_count();
                 if (n == 0) {
 #if defined(CONFIG_MALLOC_TRIM)
                     malloc_trim(4 * 1024 * 1024);
@@ -261,27 +315,35 @@ static void *call_rcu_thread(void *opaque)
                     qemu_event_wait(&rcu_call_ready_event);
                 }
             }
-            n = atomic_read(&rcu_call_count);
+            n = rcu_call_count();
         }
 
-        atomic_sub(&rcu_call_count, n);
+        /* One grace period covers everything queued so far.  */
+        for (i = 0; i < RCU_CALL_QUEUES; i++) {
+            batch[i] = atomic_read(&rcu_call_queues[i].count);
+            atomic_sub(&rcu_call_queues[i].count, batch[i]);
+        }
         synchronize_rcu();
         qemu_mutex_lock_iothread();
-        while (n > 0) {
-            node = try_dequeue();
-            while (!node) {
-                qemu_mutex_unlock_iothread();
-                qemu_event_reset(&rcu_call_ready_event);
-                node = try_dequeue();
-                if (!node) {
-                    qemu_event_wait(&rcu_call_ready_event);
-                    node = try_dequeue();
+        for (i = 0; i < RCU_CALL_QUEUES; i++) {
+            RCUCallQueue *q = &rcu_call_queues[i];
+
+            while (batch[i] > 0) {
+                node = try_dequeue(q);
+                while (!node) {
+                    qemu_mutex_unlock_iothread();
+                    qemu_event_reset(&rcu_call_ready_event);
+                    node = try_dequeue(q);
+                    if (!node) {
+                        qemu_event_wait(&rcu_call_ready_event);
+                        node = try_dequeue(q);
+                    }
+                    qemu_mutex_lock_iothread();
                 }
-                qemu_mutex_lock_iothread();
-            }
 
-            n--;
-            node->func(node);
+                batch[i]--;
+                node->func(node);
+            }
         }
         qemu_mutex_unlock_iothread();
     }
@@ -290,9 +352,16 @@ static void *call_rcu_thread(void *opaque)
 
 void call_rcu1(struct rcu_head *node, void (*func)(struct rcu_head *node))
 {
+    RCUCallQueue *q = rcu_call_queue;
+
+    if (unlikely(!q)) {
+        unsigned int idx = atomic_fetch_inc(&rcu_call_queue_next);
+        q = rcu_call_queue = &rcu_call_queues[idx % RCU_CALL_QUEUES];
+    }
+
     node->func = func;
-    enqueue(node);
-    atomic_inc(&rcu_call_count);
+    enqueue(q, node);
+    atomic_inc(&q->count);
     qemu_event_set(&rcu_call_ready_event);
 }
 
@@ -314,6 +383,7 @@ void rcu_unregister_thread(void)
 static void rcu_init_complete(void)
 {
     QemuThread thread;
+    int i;
 
     qemu_mutex_init(&rcu_registry_lock);
     qemu_mutex_init(&rcu_sync_lock);
@@ -321,6 +391,15 @@ static void rcu_init_complete(void)
 
     qemu_event_init(&rcu_call_ready_event, false);
 
+    for (i = 0; i < RCU_CALL_QUEUES; i++) {
+        RCUCallQueue *q = &rcu_call_queues[i];
+
+        if (!q->head) {
+            q->head = &q->dummy;
+            q->tail = &q->dummy.next;
+        }
+    }
+
     /* The caller is assumed to have iothread lock, so the call_rcu thread
      * must have been quiescent even after forking, just recreate it.
      */
@@ -49,6 +49,12 @@ struct ThreadPoolElement {
     /* Access to this list is protected by lock.  */
     QTAILQ_ENTRY(ThreadPoolElement) reqs;
 
+    /* Pushed atomically once the element is THREAD_DONE.  */
+    QSLIST_ENTRY(ThreadPoolElement) done_next;
+
+    /* Only accessed from pool->ctx.  */
+    QSIMPLEQ_ENTRY(ThreadPoolElement) done_entry;
+
     /* Access to this list is protected by the global mutex.  */
     QLIST_ENTRY(ThreadPoolElement) all;
 };
@@ -62,8 +68,12 @@ struct ThreadPool {
     int max_threads;
     QEMUBH *new_thread_bh;
 
+    /* Completed requests, pushed by the workers without taking lock.  */
+    QSLIST_HEAD(, ThreadPoolElement) done_reqs;
+
     /* The following variables are only accessed from one AioContext. */
     QLIST_HEAD(, ThreadPoolElement) head;
+    QSIMPLEQ_HEAD(, ThreadPoolElement) done_list;
 
     /* The following variables are protected by lock.  */
     QTAILQ_HEAD(, ThreadPoolElement) request_list;
@@ -74,6 +84,15 @@ struct ThreadPool {
     bool stopping;
 };
 
+/* Hand a THREAD_DONE element over to the completion bottom half.  The
+ * atomic push also orders the writes to ret and state before it.
+ */
+static void thread_pool_push_done(ThreadPool *pool, ThreadPoolElement *req)
+{
+    QSLIST_INSERT_HEAD_ATOMIC(&pool->done_reqs, req, done_next);
+    qemu_bh_schedule(pool->completion_bh);
+}
+
 static void *worker_thread(void *opaque)
 {
     ThreadPool *pool = opaque;
@@ -109,9 +128,9 @@ static void *worker_thread(void *opaque)
         smp_wmb();
         req->state = THREAD_DONE;
 
-        qemu_mutex_lock(&pool->lock);
+        thread_pool_push_done(pool, req);
 
-        qemu_bh_schedule(pool->completion_bh);
+        qemu_mutex_lock(&pool->lock);
     }
 
     pool->cur_threads--;
@@ -160,17 +179,39 @@ static void spawn_thread(ThreadPool *pool)
     }
 }
 
+/* Move the requests completed so far to done_list, oldest first.  */
+static void thread_pool_collect_done(ThreadPool *pool)
+{
+    QSLIST_HEAD(, ThreadPoolElement) batch;
+    QSIMPLEQ_HEAD(, ThreadPoolElement) ordered;
+    ThreadPoolElement *elem;
+
+    QSLIST_MOVE_ATOMIC(&batch, &pool->done_reqs);
+
+    /* The lock-free list is LIFO, reverse it */
+    QSIMPLEQ_INIT(&ordered);
+    while ((elem = QSLIST_FIRST(&batch))) {
+        QSLIST_REMOVE_HEAD(&batch, done_next);
+        QSIMPLEQ_INSERT_HEAD(&ordered, elem, done_entry);
+    }
+    QSIMPLEQ_CONCAT(&pool->done_list, &ordered);
+}
+
 static void thread_pool_completion_bh(void *opaque)
 {
     ThreadPool *pool = opaque;
-    ThreadPoolElement *elem, *next;
+    ThreadPoolElement *elem;
 
     aio_context_acquire(pool->ctx);
-restart:
-    QLIST_FOREACH_SAFE(elem, &pool->head, all, next) {
-        if (elem->state != THREAD_DONE) {
-            continue;
+    for (;;) {
+        /* Only look at completed requests instead of walking all of them */
+        thread_pool_collect_done(pool);
+        elem = QSIMPLEQ_FIRST(&pool->done_list);
+        if (!elem) {
+            break;
         }
+        QSIMPLEQ_REMOVE_HEAD(&pool->done_list, done_entry);
+        assert(elem->state == THREAD_DONE);
 
         trace_thread_pool_complete(pool, elem, elem->common.opaque,
                                    elem->ret);
@@ -190,16 +231,12 @@ restart:
             aio_context_acquire(pool->ctx);
 
             /* We can safely cancel the completion_bh here regardless of someone
-             * else having scheduled it meanwhile because we reenter the
-             * completion function anyway (goto restart).
+             * else having scheduled it meanwhile because the loop collects
+             * newly completed requests before looking for the next one.
              */
             qemu_bh_cancel(pool->completion_bh);
-
-            qemu_aio_unref(elem);
-            goto restart;
-        } else {
-            qemu_aio_unref(elem);
         }
+        qemu_aio_unref(elem);
     }
     aio_context_release(pool->ctx);
 }
@@ -220,10 +257,10 @@ static void thread_pool_cancel(BlockAIOCB *acb)
          */
         qemu_sem_timedwait(&pool->sem, 0) == 0) {
         QTAILQ_REMOVE(&pool->request_list, elem, reqs);
-        qemu_bh_schedule(pool->completion_bh);
 
         elem->state = THREAD_DONE;
         elem->ret = -ECANCELED;
+        thread_pool_push_done(pool, elem);
     }
 
     qemu_mutex_unlock(&pool->lock);
@@ -311,7 +348,9 @@ static void thread_pool_init_one(ThreadPool *pool, AioContext *ctx)
     pool->max_threads = 64;
     pool->new_thread_bh = aio_bh_new(ctx, spawn_thread_bh_fn, pool);
 
+    QSLIST_INIT(&pool->done_reqs);
     QLIST_INIT(&pool->head);
+    QSIMPLEQ_INIT(&pool->done_list);
     QTAILQ_INIT(&pool->request_list);
 }
 
@@ -450,23 +450,33 @@ bool throttle_schedule_timer(ThrottleState *ts,
  * @is_write: the type of operation (read/write)
  * @size:     the size of the operation
  */
-void throttle_account(ThrottleState *ts, bool is_write, uint64_t size)
+static const BucketType bucket_types_size[2][2] = {
+    { THROTTLE_BPS_TOTAL, THROTTLE_BPS_READ },
+    { THROTTLE_BPS_TOTAL, THROTTLE_BPS_WRITE }
+};
+static const BucketType bucket_types_units[2][2] = {
+    { THROTTLE_OPS_TOTAL, THROTTLE_OPS_READ },
+    { THROTTLE_OPS_TOTAL, THROTTLE_OPS_WRITE }
+};
+
+/* Return the number of operations that an I/O of @size bytes counts as
+ *
+ * @op_size: the op_size field of the ThrottleConfig, or 0
+ * @size:    the size of the operation
+ */
+double throttle_op_units(uint64_t op_size, uint64_t size)
 {
-    const BucketType bucket_types_size[2][2] = {
-        { THROTTLE_BPS_TOTAL, THROTTLE_BPS_READ },
-        { THROTTLE_BPS_TOTAL, THROTTLE_BPS_WRITE }
-    };
-    const BucketType bucket_types_units[2][2] = {
-        { THROTTLE_OPS_TOTAL, THROTTLE_OPS_READ },
-        { THROTTLE_OPS_TOTAL, THROTTLE_OPS_WRITE }
-    };
-    double units = 1.0;
-    unsigned i;
-
     /* if cfg.op_size is defined and smaller than size we compute unit count */
-    if (ts->cfg.op_size && size > ts->cfg.op_size) {
-        units = (double) size / ts->cfg.op_size;
+    if (op_size && size > op_size) {
+        return (double) size / op_size;
     }
+    return 1.0;
+}
+
+void throttle_account(ThrottleState *ts, bool is_write, uint64_t size)
+{
+    double units = throttle_op_units(ts->cfg.op_size, size);
+    unsigned i;
 
     for (i = 0; i < 2; i++) {
         LeakyBucket *bkt;
@@ -485,6 +495,72 @@ void throttle_account(ThrottleState *ts, bool is_write, uint64_t size)
     }
 }
 
+/* Compute the budget that the configured average rates for a type of
+ * operation grant in a period of time.  Limits that are not configured
+ * leave the corresponding value unchanged, so the caller initializes
+ * @units and @bytes with the largest budget it wants.
+ *
+ * @is_write: the type of operation (read/write)
+ * @ns:       the length of the period
+ * @units:    the number of operations, updated in place
+ * @bytes:    the number of bytes, updated in place
+ */
+void throttle_budget(ThrottleState *ts, bool is_write, int64_t ns,
+                     double *units, double *bytes)
+{
+    unsigned i;
+
+    for (i = 0; i < 2; i++) {
+        LeakyBucket *bkt;
+
+        bkt = &ts->cfg.buckets[bucket_types_size[is_write][i]];
+        if (bkt->avg) {
+            *bytes = MIN(*bytes,
+                         (double) bkt->avg * ns / NANOSECONDS_PER_SECOND);
+        }
+
+        bkt = &ts->cfg.buckets[bucket_types_units[is_write][i]];
+        if (bkt->avg) {
+            *units = MIN(*units,
+                         (double) bkt->avg * ns / NANOSECONDS_PER_SECOND);
+        }
+    }
+}
+
+/* Account (or, with negative values, give back) a budget obtained with
+ * throttle_budget() in the configured buckets.  Levels never drop below
+ * zero.
+ *
+ * @is_write: the type of operation (read/write)
+ * @units:    the number of operations
+ * @bytes:    the number of bytes
+ */
+void throttle_account_budget(ThrottleState *ts, bool is_write,
+                             double units, double bytes)
+{
+    unsigned i;
+
+    for (i = 0; i < 2; i++) {
+        LeakyBucket *bkt;
+
+        bkt = &ts->cfg.buckets[bucket_types_size[is_write][i]];
+        if (bkt->avg) {
+            bkt->level = MAX(bkt->level + bytes, 0);
+            if (bkt->burst_length > 1) {
+                bkt->burst_level = MAX(bkt->burst_level + bytes, 0);
+            }
+        }
+
+        bkt = &ts->cfg.buckets[bucket_types_units[is_write][i]];
+        if (bkt->avg) {
+            bkt->level = MAX(bkt->level + units, 0);
+            if (bkt->burst_length > 1) {
+                bkt->burst_level = MAX(bkt->burst_level + units, 0);
+            }
+        }
+    }
+}
+
 /* return a ThrottleConfig based on the options in a ThrottleLimits
  *
  * @arg:    the ThrottleLimits object to read from
@@ -120,6 +120,7 @@ int main(int argc, char **argv)
 #include "qapi/clone-visitor.h"
 #include "qom/object_interfaces.h"
 #include "exec/semihost.h"
+#include "exec/tb-profile.h"
 #include "crypto/init.h"
 #include "sysemu/replay.h"
 #include "qapi/qapi-events-run-state.h"
@@ -304,6 +305,11 @@ static QemuOptsList qemu_accel_opts = {
             .type = QEMU_OPT_STRING,
             .help = "Enable/disable multi-threaded TCG",
         },
+        {
+            .name = "superblocks",
+            .type = QEMU_OPT_BOOL,
+            .help = "Translate across direct jumps within a page",
+        },
         { /* end of list */ }
     },
 };
@@ -493,6 +499,9 @@ static QemuOptsList qemu_icount_opts = {
         }, {
             .name = "rrsnapshot",
             .type = QEMU_OPT_STRING,
+        }, {
+            .name = "rrperiod",
+            .type = QEMU_OPT_NUMBER,
         },
         { /* end of list */ }
     },
@@ -2907,6 +2916,23 @@ static void register_global_properties(MachineState *ms)
     user_register_global_props();
 }
 
+static int64_t startup_begin_ns, startup_last_ns;
+
+/*
+ * Emit the startup_phase trace event for the phase that just ended.
+ * Enable it with "-trace startup_phase" to see where startup time goes.
+ * Everything up to the initialization of the trace backends, including
+ * QOM type registration and option parsing, is reported as "options".
+ */
+static void startup_phase(const char *phase)
+{
+    int64_t now = get_clock();
+
+    trace_startup_phase(phase, (now - startup_last_ns) / SCALE_US,
+                        (now - startup_begin_ns) / SCALE_US);
+    startup_last_ns = now;
+}
+
 int main(int argc, char **argv, char **envp)
 {
     int i;
@@ -2950,6 +2976,7 @@ int main(int argc, char **argv, char **envp)
     QSIMPLEQ_HEAD(, BlockdevOptions_queue) bdo_queue
         = QSIMPLEQ_HEAD_INITIALIZER(bdo_queue);
 
+    startup_begin_ns = startup_last_ns = get_clock();
     module_call_init(MODULE_INIT_TRACE);
 
     qemu_init_cpu_list();
@@ -3293,6 +3320,20 @@ int main(int argc, char **argv, char **envp)
             case QEMU_OPTION_singlestep:
                 singlestep = 1;
                 break;
+#ifdef CONFIG_TCG
+            case QEMU_OPTION_perfmap:
+                if (!tb_profile_perfmap_open(&err)) {
+                    error_report_err(err);
+                    exit(1);
+                }
+                break;
+            case QEMU_OPTION_perf_jitdump:
+                if (!tb_profile_jitdump_open(optarg, &err)) {
+                    error_report_err(err);
+                    exit(1);
+                }
+                break;
+#endif
             case QEMU_OPTION_S:
                 autostart = 0;
                 break;
@@ -4058,6 +4099,7 @@ int main(int argc, char **argv, char **envp)
         exit(1);
     }
     trace_init_file(trace_file);
+    startup_phase("options");
 
     /* Open the logfile at this point and set the log mask if necessary.
      */
@@ -4295,6 +4337,7 @@ int main(int argc, char **argv, char **envp)
     }
 
     configure_accelerator(current_machine);
+    startup_phase("accel");
 
     if (!qtest_enabled() && machine_class->deprecation_reason) {
         error_report("Machine type '%s' is deprecated: %s",
@@ -4509,11 +4552,15 @@ int main(int argc, char **argv, char **envp)
     }
     parse_numa_opts(current_machine);
 
+    startup_phase("machine-opts");
+
     /* do monitor/qmp handling at preconfig state if requested */
     main_loop();
+    startup_phase("preconfig");
 
     /* from here on runstate is RUN_STATE_PRELAUNCH */
     machine_run_board_init(current_machine);
+    startup_phase("board");
 
     realtime_init();
 
@@ -4543,6 +4590,7 @@ int main(int argc, char **argv, char **envp)
                           device_init_func, NULL, NULL)) {
         exit(1);
     }
+    startup_phase("devices");
 
     cpu_synchronize_all_post_init();
 
@@ -4596,6 +4644,7 @@ int main(int argc, char **argv, char **envp)
      * when bus is created by qdev.c */
     qemu_register_reset(qbus_reset_all_fn, sysbus_get_default());
     qemu_run_machine_init_done_notifiers();
+    startup_phase("machine-done");
 
     if (rom_check_and_register_reset() != 0) {
         error_report("rom check and register reset failed");
@@ -4609,6 +4658,7 @@ int main(int argc, char **argv, char **envp)
        clock values from the log. */
     replay_checkpoint(CHECKPOINT_RESET);
     qemu_system_reset(SHUTDOWN_CAUSE_NONE);
+    startup_phase("reset");
     register_global_state();
     if (replay_mode != REPLAY_MODE_NONE) {
         replay_vmstate_init();
@@ -4640,6 +4690,7 @@ int main(int argc, char **argv, char **envp)
 
     accel_setup_post(current_machine);
     os_setup_post();
+    startup_phase("start");
 
     main_loop();
 